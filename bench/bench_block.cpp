@@ -0,0 +1,112 @@
+#include "../include/block/block.h"
+#include "../include/block/block_cache.h"
+#include "../include/consts.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// 写满一个 LSM_BLOCK_SIZE 大小的 block, keys 返回写入的全部 key
+std::shared_ptr<Block> make_block(std::vector<std::string> &keys) {
+  auto block = std::make_shared<Block>(LSM_BLOCK_SIZE);
+  char buf[32];
+  for (size_t i = 0;; i++) {
+    snprintf(buf, sizeof(buf), "key%013zu", i);
+    if (!block->add_entry(buf, std::string(64, 'v'), i + 1, false)) {
+      break;
+    }
+    keys.emplace_back(buf);
+  }
+  return block;
+}
+} // namespace
+
+// 解码一个完整的 block, 包括数据段的拷贝
+static void BM_BlockDecode(benchmark::State &state) {
+  std::vector<std::string> keys;
+  auto encoded = make_block(keys)->encode();
+  for (auto _ : state) {
+    auto block = Block::decode(encoded);
+    benchmark::DoNotOptimize(block);
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_BlockDecode);
+
+// 零拷贝解码, 对应 mmap 读取路径
+static void BM_BlockDecodeView(benchmark::State &state) {
+  std::vector<std::string> keys;
+  auto encoded = std::make_shared<std::vector<uint8_t>>(make_block(keys)->encode());
+  for (auto _ : state) {
+    auto block = Block::decode_view(encoded->data(), encoded->size(), encoded);
+    benchmark::DoNotOptimize(block);
+  }
+  state.SetBytesProcessed(state.iterations() * encoded->size());
+}
+BENCHMARK(BM_BlockDecodeView);
+
+// 在 block 内随机二分查找存在的 key
+static void BM_BlockGetIdxBinary(benchmark::State &state) {
+  std::vector<std::string> keys;
+  auto block = Block::decode(make_block(keys)->encode());
+  std::mt19937 rng(42);
+  std::shuffle(keys.begin(), keys.end(), rng);
+  size_t idx = 0;
+  for (auto _ : state) {
+    auto res = block->get_idx_binary(keys[idx], 0);
+    benchmark::DoNotOptimize(res);
+    idx = idx + 1 == keys.size() ? 0 : idx + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["entries"] = keys.size();
+}
+BENCHMARK(BM_BlockGetIdxBinary);
+
+// 多个线程并发查询同一个 BlockCache, range(0) 为分片的位数
+// 每 16 次查询中有一次写入, 模拟 cache 未命中后的回填
+static void BM_BlockCacheContention(benchmark::State &state) {
+  constexpr int kSstNum = 64;
+  constexpr int kBlockNum = 64;
+  static std::unique_ptr<BlockCache> cache;
+  static std::shared_ptr<Block> block;
+  if (state.thread_index() == 0) {
+    std::vector<std::string> keys;
+    block = make_block(keys);
+    size_t charge = BlockCache::get_charge(*block);
+    cache = std::make_unique<BlockCache>(charge * kSstNum * kBlockNum, 2,
+                                         state.range(0));
+    for (int sst_id = 0; sst_id < kSstNum; sst_id++) {
+      for (int block_id = 0; block_id < kBlockNum; block_id++) {
+        cache->put(sst_id, block_id, block);
+      }
+    }
+  }
+  std::mt19937 rng(state.thread_index());
+  for (auto _ : state) {
+    uint32_t r = rng();
+    int sst_id = r % kSstNum;
+    int block_id = (r >> 8) % kBlockNum;
+    if ((r >> 16) % 16 == 0) {
+      cache->put(sst_id, block_id, block);
+    } else {
+      benchmark::DoNotOptimize(cache->get(sst_id, block_id));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    cache.reset();
+    block.reset();
+  }
+}
+BENCHMARK(BM_BlockCacheContention)
+    ->ArgName("shard_bits")
+    ->Arg(0)
+    ->Arg(4)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,86 @@
+#include "../include/block/block_cache.h"
+#include "../include/consts.h"
+#include "../include/lsm/compact_iterator.h"
+#include "../include/sst/sst.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+// 两个 run: 新的 run 覆盖一半的 key, 其中部分为删除标记, 旧的 run 包含全部的 key
+// 只在第一次使用时生成, sst 文件位于当前目录下的 bench_compact_data 中
+const std::vector<std::vector<std::shared_ptr<SST>>> &two_runs() {
+  static const auto runs = [] {
+    std::string dir = "bench_compact_data";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    auto cache = std::make_shared<BlockCache>(1024, 2);
+    size_t next_id = 0;
+    auto build_run = [&](int step, uint64_t tranc_id) {
+      std::vector<std::shared_ptr<SST>> run;
+      SSTBuilder builder(LSM_BLOCK_SIZE, true);
+      char key[32];
+      for (int i = 0; i < 200000; i += step) {
+        snprintf(key, sizeof(key), "user%08d", i);
+        std::string value = step == 2 && i % 10 == 0
+                                ? ""
+                                : "value" + std::to_string(i * tranc_id);
+        builder.add(key, value, tranc_id);
+        if (builder.estimated_size() >= LSM_PER_MEM_SIZE_LIMIT) {
+          run.push_back(builder.build(
+              next_id, dir + "/sst_" + std::to_string(next_id), cache));
+          next_id++;
+          builder = SSTBuilder(LSM_BLOCK_SIZE, true);
+        }
+      }
+      run.push_back(builder.build(
+          next_id, dir + "/sst_" + std::to_string(next_id), cache));
+      next_id++;
+      return run;
+    };
+    return std::vector<std::vector<std::shared_ptr<SST>>>{build_run(2, 2),
+                                                          build_run(1, 1)};
+  }();
+  return runs;
+}
+
+// 完整地遍历一次 compact 的输出, range(0) 为 watermark, range(1) 为 bottommost
+template <typename Iterator> void scan_runs(benchmark::State &state) {
+  auto &runs = two_runs();
+  size_t num_entries = 0;
+  for (auto _ : state) {
+    num_entries = 0;
+    for (Iterator it(runs, state.range(0), state.range(1) != 0); it.is_valid();
+         ++it) {
+      benchmark::DoNotOptimize(it.key());
+      num_entries++;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_entries);
+}
+} // namespace
+
+// 基于堆的通用版本
+static void BM_CompactIteratorHeap(benchmark::State &state) {
+  scan_runs<CompactIterator>(state);
+}
+BENCHMARK(BM_CompactIteratorHeap)
+    ->ArgNames({"watermark", "bottommost"})
+    ->Args({0, 0})
+    ->Args({5, 0})
+    ->Args({5, 1});
+
+// 两个 run 的定长版本, 用于 full compact 和单个 L0 文件的 L0->L1 compact
+static void BM_CompactIteratorTwoRun(benchmark::State &state) {
+  scan_runs<TwoRunCompactIterator>(state);
+}
+BENCHMARK(BM_CompactIteratorTwoRun)
+    ->ArgNames({"watermark", "bottommost"})
+    ->Args({0, 0})
+    ->Args({5, 0})
+    ->Args({5, 1});
+
+BENCHMARK_MAIN();
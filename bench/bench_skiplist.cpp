@@ -0,0 +1,90 @@
+#include "../include/skiplist/skiplist.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// 16 字节定长的 key, shuffle 为 true 时打乱插入顺序
+std::vector<std::string> make_keys(size_t num, bool shuffle) {
+  std::vector<std::string> keys;
+  keys.reserve(num);
+  char buf[32];
+  for (size_t i = 0; i < num; i++) {
+    snprintf(buf, sizeof(buf), "%016zu", i);
+    keys.emplace_back(buf);
+  }
+  if (shuffle) {
+    std::mt19937 rng(42);
+    std::shuffle(keys.begin(), keys.end(), rng);
+  }
+  return keys;
+}
+
+const std::string kValue(100, 'v');
+} // namespace
+
+// 向空跳表中写入 range(0) 个 key, range(1) 为 1 时按随机顺序写入
+static void BM_SkipListPut(benchmark::State &state) {
+  auto keys = make_keys(state.range(0), state.range(1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto list = std::make_unique<SkipList>();
+    state.ResumeTiming();
+    for (size_t i = 0; i < keys.size(); i++) {
+      list->put(keys[i], kValue, i + 1);
+    }
+    state.PauseTiming();
+    list.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SkipListPut)
+    ->ArgNames({"num", "random"})
+    ->Args({1 << 10, 0})
+    ->Args({1 << 10, 1})
+    ->Args({1 << 16, 0})
+    ->Args({1 << 16, 1});
+
+// 在 range(0) 个 key 的跳表中随机查询存在的 key
+static void BM_SkipListGet(benchmark::State &state) {
+  auto keys = make_keys(state.range(0), true);
+  SkipList list;
+  for (size_t i = 0; i < keys.size(); i++) {
+    list.put(keys[i], kValue, i + 1);
+  }
+  size_t idx = 0;
+  for (auto _ : state) {
+    auto iter = list.get(keys[idx], 0);
+    benchmark::DoNotOptimize(iter);
+    idx = idx + 1 == keys.size() ? 0 : idx + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SkipListGet)->ArgName("num")->Arg(1 << 10)->Arg(1 << 16);
+
+// 多个线程并发写入同一个跳表, 每个线程写入不同的 key
+static void BM_SkipListConcurrentPut(benchmark::State &state) {
+  static std::unique_ptr<SkipList> list;
+  static const std::vector<std::string> keys = make_keys(1 << 20, true);
+  if (state.thread_index() == 0) {
+    list = std::make_unique<SkipList>();
+  }
+  // 循环开始前所有线程会在这里同步, 之后 list 已经初始化
+  size_t idx = state.thread_index();
+  for (auto _ : state) {
+    list->put(keys[idx % keys.size()], kValue, idx + 1);
+    idx += state.threads();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    list.reset();
+  }
+}
+BENCHMARK(BM_SkipListConcurrentPut)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,100 @@
+#include "../include/utils/blocked_bloom_filter.h"
+#include "../include/utils/bloom_filter.h"
+#include "../include/utils/hash.h"
+#include "../include/utils/xor_filter.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr size_t kKeyNum = 100000;
+
+// 前 kKeyNum 个 key 写入过滤器, 之后的 kKeyNum 个用于查询不存在的 key
+const std::vector<std::string> &keys() {
+  static std::vector<std::string> keys = [] {
+    std::vector<std::string> res;
+    char buf[32];
+    for (size_t i = 0; i < kKeyNum * 2; i++) {
+      snprintf(buf, sizeof(buf), "key%013zu", i);
+      res.emplace_back(buf);
+    }
+    return res;
+  }();
+  return keys;
+}
+
+std::shared_ptr<Filter> make_filter(FilterType type) {
+  std::vector<uint64_t> hashes;
+  for (size_t i = 0; i < kKeyNum; i++) {
+    hashes.push_back(hash64(keys()[i]));
+  }
+  switch (type) {
+  case FilterType::Bloom: {
+    auto bloom = std::make_shared<BloomFilter>(kKeyNum, 0.01);
+    for (size_t i = 0; i < kKeyNum; i++) {
+      bloom->add(keys()[i]);
+    }
+    return bloom;
+  }
+  case FilterType::BlockedBloom:
+    return BlockedBloomFilter::build(hashes, 10);
+  case FilterType::Xor8:
+    return XorFilter::build(std::move(hashes));
+  }
+  return nullptr;
+}
+
+// range(0) 为 FilterType, range(1) 为 1 时查询存在的 key
+void filter_possibly_contains(benchmark::State &state) {
+  auto filter = make_filter(static_cast<FilterType>(state.range(0)));
+  size_t base = state.range(1) ? 0 : kKeyNum;
+  size_t idx = 0;
+  size_t positive = 0;
+  for (auto _ : state) {
+    positive += filter->possibly_contains(keys()[base + idx]);
+    idx = idx + 1 == kKeyNum ? 0 : idx + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["positive_rate"] =
+      static_cast<double>(positive) / state.iterations();
+}
+} // namespace
+
+static void BM_BloomFilterPossiblyContains(benchmark::State &state) {
+  filter_possibly_contains(state);
+}
+BENCHMARK(BM_BloomFilterPossiblyContains)
+    ->ArgNames({"type", "hit"})
+    ->Args({static_cast<int>(FilterType::Bloom), 1})
+    ->Args({static_cast<int>(FilterType::Bloom), 0})
+    ->Args({static_cast<int>(FilterType::BlockedBloom), 1})
+    ->Args({static_cast<int>(FilterType::BlockedBloom), 0})
+    ->Args({static_cast<int>(FilterType::Xor8), 1})
+    ->Args({static_cast<int>(FilterType::Xor8), 0});
+
+// 批量查询, range(0) 为 FilterType, 每次查询 64 个不存在的 key
+static void BM_FilterPossiblyContainsBatch(benchmark::State &state) {
+  constexpr size_t kBatch = 64;
+  auto filter = make_filter(static_cast<FilterType>(state.range(0)));
+  std::vector<std::string_view> batch_keys;
+  std::vector<uint64_t> batch_hashes;
+  for (size_t i = 0; i < kBatch; i++) {
+    batch_keys.push_back(keys()[kKeyNum + i * 997 % kKeyNum]);
+    batch_hashes.push_back(hash64(batch_keys.back()));
+  }
+  uint8_t results[kBatch];
+  for (auto _ : state) {
+    filter->possibly_contains_batch(batch_keys, batch_hashes, results);
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_FilterPossiblyContainsBatch)
+    ->ArgName("type")
+    ->Arg(static_cast<int>(FilterType::Bloom))
+    ->Arg(static_cast<int>(FilterType::BlockedBloom))
+    ->Arg(static_cast<int>(FilterType::Xor8));
+
+BENCHMARK_MAIN();
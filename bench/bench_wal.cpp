@@ -0,0 +1,53 @@
+#include "../include/wal/record.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+namespace {
+// range(0) 条 put 记录, value 长度为 range(1)
+std::vector<Record> make_records(benchmark::State &state) {
+  std::vector<Record> records;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    records.push_back(Record::putRecord(i + 1, "key" + std::to_string(i),
+                                        std::string(state.range(1), 'v')));
+  }
+  return records;
+}
+} // namespace
+
+// 把一组记录编码为一个 WAL batch, 即每次写入 WAL 前的编码
+static void BM_RecordEncodeBatch(benchmark::State &state) {
+  auto records = make_records(state);
+  std::vector<uint8_t> dst;
+  for (auto _ : state) {
+    dst.clear();
+    Record::encode_batch(records, dst);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+  state.SetBytesProcessed(state.iterations() * dst.size());
+}
+BENCHMARK(BM_RecordEncodeBatch)
+    ->ArgNames({"records", "value_size"})
+    ->Args({1, 100})
+    ->Args({64, 100})
+    ->Args({64, 1024});
+
+// 恢复时的解码, 包括 crc32c 校验
+static void BM_RecordDecodeBatches(benchmark::State &state) {
+  auto records = make_records(state);
+  std::vector<uint8_t> encoded;
+  Record::encode_batch(records, encoded);
+  for (auto _ : state) {
+    auto res = Record::decode_batches(encoded.data(), encoded.size());
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_RecordDecodeBatches)
+    ->ArgNames({"records", "value_size"})
+    ->Args({64, 100})
+    ->Args({64, 1024});
+
+BENCHMARK_MAIN();
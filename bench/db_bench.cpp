@@ -0,0 +1,325 @@
+// db_bench 风格的整体性能测试, 例如:
+// db_bench --benchmarks=fillrandom,readrandom --num=1000000 --threads=4
+// 每个测试输出吞吐和单次操作延迟的 p50 / p99 / p999
+
+#include "../include/lsm/engine.h"
+#include "../include/utils/statistics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Flags {
+  std::string benchmarks = "fillseq,fillrandom,readrandom,seekrandom";
+  size_t num = 100000;    // key 的数量, 也是每个写入测试的总次数
+  size_t reads = 0;       // 读取测试的总次数, 为 0 时与 num 相同
+  size_t threads = 1;     // 每个测试的线程数
+  size_t value_size = 100;
+  size_t seek_nexts = 10; // seekrandom 每次 seek 之后的 next 次数
+  std::string db = "/tmp/toni_lsm_bench";
+  bool use_existing_db = false;
+  std::string compact = "full"; // full / leveled / tiered
+  bool statistics = false;      // 结束时输出引擎的统计信息
+  uint64_t seed = 301;
+};
+
+Flags flags;
+
+bool parse_flag(const std::string &arg) {
+  auto pos = arg.find('=');
+  if (arg.rfind("--", 0) != 0 || pos == std::string::npos) {
+    return false;
+  }
+  std::string name = arg.substr(2, pos - 2);
+  std::string value = arg.substr(pos + 1);
+  if (name == "benchmarks") {
+    flags.benchmarks = value;
+  } else if (name == "num") {
+    flags.num = std::stoull(value);
+  } else if (name == "reads") {
+    flags.reads = std::stoull(value);
+  } else if (name == "threads") {
+    flags.threads = std::max<size_t>(1, std::stoull(value));
+  } else if (name == "value_size") {
+    flags.value_size = std::stoull(value);
+  } else if (name == "seek_nexts") {
+    flags.seek_nexts = std::stoull(value);
+  } else if (name == "db") {
+    flags.db = value;
+  } else if (name == "use_existing_db") {
+    flags.use_existing_db = value != "0";
+  } else if (name == "compact") {
+    if (value != "full" && value != "leveled" && value != "tiered") {
+      return false;
+    }
+    flags.compact = value;
+  } else if (name == "statistics") {
+    flags.statistics = value != "0";
+  } else if (name == "seed") {
+    flags.seed = std::stoull(value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+CompactType compact_type() {
+  if (flags.compact == "leveled") {
+    return CompactType::LeveledCompact;
+  }
+  if (flags.compact == "tiered") {
+    return CompactType::TieredCompact;
+  }
+  return CompactType::FullCompact;
+}
+
+std::string make_key(uint64_t k) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llu", static_cast<unsigned long long>(k));
+  return buf;
+}
+
+// value 从一段随机数据中截取, 避免每次写入都生成随机数据
+class ValueGenerator {
+public:
+  explicit ValueGenerator(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    data_.resize(std::max<size_t>(1 << 20, flags.value_size * 2));
+    for (auto &c : data_) {
+      c = static_cast<char>(' ' + rng() % 95);
+    }
+  }
+
+  std::string next() {
+    if (pos_ + flags.value_size > data_.size()) {
+      pos_ = 0;
+    }
+    pos_ += flags.value_size;
+    return data_.substr(pos_ - flags.value_size, flags.value_size);
+  }
+
+private:
+  std::string data_;
+  size_t pos_ = 0;
+};
+
+// 每个线程的状态, 延迟以纳秒记录在线程自己的直方图中, 结束后再合并
+struct ThreadState {
+  size_t idx;
+  std::mt19937_64 rng;
+  ValueGenerator gen;
+  HistogramData hist;
+  size_t ops = 0;
+  size_t bytes = 0;
+  size_t found = 0;
+  bool is_writer = false; // readwhilewriting 中的写入线程, 不计入结果
+
+  explicit ThreadState(size_t idx)
+      : idx(idx), rng(flags.seed + idx), gen(flags.seed + idx) {}
+
+  // 执行一次操作并记录耗时
+  template <typename F> void timed(F &&op) {
+    auto start = std::chrono::steady_clock::now();
+    op();
+    auto end = std::chrono::steady_clock::now();
+    hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                 .count());
+    ops++;
+  }
+};
+
+class Benchmark {
+public:
+  Benchmark() { open(!flags.use_existing_db); }
+
+  void run() {
+    std::stringstream ss(flags.benchmarks);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+      if (name.empty()) {
+        continue;
+      }
+      if (name == "fillseq") {
+        run_threads(name, flags.threads, false,
+                    [this](ThreadState &s) { fill(s, true); });
+      } else if (name == "fillrandom") {
+        run_threads(name, flags.threads, false,
+                    [this](ThreadState &s) { fill(s, false); });
+      } else if (name == "readrandom") {
+        run_threads(name, flags.threads, false,
+                    [this](ThreadState &s) { read_random(s); });
+      } else if (name == "readwhilewriting") {
+        // 额外的一个线程持续随机写入, 直到全部读取线程结束
+        run_threads(name, flags.threads + 1, true, [this](ThreadState &s) {
+          s.is_writer ? write_until_done(s) : read_random(s);
+        });
+      } else if (name == "seekrandom") {
+        run_threads(name, flags.threads, false,
+                    [this](ThreadState &s) { seek_random(s); });
+      } else if (name == "flush") {
+        auto start = std::chrono::steady_clock::now();
+        lsm_->flush_all();
+        std::chrono::duration<double> secs =
+            std::chrono::steady_clock::now() - start;
+        printf("%-16s : %.3f secs\n", name.c_str(), secs.count());
+      } else {
+        fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+      }
+    }
+    if (flags.statistics) {
+      std::string info = lsm_->get_stats().to_string();
+      info.erase(std::remove(info.begin(), info.end(), '\r'), info.end());
+      printf("\n%s", info.c_str());
+    }
+  }
+
+private:
+  std::unique_ptr<LSM> lsm_;
+  std::atomic<size_t> readers_running_{0};
+
+  void open(bool fresh) {
+    if (fresh) {
+      std::filesystem::remove_all(flags.db);
+    }
+    lsm_ = std::make_unique<LSM>(flags.db, compact_type());
+  }
+
+  size_t reads() const { return flags.reads == 0 ? flags.num : flags.reads; }
+
+  void fill(ThreadState &s, bool seq) {
+    size_t per_thread = flags.num / flags.threads;
+    for (size_t i = 0; i < per_thread; i++) {
+      uint64_t k = seq ? s.idx * per_thread + i : s.rng() % flags.num;
+      std::string key = make_key(k);
+      std::string value = s.gen.next();
+      s.timed([&] { lsm_->put(key, value); });
+      s.bytes += key.size() + value.size();
+    }
+  }
+
+  void read_random(ThreadState &s) {
+    size_t per_thread = reads() / flags.threads;
+    for (size_t i = 0; i < per_thread; i++) {
+      std::string key = make_key(s.rng() % flags.num);
+      std::optional<std::string> value;
+      s.timed([&] { value = lsm_->get(key); });
+      if (value.has_value()) {
+        s.found++;
+        s.bytes += key.size() + value->size();
+      }
+    }
+    readers_running_.fetch_sub(1);
+  }
+
+  void write_until_done(ThreadState &s) {
+    while (readers_running_.load() > 0) {
+      lsm_->put(make_key(s.rng() % flags.num), s.gen.next());
+      s.ops++;
+    }
+  }
+
+  void seek_random(ThreadState &s) {
+    size_t per_thread = reads() / flags.threads;
+    for (size_t i = 0; i < per_thread; i++) {
+      std::string key = make_key(s.rng() % flags.num);
+      s.timed([&] {
+        auto iter = lsm_->new_iterator();
+        iter.seek(key);
+        if (iter.is_valid() && iter.key() == key) {
+          s.found++;
+        }
+        for (size_t j = 0; j < flags.seek_nexts && iter.is_valid(); j++) {
+          s.bytes += iter.key().size() + iter.value().size();
+          iter.next();
+        }
+      });
+    }
+  }
+
+  // 启动 thread_num 个线程执行 fn, with_writer 为 true 时 0 号线程为写入线程
+  void run_threads(const std::string &name, size_t thread_num,
+                   bool with_writer,
+                   const std::function<void(ThreadState &)> &fn) {
+    std::vector<std::unique_ptr<ThreadState>> states;
+    for (size_t i = 0; i < thread_num; i++) {
+      size_t idx = with_writer ? (i == 0 ? thread_num : i - 1) : i;
+      states.push_back(std::make_unique<ThreadState>(idx));
+      states.back()->is_writer = with_writer && i == 0;
+    }
+    readers_running_.store(thread_num - (with_writer ? 1 : 0));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto &state : states) {
+      threads.emplace_back([&fn, &state] { fn(*state); });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+
+    HistogramData hist;
+    size_t ops = 0, bytes = 0, found = 0, writes = 0;
+    for (auto &state : states) {
+      if (state->is_writer) {
+        writes += state->ops;
+        continue;
+      }
+      hist.merge(state->hist);
+      ops += state->ops;
+      bytes += state->bytes;
+      found += state->found;
+    }
+    report(name, secs.count(), hist, ops, bytes, found, writes);
+  }
+
+  void report(const std::string &name, double secs, const HistogramData &hist,
+              size_t ops, size_t bytes, size_t found, size_t writes) {
+    if (ops == 0) {
+      printf("%-16s : no operation\n", name.c_str());
+      return;
+    }
+    // 吞吐按总的墙上时间计算, 多线程时 micros/op 为平均到每个操作的时间
+    printf("%-16s : %10.3f micros/op %10.0f ops/sec %8.1f MB/s", name.c_str(),
+           secs * 1e6 / ops, ops / secs, bytes / 1048576.0 / secs);
+    if (name.find("read") != std::string::npos ||
+        name.find("seek") != std::string::npos) {
+      printf(" (%zu of %zu found)", found, ops);
+    }
+    if (writes > 0) {
+      printf(" (%zu writes)", writes);
+    }
+    printf("\n%-16s   latency(us): p50 = %.3f, p99 = %.3f, p999 = %.3f, "
+           "max = %.3f\n",
+           "", hist.percentile(50) / 1e3, hist.percentile(99) / 1e3,
+           hist.percentile(99.9) / 1e3, hist.max / 1e3);
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!parse_flag(argv[i])) {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  printf("keys: %zu, values: %zu bytes, threads: %zu, compact: %s\n",
+         flags.num, flags.value_size, flags.threads, flags.compact.c_str());
+  Benchmark bench;
+  bench.run();
+  return 0;
+}
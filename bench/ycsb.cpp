@@ -0,0 +1,712 @@
+// YCSB 风格的端到端测试, 可以直接测试嵌入的 LSM, 也可以通过 RESP 协议测试
+// server, 例如:
+// ycsb --backend=embedded --workload=a --records=1000000 --operations=1000000
+// ycsb --backend=redis --port=6379 --workload=b --threads=8
+// 运行期间每隔 --interval 秒输出一次区间吞吐以及区间内的写入阻塞和 compact,
+// 用于观察 compact 和写入阻塞造成的吞吐下降; 结束时输出每种操作的延迟分布
+//
+// 工作负载与 YCSB 的 core workloads 一致, 每条记录只有一个字段:
+// a: 50% read  50% update           zipfian
+// b: 95% read   5% update           zipfian
+// c: 100% read                      zipfian
+// d: 95% read   5% insert           latest
+// e: 95% scan   5% insert           zipfian
+// f: 50% read  50% read-modify-write zipfian
+
+#include "../include/lsm/engine.h"
+#include "../include/utils/statistics.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+enum class Op : size_t { Read, Update, Insert, Scan, ReadModifyWrite, Num };
+constexpr size_t kOpNum = static_cast<size_t>(Op::Num);
+const char *kOpNames[kOpNum] = {"READ", "UPDATE", "INSERT", "SCAN",
+                                "READ-MODIFY-WRITE"};
+
+enum class Distribution { Uniform, Zipfian, Latest };
+
+struct Flags {
+  std::string backend = "embedded"; // embedded / redis
+  std::string workload = "a";
+  size_t records = 100000;    // load 阶段写入的记录数
+  size_t operations = 100000; // run 阶段的操作总数
+  size_t threads = 1;
+  size_t value_size = 100;
+  size_t max_scan_length = 100; // scan 的长度在 [1, max_scan_length] 中均匀分布
+  std::optional<Distribution> distribution; // 为空时使用工作负载的默认分布
+  double zipfian_theta = 0.99;
+  double interval = 1.0; // 输出区间吞吐的间隔 (秒)
+  bool load = true;      // 是否执行 load 阶段
+  bool run = true;       // 是否执行 run 阶段
+  std::string db = "/tmp/toni_lsm_ycsb";
+  std::string host = "127.0.0.1";
+  int port = 6379;
+};
+
+Flags flags;
+
+// 各种操作所占的比例
+struct Workload {
+  double read = 0;
+  double update = 0;
+  double insert = 0;
+  double scan = 0;
+  double rmw = 0;
+  Distribution distribution = Distribution::Zipfian;
+};
+
+std::optional<Workload> make_workload(const std::string &name) {
+  if (name == "a") {
+    return Workload{.read = 0.5, .update = 0.5};
+  }
+  if (name == "b") {
+    return Workload{.read = 0.95, .update = 0.05};
+  }
+  if (name == "c") {
+    return Workload{.read = 1.0};
+  }
+  if (name == "d") {
+    return Workload{
+        .read = 0.95, .insert = 0.05, .distribution = Distribution::Latest};
+  }
+  if (name == "e") {
+    return Workload{.insert = 0.05, .scan = 0.95};
+  }
+  if (name == "f") {
+    return Workload{.read = 0.5, .rmw = 0.5};
+  }
+  return std::nullopt;
+}
+
+bool parse_flag(const std::string &arg) {
+  auto pos = arg.find('=');
+  if (arg.rfind("--", 0) != 0 || pos == std::string::npos) {
+    return false;
+  }
+  std::string name = arg.substr(2, pos - 2);
+  std::string value = arg.substr(pos + 1);
+  if (name == "backend") {
+    if (value != "embedded" && value != "redis") {
+      return false;
+    }
+    flags.backend = value;
+  } else if (name == "workload") {
+    if (!make_workload(value).has_value()) {
+      return false;
+    }
+    flags.workload = value;
+  } else if (name == "records") {
+    flags.records = std::max<size_t>(1, std::stoull(value));
+  } else if (name == "operations") {
+    flags.operations = std::stoull(value);
+  } else if (name == "threads") {
+    flags.threads = std::max<size_t>(1, std::stoull(value));
+  } else if (name == "value_size") {
+    flags.value_size = std::stoull(value);
+  } else if (name == "max_scan_length") {
+    flags.max_scan_length = std::max<size_t>(1, std::stoull(value));
+  } else if (name == "distribution") {
+    if (value == "uniform") {
+      flags.distribution = Distribution::Uniform;
+    } else if (value == "zipfian") {
+      flags.distribution = Distribution::Zipfian;
+    } else if (value == "latest") {
+      flags.distribution = Distribution::Latest;
+    } else {
+      return false;
+    }
+  } else if (name == "zipfian_theta") {
+    flags.zipfian_theta = std::stod(value);
+  } else if (name == "interval") {
+    flags.interval = std::stod(value);
+  } else if (name == "load") {
+    flags.load = value != "0";
+  } else if (name == "run") {
+    flags.run = value != "0";
+  } else if (name == "db") {
+    flags.db = value;
+  } else if (name == "host") {
+    flags.host = value;
+  } else if (name == "port") {
+    flags.port = std::stoi(value);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// 记录按序号排列, 热点 key 由 zipfian 的打散分布在整个 key 空间中
+std::string make_key(uint64_t k) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "user%016llu", static_cast<unsigned long long>(k));
+  return buf;
+}
+
+uint64_t fnv_hash64(uint64_t value) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < 8; i++) {
+    hash ^= value & 0xff;
+    hash *= 0x100000001b3ULL;
+    value >>= 8;
+  }
+  return hash;
+}
+
+// ****** 分布 ******
+
+// Gray 等人的 zipfian 生成器 (与 YCSB 的 ZipfianGenerator 相同), 返回
+// [0, n) 中的值, 越小的值越热; n 增大时增量地更新 zeta, 用于 latest 分布
+class ZipfianGenerator {
+public:
+  explicit ZipfianGenerator(double theta) : theta_(theta) {
+    zeta2_ = zeta(0, 2, 0);
+    alpha_ = 1.0 / (1.0 - theta_);
+  }
+
+  uint64_t next(uint64_t n, std::mt19937_64 &rng) {
+    if (n != n_) {
+      // 只会增大, 从上一次的结果继续累加
+      zetan_ = n > n_ ? zeta(n_, n, zetan_) : zeta(0, n, 0);
+      n_ = n;
+      eta_ = (1 - std::pow(2.0 / n_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * zetan_;
+    if (uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + std::pow(0.5, theta_)) {
+      return std::min<uint64_t>(1, n_ - 1);
+    }
+    auto res = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    return std::min(res, n_ - 1);
+  }
+
+private:
+  double theta_;
+  double alpha_;
+  double zeta2_;
+  double zetan_ = 0;
+  double eta_ = 0;
+  uint64_t n_ = 0;
+
+  double zeta(uint64_t from, uint64_t to, double init) const {
+    double sum = init;
+    for (uint64_t i = from; i < to; i++) {
+      sum += 1.0 / std::pow(i + 1, theta_);
+    }
+    return sum;
+  }
+};
+
+// 按分布选择一个已经写入的记录, key_num 为当前的记录数
+class KeyChooser {
+public:
+  KeyChooser(Distribution distribution)
+      : distribution_(distribution), zipfian_(flags.zipfian_theta) {}
+
+  uint64_t next(uint64_t key_num, std::mt19937_64 &rng) {
+    switch (distribution_) {
+    case Distribution::Uniform:
+      return rng() % key_num;
+    case Distribution::Zipfian:
+      // 热点集中在少数记录上, 打散后这些记录不会相邻
+      return fnv_hash64(zipfian_.next(flags.records, rng)) % key_num;
+    case Distribution::Latest:
+      return key_num - 1 - zipfian_.next(key_num, rng);
+    }
+    return 0;
+  }
+
+private:
+  Distribution distribution_;
+  ZipfianGenerator zipfian_;
+};
+
+// ****** 后端 ******
+
+class Backend {
+public:
+  virtual ~Backend() = default;
+  // 返回记录是否存在
+  virtual bool read(const std::string &key) = 0;
+  virtual void update(const std::string &key, const std::string &value) = 0;
+  virtual void insert(const std::string &key, const std::string &value) {
+    update(key, value);
+  }
+  // 从 start 开始读取至多 count 条记录
+  virtual void scan(const std::string &start, size_t count) = 0;
+  // INFO 格式的统计信息, 用于计算区间内的写入阻塞和 compact
+  virtual std::string info() = 0;
+};
+
+class EmbeddedBackend : public Backend {
+public:
+  explicit EmbeddedBackend(LSM &lsm) : lsm_(lsm) {}
+
+  bool read(const std::string &key) override {
+    return lsm_.get(key).has_value();
+  }
+  void update(const std::string &key, const std::string &value) override {
+    lsm_.put(key, value);
+  }
+  void scan(const std::string &start, size_t count) override {
+    auto iter = lsm_.new_iterator();
+    iter.seek(start);
+    for (size_t i = 0; i < count && iter.is_valid(); i++) {
+      iter.next();
+    }
+  }
+  std::string info() override { return lsm_.get_stats().to_string(); }
+
+private:
+  LSM &lsm_;
+};
+
+// 一个阻塞的 RESP 连接, 每个线程各自持有一个
+class RespClient {
+public:
+  RespClient(const std::string &host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addrs = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                    &addrs) != 0) {
+      throw std::runtime_error("Failed to resolve " + host);
+    }
+    for (auto *addr = addrs; addr != nullptr; addr = addr->ai_next) {
+      fd_ = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+      if (fd_ < 0) {
+        continue;
+      }
+      if (connect(fd_, addr->ai_addr, addr->ai_addrlen) == 0) {
+        break;
+      }
+      close(fd_);
+      fd_ = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd_ < 0) {
+      throw std::runtime_error("Failed to connect to " + host + ":" +
+                               std::to_string(port));
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  ~RespClient() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  RespClient(const RespClient &) = delete;
+  RespClient &operator=(const RespClient &) = delete;
+
+  // 发送一条命令并等待回复, 错误回复抛出异常
+  // 回复为 nil 时返回 nullopt, 为数组时返回数组的长度 (忽略其中的元素)
+  std::optional<std::string>
+  command(std::initializer_list<std::string_view> args) {
+    std::string req = "*" + std::to_string(args.size()) + "\r\n";
+    for (auto arg : args) {
+      req += "$" + std::to_string(arg.size()) + "\r\n";
+      req += arg;
+      req += "\r\n";
+    }
+    for (size_t sent = 0; sent < req.size();) {
+      ssize_t n = send(fd_, req.data() + sent, req.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        throw std::runtime_error("Failed to send request");
+      }
+      sent += n;
+    }
+    return read_reply();
+  }
+
+private:
+  int fd_ = -1;
+  std::string buf_;
+  size_t pos_ = 0;
+
+  void fill() {
+    if (pos_ > 0 && pos_ * 2 >= buf_.size()) {
+      buf_.erase(0, pos_);
+      pos_ = 0;
+    }
+    char tmp[16384];
+    ssize_t n = recv(fd_, tmp, sizeof(tmp), 0);
+    if (n <= 0) {
+      throw std::runtime_error("Connection closed by server");
+    }
+    buf_.append(tmp, n);
+  }
+
+  std::string read_line() {
+    size_t end;
+    while ((end = buf_.find("\r\n", pos_)) == std::string::npos) {
+      fill();
+    }
+    std::string line = buf_.substr(pos_, end - pos_);
+    pos_ = end + 2;
+    return line;
+  }
+
+  std::optional<std::string> read_reply() {
+    std::string line = read_line();
+    if (line.empty()) {
+      throw std::runtime_error("Invalid reply");
+    }
+    switch (line[0]) {
+    case '+':
+    case ':':
+      return line.substr(1);
+    case '-':
+      throw std::runtime_error("Server error: " + line.substr(1));
+    case '$': {
+      long long len = std::stoll(line.substr(1));
+      if (len < 0) {
+        return std::nullopt;
+      }
+      while (buf_.size() - pos_ < static_cast<size_t>(len) + 2) {
+        fill();
+      }
+      std::string value = buf_.substr(pos_, len);
+      pos_ += len + 2;
+      return value;
+    }
+    case '*': {
+      long long num = std::stoll(line.substr(1));
+      if (num < 0) {
+        return std::nullopt;
+      }
+      for (long long i = 0; i < num; i++) {
+        read_reply();
+      }
+      return std::to_string(num);
+    }
+    default:
+      throw std::runtime_error("Invalid reply: " + line);
+    }
+  }
+};
+
+class RedisBackend : public Backend {
+public:
+  RedisBackend() : client_(flags.host, flags.port) {}
+
+  bool read(const std::string &key) override {
+    return client_.command({"GET", key}).has_value();
+  }
+  void update(const std::string &key, const std::string &value) override {
+    client_.command({"SET", key, value});
+  }
+  // SCAN 的游标是起点 key 的十六进制编码, 一次 SCAN 最多返回 count 个 key
+  void scan(const std::string &start, size_t count) override {
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string cursor;
+    for (unsigned char c : start) {
+      cursor.push_back(kHex[c >> 4]);
+      cursor.push_back(kHex[c & 0xf]);
+    }
+    client_.command({"SCAN", cursor, "COUNT", std::to_string(count)});
+  }
+  std::string info() override { return client_.command({"INFO"}).value_or(""); }
+
+private:
+  RespClient client_;
+};
+
+std::unique_ptr<LSM> embedded_lsm;
+
+std::unique_ptr<Backend> make_backend() {
+  if (flags.backend == "redis") {
+    return std::make_unique<RedisBackend>();
+  }
+  return std::make_unique<EmbeddedBackend>(*embedded_lsm);
+}
+
+// 从 INFO 中读取写入阻塞和 compact 的累计值
+struct EngineSample {
+  uint64_t stall_count = 0;
+  uint64_t stall_micros = 0;
+  uint64_t flushes = 0;
+  uint64_t compactions = 0;
+};
+
+EngineSample parse_info(const std::string &info) {
+  EngineSample sample;
+  std::istringstream iss(info);
+  std::string line;
+  auto field = [&](const char *prefix, uint64_t &dst) {
+    size_t len = strlen(prefix);
+    if (line.compare(0, len, prefix) == 0) {
+      dst = std::stoull(line.substr(len));
+    }
+  };
+  while (std::getline(iss, line)) {
+    field("stall_count:", sample.stall_count);
+    field("stall_micros:", sample.stall_micros);
+    field("flush_micros:count=", sample.flushes);
+    field("compaction_micros:count=", sample.compactions);
+  }
+  return sample;
+}
+
+// ****** 执行 ******
+
+struct ThreadState {
+  size_t idx;
+  std::mt19937_64 rng;
+  std::unique_ptr<Backend> backend;
+  std::unique_ptr<KeyChooser> chooser; // run 阶段第一次使用时创建
+  std::array<HistogramData, kOpNum> hists; // 纳秒
+  std::atomic<uint64_t> ops{0};            // 由输出区间吞吐的线程读取
+  std::string value_buf;
+
+  explicit ThreadState(size_t idx)
+      : idx(idx), rng(301 + idx), backend(make_backend()) {
+    value_buf.resize(std::max<size_t>(1 << 16, flags.value_size * 2));
+    for (auto &c : value_buf) {
+      c = static_cast<char>('a' + rng() % 26);
+    }
+  }
+
+  std::string value() {
+    size_t offset = rng() % (value_buf.size() - flags.value_size + 1);
+    return value_buf.substr(offset, flags.value_size);
+  }
+
+  template <typename F> void timed(Op op, F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    hists[static_cast<size_t>(op)].add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    ops.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+class Runner {
+public:
+  Runner() : workload_(make_workload(flags.workload).value()) {
+    if (flags.distribution.has_value()) {
+      workload_.distribution = flags.distribution.value();
+    }
+  }
+
+  void load() {
+    // insert 的序号由全部线程共享, 保证 key 不重复
+    next_insert_.store(0);
+    execute("load", flags.records, [this](ThreadState &s, size_t) {
+      uint64_t k = next_insert_.fetch_add(1);
+      if (k >= flags.records) {
+        return;
+      }
+      auto key = make_key(k);
+      auto value = s.value();
+      s.timed(Op::Insert, [&] { s.backend->insert(key, value); });
+    });
+  }
+
+  void run() {
+    next_insert_.store(flags.records);
+    execute("run", flags.operations, [this](ThreadState &s, size_t) {
+      run_one(s);
+    });
+  }
+
+private:
+  Workload workload_;
+  std::atomic<uint64_t> next_insert_{0};
+  // 已经完成的 insert 之后的序号, 读取只选择这之前的记录
+  std::atomic<uint64_t> key_num_{0};
+
+  void run_one(ThreadState &s) {
+    if (!s.chooser) {
+      s.chooser = std::make_unique<KeyChooser>(workload_.distribution);
+    }
+    auto &chooser = s.chooser;
+    uint64_t key_num = std::max<uint64_t>(
+        flags.records, key_num_.load(std::memory_order_relaxed));
+    double r = std::uniform_real_distribution<double>(0, 1)(s.rng);
+    if ((r -= workload_.read) < 0) {
+      auto key = make_key(chooser->next(key_num, s.rng));
+      s.timed(Op::Read, [&] { s.backend->read(key); });
+    } else if ((r -= workload_.update) < 0) {
+      auto key = make_key(chooser->next(key_num, s.rng));
+      auto value = s.value();
+      s.timed(Op::Update, [&] { s.backend->update(key, value); });
+    } else if ((r -= workload_.insert) < 0) {
+      uint64_t k = next_insert_.fetch_add(1);
+      auto key = make_key(k);
+      auto value = s.value();
+      s.timed(Op::Insert, [&] { s.backend->insert(key, value); });
+      // 并发的 insert 可能乱序完成, 这里只保证 key_num_ 之前的大部分记录存在
+      uint64_t cur = key_num_.load();
+      while (cur < k + 1 && !key_num_.compare_exchange_weak(cur, k + 1)) {
+      }
+    } else if ((r -= workload_.scan) < 0) {
+      auto key = make_key(chooser->next(key_num, s.rng));
+      size_t len = 1 + s.rng() % flags.max_scan_length;
+      s.timed(Op::Scan, [&] { s.backend->scan(key, len); });
+    } else {
+      auto key = make_key(chooser->next(key_num, s.rng));
+      auto value = s.value();
+      s.timed(Op::ReadModifyWrite, [&] {
+        s.backend->read(key);
+        s.backend->update(key, value);
+      });
+    }
+  }
+
+  // 用 flags.threads 个线程执行 total 次 fn, 同时输出区间吞吐
+  template <typename F>
+  void execute(const char *phase, size_t total, F &&fn) {
+    std::vector<std::unique_ptr<ThreadState>> states;
+    for (size_t i = 0; i < flags.threads; i++) {
+      states.push_back(std::make_unique<ThreadState>(i));
+    }
+    auto info_backend = make_backend();
+    printf("[%s] %zu threads, %zu operations\n", phase, flags.threads, total);
+
+    std::atomic<size_t> running{flags.threads};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < flags.threads; i++) {
+      size_t num = total / flags.threads + (i < total % flags.threads);
+      threads.emplace_back([&, i, num] {
+        for (size_t j = 0; j < num; j++) {
+          fn(*states[i], j);
+        }
+        running.fetch_sub(1);
+      });
+    }
+
+    // 每个区间输出一行: 经过的秒数, 区间吞吐, 区间内的写入阻塞和 flush/compact
+    auto last_time = start;
+    uint64_t last_ops = 0;
+    auto last_sample = parse_info(info_backend->info());
+    auto interval = std::chrono::duration<double>(flags.interval);
+    while (running.load() > 0) {
+      auto deadline = last_time + interval;
+      while (running.load() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      auto now = std::chrono::steady_clock::now();
+      uint64_t ops = 0;
+      for (auto &state : states) {
+        ops += state->ops.load(std::memory_order_relaxed);
+      }
+      auto sample = parse_info(info_backend->info());
+      std::chrono::duration<double> secs = now - last_time;
+      std::chrono::duration<double> elapsed = now - start;
+      printf("[%s] %8.1f sec: %10.0f ops/sec, %zu ops, stalls = %llu "
+             "(%llu us), flushes = %llu, compactions = %llu\n",
+             phase, elapsed.count(), (ops - last_ops) / secs.count(),
+             static_cast<size_t>(ops),
+             static_cast<unsigned long long>(sample.stall_count -
+                                             last_sample.stall_count),
+             static_cast<unsigned long long>(sample.stall_micros -
+                                             last_sample.stall_micros),
+             static_cast<unsigned long long>(sample.flushes -
+                                             last_sample.flushes),
+             static_cast<unsigned long long>(sample.compactions -
+                                             last_sample.compactions));
+      fflush(stdout);
+      last_time = now;
+      last_ops = ops;
+      last_sample = sample;
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    report(phase, secs.count(), states);
+  }
+
+  void report(const char *phase, double secs,
+              const std::vector<std::unique_ptr<ThreadState>> &states) {
+    uint64_t total = 0;
+    std::array<HistogramData, kOpNum> hists;
+    for (auto &state : states) {
+      for (size_t i = 0; i < kOpNum; i++) {
+        hists[i].merge(state->hists[i]);
+      }
+      total += state->ops.load();
+    }
+    printf("[%s] overall: %.3f sec, %llu ops, %.0f ops/sec\n", phase, secs,
+           static_cast<unsigned long long>(total), total / secs);
+    for (size_t i = 0; i < kOpNum; i++) {
+      auto &hist = hists[i];
+      if (hist.count == 0) {
+        continue;
+      }
+      printf("[%s] %-18s count = %llu, avg = %.3f, p50 = %.3f, p99 = %.3f, "
+             "p999 = %.3f, max = %.3f (us)\n",
+             phase, kOpNames[i], static_cast<unsigned long long>(hist.count),
+             hist.mean() / 1e3, hist.percentile(50) / 1e3,
+             hist.percentile(99) / 1e3, hist.percentile(99.9) / 1e3,
+             hist.max / 1e3);
+    }
+  }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!parse_flag(argv[i])) {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+  try {
+    if (flags.backend == "embedded") {
+      if (flags.load) {
+        std::filesystem::remove_all(flags.db);
+      }
+      embedded_lsm = std::make_unique<LSM>(flags.db);
+    }
+    printf("backend: %s, workload: %s, records: %zu, value size: %zu\n",
+           flags.backend.c_str(), flags.workload.c_str(), flags.records,
+           flags.value_size);
+    Runner runner;
+    if (flags.load) {
+      runner.load();
+    }
+    if (flags.run) {
+      runner.run();
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  embedded_lsm.reset();
+  return 0;
+}
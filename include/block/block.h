@@ -6,6 +6,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -24,6 +25,57 @@ Refer to https://skyzh.github.io/mini-lsm/week1-03-block.html for memory layout
 |key_len (2B)|key(keylen)|val_len(2B)|val(vallen)|tranc_id(8B)| ... |
 ---------------------------------------------------------------------
 
+以上是版本 1 的格式, 新写入的 block 使用版本 2 的格式, key 按前缀压缩:
+
+------------------------------------------------------------------------------
+|  Data Section   |       Restart Section       |           Extra            |
+------------------------------------------------------------------------------
+|Entry#1|...|Entry#N|Restart#1|...|Restart#R|num_restarts|num_elements|0x8000|
+------------------------------------------------------------------------------
+
+--------------------------------------------------------------------------
+|                                Entry #1                          | ... |
+--------------------------------------------------------------------------
+|shared(2B)|unshared(2B)|key_delta(unshared)|val_len(2B)|val|tranc_id(8B)|
+--------------------------------------------------------------------------
+
+每个 entry 只保存与上一个 key 不同的部分, 与上一个 key 相同的前缀长度为 shared
+每隔 LSM_BLOCK_RESTART_INTERVAL 个 entry 设置一个 restart 点, restart 点处的
+entry 保存完整的 key (shared 为 0), Restart Section 记录这些 entry 的偏移
+num_elements 的最高位用于区分两种格式
+查找时先在 restart 点上二分, 再从 restart 点开始顺序解码
+解码后的 block 在内存中仍然保留每个 entry 的偏移, 以便按下标访问
+
+新写入的 block 使用版本 3 的格式, 在版本 2 的基础上将长度和事务 id 改为 varint:
+
+------------------------------------------------------------------------------
+| Data Section |  Restart Section  |                  Extra                   |
+------------------------------------------------------------------------------
+|Entry#1|...|Restart#1(4B)|...|base_tranc_id(8B)|num_restarts(4B)|num(4B)|0xFFFF|
+------------------------------------------------------------------------------
+
+-----------------------------------------------------------------------------
+|                              Entry #1                               | ... |
+-----------------------------------------------------------------------------
+|shared|unshared|val_len|key_delta(unshared)|val(val_len)|tranc_delta | ... |
+-----------------------------------------------------------------------------
+
+shared, unshared, val_len 和 tranc_delta 均为 varint, value 的长度不再受 64KB 限制
+val_len 的最低位表示 value 是否为 BlobIndex (value 保存在 blob 文件中), 其余位为长度
+tranc_delta 为 tranc_id 与第一个 entry 的 tranc_id (base_tranc_id) 之差的 zigzag
+编码, 同一个 block 中的事务 id 通常很接近, 大多只需要 1~2 个字节
+版本 2 的 num_elements 不会达到 0x7FFF, 末尾的 0xFFFF 不会与之混淆
+
+开启 LSM_BLOCK_HASH_INDEX 时, 版本 3 的 block 还带有一个哈希索引, 末尾的标记为 0xFFFE:
+
+------------------------------------------------------------------------------
+| ... |Restart#R|Bucket#1(1B)|...|Bucket#B|num_buckets(2B)|base_tranc_id|...|
+------------------------------------------------------------------------------
+
+每个 key 按哈希值落入一个 bucket, bucket 中保存该 key 第一个版本所在的 restart
+点的下标, 0xFF 表示没有 key, 0xFE 表示多个 restart 点的 key 发生了冲突
+点查时先查 bucket: 为空时直接返回不存在, 命中时只需要顺序扫描一个 restart 区间,
+冲突时退化为在 restart 点上二分. restart 点超过 253 个的 block 不构建哈希索引
 */
 
 class BlockIterator;
@@ -31,20 +83,106 @@ class BlockIterator;
 class Block : public std::enable_shared_from_this<Block> {
   friend BlockIterator;
 
+public:
+  enum class Format : uint8_t {
+    Plain = 1,            // 版本 1: 完整的 key, 定长的长度字段
+    PrefixCompressed = 2, // 版本 2: key 前缀压缩
+    Varint = 3,           // 版本 3: 前缀压缩 + varint 长度和事务 id
+  };
+
 private:
+  // entry 中各个字段的位置, 版本 1 的 shared 为 0
+  struct EntryLayout {
+    size_t shared;
+    size_t unshared;
+    size_t key_pos; // key 中不共享部分的位置
+    size_t value_len;
+    size_t value_pos;
+    bool blob_index; // value 是否为指向 blob 文件的 BlobIndex
+    size_t tranc_id_pos;
+    size_t end; // 下一个 entry 的位置
+  };
+
   std::vector<uint8_t> data;
-  std::vector<uint16_t> offsets;
+  std::vector<uint32_t> offsets;
+  // 版本 2 和 3 的 restart 点的偏移, 版本 1 的 block 为空
+  std::vector<uint32_t> restarts;
+  Format format = Format::Varint;
+  uint64_t base_tranc_id = 0; // 版本 3 中 tranc_delta 的基准
+  std::string last_key;       // 构建 block 时上一个写入的 key
+  // 解码得到的哈希索引, 为空表示 block 没有哈希索引
+  std::vector<uint8_t> hash_buckets;
+  // 解码时根据 restart 点处完整的 key 构建: 全部 restart key 的公共前缀长度,
+  // 以及去掉公共前缀后的定长前缀 (见 key_prefix); 在 restart 点上查找时
+  // 大部分比较只需要比较整数. 构建中的 block 为空, 此时直接比较 key
+  size_t restart_common_len = 0;
+  std::vector<uint64_t> restart_prefixes;
+  // 构建 block 时每个不同的 key 的哈希值和第一个版本所在的 restart 点
+  std::vector<std::pair<uint32_t, uint32_t>> key_restarts;
   size_t capacity;
+  // 视图模式下数据段直接指向外部内存(如 mmap 映射的 sst 文件), 不复制
+  // view_owner 保证外部内存在 block 的生命周期内有效
+  const uint8_t *view_data = nullptr;
+  size_t view_size = 0;
+  std::shared_ptr<const void> view_owner;
 
-  struct Entry {
-    std::string key;
-    std::string value;
-    uint64_t tranc_id;
-  };
-  Entry get_entry_at(size_t offset) const;
+  const uint8_t *data_ptr() const {
+    return view_data != nullptr ? view_data : data.data();
+  }
+  size_t data_size() const {
+    return view_data != nullptr ? view_size : data.size();
+  }
+
+  static std::shared_ptr<Block> decode_(const uint8_t *encoded, size_t size,
+                                        bool with_hash,
+                                        std::shared_ptr<const void> owner);
+  static std::shared_ptr<Block>
+  decode_prefix_compressed_(std::shared_ptr<Block> block,
+                            const uint8_t *encoded, size_t num_elements_pos,
+                            uint16_t num_elements,
+                            std::shared_ptr<const void> owner);
+  static std::shared_ptr<Block>
+  decode_varint_(std::shared_ptr<Block> block, const uint8_t *encoded,
+                 size_t marker_pos, bool with_hash_index,
+                 std::shared_ptr<const void> owner);
+  // 根据 key_restarts 构建哈希索引, 不满足构建条件时返回空
+  std::vector<uint8_t> build_hash_buckets_() const;
+  // 哈希索引占用的空间, 包括 num_buckets
+  size_t hash_index_size_() const;
+  static size_t hash_index_size_for_(size_t num_keys);
+  // 版本 2 和 3 只保存 restart 点的偏移, 解码时顺序扫描重建每个 entry 的偏移
+  void rebuild_offsets_(size_t num_elements);
+  // 构建 restart_common_len 和 restart_prefixes
+  void build_restart_prefixes_();
+  // 第 idx 个 restart 点处完整的 key
+  std::string_view restart_key_(size_t idx) const;
+  // [left, right) 中第一个 key 不小于目标的 restart 点
+  size_t restart_lower_bound_(const std::string &key, size_t left,
+                              size_t right) const;
+  // 第 restart_idx 个 restart 点处的 entry 的下标
+  size_t restart_entry_idx_(size_t restart_idx) const;
+  // 设置数据段: 有 owner 时直接引用外部内存, 否则复制一份
+  void set_data_(const uint8_t *encoded, size_t size,
+                 std::shared_ptr<const void> owner);
+  // 版本 2 和 3: 先通过哈希索引或者在 restart 点上二分找到 restart 区间,
+  // 再顺序查找
+  std::optional<size_t> get_idx_restart_(const std::string &key,
+                                         uint64_t tranc_id);
+
+  // 版本 2 和 3 中需要从 offset 之前最近的 restart 点开始解码 key
   std::string get_key_at(size_t offset) const;
+  // 同上, 结果写入 key 中, 复用 key 已经分配的空间
+  void get_key_at(size_t offset, std::string &key) const;
+  // 解析 offset 处的 entry, entry 超出数据段时抛出异常
+  EntryLayout entry_layout_(size_t offset) const;
+  // 第 idx 个 entry 的 key 是否与第 idx - 1 个相同
+  bool same_key_as_prev(size_t idx) const;
   std::string get_value_at(size_t offset) const;
-  uint16_t get_tranc_id_at(size_t offset) const;
+  // 指向数据段的 value, 在 block 的生命周期内有效
+  std::string_view get_value_view_at(size_t offset) const;
+  uint64_t get_tranc_id_at(size_t offset) const;
+  uint64_t decode_tranc_id_(const EntryLayout &layout) const;
+  bool is_blob_index_at(size_t offset) const;
   int compare_key_at(size_t offset, const std::string &target) const;
 
   // 根据id的可见性调整位置
@@ -53,6 +191,19 @@ private:
   bool is_same_key(size_t idx, const std::string &target_key) const;
 
 public:
+  struct Entry {
+    std::string key;
+    std::string value;
+    uint64_t tranc_id;
+    bool blob_index = false; // 为 true 时 value 是编码后的 BlobIndex
+  };
+  // 不复制 value 的 entry, value 指向 block 的数据段, key 由调用者保存
+  struct EntryView {
+    std::string_view value;
+    uint64_t tranc_id = 0;
+    bool blob_index = false;
+  };
+
   Block() = default;
   Block(size_t capacity);
   // ! 这里的编码函数不包括 hash
@@ -60,18 +211,37 @@ public:
   // ! 这里的解码函数可指定切片是否包括 hash
   static std::shared_ptr<Block> decode(const std::vector<uint8_t> &encoded,
                                        bool with_hash = false);
+  // 零拷贝解码, 返回的 block 的数据段直接引用 encoded 指向的内存
+  // owner 负责保持这段内存有效, 视图模式的 block 不能再添加 entry
+  static std::shared_ptr<Block> decode_view(const uint8_t *encoded,
+                                            size_t size,
+                                            std::shared_ptr<const void> owner,
+                                            bool with_hash = false);
   std::string get_first_key();
   size_t get_offset_at(size_t idx) const;
+  // 按 offset 读取完整的 entry, 不做事务可见性的过滤, 主要用于 compact
+  Entry get_entry_at(size_t offset) const;
+  // 顺序读取第 idx 个 entry, 结果的 key 写入 key 中
+  // key_is_prev 为 true 表示 key 中是第 idx - 1 个 entry 的 key,
+  // 此时只需要应用前缀差量, 否则从最近的 restart 点开始还原
+  EntryView get_entry_view_at(size_t idx, std::string &key,
+                              bool key_is_prev) const;
+  // blob_index 为 true 时 value 是编码后的 BlobIndex, 读取时由 sst 解析
   bool add_entry(const std::string &key, const std::string &value,
-                 uint64_t tranc_id, bool force_write);
+                 uint64_t tranc_id, bool force_write, bool blob_index = false);
   std::optional<std::string> get_value_binary(const std::string &key,
                                               uint64_t tranc_id);
 
   size_t size() const;
   size_t cur_size() const;
+  Format get_format() const;
+  bool has_hash_index() const;
   bool is_empty() const;
   std::optional<size_t> get_idx_binary(const std::string &key,
                                        uint64_t tranc_id);
+  // 第一个 key 不小于 key 的 entry 的下标 (相同 key 的最新版本),
+  // 不存在时返回 size(); 不检查事务可见性
+  size_t lower_bound_idx(const std::string &key) const;
 
   // 按照谓词返回迭代器, 左闭右开
   std::optional<
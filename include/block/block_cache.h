@@ -1,6 +1,8 @@
 #pragma once
 
 #include "block.h"
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <list>
 #include <memory>
@@ -11,20 +13,33 @@
 #include <vector>
 
 // 定义缓存项
+// 除了 data block, 缓存项也可以是 sst 的元数据(索引或者布隆过滤器),
+// 此时 block_id 为负数, 见 BlockCache::MetaType
 struct CacheItem {
-  int sst_id;
+  uint64_t sst_key; // 高 32 位为使用者的编号, 低 32 位为 sst_id, 见 share
   int block_id;
-  std::shared_ptr<Block> cache_block;
+  std::shared_ptr<void> cache_block;
   uint64_t access_count; // 访问时间戳
+  size_t charge;         // 占用的缓存容量(字节数)
+  bool high_priority;    // 高优先级的缓存项最后才会被驱逐
 };
 
 // 自定义哈希函数
+// 将 (sst_id, block_id) 拼接为 64 位整数后做混合, 避免 (1, 2) 和 (2, 1)
+// 这类简单异或会产生的冲突; first 的高 32 位(使用者的编号)另外混入
 struct pair_hash {
   template <class T1, class T2>
   std::size_t operator()(const std::pair<T1, T2> &p) const {
-    auto hash1 = std::hash<T1>{}(p.first);
-    auto hash2 = std::hash<T2>{}(p.second);
-    return hash1 ^ hash2;
+    uint64_t first = static_cast<uint64_t>(p.first);
+    uint64_t x = ((first << 32) | static_cast<uint32_t>(p.second)) ^
+                 ((first >> 32) * 0x9e3779b97f4a7c15ULL);
+    // splitmix64 的混合函数
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return static_cast<std::size_t>(x);
   }
 };
 
@@ -38,38 +53,97 @@ struct pair_equal {
 };
 
 // 定义缓存池
+// 缓存按 (sst_id, block_id) 的哈希值划分为多个互相独立的分片,
+// 每个分片各自维护 LRU-K 链表和锁, 不同分片的访问互不阻塞
+// 多个引擎可以通过 share 共用同一份容量, 整个进程的缓存占用不超过 capacity
 class BlockCache {
 public:
-  BlockCache(size_t capacity, size_t k);
+  // sst 元数据在缓存中使用的 block_id
+  enum class MetaType : int {
+    Index = -1,  // BlockIndex
+    Filter = -2, // 布隆过滤器
+  };
+
+  // capacity 为缓存的总容量(字节数), 平均分配给 2^shard_bits 个分片
+  // cache_meta 为 true 时, sst 的索引和布隆过滤器也放入缓存, 占用同一份容量
+  BlockCache(size_t capacity, size_t k, int shard_bits = 4,
+             bool cache_meta = false);
   ~BlockCache();
 
+  // 返回共用当前缓存的分片和容量的 BlockCache, 供另一个引擎使用
+  // 每个返回值有各自的编号, 不同引擎中相同的 sst_id 不会互相覆盖
+  std::shared_ptr<BlockCache> share();
+
   // 获取缓存项
   std::shared_ptr<Block> get(int sst_id, int block_id);
 
   // 插入缓存项
   void put(int sst_id, int block_id, std::shared_ptr<Block> data);
 
-  // 获取缓存命中率
+  // 获取 sst 的元数据, 调用者负责转换为实际的类型
+  std::shared_ptr<void> get_meta(int sst_id, MetaType type);
+
+  // 插入 sst 的元数据, charge 为其占用的内存大小
+  void put_meta(int sst_id, MetaType type, std::shared_ptr<void> meta,
+                size_t charge, bool high_priority);
+
+  // sst 的元数据是否由缓存管理
+  bool cache_meta() const;
+
+  // 获取缓存命中率, 只统计通过当前对象的访问
   double hit_rate() const;
 
+  // 当前缓存占用的总字节数, 包括共用这份缓存的其他引擎
+  size_t get_usage() const;
+
+  // block 占用的缓存容量
+  static size_t get_charge(const Block &block);
+
 private:
-  size_t capacity_;          // 缓存容量
-  size_t k_;                 // LRU-K 中的 K 值
-  mutable std::mutex mutex_; // 互斥锁保护缓存池
+  struct Shard {
+    size_t capacity = 0;
+    size_t usage = 0;
+    std::mutex mutex; // 互斥锁保护当前分片
 
-  // 双向链表存储缓存项
-  std::list<CacheItem> cache_list_greater_k;
-  std::list<CacheItem> cache_list_less_k;
+    // 双向链表存储缓存项
+    std::list<CacheItem> cache_list_greater_k;
+    std::list<CacheItem> cache_list_less_k;
+    std::list<CacheItem> cache_list_high_pri; // 高优先级的缓存项, 按 LRU 排列
 
-  // 哈希表索引缓存项
-  std::unordered_map<std::pair<int, int>, std::list<CacheItem>::iterator,
-                     pair_hash, pair_equal>
-      cache_map_;
+    // 哈希表索引缓存项
+    std::unordered_map<std::pair<uint64_t, int>,
+                       std::list<CacheItem>::iterator, pair_hash, pair_equal>
+        cache_map_;
+  };
+
+  // share 得到的对象之间共用的状态
+  struct Shared {
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint32_t> next_owner{1};
+  };
+
+  BlockCache(const BlockCache &other, uint32_t owner);
+
+  uint64_t get_sst_key(int sst_id) const;
+  Shard &get_shard(uint64_t sst_key, int block_id);
+
+  std::shared_ptr<void> get_(int sst_id, int block_id);
+  void put_(int sst_id, int block_id, std::shared_ptr<void> value,
+            size_t charge, bool high_priority);
+
+  // 驱逐最久未使用的缓存项, 直到可以放入 charge 字节, 调用者需要持有分片的锁
+  void evict(Shard &shard, size_t charge);
 
   // 更新缓存项的访问时间
-  void update_access_count(std::list<CacheItem>::iterator it);
+  void update_access_count(Shard &shard, std::list<CacheItem>::iterator it);
+
+  size_t capacity_; // 缓存容量
+  size_t k_;        // LRU-K 中的 K 值
+  bool cache_meta_;
+  std::shared_ptr<Shared> shared_;
+  uint64_t owner_ = 0; // 当前对象的编号, 位于缓存 key 的高 32 位
 
   // 记录请求数和命中数
-  mutable size_t total_requests_ = 0;
-  mutable size_t hit_requests_ = 0;
-};
\ No newline at end of file
+  std::atomic<size_t> total_requests_{0};
+  std::atomic<size_t> hit_requests_{0};
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "blockmeta.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * sst 中 block 的内存索引, 打开 sst 时由 BlockMeta 数组转换而来
+ * 相邻的两个 block 之间只保存一个尽量短的分隔 key, 满足
+ *   前一个 block 的 last_key < 分隔 key <= 后一个 block 的 first_key
+ * 所有 key 连续保存在 keys_ 中, 查找时直接在 string_view 上二分,
+ * 不需要为每个 block 在堆上保存两个完整的 key
+ *
+ * 共有 n + 1 个边界 key, boundary(0) 为 sst 的首 key, boundary(n) 为 sst 的尾
+ * key, 0 < i < n 时 boundary(i) 为第 i - 1 个和第 i 个 block 之间的分隔 key,
+ * 第 i 个 block 中的 key 都位于 [boundary(i), boundary(i + 1)] 之间
+ */
+class BlockIndex {
+public:
+  BlockIndex() = default;
+  explicit BlockIndex(const std::vector<BlockMeta> &metas);
+
+  // block 的数量
+  size_t size() const;
+  bool empty() const;
+  // block 在 sst 文件中的偏移
+  uint32_t block_offset(size_t block_idx) const;
+  std::string_view boundary(size_t idx) const;
+
+  // 返回第一个可能包含不小于 key 的 entry 的 block, 所有 key 都小于 key
+  // 时返回 size()
+  size_t seek(std::string_view key) const;
+
+  // 索引占用的内存, 用于缓存池计费
+  size_t memory_usage() const;
+
+  // 返回尽量短的 key, 满足 last < key <= first, 要求 last < first
+  static std::string shortest_separator(std::string_view last,
+                                        std::string_view first);
+
+private:
+  void append_key(std::string_view key);
+
+private:
+  std::vector<uint32_t> block_offsets_;
+  std::vector<uint32_t> key_ends_; // 第 i 个边界 key 在 keys_ 中的结束位置
+  std::string keys_;
+};
@@ -6,6 +6,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 
 class Block;
@@ -31,19 +32,41 @@ public:
   pointer operator->() const;
   BlockIterator &operator++();
   BlockIterator operator++(int) = delete;
+  // 移动到前一个 key 的最新可见版本, 没有时移动到 end
+  BlockIterator &operator--();
+  // 定位到最后一个有可见版本的 key
+  void seek_to_last();
+  // 定位到最后一个不大于 key 且有可见版本的 key
+  void seek_for_prev(const std::string &key);
   bool operator==(const BlockIterator &other) const;
   bool operator!=(const BlockIterator &other) const;
   value_type operator*() const;
+  // 不复制数据的访问方式, 在迭代器下一次移动之前有效
+  // value 直接指向 block 的数据段; 前缀压缩的 key 在 key_buf_ 中还原,
+  // 顺序遍历时只需要在上一个 key 上应用当前 entry 的前缀差量
+  std::string_view key() const;
+  std::string_view value() const;
   bool is_end();
+  // 当前 entry 的 tranc_id
+  uint64_t get_tranc_id() const;
+  // 当前 value 是否为 BlobIndex, 需要由 sst 从 blob 文件中读取真实的 value
+  bool is_blob_index() const;
 
 private:
   void update_current() const;
   // 跳过当前不可见事务的id (如果开启了事务功能)
   void skip_by_tranc_id();
+  // idx 为某个 key 的第一个 entry, 定位到其中可见的最新版本, 没有时返回 false
+  bool seek_visible_in_key(size_t idx);
+  // idx 为某个 key 的第一个 entry (或者 size()), 定位到它之前最后一个有可见
+  // 版本的 key, 没有时移动到 end
+  void seek_prev_key(size_t idx);
 
 private:
   std::shared_ptr<Block> block;                   // 指向所属的 Block
   size_t current_index;                           // 当前位置的索引
   uint64_t tranc_id_;                             // 当前事务 id
   mutable std::optional<value_type> cached_value; // 缓存当前值
+  mutable std::string key_buf_;                   // 还原的前缀压缩的 key
+  mutable size_t key_idx_ = SIZE_MAX; // key_buf_ 对应的 entry, SIZE_MAX 表示无效
 };
\ No newline at end of file
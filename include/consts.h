@@ -1,29 +1,121 @@
 #pragma once
 
-#define LSM_TOL_MEM_SIZE_LIMIT (64 * 1024 * 1024) // 内存表的大小限制, 64MB
-#define LSM_PER_MEM_SIZE_LIMIT (4 * 1024 * 1024) // 内存表的大小限制, 4MB
+// 引擎相关的宏是 Options (include/lsm/options.h) 中对应参数的默认值,
+// 运行时通过 Options 修改, 不需要重新编译
+
+#define LSM_TOL_MEM_SIZE_LIMIT (64 * 1024 * 1024) // 内存表实际占用内存的限制, 64MB
+#define LSM_PER_MEM_SIZE_LIMIT (4 * 1024 * 1024) // 单个内存表实际占用内存的限制, 4MB
 #define LSM_BLOCK_SIZE (32 * 1024)               // BLOCK的大小, 32KB
+#define LSM_BLOCK_RESTART_INTERVAL 16 // block 中每隔多少个 entry 保存一次完整的 key
+#define LSM_BLOCK_HASH_INDEX true // block 中是否构建 key 到 restart 点的哈希索引
+#define LSM_BLOCK_HASH_UTIL_RATIO 0.75 // 哈希索引中 key 的数量与 bucket 数量之比
+#define LSM_SKIPLIST_ARENA_BLOCK_SIZE                                          \
+  (64 * 1024) // 跳表的 Arena 每次向系统申请的内存大小, 64KB
 
 #define LSM_SST_LEVEL_RATIO 4 // 不同层级的sst的大小比例
+#define LSM_LEVELED_SST_SIZE                                                   \
+  (LSM_PER_MEM_SIZE_LIMIT * LSM_SST_LEVEL_RATIO) // leveled compact 输出的sst大小
+#define LSM_TIERED_MAX_RUN_NUM                                                 \
+  (2 * LSM_SST_LEVEL_RATIO) // tiered compact 允许的最多 sorted run 数量
+#define LSM_TIERED_SIZE_RATIO 1 // tiered compact 判断大小相近的比例(百分比)
+
+// 后台 flush / compact
+#define LSM_BG_THREAD_NUM 2 // 后台线程数, flush 和 compact 各占一个
+#define LSM_WRITE_STALL_FROZEN_BYTES                                           \
+  (2 * LSM_TOL_MEM_SIZE_LIMIT) // 冻结表积压超过该大小时阻塞写入
+#define LSM_WRITE_STALL_L0_NUM                                                 \
+  (3 * LSM_SST_LEVEL_RATIO) // l0 的 sst 数量超过该值时阻塞写入
+#define LSM_MAX_SUBCOMPACTIONS 4 // 一次 compact 最多拆分的子任务数(线程数)
+#define LSM_OPEN_THREAD_NUM 8 // 启动时并行打开 sst 的线程数
+#define LSM_SUBCOMPACT_MIN_SIZE                                                \
+  LSM_PER_MEM_SIZE_LIMIT // 每个 compact 子任务至少需要处理的输入数据量
+// 限速器每隔该时间补充一次令牌, 单次写入的大小也不超过一个周期的令牌数
+#define LSM_RATE_LIMITER_REFILL_PERIOD_US 100000
+// 自动调节时速率在 [上限 / 该值, 上限] 之间随 compact 的积压变化
+#define LSM_RATE_LIMITER_AUTO_TUNE_RATIO 8
+
+// WAL
+#define LSM_WAL_BUFFER_SIZE 128 // 缓冲区中的记录数达到该值时写入
+#define LSM_WAL_CLEAN_INTERVAL 1 // 清理已经刷盘的 WAL 文件的间隔(秒)
+#define LSM_WAL_FILE_SIZE_LIMIT 4096 // 单个 WAL 文件写满该大小后切换到下一个文件
+#define LSM_WAL_RECOVER_THREAD_NUM 4 // 并行解码 WAL 文件的线程数
+#define LSM_WAL_RECOVER_BATCH_SIZE 1024 // 每批重放到 memtable 的记录数
+#define LSM_WAL_RECYCLE_NUM 4 // 最多保留多少个清零的 WAL 文件等待复用
+// 为 true 时不经过事务的 put / remove 同样先写入 WAL, 复制的主节点需要开启
+#define LSM_WAL_ALL_WRITES false
+
+// 复制
+#define LSM_REPLICATION_BATCH_BYTES (1 << 20) // 复制流每次最多读取的 WAL 数据量
 
-// 测试时使用的小批量数据, 测试时可以注释上面的定义
-// #define LSM_TOL_MEM_SIZE_LIMIT (4  * 1024) // 内存表的大小限制, 4kb
-// #define LSM_PER_MEM_SIZE_LIMIT (1 * 1024) // 内存表的大小限制, 1KB
-// #define LSM_BLOCK_SIZE (256)               // BLOCK的大小, 1KB
+// 事务
+#define LSM_CONFLICT_STRIPE_NUM 64 // 冲突检测表的分段数
+#define LSM_CONFLICT_STRIPE_CAPACITY 4096 // 冲突检测表每个分段最多记录的 key 数
 
-#define LSMmm_BLOCK_CACHE_CAPACITY 1024 // 缓存池的块缓存容量
+// 统计
+#define LSM_STATS_SHARD_NUM 16 // 统计信息的分片数, 线程分散到不同的分片上累加
+
+#define LSMmm_BLOCK_CACHE_CAPACITY                                             \
+  (1024 * LSM_BLOCK_SIZE) // 缓存池的容量(字节数), 32MB
+#define LSMmm_BLOCK_CACHE_SHARD_BITS 4 // 缓存池分片数的对数, 16 个分片
+#define LSMmm_BLOCK_CACHE_META true // sst 的索引和布隆过滤器是否放入缓存池
+#define LSMmm_BLOCK_CACHE_PIN_L0_META                                          \
+  true // l0 sst 的索引和布隆过滤器是否固定(高优先级缓存且常驻内存)
 #define LSMmm_BLOCK_CACHE_K 8           // 缓存池的LRU-K的K值
+#define LSM_ROW_CACHE_CAPACITY 0 // 行缓存的容量(字节数), 0 表示不使用行缓存
+#define LSM_ROW_CACHE_SHARD_BITS 4 // 行缓存分片数的对数, 16 个分片
+#define LSM_SST_USE_MMAP true // sst 的 block 是否通过 mmap 零拷贝读取
+// 顺序读取 sst 时的自适应预读: 第一次预读的大小, 之后每次翻倍直到上限
+#define LSM_SST_READAHEAD_MIN (2 * LSM_BLOCK_SIZE)
+#define LSM_SST_READAHEAD_MAX (32 * LSM_BLOCK_SIZE) // 预读大小的上限, 1MB
+// 开启 LSM_HAS_IO_URING 时, 一批读取请求中同时提交的请求数上限
+#define LSM_IO_URING_QUEUE_DEPTH 64
 
 // Redis HEADER
-#define REDIS_EXPIRE_HEADER "REDIS_EXPIRE_"          // 过期时间的前缀
+// 设置了过期时间的 value 以该前缀开头, 之后是类型标记和定长的过期时间
+#define REDIS_TTL_HEADER "\x1fREDIS_TTL_"
+#define REDIS_TTL_TIME_LEN 20 // 过期时间 (unix 时间戳, 秒) 的十进制长度
 #define REDIS_HASH_VALUE_PREFFIX "REDIS_HASH_VALUE_" // 哈希表值的前缀
 #define REDIS_FIELD_PREFIX "REDIS_FIELD_"            // 哈希表字段的前缀
 #define REDIS_FIELD_SEPARATOR '$' // 哈希表字段的分隔符
-#define REDIS_LIST_SEPARATOR '#'  // 链表元素的分隔符
+#define REDIS_LIST_SEPARATOR '#'  // 旧版本中链表元素的分隔符
+#define REDIS_LIST_PREFIX "REDIS_LIST_" // 链表元素的前缀
+#define REDIS_LIST_META_PREFFIX "REDIS_LIST_META_" // 链表元数据的前缀
+// 链表元素的初始序号, 位于 uint64_t 的中间, 两端都可以继续插入
+#define REDIS_LIST_INITIAL_SEQ (1ULL << 63)
 #define REDIS_SORTED_SET_PREFIX "REDIS_SORTED_SET_" // 有序集合的前缀
 #define REDIS_SORTED_SET_SCORE_LEN 32 // 有序集合分数的长度
 #define REDIS_SET_PREFIX "REDIS_SET_" // 无序集合的前缀
+#define REDIS_SET_META_PREFFIX "REDIS_SET_META_" // 无序集合元数据的前缀
+// 命令按 key 的哈希值分散到这些锁上, 不同 key 的命令可以并行执行
+#define REDIS_LOCK_STRIPES 64
+// RESP 请求中参数的数量和单个参数长度的上限, 超出时视为协议错误
+#define REDIS_MAX_MULTIBULK_LEN (1024 * 1024)
+#define REDIS_MAX_BULK_LEN (512 * 1024 * 1024)
+#define REDIS_MAX_INLINE_LEN (64 * 1024) // inline 命令的长度上限
+#define REDIS_SERVER_IO_THREADS 4 // server 默认的 I/O 线程数
+// server 默认的分片数, 0 表示不分片; 分片时每个分片是一个独立的引擎,
+// 命令由该分片自己的线程执行
+#define REDIS_SERVER_SHARDS 0
+#define REDIS_REPLICA_POLL_MS 100 // 从节点没有新数据时再次拉取的间隔
+// SCAN 系列命令每次最多检查的记录数, COUNT 只是提示, 超过上限时按上限处理
+#define REDIS_SCAN_DEFAULT_COUNT 10
+#define REDIS_SCAN_MAX_COUNT 1000
 
 // Bloom Filter
 #define BLOOM_FILTER_EXPECTED_SIZE 65536
 #define BLOOM_FILTER_EXPECTED_ERROR_RATE 0.1
+// sst 中分块布隆过滤器每个 key 占用的位数, 10 时假阳性率约为 1%
+#define LSM_BLOOM_BITS_PER_KEY 10
+// 不小于该层级的 sst 使用 Xor 过滤器: 构建更慢, 但相同假阳性率下更省内存
+#define LSM_SST_XOR_FILTER_MIN_LEVEL 2
+
+// Block 压缩
+#define LSM_SST_COMPRESSION true // 是否压缩 sst 的 data block
+// 不小于该层级的 sst 使用 Zstd 压缩(构建时开启了 zstd 选项), 其他层级使用 LZ4
+#define LSM_SST_ZSTD_MIN_LEVEL 2
+
+// 键值分离
+#define LSM_BLOB_ENABLE true // 是否将较大的 value 保存到 blob 文件中
+#define LSM_BLOB_MIN_VALUE_SIZE (4 * 1024) // 不小于该大小的 value 写入 blob 文件
+// compact 时将最旧的这一比例的 blob 文件中仍然有效的 value 重写到新的 blob 文件
+#define LSM_BLOB_GC_AGE_CUTOFF 0.25
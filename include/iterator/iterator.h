@@ -4,7 +4,9 @@
 #include <memory>
 #include <optional>
 #include <queue>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 
 enum class IteratorType {
@@ -15,6 +17,8 @@ enum class IteratorType {
   TwoMergeIterator,
   ConcactIterator,
   LevelIterator,
+  CompactIterator,
+  MergeIterator,
 };
 
 class BaseIterator {
@@ -26,9 +30,26 @@ public:
   virtual BaseIterator &operator++() = 0;
   virtual bool operator==(const BaseIterator &other) const = 0;
   virtual bool operator!=(const BaseIterator &other) const = 0;
+  // 复制当前的键值对, 兼容旧的调用方式
   virtual value_type operator*() const = 0;
+  // 不复制数据的访问方式, 返回的 string_view 指向迭代器持有的内存
+  // (跳表的 Arena, block 的数据段或迭代器内部的缓冲区),
+  // 只在迭代器下一次 ++ 或者析构之前有效
+  virtual std::string_view key() const = 0;
+  virtual std::string_view value() const = 0;
   virtual IteratorType get_type() const = 0;
   virtual uint64_t get_tranc_id() const = 0;
+  // 当前记录自身的 tranc_id, 用于判断是否被范围删除标记覆盖
+  // get_tranc_id 返回可见性上限的迭代器需要重写
+  virtual uint64_t get_entry_tranc_id() const { return get_tranc_id(); }
+  // 当前记录是否为 merge 操作数, 只有内存表中的记录可能是操作数
+  virtual bool is_merge_operand() const { return false; }
+  // 反向移动到前一个 key 上对迭代器可见的最新版本, 没有更小的 key 时变为无效
+  // 反向遍历时每个 key 只输出一个版本; 只有 SkipListIterator (需要由
+  // seek_for_prev 创建), SstIterator 和 ConcactIterator 支持
+  virtual BaseIterator &operator--() {
+    throw std::runtime_error("reverse iteration is not supported");
+  }
   virtual bool is_end() const = 0;
   virtual bool is_valid() const = 0;
 };
@@ -41,11 +62,13 @@ struct SearchItem {
   uint64_t tranc_id_;
   int idx_;
   int level_; // 来自sst的level
+  bool merge_ = false; // 是否为 merge 操作数
 
   SearchItem() = default;
-  SearchItem(std::string k, std::string v, int i, int l, uint64_t tranc_id)
+  SearchItem(std::string k, std::string v, int i, int l, uint64_t tranc_id,
+             bool merge = false)
       : key_(std::move(k)), value_(std::move(v)), idx_(i), level_(l),
-        tranc_id_(tranc_id) {}
+        tranc_id_(tranc_id), merge_(merge) {}
 };
 
 bool operator<(const SearchItem &a, const SearchItem &b);
@@ -61,6 +84,8 @@ public:
   HeapIterator(std::vector<SearchItem> item_vec, uint64_t max_tranc_id);
   pointer operator->() const;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
   BaseIterator &operator++() override;
   BaseIterator operator++(int) = delete;
   virtual bool operator==(const BaseIterator &other) const override;
@@ -68,6 +93,8 @@ public:
 
   virtual IteratorType get_type() const override;
   virtual uint64_t get_tranc_id() const override;
+  virtual uint64_t get_entry_tranc_id() const override;
+  virtual bool is_merge_operand() const override;
   virtual bool is_end() const override;
   virtual bool is_valid() const override;
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "options.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class LSMEngine;
+
+#define LSM_DEFAULT_COLUMN_FAMILY "default"
+
+// 列族: 同一个 LSM 中独立的 key 空间, 有自己的内存表, sst 和参数
+// 全部列族共用一个 WAL 和事务管理, 跨列族的 WriteBatch 和事务是原子的
+// 默认列族的数据位于 LSM 的目录中, 其他列族位于其中的 cf_{id} 目录
+struct ColumnFamilyHandle {
+  uint32_t id; // 默认列族为 0
+  std::string name;
+  std::shared_ptr<LSMEngine> engine;
+};
+
+// 打开 LSM 时同时打开的列族及其参数
+struct ColumnFamilyDescriptor {
+  std::string name;
+  Options options;
+};
+
+// 冲突表和事务的暂存数据中使用的 key, 不同列族中相同的 key 互不影响
+// 默认列族的 key 保持不变, 其他列族为 | \0 | cf_id (32, 大端) | key |
+// 以 \0 开头的默认列族 key 同样添加前缀, 保证可以还原
+std::string encode_cf_key(uint32_t cf_id, const std::string &key);
+std::pair<uint32_t, std::string> decode_cf_key(const std::string &cf_key);
+
+// LSM 中打开的全部列族, 由 LSM 和各个引擎的回调共同持有
+class ColumnFamilySet {
+public:
+  void add(std::shared_ptr<ColumnFamilyHandle> handle);
+  // 不存在时返回 nullptr
+  std::shared_ptr<ColumnFamilyHandle> get(uint32_t id) const;
+  std::shared_ptr<ColumnFamilyHandle> get(const std::string &name) const;
+  // 按 id 升序排列
+  std::vector<std::shared_ptr<ColumnFamilyHandle>> all() const;
+
+  // 不大于返回值的事务在全部列族中都已经刷盘, WAL 中不再需要其记录
+  // 内存表为空的列族不限制这个值, 其他列族中取刷盘进度的最小值
+  uint64_t flushed_tranc_id() const;
+
+  // 列族的名称和 id 记录在 LSM 目录的 COLUMN_FAMILIES 文件中:
+  // | id (32) | name_len (32) | name | ... , 不包含默认列族
+  static std::map<uint32_t, std::string> load(const std::string &path);
+  // 写入临时文件后通过重命名原子地替换
+  void save(const std::string &path) const;
+
+private:
+  mutable std::mutex mtx_;
+  std::map<uint32_t, std::shared_ptr<ColumnFamilyHandle>> families_;
+};
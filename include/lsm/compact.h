@@ -1,5 +1,25 @@
 #pragma once
 
+#include <cstddef>
+#include <vector>
+
 enum class CompactType {
+  // 将 level x 的全部 sst 与 level x+1 的全部 sst 合并
   FullCompact,
-};
\ No newline at end of file
+  // 按 level 的大小计算分数, 每次只选取一个 sst(l0 为全部 sst),
+  // 与 level x+1 中 key 范围重叠的 sst 合并
+  LeveledCompact,
+  // l0 的每个 sst 和每个 level >= 1 都是一个 sorted run, level
+  // 越小的数据越新, 只合并大小相近的 sorted run, 以读放大换取更低的写放大
+  TieredCompact,
+};
+
+// tiered compact 的一次任务
+struct TieredCompactTask {
+  // 参与合并的 level, 按从新到旧的顺序排列, l0 参与时总是全部参与
+  std::vector<size_t> levels;
+  // 输出的 level
+  size_t output_level = 1;
+  // 输出到 l1 但 l1 已经被占用时, 需要先将 l1 及之后相邻的 level 整体下移
+  bool move_down = false;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "../block/block.h"
+#include "../iterator/iterator.h"
+#include "../sst/sst.h"
+#include "../utils/range_tombstone.h"
+#include "compaction_filter.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// compact 专用的迭代器
+// 与读路径上的迭代器不同, 它按 (key 升序, tranc_id 降序) 输出每个 key
+// 的全部版本, 并保留真实的 tranc_id, 同时根据 watermark 清理旧版本:
+// 1. tranc_id > watermark 的版本可能被活跃事务看到, 全部保留
+// 2. tranc_id <= watermark 的版本只保留最新的一个, 更旧的版本对所有事务都不可见
+// 3. 输出为最底层时, 第 2 步保留的版本如果是删除标记, 也可以直接丢弃
+// 4. tranc_id <= watermark 的版本被同样不超过 watermark 的范围删除标记覆盖时,
+//    对所有事务都已经被删除, 连同更旧的版本一起丢弃
+// 5. 第 2 步保留的版本被 compaction_filter 丢弃时, 最底层直接丢弃,
+//    否则输出为删除标记
+//
+// kNumRuns 为 0 时 run 的数量在运行时确定, 使用小根堆选择下一个 entry;
+// run 的数量固定时 (如两个 level 之间的 compact 只有 2 个 run) 游标保存在
+// 定长数组中, 直接比较各个游标, 循环在编译期展开, 不需要维护堆
+// 迭代器声明为 final, 通过具体类型调用时不经过虚函数
+template <size_t kNumRuns = 0>
+class BasicCompactIterator final : public BaseIterator {
+public:
+  // runs 按从新到旧的顺序排列, 每个 run 内部的 sst 按 key 有序且互不重叠
+  // (l0 的每个 sst 单独作为一个 run)
+  // 只输出 [lower_key, upper_key) 范围内的 key, 用于拆分 compact 子任务
+  // kNumRuns 不为 0 时 runs 的数量必须与其相同
+  // range_dels 为输入 sst 中裁剪到 [lower_key, upper_key) 的范围删除标记
+  // compaction_filter 为空时不过滤
+  BasicCompactIterator(
+      std::vector<std::vector<std::shared_ptr<SST>>> runs, uint64_t watermark,
+      bool bottommost, std::optional<std::string> lower_key = std::nullopt,
+      std::optional<std::string> upper_key = std::nullopt,
+      std::shared_ptr<const FragmentedRangeTombstones> range_dels = nullptr,
+      std::shared_ptr<const CompactionFilter> compaction_filter = nullptr);
+
+  virtual BaseIterator &operator++() override;
+  virtual bool operator==(const BaseIterator &other) const override;
+  virtual bool operator!=(const BaseIterator &other) const override;
+  virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
+  virtual IteratorType get_type() const override;
+  // 返回当前版本真实的 tranc_id
+  virtual uint64_t get_tranc_id() const override;
+  // 当前版本的 value 是否为 BlobIndex, compact 时直接复制, 不读取 blob 文件
+  bool is_blob_index() const;
+  // 需要写入输出 sst 的范围删除标记, 按 begin 升序排列
+  // 每个片段保留 watermark 以上的标记和 watermark 以下最新的一个,
+  // 输出为最底层时 watermark 以下的标记也不再需要
+  std::vector<RangeTombstone> output_range_tombstones() const;
+  virtual bool is_end() const override;
+  virtual bool is_valid() const override;
+
+private:
+  struct RunCursor {
+    std::vector<std::shared_ptr<SST>> ssts;
+    size_t sst_idx = 0;
+    size_t block_idx = 0;
+    size_t entry_idx = 0;
+    std::shared_ptr<Block> block;
+    // compact 顺序读取输入, 直接按上限预读
+    SstReadahead readahead{true};
+    bool valid = false;
+    // 当前 entry 的 key, 同一个 block 中顺序读取时只需要应用前缀差量
+    std::string key;
+    Block::EntryView entry; // value 指向 block 的数据段
+  };
+  using Cursors =
+      std::conditional_t<kNumRuns == 0, std::vector<RunCursor>,
+                         std::array<RunCursor, kNumRuns>>;
+
+  // 将 cursor 定位到第一个不小于 lower_key 的 entry
+  bool seek_lower(RunCursor &cursor);
+  // 加载 cursor 当前位置的 entry, 没有更多 entry 时返回 false
+  bool load_entry(RunCursor &cursor);
+  bool advance(RunCursor &cursor);
+  // (key 升序, tranc_id 降序, run 从新到旧) 意义下 cursor a 是否排在 b 之后
+  bool cursor_greater(size_t a, size_t b) const;
+  // 下一个 entry 所在的 cursor, 所有 run 都结束时返回 SIZE_MAX
+  size_t top() const;
+  // 推进 top() 返回的 cursor
+  void pop(size_t idx);
+  // 跳过需要清理的版本, 定位到下一个需要输出的版本
+  void find_next();
+
+private:
+  Cursors cursors_;
+  std::vector<size_t> heap_; // kNumRuns 为 0 时, cursors_ 的下标构成的小根堆
+  uint64_t watermark_;
+  bool bottommost_;
+  std::optional<std::string> lower_key_;
+  std::optional<std::string> upper_key_;
+  std::shared_ptr<const FragmentedRangeTombstones> range_dels_;
+  std::shared_ptr<const CompactionFilter> compaction_filter_;
+
+  // 当前输出的版本, key 即为 last_key_, 复用缓冲区避免每个 entry 分配内存
+  bool valid_ = false;
+  std::string cur_value_;
+  uint64_t cur_tranc_id_ = 0;
+  bool cur_blob_index_ = false;
+
+  std::string last_key_;
+  uint64_t last_tranc_id_ = 0;
+  bool has_last_ = false;
+  // 当前 key 在 watermark 以下的最新版本已经处理过, 剩余的版本都可以丢弃
+  bool last_key_done_ = false;
+};
+
+using CompactIterator = BasicCompactIterator<>;
+// 两个 level 之间的 compact 使用
+using TwoRunCompactIterator = BasicCompactIterator<2>;
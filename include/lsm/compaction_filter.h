@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// compact 时对每个 key 的可见版本调用, 用于丢弃不再需要的数据 (例如已过期的
+// value), 不需要在读路径上额外查询或者把读取转换为删除
+// 只会作用于 tranc_id 不超过 watermark 的最新版本, 对所有事务都不可见的旧版本
+// 直接被清理, 可能被活跃事务看到的版本不会传给 filter
+// ! 删除标记和 BlobIndex 不会传给 filter
+class CompactionFilter {
+public:
+  virtual ~CompactionFilter() = default;
+
+  virtual std::string name() const = 0;
+
+  // 返回 true 表示丢弃该版本: 输出为最底层时直接丢弃, 否则替换为删除标记,
+  // 避免更底层的旧版本重新可见
+  // compact 会在多个线程中并发执行, 实现需要是线程安全的
+  virtual bool filter(std::string_view key, std::string_view value) const = 0;
+};
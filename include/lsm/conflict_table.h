@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 记录每个 key 最近一次被提交写入时的提交序号(commit_seq), 用于事务提交时
+ * 的冲突检测; 每次提交分配一个递增的 commit_seq, 事务开始时记下当时的序号
+ * begin_seq, 表中 key 的 commit_seq 大于 begin_seq 说明事务开始之后有其他
+ * 写入提交了这个 key
+ * 按 key 的哈希分为多个分段, 每个分段有自己的锁, 不同 key 的提交互不阻塞
+ *
+ * 每个分段的容量有限, 超出容量时:
+ * 1. 先清理 commit_seq 不大于 watermark (活跃事务中最小的 begin_seq) 的记录,
+ *    它们不会与任何活跃事务或之后的事务冲突, 清理后不影响检测结果
+ * 2. 仍然超出时淘汰一部分记录, 并记下被淘汰的最大 commit_seq,
+ *    之后不在表中的 key 无法确定是否冲突, 需要调用者去 memtable 和 sst 查询
+ *
+ * 范围查询的冲突检测: 每个分段还按 commit_seq 的顺序记录最近提交的 key,
+ * 以及持有分段锁的提交者正在写入的 key; 校验时只检查事务开始之后提交的
+ * 和正在提交的 key 是否位于范围内, 与范围的大小无关, 也不需要其他分段的锁
+ */
+class ConflictTable {
+public:
+  enum class CheckResult {
+    NoConflict,
+    Conflict,
+    Unknown, // key 可能被淘汰了, 需要查询 memtable 和 sst
+  };
+
+  ConflictTable(size_t num_stripes, size_t stripe_capacity);
+
+  // 清理记录时使用的 watermark, 没有设置时只能淘汰记录
+  void set_watermark_callback(std::function<uint64_t()> callback);
+
+  // 按分段编号的顺序锁住 keys 所在的全部分段, 避免死锁
+  // 返回的锁释放之前, 其他提交者无法修改这些 key 的记录
+  std::vector<std::unique_lock<std::mutex>>
+  lock_keys(const std::vector<std::string> &keys);
+
+  // 检查 begin_seq 之后是否有其他写入提交了 key
+  // ! 调用者需要通过 lock_keys 持有 key 所在分段的锁
+  CheckResult check(const std::string &key, uint64_t begin_seq) const;
+  // 记录 key 在 commit_seq 被提交写入
+  // ! 调用者需要通过 lock_keys 持有 key 所在分段的锁
+  void record(const std::string &key, uint64_t commit_seq);
+
+  // 登记将要写入的 keys, 需要在校验之前调用, 之后 record 或者 clear_pending
+  // 同时校验的范围查询会看到这些 key, 即使提交最终失败(只会导致误判冲突)
+  // ! 调用者需要通过 lock_keys 持有 key 所在分段的锁
+  void add_pending(const std::vector<std::string> &keys);
+  // 提交失败时撤销 add_pending 的登记
+  void clear_pending(const std::vector<std::string> &keys);
+  // 检查 begin_seq 之后提交的, 以及其他提交者正在写入的 key 中是否有
+  // in_range 的 key; held 为调用者通过 lock_keys 持有的锁, 这些分段中
+  // 正在写入的是调用者自己的 key; 返回 Unknown 时近期的记录已经被淘汰
+  CheckResult
+  check_range(const std::function<bool(const std::string &)> &in_range,
+              uint64_t begin_seq,
+              const std::vector<std::unique_lock<std::mutex>> &held) const;
+
+  // 全部分段中的记录数
+  size_t size() const;
+
+private:
+  struct Stripe {
+    mutable std::mutex mtx;
+    std::unordered_map<std::string, uint64_t> latest; // {key, commit_seq}
+    uint64_t evicted_max = 0; // 被淘汰的记录中最大的 commit_seq
+
+    // 以下成员由 log_mtx 保护, 范围查询的校验不需要持有分段的锁
+    mutable std::mutex log_mtx;
+    std::vector<std::string> pending; // 持有分段锁的提交者正在写入的 key
+    std::deque<std::pair<uint64_t, std::string>> recent; // {commit_seq, key}
+    uint64_t recent_evicted_max = 0; // 从 recent 中淘汰的最大 commit_seq
+  };
+
+  size_t stripe_index(const std::string &key) const;
+  void shrink(Stripe &stripe);
+  // ! 调用者需要持有 stripe.log_mtx
+  void shrink_recent(Stripe &stripe);
+
+private:
+  std::vector<Stripe> stripes_;
+  size_t stripe_capacity_;
+  std::function<uint64_t()> watermark_callback_;
+};
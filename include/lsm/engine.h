@@ -2,34 +2,114 @@
 
 #include "../memtable/memtable.h"
 #include "../sst/sst.h"
+#include "../utils/perf_context.h"
+#include "../utils/prefix_extractor.h"
+#include "../utils/statistics.h"
+#include "../utils/thread_pool.h"
+#include "column_family.h"
 #include "compact.h"
+#include "merge_iterator.h"
+#include "compaction_filter.h"
+#include "merge_operator.h"
+#include "options.h"
+#include "range_iterator.h"
+#include "replication.h"
+#include "row_cache.h"
+#include "snapshot.h"
+#include "sst_file_writer.h"
 #include "transaction.h"
 #include "two_merge_iterator.h"
+#include "version.h"
+#include "write_batch.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <deque>
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
 class Level_Iterator;
+template <size_t kNumRuns> class BasicCompactIterator;
+
+// 合并多组范围删除标记, 只有一组时直接复用, 没有时返回 nullptr
+std::shared_ptr<const FragmentedRangeTombstones> merge_range_tombstones(
+    const std::vector<std::shared_ptr<const FragmentedRangeTombstones>> &sets);
+
+// 每一层 sst 的数量和总大小
+struct LevelStats {
+  size_t level;
+  size_t num_ssts;
+  size_t bytes;
+};
+
+// get_stats 返回的统计信息: 累加的计数器, 各操作的延迟直方图和当前的状态
+struct EngineStats {
+  std::array<uint64_t, kTickerNum> tickers{};
+  std::array<HistogramData, kHistogramNum> histograms;
+  size_t memtable_bytes = 0;        // 活跃表占用的内存
+  size_t frozen_memtable_bytes = 0; // 等待刷盘的冻结表占用的内存
+  size_t block_cache_usage = 0;
+  double block_cache_hit_rate = 0;
+  size_t row_cache_usage = 0; // 没有开启行缓存时为 0
+  std::vector<LevelStats> levels; // 按 level 升序, 只包含非空的 level
+
+  uint64_t ticker(Ticker ticker) const;
+  const HistogramData &histogram(HistogramType type) const;
+  // 过滤器判断可能存在, 但 sst 中没有找到的次数
+  uint64_t bloom_false_positive() const;
+
+  // Redis INFO 格式的文本, 由 "# Section" 开头的若干段 "name:value" 组成
+  std::string to_string() const;
+};
 
 class LSMEngine : public std::enable_shared_from_this<LSMEngine> {
 public:
   std::string data_dir;
+  // 打开时的参数, 其中可以修改的部分以 mutable_options() 为准
+  const Options options;
   MemTable memtable;
-  std::map<size_t, std::deque<size_t>> level_sst_ids;
-  std::unordered_map<size_t, std::shared_ptr<SST>> ssts;
-  std::shared_mutex ssts_mtx;
   std::shared_ptr<BlockCache> block_cache;
-  size_t next_sst_id = 0;
-  size_t cur_max_level = 0;
+  // 没有开启行缓存时为空, 写入内存表之后需要调用 invalidate_row_cache
+  std::unique_ptr<RowCache> row_cache;
+  std::atomic<size_t> next_sst_id = 0; // flush 和 compact 会并发分配 sst_id
+  // 已经刷入 sst 的最大 tranc_id, 与 sst 一起记录在 MANIFEST 中
+  std::atomic<uint64_t> flushed_tranc_id = 0;
+  // 以下四项与 options 中的同名参数相同
+  CompactType compact_type;
+  std::shared_ptr<PrefixExtractor> prefix_extractor;
+  std::shared_ptr<MergeOperator> merge_operator;
+  std::shared_ptr<CompactionFilter> compaction_filter;
+  // 管理键值分离的 blob 文件
+  std::shared_ptr<BlobStore> blob_store;
+  // 当前存活的快照, compact 会为其中最旧的快照保留旧版本
+  std::shared_ptr<SnapshotList> snapshots = std::make_shared<SnapshotList>();
+  // 读写路径, 后台任务和 WAL 共同记录的统计信息
+  std::shared_ptr<Statistics> stats = std::make_shared<Statistics>();
 
 public:
-  LSMEngine(std::string path);
+  LSMEngine(std::string path,
+            CompactType compact_type = CompactType::FullCompact,
+            std::shared_ptr<PrefixExtractor> prefix_extractor = nullptr,
+            std::shared_ptr<MergeOperator> merge_operator = nullptr,
+            std::shared_ptr<CompactionFilter> compaction_filter = nullptr);
+  // 参数不合法时抛出异常
+  LSMEngine(std::string path, const Options &options);
   ~LSMEngine();
 
+  // ****** 参数 ******
+  // 当前生效的可修改参数
+  std::shared_ptr<const MutableOptions> mutable_options() const;
+  // 原子地替换全部可修改参数, 参数不合法时抛出异常且不做修改
+  void set_options(const MutableOptions &new_options);
+
   std::optional<std::pair<std::string, uint64_t>> get(const std::string &key,
                                                       uint64_t tranc_id);
   std::vector<
@@ -39,74 +119,426 @@ public:
   std::optional<std::pair<std::string, uint64_t>>
   sst_get_(const std::string &key, uint64_t tranc_id);
 
-  // 如果触发了刷盘, 返回当前刷入sst的最大事务id
-  uint64_t put(const std::string &key, const std::string &value,
-               uint64_t tranc_id);
+  // ****** 快照 ******
+  // 创建一个可见 tranc_id 不超过 tranc_id 的快照, 持有当前的内存表和 Version
+  // 释放返回的 shared_ptr 即释放快照
+  std::shared_ptr<const Snapshot> get_snapshot(uint64_t tranc_id);
+  // 在快照上读取, 只访问快照持有的内存表和 Version
+  std::optional<std::pair<std::string, uint64_t>>
+  get(const std::string &key, const Snapshot &snapshot);
+
+  // 写入只会更新 memtable, 刷盘和 compact 交给后台线程完成
+  // 后台积压过多时(冻结表或 l0 sst 过多), 写入会被阻塞直到后台追上进度
+  void put(const std::string &key, const std::string &value,
+           uint64_t tranc_id);
 
-  uint64_t
-  put_batch(const std::vector<std::pair<std::string, std::string>> &kvs,
-            uint64_t tranc_id);
+  void put_batch(const std::vector<std::pair<std::string, std::string>> &kvs,
+                 uint64_t tranc_id);
 
-  uint64_t remove(const std::string &key, uint64_t tranc_id);
-  uint64_t remove_batch(const std::vector<std::string> &keys,
-                        uint64_t tranc_id);
+  void remove(const std::string &key, uint64_t tranc_id);
+  void remove_batch(const std::vector<std::string> &keys, uint64_t tranc_id);
+  // 删除 [begin, end) 中 tranc_id 之前的全部版本
+  void remove_range(const std::string &begin, const std::string &end,
+                    uint64_t tranc_id);
+  // 写入 merge 操作数, 不读取旧值; 读取时由 merge_operator 与旧值合并
+  // ! 操作数只存在于内存表中, 刷盘时会合并为完整的 value, sst 和 compact
+  // ! 不需要感知操作数
+  void merge(const std::string &key, const std::string &operand,
+             uint64_t tranc_id);
+  // 同一个 batch 共用一个 tranc_id, 同一个 key 的多条记录只能保留一条:
+  // merge 之前有 put / remove 时合并为一条 PUT, 只有 merge 时通过
+  // partial_merge 合并为一条 MERGE; 需要在写入 WAL 之前调用
+  void fold_batch_merges(std::vector<Record> &records) const;
+  // 写入 WriteBatch 转换而来的记录, 全部记录只获取一次 memtable 的锁
+  void write_records(const std::vector<Record> &records);
+  // 崩溃恢复时重放 WAL 中的 PUT / DELETE 记录
+  // 只写入 memtable, 不会阻塞也不会触发后台 flush
+  void replay_records(const std::vector<Record> &records);
+  // 直接写入 memtable 的记录 (例如事务提交) 需要在写入之后调用
+  void invalidate_row_cache(const std::vector<Record> &records);
   void clear();
+
+  // 同步地将最老的一个内存表刷入 l0, 返回刷入sst的最大事务id
   uint64_t flush();
 
+  // 导入 SstFileWriter 生成的 sst, 其中全部 entry 的 tranc_id 视为 tranc_id
+  // 文件之间不能重叠, 每个文件放入自身以及之上的层级都没有重叠的最深的层级,
+  // 通过硬链接加入数据目录, 不重写文件; 内存表不为空时会先全部刷盘
+  // 文件不合法时抛出异常, 不会导入其中任何一个文件
+  void ingest_external_files(const std::vector<std::string> &paths,
+                             uint64_t tranc_id);
+
+  // 在 dir 中创建当前 Version 的检查点: sst 和 blob 文件不会再修改, 只需要
+  // 硬链接, 然后写入只包含该 Version 的 MANIFEST; 不会刷盘内存表, 可以与
+  // flush / compact 同时进行. 返回检查点中已经刷盘的最大事务id
+  uint64_t create_checkpoint(const std::string &dir);
+
+  // 每次 flush 完成后的回调, 参数为刷入sst的最大事务id
+  void set_flush_callback(std::function<void(uint64_t)> callback);
+
+  // compact 清理旧版本时使用的 watermark, 即活跃事务中最小的 tranc_id
+  // 没有设置时 watermark 为 0, 保留所有版本
+  void set_gc_watermark_callback(std::function<uint64_t()> callback);
+
+  // memtable 超过大小限制, 或者 WriteBufferManager 要求刷盘时, 提交后台
+  // flush 任务
+  void schedule_flush_if_needed();
+
+  // 阻塞直到后台没有待执行的 flush / compact 任务
+  void wait_for_bg_jobs();
+
   std::string get_sst_path(size_t sst_id, size_t target_level);
 
-  std::optional<std::pair<TwoMergeIterator, TwoMergeIterator>>
+  // 汇总统计信息, 同时读取内存表, 各层 sst 和缓存池的当前状态
+  EngineStats get_stats();
+
+  // 当前的 Version, 读者持有返回的指针期间其中的 sst 都不会被删除
+  std::shared_ptr<const Version> current_version() const;
+
+  std::optional<std::pair<MergeIterator, MergeIterator>>
   lsm_iters_monotony_predicate(
       uint64_t tranc_id, std::function<int(const std::string &)> predicate);
 
+  // 前缀查询, 会根据 sst 的前缀过滤器跳过不包含该前缀的 sst
+  std::optional<std::pair<MergeIterator, MergeIterator>>
+  lsm_iters_preffix(uint64_t tranc_id, const std::string &preffix);
+
+  std::optional<std::pair<MergeIterator, MergeIterator>>
+  lsm_iters_monotony_predicate(
+      const Snapshot &snapshot,
+      std::function<int(const std::string &)> predicate);
+
   Level_Iterator begin(uint64_t tranc_id);
+  Level_Iterator begin(const Snapshot &snapshot);
   Level_Iterator end();
 
-  static size_t get_sst_size(size_t level);
+  // 在 mem_tables 和 version 上从第一个不小于 key 的 key 开始遍历
+  // 各个数据源直接二分定位到 key, 与 [key, upper_bound) 不相交的 sst 不会打开,
+  // 读到 upper_bound 即结束, 之后的 block 不会读取
+  // ! 迭代器持有 this, 不能在引擎析构之后使用
+  MergeIterator
+  seek_iter(uint64_t tranc_id, const std::string &key,
+            const std::optional<std::string> &upper_bound,
+            const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+            const std::shared_ptr<const Version> &version);
+  // 反向遍历: 从最后一个不大于 key 的 key 开始 (key 为空时从最后一个 key
+  // 开始), 读到小于 lower_bound 的 key 即结束
+  MergeIterator
+  seek_for_prev_iter(uint64_t tranc_id, const std::optional<std::string> &key,
+                     const std::optional<std::string> &lower_bound,
+                     const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+                     const std::shared_ptr<const Version> &version);
+
+  size_t get_sst_size(size_t level) const;
+  // leveled compact 中每一层的目标总大小
+  size_t get_level_target_size(size_t level) const;
+
+  // 内存表中找到的 key 的最新版本是 merge 操作数时, 在 tables 和 version 中
+  // 向旧版本收集操作数直到遇到完整的 value 或者删除, 再按从旧到新的顺序合并
+  // 返回的 tranc_id 为最新的操作数的 tranc_id
+  std::optional<std::pair<std::string, uint64_t>>
+  merge_get_(const std::string &key, uint64_t tranc_id,
+             const std::vector<std::shared_ptr<SkipList>> &tables,
+             const Version &version);
 
 private:
+  // ****** 后台任务 ******
+  void schedule_compact_if_needed();
+  bool need_compact();
+  bool need_stall_write();
+  // 距离阻塞写入的程度, 0 表示没有积压, 1 表示已经阻塞, 用于自动调节限速
+  double compaction_debt();
+  void report_compaction_debt();
+  void maybe_stall_write();
+  void bg_flush();
+  void bg_compact();
+  size_t get_level_sst_num(size_t level);
+
   void full_compact(size_t src_level);
   std::vector<std::shared_ptr<SST>>
-  full_l0_l1_compact(std::vector<size_t> &l0_ids, std::vector<size_t> &l1_ids);
+  full_l0_l1_compact(std::vector<std::shared_ptr<SST>> &l0_ssts,
+                     std::vector<std::shared_ptr<SST>> &l1_ssts);
+
+  std::vector<std::shared_ptr<SST>>
+  full_common_compact(std::vector<std::shared_ptr<SST>> &lx_ssts,
+                      std::vector<std::shared_ptr<SST>> &ly_ssts,
+                      size_t level_y, size_t target_sst_size);
+
+  // ****** leveled compact ******
+  // 返回分数最高且需要 compact 的 level
+  std::optional<size_t> pick_leveled_compact_level();
+  void leveled_compact(size_t src_level);
+
+  // ****** tiered compact ******
+  std::optional<TieredCompactTask> pick_tiered_compact_task();
+  void tiered_compact(const TieredCompactTask &task);
+  // 将 level 的 sorted run 整体移动到 level + 1, 只需要重命名文件
+  void move_level_down(size_t level);
+
+  // ****** Version ******
+  // 重放 MANIFEST 并打开其中的 sst, 清理崩溃时留下的文件
+  void recover_version();
+  // 在当前 Version 上应用 edit 并发布, 同时追加到 MANIFEST
+  // 被删除的 sst 会在最后一个持有它的 Version 释放后删除文件
+  void install_version(VersionEdit edit,
+                       const std::vector<std::shared_ptr<SST>> &new_ssts);
+  // 删除 inputs 中的全部 sst, 并将 new_ssts 添加到 output_level
+  VersionEdit compact_edit(
+      const std::vector<std::pair<size_t, std::vector<std::shared_ptr<SST>>>>
+          &inputs,
+      size_t output_level, const std::vector<std::shared_ptr<SST>> &new_ssts);
+  std::string get_manifest_path();
+
+  // ****** 旧版本清理 ******
+  // 活跃事务和存活快照中最小的 tranc_id
+  uint64_t get_gc_watermark();
+  // level 之下是否不存在更旧的数据, 是的话 compact 可以丢弃删除标记
+  bool is_bottommost_level(size_t level);
+  // runs 按从新到旧的顺序排列, 合并后输出到 target_level
+  // 输入较大时按 key 范围拆分为多个子任务, 在 compact_pool 中并行执行
+  std::vector<std::shared_ptr<SST>>
+  compact_sorted_runs(std::vector<std::vector<std::shared_ptr<SST>>> runs,
+                      size_t target_sst_size, size_t target_level);
+  // 根据输入 sst 的 block 边界选取子任务之间的分割 key, 不需要拆分时返回空
+  std::vector<std::string> pick_subcompact_split_keys(
+      const std::vector<std::vector<std::shared_ptr<SST>>> &runs);
+  // 合并 runs 中 [lower_key, upper_key) 范围内的 key
+  // 两个 run 时使用定长的 TwoRunCompactIterator, 否则使用基于堆的版本
+  std::vector<std::shared_ptr<SST>>
+  compact_range(std::vector<std::vector<std::shared_ptr<SST>>> runs,
+                uint64_t watermark, bool bottommost,
+                std::optional<std::string> lower_key,
+                std::optional<std::string> upper_key, size_t target_sst_size,
+                size_t target_level);
 
+  // 输出 iter 中的全部版本, BlobIndex 会被直接复制, 只有位于较旧的 blob
+  // 文件中的 value 会被重写到新的 blob 文件
+  // iter 为具体的 BasicCompactIterator 类型, 循环中的调用不经过虚函数
+  // range_dels 为需要输出的范围删除标记, 按 begin 升序排列, 切分 sst 时在边界
+  // 处截断
+  template <size_t kNumRuns>
   std::vector<std::shared_ptr<SST>>
-  full_common_compact(std::vector<size_t> &lx_ids, std::vector<size_t> &ly_ids,
-                      size_t level_y);
+  gen_sst_from_iter(BasicCompactIterator<kNumRuns> &iter,
+                    std::vector<RangeTombstone> range_dels,
+                    size_t target_sst_size, size_t target_level);
+  // level 层的 sst 是否需要固定元数据
+  bool pin_level_meta(size_t level);
+  // level 层的 sst 使用的过滤器类型和 block 压缩算法
+  FilterType level_filter_type(size_t level);
+  CompressionType level_compression(size_t level);
+  // 写入 level 层的文件时使用的限速优先级, l0 为 flush, l1 为 l0 的 compact
+  IOPriority level_io_priority(size_t level);
+  // 导入的 [first_key, last_key] 所在的层级, 见 ingest_external_files
+  size_t pick_ingest_level(const Version &version, const std::string &first_key,
+                           const std::string &last_key);
+  SSTBuilder new_sst_builder(size_t level);
+  std::unique_ptr<BlobFileBuilder> new_blob_builder(size_t level);
+  // 用 merge_operator 将 operands (从旧到新) 合并到 base 上,
+  // 操作数无法合并时保留 base, 结果为空表示 key 不存在
+  std::optional<std::string>
+  full_merge_(const std::string &key, const std::optional<std::string> &base,
+              const std::vector<std::string_view> &operands) const;
+  // 内存表刷盘时输出的记录, 其中的 merge 操作数被合并为对应版本的完整 value
+  std::vector<std::tuple<std::string, std::string, uint64_t>>
+  flush_entries_(const std::shared_ptr<SkipList> &table);
+  // 在 version 中查询 key, 不访问 memtable
+  // covering 为内存表中覆盖 key 的范围删除标记的最大 tranc_id
+  // record_get 为 true 时把这次查询计入 get 的命中层级和 SstPerGet 中,
+  // merge 和 flush 内部的查询只记录过滤器的统计
+  std::optional<std::pair<std::string, uint64_t>>
+  version_get_(const std::string &key, uint64_t tranc_id,
+               const Version &version, uint64_t covering = 0,
+               bool record_get = false);
+  // 内存表中存在 merge 操作数时, 返回在同一组内存表和 Version 上合并的
+  // resolver, 否则返回 nullptr
+  MergeIterator::MergeResolver
+  merge_resolver_(uint64_t tranc_id,
+                  const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+                  const std::shared_ptr<const Version> &version);
+  // preffix 不为空时, 只查询可能包含该前缀的 sst
+  // snapshot 不为空时, 在快照持有的内存表和 Version 上查询
+  std::optional<std::pair<MergeIterator, MergeIterator>>
+  iters_monotony_predicate_(uint64_t tranc_id,
+                            std::function<int(const std::string &)> predicate,
+                            const std::string *preffix,
+                            const Snapshot *snapshot);
 
-  std::vector<std::shared_ptr<SST>> gen_sst_from_iter(BaseIterator &iter,
-                                                      size_t target_sst_size,
-                                                      size_t target_level);
+private:
+  std::mutex flush_mtx;   // 保证冻结表按从旧到新的顺序刷盘
+  std::mutex compact_mtx; // 同一时间只允许一个 compact 任务
+  std::mutex version_mtx; // 串行化 Version 的安装和 MANIFEST 的写入
+  std::atomic<std::shared_ptr<const Version>> version_{
+      std::make_shared<const Version>()};
+  std::atomic<std::shared_ptr<const MutableOptions>> mutable_options_;
+  std::unique_ptr<Manifest> manifest;
+  std::atomic<bool> flush_scheduled = false;
+  // WriteBufferManager 要求刷盘, 下一次 bg_flush 会刷入全部内存表
+  std::atomic<bool> flush_requested = false;
+  // 注册在 options.write_buffer_manager 中的成员, 没有设置时为空
+  std::shared_ptr<WriteBufferManager::Member> write_buffer_member;
+  std::atomic<bool> compact_scheduled = false;
+  std::atomic<bool> bg_stop = false;
+  std::mutex stall_mtx;
+  std::condition_variable stall_cv; // 后台任务有进展时唤醒被阻塞的写入
+  std::mutex callback_mtx; // 回调可能在后台任务运行期间被设置
+  std::function<void(uint64_t)> flush_callback;
+  std::function<uint64_t()> gc_watermark_callback;
+  // 每一层上一次被 leveled compact 选中的 sst 的 last_key, 用于轮转选取
+  std::map<size_t, std::string> compact_cursor;
+  // compact 子任务使用的线程池, 需要在 bg_pool 之后析构
+  std::unique_ptr<ThreadPool> compact_pool;
+  // ! 需要放在最后, 保证析构时其他成员仍然有效
+  std::unique_ptr<ThreadPool> bg_pool;
 };
 
 class LSM {
 private:
-  std::shared_ptr<LSMEngine> engine;
+  std::string path_;
+  std::shared_ptr<LSMEngine> engine; // 默认列族
   std::shared_ptr<TranManager> tran_manager_;
+  std::shared_ptr<ColumnFamilySet> column_families_;
+  std::mutex column_family_mtx_; // 串行化列族的创建
+  // 从节点已经应用的位置, 见 apply_replication_batch
+  std::mutex replication_mtx_;
+  std::optional<WalPosition> replication_position_;
+  WalRecoveryStats recovery_stats_;
+
+  std::string get_column_family_file_path() const;
+  std::string get_replication_file_path() const;
+  std::shared_ptr<ColumnFamilyHandle>
+  open_column_family(uint32_t id, const std::string &name,
+                     const Options &options);
+  // 列族的引擎回调 TranManager, 更新刷盘进度和 gc watermark
+  void set_engine_callbacks(LSMEngine &cf_engine);
+  // 不存在时抛出异常
+  std::shared_ptr<LSMEngine> get_cf_engine(uint32_t cf_id) const;
+  // 将 WAL 中的记录重放到所属列族的内存表, 跳过已经刷入该列族 sst 的记录
+  void replay_records(std::vector<Record> &records);
 
 public:
-  LSM(std::string path);
+  LSM(std::string path, CompactType compact_type = CompactType::FullCompact,
+      std::shared_ptr<PrefixExtractor> prefix_extractor = nullptr,
+      std::shared_ptr<MergeOperator> merge_operator = nullptr,
+      std::shared_ptr<CompactionFilter> compaction_filter = nullptr);
+  // 参数不合法时抛出异常
+  LSM(std::string path, const Options &options);
+  // 同时打开 column_families 中的列族, 不存在的列族会被创建
+  // 之前创建过但不在 column_families 中的列族使用默认参数打开, 保证 WAL 中
+  // 它们的记录可以被重放
+  LSM(std::string path, const Options &options,
+      const std::vector<ColumnFamilyDescriptor> &column_families);
   ~LSM();
 
+  // ****** 列族 ******
+  // 不带列族参数的接口都访问默认列族
+  std::shared_ptr<ColumnFamilyHandle> default_column_family() const;
+  // 创建新的列族, 名称已经存在时抛出异常
+  std::shared_ptr<ColumnFamilyHandle>
+  create_column_family(const std::string &name, const Options &options = {});
+  // 不存在时返回 nullptr
+  std::shared_ptr<ColumnFamilyHandle>
+  get_column_family(const std::string &name) const;
+  // 包括默认列族, 按 id 升序排列
+  std::vector<std::shared_ptr<ColumnFamilyHandle>> list_column_families() const;
+
+  std::optional<std::string> get(const ColumnFamilyHandle &cf,
+                                 const std::string &key);
+  void put(const ColumnFamilyHandle &cf, const std::string &key,
+           const std::string &value);
+  void remove(const ColumnFamilyHandle &cf, const std::string &key);
+  RangeIterator new_iterator(const ColumnFamilyHandle &cf,
+                             ReadOptions options = {});
+
+  // 读取最新的数据, 不需要分配事务id
   std::optional<std::string> get(const std::string &key);
+  // 读取 tranc_id 及之前写入的数据, 用于读取自己刚写入的结果
+  std::optional<std::string> get(const std::string &key, uint64_t tranc_id);
   std::vector<std::pair<std::string, std::optional<std::string>>>
   get_batch(const std::vector<std::string> &keys);
 
+  // 创建当前数据的快照, 用于不需要开启事务的长时间读取
+  // 释放返回的 shared_ptr 即释放快照, 之后 compact 可以清理它需要的旧版本
+  std::shared_ptr<const Snapshot> get_snapshot();
+  std::optional<std::string> get(const std::string &key,
+                                 const Snapshot &snapshot);
+
   void put(const std::string &key, const std::string &value);
   void put_batch(const std::vector<std::pair<std::string, std::string>> &kvs);
 
   void remove(const std::string &key);
   void remove_batch(const std::vector<std::string> &keys);
+  // 删除 [begin, end) 中的全部 key, 只写入一条范围删除标记
+  // ! 范围删除不参与事务的冲突检测
+  void remove_range(const std::string &begin, const std::string &end);
+  // 写入 merge 操作数, 返回这次写入的 tranc_id
+  // 需要在构造时指定 MergeOperator
+  uint64_t merge(const std::string &key, const std::string &operand);
+
+  // 原子地应用 batch 中的全部操作, 写入 WAL 后再写入 memtable
+  // 之后 batch 为空, 可以继续复用; 返回 batch 使用的 tranc_id, 空 batch 返回 0
+  uint64_t write(WriteBatch &&batch);
+
+  // 导入 SstFileWriter 生成的文件, 全部文件共用一个新的 tranc_id 并返回
+  // 见 LSMEngine::ingest_external_files; ! 与范围删除一样不参与冲突检测
+  uint64_t ingest_external_files(const std::vector<std::string> &paths);
+  uint64_t ingest_external_files(const ColumnFamilyHandle &cf,
+                                 const std::vector<std::string> &paths);
+
+  // 在不存在的目录 dir 中创建检查点, 可以作为新的数据目录打开
+  // 先刷盘全部内存表, 然后硬链接各个列族的 sst, 并复制 WAL 和 tranc_id 文件;
+  // 不会阻塞读写和 compact, 期间提交的事务可能出现在检查点中, 但不会只有一部分
+  void create_checkpoint(const std::string &dir);
+
+  // ****** 复制 ******
+  // 主节点的 WAL 作为复制流, 从节点拉取之后写入自己的 WAL 和内存表
+  // 不经过事务的写入需要开启 Options::wal_all_writes 才会出现在复制流中,
+  // ingest_external_files 导入的数据和列族的创建不会复制
+  // 主节点: 当前 WAL 的末尾, 之后提交的事务都可以从这里读取
+  WalPosition get_wal_position();
+  // 主节点: 读取 from 之后已经提交的事务, from 已经不可用时抛出异常,
+  // 此时从节点需要从新的检查点重新同步
+  ReplicationBatch
+  read_replication_log(const WalPosition &from,
+                       size_t max_bytes = LSM_REPLICATION_BATCH_BYTES);
+  // 从节点: 先写入本地 WAL, 再写入各个列族的内存表, 然后记录 batch.next
+  // 读取在应用之后才能看到 batch 中的事务; 记录的 tranc_id 与主节点相同,
+  // 在保存位置之前崩溃时会重复应用, 重复的 put / remove 不会改变结果
+  void apply_replication_batch(const ReplicationBatch &batch);
+  // 从节点: 已经应用的位置, 从主节点的检查点打开时为创建检查点时主节点的位置
+  std::optional<WalPosition> get_replication_position();
 
   using LSMIterator = Level_Iterator;
+  // 可以定位的范围迭代器, 边界和 seek 下推到各层, 见 RangeIterator
+  RangeIterator new_iterator(ReadOptions options = {});
   LSMIterator begin(uint64_t tranc_id);
+  LSMIterator begin(const Snapshot &snapshot);
   LSMIterator end();
-  std::optional<std::pair<TwoMergeIterator, TwoMergeIterator>>
+  std::optional<std::pair<MergeIterator, MergeIterator>>
   lsm_iters_monotony_predicate(
       uint64_t tranc_id, std::function<int(const std::string &)> predicate);
+  std::optional<std::pair<MergeIterator, MergeIterator>>
+  lsm_iters_monotony_predicate(
+      const Snapshot &snapshot,
+      std::function<int(const std::string &)> predicate);
+  std::optional<std::pair<MergeIterator, MergeIterator>>
+  lsm_iters_preffix(uint64_t tranc_id, const std::string &preffix);
+  // 清空全部列族的数据
   void clear();
   void flush();
+  // 将全部列族的内存表刷盘
   void flush_all();
 
+  // 启动时 WAL 恢复的耗时和吞吐
+  const WalRecoveryStats &get_recovery_stats() const;
+  // 运行期间的统计信息, 见 EngineStats
+  EngineStats get_stats();
+
+  // 打开时的参数, 其中可以修改的部分以 get_mutable_options 为准
+  const Options &get_options() const;
+  MutableOptions get_mutable_options() const;
+  // 在运行期间修改写入阻塞和 compact 的参数, 参数不合法时抛出异常
+  void set_options(const MutableOptions &options);
+
   // 开启一个事务
   std::shared_ptr<TranContext>
   begin_tran(const IsolationLevel &isolation_level);
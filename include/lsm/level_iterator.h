@@ -1,20 +1,29 @@
 #pragma once
 #include "../iterator/iterator.h"
+#include "../utils/range_tombstone.h"
 #include <memory>
 #include <optional>
-#include <shared_mutex>
+#include <string>
+#include <vector>
 
 class LSMEngine;
+class SkipList;
+class Snapshot;
+class Version;
 
 class Level_Iterator : public BaseIterator {
 public:
   Level_Iterator() = default;
   Level_Iterator(std::shared_ptr<LSMEngine> engine_, uint64_t max_tranc_id);
+  // 遍历快照持有的内存表和 Version
+  Level_Iterator(std::shared_ptr<LSMEngine> engine_, const Snapshot &snapshot);
 
   virtual BaseIterator &operator++() override;
   virtual bool operator==(const BaseIterator &other) const override;
   virtual bool operator!=(const BaseIterator &other) const override;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
   virtual IteratorType get_type() const override;
   virtual uint64_t get_tranc_id() const override;
   virtual bool is_end() const override;
@@ -28,10 +37,24 @@ private:
   size_t cur_idx_;
   uint64_t max_tranc_id_;
   mutable std::optional<value_type> cached_value; // 缓存当前值
-  std::shared_lock<std::shared_mutex> rlock_;
+  std::string cur_key_; // 跳过当前 key 时使用, 推进后 key() 不再有效
+  // 迭代期间持有的 Version, 保证其中的 sst 不会被删除
+  std::shared_ptr<const Version> version_;
+  // 内存表和 version_ 中全部的范围删除标记, 没有时为 nullptr
+  std::shared_ptr<const FragmentedRangeTombstones> range_dels_;
+  // 遍历的内存表, 合并 merge 操作数时使用
+  std::vector<std::shared_ptr<SkipList>> mem_tables_;
+  // 当前 key 的最新版本是 merge 操作数时, 合并后的 value
+  std::optional<std::string> merged_value_;
 
 private:
+  // 在 version_ 和内存部分的迭代器上构建各层的迭代器
+  void init(HeapIterator mem_iter,
+            const std::vector<std::shared_ptr<SkipList>> &mem_tables);
+  // 重新选择 key 最小的迭代器, 跳过被删除的 key
+  void find_next();
+  bool range_deleted() const;
   void update_current() const;
-  std::pair<size_t, std::string> get_min_key_idx() const;
-  void skip_key(const std::string &key);
+  size_t get_min_key_idx() const;
+  void skip_key(std::string_view key);
 };
\ No newline at end of file
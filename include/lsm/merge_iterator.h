@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../iterator/iterator.h"
+#include "../utils/range_tombstone.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 多路归并的读迭代器, 每个数据源只持有一个游标, 按需推进, 不会提前读取整个范围
+// 1. sources 按从新到旧的顺序排列 (活跃表, 冻结表, l0 的 sst, 其他层),
+//    每个数据源按 key 升序输出, 同一个 key 的多个版本按 tranc_id 降序
+// 2. 同一个 key 以最新的数据源中第一个可见的版本为准, value 为空表示被删除,
+//    会直接跳过
+// 3. predicate 不为空时, 数据源遇到位于谓词范围右侧(返回 <0)的 key 即结束,
+//    调用者需要保证每个数据源的起点不位于范围左侧;
+//    bound 不为空时, 数据源遇到不小于它的 key 即结束 (反向遍历时为小于),
+//    只比较字符串, 不需要每个 key 调用一次谓词
+// 4. 比较和去重都基于数据源的 key() / value() 视图, 输出的记录留在数据源中,
+//    直到下一次 ++ 才推进, 遍历过程中不复制键值对
+// 5. range_dels 为 (数据源下标, 范围删除标记) 的列表, 按下标升序排列,
+//    与点查一致, 来自数据源 i 的版本只检查下标不超过 i 的标记,
+//    被其中可见且 tranc_id 更大的标记覆盖时视为被删除
+// 6. 输出的版本是 merge 操作数时, 通过 resolver 得到合并后的 value,
+//    value() 此时指向迭代器内部的缓冲区; resolver 返回空表示 key 不存在
+// 7. reverse 为 true 时反向遍历: 数据源按 key 降序输出 (通过 operator--),
+//    每个 key 只输出对 max_tranc_id 可见的最新版本, ++ 移动到前一个 key,
+//    此时不支持 predicate
+class MergeIterator : public BaseIterator {
+public:
+  using RangeDelSources = std::vector<
+      std::pair<size_t, std::shared_ptr<const FragmentedRangeTombstones>>>;
+  using MergeResolver =
+      std::function<std::optional<std::string>(const std::string &key)>;
+
+  MergeIterator() = default;
+  MergeIterator(std::vector<std::shared_ptr<BaseIterator>> sources,
+                uint64_t max_tranc_id,
+                std::function<int(const std::string &)> predicate = nullptr,
+                RangeDelSources range_dels = {},
+                MergeResolver resolver = nullptr,
+                std::optional<std::string> bound = std::nullopt,
+                bool reverse = false);
+
+  virtual BaseIterator &operator++() override;
+  virtual bool operator==(const BaseIterator &other) const override;
+  virtual bool operator!=(const BaseIterator &other) const override;
+  virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
+  virtual IteratorType get_type() const override;
+  // 与其他合并迭代器一致, 返回的是可见性上限
+  virtual uint64_t get_tranc_id() const override;
+  virtual bool is_end() const override;
+  virtual bool is_valid() const override;
+
+  pointer operator->() const;
+
+private:
+  struct Cursor {
+    std::shared_ptr<BaseIterator> iter;
+    std::string_view key; // 当前位置的 key, 在 iter 推进之前有效
+    uint64_t tranc_id = 0;
+  };
+
+  // 读取 cursor 当前位置的记录, 数据源已经结束时返回 false
+  bool load(Cursor &cursor);
+  // (key 按遍历方向排列, 数据源从新到旧) 意义下 cursor a 是否排在 b 之后
+  bool cursor_greater(size_t a, size_t b) const;
+  // 弹出堆顶的 cursor, 返回其下标
+  size_t pop();
+  // 按遍历方向推进 cursor, 数据源没有结束时重新入堆
+  void advance(size_t idx);
+  // cursor 当前的版本是否被范围删除标记覆盖
+  bool range_deleted(size_t idx) const;
+  // 推进 cursor 以及其他数据源中所有等于 cur_key_ 的记录
+  void skip_cur_key(size_t idx);
+  // 定位到下一个可见且没有被删除的 key
+  void find_next();
+
+private:
+  std::vector<Cursor> cursors_;
+  std::vector<size_t> heap_; // cursors_ 的下标构成的堆, 堆顶为下一个输出
+  uint64_t max_tranc_id_ = 0;
+  std::function<int(const std::string &)> predicate_;
+  RangeDelSources range_dels_;
+  MergeResolver resolver_;
+  std::optional<std::string> bound_;
+  bool reverse_ = false;
+  std::optional<std::string> merged_value_; // 当前 key 合并后的 value
+  std::string predicate_key_; // 调用谓词时复用的缓冲区
+  size_t cur_idx_ = SIZE_MAX;  // 输出当前记录的 cursor, SIZE_MAX 表示结束
+  std::string cur_key_;        // 当前 key 的副本, 推进 cursor 后用于去重
+  mutable std::optional<value_type> cur_; // operator-> 使用的缓存
+};
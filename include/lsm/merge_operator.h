@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 读-改-写操作的合并逻辑, 写入时只追加操作数 (merge operand), 不读取旧值,
+// 读取或者刷盘时再把操作数按从旧到新的顺序合并到基础值上
+// ! 空的操作数会被忽略: 引擎中空 value 表示删除, 操作数不能为空
+class MergeOperator {
+public:
+  virtual ~MergeOperator() = default;
+
+  virtual std::string name() const = 0;
+
+  // 将 operands (从旧到新) 依次合并到 existing 上, existing 为空表示 key
+  // 不存在 (或者已经被删除); 结果写入 result
+  // 返回 false 表示操作数无法合并 (例如对非数字做加法), 此时保留 existing
+  virtual bool full_merge(std::string_view key,
+                          const std::optional<std::string_view> &existing,
+                          const std::vector<std::string_view> &operands,
+                          std::string &result) const = 0;
+
+  // 把相邻的两个操作数 (left 更旧) 合并为一个, 用于同一个 WriteBatch 中
+  // 对同一个 key 的多次 merge; 不支持时返回 false
+  virtual bool partial_merge(std::string_view key, std::string_view left,
+                             std::string_view right,
+                             std::string &result) const {
+    return false;
+  }
+};
+
+// value 和操作数都是十进制的 int64, 合并为求和, 不存在的 key 视为 0
+class Int64AddOperator : public MergeOperator {
+public:
+  std::string name() const override;
+  bool full_merge(std::string_view key,
+                  const std::optional<std::string_view> &existing,
+                  const std::vector<std::string_view> &operands,
+                  std::string &result) const override;
+  bool partial_merge(std::string_view key, std::string_view left,
+                     std::string_view right,
+                     std::string &result) const override;
+
+  // 解析十进制的 int64, 格式错误或者溢出时返回空
+  static std::optional<int64_t> parse(std::string_view str);
+};
+
+// 操作数依次追加到 value 的末尾
+class StringAppendOperator : public MergeOperator {
+public:
+  std::string name() const override;
+  bool full_merge(std::string_view key,
+                  const std::optional<std::string_view> &existing,
+                  const std::vector<std::string_view> &operands,
+                  std::string &result) const override;
+  bool partial_merge(std::string_view key, std::string_view left,
+                     std::string_view right,
+                     std::string &result) const override;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../block/block_cache.h"
+#include "../consts.h"
+#include "../utils/prefix_extractor.h"
+#include "../utils/rate_limiter.h"
+#include "compact.h"
+#include "compaction_filter.h"
+#include "merge_operator.h"
+#include "write_buffer_manager.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// 可以在运行期间通过 LSM::set_options 修改的参数
+// 修改后从下一次检查开始生效: 写入阻塞在下一次写入时检查, compact
+// 在下一次 flush 或者 compact 结束时检查, 正在执行的 compact 不受影响
+struct MutableOptions {
+  // ****** 写入阻塞 ******
+  size_t write_stall_frozen_bytes = LSM_WRITE_STALL_FROZEN_BYTES;
+  size_t write_stall_l0_num = LSM_WRITE_STALL_L0_NUM;
+
+  // ****** compact ******
+  // 为 true 时不再调度新的 compact, 用于批量导入, 此时 l0 的 sst 数量不会阻塞写入
+  bool disable_auto_compactions = false;
+  // l0 的 sst 数量达到该值时触发 compact
+  size_t level0_compact_trigger = LSM_SST_LEVEL_RATIO;
+  // 每个 compact 子任务至少需要处理的输入数据量
+  size_t subcompact_min_size = LSM_SUBCOMPACT_MIN_SIZE;
+  size_t tiered_max_run_num = LSM_TIERED_MAX_RUN_NUM;
+  size_t tiered_size_ratio = LSM_TIERED_SIZE_RATIO;
+  // compact 时将最旧的这一比例的 blob 文件中仍然有效的 value 重写
+  double blob_gc_age_cutoff = LSM_BLOB_GC_AGE_CUTOFF;
+
+  // 参数不合法时抛出 std::runtime_error
+  void validate() const;
+};
+
+// 打开引擎时使用的参数, 默认值为 consts.h 中对应的宏
+// 同一个进程中的多个引擎可以使用不同的参数, 例如测试中使用更小的内存表
+struct Options : MutableOptions {
+  CompactType compact_type = CompactType::FullCompact;
+  // 为空时 sst 只有完整 key 的过滤器, 前缀查询无法跳过 sst
+  std::shared_ptr<PrefixExtractor> prefix_extractor;
+  // 合并 merge 操作数, 为空时不能写入操作数
+  std::shared_ptr<MergeOperator> merge_operator;
+  // compact 时丢弃不再需要的版本, 为空时不过滤
+  std::shared_ptr<CompactionFilter> compaction_filter;
+
+  // ****** 内存表 ******
+  size_t tol_mem_size_limit = LSM_TOL_MEM_SIZE_LIMIT; // 全部内存表的限制
+  size_t per_mem_size_limit = LSM_PER_MEM_SIZE_LIMIT; // 单个内存表的限制
+  // 不为空时内存表的占用同时计入进程级别的限制, 可以由多个引擎共用
+  std::shared_ptr<WriteBufferManager> write_buffer_manager;
+
+  // ****** sst ******
+  size_t block_size = LSM_BLOCK_SIZE;
+  size_t sst_level_ratio = LSM_SST_LEVEL_RATIO; // 相邻层级 sst 大小的比例
+  size_t bloom_bits_per_key = LSM_BLOOM_BITS_PER_KEY;
+  size_t xor_filter_min_level = LSM_SST_XOR_FILTER_MIN_LEVEL;
+  bool compression = LSM_SST_COMPRESSION;
+  size_t zstd_min_level = LSM_SST_ZSTD_MIN_LEVEL;
+
+  // ****** 缓存池 ******
+  size_t block_cache_capacity = LSMmm_BLOCK_CACHE_CAPACITY;
+  size_t block_cache_k = LSMmm_BLOCK_CACHE_K;
+  int block_cache_shard_bits = LSMmm_BLOCK_CACHE_SHARD_BITS;
+  bool block_cache_meta = LSMmm_BLOCK_CACHE_META;
+  bool pin_l0_meta = LSMmm_BLOCK_CACHE_PIN_L0_META;
+  // 不为空时通过 BlockCache::share 使用这份缓存, 多个引擎共用同一份容量,
+  // 此时忽略上面的 block_cache_capacity / k / shard_bits / meta
+  std::shared_ptr<BlockCache> block_cache;
+  // 行缓存保存热点 key 在 sst 中最新的 value, 只用于 get(key, tranc_id)
+  size_t row_cache_capacity = LSM_ROW_CACHE_CAPACITY;
+  int row_cache_shard_bits = LSM_ROW_CACHE_SHARD_BITS;
+
+  // ****** 后台任务 ******
+  size_t bg_thread_num = LSM_BG_THREAD_NUM;
+  size_t max_subcompactions = LSM_MAX_SUBCOMPACTIONS;
+  size_t open_thread_num = LSM_OPEN_THREAD_NUM;
+  // 不为空时 flush 和 compact 写入 sst / blob 文件前需要获取令牌,
+  // 可以由多个引擎共用, WAL 的写入不受限制
+  std::shared_ptr<RateLimiter> rate_limiter;
+
+  // ****** WAL ******
+  size_t wal_buffer_size = LSM_WAL_BUFFER_SIZE; // 缓冲的记录数
+  uint64_t wal_clean_interval = LSM_WAL_CLEAN_INTERVAL;
+  uint64_t wal_file_size_limit = LSM_WAL_FILE_SIZE_LIMIT;
+  size_t wal_recycle_num = LSM_WAL_RECYCLE_NUM;
+  size_t wal_recover_thread_num = LSM_WAL_RECOVER_THREAD_NUM;
+  size_t wal_recover_batch_size = LSM_WAL_RECOVER_BATCH_SIZE;
+  // 为 true 时 LSM::put / remove 等写入同样先写入 WAL, 重启时不会丢失,
+  // 也会出现在复制流中; 每次写入都需要等待 WAL 写入磁盘
+  bool wal_all_writes = LSM_WAL_ALL_WRITES;
+
+  // ****** 事务 ******
+  size_t conflict_stripe_num = LSM_CONFLICT_STRIPE_NUM;
+  size_t conflict_stripe_capacity = LSM_CONFLICT_STRIPE_CAPACITY;
+
+  // ****** 键值分离 ******
+  bool blob_enable = LSM_BLOB_ENABLE;
+  size_t blob_min_value_size = LSM_BLOB_MIN_VALUE_SIZE;
+
+  // leveled / tiered compact 输出的 sst 大小
+  size_t leveled_sst_size() const {
+    return per_mem_size_limit * sst_level_ratio;
+  }
+
+  void validate() const;
+};
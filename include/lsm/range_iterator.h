@@ -0,0 +1,63 @@
+#pragma once
+
+#include "merge_iterator.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class LSMEngine;
+class SkipList;
+class Snapshot;
+class Version;
+
+// 范围读取的参数
+struct ReadOptions {
+  // 可见的最大 tranc_id, 为 0 时读取创建迭代器时已经提交的数据
+  uint64_t tranc_id = 0;
+  // 不为空时在快照上读取, 忽略 tranc_id
+  std::shared_ptr<const Snapshot> snapshot;
+  std::optional<std::string> lower_bound; // 包含
+  std::optional<std::string> upper_bound; // 不包含
+};
+
+// 可以定位的范围迭代器, 由 LSM::new_iterator 创建, 创建后需要先 seek
+// (或者 seek_for_prev / seek_to_last)
+// 1. 持有创建时的内存表和 Version, 之后的 flush / compact 不影响遍历
+// 2. 只输出 [lower_bound, upper_bound) 中的 key, 边界下推到各个数据源:
+//    每次 seek 各个数据源直接二分定位, 范围之外的 sst 和 block 不会读取
+// 3. key() / value() 返回的视图在下一次移动之前有效
+// 4. 支持反向遍历, 改变方向时从当前 key 重新定位; 跳表没有反向指针,
+//    内存表中每次反向移动的复杂度为 O(log n)
+class RangeIterator {
+public:
+  RangeIterator(std::shared_ptr<LSMEngine> engine, ReadOptions options);
+
+  void seek_to_first();
+  // 移动到第一个不小于 key 的 key, key 小于 lower_bound 时从 lower_bound 开始
+  void seek(const std::string &key);
+  // 移动到最后一个不大于 key 的 key, key 不小于 upper_bound 时从
+  // upper_bound 之前的最后一个 key 开始
+  void seek_for_prev(const std::string &key);
+  void seek_to_last();
+  void next();
+  void prev();
+
+  bool is_valid() const;
+  std::string_view key() const;
+  std::string_view value() const;
+
+private:
+  std::shared_ptr<LSMEngine> engine_;
+  ReadOptions options_;
+  std::vector<std::shared_ptr<SkipList>> mem_tables_;
+  std::shared_ptr<const Version> version_;
+  MergeIterator iter_;
+  bool reverse_ = false; // iter_ 的遍历方向
+
+private:
+  // key 为空时从最后一个 key 开始
+  void seek_for_prev(const std::optional<std::string> &key);
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../wal/record.h"
+#include "../wal/wal.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 复制流中的一批记录, 从主节点的 WAL 中读取, 由从节点通过
+// LSM::apply_replication_batch 应用
+// 只包含已经提交的事务, 每个事务以 CREATE 开始并以 COMMIT 结束,
+// 记录的 tranc_id 与主节点中的相同
+struct ReplicationBatch {
+  std::vector<Record> records;
+  WalPosition next; // 下一次读取的位置
+
+  // ---------------------------------------------
+  // | epoch (64) | seq (64) | offset (64) | batch |
+  // ---------------------------------------------
+  // batch 为 Record::encode_batch 的编码, 没有记录时为空
+  std::vector<uint8_t> encode() const;
+  // 数据不完整或者校验失败时抛出 std::runtime_error
+  static ReplicationBatch decode(const uint8_t *data, size_t size);
+};
+
+// 从节点已经应用的位置保存在数据目录的 REPLICATION 文件中, 先写入临时文件
+// 再重命名, 不存在时返回 nullopt
+void save_replication_position(const std::string &path,
+                               const WalPosition &position);
+std::optional<WalPosition> load_replication_position(const std::string &path);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// 行缓存: 以用户 key 为索引, 保存 sst 中该 key 最新的 value 和 tranc_id,
+// 热点 key 在内存表中没有找到时只需要一次哈希查找, 不再逐个查询 sst
+// 缓存按 key 的哈希值划分为多个分片, 每个分片各自维护 LRU 链表和锁
+//
+// 正确性依赖于 sst 中只会通过内存表出现更新的版本: 每次写入内存表之后调用
+// invalidate, 不经过内存表改变 sst 内容的操作 (导入, 范围删除, 带过滤器的
+// compact, clear) 调用 clear. 读取的流程为:
+// 1. 查找内存表之前调用 sequence 记录分片的版本号
+// 2. 内存表中没有找到时调用 lookup
+// 3. 缓存中没有时查询 sst, 找到后调用 insert, 期间分片有过写入时不插入
+class RowCache {
+public:
+  // capacity 为缓存的总容量(字节数), 平均分配给 2^shard_bits 个分片
+  RowCache(size_t capacity, int shard_bits);
+
+  // key 所在分片的版本号, 分片中每次写入或者清空后增加
+  uint64_t sequence(std::string_view key) const;
+
+  // 返回对 tranc_id 可见的缓存结果, 缓存的版本比 tranc_id 更新时返回空
+  std::optional<std::pair<std::string, uint64_t>> lookup(std::string_view key,
+                                                         uint64_t tranc_id);
+
+  // 插入 read_tranc_id 读取到的 sst 中最新的版本, seq 为读取开始前
+  // sequence(key) 的结果
+  // 读取期间分片有过写入, 或者内存表中可能有对 read_tranc_id 不可见的更新
+  // 版本时不插入, 否则之后刷盘的新版本会被缓存的旧版本遮挡
+  void insert(std::string_view key, std::string_view value, uint64_t tranc_id,
+              uint64_t read_tranc_id, uint64_t seq);
+
+  // 写入内存表之后调用, tranc_id 为写入的版本
+  void invalidate(std::string_view key, uint64_t tranc_id);
+  // 清空全部分片, tranc_id 为 sst 中可能出现的最大版本
+  void clear(uint64_t tranc_id = 0);
+
+  size_t get_usage() const;
+  size_t get_capacity() const { return capacity_; }
+
+private:
+  struct Entry {
+    std::string key;
+    std::string value;
+    uint64_t tranc_id;
+    size_t charge;
+  };
+
+  struct Shard {
+    mutable std::mutex mtx;
+    std::atomic<uint64_t> seq{0};
+    std::list<Entry> lru; // 头部为最近访问的
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> map;
+    size_t usage = 0;
+  };
+
+  Shard &shard_of(std::string_view key) const;
+  void raise_max_write_(uint64_t tranc_id);
+  static void erase_(Shard &shard,
+                     std::unordered_map<std::string_view,
+                                        std::list<Entry>::iterator>::iterator it);
+
+  size_t capacity_;
+  size_t shard_capacity_;
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_mask_;
+  // 写入过内存表的最大 tranc_id, 读取的 tranc_id 小于它时不插入
+  std::atomic<uint64_t> max_write_tranc_id_{0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <vector>
+
+class SkipList;
+class Version;
+
+// ************************ Snapshot ************************
+// 数据库在某一时刻的只读视图, 不需要分配事务id, 也不需要开启事务
+// 持有创建时的全部内存表和 Version, 在快照上的读取不会受到之后 flush 和
+// compact 的影响; 快照存活期间, compact 会为它保留旧版本
+// 最后一个 shared_ptr 释放时快照自动从 SnapshotList 中移除
+class Snapshot {
+public:
+  Snapshot(uint64_t tranc_id, std::vector<std::shared_ptr<SkipList>> mem_tables,
+           std::shared_ptr<const Version> version);
+
+  // 快照可见的最大 tranc_id
+  uint64_t get_tranc_id() const;
+  // 活跃表在前, 之后为从新到旧的冻结表
+  const std::vector<std::shared_ptr<SkipList>> &get_mem_tables() const;
+  const std::shared_ptr<const Version> &get_version() const;
+
+private:
+  uint64_t tranc_id_;
+  std::vector<std::shared_ptr<SkipList>> mem_tables_;
+  std::shared_ptr<const Version> version_;
+};
+
+// ************************ SnapshotList ************************
+// 记录当前存活的快照, compact 清理旧版本时需要考虑其中最旧的快照
+class SnapshotList : public std::enable_shared_from_this<SnapshotList> {
+public:
+  // 创建快照并加入列表, 返回的快照释放时自动移除
+  std::shared_ptr<const Snapshot>
+  acquire(uint64_t tranc_id, std::vector<std::shared_ptr<SkipList>> mem_tables,
+          std::shared_ptr<const Version> version);
+
+  // 最旧的快照的 tranc_id, 没有快照时返回空
+  std::optional<uint64_t> oldest() const;
+  size_t size() const;
+
+private:
+  void release(uint64_t tranc_id);
+
+private:
+  mutable std::mutex mtx_;
+  std::multiset<uint64_t> tranc_ids_;
+};
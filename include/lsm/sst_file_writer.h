@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../sst/sst.h"
+#include "options.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+/**
+ * 离线生成可以通过 LSM::ingest_external_files 导入的 sst, 用于批量导入数据
+ * 导入时文件直接链接到数据目录中, 不经过内存表, flush 和 compact
+ *
+ * 1. key 必须严格递增, 每个 key 只有一个版本
+ * 2. entry 的 tranc_id 都写为 0, 导入时为整个文件分配一个全局的 tranc_id
+ * 3. options 中的 block_size, 压缩, 过滤器和 prefix_extractor 应当与导入的
+ *    引擎一致, 否则前缀查询无法使用文件中的前缀过滤器
+ */
+class SstFileWriter {
+public:
+  explicit SstFileWriter(const Options &options = {});
+
+  // 开始写入新的文件, 之前没有 finish 的内容被丢弃
+  void open(const std::string &path);
+
+  // key 不大于上一个 key 时抛出异常; value 为空时与 remove 相同
+  void put(const std::string &key, const std::string &value);
+  // 写入删除标记, 导入后覆盖引擎中已有的 key
+  void remove(const std::string &key);
+
+  size_t num_entries() const;
+  // 已经写入的数据的估计大小
+  size_t estimated_size() const;
+
+  // 写入文件并同步到磁盘, 没有任何 entry 时抛出异常
+  void finish();
+
+private:
+  void add(const std::string &key, const std::string &value);
+
+  Options options_;
+  std::string path_;
+  std::optional<SSTBuilder> builder_;
+  std::string last_key_;
+  size_t num_entries_ = 0;
+};
@@ -2,7 +2,11 @@
 
 #include "../utils/files.h"
 #include "../wal/wal.h"
+#include "column_family.h"
+#include "conflict_table.h"
+#include "options.h"
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -31,6 +35,17 @@ public:
   void put(const std::string &key, const std::string &value);
   void remove(const std::string &key);
   std::optional<std::string> get(const std::string &key);
+  // 在 cf 列族中读写, 一个事务可以访问多个列族, 提交时原子地写入
+  void put(const ColumnFamilyHandle &cf, const std::string &key,
+           const std::string &value);
+  void remove(const ColumnFamilyHandle &cf, const std::string &key);
+  std::optional<std::string> get(const ColumnFamilyHandle &cf,
+                                 const std::string &key);
+  // 查询所有满足 predicate(key) == 0 的 key, 包含当前事务的写入, 按 key 排序
+  // predicate 的要求与 LSM::lsm_iters_monotony_predicate 相同, 只查询默认列族
+  // SERIALIZABLE 事务会记录这次范围查询, 提交时检查范围内是否有新的写入
+  std::vector<std::pair<std::string, std::string>>
+  get_monotony_predicate(std::function<int(const std::string &)> predicate);
 
   // ! test_fail = true 是测试中手动触发的崩溃
   bool commit(bool test_fail = false);
@@ -42,11 +57,36 @@ public:
   std::shared_ptr<TranManager> tranManager_;
   uint64_t tranc_id_;
   std::vector<Record> operations;
+  // key 为 encode_cf_key 编码后的 key, 下面的 read_map_ 和 rollback_map_ 相同
   std::unordered_map<std::string, std::string> temp_map_;
   bool isCommited = false;
   bool isAborted = false;
   enum IsolationLevel isolation_level_;
 
+private:
+  void put_(uint32_t cf_id, const std::string &key, const std::string &value);
+  void remove_(uint32_t cf_id, const std::string &key);
+  std::optional<std::string> get_(uint32_t cf_id, const std::string &key);
+  // 列族对应的引擎, 默认列族为 engine_
+  const std::shared_ptr<LSMEngine> &cf_engine_(uint32_t cf_id) const;
+  // 将 operations 中的数据记录写入各自列族的内存表
+  void apply_operations();
+
+  // ! 以下检查都需要持有 key 所在冲突表分段的锁, cf_key 为编码后的 key
+  // 检查写入的 key 是否在事务开始后被其他写入提交了
+  bool has_write_conflict(const std::string &cf_key);
+  // 检查读取的 key 是否在事务开始后被其他写入提交了
+  bool has_read_conflict(
+      const std::string &cf_key,
+      const std::optional<std::pair<std::string, uint64_t>> &read_result);
+  // 检查事务开始之后, 范围内是否有其他写入或删除被提交或者正在提交
+  // held 为提交时持有的冲突表分段的锁
+  bool has_range_conflict(
+      const std::function<int(const std::string &)> &predicate,
+      const std::vector<std::unique_lock<std::mutex>> &held);
+  // key 的最新版本的 tranc_id, 不存在时返回空
+  std::optional<uint64_t> latest_tranc_id(const std::string &cf_key);
+
 private:
   std::unordered_map<std::string,
                      std::optional<std::pair<std::string, uint64_t>>>
@@ -54,26 +94,67 @@ private:
   std::unordered_map<std::string,
                      std::optional<std::pair<std::string, uint64_t>>>
       rollback_map_;
+  // SERIALIZABLE 事务范围查询的谓词
+  std::vector<std::function<int(const std::string &)>> range_reads_;
+  // 事务访问过的非默认列族的引擎
+  std::unordered_map<uint32_t, std::shared_ptr<LSMEngine>> cf_engines_;
+  // 事务开始时已经分配的最大 commit_seq, 之后的提交对冲突检测可见
+  uint64_t begin_seq_ = 0;
 };
 
 class TranManager : public std::enable_shared_from_this<TranManager> {
 public:
-  TranManager(std::string data_dir);
+  // 使用 options 中 WAL 和冲突检测相关的参数
+  TranManager(std::string data_dir, const Options &options = {});
   ~TranManager();
   void init_new_wal();
   void set_engine(std::shared_ptr<LSMEngine> engine);
   std::shared_ptr<TranContext> new_tranc(const IsolationLevel &isolation_level);
+  // 事务提交或终止后从活跃事务中移除
+  void finish_tranc(uint64_t tranc_id);
+  // 活跃事务中最小的 tranc_id, 没有活跃事务时为下一个待分配的 tranc_id
+  // compact 只需要为 tranc_id 不小于它的事务保留旧版本
+  uint64_t get_gc_watermark();
 
   uint64_t getNextTransactionId();
+  // 不分配事务id的读取使用的 tranc_id, 即已经分配的最大 tranc_id
+  // 尚未分配过事务id时为 0, 表示所有记录都可见
+  uint64_t get_read_tranc_id();
   uint64_t get_max_flushed_tranc_id();
   uint64_t get_max_finished_tranc_id_();
 
   void update_max_finished_tranc_id(uint64_t tranc_id);
   void update_max_flushed_tranc_id(uint64_t tranc_id);
+  // 从节点应用主节点的记录后, 之后分配的 tranc_id 需要大于 tranc_id
+  void update_next_tranc_id(uint64_t tranc_id);
 
   bool write_to_wal(const std::vector<Record> &records);
 
-  std::map<uint64_t, std::vector<Record>> check_recover();
+  // 记录每个 key 最近一次提交写入的 commit_seq, 提交时据此检测冲突
+  ConflictTable &get_conflict_table();
+  // 不经过事务的写入: 持有 keys 所在分段的锁执行 write, 然后记录这次提交
+  // 正在提交的事务要么检测到冲突, 要么先于这次写入完成
+  // write 执行期间 keys 登记为正在写入, 同时校验的范围查询可以看到
+  void commit_writes(const std::vector<std::string> &keys,
+                     const std::function<void()> &write);
+  // 分配一个新的 commit_seq
+  uint64_t next_commit_seq();
+  // 活跃事务中最小的 begin_seq, 不大于它的提交不会再引起冲突
+  uint64_t get_commit_watermark();
+
+  // 流式重放 WAL 中尚未刷盘的已提交事务, 每批记录交给 apply
+  WalRecoveryStats
+  recover_from_wal(const std::function<void(std::vector<Record> &)> &apply);
+
+  // 在 dir 中创建检查点的 WAL 和 tranc_id 文件, checkpoint 负责保存各个引擎的
+  // sst 并返回其中已经包含的最大 tranc_id, 之后提交的记录从复制的 WAL 中恢复
+  void create_checkpoint(const std::string &dir,
+                         const std::function<uint64_t()> &checkpoint);
+
+  // 见 WAL::end_position 和 WAL::read_from
+  WalPosition get_wal_position();
+  WalPosition read_wal(const WalPosition &from, size_t max_bytes,
+                       std::vector<Record> &records);
 
   std::string get_tranc_id_file_path();
   void write_tranc_id_file();
@@ -85,10 +166,22 @@ private:
   std::shared_ptr<LSMEngine> engine_;
   std::shared_ptr<WAL> wal;
   std::string data_dir_;
+  // WAL 的参数, 见 Options
+  size_t wal_buffer_size_;
+  uint64_t wal_clean_interval_;
+  uint64_t wal_file_size_limit_;
+  size_t wal_recycle_num_;
+  size_t wal_recover_thread_num_;
+  size_t wal_recover_batch_size_;
   // std::atomic<bool> flush_thread_running_ = true;
   std::atomic<uint64_t> nextTransactionId_ = 1;
   std::atomic<uint64_t> max_flushed_tranc_id_ = 0;
   std::atomic<uint64_t> max_finished_tranc_id_ = 0;
-  std::map<uint64_t, std::shared_ptr<TranContext>> activeTrans_;
+  std::atomic<uint64_t> commit_seq_ = 0;
+  // ! TranContext 持有 TranManager 的 shared_ptr, 这里只能使用 weak_ptr
+  // ! 未提交就被释放的事务在 get_gc_watermark 时清理
+  std::map<uint64_t, std::weak_ptr<TranContext>> activeTrans_;
+  std::mutex tranc_id_file_mtx_;
   FileObj tranc_id_file_;
+  ConflictTable conflict_table_;
 };
@@ -28,6 +28,8 @@ public:
   virtual bool operator==(const BaseIterator &other) const override;
   virtual bool operator!=(const BaseIterator &other) const override;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
   virtual IteratorType get_type() const override;
   virtual uint64_t get_tranc_id() const override;
   virtual bool is_end() const override;
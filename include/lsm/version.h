@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../sst/sst.h"
+#include "../utils/files.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ************************ VersionEdit ************************
+// 两个相邻 Version 之间的差异, flush 和 compact 每次安装新的 Version 时
+// 都会生成一个 VersionEdit, 并追加到 MANIFEST 中
+// 编码为若干个 | tag (varint) | 字段 (varint) ... | 组成的序列
+struct VersionEdit {
+  std::vector<std::pair<size_t, size_t>> deleted_files; // {level, sst_id}
+  std::vector<std::pair<size_t, size_t>> added_files;   // {level, sst_id}
+  // added_files 中 sst 的首尾 key 等元数据, 重启时不需要读取元数据块
+  std::map<size_t, SstFileMeta> file_metas; // {sst_id, meta}
+  std::optional<size_t> next_sst_id;
+  // flush 刷入 sst 的最大 tranc_id, 重放 WAL 时跳过不大于它的记录
+  std::optional<uint64_t> flushed_tranc_id;
+
+  void delete_file(size_t level, size_t sst_id);
+  void add_file(size_t level, size_t sst_id);
+  // 同时记录 sst 的元数据
+  void add_file(size_t level, const std::shared_ptr<SST> &sst);
+
+  std::vector<uint8_t> encode() const;
+  static VersionEdit decode(const uint8_t *data, size_t size);
+};
+
+// ************************ Version ************************
+// LSM 在某一时刻的形状, 即每一层包含哪些 sst, 创建后不会再被修改
+// 读者获取一次 Version 的指针后, 不需要加锁即可访问全部 sst
+// 旧的 Version 和其中的 sst 在最后一个读者释放之后才会被析构
+class Version {
+public:
+  Version() = default;
+
+  // 在当前 Version 的基础上应用 edit, 返回新的 Version
+  // new_ssts 为 edit 中新增的 sst, 同时删除并新增的 sst 表示移动到新的 level
+  std::shared_ptr<Version>
+  apply(const VersionEdit &edit,
+        const std::vector<std::shared_ptr<SST>> &new_ssts) const;
+
+  // 包含全部 sst 及其元数据的 VersionEdit, 用于写入新的 MANIFEST
+  VersionEdit snapshot() const;
+
+  // l0 按 sst_id 从大到小(从新到旧)排列, 其他 level 按 first_key 排列
+  const std::vector<std::shared_ptr<SST>> &level_ssts(size_t level) const;
+  // 只包含非空的 level
+  const std::map<size_t, std::vector<std::shared_ptr<SST>>> &levels() const;
+  size_t max_level() const;
+  size_t num_ssts(size_t level) const;
+  size_t level_size(size_t level) const;
+  std::shared_ptr<SST> find_sst(size_t sst_id) const;
+  // 在 level (>= 1) 中查找 key 范围包含 key 的 sst, 不存在时返回 nullptr
+  // 相邻的 sst 可能在范围删除标记的 end 上首尾相接, 这时选择后一个 sst:
+  // end 本身不被前一个 sst 的标记覆盖, 只可能位于后一个 sst 中
+  std::shared_ptr<SST> find_level_sst(size_t level,
+                                      const std::string &key) const;
+
+private:
+  void sort_level(size_t level);
+
+private:
+  std::map<size_t, std::vector<std::shared_ptr<SST>>> levels_;
+};
+
+// ************************ Manifest ************************
+// 记录 VersionEdit 的日志文件, 每条记录的结构如下:
+// ----------------------------------------------
+// | payload_len (32) | hash (32) | VersionEdit |
+// ----------------------------------------------
+// 新的 MANIFEST 的第一条记录为当前 Version 的 snapshot
+class Manifest {
+public:
+  // 写入只包含 snapshot 的新 MANIFEST, 通过重命名原子地替换旧文件
+  static std::unique_ptr<Manifest> create(const std::string &path,
+                                          const VersionEdit &snapshot);
+
+  // 追加一条记录并同步到磁盘
+  void append(const VersionEdit &edit);
+
+  // 读取全部记录, 末尾写入不完整的记录会被忽略
+  static std::vector<VersionEdit> read(const std::string &path);
+
+private:
+  static void encode_record(const VersionEdit &edit,
+                            std::vector<uint8_t> &dst);
+
+private:
+  FileObj file_;
+};
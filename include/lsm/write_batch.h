@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../wal/record.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ColumnFamilyHandle;
+
+/**
+ * 一组原子写入的 put / remove 操作, 通过 LSM::write 应用
+ * 整个 batch 使用同一个 tranc_id, 在 WAL 中是一次追加写入,
+ * 写入 memtable 时只获取一次锁
+ * 同一个 key 的多次操作以最后一次为准, 被之后的 remove_range 覆盖的
+ * put / remove / merge 在转换为记录时直接丢弃; merge 会与同一个 key 之前的
+ * 操作合并 (见 LSMEngine::fold_batch_merges)
+ * 带有 ColumnFamilyHandle 参数的操作写入对应的列族, 一个 batch 可以包含
+ * 多个列族的操作, 它们仍然是原子的
+ * LSM::write 会移走其中的数据, 之后 batch 为空, 可以继续复用
+ */
+class WriteBatch {
+public:
+  WriteBatch() = default;
+
+  void put(std::string key, std::string value);
+  void remove(std::string key);
+  // 写入 merge 操作数, 由引擎的 MergeOperator 与旧值合并
+  void merge(std::string key, std::string operand);
+  // 删除 [begin, end) 范围内的全部 key
+  void remove_range(std::string begin, std::string end);
+
+  void put(const ColumnFamilyHandle &cf, std::string key, std::string value);
+  void remove(const ColumnFamilyHandle &cf, std::string key);
+  void merge(const ColumnFamilyHandle &cf, std::string key,
+             std::string operand);
+  void remove_range(const ColumnFamilyHandle &cf, std::string begin,
+                    std::string end);
+
+  void clear();
+
+  // 操作的数量
+  size_t size() const;
+  bool empty() const;
+  // 全部 key 和 value 的字节数
+  size_t byte_size() const;
+
+  // 转换为 tranc_id 事务的 WAL 记录, 以 CREATE 开始并以 COMMIT 结束
+  // batch 中的 key 和 value 被移动到记录中, 之后 batch 为空
+  std::vector<Record> take_records(uint64_t tranc_id);
+
+private:
+  struct Operation {
+    OperationType type; // PUT, DELETE, MERGE 或 DELETE_RANGE
+    std::string key;    // DELETE_RANGE 为 begin
+    std::string value;  // DELETE_RANGE 为 end
+    uint32_t cf_id = 0;
+  };
+
+  void add(OperationType type, std::string key, std::string value,
+           uint32_t cf_id);
+
+  std::vector<Operation> operations_;
+  size_t byte_size_ = 0;
+};
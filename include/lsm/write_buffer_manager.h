@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+
+/**
+ * 统计同一进程中多个引擎的内存表占用, 限制其总和
+ * 每个引擎打开时注册为一个成员, 写入和刷盘之后通过 update 报告自己内存表的
+ * 大小; 总和超过 buffer_size 时, 通知内存表最大的成员刷盘
+ *
+ * 各个引擎自身的 tol_mem_size_limit 仍然有效, 两个限制先达到的一个触发刷盘
+ */
+class WriteBufferManager {
+public:
+  struct Member {
+    std::atomic<size_t> usage{0};
+    // 在某个写入者的线程中调用, 需要尽快返回, 例如只提交后台任务
+    std::function<void()> flush;
+  };
+
+  explicit WriteBufferManager(size_t buffer_size);
+
+  std::shared_ptr<Member> add_member(std::function<void()> flush);
+  // 注销之后不会再调用成员的 flush, 其内存表占用也不再计入总和
+  void remove_member(const std::shared_ptr<Member> &member);
+
+  // 更新 member 的内存表大小, 需要时通知最大的成员刷盘
+  void update(Member &member, size_t usage);
+
+  size_t buffer_size() const;
+  // 全部成员的内存表占用之和
+  size_t memory_usage() const;
+
+private:
+  size_t buffer_size_;
+  std::atomic<size_t> memory_usage_{0};
+
+  std::mutex mtx_; // 保护 members_, 调用成员的 flush 时也持有
+  std::list<std::shared_ptr<Member>> members_;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "../consts.h"
 #include "../iterator/iterator.h"
 #include "../skiplist/skiplist.h"
+#include "../wal/record.h"
+#include <atomic>
 #include <cstddef>
 #include <functional>
 #include <iostream>
@@ -13,6 +16,7 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 class BlockCache;
 class SST;
@@ -34,10 +38,17 @@ private:
   SkipListIterator frozen_get_(const std::string &key, uint64_t tranc_id);
 
   void remove_(const std::string &key, uint64_t tranc_id);
+  void merge_(const std::string &key, const std::string &operand,
+              uint64_t tranc_id);
   void frozen_cur_table_(); // _ 表示不需要锁的版本
+  // 活跃表超过大小限制时冻结
+  void try_frozen_cur_table();
+  // 读锁下获取活跃表的快照, 之后的查询不需要持有锁
+  std::shared_ptr<SkipList> get_cur_table();
 
 public:
-  MemTable();
+  // 活跃表超过 per_mem_size_limit 后被冻结
+  explicit MemTable(size_t per_mem_size_limit = LSM_PER_MEM_SIZE_LIMIT);
   ~MemTable();
 
   void put(const std::string &key, const std::string &value, uint64_t tranc_id);
@@ -49,11 +60,27 @@ public:
                     get_batch(const std::vector<std::string> &keys, uint64_t tranc_id);
   void remove(const std::string &key, uint64_t tranc_id);
   void remove_batch(const std::vector<std::string> &keys, uint64_t tranc_id);
+  // 写入 merge 操作数, 空的操作数会被忽略
+  void merge(const std::string &key, const std::string &operand,
+             uint64_t tranc_id);
+  // 内存表中是否存在 merge 操作数
+  bool has_merge_operands();
+  // 在活跃表中写入删除 [begin, end) 的范围删除标记
+  void remove_range(const std::string &begin, const std::string &end,
+                    uint64_t tranc_id);
+  // 全部内存表中覆盖 key 且对 tranc_id 可见的范围删除标记的最大 tranc_id,
+  // 没有时返回 0; 内存表中没有范围删除标记时不需要加锁
+  uint64_t range_del_covering(const std::string &key, uint64_t tranc_id);
+  // 在一次加锁中写入 records 中的 PUT / DELETE / MERGE / DELETE_RANGE 记录,
+  // 使用记录自身的 tranc_id
+  void apply_records(const std::vector<Record> &records);
 
   void clear();
-  std::shared_ptr<SST> flush_last(SSTBuilder &builder, std::string &sst_path,
-                                  size_t sst_id,
-                                  std::shared_ptr<BlockCache> block_cache);
+  // 获取最老的冻结表, 没有冻结表时会先冻结活跃表
+  // ! 这里不会移除该表, 需要等其刷入 sst 并对读者可见后再调用
+  // ! remove_last_frozen, 避免 flush 期间读者查不到数据
+  std::shared_ptr<SkipList> get_last_frozen();
+  void remove_last_frozen();
   void frozen_cur_table();
   size_t get_cur_size();
   size_t get_frozen_size();
@@ -67,10 +94,34 @@ public:
 
   HeapIterator end();
 
+  // 读锁下获取全部内存表, 活跃表在前, 之后为从新到旧的冻结表
+  // 持有返回的表期间, 它们不会因为 flush 被释放
+  std::vector<std::shared_ptr<SkipList>> get_tables();
+
+  // ****** 在一组内存表上查询, 不需要加锁 ******
+  // tables 的顺序与 get_tables 相同, 越靠前的表越新
+  static SkipListIterator
+  tables_get(const std::vector<std::shared_ptr<SkipList>> &tables,
+             const std::string &key, uint64_t tranc_id);
+  static uint64_t
+  tables_range_del_covering(const std::vector<std::shared_ptr<SkipList>> &tables,
+                            const std::string &key, uint64_t tranc_id);
+  static HeapIterator
+  tables_begin(const std::vector<std::shared_ptr<SkipList>> &tables,
+               uint64_t tranc_id);
+  static std::optional<std::pair<HeapIterator, HeapIterator>>
+  tables_iters_monotony_predicate(
+      const std::vector<std::shared_ptr<SkipList>> &tables, uint64_t tranc_id,
+      std::function<int(const std::string &)> predicate);
+
 private:
   std::shared_ptr<SkipList> current_table;
   std::list<std::shared_ptr<SkipList>> frozen_tables;
   size_t frozen_bytes;
+  size_t per_mem_size_limit_;
+  // 全部内存表中范围删除标记的数量
+  std::atomic<size_t> num_range_dels{0};
   std::shared_mutex frozen_mtx; // 冻结表的锁
-  std::shared_mutex cur_mtx;    // 活跃表的锁
+  // 活跃表的锁, 写入只需要共享锁(跳表支持并发写入), 冻结活跃表时需要写锁
+  std::shared_mutex cur_mtx;
 };
\ No newline at end of file
@@ -1,6 +1,15 @@
 #pragma once
+#include "../consts.h"
 #include "../lsm/engine.h"
+#include "replica_client.h"
+#include <array>
+#include <cstdint>
+#include <ctime>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
 
 std::vector<std::string>
 get_fileds_from_hash_value(const std::optional<std::string> &field_list_opt);
@@ -12,27 +21,123 @@ inline std::string get_hash_filed_key(const std::string &key,
 
 inline bool is_value_hash(const std::string &key);
 
-inline std::string get_explire_key(const std::string &key);
+// 过期时间与 value 保存在一起, 读取时直接判断, 不需要再查询一次:
+// | REDIS_TTL_HEADER | 类型标记 | 过期时间 (REDIS_TTL_TIME_LEN 位十进制) | value |
+// 没有设置过期时间的 value 保持原样
+// 集合类型的过期时间保存在元数据中, 类型标记为 kCollectionTag
+struct RedisTtlValue {
+  static constexpr char kStringTag = 'S';
+  static constexpr char kCollectionTag = 'C';
+
+  std::string value;                // 去除过期时间后的 value
+  std::optional<int64_t> expire_at; // unix 时间戳 (秒), 为空表示不过期
+  bool collection = false;
+
+  // now 不为空时返回判断时使用的当前时间
+  bool expired(std::time_t *now = nullptr) const;
+};
+
+std::string encode_ttl_value(const std::string &value,
+                             std::optional<int64_t> expire_at,
+                             bool collection);
+RedisTtlValue decode_ttl_value(std::string_view raw);
+
+// 链表的元数据, 以 REDIS_LIST_META_PREFFIX 开头保存在链表的 key 中
+// 元素按序号分别保存在 REDIS_LIST_<key>_<seq> 中, 序号位于 [head, tail)
+struct RedisListMeta {
+  uint64_t head = REDIS_LIST_INITIAL_SEQ;
+  uint64_t tail = REDIS_LIST_INITIAL_SEQ;
+
+  size_t size() const { return tail - head; }
+};
+
+// 字符串类型的 merge 操作数, 第一个字节为操作类型:
+// 'I' + 十进制的增量 (INCR / DECR), 'A' + 追加的内容 (APPEND)
+// 增量无法作用于当前的 value (不是整数或者溢出) 时忽略该操作数
+class RedisMergeOperator : public MergeOperator {
+public:
+  static constexpr char kIncrTag = 'I';
+  static constexpr char kAppendTag = 'A';
+
+  std::string name() const override;
+  bool full_merge(std::string_view key,
+                  const std::optional<std::string_view> &existing,
+                  const std::vector<std::string_view> &operands,
+                  std::string &result) const override;
+  bool partial_merge(std::string_view key, std::string_view left,
+                     std::string_view right,
+                     std::string &result) const override;
+};
+
+// 把已经过期的字符串在 compact 时丢弃, 读路径上不需要再清理
+// ! 集合的元数据即使过期也会保留: 元素分别保存在其他 key 中, 只能在之后写入
+// ! 这个 key 时根据元数据清理, 丢弃元数据会使旧的元素重新可见
+class RedisTtlCompactionFilter : public CompactionFilter {
+public:
+  std::string name() const override;
+  bool filter(std::string_view key, std::string_view value) const override;
+};
 
 class RedisWrapper {
 private:
   std::unique_ptr<LSM> lsm;
-  std::shared_mutex redis_mtx;
+  // 按 key 分段的锁, 同一个 key 的写命令之间互斥, 读命令持有共享锁
+  // 一个命令涉及的全部内部 key (字段, 元素, 过期时间) 都由用户 key 的锁保护
+  std::array<std::shared_mutex, REDIS_LOCK_STRIPES> key_mtxs;
 
 private:
-  // 检查 hash 的 key 是否过期并清理, 过期返回 true
-  bool expire_hash_clean(const std::string &key,
-                         std::shared_lock<std::shared_mutex> &rlock);
+  // 用户 key 所在的锁
+  std::shared_mutex &key_mutex(const std::string &key);
+  // 按锁的下标顺序获取 keys 所在的全部锁的写锁, 相同的锁只获取一次
+  std::vector<std::unique_lock<std::shared_mutex>>
+  lock_keys(const std::vector<std::string> &keys);
+  // 同上, 获取读锁
+  std::vector<std::shared_lock<std::shared_mutex>>
+  lock_keys_shared(const std::vector<std::string> &keys);
+  // keys 所在的锁的下标, 升序且不重复
+  std::vector<size_t> key_stripes(const std::vector<std::string> &keys);
+
+  // 读取 key 并解析过期时间, 已经过期的 value 同样返回, 不会写入
+  std::optional<RedisTtlValue> get_value(const std::string &key);
+  // 读取没有过期的 value, 过期和不存在都返回 nullopt, 不会写入
+  std::optional<RedisTtlValue> get_live_value(const std::string &key);
+  // 写命令使用: 已经过期的 key 连同集合的元素一起删除后返回 nullopt
+  // ! 调用者需要持有写锁
+  std::optional<RedisTtlValue> get_value_for_write(const std::string &key);
+  // 删除 key, value 为集合的元数据时同时删除全部元素
+  void remove_with_elements(const std::string &key, const std::string &value);
+  // 范围删除 key 的元素: 元素的 key 为 type_prefix + key + "_" + 后缀,
+  // 删除后缀位于 [lower, upper) 中的元素, upper 为空时删除到前缀的后继
+  // 名称以 key + "_" 开头的同类型集合的元素同样落在这个范围内, 先找出这些
+  // 集合(is_same_type 判断元数据), 范围删除时跳过它们的元素
+  void remove_elements(const std::string &type_prefix, const std::string &key,
+                       const std::string &lower,
+                       const std::optional<std::string> &upper,
+                       const std::function<bool(const std::string &)> &is_same_type);
+  // 读取链表的元数据, 链表不存在或者已经过期时返回 nullopt
+  // 旧版本中整个链表用分隔符拼接保存在 key 中, 读取时先转换为逐元素的格式
+  // expire_at 返回链表的过期时间, 更新元数据时需要保留
+  // ! 调用者需要持有写锁
+  std::optional<RedisListMeta>
+  load_list_meta(const std::string &key, std::optional<int64_t> &expire_at);
+  // 写入字符串的 merge 操作数, 返回在这次写入的 tranc_id 上读取的结果
+  // 旧的 value 已经过期时先删除, 再重新写入操作数
+  std::optional<std::string> merge_string(const std::string &key,
+                                          const std::string &operand);
+  // 写入 key 的增量操作数, 不需要读取旧值, 并发的自增之间不会冲突
+  // 之后在这次写入的 tranc_id 上读取结果, 不是整数时返回错误
+  std::string incr_by(const std::string &key, int64_t delta);
 
-  bool expire_list_clean(const std::string &key,
-                         std::shared_lock<std::shared_mutex> &rlock);
-  bool expire_zset_clean(const std::string &key,
-                         std::shared_lock<std::shared_mutex> &rlock);
-  bool expire_set_clean(const std::string &key,
-                        std::shared_lock<std::shared_mutex> &rlock);
+  // REPLICAOF 启动的复制线程, 需要在 lsm 之前析构
+  std::mutex replica_mtx_;
+  std::unique_ptr<ReplicaClient> replica_;
 
 public:
-  RedisWrapper(const std::string &db_path);
+  // 复制的主节点需要开启 wal_all_writes, 否则 SET 等命令不会出现在复制流中
+  RedisWrapper(const std::string &db_path, bool wal_all_writes = false);
+  // 使用指定的引擎参数, 前缀过滤器 / merge 操作 / compaction filter 仍然
+  // 使用 redis 的实现
+  RedisWrapper(const std::string &db_path, Options options);
   void clear();
   void flushall();
 
@@ -42,14 +147,22 @@ public:
   std::string get(std::vector<std::string> &args);
   std::string incr(std::vector<std::string> &args);
   std::string decr(std::vector<std::string> &args);
+  std::string append(std::vector<std::string> &args);
   std::string expire(std::vector<std::string> &args);
   std::string del(std::vector<std::string> &args);
   std::string ttl(std::vector<std::string> &args);
+  std::string mget(std::vector<std::string> &args);
+  std::string mset(std::vector<std::string> &args);
+  // 一组 SET 合并为一次写入, 回复与逐个执行 SET 相同 (每个 SET 一个 +OK)
+  // 用于合并流水线中连续的 SET
+  std::string set_batch(std::vector<std::pair<std::string, std::string>> &kvs);
   // 哈希操作
   std::string hset(std::vector<std::string> &args);
   std::string hget(std::vector<std::string> &args);
   std::string hdel(std::vector<std::string> &args);
   std::string hkeys(std::vector<std::string> &args);
+  std::string hmget(std::vector<std::string> &args);
+  std::string hmset(std::vector<std::string> &args);
   // 链表操作
   std::string lpush(std::vector<std::string> &args);
   std::string rpush(std::vector<std::string> &args);
@@ -71,17 +184,44 @@ public:
   std::string sismember(std::vector<std::string> &args);
   std::string scard(std::vector<std::string> &args);
   std::string smembers(std::vector<std::string> &args);
+  // 游标遍历, 每次调用最多检查 COUNT 条记录
+  // 游标为 "0" 表示从头开始 (返回 "0" 表示遍历完成), 否则为下一条记录的
+  // key (十六进制编码), 不是 redis 中的整数游标
+  std::string scan(std::vector<std::string> &args);
+  std::string hscan(std::vector<std::string> &args);
+  std::string sscan(std::vector<std::string> &args);
+  std::string zscan(std::vector<std::string> &args);
+  // 引擎的统计信息, 格式同 LSM::get_stats().to_string()
+  // 可以指定一个段名 (不区分大小写) 只返回该段, 例如 INFO stats
+  std::string info(std::vector<std::string> &args);
+  // ****** 复制 ******
+  // REPLFETCH epoch seq offset: 主节点回复该位置之后已经提交的事务, 为
+  // ReplicationBatch 的编码; 位置已经不可用时回复错误, 从节点需要从主节点新的
+  // 检查点重新同步
+  std::string replfetch(std::vector<std::string> &args);
+  // REPLICAOF host port: 成为 host:port 的从节点, 后台线程持续拉取并应用
+  // REPLICAOF NO ONE: 停止复制, 重新接受写命令
+  // 从节点需要从主节点的检查点打开, 检查点中记录了开始复制的位置
+  std::string replicaof(std::vector<std::string> &args);
+  // 正在复制时不接受写命令
+  bool is_replica();
+  // 应用主节点的一批事务, 由复制线程调用
+  void apply_replication_batch(const ReplicationBatch &batch);
 
 private:
   // ************************* Redis Command Handler *************************
   // 基础操作
   std::string redis_incr(const std::string &key);
   std::string redis_decr(const std::string &key);
+  std::string redis_append(const std::string &key, const std::string &value);
   std::string redis_expire(const std::string &key, std::string seconds_count);
   std::string redis_set(std::string &key, std::string &value);
   std::string redis_get(std::string &key);
   std::string redis_del(std::vector<std::string> &args);
   std::string redis_ttl(std::string &key);
+  // 多个 key 的读写分别只调用一次 get_batch / write
+  std::string redis_mget(const std::vector<std::string> &keys);
+  void redis_mset(std::vector<std::pair<std::string, std::string>> &kvs);
 
   // 哈希操作
   std::string redis_hset(const std::string &key, const std::string &field,
@@ -91,6 +231,8 @@ private:
   std::string redis_hget(const std::string &key, const std::string &field);
   std::string redis_hdel(const std::string &key, const std::string &field);
   std::string redis_hkeys(const std::string &key);
+  std::string redis_hmget(const std::string &key,
+                          const std::vector<std::string> &fields);
   // 链表操作
   std::string redis_lpush(const std::string &key, const std::string &value);
   std::string redis_rpush(const std::string &key, const std::string &value);
@@ -115,4 +257,18 @@ private:
                               const std::string &member);
   std::string redis_scard(const std::string &key);
   std::string redis_smembers(const std::string &key);
+  // 游标遍历
+  std::string redis_scan(const std::string &start, size_t count);
+  std::string redis_hscan(const std::string &key, const std::string &start,
+                          size_t count);
+  std::string redis_sscan(const std::string &key, const std::string &start,
+                          size_t count);
+  std::string redis_zscan(const std::string &key, const std::string &start,
+                          size_t count);
+  // 从 preffix + start 开始按 key 的顺序读取以 preffix 开头的记录, 最多 count
+  // 条, visit 的参数为去掉 preffix 的 key 和 value
+  // 返回下一次读取的起点 (去掉 preffix), 已经读完时返回 nullopt
+  std::optional<std::string> scan_preffix(
+      const std::string &preffix, const std::string &start, size_t count,
+      const std::function<void(std::string_view, std::string_view)> &visit);
 };
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../lsm/replication.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+// 从节点的复制线程: 通过 RESP 协议向主节点发送 REPLFETCH epoch seq offset,
+// 将回复中的 ReplicationBatch 交给 apply, 没有新数据时间隔
+// REDIS_REPLICA_POLL_MS 再次拉取; 连接断开后重新连接
+// 主节点回复错误 (例如位置已经不可用) 时记录错误并稍后重试
+class ReplicaClient {
+public:
+  using PositionFn = std::function<std::optional<WalPosition>()>;
+  using ApplyFn = std::function<void(const ReplicationBatch &)>;
+
+  ReplicaClient(std::string host, uint16_t port, PositionFn position,
+                ApplyFn apply);
+  // 停止并等待复制线程退出
+  ~ReplicaClient();
+
+  const std::string &host() const { return host_; }
+  uint16_t port() const { return port_; }
+  // 最近一次失败的原因, 拉取成功后清空
+  std::string last_error();
+
+private:
+  void run();
+  // 连接主节点, 失败时返回 -1
+  int connect_leader();
+  // 发送一次 REPLFETCH 并应用回复, 返回是否收到了新的记录
+  // 连接出错时抛出 std::runtime_error
+  bool fetch(int fd, const WalPosition &position);
+  void set_error(const std::string &error);
+
+  std::string host_;
+  uint16_t port_;
+  PositionFn position_;
+  ApplyFn apply_;
+  std::atomic<bool> stop_{false};
+  std::mutex error_mtx_;
+  std::string last_error_;
+  std::string read_buf_; // 已经从连接中读取但还没有解析的数据
+  std::thread thread_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ****** RESP 请求的增量解析 ******
+// 一次读取中可能包含多个流水线 (pipeline) 命令, 也可能只包含命令的一部分
+// 解析器只消费完整的命令, 不完整的部分留在缓冲区中等待之后的数据
+// 解析直接在缓冲区上进行, 只有命令的参数会被复制出来
+enum class RespStatus {
+  Ok,         // 解析出一个完整的命令
+  Incomplete, // 数据不足, 需要等待更多的数据
+  Error,      // 协议错误, 应当回复错误并关闭连接
+};
+
+struct RespParseResult {
+  RespStatus status;
+  size_t consumed = 0; // status 为 Ok 时命令占用的字节数
+  std::string error;   // status 为 Error 时的错误回复
+};
+
+// 从 data 的开头解析一个命令, 参数写入 args (复用其内存)
+// 支持 multibulk (*<n>\r\n$<len>\r\n<arg>\r\n...) 和以空白分隔的 inline 命令
+// 空的 inline 命令 (只有 \r\n) 也会返回 Ok, 此时 args 为空
+RespParseResult parse_resp_command(std::string_view data,
+                                   std::vector<std::string> &args);
+
+// ****** RESP 回复的构建 ******
+// 直接追加到 out 的末尾, 不产生中间的临时字符串
+// 同一个缓冲区可以连续写入多个回复 (例如流水线中的全部回复)
+class RespWriter {
+public:
+  explicit RespWriter(std::string &out) : out_(out) {}
+
+  RespWriter &simple(std::string_view str); // +<str>\r\n
+  RespWriter &error(std::string_view str);  // -<str>\r\n
+  RespWriter &integer(int64_t value);       // :<value>\r\n
+  RespWriter &bulk(std::string_view str);   // $<len>\r\n<str>\r\n
+  RespWriter &null_bulk();                  // $-1\r\n
+  RespWriter &array(size_t size);           // *<size>\r\n, 之后写入元素
+
+private:
+  void append_header(char type, int64_t value);
+
+  std::string &out_;
+};
+
+// 单个回复的简便写法
+std::string resp_integer(int64_t value);
+// value 已经是十进制的整数
+std::string resp_integer(std::string_view value);
+std::string resp_bulk(std::string_view str);
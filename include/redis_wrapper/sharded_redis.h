@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../utils/thread_pool.h"
+#include "redis_wrapper.h"
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 按 key 的哈希值分片的 RedisWrapper, 每个分片是一个独立的引擎
+// (内存表, WAL, 缓存池和后台线程都不共享), 保存在 db_path/shard_<i> 中
+// 每个分片只有一个执行命令的线程, 命令在该线程的队列中按提交的顺序执行,
+// 分片内部的按 key 加锁不会产生竞争; 分片线程在 Linux 上绑定到不同的 CPU
+// 同一个线程提交到同一个分片的命令按提交的顺序执行, 因此同一个连接上的
+// 命令之间的顺序保持不变
+// 涉及多个 key 的命令 (MGET / MSET / DEL) 按分片拆分后并行执行再合并回复,
+// ! 不同分片之间的写入不是原子的
+// 分片数记录在 db_path/SHARDS 中, 使用不同的分片数打开时抛出 std::runtime_error
+class ShardedRedis {
+public:
+  // 内存表和缓存池的容量按分片数平分
+  ShardedRedis(const std::string &db_path, size_t shard_num,
+               bool wal_all_writes = false);
+  // 等待全部分片执行完队列中的命令
+  ~ShardedRedis();
+
+  size_t shard_num() const { return shards_.size(); }
+  // key 所在的分片
+  size_t shard_of(std::string_view key) const;
+
+  // 在分片的线程中执行 fn(RedisWrapper &), 返回回复的 future
+  template <typename F> std::future<std::string> submit(size_t shard, F &&fn) {
+    auto &target = shards_[shard];
+    return target.pool->submit(
+        [redis = target.redis.get(), fn = std::forward<F>(fn)]() mutable {
+          return fn(*redis);
+        });
+  }
+
+  // ****** 跨分片的命令 ******
+  // 参数格式与 RedisWrapper 中对应的命令相同, 等待全部分片后返回合并的回复
+  std::string mget(std::vector<std::string> &args);
+  std::string mset(std::vector<std::string> &args);
+  std::string del(std::vector<std::string> &args);
+  std::string set_batch(std::vector<std::pair<std::string, std::string>> &kvs);
+  // 依次遍历每个分片, 游标为 "<分片>:<分片内的游标>", "0" 表示从头开始
+  std::string scan(std::vector<std::string> &args);
+  // 每个分片的统计信息之前加上 "# Shard <i>"
+  std::string info(std::vector<std::string> &args);
+  void clear();
+  void flushall();
+
+private:
+  struct Shard {
+    std::unique_ptr<RedisWrapper> redis;
+    std::unique_ptr<ThreadPool> pool; // 只有一个线程, 需要在 redis 之前析构
+  };
+
+  // 在每个分片上执行 fn 并等待, 返回按分片顺序排列的回复
+  template <typename F> std::vector<std::string> broadcast(F &&fn) {
+    std::vector<std::future<std::string>> futures;
+    futures.reserve(shards_.size());
+    for (size_t i = 0; i < shards_.size(); i++) {
+      futures.push_back(submit(i, [&fn](RedisWrapper &redis) {
+        return fn(redis);
+      }));
+    }
+    std::vector<std::string> replies;
+    replies.reserve(futures.size());
+    for (auto &future : futures) {
+      replies.push_back(future.get());
+    }
+    return replies;
+  }
+
+  std::vector<Shard> shards_;
+};
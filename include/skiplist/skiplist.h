@@ -1,123 +1,194 @@
 #pragma once
 #include "../iterator/iterator.h"
+#include "../utils/arena.h"
+#include "../utils/key_prefix.h"
+#include "../utils/range_tombstone.h"
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <random>
-#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 // ************************ SkipListNode ************************
+// 节点从跳表的 Arena 中分配, 不会单独释放, 内存布局如下:
+// ---------------------------------------------------------
+// | SkipListNode | next_[1] ... next_[height - 1] | key   |
+// ---------------------------------------------------------
+// value 单独分配, 格式为 | value_len (4B) | value |,
+// 相同 key 和 tranc_id 的更新只需要原子地替换 value_ 指针
+// value_len 的最高位标记该版本是 merge 操作数而不是完整的 value
+// key_prefix_ 为 key 的前 8 个字节 (见 key_prefix), 查找时大部分节点只需要
+// 比较一次整数, 前缀相等时才访问节点之后的 key
 struct SkipListNode {
-  std::string key_;   // 节点存储的键
-  std::string value_; // 节点存储的值
+  static constexpr uint32_t kMergeFlag = 1u << 31;
+
   uint64_t tranc_id_; // 事务 id
-  std::vector<std::shared_ptr<SkipListNode>>
-      forward_; // 指向不同层级的下一个节点的指针数组
-  std::vector<std::weak_ptr<SkipListNode>>
-      backward_; // 指向不同层级的下一个节点的指针数组
-  SkipListNode(const std::string &k, const std::string &v, int level,
-               uint64_t tranc_id)
-      : key_(k), value_(v), forward_(level, nullptr),
-        backward_(level, std::weak_ptr<SkipListNode>()), tranc_id_(tranc_id) {}
-  void set_backward(int level, std::shared_ptr<SkipListNode> node) {
-    backward_[level] = std::weak_ptr<SkipListNode>(node);
+  uint64_t key_prefix_;
+  uint32_t key_size_;
+  int height_;
+  std::atomic<const char *> value_;
+  // remove 只做逻辑删除, 读者会跳过被删除的节点
+  std::atomic<bool> deleted_;
+  // 指向不同层级的下一个节点, 实际长度为 height_
+  std::atomic<SkipListNode *> next_[1];
+
+  std::string_view key() const {
+    return std::string_view(reinterpret_cast<const char *>(&next_[height_]),
+                            key_size_);
   }
 
-  bool operator==(const SkipListNode &other) const {
-    return key_ == other.key_ && value_ == other.value_ &&
-           tranc_id_ == other.tranc_id_;
+  std::string_view value() const {
+    const char *ptr = value_.load(std::memory_order_acquire);
+    uint32_t value_size;
+    std::memcpy(&value_size, ptr, sizeof(uint32_t));
+    return std::string_view(ptr + sizeof(uint32_t), value_size & ~kMergeFlag);
   }
 
-  bool operator!=(const SkipListNode &other) const { return !(*this == other); }
+  bool is_merge() const {
+    const char *ptr = value_.load(std::memory_order_acquire);
+    uint32_t value_size;
+    std::memcpy(&value_size, ptr, sizeof(uint32_t));
+    return (value_size & kMergeFlag) != 0;
+  }
 
-  bool operator<(const SkipListNode &other) const {
-    if (key_ == other.key_) {
-      // key 相等时，trans_id 更大的优先级更高
-      return tranc_id_ > other.tranc_id_;
-    }
-    return key_ < other.key_;
+  SkipListNode *next(int level) const {
+    return next_[level].load(std::memory_order_acquire);
   }
-  bool operator>(const SkipListNode &other) const {
-    if (key_ == other.key_) {
-      // key 相等时，trans_id 更大的优先级更高
-      return tranc_id_ < other.tranc_id_;
-    }
-    return key_ > other.key_;
+
+  bool cas_next(int level, SkipListNode *expected, SkipListNode *node) {
+    return next_[level].compare_exchange_strong(expected, node,
+                                                std::memory_order_acq_rel);
   }
 };
 
 // ************************ SkipListIterator ************************
+class SkipList;
 
 class SkipListIterator : public BaseIterator {
 public:
-  // ! deprecated: 构造函数，接收锁
-  // SkipListIterator(std::shared_ptr<SkipListNode> node, std::shared_mutex
-  // &mutex)
-  //     : current(node),
-  //       lock(std::make_shared<std::shared_lock<std::shared_mutex>>(mutex)) {}
+  // 构造函数, 持有 Arena 保证迭代器有效期间节点的内存不会被释放
+  SkipListIterator(SkipListNode *node, std::shared_ptr<Arena> arena)
+      : current(node), arena_(std::move(arena)) {}
 
-  // 构造函数
-  SkipListIterator(std::shared_ptr<SkipListNode> node) : current(node) {}
+  // 支持反向遍历的迭代器, 由 SkipList::seek_for_prev 创建
+  // 反向移动需要在跳表上重新查找, 迭代器有效期间 list 不能析构
+  SkipListIterator(SkipListNode *node, std::shared_ptr<Arena> arena,
+                   SkipList *list, uint64_t max_tranc_id)
+      : current(node), arena_(std::move(arena)), list_(list),
+        max_tranc_id_(max_tranc_id) {}
 
   // 空迭代器构造函数
-  SkipListIterator() : current(nullptr), lock(nullptr) {}
+  SkipListIterator() : current(nullptr), arena_(nullptr) {}
 
   virtual BaseIterator &operator++() override;
+  // 移动到前一个 key 对 max_tranc_id 可见的最新版本
+  virtual BaseIterator &operator--() override;
   virtual bool operator==(const BaseIterator &other) const override;
   virtual bool operator!=(const BaseIterator &other) const override;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
   virtual IteratorType get_type() const override;
   virtual bool is_end() const override;
   virtual bool is_valid() const override;
   std::string get_key() const;
   std::string get_value() const;
   uint64_t get_tranc_id() const override;
+  bool is_merge_operand() const override;
 
 private:
-  std::shared_ptr<SkipListNode> current;
-  std::shared_ptr<std::shared_lock<std::shared_mutex>>
-      lock; // 持有读锁, 整个迭代器有效期间都持有读锁
+  SkipListNode *current;
+  std::shared_ptr<Arena> arena_;
+  SkipList *list_ = nullptr;
+  uint64_t max_tranc_id_ = 0;
 };
 
 // ************************ SkipList ************************
+// 支持多个线程并发写入的跳表:
+// 1. 节点分配自 Arena, key 和 value 内联存储, 整个跳表的内存随 Arena 一次性释放
+// 2. 插入时逐层 CAS 链接节点, 写者之间不需要互斥, 读者遍历时也不需要加锁
+// 3. clear 不是线程安全的, 需要上层保证调用时没有其他线程访问
+// 4. 范围删除标记数量很少, 不放入 Arena, 由互斥锁保护, 读者在没有标记时
+//    不需要加锁
 
 class SkipList {
+  friend class SkipListIterator; // 反向移动时查找前一个 key
+
 private:
-  std::shared_ptr<SkipListNode>
-      head; // 跳表的头节点，不存储实际数据，用于遍历跳表
-  int max_level;     // 跳表的最大层级数，限制跳表的高度
-  int current_level; // 跳表当前的实际层级数，动态变化
-  size_t size_bytes = 0; // 跳表当前占用的内存大小（字节数），用于跟踪内存使用
-  // std::shared_mutex rw_mutex; // ! 目前看起来这个锁是冗余的, 在上层控制即可,
-  // 后续考虑是否需要细粒度的锁
-
-  std::uniform_int_distribution<> dis_01;
-  std::uniform_int_distribution<> dis_level;
-  std::mt19937 gen;
+  static constexpr int kMaxLevel = 32;
+
+  std::shared_ptr<Arena> arena_;
+  SkipListNode *head; // 跳表的头节点，不存储实际数据，用于遍历跳表
+  std::unique_ptr<char[]> head_mem; // 头节点的内存
+  int max_level;      // 跳表的最大层级数，限制跳表的高度
+  std::atomic<int> current_level; // 跳表当前的实际层级数，动态变化
+  // 跳表中有效数据的大小（key + value + tranc_id 的字节数）
+  std::atomic<size_t> size_bytes = 0;
+  // 写入过的 merge 操作数的数量, 没有操作数时读取和刷盘不需要合并
+  std::atomic<size_t> num_merge_operands = 0;
+
+  std::mutex range_del_mtx;
+  std::vector<RangeTombstone> range_dels;
+  std::atomic<size_t> num_range_dels = 0;
+  std::atomic<size_t> range_del_bytes = 0;
+  // range_dels 切分后的结果, 新增标记时置空, 下一次读取时重新构建
+  std::shared_ptr<const FragmentedRangeTombstones> fragmented_range_dels;
 
 private:
   int random_level(); // 生成新节点的随机层级数
+  static size_t node_size(size_t key_size, int height);
+  static SkipListNode *init_node(char *mem, const std::string &key,
+                                 uint64_t tranc_id, int height);
+  SkipListNode *new_node(const std::string &key, uint64_t tranc_id,
+                         int height);
+  void reset_head();
+  const char *new_value(const std::string &value, bool merge);
+
+  // (key, tranc_id) 排序: key 升序, key 相等时 tranc_id 降序
+  // prefix 为 key_prefix(key), 由调用者在查找开始时计算一次
+  static bool node_less(const SkipListNode *node, std::string_view key,
+                        uint64_t prefix, uint64_t tranc_id);
+  // 在 level 层从 before 开始向后查找, prev 为最后一个小于目标的节点,
+  // next 为 prev 在该层的后继
+  void find_splice_for_level(std::string_view key, uint64_t prefix,
+                             uint64_t tranc_id,
+                             SkipListNode *before, int level,
+                             SkipListNode **prev, SkipListNode **next);
+  // 返回第一个不小于 (key, tranc_id) 的节点
+  SkipListNode *seek(std::string_view key, uint64_t tranc_id);
+  static SkipListNode *skip_deleted(SkipListNode *node);
+  // 最后一个 key 小于 key 的节点 (任意版本), 不存在时返回 nullptr
+  SkipListNode *find_less_than(std::string_view key);
+  // 最后一个节点, 跳表为空时返回 nullptr
+  SkipListNode *find_last();
+  // node 为某个 key 的第一个节点, 返回其中没有被删除且对 tranc_id 可见的
+  // 最新版本, 不存在时返回 nullptr
+  static SkipListNode *visible_in_key(SkipListNode *node, uint64_t tranc_id);
+  // 最后一个小于 key 且有可见版本的 key 的最新可见版本
+  SkipListNode *prev_visible(std::string_view key, uint64_t tranc_id);
+  // 更新已经存在的相同 key 和 tranc_id 的节点
+  void update_node(SkipListNode *node, const std::string &value,
+                   const char *value_ptr);
 
 public:
   SkipList(int max_lvl = 16); // 构造函数，初始化跳表
 
-  // 析构函数需要确保没有其他线程访问
-  ~SkipList() {
-    // std::unique_lock<std::shared_mutex> lock(rw_mutex);
-    // ... 清理资源
-  }
+  ~SkipList() = default;
 
-  // 插入或更新键值对
+  // 插入或更新键值对, 可以被多个线程并发调用
   // 这里不对 tranc_id 进行检查，由上层保证 tranc_id 的合法性
-  void put(const std::string &key, const std::string &value, uint64_t tranc_id);
+  // merge 为 true 时写入的是 merge 操作数, 读取时需要与更旧的版本合并
+  void put(const std::string &key, const std::string &value, uint64_t tranc_id,
+           bool merge = false);
 
   // 查找键对应的值
   // 事务 id 为0 表示没有开启事务
@@ -125,19 +196,39 @@ public:
   // 返回值: 如果找到，返回 value 和 tranc_id，否则返回空
   SkipListIterator get(const std::string &key, uint64_t tranc_id);
 
+  // 写入删除 [begin, end) 的范围删除标记, 可以被多个线程并发调用
+  void add_range_tombstone(const std::string &begin, const std::string &end,
+                           uint64_t tranc_id);
+  // 全部范围删除标记, 没有标记时返回 nullptr
+  std::shared_ptr<const FragmentedRangeTombstones> get_range_tombstones();
+  size_t num_range_tombstones() const;
+  bool has_merge_operands() const;
+
   // !!! 这里的 remove 是跳表本身真实的 remove,  lsm 应该使用 put 空值表示删除
   void remove(const std::string &key); // 删除键值对
 
   // 将跳表数据刷出，返回有序键值对列表
   // value 为 真实 value 和 tranc_id 的二元组
+  // ! 不区分 merge 操作数, 存在操作数时需要先通过迭代器合并
   std::vector<std::tuple<std::string, std::string, uint64_t>> flush();
 
+  // 有效数据的大小, 用于估计刷盘后 sst 的大小, 包括范围删除标记
   size_t get_size();
+  // 跳表实际占用的内存(Arena 已申请的全部内存), 包括节点, 指针和内存碎片
+  // 用于判断 memtable 是否需要冻结和刷盘
+  size_t get_memory_usage();
 
   void clear(); // 清空跳表，释放内存
 
   SkipListIterator begin();
   SkipListIterator begin_preffix(const std::string &preffix);
+  // 第一个 key 不小于 key 的节点 (相同 key 的最新版本)
+  SkipListIterator lower_bound(const std::string &key);
+  // 反向遍历的起点: 最后一个不大于 key 且有对 tranc_id 可见的版本的 key,
+  // 定位到其中可见的最新版本; key 为空时从最后一个 key 开始
+  // ! 跳表没有反向指针, 每次反向移动都从头节点重新查找, 复杂度为 O(log n)
+  SkipListIterator seek_for_prev(const std::optional<std::string> &key,
+                                 uint64_t tranc_id);
 
   SkipListIterator end();
   SkipListIterator end_preffix(const std::string &preffix);
@@ -146,4 +237,4 @@ public:
   iters_monotony_predicate(std::function<int(const std::string &)> predicate);
 
   void print_skiplist();
-};
\ No newline at end of file
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../utils/files.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 键值分离(参考 WiscKey / BlobDB): 较大的 value 在 flush 时写入只追加的 blob
+ * 文件, sst 中只保存指向它的 BlobIndex, compact 时只需要复制 BlobIndex
+ *
+ * blob 文件由若干条记录组成, BlobIndex 直接指向记录中 value 的位置:
+ * ------------------------------------------------------------
+ * | key_len (32) | value_len (32) | key | value | ... |
+ * ------------------------------------------------------------
+ * 记录中的 key 用于排查问题和离线恢复, 读取时不会访问
+ *
+ * BlobIndex 的编码为 | file_id (varint) | offset (varint) | size (varint) |
+ */
+
+struct BlobIndex {
+  uint64_t file_id = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+
+  std::string encode() const;
+  static BlobIndex decode(std::string_view encoded);
+};
+
+// ************************ BlobFile ************************
+// 一个 blob 文件, 由引用它的 sst 共同持有
+// live_refs 为引用它的未删除的 sst 的数量, 降为 0 后文件成为垃圾,
+// 等到所有 sst 对象(可能仍被读者持有)都释放后才真正删除文件
+class BlobFile {
+public:
+  BlobFile(uint64_t file_id, std::string path);
+  ~BlobFile();
+
+  BlobFile(const BlobFile &) = delete;
+  BlobFile &operator=(const BlobFile &) = delete;
+
+  uint64_t get_file_id() const;
+  std::string read(uint64_t offset, uint64_t size);
+
+  void ref_live();
+  void unref_live();
+  size_t live_refs() const;
+
+private:
+  uint64_t file_id_;
+  std::string path_;
+  std::once_flag open_flag_; // 第一次读取时才打开文件
+  FileObj file_;
+  std::atomic<size_t> live_refs_{0};
+  std::atomic<bool> obsolete_{false}; // live_refs 降为 0 后析构时删除文件
+};
+
+// ************************ BlobFileBuilder ************************
+// 构建一个 blob 文件, 与 SSTBuilder 一样先在内存中拼接, finish 时一次性写入
+class BlobFileBuilder {
+public:
+  BlobFileBuilder(uint64_t file_id, std::string path);
+
+  // 追加一条记录, 返回指向 value 的 BlobIndex
+  BlobIndex add(const std::string &key, const std::string &value);
+  uint64_t get_file_id() const;
+  size_t size() const;
+  // 同 SSTBuilder::set_rate_limiter
+  void set_rate_limiter(std::shared_ptr<RateLimiter> rate_limiter,
+                        IOPriority priority);
+  // 将文件写入磁盘, 必须在引用它的 sst 对读者可见之前调用
+  void finish();
+
+private:
+  uint64_t file_id_;
+  std::string path_;
+  std::vector<uint8_t> data_;
+  std::shared_ptr<RateLimiter> rate_limiter_;
+  IOPriority io_priority_ = IOPriority::Flush;
+};
+
+// ************************ BlobStore ************************
+// 管理数据目录下的全部 blob 文件, 线程安全
+class BlobStore {
+public:
+  explicit BlobStore(std::string dir);
+
+  // 分配新的 blob 文件
+  std::unique_ptr<BlobFileBuilder> new_builder();
+
+  // 返回 file_id 对应的 blob 文件, 不存在时创建文件对象(不会打开文件)
+  std::shared_ptr<BlobFile> get_file(uint64_t file_id);
+
+  // 读取 BlobIndex 指向的 value
+  std::string read(const BlobIndex &index);
+
+  // 删除没有被任何 sst 引用的 blob 文件, 在打开全部 sst 之后调用
+  // 用于清理 flush 或 compact 中途崩溃留下的文件
+  void remove_unreferenced_files();
+
+  // 被引用的 blob 文件中, 最旧的 age_cutoff 比例的文件的 file_id 都小于返回值
+  // compact 时会将这些文件中的 value 重新写入新的 blob 文件, 回收部分失效的空间
+  uint64_t relocation_cutoff(double age_cutoff);
+
+  std::string get_file_path(uint64_t file_id) const;
+
+  static bool is_blob_file(const std::string &filename);
+
+private:
+  std::string dir_;
+  std::atomic<uint64_t> next_file_id_{0};
+  std::mutex mtx_;
+  std::unordered_map<uint64_t, std::weak_ptr<BlobFile>> files_;
+};
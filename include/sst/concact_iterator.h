@@ -2,7 +2,9 @@
 
 #include "sst.h"
 #include "sst_iterator.h"
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 class ConcactIterator : public BaseIterator {
@@ -12,18 +14,34 @@ private:
   std::vector<std::shared_ptr<SST>> ssts;
   uint64_t max_tranc_id_;
 
+  // 当前 sst 遍历完时切换到之后第一个有可见记录的 sst
+  // (只有范围删除标记的 sst 中没有记录)
+  void skip_empty_ssts();
+  // 反向遍历时当前 sst 遍历完, 切换到之前最后一个有可见记录的 sst
+  void skip_empty_ssts_reverse();
+
 public:
   ConcactIterator(std::vector<std::shared_ptr<SST>> ssts, uint64_t tranc_id);
+  // 从第一个不位于谓词范围左侧(谓词返回 <= 0)的 key 开始遍历
+  ConcactIterator(std::vector<std::shared_ptr<SST>> ssts, uint64_t tranc_id,
+                  const std::function<int(const std::string &)> &predicate);
+  // 从第一个不小于 key 的 key 开始遍历, 尾 key 小于 key 的 sst 不会打开
+  // reverse 为 true 时从最后一个不大于 key 的 key 开始反向遍历,
+  // 首 key 大于 key 的 sst 不会打开
+  ConcactIterator(std::vector<std::shared_ptr<SST>> ssts, uint64_t tranc_id,
+                  const std::string &key, bool reverse = false);
 
-  std::string key();
-  std::string value();
 
   virtual BaseIterator &operator++() override;
+  virtual BaseIterator &operator--() override;
   virtual bool operator==(const BaseIterator &other) const override;
   virtual bool operator!=(const BaseIterator &other) const override;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  virtual std::string_view value() const override;
   virtual IteratorType get_type() const override;
   virtual uint64_t get_tranc_id() const override;
+  virtual uint64_t get_entry_tranc_id() const override;
   virtual bool is_end() const override;
   virtual bool is_valid() const override;
 
@@ -2,18 +2,38 @@
 
 #include "../block/block.h"
 #include "../block/block_cache.h"
+#include "../block/block_index.h"
 #include "../block/blockmeta.h"
-#include "../utils/bloom_filter.h"
+#include "blob_file.h"
+#include "../utils/compression.h"
+#include "../utils/filter.h"
+#include "../utils/prefix_extractor.h"
 #include "../utils/files.h"
+#include "../utils/io_batch.h"
+#include "../utils/range_tombstone.h"
+#include "../utils/statistics.h"
+#include "../consts.h"
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 class SstIterator;
 
+// 记录在 MANIFEST 中的 sst 元数据, 打开 sst 时可以据此跳过读取索引和过滤器
+struct SstFileMeta {
+  std::string first_key;
+  std::string last_key;
+  size_t num_blocks = 0;
+  // 不为 0 时 sst 中全部 entry 的 tranc_id 都视为该值, 用于导入的外部 sst
+  uint64_t global_tranc_id = 0;
+};
+
 /**
  * SST文件的结构, 参考自 https://skyzh.github.io/mini-lsm/week1-04-sst.html
  * ------------------------------------------------------------------------
@@ -29,16 +49,49 @@ class SstIterator;
  last_key(last_key_len) |
  * ---------------------------------------------------------------------------------------------------
 
+ * flags 包含 kSstFlagBlockCodec 时, 每个 data block 的结构如下, 否则没有 codec
+ 字节, 并且 block 总是未压缩的:
+ * ------------------------------------------------------
+ * | block 或压缩后的 block | codec (8) | Hash (32)      |
+ * ------------------------------------------------------
+ * codec 为 CompressionType, Hash 覆盖 block 和 codec
+
  * Meta Section 的结构如下:
  * ---------------------------------------------------------------
  * | num_entries (32) | MetaEntry | ... | MetaEntry | Hash (32) |
  * ---------------------------------------------------------------
  * 其中, num_entries 表示 metadata 数组的长度, Hash 是 metadata
  数组的哈希值(只包括数组部分, 不包括 num_entries ), 用于校验 metadata 的完整性
+
+ * Extra 的结构如下, 版本 1 的文件没有最后的 format_version, flags 和 magic,
+ 打开时根据文件末尾的 magic 区分:
+ * ---------------------------------------------------------------------------
+ * | meta_offset (32) | bloom_offset (32) | min_tranc_id (64) | max_tranc_id
+ (64) | format_version (32) | flags (32) | magic (64) |
+ * ---------------------------------------------------------------------------
+ * 版本 1 的过滤器为 BloomFilter, 版本 2 的过滤器首字节为 FilterType
+ * flags 包含 kSstFlagPrefixFilter 时, 过滤器中还包含 key 的前缀,
+ 过滤器之后紧跟 PrefixExtractor 的名称:
+ * ------------------------------------------------------
+ * | filter | extractor_name | extractor_name_len (32) |
+ * ------------------------------------------------------
+ * flags 包含 kSstFlagBlobRefs 时, 之后还有 sst 引用的 blob 文件的 id:
+ * ----------------------------------------------------------
+ * | blob_file_id (64) | ... | blob_file_id (64) | num (32) |
+ * ----------------------------------------------------------
+ * flags 包含 kSstFlagRangeDel 时, Extra 之前是范围删除标记, 打开 sst 时读取
+ 并常驻内存, 编码见 FragmentedRangeTombstones::encode:
+ * ----------------------------------------
+ * | range_del block | range_del_size (32) |
+ * ----------------------------------------
+ * 首尾 key 会扩展到覆盖全部范围删除标记, 此时尾 key 可能是某个标记的 end,
+ 同一层相邻的 sst 可能在这个 key 上首尾相接; sst 中可以只有范围删除标记,
+ 没有 data block
  */
 
 class SST : public std::enable_shared_from_this<SST> {
   friend class SSTBuilder;
+  friend class SstIterator;
   friend std::optional<std::pair<SstIterator, SstIterator>>
   sst_iters_monotony_predicate(
       std::shared_ptr<SST> sst, uint64_t tranc_id,
@@ -46,43 +99,146 @@ class SST : public std::enable_shared_from_this<SST> {
 
 private:
   FileObj file;
-  std::vector<BlockMeta> meta_entries;
+  // 开启 LSM_SST_USE_MMAP 时 sst 文件的只读映射, 读到的 block 直接引用其内存
+  std::shared_ptr<MmapFile> mmap_file;
+  // 元数据由缓存池管理时(BlockCache::cache_meta), 只有被固定的 sst
+  // 会一直持有 block_index 和 bloom_filter, 否则需要通过 get_index /
+  // get_filter 从缓存池或者文件中获取
+  // 文件中的 BlockMeta 数组在读取后转换为紧凑的 BlockIndex
+  std::shared_ptr<BlockIndex> block_index;
+  size_t num_blocks_ = 0;
+  uint32_t bloom_size_ = 0; // 为 0 表示没有布隆过滤器
   uint32_t bloom_offset;
   uint32_t meta_block_offset;
   size_t sst_id;
   std::string first_key;
   std::string last_key;
-  std::shared_ptr<BloomFilter> bloom_filter;
+  std::shared_ptr<Filter> bloom_filter;
   std::shared_ptr<BlockCache> block_cache;
   uint64_t min_tranc_id_ = UINT64_MAX;
   uint64_t max_tranc_id_ = 0;
+  uint64_t global_tranc_id_ = 0;
+  uint32_t format_version_ = 1;
+  uint32_t format_flags_ = 0;
+  // 构建前缀过滤器使用的 PrefixExtractor 的名称, 没有前缀过滤器时为空
+  std::string prefix_extractor_name_;
+  // 已经从 LSM 中移除, 最后一个持有者释放时删除文件
+  std::atomic<bool> obsolete_{false};
+  // sst 中的范围删除标记, 没有时为 nullptr
+  std::shared_ptr<const FragmentedRangeTombstones> range_dels_;
+  // sst 中的 BlobIndex 引用的 blob 文件, 按 file_id 排序
+  std::vector<std::shared_ptr<BlobFile>> blob_files_;
+  // 持有 blob 文件并增加其引用计数, 删除 sst 时减少
+  void set_blob_files(const std::vector<uint64_t> &file_ids,
+                      std::shared_ptr<BlobStore> blob_store);
+
+  // 根据缓存池的配置决定元数据常驻内存还是放入缓存池
+  void init_meta(std::shared_ptr<BlockIndex> index,
+                 std::shared_ptr<Filter> filter, bool pin_meta);
+  std::shared_ptr<BlockIndex> load_index();
+  std::shared_ptr<Filter> load_filter();
+  size_t filter_charge() const;
+  // 获取 block 索引和布隆过滤器, 不在内存中时从文件读取并放入缓存池
+  std::shared_ptr<BlockIndex> get_index();
+  std::shared_ptr<Filter> get_filter();
+  // block 在文件中的 (offset, size)
+  std::pair<size_t, size_t> block_range_(size_t block_idx);
+  // 解码读到的 block, block_bytes 为空时 block_data 指向映射的内存
+  std::shared_ptr<Block> decode_block_(const uint8_t *block_data,
+                                       size_t block_size,
+                                       std::vector<uint8_t> block_bytes);
 
 public:
   // 从文件中打开sst
-  static std::shared_ptr<SST> open(size_t sst_id, FileObj file,
-                                   std::shared_ptr<BlockCache> block_cache);
+  // pin_meta 为 true 时, 元数据以高优先级放入缓存池, 并且 sst 始终持有它们
+  // sst 引用了 blob 文件时必须提供 blob_store
+  // 提供 file_meta 且元数据由缓存池管理时, 只读取文件末尾的 extra,
+  // 索引和过滤器在第一次访问时才从文件读取
+  static std::shared_ptr<SST>
+  open(size_t sst_id, FileObj file, std::shared_ptr<BlockCache> block_cache,
+       bool pin_meta = false, std::shared_ptr<BlobStore> blob_store = nullptr,
+       const SstFileMeta *file_meta = nullptr);
+  ~SST();
+  // 删除 sst 文件, 不再被任何 sst 引用的 blob 文件也会随之被删除
   void del_sst();
+  // 标记 sst 已经不属于最新的 Version, 仍然持有它的旧 Version 和迭代器都释放后
+  // 才删除文件
+  void mark_obsolete();
+  // 移动sst文件到新的路径, 主要用于调整sst所在的level
+  void rename_sst(const std::string &new_path);
   // 创建一个sst, 只包含首尾key的元数据
   static std::shared_ptr<SST> create_sst_with_meta_only(
       size_t sst_id, size_t file_size, const std::string &first_key,
       const std::string &last_key, std::shared_ptr<BlockCache> block_cache);
   // 根据索引读取block
-  std::shared_ptr<Block> read_block(size_t block_idx);
+  // fill_cache 为 false 时缓存中没有的 block 读取后不放入缓存池,
+  // 用于 compact 等一次性的大范围读取, 避免挤出点查的热点数据
+  std::shared_ptr<Block> read_block(size_t block_idx, bool fill_cache = true);
+  // ****** 批量读取 block 的提交 / 完成两个阶段 ******
+  // submit_block_read 先在缓存池中查找, 命中时直接返回 block; 否则把读取请求
+  // 加入 batch 并返回 nullptr, request 为请求的编号 (mmap 读取时只发起异步预读,
+  // request 为 SIZE_MAX). batch 完成该请求后 (SIZE_MAX 可以在 submit 之后直接)
+  // 调用 complete_block_read 解码, 放入缓存池并返回 block
+  std::shared_ptr<Block> submit_block_read(size_t block_idx, IoBatch &batch,
+                                           size_t &request);
+  std::shared_ptr<Block> complete_block_read(size_t block_idx, IoBatch &batch,
+                                             size_t request);
+  // 异步预读从 first_block 开始的连续 block, 总大小不超过 max_bytes
+  // (至少一个 block), 返回预读范围之后的第一个 block 的 idx
+  size_t prefetch_blocks(size_t first_block, size_t max_bytes);
 
   // 找到key所在的block的idx
   size_t find_block_idx(const std::string &key);
 
+  // 批量经过过滤器, keys[i] 可能存在时 results[i] 为 1, 否则为 0
+  // key_hashes[i] 为 hash64(keys[i]), 没有过滤器时全部为 1
+  // stats 不为空时记录过滤器的 BloomUseful / BloomFullPositive
+  void filter_batch(std::span<const std::string_view> keys,
+                    std::span<const uint64_t> key_hashes, uint8_t *results,
+                    Statistics *stats = nullptr);
+
+  // 返回第一个可能包含不小于 key 的 entry 的 block 的 idx,
+  // 不存在时返回 num_blocks(), 与 find_block_idx 不同, 不会经过布隆过滤器
+  size_t lower_bound_block_idx(const std::string &key);
+
+  // 返回 block 的下边界: 不大于 block 的首 key, 且大于前一个 block 的所有 key
+  // 用于划分 compact 子任务的 key 范围
+  std::string get_block_boundary_key(size_t block_idx);
+
   // 根据key返回迭代器
-  SstIterator get(const std::string &key, uint64_t tranc_id);
+  // stats 不为空时记录过滤器的判断结果, 以及判断可能存在时是否确实找到
+  SstIterator get(const std::string &key, uint64_t tranc_id,
+                  Statistics *stats = nullptr);
+  // 从第一个不小于 key 的 key 开始的迭代器, 用于范围查询
+  SstIterator seek(const std::string &key, uint64_t tranc_id);
+  // 从最后一个不大于 key 的 key 开始的迭代器, 用于反向的范围查询
+  SstIterator seek_for_prev(const std::string &key, uint64_t tranc_id);
+
+  // sst 中的范围删除标记, 没有时返回 nullptr
+  std::shared_ptr<const FragmentedRangeTombstones> get_range_tombstones() const;
+  // 覆盖 key 且对 tranc_id 可见的范围删除标记的最大 tranc_id, 没有时返回 0
+  uint64_t range_del_covering(std::string_view key, uint64_t tranc_id) const;
+
+  // 读取 BlobIndex 指向的 value
+  std::string read_blob(const std::string &blob_index);
+  std::vector<uint64_t> get_blob_file_ids() const;
+
+  // sst 中是否可能存在以 preffix 为前缀的 key, 会检查首尾key和前缀过滤器
+  // extractor 与构建 sst 时使用的不一致时, 只检查首尾key
+  bool preffix_may_match(const std::string &preffix,
+                         const PrefixExtractor *extractor);
 
   // 返回sst中block的数量
   size_t num_blocks() const;
 
+  // sst 是否有完整 key 的过滤器
+  bool has_filter() const;
+
   // 返回sst的首key
-  std::string get_first_key() const;
+  const std::string &get_first_key() const;
 
   // 返回sst的尾key
-  std::string get_last_key() const;
+  const std::string &get_last_key() const;
 
   // 返回sst的大小
   size_t sst_size() const;
@@ -90,6 +246,9 @@ public:
   // 返回sst的id
   size_t get_sst_id() const;
 
+  // 返回需要记录到 MANIFEST 中的元数据
+  SstFileMeta get_file_meta() const;
+
   std::optional<std::pair<SstIterator, SstIterator>>
   iters_monotony_predicate(std::function<bool(const std::string &)> predicate);
 
@@ -97,6 +256,42 @@ public:
   SstIterator end();
 
   std::pair<uint64_t, uint64_t> get_tranc_id_range() const;
+
+  // 导入的外部 sst 中的 entry 写入时 tranc_id 都为 0, 由 MANIFEST 记录的全局
+  // tranc_id 代替, 不需要重写文件; 读取 entry 的 tranc_id 时需要经过 resolve
+  void set_global_tranc_id(uint64_t tranc_id);
+  uint64_t get_global_tranc_id() const;
+  uint64_t resolve_tranc_id(uint64_t entry_tranc_id) const {
+    return global_tranc_id_ != 0 ? global_tranc_id_ : entry_tranc_id;
+  }
+  // sst 对 tranc_id 是否可见, 只有全局 tranc_id 更大的导入的 sst 不可见
+  bool visible_to(uint64_t tranc_id) const {
+    return tranc_id == 0 || global_tranc_id_ <= tranc_id;
+  }
+
+  // 返回sst文件的格式版本
+  uint32_t get_format_version() const;
+};
+
+// 顺序读取 block 时的自适应预读
+// 连续读取相邻的 block 时, 读到已预读范围的一半时异步预读之后的 block,
+// 预读的大小从 LSM_SST_READAHEAD_MIN 开始, 每次预读后翻倍, 不超过
+// LSM_SST_READAHEAD_MAX; 出现不连续的读取或者切换到其他 sst 时重新检测
+// sequential 为 true 时 (compact 的输入) 读取一定是顺序的,
+// 第一次读取就按上限预读
+class SstReadahead {
+public:
+  explicit SstReadahead(bool sequential = false);
+  // 读取 sst 的第 block_idx 个 block 之前调用, 返回这次新预读的 block 数
+  size_t on_block_read(SST &sst, size_t block_idx);
+
+private:
+  bool sequential_;
+  const SST *sst_ = nullptr;
+  size_t last_block_ = SIZE_MAX;
+  size_t prefetched_end_ = 0; // 已经预读的范围之后的第一个 block
+  size_t trigger_block_ = 0;  // 读到该 block 时发起下一次预读
+  size_t readahead_bytes_;
 };
 
 class SSTBuilder {
@@ -107,19 +302,51 @@ private:
   std::vector<BlockMeta> meta_entries;
   std::vector<uint8_t> data;
   size_t block_size;
-  std::shared_ptr<BloomFilter> bloom_filter;
+  bool has_bloom_;
+  // 所有不重复的 key 和前缀的哈希值, build 时一次性构建过滤器
+  std::vector<uint64_t> key_hashes;
+  std::shared_ptr<PrefixExtractor> prefix_extractor_;
+  std::string last_prefix_;
+  std::vector<uint64_t> blob_file_ids_; // BlobIndex 引用的 blob 文件
+  FilterType filter_type_;
+  CompressionType compression_;
+  size_t bloom_bits_per_key_;
   uint64_t min_tranc_id_ = UINT64_MAX;
   uint64_t max_tranc_id_ = 0;
+  std::vector<RangeTombstone> range_dels_;
+  size_t range_del_bytes_ = 0;
+  std::shared_ptr<RateLimiter> rate_limiter_;
+  IOPriority io_priority_ = IOPriority::Flush;
 
 public:
   // 创建一个sst构建器, 指定目标block的大小
-  SSTBuilder(size_t block_size, bool has_bloom); // 添加一个key-value对
-  void add(const std::string &key, const std::string &value, uint64_t tranc_id);
+  // prefix_extractor 不为空时, 过滤器中同时记录 key 的前缀
+  // filter_type 为 BlockedBloom 或 Xor8, 决定 build 时构建的过滤器
+  // compression 为 data block 的压缩算法, 压缩收益不足的 block 不会被压缩
+  // bloom_bits_per_key 为 BlockedBloom 过滤器中每个 key 占用的位数
+  SSTBuilder(size_t block_size, bool has_bloom,
+             std::shared_ptr<PrefixExtractor> prefix_extractor = nullptr,
+             FilterType filter_type = FilterType::BlockedBloom,
+             CompressionType compression = CompressionType::None,
+             size_t bloom_bits_per_key = LSM_BLOOM_BITS_PER_KEY);
+  // 添加一个key-value对, blob_index 为 true 时 value 为编码后的 BlobIndex
+  void add(const std::string &key, const std::string &value, uint64_t tranc_id,
+           bool blob_index = false);
+  // 添加一个删除 [begin, end) 的范围删除标记, 与 add 的顺序无关
+  void add_range_tombstone(const std::string &begin, const std::string &end,
+                           uint64_t tranc_id);
   // 估计sst的大小
   size_t estimated_size() const;
   // 完成当前block的构建, 即将block写入data, 并创建新的block
   void finish_block();
+  // build 时写入文件的限速器和优先级, 为空时不限速
+  void set_rate_limiter(std::shared_ptr<RateLimiter> rate_limiter,
+                        IOPriority priority);
   // 构建sst, 将sst写入文件并返回SST描述类
+  // 既没有数据也没有范围删除标记时抛出异常
+  // pin_meta 和 blob_store 的含义同 SST::open
   std::shared_ptr<SST> build(size_t sst_id, const std::string &path,
-                             std::shared_ptr<BlockCache> block_cache);
+                             std::shared_ptr<BlockCache> block_cache,
+                             bool pin_meta = false,
+                             std::shared_ptr<BlobStore> blob_store = nullptr);
 };
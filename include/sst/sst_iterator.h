@@ -1,5 +1,6 @@
 #pragma once
 #include "../block/block_iterator.h"
+#include "sst.h"
 #include <cstddef>
 #include <functional>
 #include <memory>
@@ -9,11 +10,19 @@
 
 class SstIterator;
 class SST;
+class PrefixExtractor;
 
 std::optional<std::pair<SstIterator, SstIterator>>
 sst_iters_monotony_predicate(std::shared_ptr<SST> sst, uint64_t tranc_id,
                              std::function<int(const std::string &)> predicate);
 
+// 返回以 preffix 为前缀的 key 的范围
+// 前缀过滤器表明 sst 中不存在该前缀时直接返回空, 不会读取任何 block
+std::optional<std::pair<SstIterator, SstIterator>>
+sst_iters_preffix(std::shared_ptr<SST> sst, uint64_t tranc_id,
+                  const std::string &preffix,
+                  const PrefixExtractor *extractor);
+
 class SstIterator : public BaseIterator {
   friend std::optional<std::pair<SstIterator, SstIterator>>
   sst_iters_monotony_predicate(
@@ -28,10 +37,16 @@ private:
   uint64_t max_tranc_id_;
   std::shared_ptr<BlockIterator> m_block_it;
   mutable std::optional<value_type> cached_value; // 缓存当前值
+  // 当前 value 为 BlobIndex 时从 blob 文件读取的 value
+  mutable std::optional<std::string> blob_value_;
+  // 跨越 block 边界时检测顺序读取并预读之后的 block
+  SstReadahead readahead_;
 
   void update_current() const;
   void set_block_idx(size_t idx);
   void set_block_it(std::shared_ptr<BlockIterator> it);
+  // 当前 block 中没有更小的可见 key 时, 定位到之前的 block 中最后一个可见的 key
+  void seek_prev_block();
 
 public:
   // 创建迭代器, 并移动到第一个key
@@ -39,6 +54,10 @@ public:
   // 创建迭代器, 并移动到第指定key
   SstIterator(std::shared_ptr<SST> sst, const std::string &key,
               uint64_t tranc_id);
+  // 创建迭代器, 并移动到第一个不位于谓词范围左侧(谓词返回 <= 0)的 key
+  // 只会读取范围开头所在的 block, 适合按需推进的范围查询
+  SstIterator(std::shared_ptr<SST> sst, uint64_t tranc_id,
+              const std::function<int(const std::string &)> &predicate);
 
   // 创建迭代器, 并移动到第指定前缀的首端或者尾端
   static std::optional<std::pair<SstIterator, SstIterator>>
@@ -46,16 +65,26 @@ public:
                            std::function<bool(const std::string &)> predicate);
 
   void seek_first();
+  // 精确查找 key, 会经过布隆过滤器, 用于点查
   void seek(const std::string &key);
-  std::string key();
-  std::string value();
+  // 移动到第一个不小于 key 的 key, 之前的 block 不会读取
+  void seek_lower_bound(const std::string &key);
+  // 反向遍历的起点: 最后一个不大于 key 的 key
+  void seek_for_prev(const std::string &key);
+  void seek_monotony_predicate(
+      const std::function<int(const std::string &)> &predicate);
 
   virtual BaseIterator &operator++() override;
+  virtual BaseIterator &operator--() override;
   virtual bool operator==(const BaseIterator &other) const override;
   virtual bool operator!=(const BaseIterator &other) const override;
   virtual value_type operator*() const override;
+  virtual std::string_view key() const override;
+  // BlobIndex 只在第一次读取 value 时访问 blob 文件
+  virtual std::string_view value() const override;
   virtual IteratorType get_type() const override;
   virtual uint64_t get_tranc_id() const override;
+  virtual uint64_t get_entry_tranc_id() const override;
   virtual bool is_end() const override;
   virtual bool is_valid() const override;
 
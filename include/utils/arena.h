@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 线程安全的内存池, 用于跳表节点的分配
+// 只支持分配, 不支持单独释放, 所有内存在 Arena 析构时一次性释放
+// 第一次分配时才会申请 block, 未使用的 Arena 不占用内存
+class Arena {
+public:
+  explicit Arena(size_t block_size = 4096);
+  ~Arena() = default;
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // 分配 bytes 字节的内存, 按 8 字节对齐, 可以被多个线程并发调用
+  char *allocate(size_t bytes);
+
+  // 已经向系统申请的内存总量, 包括 block 中尚未使用的部分
+  size_t memory_usage() const;
+
+private:
+  struct Block {
+    std::atomic<size_t> used{0};
+    size_t capacity = 0;
+    std::unique_ptr<char[]> data;
+  };
+
+  // 当前 block 空间不足时, 在锁内切换到新的 block
+  char *allocate_fallback(Block *full_block, size_t bytes);
+  Block *new_block(size_t capacity);
+
+private:
+  size_t block_size_;
+  std::atomic<Block *> cur_block_{nullptr};
+  std::atomic<size_t> memory_usage_{0};
+  std::mutex mtx_; // 只在申请新的 block 时使用
+  std::vector<std::unique_ptr<Block>> blocks_;
+};
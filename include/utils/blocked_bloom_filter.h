@@ -0,0 +1,49 @@
+#pragma once
+
+#include "filter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 按 cache line 分块的布隆过滤器
+// 每个 key 的全部探测位都位于同一个 64 字节的 cache line 中,
+// 一次查询最多只有一次 cache miss. 编码格式如下:
+// ----------------------------------------------------------------------
+// | type (1B) | num_probes (1B) | reserved (2B) | num_lines (4B) | lines |
+// ----------------------------------------------------------------------
+class BlockedBloomFilter : public Filter {
+public:
+  // 根据所有 key 的哈希值(hash64)和前缀的哈希值(prefix_hash)构建过滤器
+  // bits_per_key 越大假阳性率越低, 10 时约为 1%
+  static std::shared_ptr<BlockedBloomFilter>
+  build(const std::vector<uint64_t> &key_hashes, size_t bits_per_key);
+
+  bool possibly_contains(const std::string &key) const override;
+  bool possibly_contains_prefix(std::string_view preffix) const override;
+  bool possibly_contains_hash(uint64_t key_hash) const;
+  void possibly_contains_batch(std::span<const std::string_view> keys,
+                               std::span<const uint64_t> key_hashes,
+                               uint8_t *results) const override;
+
+  std::vector<uint8_t> encode_filter() override;
+  static std::shared_ptr<BlockedBloomFilter> decode(const uint8_t *data,
+                                                    size_t size);
+
+  size_t num_lines() const;
+  int num_probes() const;
+
+private:
+  struct alignas(64) CacheLine {
+    uint64_t words[8];
+  };
+
+  // 计算 key 在 cache line 内的探测位, 结果为 8 个 64 位的掩码
+  static void probe_mask(uint32_t h, int num_probes, uint64_t mask[8]);
+  size_t line_idx(uint64_t key_hash) const;
+
+  std::vector<CacheLine> lines_;
+  int num_probes_ = 1;
+};
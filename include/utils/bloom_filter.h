@@ -2,12 +2,14 @@
 
 #pragma once
 
+#include "filter.h"
 #include <cmath>
 #include <functional>
 #include <string>
 #include <vector>
 
-class BloomFilter {
+// 标准布隆过滤器, 旧版本 sst 使用的过滤器格式
+class BloomFilter : public Filter {
 public:
   // 构造函数，初始化布隆过滤器
   // expected_elements: 预期插入的元素数量
@@ -21,12 +23,13 @@ public:
   void add(const std::string &key);
 
   // 如果key可能存在于布隆过滤器中，返回true；否则返回false
-  bool possibly_contains(const std::string &key) const;
+  bool possibly_contains(const std::string &key) const override;
 
   // 清空布隆过滤器
   void clear();
 
   std::vector<uint8_t> encode();
+  std::vector<uint8_t> encode_filter() override;
   static BloomFilter decode(const std::vector<uint8_t> &data);
 
 private:
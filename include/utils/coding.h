@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// varint 编码: 每个字节的低 7 位保存数据, 最高位表示之后是否还有字节
+// 32 位整数最多占 5 个字节, 64 位整数最多占 10 个字节
+
+inline size_t varint_length(uint64_t value) {
+  size_t len = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+// 写入 dst, 返回写入的最后一个字节之后的位置, 调用者保证空间足够
+inline uint8_t *encode_varint(uint8_t *dst, uint64_t value) {
+  while (value >= 0x80) {
+    *dst++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *dst++ = static_cast<uint8_t>(value);
+  return dst;
+}
+
+// 从 [ptr, limit) 中解码, 返回解码后的下一个位置, 数据不完整时返回 nullptr
+inline const uint8_t *decode_varint(const uint8_t *ptr, const uint8_t *limit,
+                                    uint64_t *value) {
+  uint64_t result = 0;
+  for (unsigned shift = 0; shift < 64 && ptr < limit; shift += 7) {
+    uint64_t byte = *ptr++;
+    result |= (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return ptr;
+    }
+  }
+  return nullptr;
+}
+
+// zigzag 编码将绝对值较小的有符号数映射为较小的无符号数, 便于 varint 压缩
+inline uint64_t zigzag_encode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// sst 中 block 的压缩算法, 写入每个 block 末尾的 codec 字节
+enum class CompressionType : uint8_t {
+  None = 0,
+  LZ4 = 1,  // LZ4 block 格式, 内置实现, 压缩和解压都很快
+  Zstd = 2, // 压缩率更高, 需要开启 xmake 的 zstd 选项
+};
+
+// 当前构建是否支持该压缩算法
+bool compression_supported(CompressionType type);
+
+// 压缩 data, 结果的格式为 | raw_size (32) | 压缩后的数据 |
+// 算法不支持或者压缩后没有明显变小时返回 false, 调用者应当保存原始数据
+bool compress_block(CompressionType type, const uint8_t *data, size_t size,
+                    std::vector<uint8_t> &out);
+
+// 解压 compress_block 的结果, 数据损坏或者算法不支持时抛出异常
+std::vector<uint8_t> decompress_block(CompressionType type,
+                                      const uint8_t *data, size_t size);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli), 用于校验 WAL 中的每个 batch
+// x86 支持 SSE4.2 或 ARMv8 支持 CRC 扩展时使用硬件指令, 否则使用查表实现
+// ! 结果会被持久化到 WAL 中, 与 iSCSI / ext4 等使用的 CRC32C 完全兼容
+uint32_t crc32c(const void *data, size_t len, uint32_t init_crc = 0);
+
+// 当前 CPU 是否支持硬件加速
+bool crc32c_hardware_supported();
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "mmap_file.h"
+#include "posix_file.h"
+#include "rate_limiter.h"
 #include "std_file.h"
 #include <cstddef>
 #include <cstdint>
@@ -8,9 +10,17 @@
 #include <string>
 #include <vector>
 
+// 文件的底层实现, 默认使用基于 pread / pwrite / fdatasync 的 PosixFile
+// 定义 LSM_USE_STD_FILE 时使用基于 std::fstream 的 StdFile
+#ifdef LSM_USE_STD_FILE
+using FileBackend = StdFile;
+#else
+using FileBackend = PosixFile;
+#endif
+
 class FileObj {
 private:
-  std::unique_ptr<StdFile> m_file;
+  std::unique_ptr<FileBackend> m_file;
   size_t m_size;
 
 public:
@@ -35,13 +45,25 @@ public:
   // 删除文件
   void del_file();
 
+  // 重命名文件
+  void rename(const std::string &new_path);
+
   // 创建文件对象, 并写入到磁盘
   static FileObj create_and_write(const std::string &path,
                                   std::vector<uint8_t> buf);
+  // 同上, rate_limiter 不为空时分段获取令牌后再写入, 用于后台任务
+  static FileObj create_and_write(const std::string &path,
+                                  std::vector<uint8_t> buf,
+                                  RateLimiter *rate_limiter,
+                                  IOPriority priority);
 
   // 打开文件对象
   static FileObj open(const std::string &path, bool create);
 
+  // 为不再修改的文件创建硬链接, 不在同一个文件系统中时复制
+  // 失败时抛出 std::filesystem::filesystem_error
+  static void link_or_copy(const std::string &src, const std::string &dst);
+
   // 读取并返回切片
   std::vector<uint8_t> read_to_slice(size_t offset, size_t length);
 
@@ -64,4 +86,17 @@ public:
   bool append(std::vector<uint8_t> &buf);
 
   bool sync();
+
+  // 异步预读 [offset, offset + length), 读取时命中页缓存, 后端不支持时返回 false
+  bool prefetch(size_t offset, size_t length);
+
+  // 后端的文件描述符, 后端不支持时返回 -1
+  int native_fd() const;
+
+  // 预先分配 [0, size) 的空间, 之后在其中的写入不需要更新文件的元数据
+  bool allocate(size_t size);
+
+  // 将文件映射到内存, 用于 sst 的零拷贝读取, 失败时返回 nullptr
+  // ! 映射的大小在调用时确定, 之后追加的内容不可见
+  std::shared_ptr<MmapFile> map_file() const;
 };
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 过滤器的类型, 位于过滤器编码后的第一个字节
+// ! 旧版本 sst 中的 BloomFilter 没有这个字节, 由 sst 的格式版本区分
+enum class FilterType : uint8_t {
+  Bloom = 0,        // BloomFilter
+  BlockedBloom = 1, // BlockedBloomFilter
+  Xor8 = 2,         // XorFilter
+};
+
+// sst 使用的过滤器的公共接口
+class Filter {
+public:
+  virtual ~Filter() = default;
+
+  // 如果key可能存在于过滤器中，返回true；否则返回false
+  virtual bool possibly_contains(const std::string &key) const = 0;
+
+  // 如果存在以 preffix 为前缀的 key, 返回true
+  // preffix 需要是 PrefixExtractor::transform 的结果, 不支持前缀的过滤器总是返回true
+  virtual bool possibly_contains_prefix(std::string_view preffix) const {
+    return true;
+  }
+
+  // 批量判断 keys 是否可能存在, keys[i] 可能存在时 results[i] 为 1, 否则为 0
+  // key_hashes[i] 为 hash64(keys[i]), 批量查询时每个 key 只计算一次哈希值
+  // 默认逐个调用 possibly_contains, 基于 hash64 的过滤器先计算全部探测位置并
+  // 预取, 再统一探测, 多个 cache miss 可以相互重叠
+  virtual void possibly_contains_batch(std::span<const std::string_view> keys,
+                                       std::span<const uint64_t> key_hashes,
+                                       uint8_t *results) const;
+
+  // 前缀使用单独的种子计算哈希值, 与完整的 key (hash64) 共用同一个过滤器
+  static uint64_t prefix_hash(std::string_view preffix);
+
+  // 编码过滤器, 第一个字节为 FilterType
+  virtual std::vector<uint8_t> encode_filter() = 0;
+
+  // 根据第一个字节的 FilterType 解码过滤器, 类型未知时抛出异常
+  static std::shared_ptr<Filter> decode_filter(const std::vector<uint8_t> &data);
+};
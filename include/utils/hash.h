@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 不分配内存的 64 位哈希函数, 实现参考 wyhash
+// ! 结果会被持久化到 sst 的过滤器中, 修改实现会导致已有文件的过滤器失效
+uint64_t hash64(const void *data, size_t len, uint64_t seed = 0);
+
+inline uint64_t hash64(std::string_view key, uint64_t seed = 0) {
+  return hash64(key.data(), key.size(), seed);
+}
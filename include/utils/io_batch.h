@@ -0,0 +1,68 @@
+#pragma once
+
+#include "files.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef LSM_HAS_IO_URING
+struct io_uring;
+#endif
+
+// 一批文件读取请求, 一次提交, 按完成的顺序处理
+// 1. 先通过 add 添加全部请求, 之后调用一次 submit, 再反复调用 wait_any
+//    取得完成的请求, 直到返回 SIZE_MAX
+// 2. 开启 io_uring 选项 (LSM_HAS_IO_URING) 时, 请求通过 io_uring 一次提交,
+//    同时在途的请求数不超过 LSM_IO_URING_QUEUE_DEPTH
+// 3. 否则 (或者 io_uring 不可用时) submit 对全部请求发起异步预读,
+//    内核并发地读取它们, wait_any 再按添加的顺序逐个 pread, 命中页缓存
+// ! submit 之后不能再添加请求
+class IoBatch {
+public:
+  IoBatch() = default;
+  ~IoBatch();
+
+  IoBatch(const IoBatch &) = delete;
+  IoBatch &operator=(const IoBatch &) = delete;
+
+  // 添加读取 file 中 [offset, offset + length) 的请求, 返回请求的编号
+  // file 需要在请求完成之前保持有效
+  size_t add(FileObj &file, size_t offset, size_t length);
+
+  // 提交全部请求, 不等待完成
+  void submit();
+
+  // 等待任意一个请求完成, 返回其编号; 全部请求都已经返回过时返回 SIZE_MAX
+  // 读取失败时抛出异常
+  size_t wait_any();
+
+  // 已经完成的请求读到的数据
+  std::vector<uint8_t> &data(size_t request);
+
+  size_t size() const;
+
+private:
+  struct Request {
+    FileObj *file;
+    size_t offset;
+    size_t length;
+    std::vector<uint8_t> buf;
+    bool via_ring = false; // 是否通过 io_uring 读取
+    bool done = false;
+  };
+
+  std::vector<Request> requests_;
+  bool submitted_ = false;
+  size_t next_sync_ = 0; // 下一个可能需要同步读取的请求
+
+#ifdef LSM_HAS_IO_URING
+  // 在队列深度允许的范围内继续提交请求
+  void submit_ring_();
+  // 取出一个完成的请求, wait 为 false 时没有完成的请求返回 SIZE_MAX
+  size_t reap_ring_(bool wait);
+
+  io_uring *ring_ = nullptr;
+  size_t next_ring_ = 0; // 下一个等待提交到 io_uring 的请求
+  size_t inflight_ = 0;
+#endif
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// ****** 定长的 key 前缀 (abbreviated key) ******
+// key 的前 8 个字节按大端序组成的整数, 不足 8 个字节时低位补 0
+// 两个前缀不相等时整数的大小关系与 key 的字典序一致, 相等时 (包括 key 只有
+// 补 0 的差别, 例如 "a" 和 "a\0") 才需要比较完整的 key
+inline uint64_t key_prefix(std::string_view key) {
+  uint64_t prefix = 0;
+  if (key.size() >= sizeof(uint64_t)) {
+    std::memcpy(&prefix, key.data(), sizeof(uint64_t));
+  } else {
+    std::memcpy(&prefix, key.data(), key.size());
+  }
+  return __builtin_bswap64(prefix);
+}
+
+// 先比较前缀, 前缀相等时再比较完整的 key, 返回值同 std::string_view::compare
+inline int compare_with_prefix(uint64_t a_prefix, std::string_view a,
+                               uint64_t b_prefix, std::string_view b) {
+  if (a_prefix != b_prefix) {
+    return a_prefix < b_prefix ? -1 : 1;
+  }
+  return a.compare(b);
+}
+
+// 升序的 prefixes 中小于 target 的个数, 即 target 的 lower bound
+// CPU 支持 AVX2 时每次比较 4 个前缀, 适合 block 中几十个 restart 点的规模
+size_t key_prefix_lower_bound(const uint64_t *prefixes, size_t n,
+                              uint64_t target);
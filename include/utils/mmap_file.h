@@ -46,6 +46,12 @@ public:
   // 同步到磁盘
   bool sync();
 
+  // 返回映射内存中 [offset, offset + length) 的指针, 不复制数据
+  const uint8_t *view(size_t offset, size_t length) const;
+
+  // 通知内核异步读入 [offset, offset + length) 的页, 之后访问时不会缺页阻塞
+  bool prefetch(size_t offset, size_t length) const;
+
 private:
   // 禁止拷贝
   MmapFile(const MmapFile &) = delete;
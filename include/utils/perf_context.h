@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// 当前线程记录 perf context 的级别, 默认关闭
+// 关闭时每个埋点只有一次线程局部变量的读取和比较
+enum class PerfLevel : uint8_t {
+  Disable = 0,     // 不记录
+  EnableCount = 1, // 只记录计数
+  EnableTime = 2,  // 同时记录各阶段的耗时, 每个计时点需要两次读取时钟
+};
+
+// 单个线程上的各阶段耗时 (纳秒) 和计数, 只会累加
+// 用法: set_perf_level 开启后, 在调用前 reset, 调用后读取 get_perf_context()
+// 例如只对慢请求输出其 to_string, 用于定位时间花在了哪个阶段
+struct PerfContext {
+  // ****** LSMEngine::get ******
+  uint64_t get_nanos = 0;          // get 的总耗时
+  uint64_t memtable_get_nanos = 0; // 内存表阶段, 包括等待锁和范围删除标记
+  uint64_t memtable_lock_nanos = 0; // 等待 cur_mtx / frozen_mtx 的时间
+  uint64_t memtable_probes = 0;     // 查询的跳表数量
+  uint64_t get_from_l0_nanos = 0;     // 在 l0 的 sst 中查询
+  uint64_t get_from_levels_nanos = 0; // 在 l1 及更深的 sst 中查询
+  uint64_t sst_checked = 0; // 检查的 sst 数量 (key 位于其范围内)
+
+  // ****** 过滤器 ******
+  uint64_t bloom_useful = 0;   // 判断不存在, 跳过了 sst
+  uint64_t bloom_positive = 0; // 判断可能存在
+
+  // ****** BlockCache ******
+  uint64_t block_cache_hits = 0;       // 数据 block 命中
+  uint64_t block_cache_misses = 0;     // 数据 block 未命中
+  uint64_t block_cache_lock_nanos = 0; // 等待分片锁的时间, 包括元数据的查询
+
+  // ****** 读取和解码 block ******
+  uint64_t blocks_read = 0;        // 从文件 (或者 mmap) 读取的 block 数量
+  uint64_t block_read_bytes = 0;   // 读取的字节数
+  uint64_t block_read_nanos = 0;   // 同步读取的耗时, 批量读取的 I/O 不计入
+  uint64_t block_decode_bytes = 0; // 解码的字节数 (解压前)
+  uint64_t block_decode_nanos = 0; // 校验, 解压和解码的耗时
+
+  void reset();
+  // "name = value" 的列表, 只包含不为 0 的项
+  std::string to_string() const;
+};
+
+namespace perf_detail {
+inline thread_local PerfLevel level = PerfLevel::Disable;
+inline thread_local PerfContext context;
+} // namespace perf_detail
+
+inline void set_perf_level(PerfLevel level) { perf_detail::level = level; }
+inline PerfLevel get_perf_level() { return perf_detail::level; }
+inline PerfContext &get_perf_context() { return perf_detail::context; }
+
+// 级别不低于 EnableCount 时累加计数
+inline void perf_count(uint64_t PerfContext::*metric, uint64_t value = 1) {
+  if (perf_detail::level >= PerfLevel::EnableCount) {
+    perf_detail::context.*metric += value;
+  }
+}
+
+// 级别为 EnableTime 时, 析构时把经过的纳秒数累加到 metric 上
+class PerfTimer {
+public:
+  explicit PerfTimer(uint64_t PerfContext::*metric)
+      : metric_(perf_detail::level >= PerfLevel::EnableTime ? metric
+                                                            : nullptr) {
+    if (metric_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~PerfTimer() {
+    if (metric_ != nullptr) {
+      perf_detail::context.*metric_ +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count();
+    }
+  }
+
+  PerfTimer(const PerfTimer &) = delete;
+  PerfTimer &operator=(const PerfTimer &) = delete;
+
+private:
+  uint64_t PerfContext::*metric_;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 基于 POSIX 文件描述符的文件实现
+// 1. read / write 使用 pread / pwrite, 不依赖共享的文件偏移,
+//    多个线程可以同时读取同一个文件
+// 2. sync 使用 fdatasync, 数据真正写入磁盘后才返回
+class PosixFile {
+private:
+  int fd_;
+  std::string filename_;
+  std::atomic<size_t> file_size_; // 缓存文件大小, 避免每次读取都调用 fstat
+
+public:
+  PosixFile() : fd_(-1), file_size_(0) {}
+  ~PosixFile() { close(); }
+
+  PosixFile(const PosixFile &) = delete;
+  PosixFile &operator=(const PosixFile &) = delete;
+
+  // 打开文件, create 为 true 时创建或清空文件
+  bool open(const std::string &filename, bool create);
+
+  // 创建文件
+  bool create(const std::string &filename, std::vector<uint8_t> &buf);
+
+  // 关闭文件
+  void close();
+
+  // 获取文件大小
+  size_t size();
+
+  // 写入数据, 可以超出当前文件的末尾
+  bool write(size_t offset, const void *data, size_t size);
+
+  // 读取数据, 线程安全
+  std::vector<uint8_t> read(size_t offset, size_t length);
+
+  // 同步到磁盘
+  bool sync();
+  // 通知内核异步预读 [offset, offset + length), 不等待读取完成
+  bool prefetch(size_t offset, size_t length);
+
+  // 预先分配 [0, size) 的磁盘空间, 文件不足 size 时扩展并以 0 填充
+  bool allocate(size_t size);
+
+  // 删除文件
+  bool remove();
+
+  // 文件路径
+  std::string path() const { return filename_; }
+
+  // 文件描述符, 用于 io_uring 等直接提交请求的接口, 没有打开时为 -1
+  int native_fd() const { return fd_; }
+
+  // 重命名文件, 已经打开的文件描述符仍然有效
+  bool rename(const std::string &new_filename);
+};
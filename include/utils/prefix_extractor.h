@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 从 key 中提取前缀, 用于构建 sst 的前缀过滤器
+// 前缀查询 preffix 能使用过滤器的前提是 in_domain(preffix) 为 true,
+// 此时所有以 preffix 开头的 key 的前缀都等于 transform(preffix)
+class PrefixExtractor {
+public:
+  virtual ~PrefixExtractor() = default;
+
+  // 名称会写入 sst, 与引擎当前使用的 extractor 不一致时不使用前缀过滤器
+  virtual std::string name() const = 0;
+
+  // key 是否存在前缀
+  virtual bool in_domain(std::string_view key) const = 0;
+
+  // 返回 key 的前缀, 只能在 in_domain(key) 为 true 时调用
+  virtual std::string_view transform(std::string_view key) const = 0;
+};
+
+// 取 key 的前 len 个字节作为前缀
+class FixedPrefixExtractor : public PrefixExtractor {
+public:
+  explicit FixedPrefixExtractor(size_t len);
+
+  std::string name() const override;
+  bool in_domain(std::string_view key) const override;
+  std::string_view transform(std::string_view key) const override;
+
+private:
+  size_t len_;
+};
+
+// RedisWrapper 中集合类型的 key 的格式为 namespace + key + "_" + ...,
+// 取到 namespace 之后第一个 '_' (包含) 为止作为前缀
+// ! key 本身包含 '_' 时前缀会更短, 但同一个 key 的元素的前缀仍然相同
+class RedisPrefixExtractor : public PrefixExtractor {
+public:
+  RedisPrefixExtractor();
+
+  std::string name() const override;
+  bool in_domain(std::string_view key) const override;
+  std::string_view transform(std::string_view key) const override;
+
+private:
+  // 返回前缀的长度, 不存在前缀时返回 0
+  size_t prefix_len(std::string_view key) const;
+
+  std::vector<std::string> namespaces_;
+};
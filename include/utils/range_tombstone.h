@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 范围删除标记, 删除 [begin, end) 中 tranc_id 小于自身的全部版本
+// ! tranc_id 相等时以点记录为准: 同一个 WriteBatch 中 remove_range 之前的
+// ! put / remove 已经在 WriteBatch 中被丢弃
+struct RangeTombstone {
+  std::string begin;
+  std::string end; // 不包含
+  uint64_t tranc_id;
+
+  RangeTombstone() = default;
+  RangeTombstone(std::string begin, std::string end, uint64_t tranc_id)
+      : begin(std::move(begin)), end(std::move(end)), tranc_id(tranc_id) {}
+
+  bool operator==(const RangeTombstone &other) const = default;
+};
+
+// 一组可能互相重叠的范围删除标记, 切分为互不重叠的片段后用于查询
+// 每个片段记录覆盖它的全部标记的 tranc_id (降序), 查询时二分定位片段
+class FragmentedRangeTombstones {
+public:
+  struct Fragment {
+    std::string begin;
+    std::string end;
+    std::vector<uint64_t> tranc_ids; // 降序
+  };
+
+  FragmentedRangeTombstones() = default;
+  explicit FragmentedRangeTombstones(std::vector<RangeTombstone> tombstones);
+
+  bool empty() const;
+  // 构建时传入的原始标记, 按 begin 升序排列
+  const std::vector<RangeTombstone> &tombstones() const;
+  const std::vector<Fragment> &fragments() const;
+
+  // 覆盖 key 且对 max_tranc_id 可见的标记中最大的 tranc_id, 没有时返回 0
+  // max_tranc_id 为 0 表示全部可见
+  uint64_t max_covering(std::string_view key, uint64_t max_tranc_id) const;
+
+  // ****** sst 中的 range_del block ******
+  // | num (varint) | {begin_len (varint) | begin | end_len (varint) | end |
+  // | tranc_id (varint)} ... |
+  static void encode(const std::vector<RangeTombstone> &tombstones,
+                     std::vector<uint8_t> &dst);
+  static std::vector<RangeTombstone> decode(const uint8_t *data, size_t size);
+
+private:
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../consts.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+// 后台写入的优先级, 数值越小优先级越高
+enum class IOPriority : uint32_t {
+  Flush,        // 内存表刷盘, 积压会直接阻塞前台写入
+  L0Compaction, // 输出到 l1 的 compact, 消化 l0 的积压
+  Compaction,   // 更深层级的 compact
+  Num,
+};
+
+// 令牌桶限速器, 用于 flush 和 compact 写入 sst / blob 文件
+// 每 LSM_RATE_LIMITER_REFILL_PERIOD_US 补充一次令牌, 令牌不跨周期累积;
+// 令牌不足时请求按优先级排队, 补充后先满足高优先级的请求,
+// 同一优先级内先到先得. 可以通过 Options::rate_limiter 由多个引擎共用
+// ! WAL 等前台写入不经过限速器
+class RateLimiter {
+public:
+  // auto_tuned 为 true 时 bytes_per_second 为速率的上限,
+  // 实际速率随 update_compaction_debt 报告的积压在 [上限 / ratio, 上限] 之间调整
+  explicit RateLimiter(
+      int64_t bytes_per_second, bool auto_tuned = false,
+      int64_t refill_period_us = LSM_RATE_LIMITER_REFILL_PERIOD_US);
+
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  // 阻塞直到获得 bytes 个令牌, 超过一个周期的请求拆分为多次获取
+  void request(size_t bytes, IOPriority priority);
+
+  // 修改速率 (自动调节时为上限), 从下一次补充开始生效
+  void set_bytes_per_second(int64_t bytes_per_second);
+  int64_t get_bytes_per_second() const;
+  // 当前实际生效的速率
+  int64_t get_effective_bytes_per_second() const;
+  bool is_auto_tuned() const { return auto_tuned_; }
+  // 单次获取的令牌上限, 即一个周期补充的令牌数, 写入者按该大小分段写入
+  size_t get_single_burst_bytes() const;
+
+  // 报告 compact 的积压程度, 0 表示没有积压, 1 表示即将阻塞写入
+  // 积压越多速率越高; 多个引擎共用时以最近一次报告为准
+  void update_compaction_debt(double debt);
+
+  // 通过限速器的总字节数 / 等待令牌的总时间
+  uint64_t get_total_bytes_through(IOPriority priority) const;
+  uint64_t get_total_wait_micros() const;
+
+private:
+  struct Request {
+    size_t bytes;
+    bool granted = false;
+  };
+  using Clock = std::chrono::steady_clock;
+
+  void request_chunk(size_t bytes, IOPriority priority);
+  // 补充令牌并按优先级满足排队的请求, 需要持有 mtx_
+  void refill_(Clock::time_point now);
+  // 一个周期补充的令牌数
+  int64_t refill_bytes_() const;
+  bool queues_empty_() const;
+
+  const bool auto_tuned_;
+  const int64_t refill_period_us_;
+  std::atomic<int64_t> max_bytes_per_second_;
+  std::atomic<int64_t> bytes_per_second_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  int64_t available_bytes_;
+  Clock::time_point next_refill_;
+  std::array<std::deque<Request *>, static_cast<size_t>(IOPriority::Num)>
+      queues_;
+
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(IOPriority::Num)>
+      total_bytes_{};
+  std::atomic<uint64_t> total_wait_micros_{0};
+};
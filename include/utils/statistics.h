@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../consts.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// 累加的计数器
+enum class Ticker : uint32_t {
+  GetHitMemtable,    // get 在内存表中找到 (包括删除标记)
+  GetHitRowCache,    // get 在行缓存中找到, 不需要查询 sst
+  GetHitL0,          // get 在 l0 的 sst 中找到
+  GetHitL1,          // get 在 l1 的 sst 中找到
+  GetHitL2AndUp,     // get 在 l2 及更深的 sst 中找到
+  GetMiss,           // get 在所有数据源中都没有找到
+  BloomUseful,       // 过滤器判断不存在, 省去了一次 sst 查询
+  BloomFullPositive, // 过滤器判断可能存在
+  BloomTruePositive, // 过滤器判断可能存在, 且确实在 sst 中找到
+  StallCount,        // 写入被阻塞的次数
+  StallMicros,       // 写入被阻塞的总时间
+  FlushBytes,        // flush 写入的 sst 字节数
+  CompactReadBytes,  // compact 输入的 sst 字节数
+  CompactWriteBytes, // compact 输出的 sst 字节数
+  WalBytes,          // 写入 WAL 的字节数
+  Num,
+};
+
+// 直方图, 除 SstPerGet 之外单位都是微秒
+enum class HistogramType : uint32_t {
+  Get,        // 单个 key 的 get
+  MultiGet,   // get_batch 整体
+  Write,      // 不经过事务的 put / remove / write
+  Commit,     // 事务的 commit
+  Flush,      // 一次 flush
+  Compaction, // 一次后台 compact
+  WalSync,    // WAL 一个组的写入和 sync
+  SstPerGet,  // get 时检查的 sst 数量 (key 位于其范围内, 包括被过滤器排除的)
+  Num,
+};
+
+constexpr size_t kTickerNum = static_cast<size_t>(Ticker::Num);
+constexpr size_t kHistogramNum = static_cast<size_t>(HistogramType::Num);
+
+// 直方图的汇总结果
+// 桶按 HDR 的方式划分: 小于 8 的值各占一个桶, 之后每个 2 的幂次区间再等分为
+// 8 个子区间, 任意大小的值相对误差都不超过 1/8, 桶的数量固定
+struct HistogramData {
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  std::array<uint64_t, kNumBuckets> buckets{};
+
+  // 单线程地记录一个值, 以及合并另一组数据, 用于不需要并发写入的场景
+  void add(uint64_t value);
+  void merge(const HistogramData &other);
+
+  double mean() const;
+  // p 为百分比 (0 ~ 100), 在所在的桶内线性插值, 没有数据时返回 0
+  double percentile(double p) const;
+
+  static size_t bucket_index(uint64_t value);
+  // 桶对应的值的范围 [lower, lower + width)
+  static uint64_t bucket_lower(size_t idx);
+  static uint64_t bucket_width(size_t idx);
+};
+
+// 引擎的统计信息
+// 线程按首次使用的顺序分散到 LSM_STATS_SHARD_NUM 个缓存行对齐的分片上,
+// 记录时只对所在分片做 relaxed 的原子累加, 不同线程之间几乎没有竞争;
+// 读取时再汇总全部分片, 汇总期间写入的数据可能只有一部分被计入
+class Statistics {
+public:
+  Statistics();
+
+  Statistics(const Statistics &) = delete;
+  Statistics &operator=(const Statistics &) = delete;
+
+  void record_tick(Ticker ticker, uint64_t count = 1);
+  void record(HistogramType type, uint64_t value);
+
+  uint64_t get_ticker(Ticker ticker) const;
+  HistogramData get_histogram(HistogramType type) const;
+  // 清零全部计数器和直方图
+  void reset();
+
+  // INFO 输出中使用的名称
+  static const char *ticker_name(Ticker ticker);
+  static const char *histogram_name(HistogramType type);
+
+private:
+  struct HistogramShard {
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> min{UINT64_MAX};
+    std::atomic<uint64_t> max{0};
+    std::array<std::atomic<uint64_t>, HistogramData::kNumBuckets> buckets{};
+  };
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, kTickerNum> tickers{};
+    std::array<HistogramShard, kHistogramNum> histograms;
+  };
+
+  Shard &local_shard();
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+// 析构时把经过的时间 (微秒) 记录到直方图中, stats 为空时不做任何事
+class StopWatch {
+public:
+  StopWatch(Statistics *stats, HistogramType type);
+  ~StopWatch();
+
+  StopWatch(const StopWatch &) = delete;
+  StopWatch &operator=(const StopWatch &) = delete;
+
+  uint64_t elapsed_micros() const;
+
+private:
+  Statistics *stats_;
+  HistogramType type_;
+  std::chrono::steady_clock::time_point start_;
+};
@@ -40,7 +40,21 @@ public:
 
   // 同步到磁盘
   bool sync();
+  // std::fstream 无法预读, 总是返回 false
+  bool prefetch(size_t offset, size_t length);
+
+  // 文件不足 size 时以 0 填充到 size
+  bool allocate(size_t size);
 
   // 删除文件
   bool remove();
+
+  // 文件路径
+  std::string path() const { return filename_.string(); }
+
+  // std::fstream 没有可以直接提交请求的文件描述符
+  int native_fd() const { return -1; }
+
+  // 重命名文件, 已经打开的文件句柄仍然有效
+  bool rename(const std::string &new_filename);
 };
\ No newline at end of file
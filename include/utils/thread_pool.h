@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// 简单的固定线程数的线程池, 用于后台 flush / compact 等任务
+// 析构时会执行完队列中已经提交的任务后再退出
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t thread_num);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // 提交任务, 返回对应的 future
+  template <typename F> auto submit(F &&f) -> std::future<decltype(f())> {
+    using R = decltype(f());
+    // std::function 要求可拷贝, 因此 packaged_task 需要用 shared_ptr 包一层
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> res = task->get_future();
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    cv_.notify_one();
+    return res;
+  }
+
+  size_t thread_num() const;
+
+private:
+  void worker_loop();
+
+private:
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
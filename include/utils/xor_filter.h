@@ -0,0 +1,47 @@
+#pragma once
+
+#include "filter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 8 位指纹的 Xor 过滤器, 参考 Graf & Lemire, "Xor Filters: Faster and
+// Smaller Than Bloom and Cuckoo Filters"
+// 每个 key 约占 9.84 位, 假阳性率约为 0.39%, 相同假阳性率下比布隆过滤器
+// 节省约 30% 的空间, 但构建更慢, 适合数据量最大的底层 sst. 编码格式如下:
+// -------------------------------------------------------------------
+// | type (1B) | reserved (3B) | block_length (4B) | seed (8B) | fps |
+// -------------------------------------------------------------------
+class XorFilter : public Filter {
+public:
+  // 根据所有 key 的哈希值(hash64)和前缀的哈希值(prefix_hash)构建过滤器
+  // 重复的哈希值会被去重
+  static std::shared_ptr<XorFilter> build(std::vector<uint64_t> key_hashes);
+
+  bool possibly_contains(const std::string &key) const override;
+  bool possibly_contains_prefix(std::string_view preffix) const override;
+  bool possibly_contains_hash(uint64_t key_hash) const;
+  void possibly_contains_batch(std::span<const std::string_view> keys,
+                               std::span<const uint64_t> key_hashes,
+                               uint8_t *results) const override;
+
+  std::vector<uint8_t> encode_filter() override;
+  static std::shared_ptr<XorFilter> decode(const uint8_t *data, size_t size);
+
+  size_t size_in_bytes() const;
+
+private:
+  // 返回哈希值在三个分段中对应的下标
+  void positions(uint64_t h, uint32_t pos[3]) const;
+  uint64_t mix(uint64_t key_hash) const;
+  static uint8_t fingerprint(uint64_t h);
+  // 用给定的种子尝试构建, 存在环导致无法剥离时返回 false
+  bool try_build(const std::vector<uint64_t> &key_hashes);
+
+  uint64_t seed_ = 0;
+  uint32_t block_length_ = 0;
+  std::vector<uint8_t> fingerprints_;
+};
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -12,6 +14,8 @@ enum class OperationType {
   ROLLBACK,
   PUT,
   DELETE,
+  DELETE_RANGE, // key 和 value 分别为删除范围的 begin 和 end (不包含)
+  MERGE,        // value 为 merge 操作数
 };
 
 class Record {
@@ -25,21 +29,45 @@ public:
   static Record createRecord(uint64_t tranc_id);
   static Record commitRecord(uint64_t tranc_id);
   static Record rollbackRecord(uint64_t tranc_id);
-  static Record putRecord(uint64_t tranc_id, const std::string &key,
-                          const std::string &value);
-  static Record deleteRecord(uint64_t tranc_id, const std::string &key);
+  static Record putRecord(uint64_t tranc_id, std::string key,
+                          std::string value);
+  static Record deleteRecord(uint64_t tranc_id, std::string key);
+  static Record deleteRangeRecord(uint64_t tranc_id, std::string begin,
+                                  std::string end);
+  static Record mergeRecord(uint64_t tranc_id, std::string key,
+                            std::string operand);
 
-  // 编码记录
-  std::vector<uint8_t> encode() const;
-
-  // 解码记录
-  static std::vector<Record> decode(const std::vector<uint8_t> &data);
+  // ****** WAL batch ******
+  // WAL 中每次写入的全部记录编码为一个 batch, 追加到 dst 的末尾:
+  // ----------------------------------------------------------
+  // | crc32c (32) | payload_len (32) | count (32) | payload |
+  // ----------------------------------------------------------
+  // crc32c 覆盖 payload_len, count 和 payload, payload 由 count 条记录组成:
+  // | tranc_id (varint) | op (8) | cf_id (varint) | key_len (varint) | key |
+  // | value_len (varint) | value |
+  // 只有 PUT, DELETE, DELETE_RANGE 和 MERGE 包含 key, 只有 PUT,
+  // DELETE_RANGE 和 MERGE 包含 value; 只有非默认列族的记录包含 cf_id,
+  // 此时 op 的最高位为 1, 因此默认列族的编码与没有列族时相同
+  static void encode_batch(const std::vector<Record> &records,
+                           std::vector<uint8_t> &dst);
+  // 依次解码 [data, data + size) 中的 batch, 遇到不完整或者校验失败的 batch
+  // (写入时崩溃, 或者预先分配的空白区域)时停止, 之后的数据都被忽略
+  static std::vector<Record> decode_batches(const uint8_t *data, size_t size);
+  // 解码 batch 格式之前的 WAL 文件, 每条记录单独编码:
+  // | record_len (16) | tranc_id (64) | op (8) | key_len (16) | key |
+  // | value_len (16) | value |
+  // 只有 PUT 和 DELETE 包含 key, 只有 PUT 包含 value, 不完整的记录及之后的
+  // 数据都被忽略; 只用于恢复升级前留下的 WAL 文件
+  static std::vector<Record> decode_legacy(const uint8_t *data, size_t size);
 
   // 获取记录的各个部分
   uint64_t getTrancId() const { return tranc_id_; }
   OperationType getOperationType() const { return operation_type_; }
-  std::string getKey() const { return key_; }
-  std::string getValue() const { return value_; }
+  const std::string &getKey() const { return key_; }
+  const std::string &getValue() const { return value_; }
+  // 记录所属的列族, 0 为默认列族
+  uint32_t getColumnFamilyId() const { return cf_id_; }
+  void setColumnFamilyId(uint32_t cf_id) { cf_id_ = cf_id; }
 
   // 打印记录（用于调试）
   void print() const;
@@ -47,10 +75,17 @@ public:
   bool operator==(const Record &other) const;
   bool operator!=(const Record &other) const;
 
+private:
+  // 解码一个校验通过的 batch 中的 count 条记录, 格式错误时返回空
+  static std::optional<std::vector<Record>>
+  decode_batch_payload(const uint8_t *ptr, size_t payload_len, uint32_t count);
+  bool has_key() const;
+  bool has_value() const;
+
 private:
   uint64_t tranc_id_;
   OperationType operation_type_;
+  uint32_t cf_id_ = 0;
   std::string key_;
   std::string value_;
-  uint16_t record_len_;
 };
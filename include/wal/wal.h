@@ -2,47 +2,156 @@
 
 #pragma once
 
+#include "../consts.h"
 #include "../utils/files.h"
+#include "../utils/statistics.h"
 #include "record.h"
 #include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+// 流式恢复 WAL 的统计信息
+struct WalRecoveryStats {
+  size_t num_files = 0;
+  size_t num_bytes = 0;   // 读取的 WAL 文件总大小
+  size_t num_records = 0; // 重放的记录数
+  size_t num_trancs = 0;  // 重放的已提交事务数
+  double elapsed_sec = 0;
+
+  // 每秒恢复的 WAL 数据量, 单位为 MB
+  double throughput_mb() const;
+};
+
+// WAL 中的位置, 用于从这里继续读取之后提交的记录
+// epoch 在每次打开 WAL 时随机生成, 重启之前的位置不能再使用
+struct WalPosition {
+  uint64_t epoch = 0;
+  uint64_t seq = 0;    // 所在的 WAL 文件
+  uint64_t offset = 0; // 文件中 batch 的边界
+
+  bool operator==(const WalPosition &other) const = default;
+};
+
 class WAL {
 public:
+  // 每个 WAL 文件以 kSegmentMagic 开头, 之后是依次追加的 batch
+  // 没有该标记的文件由 batch 格式之前的版本写入, 恢复时按旧格式逐条解码
+  static constexpr char kSegmentMagic[8] = {'T', 'L', 'S', 'M',
+                                            'W', 'A', 'L', '2'};
+  static constexpr size_t kSegmentHeaderSize = sizeof(kSegmentMagic);
+
+  // 每个 WAL 文件写满 file_size_limit 后切换到下一个文件
+  // 不再需要的文件最多保留 recycle_num 个, 清零后作为之后的新文件复用
+  // stats 不为空时记录每个组的写入字节数和 sync 延迟
   WAL(const std::string &log_dir, size_t buffer_size,
       uint64_t max_finished_tranc_id, uint64_t clean_interval,
-      uint64_t file_size_limit);
+      uint64_t file_size_limit, size_t recycle_num = LSM_WAL_RECYCLE_NUM,
+      std::shared_ptr<Statistics> stats = nullptr);
   ~WAL();
 
   static std::map<uint64_t, std::vector<Record>>
   recover(const std::string &log_dir, uint64_t max_finished_tranc_id);
 
+  // 流式恢复: thread_num 个线程并行解码 WAL 文件, 同时最多只有 thread_num
+  // 个文件的记录在内存中, 然后按文件顺序将已提交事务的全部记录分批交给 apply
+  // 每批至少包含 batch_size 条记录(最后一批除外), 同一个事务的记录不会被拆分
+  // 没有 COMMIT 记录的事务(写入时崩溃)和回滚的事务会被丢弃
+  static WalRecoveryStats
+  recover_streaming(const std::string &log_dir, uint64_t max_flushed_tranc_id,
+                    size_t thread_num, size_t batch_size,
+                    const std::function<void(std::vector<Record> &)> &apply);
+
   // 将记录添加到缓冲区
+  // 缓冲区满或者 force_flush 时, 记录交给写线程, 并阻塞到记录写入磁盘为止
+  // 多个线程同时提交的记录会被写线程合并为一次写入和一次 sync(组提交)
   void log(const std::vector<Record> &records, bool force_flush = false);
 
   // 强制将缓冲区中的数据写入 WAL 文件
   void flush();
 
+  // 所有 tranc_id 不大于 max_finished_tranc_id 的记录都已经刷入 sst,
+  // 只包含这些记录的 WAL 文件可以被清理
   void set_max_finished_tranc_id(uint64_t max_finished_tranc_id);
 
+  // 创建检查点: 暂停清理 WAL 文件后调用 checkpoint 保存 sst, 其返回值为 sst
+  // 中已经包含的最大 tranc_id, 然后将可能包含更大 tranc_id 的 WAL 文件复制到 dir
+  // 正在写入的文件末尾可能是不完整的 batch, 恢复时会被丢弃
+  void copy_to(const std::string &dir,
+               const std::function<uint64_t()> &checkpoint);
+
+  // 已经写入磁盘的记录的末尾, 之后提交的记录从这里开始
+  WalPosition end_position();
+  // 读取 from 之后已经写入磁盘的全部 batch 的记录, 追加到 records 中
+  // 读取的数据量达到 max_bytes 后在文件的边界停止, 返回下一次读取的位置
+  // from 之后的文件已经被清理, 或者 epoch 不一致时抛出 std::runtime_error
+  WalPosition read_from(const WalPosition &from, size_t max_bytes,
+                        std::vector<Record> &records);
+
 private:
+  // log_dir 下的 WAL 文件, 按 seq 升序排列
+  static std::vector<std::string> list_wal_paths(const std::string &log_dir);
+  // 解码 WAL 文件中 tranc_id 大于 max_flushed_tranc_id 的记录
+  static std::vector<Record> decode_wal_file(const std::string &wal_path,
+                                             uint64_t max_flushed_tranc_id);
+  // 根据文件开头的标记选择解码的格式
+  static std::vector<Record> decode_segment(const uint8_t *data, size_t size);
   void cleaner();
+  // 写线程, 将所有等待中的记录编码到一块连续的内存, 一次写入并 sync
+  void writer();
+  // 将 log_buffer_ 交给写线程, 返回需要等待的组号, 调用者需要持有 mutex_
+  uint64_t submit_buffer_();
   void cleanWALFile();
   void reset_file();
+  // 切换到序号为 seq 的文件, 优先复用空闲文件, 调用者需要持有 mutex_
+  void open_segment(uint64_t seq);
+  std::string get_segment_path(uint64_t seq) const;
 
 protected:
+  // 已经写满的 WAL 文件的元数据, 在切换文件时记录
+  struct SegmentMeta {
+    uint64_t max_tranc_id; // 文件中记录的最大 tranc_id
+    size_t size;           // 写入的数据量
+  };
+
   std::string active_log_path_;
   FileObj log_file_;
   size_t file_size_limit_;
+  std::string log_dir_;
+  uint64_t active_seq_ = 0;
+  // 以下两个成员只会被写线程修改
+  size_t write_offset_ = 0;          // 当前文件中下一条记录的写入位置
+  uint64_t segment_max_tranc_id_ = 0; // 当前文件中记录的最大 tranc_id
+  std::vector<uint8_t> write_buf_;    // 编码 batch 的缓冲区
+  std::map<uint64_t, SegmentMeta> sealed_segments_; // {seq, meta}
+  uint64_t epoch_;
+  // 已经写入磁盘的记录的末尾, 由写线程在 sync 之后更新
+  uint64_t synced_seq_ = 0;
+  size_t synced_offset_ = 0;
+  std::vector<std::string> free_segments_; // 清零后等待复用的文件
+  size_t recycle_num_;
+  std::shared_ptr<Statistics> stats_;
   std::mutex mutex_;
+  // 清理文件和 copy_to 互斥, 复制期间已经列出的文件不会被删除或者复用
+  std::mutex clean_mtx_;
   std::vector<Record> log_buffer_;
   size_t buffer_size_;
+  // ****** 组提交 ******
+  std::vector<Record> pending_records_; // 等待写线程写入的记录
+  uint64_t filling_group_ = 1; // pending_records_ 所属的组号
+  uint64_t synced_group_ = 0;  // 已经写入磁盘的最大组号
+  bool io_failed_ = false;     // 写入失败后不再接受新的记录
+  bool stop_writer_ = false;
+  std::condition_variable writer_cv_; // 唤醒写线程
+  std::condition_variable synced_cv_; // 唤醒等待写入完成的提交者
+  std::thread writer_thread_;
   std::thread cleaner_thread_;
   uint64_t max_finished_tranc_id_;
   std::atomic<bool> stop_cleaner_;
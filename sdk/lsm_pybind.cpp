@@ -3,9 +3,107 @@
 #include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace py = pybind11;
 
+// ****** 批量接口 ******
+// 引擎中的工作在释放 GIL 之后进行, 返回的 key / value 均为 bytes,
+// 不需要逐个解码 UTF-8
+
+namespace {
+
+// [start, end) 中最多 limit 个键值对, start / end 为空表示不限制,
+// limit 为 0 表示不限制数量; visit 返回 false 时提前结束
+template <typename F>
+void scan_range(LSM &lsm, const std::optional<std::string> &start,
+                const std::optional<std::string> &end, size_t limit,
+                F &&visit) {
+  ReadOptions options;
+  options.lower_bound = start;
+  options.upper_bound = end;
+  auto iter = lsm.new_iterator(std::move(options));
+  iter.seek_to_first();
+  for (size_t count = 0; iter.is_valid() && (limit == 0 || count < limit);
+       count++, iter.next()) {
+    visit(iter.key(), iter.value());
+  }
+}
+
+py::list get_batch(LSM &lsm, const std::vector<std::string> &keys) {
+  std::vector<std::pair<std::string, std::optional<std::string>>> results;
+  {
+    py::gil_scoped_release release;
+    results = lsm.get_batch(keys);
+  }
+  py::list values(results.size());
+  for (size_t i = 0; i < results.size(); i++) {
+    auto &value = results[i].second;
+    if (value.has_value()) {
+      values[i] = py::bytes(value->data(), value->size());
+    } else {
+      values[i] = py::none();
+    }
+  }
+  return values;
+}
+
+py::list scan(LSM &lsm, const std::optional<std::string> &start,
+              const std::optional<std::string> &end, size_t limit) {
+  std::vector<std::pair<std::string, std::string>> kvs;
+  {
+    py::gil_scoped_release release;
+    scan_range(lsm, start, end, limit,
+               [&kvs](std::string_view key, std::string_view value) {
+                 kvs.emplace_back(key, value);
+               });
+  }
+  py::list result(kvs.size());
+  for (size_t i = 0; i < kvs.size(); i++) {
+    result[i] =
+        py::make_tuple(py::bytes(kvs[i].first), py::bytes(kvs[i].second));
+  }
+  return result;
+}
+
+// 与 Arrow 的 large_binary 相同的列式布局: offsets 为 count + 1 个本机字节序的
+// int64, 第 i 个元素为 data[offsets[i], offsets[i + 1]), 每一列只需要创建
+// 两个 bytes 对象
+py::dict scan_columns(LSM &lsm, const std::optional<std::string> &start,
+                      const std::optional<std::string> &end, size_t limit) {
+  std::vector<int64_t> key_offsets = {0};
+  std::vector<int64_t> value_offsets = {0};
+  std::string key_data;
+  std::string value_data;
+  {
+    py::gil_scoped_release release;
+    scan_range(lsm, start, end, limit,
+               [&](std::string_view key, std::string_view value) {
+                 key_data.append(key);
+                 value_data.append(value);
+                 key_offsets.push_back(key_data.size());
+                 value_offsets.push_back(value_data.size());
+               });
+  }
+  auto to_bytes = [](const std::vector<int64_t> &offsets) {
+    return py::bytes(reinterpret_cast<const char *>(offsets.data()),
+                     offsets.size() * sizeof(int64_t));
+  };
+  py::dict result;
+  result["count"] = key_offsets.size() - 1;
+  result["key_offsets"] = to_bytes(key_offsets);
+  result["key_data"] = py::bytes(key_data);
+  result["value_offsets"] = to_bytes(value_offsets);
+  result["value_data"] = py::bytes(value_data);
+  return result;
+}
+
+} // namespace
+
 // 绑定 TwoMergeIterator 迭代器
 void bind_TwoMergeIterator(py::module &m) {
   py::class_<TwoMergeIterator>(m, "TwoMergeIterator")
@@ -42,9 +140,12 @@ void bind_TranContext(py::module &m) {
       .def("commit", &TranContext::commit,
            py::arg("test_fail") = false) // 处理默认参数
       .def("abort", &TranContext::abort)
-      .def("get", &TranContext::get)
-      .def("remove", &TranContext::remove)
-      .def("put", &TranContext::put);
+      // 只绑定默认列族的 get / remove / put
+      .def("get", py::overload_cast<const std::string &>(&TranContext::get))
+      .def("remove",
+           py::overload_cast<const std::string &>(&TranContext::remove))
+      .def("put", py::overload_cast<const std::string &, const std::string &>(
+                      &TranContext::put));
 }
 
 void bind_IsolationLevel(py::module &m) {
@@ -67,18 +168,36 @@ PYBIND11_MODULE(lsm_pybind, m) {
   py::class_<LSM>(m, "LSM")
       .def(py::init<const std::string &>())
       // 基础操作
-      .def("put", &LSM::put, py::arg("key"), py::arg("value"),
+      // put / get / remove / begin 有多个重载, 需要指明绑定的版本
+      .def("put",
+           py::overload_cast<const std::string &, const std::string &>(
+               &LSM::put),
+           py::arg("key"), py::arg("value"),
            "Insert a key-value pair (bytes type)")
-      .def("get", &LSM::get, py::arg("key"),
+      .def("get", py::overload_cast<const std::string &>(&LSM::get),
+           py::arg("key"),
            "Get value by key, returns None if not found")
-      .def("remove", &LSM::remove, py::arg("key"), "Delete a key")
-      // 批量操作
+      .def("remove", py::overload_cast<const std::string &>(&LSM::remove),
+           py::arg("key"), "Delete a key")
+      // 批量操作, 参数在释放 GIL 之前转换
       .def("put_batch", &LSM::put_batch, py::arg("kvs"),
+           py::call_guard<py::gil_scoped_release>(),
            "Batch insert key-value pairs")
       .def("remove_batch", &LSM::remove_batch, py::arg("keys"),
-           "Batch delete keys")
+           py::call_guard<py::gil_scoped_release>(), "Batch delete keys")
+      .def("get_batch", &get_batch, py::arg("keys"),
+           "Get values of keys as a list of bytes (None if not found)")
+      .def("scan", &scan, py::arg("start") = py::none(),
+           py::arg("end") = py::none(), py::arg("limit") = 0,
+           "List of (key, value) bytes tuples in [start, end), at most limit "
+           "pairs (0 for no limit)")
+      .def("scan_columns", &scan_columns, py::arg("start") = py::none(),
+           py::arg("end") = py::none(), py::arg("limit") = 0,
+           "Same range as scan, returned as Arrow large_binary style buffers: "
+           "count, key_offsets, key_data, value_offsets, value_data")
       // 迭代器
-      .def("begin", &LSM::begin, py::arg("tranc_id"),
+      .def("begin", py::overload_cast<uint64_t>(&LSM::begin),
+           py::arg("tranc_id"),
            "Start an iterator with transaction ID")
       .def("end", &LSM::end, "Get end iterator")
       // 事务
@@ -25,3 +25,22 @@ t.commit()
 
 db.get("tomxx")
 # '1'
+
+# 批量接口返回 bytes, 引擎中的工作不持有 GIL
+db.put_batch([(b"k1", b"v1"), (b"k2", b"v2"), (b"k3", b"v3")])
+
+db.get_batch([b"k1", b"missing"])
+# [b'v1', None]
+
+db.scan(b"k1", b"k3")
+# [(b'k1', b'v1'), (b'k2', b'v2')]
+
+cols = db.scan_columns(start=b"k", limit=3)
+offsets = memoryview(cols["key_offsets"]).cast("q")
+[cols["key_data"][offsets[i]:offsets[i + 1]] for i in range(cols["count"])]
+# [b'k1', b'k2', b'k3']
+
+# 可以直接构建 pyarrow 的数组, 不需要复制:
+# import pyarrow as pa
+# keys = pa.Array.from_buffers(pa.large_binary(), cols["count"],
+#     [None, pa.py_buffer(cols["key_offsets"]), pa.py_buffer(cols["key_data"])])
@@ -1,4 +1,4 @@
-from typing import Iterator, List, Optional, Tuple, Any, Callable
+from typing import Iterator, List, Optional, Tuple, Any, Callable, Dict
 from enum import Enum
 
 
@@ -67,6 +67,21 @@ class LSM:
     def remove_batch(self, keys: List[bytes]) -> None:
         ...
 
+    def get_batch(self, keys: List[bytes]) -> List[Optional[bytes]]:
+        ...
+
+    # [start, end) 中最多 limit 个键值对, limit 为 0 表示不限制数量
+    def scan(self, start: Optional[bytes] = None, end: Optional[bytes] = None,
+             limit: int = 0) -> List[Tuple[bytes, bytes]]:
+        ...
+
+    # 与 scan 范围相同, 返回 count, key_offsets, key_data,
+    # value_offsets, value_data, offsets 为本机字节序的 int64
+    def scan_columns(self, start: Optional[bytes] = None,
+                     end: Optional[bytes] = None,
+                     limit: int = 0) -> Dict[str, Any]:
+        ...
+
     # 迭代器
     def begin(self, tranc_id: int) -> Level_Iterator:
         ...
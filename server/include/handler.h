@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cctype>
 #include <string>
+#include <string_view>
 #include <vector>
 
 enum class OPS {
@@ -17,13 +18,18 @@ enum class OPS {
   DEL,
   INCR,
   DECR,
+  APPEND,
   EXPIRE,
   TTL,
+  MGET,
+  MSET,
   // 哈希操作
   HSET,
   HGET,
   HDEL,
   HKEYS,
+  HMGET,
+  HMSET,
   // 链表操作
   LPUSH,
   RPUSH,
@@ -45,14 +51,42 @@ enum class OPS {
   SISMEMBER,
   SCARD,
   SMEMBERS,
+  // 游标遍历
+  SCAN,
+  HSCAN,
+  SSCAN,
+  ZSCAN,
+  // 服务器信息
+  INFO,
+  // 复制
+  REPLFETCH,
+  REPLICAOF,
   // 其他
   UNKNOWN,
 };
 
 OPS string2Ops(const std::string &opStr);
 
+// 会修改数据的命令, 从节点不接受这些命令
+bool is_write_command(OPS op);
+
+// 命令的处理函数, 返回 RESP 格式的回复
+using CommandHandler = std::string (*)(std::vector<std::string> &args,
+                                       RedisWrapper &engine);
+
+struct RedisCommand {
+  std::string_view name; // 小写的命令名
+  OPS op;
+  CommandHandler handler;
+};
+
+// 按命令名查找 (不区分大小写), 不存在时返回 nullptr
+// 命令表在编译期构建为完美哈希, 查找只需要一次哈希和一次比较, 不分配内存
+const RedisCommand *lookup_command(std::string_view name);
+
 std::string flushall_handler(RedisWrapper &engine);
 std::string save_handler(RedisWrapper &engine);
+std::string info_handler(std::vector<std::string> &args, RedisWrapper &engine);
 
 // 基础操作
 std::string set_handler(std::vector<std::string> &args, RedisWrapper &engine);
@@ -60,15 +94,21 @@ std::string get_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string del_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string incr_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string decr_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string append_handler(std::vector<std::string> &args,
+                           RedisWrapper &engine);
 std::string expire_handler(std::vector<std::string> &args,
                            RedisWrapper &engine);
 std::string ttl_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string mget_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string mset_handler(std::vector<std::string> &args, RedisWrapper &engine);
 
 // 哈希操作
 std::string hset_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string hget_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string hdel_handler(std::vector<std::string> &args, RedisWrapper &engine);
 std::string hkeys_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string hmget_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string hmset_handler(std::vector<std::string> &args, RedisWrapper &engine);
 
 // 链表操作
 std::string lpush_handler(std::vector<std::string> &args, RedisWrapper &engine);
@@ -104,3 +144,14 @@ std::string scard_handler(std::vector<std::string> &args, RedisWrapper &engine);
 
 std::string smembers_handler(std::vector<std::string> &args,
                              RedisWrapper &engine);
+
+std::string scan_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string hscan_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string sscan_handler(std::vector<std::string> &args, RedisWrapper &engine);
+std::string zscan_handler(std::vector<std::string> &args, RedisWrapper &engine);
+
+// 复制
+std::string replfetch_handler(std::vector<std::string> &args,
+                              RedisWrapper &engine);
+std::string replicaof_handler(std::vector<std::string> &args,
+                              RedisWrapper &engine);
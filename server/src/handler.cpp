@@ -1,84 +1,41 @@
 #include "../include/handler.h"
+#include "../../include/redis_wrapper/resp.h"
+#include <array>
+#include <cstdint>
+#include <iterator>
 #include <muduo/base/Logging.h>
 
-// 将字符串转换为小写
-std::string toLower(const std::string &str) {
-  std::string lowerStr = str;
-  std::transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-  return lowerStr;
-}
-
 // 将操作类型字符串转换为枚举类型 OPS
 OPS string2Ops(const std::string &opStr) {
-  std::string lowerOpStr = toLower(opStr);
-
-  if (lowerOpStr == "ping") {
-    return OPS::PING;
-  } else if (lowerOpStr == "flushall") {
-    return OPS::FLUSHALL;
-  } else if (lowerOpStr == "save") {
-    return OPS::SAVE;
-  } else if (lowerOpStr == "get") {
-    return OPS::GET;
-  } else if (lowerOpStr == "set") {
-    return OPS::SET;
-  } else if (lowerOpStr == "del") {
-    return OPS::DEL;
-  } else if (lowerOpStr == "incr") {
-    return OPS::INCR;
-  } else if (lowerOpStr == "decr") {
-    return OPS::DECR;
-  } else if (lowerOpStr == "expire") {
-    return OPS::EXPIRE;
-  } else if (lowerOpStr == "ttl") {
-    return OPS::TTL;
-  } else if (lowerOpStr == "hset") {
-    return OPS::HSET;
-  } else if (lowerOpStr == "hget") {
-    return OPS::HGET;
-  } else if (lowerOpStr == "hdel") {
-    return OPS::HDEL;
-  } else if (lowerOpStr == "hkeys") {
-    return OPS::HKEYS;
-  } else if (lowerOpStr == "rpush") {
-    return OPS::RPUSH;
-  } else if (lowerOpStr == "lpush") {
-    return OPS::LPUSH;
-  } else if (lowerOpStr == "rpop") {
-    return OPS::RPOP;
-  } else if (lowerOpStr == "lpop") {
-    return OPS::LPOP;
-  } else if (lowerOpStr == "llen") {
-    return OPS::LLEN;
-  } else if (lowerOpStr == "lrange") {
-    return OPS::LRANGE;
-  } else if (lowerOpStr == "zadd") {
-    return OPS::ZADD;
-  } else if (lowerOpStr == "zcard") {
-    return OPS::ZCARD;
-  } else if (lowerOpStr == "zincrby") {
-    return OPS::ZINCRBY;
-  } else if (lowerOpStr == "zrange") {
-    return OPS::ZRANGE;
-  } else if (lowerOpStr == "zrank") {
-    return OPS::ZRANK;
-  } else if (lowerOpStr == "zrem") {
-    return OPS::ZREM;
-  } else if (lowerOpStr == "zscore") {
-    return OPS::ZSCORE;
-  } else if (lowerOpStr == "sadd") {
-    return OPS::SADD;
-  } else if (lowerOpStr == "scard") {
-    return OPS::SCARD;
-  } else if (lowerOpStr == "smembers") {
-    return OPS::SMEMBERS;
-  } else if (lowerOpStr == "srem") {
-    return OPS::SREM;
-  } else if (lowerOpStr == "sismember") {
-    return OPS::SISMEMBER;
-  } else {
-    return OPS::UNKNOWN;
+  auto command = lookup_command(opStr);
+  return command == nullptr ? OPS::UNKNOWN : command->op;
+}
+
+bool is_write_command(OPS op) {
+  switch (op) {
+  case OPS::FLUSHALL:
+  case OPS::SET:
+  case OPS::DEL:
+  case OPS::INCR:
+  case OPS::DECR:
+  case OPS::APPEND:
+  case OPS::EXPIRE:
+  case OPS::MSET:
+  case OPS::HSET:
+  case OPS::HDEL:
+  case OPS::HMSET:
+  case OPS::LPUSH:
+  case OPS::RPUSH:
+  case OPS::LPOP:
+  case OPS::RPOP:
+  case OPS::ZADD:
+  case OPS::ZREM:
+  case OPS::ZINCRBY:
+  case OPS::SADD:
+  case OPS::SREM:
+    return true;
+  default:
+    return false;
   }
 }
 
@@ -93,6 +50,13 @@ std::string save_handler(RedisWrapper &engine) {
   return "+OK\r\n";
 }
 
+std::string info_handler(std::vector<std::string> &args, RedisWrapper &engine) {
+  if (args.size() > 2) {
+    return "-ERR wrong number of arguments for 'info' command\r\n";
+  }
+  return engine.info(args);
+}
+
 // **************************** 基础操作 ****************************
 std::string set_handler(std::vector<std::string> &args, RedisWrapper &engine) {
   if (args.size() != 3) {
@@ -135,8 +99,12 @@ std::string incr_handler(std::vector<std::string> &args, RedisWrapper &engine) {
 #endif
 
   auto res = engine.incr(args);
+  // 负数的结果同样以 '-' 开头, 只有 -ERR 是错误信息
+  if (res.starts_with("-ERR")) {
+    return res;
+  }
 
-  return ":" + res + "\r\n";
+  return resp_integer(res);
 }
 
 std::string decr_handler(std::vector<std::string> &args, RedisWrapper &engine) {
@@ -147,8 +115,24 @@ std::string decr_handler(std::vector<std::string> &args, RedisWrapper &engine) {
 #endif
 
   auto res = engine.decr(args);
+  // 负数的结果同样以 '-' 开头, 只有 -ERR 是错误信息
+  if (res.starts_with("-ERR")) {
+    return res;
+  }
 
-  return ":" + res + "\r\n";
+  return resp_integer(res);
+}
+
+std::string append_handler(std::vector<std::string> &args,
+                           RedisWrapper &engine) {
+  if (args.size() != 3)
+    return "-ERR wrong number of arguments for 'APPEND' command\r\n";
+#ifdef LSM_DEBUG
+  LOG_INFO << "command is: " << args[0] << " " << args[1] << " " << args[2]
+           << '\n';
+#endif
+
+  return engine.append(args);
 }
 
 std::string expire_handler(std::vector<std::string> &args,
@@ -172,6 +156,18 @@ std::string ttl_handler(std::vector<std::string> &args, RedisWrapper &engine) {
 
   return engine.ttl(args);
 }
+
+std::string mget_handler(std::vector<std::string> &args, RedisWrapper &engine) {
+  if (args.size() < 2)
+    return "-ERR wrong number of arguments for 'mget' command\r\n";
+  return engine.mget(args);
+}
+
+std::string mset_handler(std::vector<std::string> &args, RedisWrapper &engine) {
+  if (args.size() < 3 || args.size() % 2 != 1)
+    return "-ERR wrong number of arguments for 'mset' command\r\n";
+  return engine.mset(args);
+}
 // **************************** 哈希操作 ****************************
 std::string hset_handler(std::vector<std::string> &args, RedisWrapper &engine) {
   if (args.size() < 4)
@@ -217,6 +213,20 @@ std::string hkeys_handler(std::vector<std::string> &args,
   return engine.hkeys(args);
 }
 
+std::string hmget_handler(std::vector<std::string> &args,
+                          RedisWrapper &engine) {
+  if (args.size() < 3)
+    return "-ERR wrong number of arguments for 'hmget' command\r\n";
+  return engine.hmget(args);
+}
+
+std::string hmset_handler(std::vector<std::string> &args,
+                          RedisWrapper &engine) {
+  if (args.size() < 4 || args.size() % 2 != 0)
+    return "-ERR wrong number of arguments for 'hmset' command\r\n";
+  return engine.hmset(args);
+}
+
 // ***************************** 链表操作 ****************************
 std::string lpush_handler(std::vector<std::string> &args,
                           RedisWrapper &engine) {
@@ -366,4 +376,173 @@ std::string smembers_handler(std::vector<std::string> &args,
     return "-ERR wrong number of arguments for 'smembers' command\r\n";
   }
   return engine.smembers(args);
-}
\ No newline at end of file
+}
+
+// 游标遍历, COUNT 等选项在 RedisWrapper 中解析
+std::string scan_handler(std::vector<std::string> &args, RedisWrapper &engine) {
+  if (args.size() < 2) {
+    return "-ERR wrong number of arguments for 'scan' command\r\n";
+  }
+  return engine.scan(args);
+}
+
+std::string hscan_handler(std::vector<std::string> &args,
+                          RedisWrapper &engine) {
+  if (args.size() < 3) {
+    return "-ERR wrong number of arguments for 'hscan' command\r\n";
+  }
+  return engine.hscan(args);
+}
+
+std::string sscan_handler(std::vector<std::string> &args,
+                          RedisWrapper &engine) {
+  if (args.size() < 3) {
+    return "-ERR wrong number of arguments for 'sscan' command\r\n";
+  }
+  return engine.sscan(args);
+}
+
+std::string zscan_handler(std::vector<std::string> &args,
+                          RedisWrapper &engine) {
+  if (args.size() < 3) {
+    return "-ERR wrong number of arguments for 'zscan' command\r\n";
+  }
+  return engine.zscan(args);
+}
+
+// ******************************* 复制 ********************************
+std::string replfetch_handler(std::vector<std::string> &args,
+                              RedisWrapper &engine) {
+  return engine.replfetch(args);
+}
+
+std::string replicaof_handler(std::vector<std::string> &args,
+                              RedisWrapper &engine) {
+  return engine.replicaof(args);
+}
+
+// ******************************* 命令表 ******************************
+namespace {
+
+constexpr char ascii_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a, 计算前先转换为小写
+// 槽位只取哈希的低位, 而 FNV-1a 的低位只受种子低位的影响, 最后再混合一次,
+// 否则只有 kCommandSlots 个种子是有效的
+constexpr uint32_t command_hash(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(ascii_lower(c));
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+constexpr RedisCommand kCommands[] = {
+    {"ping", OPS::PING,
+     [](std::vector<std::string> &, RedisWrapper &) -> std::string {
+       return "+PONG\r\n";
+     }},
+    {"flushall", OPS::FLUSHALL,
+     [](std::vector<std::string> &, RedisWrapper &engine) {
+       return flushall_handler(engine);
+     }},
+    {"save", OPS::SAVE,
+     [](std::vector<std::string> &, RedisWrapper &engine) {
+       return save_handler(engine);
+     }},
+    {"get", OPS::GET, get_handler},
+    {"set", OPS::SET, set_handler},
+    {"del", OPS::DEL, del_handler},
+    {"incr", OPS::INCR, incr_handler},
+    {"decr", OPS::DECR, decr_handler},
+    {"append", OPS::APPEND, append_handler},
+    {"expire", OPS::EXPIRE, expire_handler},
+    {"ttl", OPS::TTL, ttl_handler},
+    {"mget", OPS::MGET, mget_handler},
+    {"mset", OPS::MSET, mset_handler},
+    {"hset", OPS::HSET, hset_handler},
+    {"hget", OPS::HGET, hget_handler},
+    {"hdel", OPS::HDEL, hdel_handler},
+    {"hkeys", OPS::HKEYS, hkeys_handler},
+    {"hmget", OPS::HMGET, hmget_handler},
+    {"hmset", OPS::HMSET, hmset_handler},
+    {"lpush", OPS::LPUSH, lpush_handler},
+    {"rpush", OPS::RPUSH, rpush_handler},
+    {"lpop", OPS::LPOP, lpop_handler},
+    {"rpop", OPS::RPOP, rpop_handler},
+    {"llen", OPS::LLEN, llen_handler},
+    {"lrange", OPS::LRANGE, lrange_handler},
+    {"zadd", OPS::ZADD, zadd_handler},
+    {"zrem", OPS::ZREM, zrem_handler},
+    {"zrange", OPS::ZRANGE, zrange_handler},
+    {"zcard", OPS::ZCARD, zcard_handler},
+    {"zscore", OPS::ZSCORE, zscore_handler},
+    {"zincrby", OPS::ZINCRBY, zincrby_handler},
+    {"zrank", OPS::ZRANK, zrank_handler},
+    {"sadd", OPS::SADD, sadd_handler},
+    {"srem", OPS::SREM, srem_handler},
+    {"sismember", OPS::SISMEMBER, sismember_handler},
+    {"scard", OPS::SCARD, scard_handler},
+    {"smembers", OPS::SMEMBERS, smembers_handler},
+    {"scan", OPS::SCAN, scan_handler},
+    {"hscan", OPS::HSCAN, hscan_handler},
+    {"sscan", OPS::SSCAN, sscan_handler},
+    {"zscan", OPS::ZSCAN, zscan_handler},
+    {"info", OPS::INFO, info_handler},
+    {"replfetch", OPS::REPLFETCH, replfetch_handler},
+    {"replicaof", OPS::REPLICAOF, replicaof_handler},
+};
+
+constexpr size_t kCommandSlots = 256;
+
+struct CommandTable {
+  uint32_t seed = 0;
+  std::array<int16_t, kCommandSlots> slots{};
+};
+
+// 从 0 开始尝试哈希种子, 直到所有命令落入不同的槽位
+constexpr CommandTable build_command_table() {
+  for (uint32_t seed = 0;; seed++) {
+    CommandTable table;
+    table.seed = seed;
+    table.slots.fill(-1);
+    bool collision = false;
+    for (size_t i = 0; i < std::size(kCommands) && !collision; i++) {
+      auto slot = command_hash(kCommands[i].name, seed) % kCommandSlots;
+      collision = table.slots[slot] >= 0;
+      table.slots[slot] = static_cast<int16_t>(i);
+    }
+    if (!collision) {
+      return table;
+    }
+  }
+}
+
+constexpr CommandTable kCommandTable = build_command_table();
+
+} // namespace
+
+const RedisCommand *lookup_command(std::string_view name) {
+  auto idx = kCommandTable.slots[command_hash(name, kCommandTable.seed) %
+                                 kCommandSlots];
+  if (idx < 0) {
+    return nullptr;
+  }
+  // 不在表中的命令也可能落入某个槽位, 需要比较命令名
+  auto &command = kCommands[idx];
+  if (command.name.size() != name.size()) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < name.size(); i++) {
+    if (ascii_lower(name[i]) != command.name[i]) {
+      return nullptr;
+    }
+  }
+  return &command;
+}
@@ -1,6 +1,12 @@
+#include "../../include/consts.h"
 #include "../../include/redis_wrapper/redis_wrapper.h"
+#include "../../include/redis_wrapper/resp.h"
+#include "../../include/redis_wrapper/sharded_redis.h"
 #include "../include/handler.h"
 #include <cstddef>
+#include <cstdlib>
+#include <future>
+#include <memory>
 #include <iostream>
 #include <muduo/base/Logging.h>
 #include <muduo/net/EventLoop.h>
@@ -8,6 +14,7 @@
 #include <muduo/net/TcpConnection.h>
 #include <muduo/net/TcpServer.h>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -16,8 +23,21 @@ using namespace muduo::net;
 
 class RedisServer {
 public:
-  RedisServer(EventLoop *loop, const InetAddress &listenAddr)
-      : server_(loop, listenAddr, "RedisServer"), redis("example_db") {
+  // io_threads 为 0 时所有连接都在 loop 中处理
+  // RedisWrapper 按 key 加锁, 不同连接上的命令可以在多个 I/O 线程中并行执行
+  // shards 不为 0 时使用 ShardedRedis, I/O 线程只负责解析和转发命令,
+  // 命令在 key 所在分片的线程中执行
+  RedisServer(EventLoop *loop, const InetAddress &listenAddr,
+              int io_threads = REDIS_SERVER_IO_THREADS,
+              const std::string &db_path = "example_db",
+              size_t shards = REDIS_SERVER_SHARDS)
+      : server_(loop, listenAddr, "RedisServer") {
+    if (shards == 0) {
+      redis = std::make_unique<RedisWrapper>(db_path, true);
+    } else {
+      sharded = std::make_unique<ShardedRedis>(db_path, shards, true);
+    }
+    server_.setThreadNum(io_threads);
     server_.setConnectionCallback(
         std::bind(&RedisServer::onConnection, this, std::placeholders::_1));
     server_.setMessageCallback(
@@ -39,78 +59,83 @@ public:
   }
 
   void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time) {
-    std::string msg(buf->retrieveAllAsString());
 #ifdef LSM_DEBUG
-    LOG_INFO << "Received message at " << time.toString() << ":\n" << msg;
+    LOG_INFO << "Received " << buf->readableBytes() << " bytes at "
+             << time.toString();
 #endif
-
-    // 解析并处理请求
-    std::string response = handleRequest(msg);
-    conn->send(response);
-  }
-
-  std::string handleRequest(const std::string &request) {
-    size_t pos = 0;
-
-    if (request.empty()) {
-      return "-ERR Protocol error: expected '*'\r\n";
-    }
-
-    if (request == "PING\r\n") {
-      return "+PONG\r\n";
-    }
-
-    int numElements = 0;
-    try {
-      numElements = std::stoi(request.substr(pos + 1)); // 跳过 '*'
-    } catch (const std::exception &) {
-      return "-ERR Protocol error: invalid number of elements\r\n";
-    }
-    pos = request.find('\n', pos) + 1; // 跳过 '\r\n'
-
-#ifdef LSM_DEBUG
-    LOG_INFO << "request: " << request << '\n';
-    LOG_INFO << "Number of elements: " << numElements << '\n';
-#endif
-    std::vector<std::string> args;
-
-    for (int i = 0; i < numElements; ++i) {
-      if (pos >= request.size() || request[pos] != '$') {
-#ifdef LSM_DEBUG
-        LOG_INFO << "pos = " << pos << ", i = " << i
-                 << ", last args = " << args.back() << '\n';
-        LOG_INFO << "-ERR Protocol error: expected '$'\r\n";
-#endif
-
-        return "-ERR Protocol error: expected '$'\r\n";
+    // 每个 I/O 线程复用自己的参数和回复缓冲区
+    static thread_local std::vector<std::string> args;
+    static thread_local std::string responses;
+    // 分片时每个命令的回复, 按命令的顺序排列
+    static thread_local std::vector<std::future<std::string>> pending_replies;
+    // 流水线中连续的 SET 合并为一次写入, 回复的顺序保持不变
+    static thread_local std::vector<std::pair<std::string, std::string>>
+        pending_sets;
+    responses.clear();
+    auto flush_sets = [this]() {
+      if (pending_sets.empty()) {
+        return;
       }
-
-      int len = 0;
-      std::string value_len;
-      int next_n_pos;
-      try {
-        next_n_pos = request.find('\n', pos);
-        len = std::stoi(request.substr(pos + 1)); // 跳过 '$'
-      } catch (const std::exception &) {
-#ifdef LSM_DEBUG
-        LOG_INFO << "-ERR Protocol error: invalid bulk string length\r\n";
-#endif
-        return "-ERR Protocol error: invalid bulk string length\r\n";
+      if (sharded) {
+        pending_replies.push_back(ready(sharded->set_batch(pending_sets)));
+      } else {
+        responses += redis->set_batch(pending_sets);
       }
-      pos = next_n_pos + 1; // 跳过 '$' 值 \r\n
-      if (pos + len > request.size()) {
-#ifdef LSM_DEBUG
-        LOG_INFO << "-ERR Protocol error: bulk string length exceeds request "
-                    "size\r\n";
-#endif
-
-        return "-ERR Protocol error: bulk string length exceeds request "
-               "size\r\n";
+      pending_sets.clear();
+    };
+    // 等待分片执行完已经转发的命令, 回复追加到 responses 中
+    auto flush_replies = [&flush_sets]() {
+      flush_sets();
+      for (auto &reply : pending_replies) {
+        responses += reply.get();
+      }
+      pending_replies.clear();
+    };
+
+    // 处理这次读取中全部完整的命令, 不完整的部分留在 buf 中
+    while (buf->readableBytes() > 0) {
+      auto result = parse_resp_command(
+          std::string_view(buf->peek(), buf->readableBytes()), args);
+      if (result.status == RespStatus::Incomplete) {
+        break;
+      }
+      if (result.status == RespStatus::Error) {
+        // 之后的数据无法再定位到命令的边界, 回复错误后关闭连接
+        flush_replies();
+        responses += result.error;
+        buf->retrieveAll();
+        conn->send(responses);
+        conn->shutdown();
+        return;
+      }
+      buf->retrieve(result.consumed);
+      if (args.empty()) {
+        continue;
+      }
+      auto command = lookup_command(args[0]);
+      if (command != nullptr && command->op == OPS::SET && args.size() == 3 &&
+          (sharded || !redis->is_replica())) {
+        pending_sets.emplace_back(std::move(args[1]), std::move(args[2]));
+        continue;
+      }
+      flush_sets();
+      if (sharded) {
+        pending_replies.push_back(dispatchSharded(command, args));
+      } else {
+        responses += handleRequest(command, args);
       }
-      args.push_back(request.substr(pos, len));
-      next_n_pos = request.find('\n', pos);
-      pos = next_n_pos + 1; // 跳过数据和/r/n
     }
+    flush_replies();
+
+    // 流水线中的全部回复合并为一次发送
+    if (!responses.empty()) {
+      conn->send(responses);
+    }
+  }
+
+  // command 为 lookup_command(args[0]) 的结果
+  std::string handleRequest(const RedisCommand *command,
+                            std::vector<std::string> &args) {
 #ifdef LSM_DEBUG
     LOG_INFO << "Request: ";
     for (const auto &arg : args) {
@@ -120,88 +145,90 @@ public:
 #endif
 
     // 处理命令
-    switch (string2Ops(args[0])) {
+    if (command == nullptr) {
+      return "-ERR unknown command '" + args[0] + "'\r\n";
+    }
+    if (is_write_command(command->op) && redis->is_replica()) {
+      return "-READONLY You can't write against a read only replica.\r\n";
+    }
+    return command->handler(args, *redis);
+  }
+
+  // 分片时转发命令: 只涉及一个 key 的命令交给 key 所在的分片执行, 不等待
+  // 结果; 涉及多个分片的命令在当前线程中拆分并等待全部分片
+  std::future<std::string> dispatchSharded(const RedisCommand *command,
+                                           std::vector<std::string> &args) {
+    if (command == nullptr) {
+      return ready("-ERR unknown command '" + args[0] + "'\r\n");
+    }
+    switch (command->op) {
     case OPS::PING:
-      return "+PONG\r\n";
+      return ready("+PONG\r\n");
     case OPS::FLUSHALL:
-      return flushall_handler(redis);
+      sharded->clear();
+      return ready("+OK\r\n");
     case OPS::SAVE:
-      return save_handler(redis);
-    case OPS::SET:
-      return set_handler(args, redis);
-    case OPS::GET:
-      return get_handler(args, redis);
+      sharded->flushall();
+      return ready("+OK\r\n");
+    case OPS::INFO:
+      if (args.size() > 2) {
+        return ready("-ERR wrong number of arguments for 'info' command\r\n");
+      }
+      return ready(sharded->info(args));
+    case OPS::MGET:
+      if (args.size() < 2) {
+        return ready("-ERR wrong number of arguments for 'mget' command\r\n");
+      }
+      return ready(sharded->mget(args));
+    case OPS::MSET:
+      return ready(sharded->mset(args));
     case OPS::DEL:
-      return del_handler(args, redis);
-    case OPS::INCR:
-      return incr_handler(args, redis);
-    case OPS::DECR:
-      return decr_handler(args, redis);
-    case OPS::EXPIRE:
-      return expire_handler(args, redis);
-    case OPS::TTL:
-      return ttl_handler(args, redis);
-    case OPS::HSET:
-      return hset_handler(args, redis);
-    case OPS::HGET:
-      return hget_handler(args, redis);
-    case OPS::HDEL:
-      return hdel_handler(args, redis);
-    case OPS::HKEYS:
-      return hkeys_handler(args, redis);
-    case OPS::LLEN:
-      return llen_handler(args, redis);
-    case OPS::LPUSH:
-      return lpush_handler(args, redis);
-    case OPS::RPUSH:
-      return rpush_handler(args, redis);
-    case OPS::LPOP:
-      return lpop_handler(args, redis);
-    case OPS::RPOP:
-      return rpop_handler(args, redis);
-    case OPS::LRANGE:
-      return lrange_handler(args, redis);
-    case OPS::ZADD:
-      return zadd_handler(args, redis);
-    case OPS::ZCARD:
-      return zcard_handler(args, redis);
-    case OPS::ZINCRBY:
-      return zincrby_handler(args, redis);
-    case OPS::ZRANGE:
-      return zrange_handler(args, redis);
-    case OPS::ZRANK:
-      return zrank_handler(args, redis);
-    case OPS::ZSCORE:
-      return zscore_handler(args, redis);
-    case OPS::ZREM:
-      return zrem_handler(args, redis);
-    case OPS::SADD:
-      return sadd_handler(args, redis);
-    case OPS::SMEMBERS:
-      return smembers_handler(args, redis);
-    case OPS::SCARD:
-      return scard_handler(args, redis);
-    case OPS::SISMEMBER:
-      return sismember_handler(args, redis);
-    case OPS::SREM:
-      return srem_handler(args, redis);
+      if (args.size() < 2) {
+        return ready("-ERR wrong number of arguments for 'del' command\r\n");
+      }
+      return ready(sharded->del(args));
+    case OPS::SCAN:
+      return ready(sharded->scan(args));
+    case OPS::REPLFETCH:
+    case OPS::REPLICAOF:
+      return ready("-ERR replication is not supported in sharded mode\r\n");
     default:
-      return "-ERR unknown command '" + args[0] + "'\r\n";
+      break;
     }
+    // 参数个数不对的命令同样交给分片, 由处理函数回复错误
+    size_t shard = args.size() > 1 ? sharded->shard_of(args[1]) : 0;
+    return sharded->submit(
+        shard, [handler = command->handler,
+                args = std::move(args)](RedisWrapper &engine) mutable {
+          return handler(args, engine);
+        });
+  }
+
+  static std::future<std::string> ready(std::string reply) {
+    std::promise<std::string> promise;
+    promise.set_value(std::move(reply));
+    return promise.get_future();
   }
 
   TcpServer server_;
-  RedisWrapper redis; // 简单的键值存储
+  // 简单的键值存储, 全部写入先写入 WAL, 可以作为复制的主节点
+  // 两者只有一个不为空
+  std::unique_ptr<RedisWrapper> redis;
+  std::unique_ptr<ShardedRedis> sharded;
 };
 
-int main() {
+// 用法: server [port] [io_threads] [db_path] [shards]
+// 只读副本的 db_path 为 leader 的 checkpoint 目录, 分片时不支持复制
+int main(int argc, char *argv[]) {
+  uint16_t port = argc > 1 ? std::atoi(argv[1]) : 6379; // Redis默认端口
+  int io_threads = argc > 2 ? std::atoi(argv[2]) : REDIS_SERVER_IO_THREADS;
+  std::string db_path = argc > 3 ? argv[3] : "example_db";
+  size_t shards = argc > 4 ? std::atoi(argv[4]) : REDIS_SERVER_SHARDS;
+
   EventLoop loop;
-  InetAddress listenAddr(6379); // Redis默认端口
-  RedisServer server(&loop, listenAddr);
+  InetAddress listenAddr(port);
+  RedisServer server(&loop, listenAddr, io_threads, db_path, shards);
 
   server.start();
   loop.loop(); // 进入事件循环
-  // DEBUG
-  // server.handleRequest(
-  //     "*3\r\n$3\r\nSET\r\n$6\r\npasswd\r\n$12\r\ntmdgnnwscjl\r\n");
 }
\ No newline at end of file
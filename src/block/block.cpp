@@ -1,5 +1,10 @@
 #include "../../include/block/block.h"
 #include "../../include/block/block_iterator.h"
+#include "../../include/consts.h"
+#include "../../include/utils/coding.h"
+#include "../../include/utils/hash.h"
+#include "../../include/utils/key_prefix.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -8,65 +13,135 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+
+namespace {
+// num_elements 的最高位, 表示 block 为版本 2 的前缀压缩格式
+constexpr uint16_t kPrefixCompressedFlag = 0x8000;
+// 版本 3 的 block 末尾的标记
+constexpr uint16_t kVarintBlockMarker = 0xFFFF;
+// 带有哈希索引的版本 3 的 block 末尾的标记
+constexpr uint16_t kVarintHashBlockMarker = 0xFFFE;
+// 哈希索引的 bucket 中的特殊值, restart 点的下标必须小于 kHashBucketCollision
+constexpr uint8_t kHashBucketEmpty = 0xFF;
+constexpr uint8_t kHashBucketCollision = 0xFE;
+// 版本 3 的 Extra 段: base_tranc_id + num_restarts + num_elements + 标记
+constexpr size_t kVarintBlockExtraSize = sizeof(uint64_t) +
+                                         2 * sizeof(uint32_t) +
+                                         sizeof(uint16_t);
+
+template <typename T> void put_fixed(std::vector<uint8_t> &dst, T value) {
+  size_t pos = dst.size();
+  dst.resize(pos + sizeof(T));
+  memcpy(dst.data() + pos, &value, sizeof(T));
+}
+
+// 哈希索引使用的 key 的哈希值
+uint32_t block_key_hash(std::string_view key) {
+  return static_cast<uint32_t>(hash64(key));
+}
+} // namespace
 
 Block::Block(size_t capacity) : capacity(capacity) {}
 
 std::vector<uint8_t> Block::encode() {
-  // 计算总大小：数据段 + 偏移数组(每个偏移2字节) + 元素个数(2字节)
-  size_t total_bytes = data.size() * sizeof(uint8_t) +
-                       offsets.size() * sizeof(uint16_t) + sizeof(uint16_t);
-  std::vector<uint8_t> encoded(total_bytes, 0);
+  std::vector<uint8_t> encoded;
+  encoded.reserve(cur_size());
 
   // 1. 复制数据段
-  memcpy(encoded.data(), data.data(), data.size() * sizeof(uint8_t));
-
-  // 2. 复制偏移数组
-  size_t offset_pos = data.size() * sizeof(uint8_t);
-  memcpy(encoded.data() + offset_pos,
-         offsets.data(),                   // vector 的连续内存起始位置
-         offsets.size() * sizeof(uint16_t) // 总字节数
-  );
-
-  // 3. 写入元素个数
-  size_t num_pos =
-      data.size() * sizeof(uint8_t) + offsets.size() * sizeof(uint16_t);
+  encoded.insert(encoded.end(), data_ptr(), data_ptr() + data_size());
+
+  // 2. 版本 3 的偏移为 4 字节, 并在 Extra 段记录事务 id 的基准
+  if (format == Format::Varint) {
+    for (auto restart : restarts) {
+      put_fixed<uint32_t>(encoded, restart);
+    }
+    // 解码得到的 block 直接保留原来的哈希索引
+    auto buckets = hash_buckets.empty() ? build_hash_buckets_() : hash_buckets;
+    if (!buckets.empty()) {
+      encoded.insert(encoded.end(), buckets.begin(), buckets.end());
+      put_fixed<uint16_t>(encoded, buckets.size());
+    }
+    put_fixed<uint64_t>(encoded, base_tranc_id);
+    put_fixed<uint32_t>(encoded, restarts.size());
+    put_fixed<uint32_t>(encoded, offsets.size());
+    put_fixed<uint16_t>(encoded, buckets.empty() ? kVarintBlockMarker
+                                                 : kVarintHashBlockMarker);
+    return encoded;
+  }
+
+  // 3. 版本 1 保存每个 entry 的偏移, 版本 2 只保存 restart 点的偏移,
+  // 并额外记录 restart 点的个数
+  const auto &offset_section =
+      format == Format::PrefixCompressed ? restarts : offsets;
+  for (auto offset : offset_section) {
+    put_fixed<uint16_t>(encoded, offset);
+  }
   uint16_t num_elements = offsets.size();
-  memcpy(encoded.data() + num_pos, &num_elements, sizeof(uint16_t));
+  if (format == Format::PrefixCompressed) {
+    put_fixed<uint16_t>(encoded, restarts.size());
+    num_elements |= kPrefixCompressedFlag;
+  }
+  put_fixed<uint16_t>(encoded, num_elements);
 
   return encoded;
 }
 
 std::shared_ptr<Block> Block::decode(const std::vector<uint8_t> &encoded,
                                      bool with_hash) {
+  return decode_(encoded.data(), encoded.size(), with_hash, nullptr);
+}
+
+std::shared_ptr<Block> Block::decode_view(const uint8_t *encoded, size_t size,
+                                          std::shared_ptr<const void> owner,
+                                          bool with_hash) {
+  return decode_(encoded, size, with_hash, std::move(owner));
+}
+
+std::shared_ptr<Block> Block::decode_(const uint8_t *encoded, size_t size,
+                                      bool with_hash,
+                                      std::shared_ptr<const void> owner) {
   // 使用 make_shared 创建对象
   auto block = std::make_shared<Block>();
 
   // 1. 安全性检查
-  if (encoded.size() < sizeof(uint16_t)) {
+  if (size < sizeof(uint16_t) + (with_hash ? sizeof(uint32_t) : 0)) {
     throw std::runtime_error("Encoded data too small");
   }
 
   // 2. 读取元素个数
   uint16_t num_elements;
-  size_t num_elements_pos = encoded.size() - sizeof(uint16_t);
+  size_t num_elements_pos = size - sizeof(uint16_t);
   if (with_hash) {
     num_elements_pos -= sizeof(uint32_t);
-    auto hash_pos = encoded.size() - sizeof(uint32_t);
+    auto hash_pos = size - sizeof(uint32_t);
     uint32_t hash_value;
-    memcpy(&hash_value, encoded.data() + hash_pos, sizeof(uint32_t));
+    memcpy(&hash_value, encoded + hash_pos, sizeof(uint32_t));
 
-    uint32_t compute_hash = std::hash<std::string_view>{}(
-        std::string_view(reinterpret_cast<const char *>(encoded.data()),
-                         encoded.size() - sizeof(uint32_t)));
+    uint32_t compute_hash = std::hash<std::string_view>{}(std::string_view(
+        reinterpret_cast<const char *>(encoded), size - sizeof(uint32_t)));
     if (hash_value != compute_hash) {
       throw std::runtime_error("Block hash verification failed");
     }
   }
-  memcpy(&num_elements, encoded.data() + num_elements_pos, sizeof(uint16_t));
+  memcpy(&num_elements, encoded + num_elements_pos, sizeof(uint16_t));
+  if (num_elements == kVarintBlockMarker ||
+      num_elements == kVarintHashBlockMarker) {
+    return decode_varint_(block, encoded, num_elements_pos,
+                          num_elements == kVarintHashBlockMarker,
+                          std::move(owner));
+  }
+  if (num_elements & kPrefixCompressedFlag) {
+    return decode_prefix_compressed_(block, encoded, num_elements_pos,
+                                     num_elements & ~kPrefixCompressedFlag,
+                                     std::move(owner));
+  }
+  block->format = Format::Plain;
 
   // 3. 验证数据大小
   size_t required_size = sizeof(uint16_t) + num_elements * sizeof(uint16_t);
-  if (encoded.size() < required_size) {
+  if (num_elements_pos + sizeof(uint16_t) < required_size) {
     throw std::runtime_error("Invalid encoded data size");
   }
 
@@ -76,29 +151,241 @@ std::shared_ptr<Block> Block::decode(const std::vector<uint8_t> &encoded,
 
   // 5. 读取偏移数组
   block->offsets.resize(num_elements);
-  memcpy(block->offsets.data(), encoded.data() + offsets_section_start,
-         num_elements * sizeof(uint16_t));
+  for (size_t i = 0; i < num_elements; i++) {
+    uint16_t offset;
+    memcpy(&offset, encoded + offsets_section_start + i * sizeof(uint16_t),
+           sizeof(uint16_t));
+    block->offsets[i] = offset;
+  }
+
+  // 6. 数据段: 有 owner 时直接引用外部内存, 否则复制一份
+  block->set_data_(encoded, offsets_section_start, std::move(owner));
+  return block;
+}
 
-  // 6. 复制数据段
-  block->data.reserve(offsets_section_start); // 优化内存分配
-  block->data.assign(encoded.begin(), encoded.begin() + offsets_section_start);
+std::shared_ptr<Block> Block::decode_prefix_compressed_(
+    std::shared_ptr<Block> block, const uint8_t *encoded,
+    size_t num_elements_pos, uint16_t num_elements,
+    std::shared_ptr<const void> owner) {
+  block->format = Format::PrefixCompressed;
 
+  // 1. 读取 restart 点
+  if (num_elements_pos < sizeof(uint16_t)) {
+    throw std::runtime_error("Invalid encoded data size");
+  }
+  size_t num_restarts_pos = num_elements_pos - sizeof(uint16_t);
+  uint16_t num_restarts;
+  memcpy(&num_restarts, encoded + num_restarts_pos, sizeof(uint16_t));
+  if (num_restarts_pos < num_restarts * sizeof(uint16_t)) {
+    throw std::runtime_error("Invalid encoded data size");
+  }
+  size_t restarts_start = num_restarts_pos - num_restarts * sizeof(uint16_t);
+  block->restarts.resize(num_restarts);
+  for (size_t i = 0; i < num_restarts; i++) {
+    uint16_t restart;
+    memcpy(&restart, encoded + restarts_start + i * sizeof(uint16_t),
+           sizeof(uint16_t));
+    block->restarts[i] = restart;
+  }
+
+  // 2. 数据段
+  block->set_data_(encoded, restarts_start, std::move(owner));
+
+  // 3. 顺序扫描一遍, 重建每个 entry 的偏移
+  block->rebuild_offsets_(num_elements);
+  block->build_restart_prefixes_();
   return block;
 }
 
-std::string Block::get_first_key() {
-  if (data.empty() || offsets.empty()) {
-    return "";
+std::shared_ptr<Block>
+Block::decode_varint_(std::shared_ptr<Block> block, const uint8_t *encoded,
+                      size_t marker_pos, bool with_hash_index,
+                      std::shared_ptr<const void> owner) {
+  block->format = Format::Varint;
+
+  // 1. 读取 Extra 段
+  size_t extra_size = kVarintBlockExtraSize - sizeof(uint16_t);
+  if (marker_pos < extra_size) {
+    throw std::runtime_error("Invalid encoded data size");
+  }
+  size_t base_pos = marker_pos - extra_size;
+  uint32_t num_restarts, num_elements;
+  memcpy(&block->base_tranc_id, encoded + base_pos, sizeof(uint64_t));
+  memcpy(&num_restarts, encoded + base_pos + sizeof(uint64_t),
+         sizeof(uint32_t));
+  memcpy(&num_elements,
+         encoded + base_pos + sizeof(uint64_t) + sizeof(uint32_t),
+         sizeof(uint32_t));
+
+  // 2. 读取哈希索引, 位于 restart 点和 Extra 段之间
+  size_t restarts_end = base_pos;
+  if (with_hash_index) {
+    if (restarts_end < sizeof(uint16_t)) {
+      throw std::runtime_error("Invalid encoded data size");
+    }
+    uint16_t num_buckets;
+    memcpy(&num_buckets, encoded + restarts_end - sizeof(uint16_t),
+           sizeof(uint16_t));
+    restarts_end -= sizeof(uint16_t);
+    if (num_buckets == 0 || restarts_end < num_buckets) {
+      throw std::runtime_error("Invalid encoded data size");
+    }
+    restarts_end -= num_buckets;
+    block->hash_buckets.assign(encoded + restarts_end,
+                               encoded + restarts_end + num_buckets);
   }
 
-  // 读取第一个key的长度（前2字节）
-  uint16_t key_len;
-  memcpy(&key_len, data.data(), sizeof(uint16_t));
+  // 3. 读取 restart 点
+  if (restarts_end / sizeof(uint32_t) < num_restarts) {
+    throw std::runtime_error("Invalid encoded data size");
+  }
+  size_t restarts_start = restarts_end - num_restarts * sizeof(uint32_t);
+  block->restarts.resize(num_restarts);
+  memcpy(block->restarts.data(), encoded + restarts_start,
+         num_restarts * sizeof(uint32_t));
+
+  // 4. 数据段和每个 entry 的偏移
+  block->set_data_(encoded, restarts_start, std::move(owner));
+  block->rebuild_offsets_(num_elements);
+  block->build_restart_prefixes_();
+  return block;
+}
 
-  // 读取key
-  std::string key(reinterpret_cast<char *>(data.data() + sizeof(uint16_t)),
-                  key_len);
-  return key;
+std::vector<uint8_t> Block::build_hash_buckets_() const {
+  if (!LSM_BLOCK_HASH_INDEX || key_restarts.empty() ||
+      restarts.size() > kHashBucketCollision) {
+    return {};
+  }
+  size_t num_buckets =
+      hash_index_size_for_(key_restarts.size()) - sizeof(uint16_t);
+  if (num_buckets > UINT16_MAX) {
+    return {};
+  }
+  std::vector<uint8_t> buckets(num_buckets, kHashBucketEmpty);
+  for (auto [hash, restart_idx] : key_restarts) {
+    auto &bucket = buckets[hash % num_buckets];
+    if (bucket == kHashBucketEmpty) {
+      bucket = restart_idx;
+    } else if (bucket != restart_idx) {
+      bucket = kHashBucketCollision;
+    }
+  }
+  return buckets;
+}
+
+size_t Block::hash_index_size_() const {
+  if (!hash_buckets.empty()) {
+    return hash_buckets.size() + sizeof(uint16_t);
+  }
+  if (!LSM_BLOCK_HASH_INDEX || restarts.size() > kHashBucketCollision) {
+    return 0;
+  }
+  return hash_index_size_for_(key_restarts.size());
+}
+
+size_t Block::hash_index_size_for_(size_t num_keys) {
+  if (num_keys == 0) {
+    return 0;
+  }
+  return static_cast<size_t>(num_keys / LSM_BLOCK_HASH_UTIL_RATIO) + 1 +
+         sizeof(uint16_t);
+}
+
+void Block::rebuild_offsets_(size_t num_elements) {
+  offsets.reserve(num_elements);
+  size_t pos = 0;
+  while (pos < data_size() && offsets.size() < num_elements) {
+    offsets.push_back(pos);
+    pos = entry_layout_(pos).end;
+  }
+  if (pos != data_size() || offsets.size() != num_elements) {
+    throw std::runtime_error("Corrupted block entry");
+  }
+}
+
+void Block::build_restart_prefixes_() {
+  if (restarts.empty()) {
+    return;
+  }
+  // restart key 有序, 第一个和最后一个的公共前缀就是全部 restart key 的
+  auto first = restart_key_(0);
+  auto last = restart_key_(restarts.size() - 1);
+  size_t common = 0;
+  while (common < first.size() && common < last.size() &&
+         first[common] == last[common]) {
+    common++;
+  }
+  restart_common_len = common;
+  restart_prefixes.resize(restarts.size());
+  for (size_t i = 0; i < restarts.size(); i++) {
+    restart_prefixes[i] = key_prefix(restart_key_(i).substr(common));
+  }
+}
+
+std::string_view Block::restart_key_(size_t idx) const {
+  auto layout = entry_layout_(restarts[idx]);
+  return std::string_view(
+      reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+      layout.unshared);
+}
+
+size_t Block::restart_lower_bound_(const std::string &key, size_t left,
+                                   size_t right) const {
+  if (!restart_prefixes.empty() && left < right) {
+    // 目标不以公共前缀开头时, 与全部 restart key 的大小关系相同
+    std::string_view target(key);
+    int cmp = target.substr(0, restart_common_len)
+                  .compare(restart_key_(0).substr(0, restart_common_len));
+    if (cmp != 0) {
+      return cmp < 0 ? left : right;
+    }
+    // 前缀小于目标的 restart 点一定小于目标, 前缀相等的再比较完整的 key
+    uint64_t prefix = key_prefix(target.substr(restart_common_len));
+    left += key_prefix_lower_bound(restart_prefixes.data() + left,
+                                   right - left, prefix);
+    right = std::upper_bound(restart_prefixes.begin() + left,
+                             restart_prefixes.begin() + right, prefix) -
+            restart_prefixes.begin();
+  }
+  // restart 点处保存的是完整的 key, 不需要解码
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (restart_key_(mid) < key) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+size_t Block::restart_entry_idx_(size_t restart_idx) const {
+  size_t idx = restart_idx * LSM_BLOCK_RESTART_INTERVAL;
+  if (idx >= offsets.size() || offsets[idx] != restarts[restart_idx]) {
+    // restart 间隔与当前配置不同, 根据偏移定位
+    idx = std::lower_bound(offsets.begin(), offsets.end(),
+                           restarts[restart_idx]) -
+          offsets.begin();
+  }
+  return idx;
+}
+
+void Block::set_data_(const uint8_t *encoded, size_t size,
+                      std::shared_ptr<const void> owner) {
+  if (owner != nullptr) {
+    view_data = encoded;
+    view_size = size;
+    view_owner = std::move(owner);
+  } else {
+    data.assign(encoded, encoded + size);
+  }
+}
+
+std::string Block::get_first_key() {
+  if (data_size() == 0 || offsets.empty()) {
+    return "";
+  }
+  return get_key_at(offsets[0]);
 }
 
 size_t Block::get_offset_at(size_t idx) const {
@@ -109,95 +396,243 @@ size_t Block::get_offset_at(size_t idx) const {
 }
 
 bool Block::add_entry(const std::string &key, const std::string &value,
-                      uint64_t tranc_id, bool force_write) {
+                      uint64_t tranc_id, bool force_write, bool blob_index) {
+  if (view_data != nullptr || format != Format::Varint) {
+    throw std::runtime_error("Cannot add entry to a decoded block");
+  }
+  if (offsets.empty()) {
+    // 第一个 entry 的事务 id 作为之后 entry 的基准
+    base_tranc_id = tranc_id;
+  }
+  // 每隔 LSM_BLOCK_RESTART_INTERVAL 个 entry 保存一次完整的 key
+  bool is_restart = offsets.size() % LSM_BLOCK_RESTART_INTERVAL == 0;
+  size_t shared = 0;
+  if (!is_restart) {
+    size_t max_shared = std::min(key.size(), last_key.size());
+    while (shared < max_shared && key[shared] == last_key[shared]) {
+      shared++;
+    }
+  }
+  size_t unshared = key.size() - shared;
+  uint64_t value_tag = (static_cast<uint64_t>(value.size()) << 1) |
+                       (blob_index ? 1 : 0);
+  uint64_t tranc_delta =
+      zigzag_encode(static_cast<int64_t>(tranc_id - base_tranc_id));
+
+  // 计算entry大小：shared + unshared + value长度 + key_delta + value +
+  // tranc_delta, 其中长度和 tranc_delta 均为 varint
+  size_t entry_size = varint_length(shared) + varint_length(unshared) +
+                      varint_length(value_tag) + unshared + value.size() +
+                      varint_length(tranc_delta);
+  // 新的 key 还会使哈希索引增大
+  bool new_key = offsets.empty() || key != last_key;
+  size_t hash_growth =
+      new_key && LSM_BLOCK_HASH_INDEX
+          ? hash_index_size_for_(key_restarts.size() + 1) -
+                hash_index_size_for_(key_restarts.size())
+          : 0;
   if (!force_write &&
-      (cur_size() + key.size() + value.size() + 3 * sizeof(uint16_t) +
-           sizeof(uint64_t) >
+      (cur_size() + entry_size + (is_restart ? sizeof(uint32_t) : 0) +
+           hash_growth >
        capacity) &&
       !offsets.empty()) {
     return false;
   }
-  // 计算entry大小：key长度(2B) + key + value长度(2B) + value
-  size_t entry_size = sizeof(uint16_t) + key.size() + sizeof(uint16_t) +
-                      value.size() + sizeof(uint64_t);
   size_t old_size = data.size();
   data.resize(old_size + entry_size);
+  uint8_t *pos = data.data() + old_size;
 
-  // 写入key长度
-  uint16_t key_len = key.size();
-  memcpy(data.data() + old_size, &key_len, sizeof(uint16_t));
-
-  // 写入key
-  memcpy(data.data() + old_size + sizeof(uint16_t), key.data(), key_len);
-
-  // 写入value长度
-  uint16_t value_len = value.size();
-  memcpy(data.data() + old_size + sizeof(uint16_t) + key_len, &value_len,
-         sizeof(uint16_t));
+  // 写入 shared, unshared 和 value 的长度(最低位为 blob_index)
+  pos = encode_varint(pos, shared);
+  pos = encode_varint(pos, unshared);
+  pos = encode_varint(pos, value_tag);
 
-  // 写入value
-  memcpy(data.data() + old_size + sizeof(uint16_t) + key_len + sizeof(uint16_t),
-         value.data(), value_len);
+  // 写入 key 中不共享的部分和 value
+  memcpy(pos, key.data() + shared, unshared);
+  pos += unshared;
+  memcpy(pos, value.data(), value.size());
+  pos += value.size();
 
   // 写入事务id
-  memcpy(data.data() + old_size + sizeof(uint16_t) + key_len +
-             sizeof(uint16_t) + value_len,
-         &tranc_id, sizeof(uint64_t));
+  encode_varint(pos, tranc_delta);
 
   // 记录偏移
+  if (is_restart) {
+    restarts.push_back(old_size);
+  }
   offsets.push_back(old_size);
+  if (new_key) {
+    key_restarts.emplace_back(block_key_hash(key), restarts.size() - 1);
+  }
+  last_key = key;
   return true;
 }
 
+Block::EntryLayout Block::entry_layout_(size_t offset) const {
+  const uint8_t *base = data_ptr();
+  size_t size = data_size();
+  EntryLayout layout;
+
+  if (format == Format::Varint) {
+    const uint8_t *limit = base + size;
+    uint64_t shared = 0, unshared = 0, value_tag = 0;
+    const uint8_t *ptr =
+        offset < size ? decode_varint(base + offset, limit, &shared) : nullptr;
+    if (ptr != nullptr) {
+      ptr = decode_varint(ptr, limit, &unshared);
+    }
+    if (ptr != nullptr) {
+      ptr = decode_varint(ptr, limit, &value_tag);
+    }
+    uint64_t value_len = value_tag >> 1;
+    size_t remaining = ptr != nullptr ? limit - ptr : 0;
+    if (ptr == nullptr || unshared > remaining ||
+        value_len > remaining - unshared) {
+      throw std::runtime_error("Corrupted block entry");
+    }
+    layout.shared = shared;
+    layout.unshared = unshared;
+    layout.key_pos = ptr - base;
+    layout.value_len = value_len;
+    layout.blob_index = value_tag & 1;
+    layout.value_pos = layout.key_pos + unshared;
+    layout.tranc_id_pos = layout.value_pos + value_len;
+    uint64_t tranc_delta;
+    ptr = decode_varint(base + layout.tranc_id_pos, limit, &tranc_delta);
+    if (ptr == nullptr) {
+      throw std::runtime_error("Corrupted block entry");
+    }
+    layout.end = ptr - base;
+    return layout;
+  }
+
+  // 版本 1 和 2 的长度字段均为 2 字节
+  size_t header_size = format == Format::PrefixCompressed
+                           ? 2 * sizeof(uint16_t)
+                           : sizeof(uint16_t);
+  if (offset + header_size > size) {
+    throw std::runtime_error("Corrupted block entry");
+  }
+  uint16_t shared = 0, unshared;
+  if (format == Format::PrefixCompressed) {
+    memcpy(&shared, base + offset, sizeof(uint16_t));
+    memcpy(&unshared, base + offset + sizeof(uint16_t), sizeof(uint16_t));
+  } else {
+    memcpy(&unshared, base + offset, sizeof(uint16_t));
+  }
+  layout.shared = shared;
+  layout.unshared = unshared;
+  layout.key_pos = offset + header_size;
+  size_t val_len_pos = layout.key_pos + unshared;
+  if (val_len_pos + sizeof(uint16_t) > size) {
+    throw std::runtime_error("Corrupted block entry");
+  }
+  uint16_t value_len;
+  memcpy(&value_len, base + val_len_pos, sizeof(uint16_t));
+  layout.value_len = value_len;
+  layout.blob_index = false;
+  layout.value_pos = val_len_pos + sizeof(uint16_t);
+  layout.tranc_id_pos = layout.value_pos + value_len;
+  layout.end = layout.tranc_id_pos + sizeof(uint64_t);
+  if (layout.end > size) {
+    throw std::runtime_error("Corrupted block entry");
+  }
+  return layout;
+}
+
 // 从指定偏移量获取entry的key
 std::string Block::get_key_at(size_t offset) const {
-  uint16_t key_len;
-  memcpy(&key_len, data.data() + offset, sizeof(uint16_t));
-  return std::string(
-      reinterpret_cast<const char *>(data.data() + offset + sizeof(uint16_t)),
-      key_len);
+  std::string key;
+  get_key_at(offset, key);
+  return key;
 }
 
-// 从指定偏移量获取entry的value
-std::string Block::get_value_at(size_t offset) const {
-  // 先获取key长度
-  uint16_t key_len;
-  memcpy(&key_len, data.data() + offset, sizeof(uint16_t));
+void Block::get_key_at(size_t offset, std::string &key) const {
+  if (format == Format::Plain) {
+    auto layout = entry_layout_(offset);
+    key.assign(reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+               layout.unshared);
+    return;
+  }
 
-  // 计算value长度的位置
-  size_t value_len_pos = offset + sizeof(uint16_t) + key_len;
-  uint16_t value_len;
-  memcpy(&value_len, data.data() + value_len_pos, sizeof(uint16_t));
+  // 从 offset 之前最近的 restart 点开始, 逐个 entry 还原 key
+  auto it = std::upper_bound(restarts.begin(), restarts.end(), offset);
+  size_t pos = it == restarts.begin() ? 0 : *(it - 1);
+  while (true) {
+    auto layout = entry_layout_(pos);
+    key.resize(layout.shared);
+    key.append(reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+               layout.unshared);
+    if (pos >= offset) {
+      return;
+    }
+    pos = layout.end;
+  }
+}
 
-  // 返回value
-  return std::string(reinterpret_cast<const char *>(
-                         data.data() + value_len_pos + sizeof(uint16_t)),
-                     value_len);
+// 从指定偏移量获取entry的value
+std::string Block::get_value_at(size_t offset) const {
+  auto layout = entry_layout_(offset);
+  return std::string(
+      reinterpret_cast<const char *>(data_ptr() + layout.value_pos),
+      layout.value_len);
 }
 
-uint16_t Block::get_tranc_id_at(size_t offset) const {
-  // 先获取key长度
-  uint16_t key_len;
-  memcpy(&key_len, data.data() + offset, sizeof(uint16_t));
+std::string_view Block::get_value_view_at(size_t offset) const {
+  auto layout = entry_layout_(offset);
+  return std::string_view(
+      reinterpret_cast<const char *>(data_ptr() + layout.value_pos),
+      layout.value_len);
+}
 
-  // 计算value长度的位置
-  size_t value_len_pos = offset + sizeof(uint16_t) + key_len;
-  uint16_t value_len;
-  memcpy(&value_len, data.data() + value_len_pos, sizeof(uint16_t));
+uint64_t Block::get_tranc_id_at(size_t offset) const {
+  return decode_tranc_id_(entry_layout_(offset));
+}
 
-  // 计算事务id的位置
-  size_t tranc_id_pos = value_len_pos + sizeof(uint16_t) + value_len;
+uint64_t Block::decode_tranc_id_(const EntryLayout &layout) const {
+  if (format == Format::Varint) {
+    // 长度已经在 entry_layout_ 中校验过
+    uint64_t tranc_delta = 0;
+    decode_varint(data_ptr() + layout.tranc_id_pos, data_ptr() + layout.end,
+                  &tranc_delta);
+    return base_tranc_id + static_cast<uint64_t>(zigzag_decode(tranc_delta));
+  }
   uint64_t tranc_id;
-  memcpy(&tranc_id, data.data() + tranc_id_pos, sizeof(uint64_t));
+  memcpy(&tranc_id, data_ptr() + layout.tranc_id_pos, sizeof(uint64_t));
   return tranc_id;
 }
 
+bool Block::is_blob_index_at(size_t offset) const {
+  return format == Format::Varint && entry_layout_(offset).blob_index;
+}
+
 // 比较指定偏移量处的key与目标key
 int Block::compare_key_at(size_t offset, const std::string &target) const {
-  std::string key = get_key_at(offset);
+  if (format != Format::Plain) {
+    return get_key_at(offset).compare(target);
+  }
+  auto layout = entry_layout_(offset);
+  std::string_view key(
+      reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+      layout.unshared);
   return key.compare(target);
 }
 
+bool Block::same_key_as_prev(size_t idx) const {
+  if (idx == 0 || idx >= offsets.size()) {
+    return false;
+  }
+  if (format != Format::Plain &&
+      !std::binary_search(restarts.begin(), restarts.end(), offsets[idx])) {
+    // 非 restart 点的 entry 与上一个 key 完全共享时才相同
+    auto layout = entry_layout_(offsets[idx]);
+    auto prev_layout = entry_layout_(offsets[idx - 1]);
+    return layout.unshared == 0 &&
+           layout.shared == prev_layout.shared + prev_layout.unshared;
+  }
+  return get_key_at(offsets[idx]) == get_key_at(offsets[idx - 1]);
+}
+
 // 相同的key连续分布, 且相同的key的事务id从大到小排布
 // 这里的逻辑是找到最接近 tranc_id 的键值对的索引位置
 int Block::adjust_idx_by_tranc_id(size_t idx, uint64_t tranc_id) {
@@ -267,6 +702,9 @@ std::optional<size_t> Block::get_idx_binary(const std::string &key,
   if (offsets.empty()) {
     return std::nullopt;
   }
+  if (format != Format::Plain) {
+    return get_idx_restart_(key, tranc_id);
+  }
   // 二分查找
   int left = 0;
   int right = offsets.size() - 1;
@@ -297,6 +735,85 @@ std::optional<size_t> Block::get_idx_binary(const std::string &key,
   return std::nullopt;
 }
 
+size_t Block::lower_bound_idx(const std::string &key) const {
+  if (format != Format::Plain && !restarts.empty()) {
+    // 先在 restart 点上查找, 再从最后一个小于目标的 restart 点开始顺序解码
+    size_t restart_idx = restart_lower_bound_(key, 0, restarts.size());
+    size_t idx = restart_entry_idx_(restart_idx == 0 ? 0 : restart_idx - 1);
+    std::string cur_key;
+    for (; idx < offsets.size(); idx++) {
+      auto layout = entry_layout_(offsets[idx]);
+      cur_key.resize(layout.shared);
+      cur_key.append(
+          reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+          layout.unshared);
+      if (cur_key >= key) {
+        break;
+      }
+    }
+    return idx;
+  }
+  size_t left = 0;
+  size_t right = offsets.size();
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (compare_key_at(offsets[mid], key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+std::optional<size_t> Block::get_idx_restart_(const std::string &key,
+                                              uint64_t tranc_id) {
+  // 1. 通过哈希索引直接定位 key 所在的 restart 区间
+  size_t scan_end = data_size();
+  size_t left = 0;
+  size_t right = restarts.size();
+  if (!hash_buckets.empty()) {
+    uint8_t bucket = hash_buckets[block_key_hash(key) % hash_buckets.size()];
+    if (bucket == kHashBucketEmpty) {
+      return std::nullopt;
+    }
+    if (bucket < restarts.size()) {
+      // key 的第一个版本只可能在这个 restart 区间中
+      left = right = bucket + 1;
+      if (static_cast<size_t>(bucket) + 1 < restarts.size()) {
+        scan_end = restarts[bucket + 1];
+      }
+    }
+  }
+
+  // 2. 在 restart 点上查找, 找到最后一个 key 小于目标的 restart 点
+  left = restart_lower_bound_(key, left, right);
+  size_t restart_idx = left == 0 ? 0 : left - 1;
+
+  // 3. 从 restart 点开始顺序解码, 找到第一个不小于目标的 key
+  size_t idx = restart_entry_idx_(restart_idx);
+  std::string cur_key;
+  for (; idx < offsets.size() && offsets[idx] < scan_end; idx++) {
+    auto layout = entry_layout_(offsets[idx]);
+    cur_key.resize(layout.shared);
+    cur_key.append(reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+                   layout.unshared);
+    int cmp = cur_key.compare(key);
+    if (cmp > 0) {
+      return std::nullopt;
+    }
+    if (cmp == 0) {
+      // 相同 key 的第一个版本, 还需要判断事务id可见性
+      auto new_idx = adjust_idx_by_tranc_id(idx, tranc_id);
+      if (new_idx == -1) {
+        return std::nullopt;
+      }
+      return new_idx;
+    }
+  }
+  return std::nullopt;
+}
+
 // 返回第一个满足谓词的位置和最后一个满足谓词的位置
 // 如果不存在, 范围nullptr
 // 谓词作用于key, 且保证满足谓词的结果只在一段连续的区间内, 例如前缀匹配的谓词
@@ -365,15 +882,51 @@ Block::Entry Block::get_entry_at(size_t offset) const {
   entry.key = get_key_at(offset);
   entry.value = get_value_at(offset);
   entry.tranc_id = get_tranc_id_at(offset);
+  entry.blob_index = is_blob_index_at(offset);
+  return entry;
+}
+
+Block::EntryView Block::get_entry_view_at(size_t idx, std::string &key,
+                                          bool key_is_prev) const {
+  size_t offset = get_offset_at(idx);
+  if (!key_is_prev) {
+    get_key_at(offset, key);
+  }
+  auto layout = entry_layout_(offset);
+  if (key_is_prev) {
+    // 版本 1 和 restart 点的 shared 为 0, 同样适用
+    key.resize(layout.shared);
+    key.append(reinterpret_cast<const char *>(data_ptr() + layout.key_pos),
+               layout.unshared);
+  }
+  EntryView entry;
+  entry.value = std::string_view(
+      reinterpret_cast<const char *>(data_ptr() + layout.value_pos),
+      layout.value_len);
+  entry.tranc_id = decode_tranc_id_(layout);
+  entry.blob_index = format == Format::Varint && layout.blob_index;
   return entry;
 }
 
 size_t Block::size() const { return offsets.size(); }
 
 size_t Block::cur_size() const {
-  return data.size() + offsets.size() * sizeof(uint16_t) + sizeof(uint16_t);
+  switch (format) {
+  case Format::Varint:
+    return data_size() + restarts.size() * sizeof(uint32_t) +
+           hash_index_size_() + kVarintBlockExtraSize;
+  case Format::PrefixCompressed:
+    return data_size() + restarts.size() * sizeof(uint16_t) +
+           2 * sizeof(uint16_t);
+  default:
+    return data_size() + offsets.size() * sizeof(uint16_t) + sizeof(uint16_t);
+  }
 }
 
+Block::Format Block::get_format() const { return format; }
+
+bool Block::has_hash_index() const { return !hash_buckets.empty(); }
+
 bool Block::is_empty() const { return offsets.empty(); }
 
 BlockIterator Block::begin(uint64_t tranc_id) {
@@ -1,90 +1,183 @@
 #include "../../include/block/block_cache.h"
 #include "../../include/block/block.h"
+#include "../../include/utils/perf_context.h"
+#include <algorithm>
 #include <chrono>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
 
-BlockCache::BlockCache(size_t capacity, size_t k)
-    : capacity_(capacity), k_(k) {}
+BlockCache::BlockCache(size_t capacity, size_t k, int shard_bits,
+                       bool cache_meta)
+    : capacity_(capacity), k_(k), cache_meta_(cache_meta),
+      shared_(std::make_shared<Shared>()) {
+  size_t shard_num = static_cast<size_t>(1) << std::max(shard_bits, 0);
+  for (size_t i = 0; i < shard_num; i++) {
+    auto shard = std::make_unique<Shard>();
+    // 容量向上取整, 保证各分片容量之和不小于总容量
+    shard->capacity = (capacity + shard_num - 1) / shard_num;
+    shared_->shards.push_back(std::move(shard));
+  }
+}
+
+BlockCache::BlockCache(const BlockCache &other, uint32_t owner)
+    : capacity_(other.capacity_), k_(other.k_), cache_meta_(other.cache_meta_),
+      shared_(other.shared_), owner_(owner) {}
 
 BlockCache::~BlockCache() = default;
 
+std::shared_ptr<BlockCache> BlockCache::share() {
+  return std::shared_ptr<BlockCache>(
+      new BlockCache(*this, shared_->next_owner.fetch_add(1)));
+}
+
+uint64_t BlockCache::get_sst_key(int sst_id) const {
+  return (owner_ << 32) | static_cast<uint32_t>(sst_id);
+}
+
+BlockCache::Shard &BlockCache::get_shard(uint64_t sst_key, int block_id) {
+  // 使用哈希值的高位选择分片, 低位留给分片内的哈希表
+  auto &shards = shared_->shards;
+  size_t hash = pair_hash{}(std::make_pair(sst_key, block_id));
+  return *shards[(hash >> 32) & (shards.size() - 1)];
+}
+
+size_t BlockCache::get_charge(const Block &block) {
+  return sizeof(Block) + block.cur_size();
+}
+
 std::shared_ptr<Block> BlockCache::get(int sst_id, int block_id) {
-  std::lock_guard<std::mutex> lock(mutex_);
+  auto block = std::static_pointer_cast<Block>(get_(sst_id, block_id));
+  perf_count(block != nullptr ? &PerfContext::block_cache_hits
+                              : &PerfContext::block_cache_misses);
+  return block;
+}
+
+void BlockCache::put(int sst_id, int block_id, std::shared_ptr<Block> block) {
+  size_t charge = get_charge(*block);
+  put_(sst_id, block_id, std::move(block), charge, false);
+}
+
+std::shared_ptr<void> BlockCache::get_meta(int sst_id, MetaType type) {
+  return get_(sst_id, static_cast<int>(type));
+}
+
+void BlockCache::put_meta(int sst_id, MetaType type, std::shared_ptr<void> meta,
+                          size_t charge, bool high_priority) {
+  put_(sst_id, static_cast<int>(type), std::move(meta), charge, high_priority);
+}
+
+bool BlockCache::cache_meta() const { return cache_meta_; }
+
+std::shared_ptr<void> BlockCache::get_(int sst_id, int block_id) {
   ++total_requests_; // 增加总请求数
-  auto key = std::make_pair(sst_id, block_id);
-  auto it = cache_map_.find(key);
-  if (it == cache_map_.end()) {
+  uint64_t sst_key = get_sst_key(sst_id);
+  auto &shard = get_shard(sst_key, block_id);
+  std::unique_lock<std::mutex> lock(shard.mutex, std::defer_lock);
+  {
+    PerfTimer timer(&PerfContext::block_cache_lock_nanos);
+    lock.lock();
+  }
+  auto key = std::make_pair(sst_key, block_id);
+  auto it = shard.cache_map_.find(key);
+  if (it == shard.cache_map_.end()) {
     return nullptr; // 缓存未命中
   }
 
   ++hit_requests_; // 增加命中请求数
   // 更新访问次数
-  update_access_count(it->second);
+  update_access_count(shard, it->second);
 
   return it->second->cache_block;
 }
 
-void BlockCache::put(int sst_id, int block_id, std::shared_ptr<Block> block) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto key = std::make_pair(sst_id, block_id);
-  auto it = cache_map_.find(key);
+void BlockCache::put_(int sst_id, int block_id, std::shared_ptr<void> value,
+                      size_t charge, bool high_priority) {
+  uint64_t sst_key = get_sst_key(sst_id);
+  auto &shard = get_shard(sst_key, block_id);
+  if (charge > shard.capacity) {
+    // 单个缓存项超过分片的容量, 放入缓存只会驱逐其他所有缓存项
+    return;
+  }
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto key = std::make_pair(sst_key, block_id);
+  auto it = shard.cache_map_.find(key);
 
-  if (it != cache_map_.end()) {
+  if (it != shard.cache_map_.end()) {
     // 更新已有缓存项
     // ! 照理说 Block 类的数据是不可变的，这里的更新分支应该不会存在,
     // 只是debug用
-    it->second->cache_block = block;
-    update_access_count(it->second);
+    shard.usage = shard.usage - it->second->charge + charge;
+    it->second->cache_block = std::move(value);
+    it->second->charge = charge;
+    update_access_count(shard, it->second);
   } else {
-    // 插入新缓存项
-    if (cache_map_.size() >= capacity_) {
-      // 移除最久未使用的缓存项
-      if (!cache_list_less_k.empty()) {
-        // 优先从 cache_list_less_k 中移除
-        cache_map_.erase(std::make_pair(cache_list_less_k.back().sst_id,
-                                        cache_list_less_k.back().block_id));
-        cache_list_less_k.pop_back();
-      } else {
-        cache_map_.erase(std::make_pair(cache_list_greater_k.back().sst_id,
-                                        cache_list_greater_k.back().block_id));
-        cache_list_greater_k.pop_back();
-      }
-    }
-
-    CacheItem item = {sst_id, block_id, block, 1};
-    cache_list_less_k.push_front(item);
-    cache_map_[key] = cache_list_less_k.begin();
+    // 插入新缓存项, 必要时移除最久未使用的缓存项
+    evict(shard, charge);
+
+    CacheItem item = {sst_key, block_id, std::move(value), 1, charge,
+                      high_priority};
+    auto &list =
+        high_priority ? shard.cache_list_high_pri : shard.cache_list_less_k;
+    list.push_front(std::move(item));
+    shard.cache_map_[key] = list.begin();
+    shard.usage += charge;
+  }
+}
+
+void BlockCache::evict(Shard &shard, size_t charge) {
+  while (shard.usage + charge > shard.capacity && !shard.cache_map_.empty()) {
+    // 优先从 cache_list_less_k 中移除, 高优先级的缓存项最后移除
+    auto &list = !shard.cache_list_less_k.empty() ? shard.cache_list_less_k
+                 : !shard.cache_list_greater_k.empty()
+                     ? shard.cache_list_greater_k
+                     : shard.cache_list_high_pri;
+    auto &victim = list.back();
+    shard.cache_map_.erase(std::make_pair(victim.sst_key, victim.block_id));
+    shard.usage -= victim.charge;
+    list.pop_back();
   }
 }
 
 double BlockCache::hit_rate() const {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return total_requests_ == 0
-             ? 0.0
-             : static_cast<double>(hit_requests_) / total_requests_;
+  size_t total = total_requests_.load(std::memory_order_relaxed);
+  size_t hit = hit_requests_.load(std::memory_order_relaxed);
+  return total == 0 ? 0.0 : static_cast<double>(hit) / total;
+}
+
+size_t BlockCache::get_usage() const {
+  size_t usage = 0;
+  for (auto &shard : shared_->shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    usage += shard->usage;
+  }
+  return usage;
 }
 
-void BlockCache::update_access_count(std::list<CacheItem>::iterator it) {
+void BlockCache::update_access_count(Shard &shard,
+                                     std::list<CacheItem>::iterator it) {
+  if (it->high_priority) {
+    // 高优先级的缓存项只按 LRU 排列
+    shard.cache_list_high_pri.splice(shard.cache_list_high_pri.begin(),
+                                     shard.cache_list_high_pri, it);
+    return;
+  }
   ++it->access_count;
   if (it->access_count < k_) {
     // 更新后仍然位于cache_list_less_k
     // 重新置于cache_list_less_k头部
-    cache_list_less_k.splice(cache_list_less_k.begin(), cache_list_less_k, it);
+    shard.cache_list_less_k.splice(shard.cache_list_less_k.begin(),
+                                   shard.cache_list_less_k, it);
   } else if (it->access_count == k_) {
     // 更新后满足k次访问, 升级链表
     // 从 cache_list_less_k 移动到 cache_list_greater_k 头部
-    auto item = *it;
-    cache_list_less_k.erase(it);
-    cache_list_greater_k.push_front(item);
-    cache_map_[std::make_pair(item.sst_id, item.block_id)] =
-        cache_list_greater_k.begin();
+    shard.cache_list_greater_k.splice(shard.cache_list_greater_k.begin(),
+                                      shard.cache_list_less_k, it);
   } else if (it->access_count > k_) {
     // 本来就位于 cache_list_greater_k
     // 移动到 cache_list_greater_k 头部
-    cache_list_greater_k.splice(cache_list_greater_k.begin(),
-                                cache_list_greater_k, it);
+    shard.cache_list_greater_k.splice(shard.cache_list_greater_k.begin(),
+                                      shard.cache_list_greater_k, it);
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,83 @@
+#include "../../include/block/block_index.h"
+#include <algorithm>
+#include <stdexcept>
+
+BlockIndex::BlockIndex(const std::vector<BlockMeta> &metas) {
+  if (metas.empty()) {
+    return;
+  }
+  block_offsets_.reserve(metas.size());
+  key_ends_.reserve(metas.size() + 1);
+  append_key(metas.front().first_key);
+  for (size_t i = 0; i < metas.size(); i++) {
+    block_offsets_.push_back(metas[i].offset);
+    if (i + 1 < metas.size()) {
+      append_key(shortest_separator(metas[i].last_key, metas[i + 1].first_key));
+    }
+  }
+  append_key(metas.back().last_key);
+  keys_.shrink_to_fit();
+}
+
+void BlockIndex::append_key(std::string_view key) {
+  keys_.append(key);
+  key_ends_.push_back(keys_.size());
+}
+
+size_t BlockIndex::size() const { return block_offsets_.size(); }
+
+bool BlockIndex::empty() const { return block_offsets_.empty(); }
+
+uint32_t BlockIndex::block_offset(size_t block_idx) const {
+  if (block_idx >= block_offsets_.size()) {
+    throw std::out_of_range("Block index out of range");
+  }
+  return block_offsets_[block_idx];
+}
+
+std::string_view BlockIndex::boundary(size_t idx) const {
+  if (idx >= key_ends_.size()) {
+    throw std::out_of_range("Block index out of range");
+  }
+  size_t begin = idx == 0 ? 0 : key_ends_[idx - 1];
+  return std::string_view(keys_).substr(begin, key_ends_[idx] - begin);
+}
+
+size_t BlockIndex::seek(std::string_view key) const {
+  size_t num_blocks = size();
+  if (num_blocks == 0 || key > boundary(num_blocks)) {
+    return num_blocks;
+  }
+  // 找到最后一个不大于 key 的分隔 key, 即 boundary(1) ~ boundary(n - 1)
+  size_t left = 1;
+  size_t right = num_blocks;
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (boundary(mid) <= key) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left - 1;
+}
+
+size_t BlockIndex::memory_usage() const {
+  return sizeof(BlockIndex) + block_offsets_.capacity() * sizeof(uint32_t) +
+         key_ends_.capacity() * sizeof(uint32_t) + keys_.capacity();
+}
+
+std::string BlockIndex::shortest_separator(std::string_view last,
+                                           std::string_view first) {
+  if (last >= first) {
+    // 正常情况下不会出现, 使用 first 保证 boundary(i) <= first_key
+    return std::string(first);
+  }
+  // 取 first 中比公共前缀多一个字符的前缀, 它大于 last 且不大于 first
+  size_t shared = 0;
+  size_t max_shared = std::min(last.size(), first.size());
+  while (shared < max_shared && last[shared] == first[shared]) {
+    shared++;
+  }
+  return std::string(first.substr(0, shared + 1));
+}
@@ -30,6 +30,61 @@ BlockIterator::BlockIterator(std::shared_ptr<Block> b, const std::string &key,
 //   skip_by_tranc_id();
 // }
 
+bool BlockIterator::seek_visible_in_key(size_t idx) {
+  for (size_t i = idx; i < block->size(); i++) {
+    if (i > idx && !block->same_key_as_prev(i)) {
+      break;
+    }
+    // 相同 key 的版本按 tranc_id 降序排列, 第一个可见的即为最新的可见版本
+    if (tranc_id_ == 0 ||
+        block->get_tranc_id_at(block->get_offset_at(i)) <= tranc_id_) {
+      current_index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void BlockIterator::seek_prev_key(size_t idx) {
+  cached_value = std::nullopt;
+  while (idx > 0) {
+    size_t start = idx - 1;
+    while (start > 0 && block->same_key_as_prev(start)) {
+      start--;
+    }
+    if (seek_visible_in_key(start)) {
+      return;
+    }
+    idx = start;
+  }
+  current_index = block->size();
+}
+
+BlockIterator &BlockIterator::operator--() {
+  if (!block || current_index >= block->size()) {
+    return *this;
+  }
+  size_t start = current_index;
+  while (start > 0 && block->same_key_as_prev(start)) {
+    start--;
+  }
+  seek_prev_key(start);
+  return *this;
+}
+
+void BlockIterator::seek_to_last() { seek_prev_key(block->size()); }
+
+void BlockIterator::seek_for_prev(const std::string &key) {
+  cached_value = std::nullopt;
+  size_t idx = block->lower_bound_idx(key);
+  if (idx < block->size() &&
+      block->compare_key_at(block->get_offset_at(idx), key) == 0 &&
+      seek_visible_in_key(idx)) {
+    return;
+  }
+  seek_prev_key(idx);
+}
+
 BlockIterator::pointer BlockIterator::operator->() const {
   update_current();
   return &(*cached_value);
@@ -37,20 +92,12 @@ BlockIterator::pointer BlockIterator::operator->() const {
 
 BlockIterator &BlockIterator::operator++() {
   if (block && current_index < block->size()) {
-    auto prev_idx = current_index;
-    auto prev_offset = block->get_offset_at(prev_idx);
-    auto prev_entry = block->get_entry_at(prev_offset);
-
     ++current_index;
 
     // 跳过相同的key
-    while (block && current_index < block->size()) {
-      auto cur_offset = block->get_offset_at(current_index);
-      auto cur_entry = block->get_entry_at(cur_offset);
-      if (cur_entry.key != prev_entry.key) {
-        break;
-      }
-      // 可能会连续出现多个key, 但由不同事务创建, 同样的key直接跳过
+    // 可能会连续出现多个key, 但由不同事务创建, 同样的key直接跳过
+    while (block && current_index < block->size() &&
+           block->same_key_as_prev(current_index)) {
       ++current_index;
     }
 
@@ -82,20 +129,65 @@ BlockIterator::value_type BlockIterator::operator*() const {
 
   // 使用缓存避免重复解析
   if (!cached_value.has_value()) {
-    size_t offset = block->get_offset_at(current_index);
-    cached_value =
-        std::make_pair(block->get_key_at(offset), block->get_value_at(offset));
+    cached_value = std::make_pair(std::string(key()), std::string(value()));
   }
   return *cached_value;
 }
 
+std::string_view BlockIterator::key() const {
+  if (!block || current_index >= block->size()) {
+    throw std::out_of_range("Iterator out of range");
+  }
+  size_t offset = block->get_offset_at(current_index);
+  if (block->format == Block::Format::Plain) {
+    auto layout = block->entry_layout_(offset);
+    return std::string_view(
+        reinterpret_cast<const char *>(block->data_ptr() + layout.key_pos),
+        layout.unshared);
+  }
+  if (key_idx_ == current_index) {
+    return key_buf_;
+  }
+  if (key_idx_ < current_index) {
+    // 向后移动时逐个应用前缀差量, restart 点的 shared 为 0, 同样适用
+    for (size_t idx = key_idx_ + 1; idx <= current_index; idx++) {
+      auto layout = block->entry_layout_(block->get_offset_at(idx));
+      key_buf_.resize(layout.shared);
+      key_buf_.append(
+          reinterpret_cast<const char *>(block->data_ptr() + layout.key_pos),
+          layout.unshared);
+    }
+  } else {
+    block->get_key_at(offset, key_buf_);
+  }
+  key_idx_ = current_index;
+  return key_buf_;
+}
+
+std::string_view BlockIterator::value() const {
+  if (!block || current_index >= block->size()) {
+    throw std::out_of_range("Iterator out of range");
+  }
+  return block->get_value_view_at(block->get_offset_at(current_index));
+}
+
 bool BlockIterator::is_end() { return current_index == block->offsets.size(); }
 
+uint64_t BlockIterator::get_tranc_id() const {
+  if (!block || current_index >= block->size()) {
+    throw std::out_of_range("Iterator out of range");
+  }
+  return block->get_tranc_id_at(block->get_offset_at(current_index));
+}
+
+bool BlockIterator::is_blob_index() const {
+  return block && current_index < block->size() &&
+         block->is_blob_index_at(block->get_offset_at(current_index));
+}
+
 void BlockIterator::update_current() const {
   if (!cached_value && current_index < block->offsets.size()) {
-    size_t offset = block->get_offset_at(current_index);
-    cached_value =
-        std::make_pair(block->get_key_at(offset), block->get_value_at(offset));
+    cached_value = std::make_pair(std::string(key()), std::string(value()));
   }
 }
 
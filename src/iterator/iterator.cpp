@@ -1,4 +1,5 @@
 #include "../../include/iterator/iterator.h"
+#include <stdexcept>
 #include <tuple>
 #include <vector>
 
@@ -66,6 +67,20 @@ HeapIterator::value_type HeapIterator::operator*() const {
   return std::make_pair(items.top().key_, items.top().value_);
 }
 
+std::string_view HeapIterator::key() const {
+  if (items.empty()) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return items.top().key_;
+}
+
+std::string_view HeapIterator::value() const {
+  if (items.empty()) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return items.top().value_;
+}
+
 BaseIterator &HeapIterator::operator++() {
   if (items.empty()) {
     return *this; // 处理空队列情况
@@ -163,3 +178,11 @@ IteratorType HeapIterator::get_type() const {
 }
 
 uint64_t HeapIterator::get_tranc_id() const { return max_tranc_id_; }
+
+uint64_t HeapIterator::get_entry_tranc_id() const {
+  return items.empty() ? 0 : items.top().tranc_id_;
+}
+
+bool HeapIterator::is_merge_operand() const {
+  return !items.empty() && items.top().merge_;
+}
@@ -0,0 +1,114 @@
+#include "../../include/lsm/column_family.h"
+#include "../../include/lsm/engine.h"
+#include "../../include/utils/files.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+std::string encode_cf_key(uint32_t cf_id, const std::string &key) {
+  if (cf_id == 0 && (key.empty() || key[0] != '\0')) {
+    return key;
+  }
+  std::string cf_key(1 + sizeof(uint32_t) + key.size(), '\0');
+  for (size_t i = 0; i < sizeof(uint32_t); i++) {
+    cf_key[1 + i] = static_cast<char>((cf_id >> (24 - 8 * i)) & 0xff);
+  }
+  std::memcpy(cf_key.data() + 1 + sizeof(uint32_t), key.data(), key.size());
+  return cf_key;
+}
+
+std::pair<uint32_t, std::string> decode_cf_key(const std::string &cf_key) {
+  if (cf_key.empty() || cf_key[0] != '\0') {
+    return {0, cf_key};
+  }
+  uint32_t cf_id = 0;
+  for (size_t i = 0; i < sizeof(uint32_t); i++) {
+    cf_id = (cf_id << 8) | static_cast<uint8_t>(cf_key[1 + i]);
+  }
+  return {cf_id, cf_key.substr(1 + sizeof(uint32_t))};
+}
+
+void ColumnFamilySet::add(std::shared_ptr<ColumnFamilyHandle> handle) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  families_[handle->id] = std::move(handle);
+}
+
+std::shared_ptr<ColumnFamilyHandle> ColumnFamilySet::get(uint32_t id) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = families_.find(id);
+  return it == families_.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<ColumnFamilyHandle>
+ColumnFamilySet::get(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (auto &[id, handle] : families_) {
+    if (handle->name == name) {
+      return handle;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<std::shared_ptr<ColumnFamilyHandle>> ColumnFamilySet::all() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  std::vector<std::shared_ptr<ColumnFamilyHandle>> result;
+  for (auto &[id, handle] : families_) {
+    result.push_back(handle);
+  }
+  return result;
+}
+
+uint64_t ColumnFamilySet::flushed_tranc_id() const {
+  uint64_t min_unflushed = std::numeric_limits<uint64_t>::max();
+  uint64_t max_flushed = 0;
+  for (auto &handle : all()) {
+    uint64_t flushed = handle->engine->flushed_tranc_id.load();
+    max_flushed = std::max(max_flushed, flushed);
+    if (handle->engine->memtable.get_total_size() > 0) {
+      min_unflushed = std::min(min_unflushed, flushed);
+    }
+  }
+  return std::min(min_unflushed, max_flushed);
+}
+
+std::map<uint32_t, std::string>
+ColumnFamilySet::load(const std::string &path) {
+  std::map<uint32_t, std::string> families;
+  if (!std::filesystem::exists(path)) {
+    return families;
+  }
+  auto file = FileObj::open(path, false);
+  size_t offset = 0;
+  while (offset + 2 * sizeof(uint32_t) <= file.size()) {
+    uint32_t id = file.read_uint32(offset);
+    uint32_t name_len = file.read_uint32(offset + sizeof(uint32_t));
+    offset += 2 * sizeof(uint32_t);
+    if (offset + name_len > file.size()) {
+      throw std::runtime_error("Corrupted column family file: " + path);
+    }
+    auto name = file.read_to_slice(offset, name_len);
+    families[id] = std::string(name.begin(), name.end());
+    offset += name_len;
+  }
+  return families;
+}
+
+void ColumnFamilySet::save(const std::string &path) const {
+  std::vector<uint8_t> buf;
+  for (auto &handle : all()) {
+    if (handle->id == 0) {
+      continue;
+    }
+    uint32_t header[2] = {handle->id,
+                          static_cast<uint32_t>(handle->name.size())};
+    auto *bytes = reinterpret_cast<const uint8_t *>(header);
+    buf.insert(buf.end(), bytes, bytes + sizeof(header));
+    buf.insert(buf.end(), handle->name.begin(), handle->name.end());
+  }
+  auto tmp_path = path + ".tmp";
+  FileObj::create_and_write(tmp_path, buf);
+  std::filesystem::rename(tmp_path, path);
+}
@@ -0,0 +1,310 @@
+#include "../../include/lsm/compact_iterator.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+template <size_t kNumRuns>
+BasicCompactIterator<kNumRuns>::BasicCompactIterator(
+    std::vector<std::vector<std::shared_ptr<SST>>> runs, uint64_t watermark,
+    bool bottommost, std::optional<std::string> lower_key,
+    std::optional<std::string> upper_key,
+    std::shared_ptr<const FragmentedRangeTombstones> range_dels,
+    std::shared_ptr<const CompactionFilter> compaction_filter)
+    : watermark_(watermark), bottommost_(bottommost),
+      lower_key_(std::move(lower_key)), upper_key_(std::move(upper_key)),
+      range_dels_(std::move(range_dels)),
+      compaction_filter_(std::move(compaction_filter)) {
+  if constexpr (kNumRuns == 0) {
+    cursors_.resize(runs.size());
+  } else if (runs.size() != kNumRuns) {
+    throw std::runtime_error("CompactIterator: unexpected number of runs");
+  }
+  for (size_t i = 0; i < runs.size(); i++) {
+    cursors_[i].ssts = std::move(runs[i]);
+    cursors_[i].valid = seek_lower(cursors_[i]);
+    if constexpr (kNumRuns == 0) {
+      if (cursors_[i].valid) {
+        heap_.push_back(i);
+      }
+    }
+  }
+  if constexpr (kNumRuns == 0) {
+    auto cmp = [this](size_t a, size_t b) { return cursor_greater(a, b); };
+    std::make_heap(heap_.begin(), heap_.end(), cmp);
+  }
+
+  find_next();
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::seek_lower(RunCursor &cursor) {
+  if (!lower_key_.has_value()) {
+    return load_entry(cursor);
+  }
+  auto &lower_key = lower_key_.value();
+  // 跳过整体位于 lower_key 之前的 sst 和 block
+  while (cursor.sst_idx < cursor.ssts.size() &&
+         cursor.ssts[cursor.sst_idx]->get_last_key() < lower_key) {
+    cursor.sst_idx++;
+  }
+  if (cursor.sst_idx < cursor.ssts.size()) {
+    cursor.block_idx =
+        cursor.ssts[cursor.sst_idx]->lower_bound_block_idx(lower_key);
+  }
+  // block 内部剩余的部分逐个跳过
+  bool valid = load_entry(cursor);
+  while (valid && cursor.key < lower_key) {
+    valid = advance(cursor);
+  }
+  return valid;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::load_entry(RunCursor &cursor) {
+  while (cursor.sst_idx < cursor.ssts.size()) {
+    auto &sst = cursor.ssts[cursor.sst_idx];
+    if (cursor.block_idx >= sst->num_blocks()) {
+      // 当前 sst 已经读完, 切换到 run 中的下一个 sst
+      cursor.sst_idx++;
+      cursor.block_idx = 0;
+      cursor.entry_idx = 0;
+      cursor.block = nullptr;
+      continue;
+    }
+    bool key_is_prev = true;
+    if (!cursor.block) {
+      // compact 的输入只会读取一次, 不放入缓存池
+      cursor.readahead.on_block_read(*sst, cursor.block_idx);
+      cursor.block = sst->read_block(cursor.block_idx, false);
+      key_is_prev = false;
+    }
+    if (cursor.entry_idx >= cursor.block->size()) {
+      cursor.block_idx++;
+      cursor.entry_idx = 0;
+      cursor.block = nullptr;
+      continue;
+    }
+    // 同一个 block 中只会逐个 entry 向后移动, cursor.key 即为上一个 entry
+    // 的 key (seek_lower 从 block 开头读取时也是如此)
+    cursor.entry = cursor.block->get_entry_view_at(
+        cursor.entry_idx, cursor.key, key_is_prev && cursor.entry_idx > 0);
+    cursor.entry.tranc_id = sst->resolve_tranc_id(cursor.entry.tranc_id);
+    if (upper_key_.has_value() && cursor.key >= upper_key_.value()) {
+      // 超出范围, run 中之后的 key 只会更大
+      cursor.sst_idx = cursor.ssts.size();
+      cursor.block = nullptr;
+      return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::advance(RunCursor &cursor) {
+  cursor.entry_idx++;
+  cursor.valid = load_entry(cursor);
+  return cursor.valid;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::cursor_greater(size_t a, size_t b) const {
+  auto &cursor_a = cursors_[a];
+  auto &cursor_b = cursors_[b];
+  int cmp = cursor_a.key.compare(cursor_b.key);
+  if (cmp != 0) {
+    return cmp > 0;
+  }
+  if (cursor_a.entry.tranc_id != cursor_b.entry.tranc_id) {
+    return cursor_a.entry.tranc_id < cursor_b.entry.tranc_id;
+  }
+  // 同一个版本出现在多个 run 中时, 更新的 run 优先
+  return a > b;
+}
+
+template <size_t kNumRuns> size_t BasicCompactIterator<kNumRuns>::top() const {
+  if constexpr (kNumRuns == 0) {
+    return heap_.empty() ? SIZE_MAX : heap_.front();
+  } else {
+    size_t best = SIZE_MAX;
+    for (size_t i = 0; i < kNumRuns; i++) {
+      if (cursors_[i].valid && (best == SIZE_MAX || cursor_greater(best, i))) {
+        best = i;
+      }
+    }
+    return best;
+  }
+}
+
+template <size_t kNumRuns>
+void BasicCompactIterator<kNumRuns>::pop(size_t idx) {
+  if constexpr (kNumRuns == 0) {
+    auto cmp = [this](size_t a, size_t b) { return cursor_greater(a, b); };
+    std::pop_heap(heap_.begin(), heap_.end(), cmp);
+    heap_.pop_back();
+    if (advance(cursors_[idx])) {
+      heap_.push_back(idx);
+      std::push_heap(heap_.begin(), heap_.end(), cmp);
+    }
+  } else {
+    advance(cursors_[idx]);
+  }
+}
+
+template <size_t kNumRuns> void BasicCompactIterator<kNumRuns>::find_next() {
+  size_t idx;
+  while ((idx = top()) != SIZE_MAX) {
+    auto &cursor = cursors_[idx];
+    uint64_t tranc_id = cursor.entry.tranc_id;
+    if (has_last_ && cursor.key == last_key_) {
+      if (last_key_done_ || tranc_id == last_tranc_id_) {
+        // 比 watermark 以下最新版本更旧的版本, 对所有事务都不可见;
+        // 或者重复的版本, 保留更新的 run 中的那一个
+        pop(idx);
+        continue;
+      }
+    } else {
+      last_key_.assign(cursor.key);
+      has_last_ = true;
+      last_key_done_ = false;
+    }
+    last_tranc_id_ = tranc_id;
+
+    if (range_dels_ != nullptr && watermark_ != 0 && tranc_id <= watermark_ &&
+        range_dels_->max_covering(cursor.key, watermark_) > tranc_id) {
+      // 覆盖它的范围删除标记对所有事务可见, 更旧的版本同样被覆盖
+      last_key_done_ = true;
+      pop(idx);
+      continue;
+    }
+    // tranc_id > watermark 的版本可能被活跃事务看到, 直接输出
+    bool filtered = false;
+    if (tranc_id <= watermark_) {
+      last_key_done_ = true;
+      filtered = compaction_filter_ != nullptr && !cursor.entry.blob_index &&
+                 !cursor.entry.value.empty() &&
+                 compaction_filter_->filter(cursor.key, cursor.entry.value);
+      if (bottommost_ && (filtered || cursor.entry.value.empty())) {
+        // 最底层不存在更旧的数据, 删除标记没有保留的必要
+        pop(idx);
+        continue;
+      }
+    }
+    // value 指向的 block 可能在推进 cursor 后被释放, 先复制出来
+    // 被过滤的版本输出为删除标记, 遮挡更底层的旧版本
+    cur_value_.assign(filtered ? std::string_view{} : cursor.entry.value);
+    cur_tranc_id_ = tranc_id;
+    cur_blob_index_ = cursor.entry.blob_index;
+    valid_ = true;
+    pop(idx);
+    return;
+  }
+  valid_ = false;
+}
+
+template <size_t kNumRuns>
+BaseIterator &BasicCompactIterator<kNumRuns>::operator++() {
+  if (valid_) {
+    find_next();
+  }
+  return *this;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::operator==(
+    const BaseIterator &other) const {
+  if (other.get_type() != IteratorType::CompactIterator) {
+    return false;
+  }
+  if (is_end() && other.is_end()) {
+    return true;
+  }
+  return this == &other;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::operator!=(
+    const BaseIterator &other) const {
+  return !(*this == other);
+}
+
+template <size_t kNumRuns>
+typename BasicCompactIterator<kNumRuns>::value_type
+BasicCompactIterator<kNumRuns>::operator*() const {
+  if (!valid_) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return std::make_pair(last_key_, cur_value_);
+}
+
+template <size_t kNumRuns>
+std::string_view BasicCompactIterator<kNumRuns>::key() const {
+  if (!valid_) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return last_key_;
+}
+
+template <size_t kNumRuns>
+std::string_view BasicCompactIterator<kNumRuns>::value() const {
+  if (!valid_) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return cur_value_;
+}
+
+template <size_t kNumRuns>
+IteratorType BasicCompactIterator<kNumRuns>::get_type() const {
+  return IteratorType::CompactIterator;
+}
+
+template <size_t kNumRuns>
+uint64_t BasicCompactIterator<kNumRuns>::get_tranc_id() const {
+  return valid_ ? cur_tranc_id_ : 0;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::is_blob_index() const {
+  return valid_ && cur_blob_index_;
+}
+
+template <size_t kNumRuns>
+std::vector<RangeTombstone>
+BasicCompactIterator<kNumRuns>::output_range_tombstones() const {
+  std::vector<RangeTombstone> result;
+  if (range_dels_ == nullptr) {
+    return result;
+  }
+  if (watermark_ == 0) {
+    // 不清理任何版本, 标记也全部保留
+    return range_dels_->tombstones();
+  }
+  for (auto &fragment : range_dels_->fragments()) {
+    for (auto tranc_id : fragment.tranc_ids) {
+      if (tranc_id <= watermark_) {
+        // 更旧的标记被这一个完全遮挡
+        if (!bottommost_) {
+          result.emplace_back(fragment.begin, fragment.end, tranc_id);
+        }
+        break;
+      }
+      result.emplace_back(fragment.begin, fragment.end, tranc_id);
+    }
+  }
+  return result;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::is_end() const {
+  return !valid_;
+}
+
+template <size_t kNumRuns>
+bool BasicCompactIterator<kNumRuns>::is_valid() const {
+  return valid_;
+}
+
+// compact 只会用到这两种形状
+template class BasicCompactIterator<0>;
+template class BasicCompactIterator<2>;
@@ -0,0 +1,185 @@
+#include "../../include/lsm/conflict_table.h"
+#include "../../include/utils/hash.h"
+#include <algorithm>
+
+ConflictTable::ConflictTable(size_t num_stripes, size_t stripe_capacity)
+    : stripes_(std::max<size_t>(num_stripes, 1)),
+      stripe_capacity_(std::max<size_t>(stripe_capacity, 1)) {}
+
+void ConflictTable::set_watermark_callback(std::function<uint64_t()> callback) {
+  watermark_callback_ = std::move(callback);
+}
+
+size_t ConflictTable::stripe_index(const std::string &key) const {
+  return hash64(key) % stripes_.size();
+}
+
+std::vector<std::unique_lock<std::mutex>>
+ConflictTable::lock_keys(const std::vector<std::string> &keys) {
+  std::vector<size_t> indexes;
+  indexes.reserve(keys.size());
+  for (auto &key : keys) {
+    indexes.push_back(stripe_index(key));
+  }
+  std::sort(indexes.begin(), indexes.end());
+  indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(indexes.size());
+  for (auto idx : indexes) {
+    locks.emplace_back(stripes_[idx].mtx);
+  }
+  return locks;
+}
+
+ConflictTable::CheckResult ConflictTable::check(const std::string &key,
+                                                uint64_t begin_seq) const {
+  auto &stripe = stripes_[stripe_index(key)];
+  auto it = stripe.latest.find(key);
+  if (it != stripe.latest.end()) {
+    return it->second > begin_seq ? CheckResult::Conflict
+                                  : CheckResult::NoConflict;
+  }
+  // 被淘汰的记录都不晚于 begin_seq 时, 不在表中就说明没有冲突
+  return stripe.evicted_max > begin_seq ? CheckResult::Unknown
+                                        : CheckResult::NoConflict;
+}
+
+void ConflictTable::record(const std::string &key, uint64_t commit_seq) {
+  auto &stripe = stripes_[stripe_index(key)];
+  auto [it, inserted] = stripe.latest.try_emplace(key, commit_seq);
+  if (!inserted) {
+    it->second = std::max(it->second, commit_seq);
+  } else if (stripe.latest.size() > stripe_capacity_) {
+    shrink(stripe);
+  }
+
+  std::lock_guard<std::mutex> lock(stripe.log_mtx);
+  std::erase(stripe.pending, key);
+  // 同一个分段的提交持有分段锁依次进行, commit_seq 递增
+  stripe.recent.emplace_back(commit_seq, key);
+  if (stripe.recent.size() > stripe_capacity_) {
+    shrink_recent(stripe);
+  }
+}
+
+void ConflictTable::add_pending(const std::vector<std::string> &keys) {
+  for (auto &key : keys) {
+    auto &stripe = stripes_[stripe_index(key)];
+    std::lock_guard<std::mutex> lock(stripe.log_mtx);
+    stripe.pending.push_back(key);
+  }
+}
+
+void ConflictTable::clear_pending(const std::vector<std::string> &keys) {
+  for (auto &key : keys) {
+    auto &stripe = stripes_[stripe_index(key)];
+    std::lock_guard<std::mutex> lock(stripe.log_mtx);
+    std::erase(stripe.pending, key);
+  }
+}
+
+ConflictTable::CheckResult ConflictTable::check_range(
+    const std::function<bool(const std::string &)> &in_range,
+    uint64_t begin_seq,
+    const std::vector<std::unique_lock<std::mutex>> &held) const {
+  std::vector<const std::mutex *> held_mtxs;
+  held_mtxs.reserve(held.size());
+  for (auto &lock : held) {
+    held_mtxs.push_back(lock.mutex());
+  }
+  std::sort(held_mtxs.begin(), held_mtxs.end());
+
+  std::vector<std::string> keys;
+  for (auto &stripe : stripes_) {
+    keys.clear();
+    {
+      std::lock_guard<std::mutex> lock(stripe.log_mtx);
+      if (stripe.recent_evicted_max > begin_seq) {
+        return CheckResult::Unknown;
+      }
+      // recent 按 commit_seq 升序排列, 只需要 begin_seq 之后的部分
+      auto it = std::upper_bound(
+          stripe.recent.begin(), stripe.recent.end(), begin_seq,
+          [](uint64_t seq, const auto &entry) { return seq < entry.first; });
+      for (; it != stripe.recent.end(); ++it) {
+        keys.push_back(it->second);
+      }
+      if (!std::binary_search(held_mtxs.begin(), held_mtxs.end(),
+                              &stripe.mtx)) {
+        keys.insert(keys.end(), stripe.pending.begin(), stripe.pending.end());
+      }
+    }
+    // in_range 可能较慢, 不在持有 log_mtx 时调用
+    for (auto &key : keys) {
+      if (in_range(key)) {
+        return CheckResult::Conflict;
+      }
+    }
+  }
+  return CheckResult::NoConflict;
+}
+
+size_t ConflictTable::size() const {
+  size_t size = 0;
+  for (auto &stripe : stripes_) {
+    std::lock_guard<std::mutex> lock(stripe.mtx);
+    size += stripe.latest.size();
+  }
+  return size;
+}
+
+void ConflictTable::shrink(Stripe &stripe) {
+  // 1. 早于全部活跃事务开始的提交不会再引起冲突, 可以直接清理
+  if (watermark_callback_) {
+    uint64_t watermark = watermark_callback_();
+    std::erase_if(stripe.latest, [watermark](auto &entry) {
+      return entry.second <= watermark;
+    });
+    if (stripe.evicted_max <= watermark) {
+      // 被淘汰的记录也都早于全部活跃事务了
+      stripe.evicted_max = 0;
+    }
+  }
+  if (stripe.latest.size() * 4 <= stripe_capacity_ * 3) {
+    return;
+  }
+
+  // 2. 长事务导致无法清理时, 淘汰 commit_seq 较小的一半记录
+  std::vector<uint64_t> commit_seqs;
+  commit_seqs.reserve(stripe.latest.size());
+  for (auto &[key, commit_seq] : stripe.latest) {
+    commit_seqs.push_back(commit_seq);
+  }
+  auto mid = commit_seqs.begin() + commit_seqs.size() / 2;
+  std::nth_element(commit_seqs.begin(), mid, commit_seqs.end());
+  uint64_t cutoff = *mid;
+  std::erase_if(stripe.latest, [&stripe, cutoff](auto &entry) {
+    if (entry.second <= cutoff) {
+      stripe.evicted_max = std::max(stripe.evicted_max, entry.second);
+      return true;
+    }
+    return false;
+  });
+}
+
+void ConflictTable::shrink_recent(Stripe &stripe) {
+  // 与 shrink 相同, 先清理早于全部活跃事务开始的提交
+  if (watermark_callback_) {
+    uint64_t watermark = watermark_callback_();
+    while (!stripe.recent.empty() && stripe.recent.front().first <= watermark) {
+      stripe.recent.pop_front();
+    }
+    if (stripe.recent_evicted_max <= watermark) {
+      stripe.recent_evicted_max = 0;
+    }
+  }
+  if (stripe.recent.size() * 4 <= stripe_capacity_ * 3) {
+    return;
+  }
+  // 长事务导致无法清理时, 淘汰较旧的一半
+  auto mid = stripe.recent.begin() + stripe.recent.size() / 2;
+  stripe.recent_evicted_max =
+      std::max(stripe.recent_evicted_max, std::prev(mid)->first);
+  stripe.recent.erase(stripe.recent.begin(), mid);
+}
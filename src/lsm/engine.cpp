@@ -1,342 +1,1007 @@
 #include "../../include/lsm/engine.h"
 #include "../../include/consts.h"
+#include "../../include/lsm/compact_iterator.h"
 #include "../../include/lsm/level_iterator.h"
 #include "../../include/sst/concact_iterator.h"
 #include "../../include/sst/sst.h"
 #include "../../include/sst/sst_iterator.h"
+#include "../../include/utils/hash.h"
+#include "../../include/utils/perf_context.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <exception>
 #include <filesystem>
+#include <future>
+#include <iomanip>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
+#include <span>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-// *********************** LSMEngine ***********************
-LSMEngine::LSMEngine(std::string path) : data_dir(path) {
-  // 初始化 block_cahce
-  block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
-                                             LSMmm_BLOCK_CACHE_K);
-
-  // 创建数据目录
-  if (!std::filesystem::exists(path)) {
-    std::filesystem::create_directory(path);
-  } else {
-    // 如果目录存在，则检查是否有 sst 文件并加载
-    for (const auto &entry : std::filesystem::directory_iterator(path)) {
-      if (!entry.is_regular_file()) {
-        continue;
+namespace {
+
+using BatchGetResults = std::vector<
+    std::pair<std::string, std::optional<std::pair<std::string, uint64_t>>>>;
+
+// get_batch 在 sst 中查询的状态
+// pending 为还没有找到的 key 在 keys 中的下标, 按 key 升序排列且互不重复,
+// pending_keys / pending_hashes / pending_covering 与 pending 一一对应
+// pending_covering 为已经查询过的数据源中覆盖该 key 的范围删除标记的最大
+// tranc_id, 之后找到的更旧的版本会被其删除
+struct BatchGetState {
+  const std::vector<std::string> &keys;
+  uint64_t tranc_id;
+  BatchGetResults &results;
+  Statistics *stats;
+  std::vector<size_t> pending;
+  std::vector<std::string_view> pending_keys;
+  std::vector<uint64_t> pending_hashes;
+  std::vector<uint64_t> pending_covering;
+};
+
+// 在一个 sorted run (一个 l0 的 sst, 或者其他 level 的全部 sst) 中批量查询
+// pending 中的 key, 找到的记录 (包括删除标记) 写入 results 并从 pending 中移除
+// 1. key 和 run 中的 sst 都有序, 用只向后移动的游标归并, 确定每个 sst 中的 key
+// 2. 每个 sst 中的 key 一次经过过滤器, 之后按 (sst, block) 分组
+// 3. 缓存池中没有的 block 一次性提交读取, 每个读取完成时,
+//    立即在其中查询这一组 key, 每个 block 只读取和查询一次
+void batch_get_run(std::span<const std::shared_ptr<SST>> run,
+                   BatchGetState &state) {
+  // 一组位于同一个 block 的 key, 为 pending 中 [begin, end) 的部分
+  struct BlockRead {
+    SST *sst;
+    size_t block_idx;
+    size_t begin;
+    size_t end;
+  };
+  auto &pending = state.pending;
+  std::vector<uint8_t> may_match(pending.size(), 0);
+  std::vector<uint8_t> found(pending.size(), 0);
+  std::vector<BlockRead> reads;
+
+  size_t sst_pos = 0;
+  size_t i = 0;
+  // 相邻的 sst 可能首尾相接, 首尾相接的 key 属于后一个 sst
+  auto before_next_sst = [&](size_t pos, std::string_view key) {
+    return pos + 1 == run.size() || key < run[pos + 1]->get_first_key();
+  };
+  while (i < pending.size() && sst_pos < run.size()) {
+    auto &sst = run[sst_pos];
+    auto &last_key = sst->get_last_key();
+    if (!sst->visible_to(state.tranc_id)) {
+      sst_pos++;
+      continue;
+    }
+    if (last_key < state.pending_keys[i] ||
+        !before_next_sst(sst_pos, state.pending_keys[i])) {
+      sst_pos++;
+      continue;
+    }
+    if (state.pending_keys[i] < sst->get_first_key()) {
+      i++;
+      continue;
+    }
+    // [i, j) 为落在这个 sst 范围内的 key
+    size_t j = i + 1;
+    while (j < pending.size() && state.pending_keys[j] <= last_key &&
+           before_next_sst(sst_pos, state.pending_keys[j])) {
+      j++;
+    }
+    perf_count(&PerfContext::sst_checked);
+    if (auto range_dels = sst->get_range_tombstones()) {
+      for (size_t k = i; k < j; k++) {
+        state.pending_covering[k] =
+            std::max(state.pending_covering[k],
+                     range_dels->max_covering(state.pending_keys[k],
+                                              state.tranc_id));
       }
-
-      std::string filename = entry.path().filename().string();
-      // SST文件名格式为: sst_{id}.level
-      if (!filename.starts_with("sst_")) {
+    }
+    sst->filter_batch(std::span(state.pending_keys).subspan(i, j - i),
+                      std::span(state.pending_hashes).subspan(i, j - i),
+                      may_match.data() + i, state.stats);
+    for (size_t k = i; k < j; k++) {
+      if (!may_match[k]) {
         continue;
       }
-
-      // 找到 . 的位置
-      size_t dot_pos = filename.find('.');
-      if (dot_pos == std::string::npos || dot_pos == filename.length() - 1) {
+      size_t block_idx = sst->lower_bound_block_idx(state.keys[pending[k]]);
+      if (block_idx >= sst->num_blocks()) {
+        may_match[k] = 0;
         continue;
       }
+      if (!reads.empty() && reads.back().sst == sst.get() &&
+          reads.back().block_idx == block_idx) {
+        reads.back().end = k + 1;
+      } else {
+        reads.push_back(BlockRead{sst.get(), block_idx, k, k + 1});
+      }
+    }
+    i = j;
+    sst_pos++;
+  }
 
-      // 提取 level
-      std::string level_str =
-          filename.substr(dot_pos + 1, filename.length() - 1 - dot_pos);
-      if (level_str.empty()) {
+  auto search_block = [&](const BlockRead &read,
+                          const std::shared_ptr<Block> &block) {
+    std::string entry_key;
+    for (size_t k = read.begin; k < read.end; k++) {
+      if (!may_match[k]) {
         continue;
       }
-      size_t level = std::stoull(level_str);
-
-      // 提取SST ID
-      std::string id_str = filename.substr(4, dot_pos - 4); // 4 for "sst_"
-      if (id_str.empty()) {
+      size_t key_idx = pending[k];
+      auto idx = block->get_idx_binary(state.keys[key_idx], state.tranc_id);
+      if (!idx.has_value()) {
+        // 没有可见的版本, 继续在更旧的 run 中查找
         continue;
       }
-      size_t sst_id = std::stoull(id_str);
+      found[k] = 1;
+      if (read.sst->has_filter()) {
+        state.stats->record_tick(Ticker::BloomTruePositive);
+      }
+      auto entry = block->get_entry_view_at(idx.value(), entry_key, false);
+      entry.tranc_id = read.sst->resolve_tranc_id(entry.tranc_id);
+      auto &value = state.results[key_idx].second;
+      if (entry.value.empty() || state.pending_covering[k] > entry.tranc_id) {
+        // 空值表示被删除
+        value = std::nullopt;
+      } else if (entry.blob_index) {
+        value = std::make_pair(read.sst->read_blob(std::string(entry.value)),
+                               state.tranc_id);
+      } else {
+        value = std::make_pair(std::string(entry.value), state.tranc_id);
+      }
+    }
+  };
+
+  // 缓存命中的 block 直接查询, 其余的请求加入同一批次
+  IoBatch batch;
+  std::vector<size_t> request_reads; // 请求编号 -> reads 的下标
+  std::vector<size_t> mapped_reads;  // mmap 读取的 block, 只发起了预读
+  for (size_t r = 0; r < reads.size(); r++) {
+    size_t request;
+    auto block =
+        reads[r].sst->submit_block_read(reads[r].block_idx, batch, request);
+    if (block != nullptr) {
+      search_block(reads[r], block);
+    } else if (request == SIZE_MAX) {
+      mapped_reads.push_back(r);
+    } else {
+      request_reads.resize(request + 1);
+      request_reads[request] = r;
+    }
+  }
+  batch.submit();
+  for (size_t r : mapped_reads) {
+    search_block(reads[r], reads[r].sst->complete_block_read(
+                               reads[r].block_idx, batch, SIZE_MAX));
+  }
+  size_t request;
+  while ((request = batch.wait_any()) != SIZE_MAX) {
+    auto &read = reads[request_reads[request]];
+    search_block(read,
+                 read.sst->complete_block_read(read.block_idx, batch, request));
+  }
 
-      // 加载SST文件, 初始化时需要加写锁
-      std::unique_lock<std::shared_mutex> lock(ssts_mtx); // 写锁
+  // 移除已经找到的 key, 保持剩余的 key 有序
+  size_t kept = 0;
+  for (size_t k = 0; k < pending.size(); k++) {
+    if (!found[k]) {
+      pending[kept] = pending[k];
+      state.pending_keys[kept] = state.pending_keys[k];
+      state.pending_hashes[kept] = state.pending_hashes[k];
+      state.pending_covering[kept] = state.pending_covering[k];
+      kept++;
+    }
+  }
+  pending.resize(kept);
+  state.pending_keys.resize(kept);
+  state.pending_hashes.resize(kept);
+  state.pending_covering.resize(kept);
+}
 
-      next_sst_id = std::max(sst_id, next_sst_id);    // 记录目前最大的 sst_id
-      cur_max_level = std::max(level, cur_max_level); // 记录目前最大的 level
-      std::string sst_path = get_sst_path(sst_id, level);
-      auto sst = SST::open(sst_id, FileObj::open(sst_path, false), block_cache);
-      ssts[sst_id] = sst;
+// 从 sst_{id}.level 格式的文件名中解析出 {sst_id, level}
+std::optional<std::pair<size_t, size_t>>
+parse_sst_filename(const std::string &filename) {
+  if (!filename.starts_with("sst_")) {
+    return std::nullopt;
+  }
+  size_t dot_pos = filename.find('.');
+  if (dot_pos == std::string::npos || dot_pos == 4 ||
+      dot_pos == filename.length() - 1) {
+    return std::nullopt;
+  }
+  std::string id_str = filename.substr(4, dot_pos - 4); // 4 for "sst_"
+  std::string level_str = filename.substr(dot_pos + 1);
+  auto is_digits = [](const std::string &str) {
+    return std::all_of(str.begin(), str.end(),
+                       [](char c) { return c >= '0' && c <= '9'; });
+  };
+  if (!is_digits(id_str) || !is_digits(level_str)) {
+    return std::nullopt;
+  }
+  return std::make_pair(std::stoull(id_str), std::stoull(level_str));
+}
 
-      level_sst_ids[level].push_back(sst_id);
-    }
+// memtable 中找到的记录, value 为空或者被 tranc_id 更大的范围删除标记覆盖
+// (covering 为覆盖它的标记的最大 tranc_id) 表示被删除了
+std::optional<std::pair<std::string, uint64_t>>
+mem_result(const SkipListIterator &iter, uint64_t covering) {
+  if (iter.get_value().empty() || covering > iter.get_tranc_id()) {
+    return std::nullopt;
+  }
+  return std::pair<std::string, uint64_t>{iter.get_value(),
+                                          iter.get_tranc_id()};
+}
+} // namespace
+
+std::shared_ptr<const FragmentedRangeTombstones> merge_range_tombstones(
+    const std::vector<std::shared_ptr<const FragmentedRangeTombstones>> &sets) {
+  if (sets.empty()) {
+    return nullptr;
+  }
+  if (sets.size() == 1) {
+    return sets.front();
+  }
+  std::vector<RangeTombstone> tombstones;
+  for (auto &set : sets) {
+    tombstones.insert(tombstones.end(), set->tombstones().begin(),
+                      set->tombstones().end());
+  }
+  return std::make_shared<const FragmentedRangeTombstones>(
+      std::move(tombstones));
+}
+
+// *********************** EngineStats ***********************
+uint64_t EngineStats::ticker(Ticker ticker) const {
+  return tickers[static_cast<size_t>(ticker)];
+}
 
-    next_sst_id++; // 现有的最大 sst_id 自增后才是下一个分配的 sst_id
+const HistogramData &EngineStats::histogram(HistogramType type) const {
+  return histograms[static_cast<size_t>(type)];
+}
 
-    for (auto &[level, sst_id_list] : level_sst_ids) {
-      std::sort(sst_id_list.begin(), sst_id_list.end());
-      if (level == 0) {
-        // 其他 level 的 sst 都是没有重叠的, 且 id 小的表示 key
-        // 排序在前面的部分, 不需要 reverse
-        std::reverse(sst_id_list.begin(), sst_id_list.end());
-      }
-    }
+uint64_t EngineStats::bloom_false_positive() const {
+  uint64_t positive = ticker(Ticker::BloomFullPositive);
+  uint64_t true_positive = ticker(Ticker::BloomTruePositive);
+  // 两个计数器分别汇总, 并发写入时可能短暂地不一致
+  return positive > true_positive ? positive - true_positive : 0;
+}
+
+std::string EngineStats::to_string() const {
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  oss << "# Memtable\r\n";
+  oss << "memtable_bytes:" << memtable_bytes << "\r\n";
+  oss << "frozen_memtable_bytes:" << frozen_memtable_bytes << "\r\n";
+  oss << "\r\n# BlockCache\r\n";
+  oss << "block_cache_usage:" << block_cache_usage << "\r\n";
+  oss << "block_cache_hit_rate:" << block_cache_hit_rate << "\r\n";
+  oss << "row_cache_usage:" << row_cache_usage << "\r\n";
+  oss << "\r\n# Levels\r\n";
+  for (auto &level : levels) {
+    oss << "level" << level.level << ":ssts=" << level.num_ssts
+        << ",bytes=" << level.bytes << "\r\n";
+  }
+  oss << "\r\n# Stats\r\n";
+  for (size_t i = 0; i < kTickerNum; i++) {
+    oss << Statistics::ticker_name(static_cast<Ticker>(i)) << ":"
+        << tickers[i] << "\r\n";
+  }
+  oss << "bloom_false_positive:" << bloom_false_positive() << "\r\n";
+  oss << "\r\n# Latency\r\n";
+  for (size_t i = 0; i < kHistogramNum; i++) {
+    auto &hist = histograms[i];
+    oss << Statistics::histogram_name(static_cast<HistogramType>(i))
+        << ":count=" << hist.count << ",mean=" << hist.mean()
+        << ",p50=" << hist.percentile(50) << ",p95=" << hist.percentile(95)
+        << ",p99=" << hist.percentile(99) << ",p999=" << hist.percentile(99.9)
+        << ",max=" << hist.max << "\r\n";
   }
+  return oss.str();
 }
 
-LSMEngine::~LSMEngine() = default;
+// *********************** LSMEngine ***********************
+namespace {
+Options make_options(CompactType compact_type,
+                     std::shared_ptr<PrefixExtractor> prefix_extractor,
+                     std::shared_ptr<MergeOperator> merge_operator,
+                     std::shared_ptr<CompactionFilter> compaction_filter) {
+  Options options;
+  options.compact_type = compact_type;
+  options.prefix_extractor = std::move(prefix_extractor);
+  options.merge_operator = std::move(merge_operator);
+  options.compaction_filter = std::move(compaction_filter);
+  return options;
+}
+
+const Options &validated(const Options &options) {
+  options.validate();
+  return options;
+}
+} // namespace
+
+LSMEngine::LSMEngine(std::string path, CompactType compact_type,
+                     std::shared_ptr<PrefixExtractor> prefix_extractor,
+                     std::shared_ptr<MergeOperator> merge_operator,
+                     std::shared_ptr<CompactionFilter> compaction_filter)
+    : LSMEngine(std::move(path),
+                make_options(compact_type, std::move(prefix_extractor),
+                             std::move(merge_operator),
+                             std::move(compaction_filter))) {}
+
+LSMEngine::LSMEngine(std::string path, const Options &options)
+    : data_dir(path), options(validated(options)),
+      memtable(options.per_mem_size_limit), compact_type(options.compact_type),
+      prefix_extractor(options.prefix_extractor),
+      merge_operator(options.merge_operator),
+      compaction_filter(options.compaction_filter),
+      mutable_options_(std::make_shared<const MutableOptions>(options)) {
+  // 初始化 block_cahce, 共用缓存时使用独立的编号区分各个引擎的 sst
+  if (options.block_cache != nullptr) {
+    block_cache = options.block_cache->share();
+  } else {
+    block_cache = std::make_shared<BlockCache>(
+        options.block_cache_capacity, options.block_cache_k,
+        options.block_cache_shard_bits, options.block_cache_meta);
+  }
+
+  if (options.row_cache_capacity > 0) {
+    row_cache = std::make_unique<RowCache>(options.row_cache_capacity,
+                                           options.row_cache_shard_bits);
+  }
+
+  blob_store = std::make_shared<BlobStore>(path);
+
+  // 创建数据目录
+  if (!std::filesystem::exists(path)) {
+    std::filesystem::create_directory(path);
+  }
+  // 根据 MANIFEST 恢复每一层包含的 sst
+  recover_version();
+  if (row_cache != nullptr) {
+    // 上次运行写入的版本都已经在 sst 中, 比其更旧的读取不能填充行缓存
+    row_cache->clear(flushed_tranc_id.load());
+  }
+
+  compact_pool = std::make_unique<ThreadPool>(options.max_subcompactions);
+  bg_pool = std::make_unique<ThreadPool>(options.bg_thread_num);
+  if (options.write_buffer_manager != nullptr) {
+    write_buffer_member = options.write_buffer_manager->add_member([this]() {
+      flush_requested = true;
+      schedule_flush_if_needed();
+    });
+  }
+  // 上次关闭时可能还有没完成的 compact
+  schedule_compact_if_needed();
+}
+
+LSMEngine::~LSMEngine() {
+  // 不再执行新的后台任务, 正在执行的任务会正常完成
+  bg_stop = true;
+  stall_cv.notify_all();
+  bg_pool.reset();
+  compact_pool.reset();
+  // 后台任务结束后才能注销, 否则其中的 flush 会再次报告内存表的大小
+  // 注销之后 WriteBufferManager 不会再从其他引擎的写入线程中调用当前引擎
+  if (write_buffer_member != nullptr) {
+    options.write_buffer_manager->remove_member(write_buffer_member);
+  }
+}
 
 std::optional<std::pair<std::string, uint64_t>>
 LSMEngine::get(const std::string &key, uint64_t tranc_id) {
-  // 1. 先查找 memtable
-  auto mem_res = memtable.get(key, tranc_id);
+  StopWatch watch(stats.get(), HistogramType::Get);
+  PerfTimer get_timer(&PerfContext::get_nanos);
+  // 1. 先查找 memtable, 其中的范围删除标记同时作用于 sst 中的版本
+  // 行缓存的版本号需要在查找 memtable 之前读取, 之后的写入会使插入失效
+  uint64_t row_seq = row_cache != nullptr ? row_cache->sequence(key) : 0;
+  SkipListIterator mem_res;
+  uint64_t covering;
+  {
+    PerfTimer timer(&PerfContext::memtable_get_nanos);
+    mem_res = memtable.get(key, tranc_id);
+    covering = memtable.range_del_covering(key, tranc_id);
+  }
   if (mem_res.is_valid()) {
-    if (mem_res.get_value().size() > 0) {
-      // 值存在且不为空（没有被删除）
-      return std::pair<std::string, uint64_t>{mem_res.get_value(),
-                                              mem_res.get_tranc_id()};
-    } else {
-      // memtable返回的kv的value为空值表示被删除了
-      return std::nullopt;
+    stats->record_tick(Ticker::GetHitMemtable);
+    if (mem_res.is_merge_operand() && covering <= mem_res.get_tranc_id()) {
+      // 内存表需要先于 Version 获取
+      auto mem_tables = memtable.get_tables();
+      return merge_get_(key, tranc_id, mem_tables, *current_version());
     }
+    return mem_result(mem_res, covering);
   }
 
-  // 2. l0 sst中查询
-  std::shared_lock<std::shared_mutex> rlock(ssts_mtx); // 读锁
+  // 2. 再查找行缓存, 内存表中的范围删除标记可能覆盖缓存的版本, 此时跳过
+  if (row_cache != nullptr && covering == 0) {
+    if (auto cached = row_cache->lookup(key, tranc_id)) {
+      stats->record_tick(Ticker::GetHitRowCache);
+      return cached;
+    }
+  }
 
-  for (auto &sst_id : level_sst_ids[0]) {
-    //  中的 sst_id 是按从大到小的顺序排列,
-    // sst_id 越大, 表示是越晚刷入的, 优先查询
-    auto &sst = ssts[sst_id];
-    auto sst_iterator = sst->get(key, tranc_id);
-    if (sst_iterator != sst->end()) {
-      if ((sst_iterator)->second.size() > 0) {
-        // 值存在且不为空（没有被删除）
-        return std::pair<std::string, uint64_t>{sst_iterator->second,
-                                                sst_iterator.get_tranc_id()};
-      } else {
-        // 空值表示被删除了
-        return std::nullopt;
-      }
-    }
-  }
-
-  // 3. 其他level的sst中查询
-  for (size_t level = 1; level <= cur_max_level; level++) {
-    std::deque<size_t> l_sst_ids = level_sst_ids[level];
-    // 二分查询
-    size_t left = 0;
-    size_t right = l_sst_ids.size();
-    while (left < right) {
-      size_t mid = left + (right - left) / 2;
-      auto &sst = ssts[l_sst_ids[mid]];
-      if (sst->get_first_key() <= key && key <= sst->get_last_key()) {
-        // 如果sst_id在中, 则在sst中查询
-        auto sst_iterator = sst->get(key, tranc_id);
-        if (sst_iterator.is_valid()) {
-          if ((sst_iterator)->second.size() > 0) {
-            // 值存在且不为空（没有被删除）
-            return std::pair<std::string, uint64_t>{
-                sst_iterator->second, sst_iterator.get_tranc_id()};
-          } else {
-            // 空值表示被删除了
-            return std::nullopt;
-          }
-        } else {
-          break;
-        }
-      } else if (sst->get_last_key() < key) {
-        left = mid + 1;
-      } else {
-        right = mid;
-      }
+  // 3. 最后查找 sst, 之后只访问这一个 Version, 不需要加锁
+  auto res = version_get_(key, tranc_id, *current_version(), covering, true);
+  if (row_cache != nullptr && covering == 0 && res.has_value()) {
+    row_cache->insert(key, res->first, res->second, tranc_id, row_seq);
+  }
+  return res;
+}
+
+std::optional<std::pair<std::string, uint64_t>>
+LSMEngine::get(const std::string &key, const Snapshot &snapshot) {
+  StopWatch watch(stats.get(), HistogramType::Get);
+  PerfTimer get_timer(&PerfContext::get_nanos);
+  const auto &mem_tables = snapshot.get_mem_tables();
+  SkipListIterator mem_res;
+  uint64_t covering;
+  {
+    PerfTimer timer(&PerfContext::memtable_get_nanos);
+    mem_res = MemTable::tables_get(mem_tables, key, snapshot.get_tranc_id());
+    covering = MemTable::tables_range_del_covering(mem_tables, key,
+                                                   snapshot.get_tranc_id());
+  }
+  if (mem_res.is_valid()) {
+    stats->record_tick(Ticker::GetHitMemtable);
+    if (mem_res.is_merge_operand() && covering <= mem_res.get_tranc_id()) {
+      return merge_get_(key, snapshot.get_tranc_id(), mem_tables,
+                        *snapshot.get_version());
     }
+    return mem_result(mem_res, covering);
   }
+  return version_get_(key, snapshot.get_tranc_id(), *snapshot.get_version(),
+                      covering, true);
+}
 
-  return std::nullopt;
+std::shared_ptr<const Snapshot> LSMEngine::get_snapshot(uint64_t tranc_id) {
+  // ! 必须先获取内存表再获取 Version: 两者之间完成的 flush 只会使数据
+  // ! 同时出现在内存表和 sst 中, 反过来则可能两边都查不到刚刷盘的数据
+  auto mem_tables = memtable.get_tables();
+  auto version = current_version();
+  return snapshots->acquire(tranc_id, std::move(mem_tables),
+                            std::move(version));
 }
 
 std::vector<
     std::pair<std::string, std::optional<std::pair<std::string, uint64_t>>>>
 LSMEngine::get_batch(const std::vector<std::string> &keys, uint64_t tranc_id) {
+  StopWatch watch(stats.get(), HistogramType::MultiGet);
   // 1. 先从 memtable 中批量查找
   auto results = memtable.get_batch(keys, tranc_id);
 
-  // 2. 如果所有键都在memtable 中找到，直接返回
-  bool need_search_sst = false;
-  for (const auto &[key, value] : results) {
+  // 内存表中找到的 key (包括删除标记) 以内存表为准, 不需要再查询 sst
+  // 内存表中没有范围删除标记时 covering 全部为 0
+  std::vector<uint64_t> covering(keys.size(), 0);
+  for (size_t idx = 0; idx < keys.size(); idx++) {
+    covering[idx] = memtable.range_del_covering(keys[idx], tranc_id);
+  }
+  // 内存表需要先于 Version 获取, 避免漏掉两者之间刷盘的数据
+  std::vector<std::shared_ptr<SkipList>> mem_tables;
+  if (memtable.has_merge_operands()) {
+    mem_tables = memtable.get_tables();
+  }
+  auto version = current_version();
+  BatchGetState state{keys, tranc_id, results, stats.get()};
+  for (size_t idx = 0; idx < results.size(); idx++) {
+    auto &value = results[idx].second;
     if (!value.has_value()) {
-      // 需要查找
-      need_search_sst = true;
+      state.pending.push_back(idx);
+    } else if (value->first.empty() || covering[idx] > value->second) {
+      // 空值或者被范围删除标记覆盖表示被删除
+      value = std::nullopt;
+    } else if (!mem_tables.empty() &&
+               MemTable::tables_get(mem_tables, keys[idx], tranc_id)
+                   .is_merge_operand()) {
+      value = merge_get_(keys[idx], tranc_id, mem_tables, *version);
+    }
+  }
+  if (state.pending.empty()) {
+    return results; // 不需要查sst
+  }
+
+  // 2. 剩余的 key 排序一次, 相同的 key 只查询一次, 最后复制结果
+  auto &pending = state.pending;
+  std::stable_sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+    return keys[a] < keys[b];
+  });
+  std::vector<std::pair<size_t, size_t>> duplicates; // (重复的 key, 查询的 key)
+  size_t unique = 0;
+  for (size_t k = 0; k < pending.size(); k++) {
+    if (unique > 0 && keys[pending[k]] == keys[pending[unique - 1]]) {
+      duplicates.emplace_back(pending[k], pending[unique - 1]);
+    } else {
+      pending[unique++] = pending[k];
+    }
+  }
+  pending.resize(unique);
+  state.pending_keys.reserve(unique);
+  state.pending_hashes.reserve(unique);
+  state.pending_covering.reserve(unique);
+  for (size_t key_idx : pending) {
+    state.pending_keys.emplace_back(keys[key_idx]);
+    state.pending_hashes.push_back(hash64(keys[key_idx]));
+    state.pending_covering.push_back(covering[key_idx]);
+  }
+
+  // 3. 按从新到旧的顺序逐个 sorted run 查询
+  // l0 中的 sst 之间有重叠, 每个 sst 单独作为一个 run
+  auto &l0_ssts = version->level_ssts(0);
+  for (size_t i = 0; i < l0_ssts.size() && !pending.empty(); i++) {
+    batch_get_run(std::span(&l0_ssts[i], 1), state);
+  }
+
+  // 4. 其他层级的 sst 互不重叠, 每个 level 是一个 run
+  for (auto &[level, l_ssts] : version->levels()) {
+    if (pending.empty()) {
       break;
     }
+    if (level == 0) {
+      continue;
+    }
+    batch_get_run(l_ssts, state);
   }
 
-  if (!need_search_sst) {
-    return results; // 不需要查sst
+  for (auto [dup, src] : duplicates) {
+    results[dup].second = results[src].second;
   }
+  return results;
+}
 
-  // 2. 从 L0 层 SST 文件中批量查找未命中的键
-  std::shared_lock<std::shared_mutex> rlock(ssts_mtx); // 加读锁
-  for (auto &[key, value] : results) {
-    for (auto &sst_id : level_sst_ids[0]) {
-      auto &sst = ssts[sst_id];
-      auto sst_iterator = sst->get(key, tranc_id);
+std::optional<std::pair<std::string, uint64_t>>
+LSMEngine::sst_get_(const std::string &key, uint64_t tranc_id) {
+  return version_get_(key, tranc_id, *current_version());
+}
+
+std::optional<std::pair<std::string, uint64_t>>
+LSMEngine::version_get_(const std::string &key, uint64_t tranc_id,
+                        const Version &version, uint64_t covering,
+                        bool record_get) {
+  // 找到的版本被已经查询过的数据源中 tranc_id 更大的范围删除标记覆盖时,
+  // 同样视为被删除
+  auto sst_result = [&covering](SstIterator &sst_iterator)
+      -> std::optional<std::pair<std::string, uint64_t>> {
+    if (sst_iterator->second.empty() ||
+        covering > sst_iterator.get_entry_tranc_id()) {
+      // 空值表示被删除了
+      return std::nullopt;
+    }
+    // 值存在且不为空（没有被删除）
+    return std::pair<std::string, uint64_t>{sst_iterator->second,
+                                            sst_iterator.get_tranc_id()};
+  };
+
+  // 查询结束时记录检查过的 sst 数量和命中的层级, level 为空表示没有找到
+  size_t sst_probes = 0;
+  auto record = [&](std::optional<size_t> level) {
+    if (!record_get) {
+      return;
+    }
+    stats->record(HistogramType::SstPerGet, sst_probes);
+    if (!level.has_value()) {
+      stats->record_tick(Ticker::GetMiss);
+    } else {
+      stats->record_tick(level == 0   ? Ticker::GetHitL0
+                         : level == 1 ? Ticker::GetHitL1
+                                      : Ticker::GetHitL2AndUp);
+    }
+  };
+
+  {
+    PerfTimer timer(&PerfContext::get_from_l0_nanos);
+    for (auto &sst : version.level_ssts(0)) {
+      // l0 中的 sst 是按 sst_id 从大到小的顺序排列,
+      // sst_id 越大, 表示是越晚刷入的, 优先查询
+      covering = std::max(covering, sst->range_del_covering(key, tranc_id));
+      if (key < sst->get_first_key() || key > sst->get_last_key()) {
+        continue;
+      }
+      sst_probes++;
+      perf_count(&PerfContext::sst_checked);
+      auto sst_iterator = sst->get(key, tranc_id, stats.get());
       if (sst_iterator != sst->end()) {
-        if (sst_iterator->second.size() > 0) {
-          // 值存在且不为空
-          value =
-              std::make_pair(sst_iterator->second, sst_iterator.get_tranc_id());
-        } else {
-          // 空值表示被删除
-          value = std::nullopt;
-        }
-        break; // 停止继续查找
+        record(0);
+        return sst_result(sst_iterator);
       }
     }
   }
 
-  // 3. 从其他层级 SST 文件中批量查找未命中的键
-  for (size_t level = 1; level <= cur_max_level; level++) {
-    std::deque<size_t> l_sst_ids = level_sst_ids[level];
+  // 2. 其他level的sst中查询, 每一层只有一个 sst 可能包含 key
+  PerfTimer timer(&PerfContext::get_from_levels_nanos);
+  for (auto &[level, l_ssts] : version.levels()) {
+    if (level == 0) {
+      continue;
+    }
+    auto sst = version.find_level_sst(level, key);
+    if (sst == nullptr) {
+      continue;
+    }
+    covering = std::max(covering, sst->range_del_covering(key, tranc_id));
+    sst_probes++;
+    perf_count(&PerfContext::sst_checked);
+    auto sst_iterator = sst->get(key, tranc_id, stats.get());
+    if (sst_iterator.is_valid()) {
+      record(level);
+      return sst_result(sst_iterator);
+    }
+  }
 
-    for (auto &[key, value] : results) {
-      if (value.has_value()) // 已找到，跳过
-      {
-        continue;
-      }
+  record(std::nullopt);
+  return std::nullopt;
+}
 
-      // 二分查找确定键可能所在的 SST 文件
-      size_t left = 0;
-      size_t right = l_sst_ids.size();
-      while (left < right) {
-        size_t mid = left + (right - left) / 2;
-        auto &sst = ssts[l_sst_ids[mid]];
-
-        if (sst->get_first_key() <= key && key <= sst->get_last_key()) {
-          // 如果键在当前 SST 文件范围内，则在 SST 中查找
-          auto sst_iterator = sst->get(key, tranc_id);
-          if (sst_iterator.is_valid()) {
-            if (sst_iterator->second.size() > 0) {
-              // 值存在且不为空
-              value = std::make_pair(sst_iterator->second,
-                                     sst_iterator.get_tranc_id());
-            } else {
-              // 空值表示被删除
-              value = std::nullopt;
-            }
-          }
-          break; // 停止继续查找
-        } else if (sst->get_last_key() < key) {
-          left = mid + 1;
-        } else {
-          right = mid;
+std::optional<std::pair<std::string, uint64_t>>
+LSMEngine::merge_get_(const std::string &key, uint64_t tranc_id,
+                      const std::vector<std::shared_ptr<SkipList>> &tables,
+                      const Version &version) {
+  uint64_t covering =
+      MemTable::tables_range_del_covering(tables, key, tranc_id);
+  // 1. 从新到旧收集操作数, 直到遇到完整的 value, 删除标记或者被范围删除覆盖
+  std::vector<std::string> operands; // 从新到旧
+  std::optional<std::string> base;
+  bool base_found = false;
+  uint64_t result_tranc_id = 0;
+  for (auto &table : tables) {
+    for (auto iter = table->get(key, tranc_id);
+         iter.is_valid() && iter.key() == key; ++iter) {
+      if (covering > iter.get_tranc_id()) {
+        base_found = true;
+        break;
+      }
+      if (result_tranc_id == 0) {
+        result_tranc_id = iter.get_tranc_id();
+      }
+      if (!iter.is_merge_operand()) {
+        base_found = true;
+        if (!iter.value().empty()) {
+          base = iter.get_value();
         }
+        break;
+      }
+      operands.push_back(iter.get_value());
+    }
+    if (base_found) {
+      break;
+    }
+  }
+  // 2. 内存表中没有基础值时, 在 sst 中查询更旧的版本
+  if (!base_found) {
+    auto sst_res = version_get_(key, tranc_id, version, covering);
+    if (sst_res.has_value()) {
+      base = std::move(sst_res->first);
+      if (result_tranc_id == 0) {
+        result_tranc_id = sst_res->second;
       }
     }
   }
 
-  return results;
+  std::optional<std::string> result;
+  if (operands.empty()) {
+    result = std::move(base);
+  } else {
+    std::vector<std::string_view> views(operands.rbegin(), operands.rend());
+    result = full_merge_(key, base, views);
+  }
+  if (!result.has_value()) {
+    return std::nullopt;
+  }
+  return std::make_pair(std::move(result.value()), result_tranc_id);
 }
 
-std::optional<std::pair<std::string, uint64_t>>
-LSMEngine::sst_get_(const std::string &key, uint64_t tranc_id) {
+std::optional<std::string>
+LSMEngine::full_merge_(const std::string &key,
+                       const std::optional<std::string> &base,
+                       const std::vector<std::string_view> &operands) const {
+  if (merge_operator == nullptr) {
+    throw std::runtime_error("merge operand found without a merge operator");
+  }
+  std::optional<std::string_view> existing;
+  if (base.has_value()) {
+    existing = base.value();
+  }
+  std::string merged;
+  if (!merge_operator->full_merge(key, existing, operands, merged)) {
+    // 无法合并的操作数被忽略
+    return base;
+  }
+  if (merged.empty()) {
+    return std::nullopt;
+  }
+  return merged;
+}
 
-  // 1. l0 sst中查询
-  for (auto &sst_id : level_sst_ids[0]) {
-    //  中的 sst_id 是按从大到小的顺序排列,
-    // sst_id 越大, 表示是越晚刷入的, 优先查询
-    auto sst = ssts[sst_id];
-    auto sst_iterator = sst->get(key, tranc_id);
-    if (sst_iterator != sst->end()) {
-      if ((sst_iterator)->second.size() > 0) {
-        // 值存在且不为空（没有被删除）
-        return std::pair<std::string, uint64_t>{sst_iterator->second,
-                                                sst_iterator.get_tranc_id()};
-      } else {
-        // 空值表示被删除了
-        return std::nullopt;
-      }
-    }
-  }
-
-  // 2. 其他level的sst中查询
-  for (size_t level = 1; level <= cur_max_level; level++) {
-    std::deque<size_t> l_sst_ids = level_sst_ids[level];
-    // 二分查询
-    size_t left = 0;
-    size_t right = l_sst_ids.size();
-    while (left < right) {
-      size_t mid = left + (right - left) / 2;
-      auto sst = ssts[l_sst_ids[mid]];
-      if (sst->get_first_key() <= key && key <= sst->get_last_key()) {
-        // 如果sst_id在中, 则在sst中查询
-        auto sst_iterator = sst->get(key, tranc_id);
-        if (sst_iterator.is_valid()) {
-          if ((sst_iterator)->second.size() > 0) {
-            // 值存在且不为空（没有被删除）
-            return std::pair<std::string, uint64_t>{
-                sst_iterator->second, sst_iterator.get_tranc_id()};
-          } else {
-            // 空值表示被删除了
-            return std::nullopt;
-          }
-        } else {
-          break;
-        }
-      } else if (sst->get_last_key() < key) {
-        left = mid + 1;
-      } else {
-        right = mid;
+std::vector<std::tuple<std::string, std::string, uint64_t>>
+LSMEngine::flush_entries_(const std::shared_ptr<SkipList> &table) {
+  if (!table->has_merge_operands()) {
+    return table->flush();
+  }
+  // 该表是最老的内存表, 更旧的版本都已经位于 sst 中
+  auto version = current_version();
+  auto range_dels = table->get_range_tombstones();
+  struct Entry {
+    std::string value;
+    uint64_t tranc_id;
+    bool merge;
+  };
+  std::vector<std::tuple<std::string, std::string, uint64_t>> data;
+  std::vector<Entry> group; // 同一个 key 的全部版本, tranc_id 降序
+  std::string group_key;
+
+  // 按从旧到新的顺序将每个操作数合并为其所在版本的完整 value
+  auto fold_group = [&]() {
+    size_t begin = data.size();
+    std::optional<std::string> cur;
+    bool cur_known = false;
+    uint64_t cur_tranc_id = 0;
+    for (size_t i = group.size(); i-- > 0;) {
+      auto &entry = group[i];
+      if (!entry.merge) {
+        cur_known = true;
+        cur_tranc_id = entry.tranc_id;
+        cur = entry.value.empty() ? std::nullopt
+                                  : std::make_optional(entry.value);
+        data.emplace_back(group_key, std::move(entry.value), entry.tranc_id);
+        continue;
       }
+      uint64_t covering =
+          range_dels == nullptr
+              ? 0
+              : range_dels->max_covering(group_key, entry.tranc_id);
+      if (!cur_known) {
+        auto sst_res =
+            version_get_(group_key, entry.tranc_id, *version, covering);
+        cur = sst_res.has_value() ? std::make_optional(sst_res->first)
+                                  : std::nullopt;
+        cur_known = true;
+      } else if (covering > cur_tranc_id) {
+        cur = std::nullopt;
+      }
+      cur = full_merge_(group_key, cur, {entry.value});
+      cur_tranc_id = entry.tranc_id;
+      // 合并结果为空时写入删除标记
+      data.emplace_back(group_key, cur.value_or(""), entry.tranc_id);
+    }
+    // 恢复 tranc_id 降序
+    std::reverse(data.begin() + begin, data.end());
+    group.clear();
+  };
+
+  for (auto iter = table->begin(); iter.is_valid(); ++iter) {
+    if (!group.empty() && iter.key() != group_key) {
+      fold_group();
     }
+    if (group.empty()) {
+      group_key.assign(iter.key());
+    }
+    group.push_back(
+        Entry{iter.get_value(), iter.get_tranc_id(), iter.is_merge_operand()});
   }
-
-  return std::nullopt;
+  if (!group.empty()) {
+    fold_group();
+  }
+  return data;
 }
 
-uint64_t LSMEngine::put(const std::string &key, const std::string &value,
-                        uint64_t tranc_id) {
+void LSMEngine::put(const std::string &key, const std::string &value,
+                    uint64_t tranc_id) {
+  maybe_stall_write();
   memtable.put(key, value, tranc_id);
-
-  // 如果 memtable 太大，需要刷新到磁盘
-  if (memtable.get_total_size() >= LSM_TOL_MEM_SIZE_LIMIT) {
-    return flush();
+  if (row_cache != nullptr) {
+    row_cache->invalidate(key, tranc_id);
   }
-  return 0;
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
 }
 
-uint64_t LSMEngine::put_batch(
+void LSMEngine::put_batch(
     const std::vector<std::pair<std::string, std::string>> &kvs,
     uint64_t tranc_id) {
+  maybe_stall_write();
   memtable.put_batch(kvs, tranc_id);
-  // 如果 memtable 太大，需要刷新到磁盘
-  if (memtable.get_total_size() >= LSM_TOL_MEM_SIZE_LIMIT) {
-    return flush();
+  if (row_cache != nullptr) {
+    for (auto &[key, value] : kvs) {
+      row_cache->invalidate(key, tranc_id);
+    }
+  }
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
+}
+
+void LSMEngine::merge(const std::string &key, const std::string &operand,
+                      uint64_t tranc_id) {
+  if (merge_operator == nullptr) {
+    throw std::runtime_error("merge operator is not set");
+  }
+  maybe_stall_write();
+  memtable.merge(key, operand, tranc_id);
+  if (row_cache != nullptr) {
+    row_cache->invalidate(key, tranc_id);
+  }
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
+}
+
+void LSMEngine::fold_batch_merges(std::vector<Record> &records) const {
+  auto is_point = [](const Record &record) {
+    auto type = record.getOperationType();
+    return type == OperationType::PUT || type == OperationType::DELETE ||
+           (type == OperationType::MERGE && !record.getValue().empty());
+  };
+  bool has_merge = false;
+  for (auto &record : records) {
+    has_merge |= record.getOperationType() == OperationType::MERGE;
+  }
+  if (!has_merge) {
+    return;
+  }
+  if (merge_operator == nullptr) {
+    throw std::runtime_error("merge operator is not set");
+  }
+
+  // 每个 key 折叠后的状态, 只保留在该 key 的最后一条记录的位置
+  struct Folded {
+    size_t count = 0;
+    size_t last = 0;
+    bool known = false; // 是否存在 put / remove 作为基础值
+    std::optional<std::string> base;
+    std::vector<std::string> operands;
+  };
+  std::unordered_map<std::string, Folded> folded;
+  for (size_t i = 0; i < records.size(); i++) {
+    auto &record = records[i];
+    if (!is_point(record)) {
+      continue;
+    }
+    auto &state = folded[record.getKey()];
+    state.count++;
+    state.last = i;
+    if (record.getOperationType() == OperationType::MERGE) {
+      state.operands.push_back(record.getValue());
+      continue;
+    }
+    state.known = true;
+    state.operands.clear();
+    state.base = std::nullopt;
+    if (record.getOperationType() == OperationType::PUT &&
+        !record.getValue().empty()) {
+      state.base = record.getValue();
+    }
+  }
+
+  std::vector<Record> result;
+  result.reserve(records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    auto &record = records[i];
+    if (!is_point(record)) {
+      result.push_back(std::move(record));
+      continue;
+    }
+    auto &state = folded[record.getKey()];
+    if (state.count == 1 || state.operands.empty()) {
+      // 没有需要合并的操作数, 与之前一样以最后一条记录为准
+      if (i == state.last) {
+        result.push_back(std::move(record));
+      }
+      continue;
+    }
+    if (i != state.last) {
+      continue;
+    }
+    uint64_t tranc_id = record.getTrancId();
+    if (state.known) {
+      std::vector<std::string_view> operands(state.operands.begin(),
+                                             state.operands.end());
+      auto merged = full_merge_(record.getKey(), state.base, operands);
+      if (merged.has_value()) {
+        result.push_back(Record::putRecord(tranc_id, record.getKey(),
+                                           std::move(merged.value())));
+      } else {
+        result.push_back(Record::deleteRecord(tranc_id, record.getKey()));
+      }
+      continue;
+    }
+    std::string combined = state.operands.front();
+    for (size_t k = 1; k < state.operands.size(); k++) {
+      std::string next;
+      if (!merge_operator->partial_merge(record.getKey(), combined,
+                                         state.operands[k], next)) {
+        throw std::runtime_error(
+            "merge operands in one batch can not be combined");
+      }
+      combined = std::move(next);
+    }
+    result.push_back(
+        Record::mergeRecord(tranc_id, record.getKey(), std::move(combined)));
+  }
+  records = std::move(result);
+}
+
+void LSMEngine::write_records(const std::vector<Record> &records) {
+  maybe_stall_write();
+  memtable.apply_records(records);
+  invalidate_row_cache(records);
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
+}
+
+void LSMEngine::replay_records(const std::vector<Record> &records) {
+  memtable.apply_records(records);
+  invalidate_row_cache(records);
+}
+
+void LSMEngine::invalidate_row_cache(const std::vector<Record> &records) {
+  if (row_cache == nullptr) {
+    return;
+  }
+  for (auto &record : records) {
+    switch (record.getOperationType()) {
+    case OperationType::PUT:
+    case OperationType::DELETE:
+    case OperationType::MERGE:
+      row_cache->invalidate(record.getKey(), record.getTrancId());
+      break;
+    case OperationType::DELETE_RANGE:
+      row_cache->clear(record.getTrancId());
+      break;
+    default:
+      break;
+    }
   }
-  return 0;
 }
-uint64_t LSMEngine::remove(const std::string &key, uint64_t tranc_id) {
+
+void LSMEngine::remove(const std::string &key, uint64_t tranc_id) {
+  maybe_stall_write();
   // 在 LSM 中，删除实际上是插入一个空值
   memtable.remove(key, tranc_id);
-  // 如果 memtable 太大，需要刷新到磁盘
-  if (memtable.get_total_size() >= LSM_TOL_MEM_SIZE_LIMIT) {
-    return flush();
+  if (row_cache != nullptr) {
+    row_cache->invalidate(key, tranc_id);
   }
-  return 0;
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
 }
 
-uint64_t LSMEngine::remove_batch(const std::vector<std::string> &keys,
-                                 uint64_t tranc_id) {
+void LSMEngine::remove_batch(const std::vector<std::string> &keys,
+                             uint64_t tranc_id) {
+  maybe_stall_write();
   memtable.remove_batch(keys, tranc_id);
-  // 如果 memtable 太大，需要刷新到磁盘
-  if (memtable.get_total_size() >= LSM_TOL_MEM_SIZE_LIMIT) {
-    return flush();
+  if (row_cache != nullptr) {
+    for (auto &key : keys) {
+      row_cache->invalidate(key, tranc_id);
+    }
+  }
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
+}
+
+void LSMEngine::remove_range(const std::string &begin, const std::string &end,
+                             uint64_t tranc_id) {
+  maybe_stall_write();
+  // 只写入一条范围删除标记, 被覆盖的数据在 compact 时清理
+  memtable.remove_range(begin, end, tranc_id);
+  if (row_cache != nullptr) {
+    row_cache->clear(tranc_id);
   }
-  return 0;
+  // 如果 memtable 太大，交给后台线程刷新到磁盘
+  schedule_flush_if_needed();
 }
 
 void LSMEngine::clear() {
+  // 等待正在执行的后台任务完成, 避免其访问被清理的数据
+  std::unique_lock<std::mutex> flush_lock(flush_mtx);
+  std::unique_lock<std::mutex> compact_lock(compact_mtx);
+  std::unique_lock<std::mutex> lock(version_mtx);
+
   memtable.clear();
-  level_sst_ids.clear();
-  ssts.clear();
+  manifest.reset();
+  version_.store(std::make_shared<Version>());
+  if (row_cache != nullptr) {
+    row_cache->clear();
+  }
   // 清空当前文件夹的所有内容
   try {
     for (const auto &entry : std::filesystem::directory_iterator(data_dir)) {
@@ -349,40 +1014,557 @@ void LSMEngine::clear() {
     // 处理文件系统错误
     std::cerr << "Error clearing directory: " << e.what() << std::endl;
   }
+  VersionEdit snapshot;
+  snapshot.next_sst_id = next_sst_id.load();
+  snapshot.flushed_tranc_id = flushed_tranc_id.load();
+  manifest = Manifest::create(get_manifest_path(), snapshot);
 }
 
 uint64_t LSMEngine::flush() {
-  if (memtable.get_total_size() == 0) {
+  // 同一时间只有一个 flush, 保证冻结表按从旧到新的顺序刷入 l0
+  std::unique_lock<std::mutex> flush_lock(flush_mtx);
+
+  // 1. 获取 memtable 中最旧的表, 此时还不能将其从 memtable 中移除
+  auto table = memtable.get_last_frozen();
+  if (table == nullptr) {
     return 0;
   }
+  StopWatch watch(stats.get(), HistogramType::Flush);
 
-  std::unique_lock<std::shared_mutex> lock(ssts_mtx); // 写锁
+  // 2. 创建新的 SST ID
+  size_t new_sst_id = next_sst_id++;
 
-  // 1. 先判断 l0 sst 是否数量超限需要concat到 l1
-  if (level_sst_ids.find(0) != level_sst_ids.end() &&
-      level_sst_ids[0].size() >= LSM_SST_LEVEL_RATIO) {
-    full_compact(0);
+  // 3. 不持有任何 sst 相关的锁的情况下构建 sst
+  // 较大的 value 写入 blob 文件, sst 中只保存 BlobIndex
+  auto builder = new_sst_builder(0);
+  std::unique_ptr<BlobFileBuilder> blob_builder;
+  for (auto &[k, v, t] : flush_entries_(table)) {
+    if (options.blob_enable && v.size() >= options.blob_min_value_size) {
+      if (blob_builder == nullptr) {
+        blob_builder = new_blob_builder(0);
+      }
+      builder.add(k, blob_builder->add(k, v).encode(), t, true);
+    } else {
+      builder.add(k, v, t);
+    }
+  }
+  if (auto range_dels = table->get_range_tombstones()) {
+    for (auto &tombstone : range_dels->tombstones()) {
+      builder.add_range_tombstone(tombstone.begin, tombstone.end,
+                                  tombstone.tranc_id);
+    }
+  }
+  if (blob_builder != nullptr) {
+    // blob 文件需要先于引用它的 sst 写入磁盘
+    blob_builder->finish();
+  }
+  auto sst_path = get_sst_path(new_sst_id, 0);
+  auto new_sst = builder.build(new_sst_id, sst_path, block_cache,
+                               pin_level_meta(0), blob_store);
+  stats->record_tick(Ticker::FlushBytes, new_sst->sst_size());
+
+  // 4. 安装包含新 sst 的 Version, 同时记录刷盘的进度
+  uint64_t max_tranc_id = new_sst->get_tranc_id_range().second;
+  VersionEdit edit;
+  edit.add_file(0, new_sst);
+  edit.flushed_tranc_id = std::max(max_tranc_id, flushed_tranc_id.load());
+  install_version(std::move(edit), {new_sst});
+  flushed_tranc_id = std::max(max_tranc_id, flushed_tranc_id.load());
+
+  // 5. sst 已经对读者可见, 才能移除对应的冻结表
+  memtable.remove_last_frozen();
+  flush_lock.unlock();
+  if (write_buffer_member != nullptr) {
+    options.write_buffer_manager->update(*write_buffer_member,
+                                         memtable.get_total_size());
   }
 
-  // 2. 创建新的 SST ID
-  size_t new_sst_id = next_sst_id++;
+  // 返回新刷入的 sst 的最大的 tranc_id
+  std::function<void(uint64_t)> callback;
+  {
+    // 回调可能在后台任务运行时才被设置
+    std::lock_guard<std::mutex> lock(callback_mtx);
+    callback = flush_callback;
+  }
+  if (callback) {
+    callback(max_tranc_id);
+  }
 
-  // 3. 准备 SSTBuilder
-  SSTBuilder builder(LSM_BLOCK_SIZE, true); // 4KB block size
+  stall_cv.notify_all();
+  schedule_compact_if_needed();
+  return max_tranc_id;
+}
 
-  // 4. 将 memtable 中最旧的表写入 SST
-  auto sst_path = get_sst_path(new_sst_id, 0);
-  auto new_sst =
-      memtable.flush_last(builder, sst_path, new_sst_id, block_cache);
+void LSMEngine::ingest_external_files(const std::vector<std::string> &paths,
+                                      uint64_t tranc_id) {
+  // 1. 检查文件, 只能导入 SstFileWriter 生成的文件
+  struct ExternalFile {
+    std::string path;
+    std::string first_key;
+    std::string last_key;
+  };
+  std::vector<ExternalFile> files;
+  for (auto &path : paths) {
+    auto sst = SST::open(0, FileObj::open(path, false), nullptr);
+    if (sst->num_blocks() == 0 || sst->get_range_tombstones() != nullptr ||
+        !sst->get_blob_file_ids().empty() ||
+        sst->get_tranc_id_range().second != 0) {
+      throw std::runtime_error("Not an SST created by SstFileWriter: " + path);
+    }
+    files.push_back({path, sst->get_first_key(), sst->get_last_key()});
+  }
+  std::sort(files.begin(), files.end(), [](auto &a, auto &b) {
+    return a.first_key < b.first_key;
+  });
+  for (size_t i = 1; i < files.size(); i++) {
+    if (files[i].first_key <= files[i - 1].last_key) {
+      throw std::runtime_error("External SST files overlap: " +
+                               files[i - 1].path + ", " + files[i].path);
+    }
+  }
+  if (files.empty()) {
+    return;
+  }
 
-  // 5. 更新内存索引
-  ssts[new_sst_id] = new_sst;
+  // 2. 内存表中的旧版本会遮挡导入的数据, 需要先刷盘
+  while (memtable.get_total_size() > 0) {
+    flush();
+  }
 
-  // 6. 更新 sst_ids
-  level_sst_ids[0].push_front(new_sst_id);
+  // 3. compact 会改变各层的 sst, 选择层级到安装 Version 期间需要持有 compact_mtx
+  std::unique_lock<std::mutex> compact_lock(compact_mtx);
+  auto version = current_version();
+  VersionEdit edit;
+  std::vector<std::shared_ptr<SST>> new_ssts;
+  std::vector<std::string> linked;
+  try {
+    for (auto &file : files) {
+      size_t level = pick_ingest_level(*version, file.first_key, file.last_key);
+      size_t sst_id = next_sst_id++;
+      auto sst_path = get_sst_path(sst_id, level);
+      FileObj::link_or_copy(file.path, sst_path);
+      linked.push_back(sst_path);
+      auto sst = SST::open(sst_id, FileObj::open(sst_path, false), block_cache,
+                           pin_level_meta(level), blob_store);
+      sst->set_global_tranc_id(tranc_id);
+      edit.add_file(level, sst);
+      new_ssts.push_back(std::move(sst));
+    }
+    install_version(std::move(edit), new_ssts);
+    if (row_cache != nullptr) {
+      // 导入的数据不经过内存表, 行缓存中的版本可能被其遮挡
+      row_cache->clear(tranc_id);
+    }
+  } catch (...) {
+    new_ssts.clear();
+    for (auto &path : linked) {
+      std::filesystem::remove(path);
+    }
+    throw;
+  }
+  compact_lock.unlock();
+  schedule_compact_if_needed();
+}
 
-  // 返回新刷入的 sst 的最大的 tranc_id
-  return new_sst->get_tranc_id_range().second;
+size_t LSMEngine::pick_ingest_level(const Version &version,
+                                    const std::string &first_key,
+                                    const std::string &last_key) {
+  auto overlaps = [&](size_t level) {
+    for (auto &sst : version.level_ssts(level)) {
+      if (sst->get_first_key() <= last_key && first_key <= sst->get_last_key()) {
+        return true;
+      }
+    }
+    return false;
+  };
+  // 与 l0 重叠时只能作为最新的 l0 sst
+  if (overlaps(0)) {
+    return 0;
+  }
+  // 更深的层级中的数据更旧, 导入的文件需要位于所有重叠的 sst 之上
+  for (size_t level = 1; level <= version.max_level(); level++) {
+    if (overlaps(level)) {
+      return level - 1;
+    }
+  }
+  return std::max<size_t>(1, version.max_level());
+}
+
+uint64_t LSMEngine::create_checkpoint(const std::string &dir) {
+  // 先读取刷盘进度再获取 Version, Version 中一定包含该进度之前的全部记录
+  uint64_t checkpoint_tranc_id = flushed_tranc_id.load();
+  // 持有 Version 期间其中的 sst 和 blob 文件都不会被删除
+  auto version = current_version();
+  std::filesystem::create_directories(dir);
+
+  std::set<uint64_t> blob_ids;
+  for (auto &[level, ssts] : version->levels()) {
+    for (auto &sst : ssts) {
+      // compact 可能同时将 sst 移动到更深的层级并重命名文件,
+      // 文件名中的层级与 MANIFEST 不一致时, 打开检查点时会重命名
+      size_t sst_id = sst->get_sst_id();
+      for (size_t file_level = level;; file_level++) {
+        auto src = get_sst_path(sst_id, file_level);
+        try {
+          FileObj::link_or_copy(
+              src, dir + "/" + std::filesystem::path(src).filename().string());
+          break;
+        } catch (const std::filesystem::filesystem_error &) {
+          if (file_level >= current_version()->max_level() + 1) {
+            throw;
+          }
+        }
+      }
+      for (auto blob_id : sst->get_blob_file_ids()) {
+        blob_ids.insert(blob_id);
+      }
+    }
+  }
+  for (auto blob_id : blob_ids) {
+    auto src = blob_store->get_file_path(blob_id);
+    FileObj::link_or_copy(
+        src, dir + "/" + std::filesystem::path(src).filename().string());
+  }
+
+  // 新的 MANIFEST 只包含这个 Version
+  auto snapshot = version->snapshot();
+  snapshot.next_sst_id = next_sst_id.load();
+  snapshot.flushed_tranc_id = checkpoint_tranc_id;
+  Manifest::create(dir + "/MANIFEST", snapshot);
+  return checkpoint_tranc_id;
+}
+
+void LSMEngine::set_flush_callback(std::function<void(uint64_t)> callback) {
+  std::lock_guard<std::mutex> lock(callback_mtx);
+  flush_callback = std::move(callback);
+}
+
+void LSMEngine::set_gc_watermark_callback(
+    std::function<uint64_t()> callback) {
+  std::lock_guard<std::mutex> lock(callback_mtx);
+  gc_watermark_callback = std::move(callback);
+}
+
+void LSMEngine::schedule_flush_if_needed() {
+  if (bg_stop) {
+    return;
+  }
+  size_t mem_size = memtable.get_total_size();
+  if (write_buffer_member != nullptr) {
+    // 超出进程级别的限制时, 这里可能调用内存表最大的引擎的回调
+    options.write_buffer_manager->update(*write_buffer_member, mem_size);
+  }
+  if (!flush_requested && mem_size < options.tol_mem_size_limit) {
+    return;
+  }
+  if (flush_scheduled.exchange(true)) {
+    // 已经有 flush 任务在排队或执行
+    return;
+  }
+  bg_pool->submit([this]() { bg_flush(); });
+}
+
+void LSMEngine::schedule_compact_if_needed() {
+  if (bg_stop || !need_compact()) {
+    return;
+  }
+  if (compact_scheduled.exchange(true)) {
+    // 已经有 compact 任务在排队或执行
+    return;
+  }
+  bg_pool->submit([this]() { bg_compact(); });
+}
+
+void LSMEngine::bg_flush() {
+  report_compaction_debt();
+  while (!bg_stop && memtable.get_total_size() >= options.tol_mem_size_limit) {
+    flush();
+  }
+  if (flush_requested.exchange(false)) {
+    // 进程级别的内存表占用超出限制, 活跃表也需要刷盘
+    while (!bg_stop && memtable.get_frozen_size() > 0) {
+      flush();
+    }
+    if (!bg_stop) {
+      flush(); // 活跃表为空时不做任何操作
+    }
+  }
+  flush_scheduled = false;
+  stall_cv.notify_all();
+  // 重置标记前可能有写入者的调度请求被忽略了, 需要再检查一次
+  schedule_flush_if_needed();
+}
+
+void LSMEngine::bg_compact() {
+  while (!bg_stop && need_compact()) {
+    // 每轮 compact 开始前根据积压调整限速, 积压越多后台写入越快
+    report_compaction_debt();
+    std::unique_lock<std::mutex> compact_lock(compact_mtx);
+    StopWatch watch(stats.get(), HistogramType::Compaction);
+    if (compact_type == CompactType::LeveledCompact) {
+      auto level = pick_leveled_compact_level();
+      if (level.has_value()) {
+        leveled_compact(level.value());
+      }
+    } else if (compact_type == CompactType::TieredCompact) {
+      auto task = pick_tiered_compact_task();
+      if (task.has_value()) {
+        tiered_compact(task.value());
+      }
+    } else {
+      full_compact(0);
+    }
+    compact_lock.unlock();
+    stall_cv.notify_all();
+  }
+  compact_scheduled = false;
+  report_compaction_debt();
+  stall_cv.notify_all();
+  // 同 bg_flush, 避免丢失 compact 调度请求
+  schedule_compact_if_needed();
+}
+
+bool LSMEngine::need_compact() {
+  if (mutable_options()->disable_auto_compactions) {
+    return false;
+  }
+  if (compact_type == CompactType::LeveledCompact) {
+    return pick_leveled_compact_level().has_value();
+  }
+  if (compact_type == CompactType::TieredCompact) {
+    return pick_tiered_compact_task().has_value();
+  }
+  return get_level_sst_num(0) >= mutable_options()->level0_compact_trigger;
+}
+
+size_t LSMEngine::get_level_sst_num(size_t level) {
+  return current_version()->num_ssts(level);
+}
+
+bool LSMEngine::need_stall_write() {
+  auto opts = mutable_options();
+  if (memtable.get_frozen_size() >= opts->write_stall_frozen_bytes) {
+    return true;
+  }
+  // 关闭自动 compact 时 l0 的积压不会被消化, 不能因此阻塞写入
+  return !opts->disable_auto_compactions &&
+         get_level_sst_num(0) >= opts->write_stall_l0_num;
+}
+
+double LSMEngine::compaction_debt() {
+  auto opts = mutable_options();
+  double debt = static_cast<double>(memtable.get_frozen_size()) /
+                opts->write_stall_frozen_bytes;
+  if (!opts->disable_auto_compactions) {
+    debt = std::max(debt, static_cast<double>(get_level_sst_num(0)) /
+                              opts->write_stall_l0_num);
+  }
+  return std::min(debt, 1.0);
+}
+
+void LSMEngine::report_compaction_debt() {
+  if (options.rate_limiter != nullptr && options.rate_limiter->is_auto_tuned()) {
+    options.rate_limiter->update_compaction_debt(compaction_debt());
+  }
+}
+
+void LSMEngine::maybe_stall_write() {
+  if (bg_stop || !need_stall_write()) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  do {
+    // 确保后台任务已经提交, 然后等待其进展
+    schedule_flush_if_needed();
+    schedule_compact_if_needed();
+    std::unique_lock<std::mutex> lock(stall_mtx);
+    stall_cv.wait_for(lock, std::chrono::milliseconds(10));
+  } while (!bg_stop && need_stall_write());
+  stats->record_tick(Ticker::StallCount);
+  stats->record_tick(Ticker::StallMicros,
+                     std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+}
+
+std::shared_ptr<const MutableOptions> LSMEngine::mutable_options() const {
+  return mutable_options_.load();
+}
+
+void LSMEngine::set_options(const MutableOptions &new_options) {
+  new_options.validate();
+  mutable_options_.store(std::make_shared<const MutableOptions>(new_options));
+  // 阈值提高后被阻塞的写入可能可以继续, 降低后可能需要立即 compact
+  stall_cv.notify_all();
+  schedule_compact_if_needed();
+}
+
+void LSMEngine::wait_for_bg_jobs() {
+  while (flush_scheduled || compact_scheduled) {
+    std::unique_lock<std::mutex> lock(stall_mtx);
+    stall_cv.wait_for(lock, std::chrono::milliseconds(10));
+  }
+}
+
+void LSMEngine::recover_version() {
+  // 1. 找到目录中已有的 sst 文件, 文件名格式为: sst_{id}.level
+  std::unordered_map<size_t, size_t> sst_files; // {sst_id, level}
+  for (const auto &entry : std::filesystem::directory_iterator(data_dir)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    auto parsed = parse_sst_filename(entry.path().filename().string());
+    if (!parsed.has_value()) {
+      continue;
+    }
+    auto [sst_id, level] = parsed.value();
+    sst_files[sst_id] = level;
+    // 现有的最大 sst_id 自增后才是下一个分配的 sst_id
+    next_sst_id = std::max(sst_id + 1, next_sst_id.load());
+  }
+
+  // 2. 重放 MANIFEST, 没有 MANIFEST 的旧数据目录使用全部 sst 文件
+  std::map<size_t, size_t> live_ssts; // {sst_id, level}
+  std::map<size_t, SstFileMeta> file_metas;
+  auto manifest_path = get_manifest_path();
+  if (std::filesystem::exists(manifest_path)) {
+    for (auto &record : Manifest::read(manifest_path)) {
+      if (record.next_sst_id.has_value()) {
+        next_sst_id = std::max(record.next_sst_id.value(), next_sst_id.load());
+      }
+      if (record.flushed_tranc_id.has_value()) {
+        flushed_tranc_id = std::max(record.flushed_tranc_id.value(),
+                                    flushed_tranc_id.load());
+      }
+      for (auto [level, sst_id] : record.deleted_files) {
+        live_ssts.erase(sst_id);
+        file_metas.erase(sst_id);
+      }
+      for (auto [level, sst_id] : record.added_files) {
+        live_ssts[sst_id] = level;
+      }
+      for (auto &[sst_id, meta] : record.file_metas) {
+        file_metas[sst_id] = meta;
+      }
+    }
+  } else {
+    live_ssts.insert(sst_files.begin(), sst_files.end());
+  }
+
+  // 3. 清理 flush 或 compact 中途退出时留下的 sst 文件
+  for (auto [sst_id, level] : sst_files) {
+    auto it = live_ssts.find(sst_id);
+    if (it == live_ssts.end()) {
+      // sst 已经写入但还没有安装到 Version 中, 或者已经被删除
+      std::filesystem::remove(get_sst_path(sst_id, level));
+    } else if (it->second != level) {
+      // move_level_down 重命名文件后, 还没有写入 MANIFEST
+      std::filesystem::rename(get_sst_path(sst_id, level),
+                              get_sst_path(sst_id, it->second));
+    }
+  }
+
+  // 4. 并行打开 sst, MANIFEST 中有元数据的 sst 不需要读取元数据块
+  VersionEdit edit;
+  std::vector<std::shared_ptr<SST>> ssts;
+  {
+    ThreadPool open_pool(options.open_thread_num);
+    std::vector<std::future<std::shared_ptr<SST>>> futures;
+    for (auto [sst_id, level] : live_ssts) {
+      if (!sst_files.count(sst_id)) {
+        throw std::runtime_error("SST in MANIFEST is missing: " +
+                                 get_sst_path(sst_id, level));
+      }
+      auto meta_it = file_metas.find(sst_id);
+      const SstFileMeta *file_meta =
+          meta_it == file_metas.end() ? nullptr : &meta_it->second;
+      futures.push_back(open_pool.submit([this, sst_id, level, file_meta]() {
+        return SST::open(sst_id,
+                         FileObj::open(get_sst_path(sst_id, level), false),
+                         block_cache, pin_level_meta(level), blob_store,
+                         file_meta);
+      }));
+      edit.add_file(level, sst_id);
+    }
+    for (auto &future : futures) {
+      ssts.push_back(future.get());
+    }
+  }
+  // 清理 flush 或 compact 中途退出时留下的 blob 文件
+  blob_store->remove_unreferenced_files();
+
+  // 5. 用恢复出的 Version 重写 MANIFEST, 避免日志无限增长
+  auto version = Version().apply(edit, ssts);
+  auto snapshot = version->snapshot();
+  snapshot.next_sst_id = next_sst_id.load();
+  snapshot.flushed_tranc_id = flushed_tranc_id.load();
+  manifest = Manifest::create(manifest_path, snapshot);
+  version_.store(std::move(version));
+}
+
+std::shared_ptr<const Version> LSMEngine::current_version() const {
+  return version_.load();
+}
+
+void LSMEngine::install_version(
+    VersionEdit edit, const std::vector<std::shared_ptr<SST>> &new_ssts) {
+  std::lock_guard<std::mutex> lock(version_mtx);
+  auto old_version = version_.load();
+  auto new_version = old_version->apply(edit, new_ssts);
+  // 先写入 MANIFEST 再对读者可见
+  edit.next_sst_id = next_sst_id.load();
+  manifest->append(edit);
+  version_.store(new_version);
+  if (row_cache != nullptr && compaction_filter != nullptr &&
+      !edit.deleted_files.empty()) {
+    // compaction filter 可能删除或者修改 sst 中最新的版本
+    row_cache->clear();
+  }
+
+  // 只被删除而没有被重新添加的 sst 已经不可见, 等到旧的 Version 都释放后删除
+  std::unordered_set<size_t> added_ids;
+  for (auto &added : edit.added_files) {
+    added_ids.insert(added.second);
+  }
+  for (auto &deleted : edit.deleted_files) {
+    if (!added_ids.count(deleted.second)) {
+      old_version->find_sst(deleted.second)->mark_obsolete();
+    }
+  }
+}
+
+std::string LSMEngine::get_manifest_path() {
+  return data_dir + "/MANIFEST";
+}
+
+EngineStats LSMEngine::get_stats() {
+  EngineStats result;
+  for (size_t i = 0; i < kTickerNum; i++) {
+    result.tickers[i] = stats->get_ticker(static_cast<Ticker>(i));
+  }
+  for (size_t i = 0; i < kHistogramNum; i++) {
+    result.histograms[i] =
+        stats->get_histogram(static_cast<HistogramType>(i));
+  }
+  result.memtable_bytes = memtable.get_cur_size();
+  result.frozen_memtable_bytes = memtable.get_frozen_size();
+  result.block_cache_usage = block_cache->get_usage();
+  result.block_cache_hit_rate = block_cache->hit_rate();
+  if (row_cache != nullptr) {
+    result.row_cache_usage = row_cache->get_usage();
+  }
+  auto version = current_version();
+  for (auto &[level, l_ssts] : version->levels()) {
+    if (l_ssts.empty()) {
+      continue;
+    }
+    LevelStats level_stats{level, l_ssts.size(), 0};
+    for (auto &sst : l_ssts) {
+      level_stats.bytes += sst->sst_size();
+    }
+    result.levels.push_back(level_stats);
+  }
+  return result;
 }
 
 std::string LSMEngine::get_sst_path(size_t sst_id, size_t target_level) {
@@ -393,240 +1575,1071 @@ std::string LSMEngine::get_sst_path(size_t sst_id, size_t target_level) {
   return ss.str();
 }
 
-std::optional<std::pair<TwoMergeIterator, TwoMergeIterator>>
+std::optional<std::pair<MergeIterator, MergeIterator>>
 LSMEngine::lsm_iters_monotony_predicate(
     uint64_t tranc_id, std::function<int(const std::string &)> predicate) {
+  return iters_monotony_predicate_(tranc_id, std::move(predicate), nullptr,
+                                   nullptr);
+}
 
-  //  先从 memtable 中查询
-  auto mem_result = memtable.iters_monotony_predicate(tranc_id, predicate);
+std::optional<std::pair<MergeIterator, MergeIterator>>
+LSMEngine::lsm_iters_monotony_predicate(
+    const Snapshot &snapshot,
+    std::function<int(const std::string &)> predicate) {
+  return iters_monotony_predicate_(snapshot.get_tranc_id(),
+                                   std::move(predicate), nullptr, &snapshot);
+}
 
-  // 再从 sst 中查询
-  std::vector<SearchItem> item_vec;
-  for (auto &[sst_level, sst_ids] : level_sst_ids) {
-    for (auto &sst_id : sst_ids) {
-      auto sst = ssts[sst_id];
-      auto result = sst_iters_monotony_predicate(sst, tranc_id, predicate);
-      if (!result.has_value()) {
-        continue;
+std::optional<std::pair<MergeIterator, MergeIterator>>
+LSMEngine::lsm_iters_preffix(uint64_t tranc_id, const std::string &preffix) {
+  return iters_monotony_predicate_(
+      tranc_id,
+      [preffix](const std::string &key) {
+        return -key.compare(0, preffix.size(), preffix);
+      },
+      &preffix, nullptr);
+}
+
+std::optional<std::pair<MergeIterator, MergeIterator>>
+LSMEngine::iters_monotony_predicate_(
+    uint64_t tranc_id, std::function<int(const std::string &)> predicate,
+    const std::string *preffix, const Snapshot *snapshot) {
+  // 内存表需要先于 Version 获取, 避免漏掉两者之间刷盘的数据
+  auto mem_tables =
+      snapshot != nullptr ? snapshot->get_mem_tables() : memtable.get_tables();
+  auto version =
+      snapshot != nullptr ? snapshot->get_version() : current_version();
+  auto may_match = [&](const std::shared_ptr<SST> &sst) {
+    return preffix == nullptr ||
+           sst->preffix_may_match(*preffix, prefix_extractor.get());
+  };
+
+  // 数据源按从新到旧的顺序排列, 每个数据源只定位到范围的开头, 之后按需推进
+  // 范围删除标记记录在其所在的数据源的下标上, 与点查时查询的顺序一致;
+  // 被前缀过滤器跳过的 sst 中的标记仍然作用于之后的数据源
+  std::vector<std::shared_ptr<BaseIterator>> sources;
+  MergeIterator::RangeDelSources range_dels;
+  // 1. 内存表, 活跃表在前, 与点查一致, 全部内存表的标记作用于所有数据源
+  std::vector<std::shared_ptr<const FragmentedRangeTombstones>> mem_range_dels;
+  for (auto &table : mem_tables) {
+    if (auto table_range_dels = table->get_range_tombstones()) {
+      mem_range_dels.push_back(std::move(table_range_dels));
+    }
+    auto result = table->iters_monotony_predicate(predicate);
+    if (result.has_value()) {
+      sources.push_back(std::make_shared<SkipListIterator>(result->first));
+    }
+  }
+  if (auto merged = merge_range_tombstones(mem_range_dels)) {
+    range_dels.emplace_back(0, std::move(merged));
+  }
+  // 2. l0 中的 sst 可能互相重叠, 每个 sst 单独作为一个数据源
+  for (auto &sst : version->level_ssts(0)) {
+    if (auto sst_range_dels = sst->get_range_tombstones()) {
+      range_dels.emplace_back(sources.size(), std::move(sst_range_dels));
+    }
+    if (may_match(sst)) {
+      sources.push_back(
+          std::make_shared<SstIterator>(sst, tranc_id, predicate));
+    }
+  }
+  // 3. 其他层的 sst 互不重叠, 每一层作为一个数据源
+  for (auto &[level, level_ssts] : version->levels()) {
+    if (level == 0) {
+      continue;
+    }
+    std::vector<std::shared_ptr<SST>> ssts;
+    std::vector<std::shared_ptr<const FragmentedRangeTombstones>>
+        level_range_dels;
+    for (auto &sst : level_ssts) {
+      if (auto sst_range_dels = sst->get_range_tombstones()) {
+        level_range_dels.push_back(std::move(sst_range_dels));
       }
-      auto [it_begin, it_end] = result.value();
-      for (; it_begin != it_end && it_begin.is_valid(); ++it_begin) {
-        // l0中, 这里越古老的sst的idx越小, 我们需要让新的sst优先在堆顶
-        // 让新的sst(拥有更大的idx)排序在前面, 反转符号就行了
-        if (tranc_id != 0 && it_begin.get_tranc_id() > tranc_id) {
-          // 如果开启了事务, 比当前事务 id 更大的记录是不可见的
-          continue;
+      if (may_match(sst)) {
+        ssts.push_back(sst);
+      }
+    }
+    if (auto merged = merge_range_tombstones(level_range_dels)) {
+      range_dels.emplace_back(sources.size(), std::move(merged));
+    }
+    if (!ssts.empty()) {
+      sources.push_back(std::make_shared<ConcactIterator>(
+          std::move(ssts), tranc_id, predicate));
+    }
+  }
+
+  // ! 迭代器持有 this, 不能在引擎析构之后使用
+  MergeIterator begin(std::move(sources), tranc_id, std::move(predicate),
+                      std::move(range_dels),
+                      merge_resolver_(tranc_id, mem_tables, version));
+  if (!begin.is_valid()) {
+    return std::nullopt;
+  }
+  return std::make_pair(std::move(begin), MergeIterator{});
+}
+
+MergeIterator::MergeResolver LSMEngine::merge_resolver_(
+    uint64_t tranc_id, const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+    const std::shared_ptr<const Version> &version) {
+  for (auto &table : mem_tables) {
+    if (table->has_merge_operands()) {
+      return [this, mem_tables, version,
+              tranc_id](const std::string &key) -> std::optional<std::string> {
+        auto merged = merge_get_(key, tranc_id, mem_tables, *version);
+        if (!merged.has_value()) {
+          return std::nullopt;
         }
-        if (!item_vec.empty() && item_vec.back().key_ == it_begin.key()) {
-          // 如果key相同，则只保留最新的事务修改的记录即可
-          // 且这个记录既然已经存在于item_vec中，则其肯定满足了事务的可见性判断
-          continue;
+        return std::move(merged->first);
+      };
+    }
+  }
+  return nullptr;
+}
+
+MergeIterator
+LSMEngine::seek_iter(uint64_t tranc_id, const std::string &key,
+                     const std::optional<std::string> &upper_bound,
+                     const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+                     const std::shared_ptr<const Version> &version) {
+  auto overlaps = [&](const std::shared_ptr<SST> &sst) {
+    return sst->get_last_key() >= key &&
+           (!upper_bound.has_value() || sst->get_first_key() < *upper_bound);
+  };
+
+  // 数据源和范围删除标记的顺序与 iters_monotony_predicate_ 一致;
+  // 不打开的 sst 中的标记仍然作用于之后的数据源
+  std::vector<std::shared_ptr<BaseIterator>> sources;
+  MergeIterator::RangeDelSources range_dels;
+  std::vector<std::shared_ptr<const FragmentedRangeTombstones>> mem_range_dels;
+  for (auto &table : mem_tables) {
+    if (auto table_range_dels = table->get_range_tombstones()) {
+      mem_range_dels.push_back(std::move(table_range_dels));
+    }
+    auto iter = table->lower_bound(key);
+    if (iter.is_valid()) {
+      sources.push_back(std::make_shared<SkipListIterator>(std::move(iter)));
+    }
+  }
+  if (auto merged = merge_range_tombstones(mem_range_dels)) {
+    range_dels.emplace_back(0, std::move(merged));
+  }
+  for (auto &sst : version->level_ssts(0)) {
+    if (auto sst_range_dels = sst->get_range_tombstones()) {
+      range_dels.emplace_back(sources.size(), std::move(sst_range_dels));
+    }
+    if (overlaps(sst)) {
+      sources.push_back(std::make_shared<SstIterator>(sst->seek(key, tranc_id)));
+    }
+  }
+  for (auto &[level, level_ssts] : version->levels()) {
+    if (level == 0) {
+      continue;
+    }
+    std::vector<std::shared_ptr<SST>> ssts;
+    std::vector<std::shared_ptr<const FragmentedRangeTombstones>>
+        level_range_dels;
+    for (auto &sst : level_ssts) {
+      if (auto sst_range_dels = sst->get_range_tombstones()) {
+        level_range_dels.push_back(std::move(sst_range_dels));
+      }
+      if (overlaps(sst)) {
+        ssts.push_back(sst);
+      }
+    }
+    if (auto merged = merge_range_tombstones(level_range_dels)) {
+      range_dels.emplace_back(sources.size(), std::move(merged));
+    }
+    if (!ssts.empty()) {
+      sources.push_back(
+          std::make_shared<ConcactIterator>(std::move(ssts), tranc_id, key));
+    }
+  }
+  return MergeIterator(std::move(sources), tranc_id, nullptr,
+                       std::move(range_dels),
+                       merge_resolver_(tranc_id, mem_tables, version),
+                       upper_bound);
+}
+
+MergeIterator LSMEngine::seek_for_prev_iter(
+    uint64_t tranc_id, const std::optional<std::string> &key,
+    const std::optional<std::string> &lower_bound,
+    const std::vector<std::shared_ptr<SkipList>> &mem_tables,
+    const std::shared_ptr<const Version> &version) {
+  auto overlaps = [&](const std::shared_ptr<SST> &sst) {
+    return (!key.has_value() || sst->get_first_key() <= *key) &&
+           (!lower_bound.has_value() || sst->get_last_key() >= *lower_bound);
+  };
+  auto seek_sst = [&](const std::shared_ptr<SST> &sst) {
+    return sst->seek_for_prev(key.value_or(sst->get_last_key()), tranc_id);
+  };
+
+  // 数据源和范围删除标记的顺序与正向遍历一致
+  std::vector<std::shared_ptr<BaseIterator>> sources;
+  MergeIterator::RangeDelSources range_dels;
+  std::vector<std::shared_ptr<const FragmentedRangeTombstones>> mem_range_dels;
+  for (auto &table : mem_tables) {
+    if (auto table_range_dels = table->get_range_tombstones()) {
+      mem_range_dels.push_back(std::move(table_range_dels));
+    }
+    auto iter = table->seek_for_prev(key, tranc_id);
+    if (iter.is_valid()) {
+      sources.push_back(std::make_shared<SkipListIterator>(std::move(iter)));
+    }
+  }
+  if (auto merged = merge_range_tombstones(mem_range_dels)) {
+    range_dels.emplace_back(0, std::move(merged));
+  }
+  for (auto &sst : version->level_ssts(0)) {
+    if (auto sst_range_dels = sst->get_range_tombstones()) {
+      range_dels.emplace_back(sources.size(), std::move(sst_range_dels));
+    }
+    if (overlaps(sst)) {
+      sources.push_back(std::make_shared<SstIterator>(seek_sst(sst)));
+    }
+  }
+  for (auto &[level, level_ssts] : version->levels()) {
+    if (level == 0) {
+      continue;
+    }
+    std::vector<std::shared_ptr<SST>> ssts;
+    std::vector<std::shared_ptr<const FragmentedRangeTombstones>>
+        level_range_dels;
+    for (auto &sst : level_ssts) {
+      if (auto sst_range_dels = sst->get_range_tombstones()) {
+        level_range_dels.push_back(std::move(sst_range_dels));
+      }
+      if (overlaps(sst)) {
+        ssts.push_back(sst);
+      }
+    }
+    if (auto merged = merge_range_tombstones(level_range_dels)) {
+      range_dels.emplace_back(sources.size(), std::move(merged));
+    }
+    if (!ssts.empty()) {
+      auto last_key = key.value_or(ssts.back()->get_last_key());
+      sources.push_back(std::make_shared<ConcactIterator>(
+          std::move(ssts), tranc_id, last_key, true));
+    }
+  }
+  return MergeIterator(std::move(sources), tranc_id, nullptr,
+                       std::move(range_dels),
+                       merge_resolver_(tranc_id, mem_tables, version),
+                       lower_bound, true);
+}
+
+Level_Iterator LSMEngine::begin(uint64_t tranc_id) {
+  return Level_Iterator(shared_from_this(), tranc_id);
+}
+
+Level_Iterator LSMEngine::begin(const Snapshot &snapshot) {
+  return Level_Iterator(shared_from_this(), snapshot);
+}
+
+Level_Iterator LSMEngine::end() { return Level_Iterator{}; }
+
+void LSMEngine::full_compact(size_t src_level) {
+  // 将 src_level 的 sst 全体压缩到 src_level + 1
+  // ! 调用者需要持有 compact_mtx, levels >= 1 只会被 compact 修改
+
+  // 递归地判断下一级 level 是否需要 full compact
+  if (get_level_sst_num(src_level + 1) >= options.sst_level_ratio) {
+    full_compact(src_level + 1);
+  }
+
+  // 1. 从当前的 Version 中获取源level和目标level的 sst
+  // ! compact 期间 l0 可能有新的 sst 刷入, 这里只处理当前的快照
+  auto version = current_version();
+  auto lx_ssts = version->level_ssts(src_level);
+  auto ly_ssts = version->level_ssts(src_level + 1);
+  if (lx_ssts.empty()) {
+    return;
+  }
+
+  // 2. 不持有锁的情况下合并, 读者可以继续访问旧的 sst
+  std::vector<std::shared_ptr<SST>> new_ssts;
+  if (src_level == 0) {
+    // l0这一层不同sst的key有重叠, 需要额外处理
+    new_ssts = full_l0_l1_compact(lx_ssts, ly_ssts);
+  } else {
+    new_ssts = full_common_compact(lx_ssts, ly_ssts, src_level + 1,
+                                   get_sst_size(src_level + 1));
+  }
+
+  // 3. 用新的sst替换旧的sst, 旧的sst在不再被读者引用后删除
+  install_version(compact_edit({{src_level, lx_ssts}, {src_level + 1, ly_ssts}},
+                               src_level + 1, new_ssts),
+                  new_ssts);
+}
+
+std::vector<std::shared_ptr<SST>>
+LSMEngine::full_l0_l1_compact(std::vector<std::shared_ptr<SST>> &l0_ssts,
+                              std::vector<std::shared_ptr<SST>> &l1_ssts) {
+  // l0 的sst之间的key有重叠, 每个 sst 单独作为一个 sorted run
+  std::vector<std::vector<std::shared_ptr<SST>>> runs;
+  for (auto &sst : l0_ssts) {
+    runs.push_back({sst});
+  }
+  runs.push_back(l1_ssts);
+
+  return compact_sorted_runs(std::move(runs), options.leveled_sst_size(), 1);
+}
+
+std::vector<std::shared_ptr<SST>>
+LSMEngine::full_common_compact(std::vector<std::shared_ptr<SST>> &lx_ssts,
+                               std::vector<std::shared_ptr<SST>> &ly_ssts,
+                               size_t level_y, size_t target_sst_size) {
+  return compact_sorted_runs({lx_ssts, ly_ssts}, target_sst_size, level_y);
+}
+
+std::optional<size_t> LSMEngine::pick_leveled_compact_level() {
+  auto version = current_version();
+
+  // 分数 = 当前大小 / 目标大小, l0 由于 key 重叠, 使用 sst 的数量计算
+  std::optional<size_t> picked_level;
+  double max_score = 1.0;
+  size_t l0_trigger = mutable_options()->level0_compact_trigger;
+  for (auto &[level, level_ssts] : version->levels()) {
+    double score = 0;
+    if (level == 0) {
+      score = static_cast<double>(level_ssts.size()) / l0_trigger;
+    } else {
+      score = static_cast<double>(version->level_size(level)) /
+              get_level_target_size(level);
+    }
+    // 分数大于等于 1 才需要 compact, 同分时优先选择更低的 level
+    if (score > max_score || (score == max_score && !picked_level.has_value())) {
+      max_score = score;
+      picked_level = level;
+    }
+  }
+  return picked_level;
+}
+
+void LSMEngine::leveled_compact(size_t src_level) {
+  // ! 调用者需要持有 compact_mtx
+
+  // 1. 从当前的 Version 中选取参与 compact 的 sst
+  std::vector<std::shared_ptr<SST>> lx_ssts;
+  std::vector<std::shared_ptr<SST>> ly_ssts;
+  {
+    auto version = current_version();
+    auto &lx = version->level_ssts(src_level);
+    if (lx.empty()) {
+      return;
+    }
+
+    if (src_level == 0) {
+      // l0 的 sst 之间 key 有重叠, 需要全部参与
+      lx_ssts = lx;
+    } else {
+      // 从上次选中的位置开始轮转选取一个 sst
+      auto cursor_it = compact_cursor.find(src_level);
+      std::shared_ptr<SST> picked = lx.front();
+      if (cursor_it != compact_cursor.end()) {
+        for (auto &sst : lx) {
+          if (sst->get_first_key() > cursor_it->second) {
+            picked = sst;
+            break;
+          }
         }
-        item_vec.emplace_back(it_begin.key(), it_begin.value(), -sst_id,
-                              sst_level, it_begin.get_tranc_id());
       }
+      compact_cursor[src_level] = picked->get_last_key();
+      lx_ssts.push_back(picked);
+    }
+
+    // 计算选中的 sst 的 key 范围
+    std::string first_key = lx_ssts.front()->get_first_key();
+    std::string last_key = lx_ssts.front()->get_last_key();
+    for (auto &sst : lx_ssts) {
+      first_key = std::min(first_key, sst->get_first_key());
+      last_key = std::max(last_key, sst->get_last_key());
+    }
+
+    // 只有 key 范围重叠的下一层 sst 需要参与
+    for (auto &sst : version->level_ssts(src_level + 1)) {
+      if (sst->get_last_key() < first_key || sst->get_first_key() > last_key) {
+        continue;
+      }
+      ly_ssts.push_back(sst);
+    }
+  }
+
+  // 2. 不持有锁的情况下合并
+  std::vector<std::shared_ptr<SST>> new_ssts;
+  if (src_level == 0) {
+    new_ssts = full_l0_l1_compact(lx_ssts, ly_ssts);
+  } else {
+    new_ssts = full_common_compact(lx_ssts, ly_ssts, src_level + 1,
+                                   options.leveled_sst_size());
+  }
+
+  // 3. 替换参与 compact 的 sst
+  install_version(compact_edit({{src_level, lx_ssts}, {src_level + 1, ly_ssts}},
+                               src_level + 1, new_ssts),
+                  new_ssts);
+}
+
+std::optional<TieredCompactTask> LSMEngine::pick_tiered_compact_task() {
+  auto version = current_version();
+
+  // 统计每个 sorted run 的大小, level >= 1 按从新到旧排列
+  size_t l0_num = 0;
+  size_t l0_size = 0;
+  std::vector<std::pair<size_t, size_t>> level_runs; // {level, size}
+  for (auto &[level, level_ssts] : version->levels()) {
+    size_t level_size = version->level_size(level);
+    if (level == 0) {
+      l0_num = level_ssts.size();
+      l0_size = level_size;
+    } else {
+      level_runs.emplace_back(level, level_size);
     }
   }
 
-  std::shared_ptr<HeapIterator> l0_iter_ptr =
-      std::make_shared<HeapIterator>(item_vec, tranc_id);
-
-  if (!mem_result.has_value() && item_vec.empty()) {
+  size_t run_num = l0_num + level_runs.size();
+  auto opts = mutable_options();
+  if (l0_num < opts->level0_compact_trigger &&
+      run_num <= opts->tiered_max_run_num) {
     return std::nullopt;
   }
-  if (mem_result.has_value()) {
-    auto [mem_start, mem_end] = mem_result.value();
-    std::shared_ptr<HeapIterator> mem_start_ptr =
-        std::make_shared<HeapIterator>();
-    *mem_start_ptr = mem_start;
-    auto start = TwoMergeIterator(mem_start_ptr, l0_iter_ptr, tranc_id);
-    auto end = TwoMergeIterator{};
-    return std::make_optional<std::pair<TwoMergeIterator, TwoMergeIterator>>(
-        start, end);
+
+  // 1. 从最新的 sorted run 开始, 不断合并大小相近的下一个 sorted run
+  TieredCompactTask task;
+  size_t candidate_size = 0;
+  size_t merged_num = 0;
+  size_t idx = 0;
+  if (l0_num > 0) {
+    task.levels.push_back(0);
+    candidate_size = l0_size;
+    merged_num = l0_num;
   } else {
-    auto start = TwoMergeIterator(std::make_shared<HeapIterator>(), l0_iter_ptr,
-                                  tranc_id);
-    auto end = TwoMergeIterator{};
-    return std::make_optional<std::pair<TwoMergeIterator, TwoMergeIterator>>(
-        start, end);
+    task.levels.push_back(level_runs[0].first);
+    candidate_size = level_runs[0].second;
+    merged_num = 1;
+    idx = 1;
+  }
+  for (; idx < level_runs.size(); idx++) {
+    auto [level, level_size] = level_runs[idx];
+    if (level_size * 100 > candidate_size * (100 + opts->tiered_size_ratio)) {
+      break;
+    }
+    task.levels.push_back(level);
+    candidate_size += level_size;
+    merged_num++;
   }
-}
 
-Level_Iterator LSMEngine::begin(uint64_t tranc_id) {
-  return Level_Iterator(shared_from_this(), tranc_id);
-}
+  // 2. sorted run 的数量仍然超限时, 强制继续合并更旧的 sorted run
+  for (; idx < level_runs.size() &&
+         run_num - merged_num + 1 > opts->tiered_max_run_num;
+       idx++) {
+    task.levels.push_back(level_runs[idx].first);
+    merged_num++;
+  }
 
-Level_Iterator LSMEngine::end() { return Level_Iterator{}; }
+  if (merged_num < 2) {
+    // 只有一个 sorted run, 没有合并的必要
+    return std::nullopt;
+  }
 
-void LSMEngine::full_compact(size_t src_level) {
-  // 将 src_level 的 sst 全体压缩到 src_level + 1
+  // 3. 确定输出的 level
+  if (task.levels.back() != 0) {
+    // 输出到参与合并的最旧的 level, 更旧的 level 都没有参与, 新旧顺序不变
+    task.output_level = task.levels.back();
+  } else if (level_runs.empty()) {
+    task.output_level = 1;
+  } else if (level_runs[0].first > 1) {
+    // 只有 l0 参与合并, 输出到最新的 sorted run 之上的空闲 level
+    task.output_level = level_runs[0].first - 1;
+  } else {
+    // l1 已经被更旧的 sorted run 占用, 需要先整体下移
+    task.output_level = 1;
+    task.move_down = true;
+  }
+  return task;
+}
 
-  // 递归地判断下一级 level 是否需要 full compact
-  if (level_sst_ids[src_level + 1].size() >= LSM_SST_LEVEL_RATIO) {
-    full_compact(src_level + 1);
+void LSMEngine::tiered_compact(const TieredCompactTask &task) {
+  // ! 调用者需要持有 compact_mtx
+  if (task.move_down) {
+    move_level_down(1);
   }
 
-  // 获取源level和目标level的 sst_id
-  auto old_level_id_x = level_sst_ids[src_level];
-  auto old_level_id_y = level_sst_ids[src_level + 1];
-  std::vector<std::shared_ptr<SST>> new_ssts;
-  std::vector<size_t> lx_ids(old_level_id_x.begin(), old_level_id_x.end());
-  std::vector<size_t> ly_ids(old_level_id_y.begin(), old_level_id_y.end());
-  if (src_level == 0) {
-    // l0这一层不同sst的key有重叠, 需要额外处理
-    new_ssts = full_l0_l1_compact(lx_ids, ly_ids);
-  } else {
-    new_ssts = full_common_compact(lx_ids, ly_ids, src_level + 1);
+  // 1. 从当前的 Version 中获取参与合并的 sst, 按从新到旧的顺序排列
+  std::vector<std::pair<size_t, std::vector<std::shared_ptr<SST>>>> inputs;
+  auto version = current_version();
+  for (auto level : task.levels) {
+    auto &level_ssts = version->level_ssts(level);
+    if (!level_ssts.empty()) {
+      inputs.emplace_back(level, level_ssts);
+    }
+  }
+  if (inputs.empty()) {
+    return;
   }
-  // 完成 compact 后移除旧的sst记录
-  for (auto &old_sst_id : old_level_id_x) {
-    ssts[old_sst_id]->del_sst();
-    ssts.erase(old_sst_id);
+
+  // 2. 不持有锁的情况下合并, l0 的每个 sst 单独作为一个 sorted run
+  std::vector<std::vector<std::shared_ptr<SST>>> runs;
+  for (auto &[level, level_ssts] : inputs) {
+    if (level == 0) {
+      for (auto &sst : level_ssts) {
+        runs.push_back({sst});
+      }
+    } else {
+      runs.push_back(level_ssts);
+    }
   }
-  for (auto &old_sst_id : old_level_id_y) {
-    ssts[old_sst_id]->del_sst();
-    ssts.erase(old_sst_id);
+  auto new_ssts = compact_sorted_runs(std::move(runs), options.leveled_sst_size(),
+                                      task.output_level);
+
+  // 3. 替换参与合并的 sst
+  install_version(compact_edit(inputs, task.output_level, new_ssts), new_ssts);
+}
+
+void LSMEngine::move_level_down(size_t level) {
+  // ! 调用者需要持有 compact_mtx
+  // 下一层非空时需要先将其下移, 保证 level 越小数据越新
+  if (get_level_sst_num(level + 1) > 0) {
+    move_level_down(level + 1);
   }
-  level_sst_ids[src_level].clear();
-  level_sst_ids[src_level + 1].clear();
 
-  cur_max_level = std::max(cur_max_level, src_level + 1);
+  VersionEdit edit;
+  for (auto &sst : current_version()->level_ssts(level)) {
+    // 文件名中记录了 level, 需要重命名才能在重启后正确加载
+    size_t sst_id = sst->get_sst_id();
+    sst->rename_sst(get_sst_path(sst_id, level + 1));
+    edit.delete_file(level, sst_id);
+    edit.add_file(level + 1, sst);
+  }
+  install_version(std::move(edit), {});
+}
 
-  // 添加新的sst
+VersionEdit LSMEngine::compact_edit(
+    const std::vector<std::pair<size_t, std::vector<std::shared_ptr<SST>>>>
+        &inputs,
+    size_t output_level, const std::vector<std::shared_ptr<SST>> &new_ssts) {
+  VersionEdit edit;
+  for (auto &[level, level_ssts] : inputs) {
+    for (auto &sst : level_ssts) {
+      edit.delete_file(level, sst->get_sst_id());
+      stats->record_tick(Ticker::CompactReadBytes, sst->sst_size());
+    }
+  }
   for (auto &new_sst : new_ssts) {
-    level_sst_ids[src_level + 1].push_back(new_sst->get_sst_id());
-    ssts[new_sst->get_sst_id()] = new_sst;
+    edit.add_file(output_level, new_sst);
+    stats->record_tick(Ticker::CompactWriteBytes, new_sst->sst_size());
   }
-  // 此处没必要reverse了
-  std::sort(level_sst_ids[src_level + 1].begin(),
-            level_sst_ids[src_level + 1].end());
+  return edit;
 }
 
-std::vector<std::shared_ptr<SST>>
-LSMEngine::full_l0_l1_compact(std::vector<size_t> &l0_ids,
-                              std::vector<size_t> &l1_ids) {
-  // TODO: 这里需要补全的是对已经完成事务的删除
-  std::vector<SstIterator> l0_iters;
-  std::vector<std::shared_ptr<SST>> l1_ssts;
-
-  for (auto id : l0_ids) {
-    auto sst_it = ssts[id]->begin(0);
-    l0_iters.push_back(sst_it);
+uint64_t LSMEngine::get_gc_watermark() {
+  std::function<uint64_t()> callback;
+  {
+    std::lock_guard<std::mutex> lock(callback_mtx);
+    callback = gc_watermark_callback;
+  }
+  if (!callback) {
+    // 不知道还有哪些事务需要读旧版本, 保守地保留全部版本
+    return 0;
   }
-  for (auto id : l1_ids) {
-    l1_ssts.push_back(ssts[id]);
+  auto watermark = callback();
+  // 快照与事务一样需要看到 tranc_id 不超过自身的最新版本
+  if (auto oldest = snapshots->oldest(); oldest.has_value()) {
+    watermark = std::min(watermark, oldest.value());
   }
-  // l0 的sst之间的key有重叠, 需要合并
-  auto [l0_begin, l0_end] = SstIterator::merge_sst_iterator(l0_iters, 0);
+  return watermark;
+}
 
-  std::shared_ptr<HeapIterator> l0_begin_ptr = std::make_shared<HeapIterator>();
-  *l0_begin_ptr = l0_begin;
+bool LSMEngine::is_bottommost_level(size_t level) {
+  // Version 中只保存非空的 level
+  return current_version()->max_level() <= level;
+}
 
-  std::shared_ptr<ConcactIterator> old_l1_begin_ptr =
-      std::make_shared<ConcactIterator>(l1_ssts, 0);
+std::vector<std::shared_ptr<SST>> LSMEngine::compact_sorted_runs(
+    std::vector<std::vector<std::shared_ptr<SST>>> runs,
+    size_t target_sst_size, size_t target_level) {
+  // ! 调用者需要持有 compact_mtx, 保证 target_level 之下的 level 不会被修改
+  // watermark 需要在读取 sst 之前获取, 之后开启的事务 tranc_id 都不会更小
+  auto watermark = get_gc_watermark();
+  bool bottommost = is_bottommost_level(target_level);
+
+  auto split_keys = pick_subcompact_split_keys(runs);
+  if (split_keys.empty()) {
+    return compact_range(std::move(runs), watermark, bottommost, std::nullopt,
+                         std::nullopt, target_sst_size, target_level);
+  }
 
-  TwoMergeIterator l0_l1_begin(l0_begin_ptr, old_l1_begin_ptr, 0);
+  // 每个子任务处理 [split_keys[i - 1], split_keys[i]) 范围内的 key
+  // 同一个 key 的所有版本只会落在一个子任务中
+  std::vector<std::future<std::vector<std::shared_ptr<SST>>>> futures;
+  for (size_t i = 0; i <= split_keys.size(); i++) {
+    std::optional<std::string> lower_key;
+    std::optional<std::string> upper_key;
+    if (i > 0) {
+      lower_key = split_keys[i - 1];
+    }
+    if (i < split_keys.size()) {
+      upper_key = split_keys[i];
+    }
+    futures.push_back(compact_pool->submit([this, runs, watermark, bottommost,
+                                            lower_key, upper_key,
+                                            target_sst_size, target_level]() {
+      return compact_range(runs, watermark, bottommost, lower_key, upper_key,
+                           target_sst_size, target_level);
+    }));
+  }
 
-  return gen_sst_from_iter(l0_l1_begin,
-                           LSM_PER_MEM_SIZE_LIMIT * LSM_SST_LEVEL_RATIO, 1);
+  // 子任务的结果按 key 范围的顺序拼接, 由调用者统一安装
+  std::vector<std::shared_ptr<SST>> new_ssts;
+  std::exception_ptr error;
+  for (auto &future : futures) {
+    try {
+      auto sub_ssts = future.get();
+      new_ssts.insert(new_ssts.end(), sub_ssts.begin(), sub_ssts.end());
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+  if (error) {
+    // 任意一个子任务失败, 整个 compact 都不会生效, 清理已经生成的 sst
+    for (auto &sst : new_ssts) {
+      sst->del_sst();
+    }
+    std::rethrow_exception(error);
+  }
+  return new_ssts;
 }
 
-std::vector<std::shared_ptr<SST>>
-LSMEngine::full_common_compact(std::vector<size_t> &lx_ids,
-                               std::vector<size_t> &ly_ids, size_t level_y) {
-  // TODO 需要补全已完成事务的滤除
-  std::vector<std::shared_ptr<SST>> lx_iters;
-  std::vector<std::shared_ptr<SST>> ly_iters;
-
-  for (auto id : lx_ids) {
-    lx_iters.push_back(ssts[id]);
+std::vector<std::string> LSMEngine::pick_subcompact_split_keys(
+    const std::vector<std::vector<std::shared_ptr<SST>>> &runs) {
+  size_t total_size = 0;
+  for (auto &run : runs) {
+    for (auto &sst : run) {
+      total_size += sst->sst_size();
+    }
   }
-  for (auto id : ly_ids) {
-    ly_iters.push_back(ssts[id]);
+  size_t sub_num =
+      std::min<size_t>(options.max_subcompactions,
+                       total_size / mutable_options()->subcompact_min_size);
+  if (sub_num <= 1) {
+    return {};
   }
 
-  std::shared_ptr<ConcactIterator> old_lx_begin_ptr =
-      std::make_shared<ConcactIterator>(lx_iters, 0);
-
-  std::shared_ptr<ConcactIterator> old_ly_begin_ptr =
-      std::make_shared<ConcactIterator>(ly_iters, 0);
-
-  TwoMergeIterator lx_ly_begin(old_lx_begin_ptr, old_ly_begin_ptr, 0);
+  // block 的大小基本一致, 按 block 下边界的分位数划分可以使子任务大小相近
+  std::vector<std::string> block_keys;
+  for (auto &run : runs) {
+    for (auto &sst : run) {
+      for (size_t i = 0; i < sst->num_blocks(); i++) {
+        block_keys.push_back(sst->get_block_boundary_key(i));
+      }
+    }
+  }
+  std::sort(block_keys.begin(), block_keys.end());
+
+  std::vector<std::string> split_keys;
+  for (size_t i = 1; i < sub_num; i++) {
+    auto &key = block_keys[i * block_keys.size() / sub_num];
+    // 分割 key 需要严格递增, 且不能是最小的 key, 否则会产生空的子任务
+    if (key == block_keys.front() ||
+        (!split_keys.empty() && key <= split_keys.back())) {
+      continue;
+    }
+    split_keys.push_back(key);
+  }
+  return split_keys;
+}
 
-  // TODO:如果目标 level 的下一级 level+1 不存在, 则为底层的level,
-  // 可以清理掉删除标记
+std::vector<std::shared_ptr<SST>> LSMEngine::compact_range(
+    std::vector<std::vector<std::shared_ptr<SST>>> runs, uint64_t watermark,
+    bool bottommost, std::optional<std::string> lower_key,
+    std::optional<std::string> upper_key, size_t target_sst_size,
+    size_t target_level) {
+  // 输入 sst 中的范围删除标记, 裁剪到子任务的范围内
+  std::vector<RangeTombstone> tombstones;
+  for (auto &run : runs) {
+    for (auto &sst : run) {
+      auto range_dels = sst->get_range_tombstones();
+      if (range_dels == nullptr) {
+        continue;
+      }
+      for (auto &tombstone : range_dels->tombstones()) {
+        auto begin = tombstone.begin;
+        auto end = tombstone.end;
+        if (lower_key.has_value() && begin < lower_key.value()) {
+          begin = lower_key.value();
+        }
+        if (upper_key.has_value() && end > upper_key.value()) {
+          end = upper_key.value();
+        }
+        if (begin < end) {
+          tombstones.emplace_back(std::move(begin), std::move(end),
+                                  tombstone.tranc_id);
+        }
+      }
+    }
+  }
+  std::shared_ptr<const FragmentedRangeTombstones> range_dels;
+  if (!tombstones.empty()) {
+    range_dels =
+        std::make_shared<const FragmentedRangeTombstones>(std::move(tombstones));
+  }
 
-  return gen_sst_from_iter(lx_ly_begin, LSMEngine::get_sst_size(level_y),
-                           level_y);
+  if (runs.size() == 2) {
+    // full_common_compact 以及只有一个 l0 sst 的 full_l0_l1_compact
+    TwoRunCompactIterator iter(std::move(runs), watermark, bottommost,
+                               std::move(lower_key), std::move(upper_key),
+                               std::move(range_dels), compaction_filter);
+    return gen_sst_from_iter(iter, iter.output_range_tombstones(),
+                             target_sst_size, target_level);
+  }
+  CompactIterator iter(std::move(runs), watermark, bottommost,
+                       std::move(lower_key), std::move(upper_key),
+                       std::move(range_dels), compaction_filter);
+  return gen_sst_from_iter(iter, iter.output_range_tombstones(),
+                           target_sst_size, target_level);
 }
 
+template <size_t kNumRuns>
 std::vector<std::shared_ptr<SST>>
-LSMEngine::gen_sst_from_iter(BaseIterator &iter, size_t target_sst_size,
-                             size_t target_level) {
-  // TODO: 这里需要补全的是对已经完成事务的删除
-
+LSMEngine::gen_sst_from_iter(BasicCompactIterator<kNumRuns> &iter,
+                             std::vector<RangeTombstone> range_dels,
+                             size_t target_sst_size, size_t target_level) {
   std::vector<std::shared_ptr<SST>> new_ssts;
-  auto new_sst_builder = SSTBuilder(LSM_BLOCK_SIZE, true);
-  while (iter.is_valid() && !iter.is_end()) {
+  auto builder = new_sst_builder(target_level);
+  // 范围删除标记按 begin 依次激活, 切分 sst 时跨越边界的部分留给下一个 sst
+  size_t next_range_del = 0;
+  std::vector<RangeTombstone> active_range_dels;
+  auto add_range_del = [&builder](const RangeTombstone &tombstone) {
+    if (tombstone.begin < tombstone.end) {
+      builder.add_range_tombstone(tombstone.begin, tombstone.end,
+                                  tombstone.tranc_id);
+    }
+  };
+  // 复用 key 和 value 的缓冲区, 每个 entry 只复制, 不重新分配内存
+  std::string key;
+  std::string value;
+  std::string last_key;
+  // 位于 file_id 小于 relocate_before 的 blob 文件中的 value 需要重写
+  uint64_t relocate_before =
+      blob_store->relocation_cutoff(mutable_options()->blob_gc_age_cutoff);
+  std::unique_ptr<BlobFileBuilder> blob_builder;
+  while (iter.is_valid()) {
+    key.assign(iter.key());
+    value.assign(iter.value());
+    bool blob_index = iter.is_blob_index();
+    if (blob_index) {
+      auto index = BlobIndex::decode(value);
+      if (index.file_id < relocate_before) {
+        if (blob_builder == nullptr) {
+          blob_builder = new_blob_builder(target_level);
+        }
+        value = blob_builder->add(key, blob_store->read(index)).encode();
+      }
+    }
 
-    new_sst_builder.add((*iter).first, (*iter).second, 0);
-    ++iter;
+    while (next_range_del < range_dels.size() &&
+           range_dels[next_range_del].begin <= key) {
+      active_range_dels.push_back(std::move(range_dels[next_range_del++]));
+    }
+
+    // 同一个 key 的多个版本必须位于同一个 sst 中, 否则 level 内会出现重叠
+    if (builder.estimated_size() >= target_sst_size && key != last_key) {
+      // 标记中位于 key 之前的部分写入当前的 sst
+      std::vector<RangeTombstone> remaining;
+      for (auto &tombstone : active_range_dels) {
+        if (tombstone.end <= key) {
+          add_range_del(tombstone);
+          continue;
+        }
+        add_range_del(RangeTombstone(tombstone.begin, key, tombstone.tranc_id));
+        tombstone.begin = key;
+        remaining.push_back(std::move(tombstone));
+      }
+      active_range_dels = std::move(remaining);
 
-    if (new_sst_builder.estimated_size() >= target_sst_size) {
-      size_t sst_id = next_sst_id++; // TODO: 后续优化并发性
+      size_t sst_id = next_sst_id++;
       std::string sst_path = get_sst_path(sst_id, target_level);
-      auto new_sst = new_sst_builder.build(sst_id, sst_path, this->block_cache);
+      auto new_sst = builder.build(sst_id, sst_path, this->block_cache,
+                                   pin_level_meta(target_level), blob_store);
       new_ssts.push_back(new_sst);
-      new_sst_builder = SSTBuilder(LSM_BLOCK_SIZE, true); // 重置builder
+      builder = new_sst_builder(target_level); // 重置builder
     }
+
+    builder.add(key, value, iter.get_tranc_id(), blob_index);
+    std::swap(last_key, key);
+    ++iter;
+  }
+  for (auto &tombstone : active_range_dels) {
+    add_range_del(tombstone);
   }
-  if (new_sst_builder.estimated_size() > 0) {
-    size_t sst_id = next_sst_id++; // TODO: 后续优化并发性
+  for (; next_range_del < range_dels.size(); next_range_del++) {
+    add_range_del(range_dels[next_range_del]);
+  }
+  if (builder.estimated_size() > 0) {
+    size_t sst_id = next_sst_id++;
     std::string sst_path = get_sst_path(sst_id, target_level);
-    auto new_sst = new_sst_builder.build(sst_id, sst_path, this->block_cache);
+    auto new_sst = builder.build(sst_id, sst_path, this->block_cache,
+                                 pin_level_meta(target_level), blob_store);
     new_ssts.push_back(new_sst);
   }
+  if (blob_builder != nullptr) {
+    // 新的 sst 在返回之后才对读者可见, 此时重写的 blob 文件已经写入磁盘
+    blob_builder->finish();
+  }
 
   return new_ssts;
 }
 
-size_t LSMEngine::get_sst_size(size_t level) {
+FilterType LSMEngine::level_filter_type(size_t level) {
+  // 底层保存了绝大部分数据, 过滤器的内存占用也主要来自底层
+  return level >= options.xor_filter_min_level ? FilterType::Xor8
+                                               : FilterType::BlockedBloom;
+}
+
+CompressionType LSMEngine::level_compression(size_t level) {
+  if (!options.compression) {
+    return CompressionType::None;
+  }
+  // 上层的 sst 很快会被 compact, 使用更快的 LZ4; 底层使用压缩率更高的 Zstd
+  if (level >= options.zstd_min_level &&
+      compression_supported(CompressionType::Zstd)) {
+    return CompressionType::Zstd;
+  }
+  return CompressionType::LZ4;
+}
+
+IOPriority LSMEngine::level_io_priority(size_t level) {
+  if (level == 0) {
+    return IOPriority::Flush;
+  }
+  // 消化 l0 的积压可以更快地解除写入阻塞, 优先于更深层级的 compact
+  return level == 1 ? IOPriority::L0Compaction : IOPriority::Compaction;
+}
+
+SSTBuilder LSMEngine::new_sst_builder(size_t level) {
+  SSTBuilder builder(options.block_size, true, prefix_extractor,
+                     level_filter_type(level), level_compression(level),
+                     options.bloom_bits_per_key);
+  builder.set_rate_limiter(options.rate_limiter, level_io_priority(level));
+  return builder;
+}
+
+std::unique_ptr<BlobFileBuilder> LSMEngine::new_blob_builder(size_t level) {
+  auto builder = blob_store->new_builder();
+  builder->set_rate_limiter(options.rate_limiter, level_io_priority(level));
+  return builder;
+}
+
+bool LSMEngine::pin_level_meta(size_t level) {
+  // l0 的 sst 之间互相重叠, 每次查询都需要访问全部 l0 sst 的元数据
+  return options.pin_l0_meta && level == 0;
+}
+
+size_t LSMEngine::get_level_target_size(size_t level) const {
+  // 与 full compact 中每层最多容纳 sst_level_ratio 个 sst 保持一致
+  return get_sst_size(level) * options.sst_level_ratio;
+}
+
+size_t LSMEngine::get_sst_size(size_t level) const {
   if (level == 0) {
-    return LSM_PER_MEM_SIZE_LIMIT;
+    return options.per_mem_size_limit;
   } else {
-    return LSM_PER_MEM_SIZE_LIMIT *
-           static_cast<size_t>(std::pow(LSM_SST_LEVEL_RATIO, level));
+    return options.per_mem_size_limit *
+           static_cast<size_t>(std::pow(options.sst_level_ratio, level));
   }
 }
 
 // *********************** LSM ***********************
-LSM::LSM(std::string path)
-    : engine(std::make_shared<LSMEngine>(path)),
-      tran_manager_(std::make_shared<TranManager>(path)) {
+LSM::LSM(std::string path, CompactType compact_type,
+         std::shared_ptr<PrefixExtractor> prefix_extractor,
+         std::shared_ptr<MergeOperator> merge_operator,
+         std::shared_ptr<CompactionFilter> compaction_filter)
+    : LSM(std::move(path),
+          make_options(compact_type, std::move(prefix_extractor),
+                       std::move(merge_operator),
+                       std::move(compaction_filter))) {}
+
+LSM::LSM(std::string path, const Options &options)
+    : LSM(std::move(path), options, {}) {}
+
+LSM::LSM(std::string path, const Options &options,
+         const std::vector<ColumnFamilyDescriptor> &column_families)
+    : path_(path), engine(std::make_shared<LSMEngine>(path, options)),
+      tran_manager_(std::make_shared<TranManager>(path, options)),
+      column_families_(std::make_shared<ColumnFamilySet>()) {
   tran_manager_->set_engine(engine);
-  auto check_recover_res = tran_manager_->check_recover();
-  for (auto &[tranc_id, records] : check_recover_res) {
-    tran_manager_->update_max_finished_tranc_id(tranc_id);
-    for (auto &record : records) {
-      if (record.getOperationType() == OperationType::PUT) {
-        engine->put(record.getKey(), record.getValue(), tranc_id);
-      } else if (record.getOperationType() == OperationType::DELETE) {
-        engine->remove(record.getKey(), tranc_id);
-      }
+  column_families_->add(std::make_shared<ColumnFamilyHandle>(
+      ColumnFamilyHandle{0, LSM_DEFAULT_COLUMN_FAMILY, engine}));
+  set_engine_callbacks(*engine);
+
+  // 重放 WAL 之前需要打开全部已有的列族
+  for (auto &[id, name] :
+       ColumnFamilySet::load(get_column_family_file_path())) {
+    auto it = std::find_if(
+        column_families.begin(), column_families.end(),
+        [&name](const ColumnFamilyDescriptor &cf) { return cf.name == name; });
+    open_column_family(id, name,
+                       it == column_families.end() ? Options{} : it->options);
+  }
+  for (auto &descriptor : column_families) {
+    if (get_column_family(descriptor.name) == nullptr) {
+      create_column_family(descriptor.name, descriptor.options);
     }
   }
+
+  // 重放期间只写入 memtable, 结束后再统一刷盘
+  recovery_stats_ =
+      tran_manager_->recover_from_wal([this](std::vector<Record> &records) {
+        replay_records(records);
+        for (auto &record : records) {
+          if (record.getOperationType() == OperationType::COMMIT) {
+            tran_manager_->update_max_finished_tranc_id(record.getTrancId());
+          }
+        }
+      });
+  // ! 重放的数据刷入 sst 之后才能删除旧的 WAL 文件
+  flush_all();
   tran_manager_->init_new_wal();
+  replication_position_ = load_replication_position(get_replication_file_path());
 }
 
 LSM::~LSM() {
   flush_all();
+  // flush 回调中持有列族集合, 后台任务结束前析构可能使后台线程释放最后一个
+  // 引用, 在引擎自己的线程池中析构引擎
+  for (auto &cf : column_families_->all()) {
+    cf->engine->wait_for_bg_jobs();
+  }
   tran_manager_->write_tranc_id_file();
 }
 
+std::string LSM::get_column_family_file_path() const {
+  return path_ + "/COLUMN_FAMILIES";
+}
+
+std::string LSM::get_replication_file_path() const {
+  return path_ + "/REPLICATION";
+}
+
+void LSM::set_engine_callbacks(LSMEngine &cf_engine) {
+  // 后台 flush 完成后需要更新已经刷盘的最大事务id
+  // ! 使用 weak_ptr, 避免 engine 和 tran_manager_ 之间的循环引用
+  std::weak_ptr<TranManager> weak_tran_manager = tran_manager_;
+  std::weak_ptr<ColumnFamilySet> weak_families = column_families_;
+  cf_engine.set_flush_callback(
+      [weak_tran_manager, weak_families](uint64_t) {
+        auto tran_manager = weak_tran_manager.lock();
+        auto families = weak_families.lock();
+        if (tran_manager && families) {
+          // 每个列族分别刷盘, WAL 只能清理到全部列族都已经刷盘的位置
+          tran_manager->update_max_flushed_tranc_id(
+              families->flushed_tranc_id());
+        }
+      });
+  cf_engine.set_gc_watermark_callback([weak_tran_manager]() -> uint64_t {
+    if (auto tran_manager = weak_tran_manager.lock()) {
+      return tran_manager->get_gc_watermark();
+    }
+    return 0;
+  });
+}
+
+std::shared_ptr<ColumnFamilyHandle>
+LSM::open_column_family(uint32_t id, const std::string &name,
+                        const Options &options) {
+  auto cf_engine = std::make_shared<LSMEngine>(
+      path_ + "/cf_" + std::to_string(id), options);
+  set_engine_callbacks(*cf_engine);
+  auto handle = std::make_shared<ColumnFamilyHandle>(
+      ColumnFamilyHandle{id, name, std::move(cf_engine)});
+  column_families_->add(handle);
+  return handle;
+}
+
+std::shared_ptr<ColumnFamilyHandle> LSM::default_column_family() const {
+  return column_families_->get(0);
+}
+
+std::shared_ptr<ColumnFamilyHandle>
+LSM::create_column_family(const std::string &name, const Options &options) {
+  std::lock_guard<std::mutex> lock(column_family_mtx_);
+  if (get_column_family(name) != nullptr) {
+    throw std::runtime_error("Column family already exists: " + name);
+  }
+  uint32_t id = column_families_->all().back()->id + 1;
+  auto handle = open_column_family(id, name, options);
+  // 列族的目录创建之后再记录, 重启时不会打开不存在的列族
+  column_families_->save(get_column_family_file_path());
+  return handle;
+}
+
+std::shared_ptr<ColumnFamilyHandle>
+LSM::get_column_family(const std::string &name) const {
+  return column_families_->get(name);
+}
+
+std::vector<std::shared_ptr<ColumnFamilyHandle>>
+LSM::list_column_families() const {
+  return column_families_->all();
+}
+
+std::shared_ptr<LSMEngine> LSM::get_cf_engine(uint32_t cf_id) const {
+  auto handle = column_families_->get(cf_id);
+  if (handle == nullptr) {
+    throw std::runtime_error("Unknown column family id: " +
+                             std::to_string(cf_id));
+  }
+  return handle->engine;
+}
+
+void LSM::replay_records(std::vector<Record> &records) {
+  std::map<uint32_t, std::vector<Record>> cf_records;
+  for (auto &record : records) {
+    auto type = record.getOperationType();
+    if (type == OperationType::CREATE || type == OperationType::COMMIT ||
+        type == OperationType::ROLLBACK) {
+      continue;
+    }
+    cf_records[record.getColumnFamilyId()].push_back(std::move(record));
+  }
+  for (auto &[cf_id, cf_batch] : cf_records) {
+    auto cf_engine = get_cf_engine(cf_id);
+    // 各个列族分别刷盘, 其他列族的刷盘进度可能落后于当前列族
+    uint64_t flushed = cf_engine->flushed_tranc_id.load();
+    std::erase_if(cf_batch, [flushed](const Record &record) {
+      return record.getTrancId() <= flushed;
+    });
+    cf_engine->replay_records(cf_batch);
+  }
+}
+
 std::optional<std::string> LSM::get(const std::string &key) {
-  auto tranc_id = tran_manager_->getNextTransactionId();
+  auto tranc_id = tran_manager_->get_read_tranc_id();
+  auto res = engine->get(key, tranc_id);
+
+  if (res.has_value()) {
+    return res.value().first;
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string> LSM::get(const std::string &key,
+                                    uint64_t tranc_id) {
   auto res = engine->get(key, tranc_id);
+  if (res.has_value()) {
+    return res.value().first;
+  }
+  return std::nullopt;
+}
+
+std::shared_ptr<const Snapshot> LSM::get_snapshot() {
+  // 快照可能存活很久, 分配一个新的 tranc_id, 保证后台 compact 已经读取的
+  // watermark 不会大于快照的 tranc_id
+  return engine->get_snapshot(tran_manager_->getNextTransactionId());
+}
 
+std::optional<std::string> LSM::get(const std::string &key,
+                                    const Snapshot &snapshot) {
+  auto res = engine->get(key, snapshot);
   if (res.has_value()) {
     return res.value().first;
   }
@@ -635,8 +2648,8 @@ std::optional<std::string> LSM::get(const std::string &key) {
 
 std::vector<std::pair<std::string, std::optional<std::string>>>
 LSM::get_batch(const std::vector<std::string> &keys) {
-  // 1. 获取事务ID
-  auto tranc_id = tran_manager_->getNextTransactionId();
+  // 1. 获取读取使用的事务ID
+  auto tranc_id = tran_manager_->get_read_tranc_id();
 
   // 2. 调用 engine 的批量查询接口
   auto batch_results = engine->get_batch(keys, tranc_id);
@@ -654,49 +2667,367 @@ LSM::get_batch(const std::vector<std::string> &keys) {
   return results;
 }
 
+std::optional<std::string> LSM::get(const ColumnFamilyHandle &cf,
+                                    const std::string &key) {
+  auto res = cf.engine->get(key, tran_manager_->get_read_tranc_id());
+  if (res.has_value()) {
+    return res.value().first;
+  }
+  return std::nullopt;
+}
+
+// ! 不经过事务的写入也需要通过 commit_writes 记录到冲突表中,
+// ! 这样正在提交的事务要么检测到冲突, 要么先于这次写入完成
 void LSM::put(const std::string &key, const std::string &value) {
+  put(*default_column_family(), key, value);
+}
+
+void LSM::put(const ColumnFamilyHandle &cf, const std::string &key,
+              const std::string &value) {
+  if (engine->options.wal_all_writes) {
+    WriteBatch batch;
+    batch.put(cf, key, value);
+    write(std::move(batch));
+    return;
+  }
+  StopWatch watch(cf.engine->stats.get(), HistogramType::Write);
   auto tranc_id = tran_manager_->getNextTransactionId();
-  engine->put(key, value, tranc_id);
+  tran_manager_->commit_writes({encode_cf_key(cf.id, key)}, [&]() {
+    cf.engine->put(key, value, tranc_id);
+  });
 }
 
 void LSM::put_batch(
     const std::vector<std::pair<std::string, std::string>> &kvs) {
+  if (engine->options.wal_all_writes) {
+    WriteBatch batch;
+    for (auto &[k, v] : kvs) {
+      batch.put(k, v);
+    }
+    write(std::move(batch));
+    return;
+  }
+  StopWatch watch(engine->stats.get(), HistogramType::Write);
   auto tranc_id = tran_manager_->getNextTransactionId();
-  engine->put_batch(kvs, tranc_id);
+  std::vector<std::string> keys;
+  keys.reserve(kvs.size());
+  for (auto &[k, v] : kvs) {
+    keys.push_back(encode_cf_key(0, k));
+  }
+  tran_manager_->commit_writes(
+      keys, [&]() { engine->put_batch(kvs, tranc_id); });
 }
+
 void LSM::remove(const std::string &key) {
+  remove(*default_column_family(), key);
+}
+
+void LSM::remove(const ColumnFamilyHandle &cf, const std::string &key) {
+  if (engine->options.wal_all_writes) {
+    WriteBatch batch;
+    batch.remove(cf, key);
+    write(std::move(batch));
+    return;
+  }
+  StopWatch watch(cf.engine->stats.get(), HistogramType::Write);
   auto tranc_id = tran_manager_->getNextTransactionId();
-  engine->remove(key, tranc_id);
+  tran_manager_->commit_writes({encode_cf_key(cf.id, key)},
+                               [&]() { cf.engine->remove(key, tranc_id); });
 }
 
 void LSM::remove_batch(const std::vector<std::string> &keys) {
+  if (engine->options.wal_all_writes) {
+    WriteBatch batch;
+    for (auto &key : keys) {
+      batch.remove(key);
+    }
+    write(std::move(batch));
+    return;
+  }
+  StopWatch watch(engine->stats.get(), HistogramType::Write);
+  auto tranc_id = tran_manager_->getNextTransactionId();
+  std::vector<std::string> cf_keys;
+  cf_keys.reserve(keys.size());
+  for (auto &key : keys) {
+    cf_keys.push_back(encode_cf_key(0, key));
+  }
+  tran_manager_->commit_writes(
+      cf_keys, [&]() { engine->remove_batch(keys, tranc_id); });
+}
+
+void LSM::remove_range(const std::string &begin, const std::string &end) {
+  WriteBatch batch;
+  batch.remove_range(begin, end);
+  write(std::move(batch));
+}
+
+uint64_t LSM::merge(const std::string &key, const std::string &operand) {
+  WriteBatch batch;
+  batch.merge(key, operand);
+  return write(std::move(batch));
+}
+
+uint64_t LSM::write(WriteBatch &&batch) {
+  if (batch.empty()) {
+    return 0;
+  }
+  StopWatch watch(engine->stats.get(), HistogramType::Write);
+  auto tranc_id = tran_manager_->getNextTransactionId();
+  auto records = batch.take_records(tranc_id);
+  // 按列族拆分, 去掉首尾的 CREATE 和 COMMIT
+  std::map<uint32_t, std::vector<Record>> cf_records;
+  for (size_t i = 1; i + 1 < records.size(); i++) {
+    cf_records[records[i].getColumnFamilyId()].push_back(
+        std::move(records[i]));
+  }
+  records.erase(records.begin() + 1, records.end());
+  std::vector<std::string> keys;
+  std::vector<std::pair<std::shared_ptr<LSMEngine>, size_t>> cf_writes;
+  for (auto &[cf_id, cf_batch] : cf_records) {
+    // WAL 中记录的是合并之后的结果, 重放时不需要再次合并
+    auto cf_engine = get_cf_engine(cf_id);
+    cf_engine->fold_batch_merges(cf_batch);
+    for (auto &record : cf_batch) {
+      record.setColumnFamilyId(cf_id); // 合并生成的记录需要重新设置
+      if (record.getOperationType() == OperationType::PUT ||
+          record.getOperationType() == OperationType::DELETE ||
+          record.getOperationType() == OperationType::MERGE) {
+        keys.push_back(encode_cf_key(cf_id, record.getKey()));
+      }
+    }
+    cf_writes.emplace_back(std::move(cf_engine), cf_batch.size());
+    std::move(cf_batch.begin(), cf_batch.end(), std::back_inserter(records));
+  }
+  records.push_back(Record::commitRecord(tranc_id));
+  tran_manager_->commit_writes(keys, [&]() {
+    // 先刷入wal
+    if (!tran_manager_->write_to_wal(records)) {
+      throw std::runtime_error("write to wal failed");
+    }
+    if (cf_writes.size() == 1) {
+      cf_writes.front().first->write_records(records);
+      return;
+    }
+    // 各个列族的记录在 records 中是连续的
+    size_t begin = 1;
+    for (auto &[cf_engine, count] : cf_writes) {
+      cf_engine->write_records(std::vector<Record>(
+          records.begin() + begin, records.begin() + begin + count));
+      begin += count;
+    }
+  });
+  tran_manager_->update_max_finished_tranc_id(tranc_id);
+  return tranc_id;
+}
+
+uint64_t LSM::ingest_external_files(const std::vector<std::string> &paths) {
+  return ingest_external_files(*default_column_family(), paths);
+}
+
+uint64_t LSM::ingest_external_files(const ColumnFamilyHandle &cf,
+                                    const std::vector<std::string> &paths) {
+  // 导入的数据不经过 WAL, 需要立即记录 tranc_id 的分配进度,
+  // 否则崩溃重启后新写入的 tranc_id 可能小于导入的文件
   auto tranc_id = tran_manager_->getNextTransactionId();
-  engine->remove_batch(keys, tranc_id);
+  cf.engine->ingest_external_files(paths, tranc_id);
+  tran_manager_->update_max_finished_tranc_id(tranc_id);
+  tran_manager_->write_tranc_id_file();
+  return tranc_id;
+}
+
+void LSM::create_checkpoint(const std::string &dir) {
+  if (std::filesystem::exists(dir)) {
+    throw std::runtime_error("Checkpoint directory already exists: " + dir);
+  }
+  // 检查点作为从节点打开时, 从开始创建检查点时的位置继续复制
+  // 之后到检查点完成之间的事务会重复应用
+  WalPosition position;
+  {
+    std::lock_guard<std::mutex> lock(replication_mtx_);
+    position = replication_position_.value_or(tran_manager_->get_wal_position());
+  }
+  // 不经过事务的写入没有 WAL, 只能先刷盘; 同时写入的数据由 WAL 恢复或者不包含在
+  // 检查点中, 不需要等待
+  for (auto &cf : column_families_->all()) {
+    size_t table_num = cf->engine->memtable.get_tables().size();
+    for (size_t i = 0; i < table_num; i++) {
+      cf->engine->flush();
+    }
+  }
+  // 在临时目录中创建, 完成后再重命名, 中途失败不会留下不完整的检查点
+  auto tmp_dir = dir + ".tmp";
+  std::filesystem::remove_all(tmp_dir);
+  try {
+    std::lock_guard<std::mutex> lock(column_family_mtx_);
+    std::filesystem::create_directories(tmp_dir);
+    tran_manager_->create_checkpoint(tmp_dir, [&]() {
+      // WAL 只需要从全部列族中最慢的刷盘进度开始恢复
+      uint64_t checkpoint_tranc_id = UINT64_MAX;
+      for (auto &cf : column_families_->all()) {
+        auto cf_dir =
+            cf->id == 0 ? tmp_dir : tmp_dir + "/cf_" + std::to_string(cf->id);
+        checkpoint_tranc_id =
+            std::min(checkpoint_tranc_id, cf->engine->create_checkpoint(cf_dir));
+      }
+      return checkpoint_tranc_id;
+    });
+    column_families_->save(tmp_dir + "/COLUMN_FAMILIES");
+    save_replication_position(tmp_dir + "/REPLICATION", position);
+    std::filesystem::rename(tmp_dir, dir);
+  } catch (...) {
+    std::error_code ec;
+    std::filesystem::remove_all(tmp_dir, ec);
+    throw;
+  }
+}
+
+WalPosition LSM::get_wal_position() {
+  return tran_manager_->get_wal_position();
+}
+
+ReplicationBatch LSM::read_replication_log(const WalPosition &from,
+                                           size_t max_bytes) {
+  std::vector<Record> records;
+  ReplicationBatch batch;
+  batch.next = tran_manager_->read_wal(from, max_bytes, records);
+  // 一个事务的全部记录在 WAL 中是一次写入, 不会跨越读取的边界
+  // 组提交时多个事务的记录依次排列, 只保留已经提交的事务
+  std::unordered_map<uint64_t, std::vector<Record>> trancs;
+  for (auto &record : records) {
+    auto tranc_id = record.getTrancId();
+    switch (record.getOperationType()) {
+    case OperationType::COMMIT: {
+      auto &tranc = trancs[tranc_id];
+      std::move(tranc.begin(), tranc.end(), std::back_inserter(batch.records));
+      batch.records.push_back(std::move(record));
+      trancs.erase(tranc_id);
+      break;
+    }
+    case OperationType::ROLLBACK:
+      trancs.erase(tranc_id);
+      break;
+    default:
+      trancs[tranc_id].push_back(std::move(record));
+    }
+  }
+  return batch;
+}
+
+void LSM::apply_replication_batch(const ReplicationBatch &batch) {
+  std::lock_guard<std::mutex> lock(replication_mtx_);
+  if (!batch.records.empty()) {
+    // 写入 WAL 之前确认全部列族都存在, 否则重启时无法重放
+    std::map<uint32_t, std::pair<std::shared_ptr<LSMEngine>, std::vector<Record>>>
+        cf_records;
+    uint64_t max_tranc_id = 0;
+    for (auto &record : batch.records) {
+      max_tranc_id = std::max(max_tranc_id, record.getTrancId());
+      auto type = record.getOperationType();
+      if (type == OperationType::CREATE || type == OperationType::COMMIT ||
+          type == OperationType::ROLLBACK) {
+        continue;
+      }
+      auto &[cf_engine, cf_batch] = cf_records[record.getColumnFamilyId()];
+      if (cf_engine == nullptr) {
+        cf_engine = get_cf_engine(record.getColumnFamilyId());
+      }
+      cf_batch.push_back(record);
+    }
+    if (!tran_manager_->write_to_wal(batch.records)) {
+      throw std::runtime_error("write to wal failed");
+    }
+    for (auto &[cf_id, cf_write] : cf_records) {
+      cf_write.first->write_records(cf_write.second);
+    }
+    // 推进 tranc_id 之后读取才能看到这一批事务, 本地之后分配的 tranc_id
+    // 也不会小于主节点的记录
+    tran_manager_->update_next_tranc_id(max_tranc_id);
+    tran_manager_->update_max_finished_tranc_id(max_tranc_id);
+  }
+  if (replication_position_ != batch.next) {
+    save_replication_position(get_replication_file_path(), batch.next);
+    replication_position_ = batch.next;
+  }
+}
+
+std::optional<WalPosition> LSM::get_replication_position() {
+  std::lock_guard<std::mutex> lock(replication_mtx_);
+  return replication_position_;
 }
 
-void LSM::clear() { engine->clear(); }
+void LSM::clear() {
+  for (auto &cf : column_families_->all()) {
+    cf->engine->clear();
+  }
+}
 
-void LSM::flush() { auto max_tranc_id = engine->flush(); }
+void LSM::flush() { engine->flush(); }
 
 void LSM::flush_all() {
-  while (engine->memtable.get_total_size() > 0) {
-    auto max_tranc_id = engine->flush();
-    tran_manager_->update_max_flushed_tranc_id(max_tranc_id);
+  // flush 完成后会通过回调更新 max_flushed_tranc_id
+  for (auto &cf : column_families_->all()) {
+    while (cf->engine->memtable.get_total_size() > 0) {
+      cf->engine->flush();
+    }
+  }
+}
+
+const WalRecoveryStats &LSM::get_recovery_stats() const {
+  return recovery_stats_;
+}
+
+EngineStats LSM::get_stats() { return engine->get_stats(); }
+
+const Options &LSM::get_options() const { return engine->options; }
+
+MutableOptions LSM::get_mutable_options() const {
+  return *engine->mutable_options();
+}
+
+void LSM::set_options(const MutableOptions &options) {
+  engine->set_options(options);
+}
+
+RangeIterator LSM::new_iterator(ReadOptions options) {
+  return new_iterator(*default_column_family(), std::move(options));
+}
+
+RangeIterator LSM::new_iterator(const ColumnFamilyHandle &cf,
+                                ReadOptions options) {
+  if (options.snapshot == nullptr && options.tranc_id == 0) {
+    options.tranc_id = tran_manager_->get_read_tranc_id();
   }
+  return RangeIterator(cf.engine, std::move(options));
 }
 
 LSM::LSMIterator LSM::begin(uint64_t tranc_id) {
   return engine->begin(tranc_id);
 }
 
+LSM::LSMIterator LSM::begin(const Snapshot &snapshot) {
+  return engine->begin(snapshot);
+}
+
 LSM::LSMIterator LSM::end() { return engine->end(); }
 
-std::optional<std::pair<TwoMergeIterator, TwoMergeIterator>>
+std::optional<std::pair<MergeIterator, MergeIterator>>
 LSM::lsm_iters_monotony_predicate(
     uint64_t tranc_id, std::function<int(const std::string &)> predicate) {
   return engine->lsm_iters_monotony_predicate(tranc_id, predicate);
 }
 
+std::optional<std::pair<MergeIterator, MergeIterator>>
+LSM::lsm_iters_monotony_predicate(
+    const Snapshot &snapshot,
+    std::function<int(const std::string &)> predicate) {
+  return engine->lsm_iters_monotony_predicate(snapshot, std::move(predicate));
+}
+
+std::optional<std::pair<MergeIterator, MergeIterator>>
+LSM::lsm_iters_preffix(uint64_t tranc_id, const std::string &preffix) {
+  return engine->lsm_iters_preffix(tranc_id, preffix);
+}
+
 // 开启一个事务
 std::shared_ptr<TranContext>
 LSM::begin_tran(const IsolationLevel &isolation_level) {
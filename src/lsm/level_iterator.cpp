@@ -1,68 +1,114 @@
 #include "../../include/lsm/level_iterator.h"
 #include "../../include/lsm/engine.h"
+#include "../../include/lsm/snapshot.h"
 #include "../../include/sst/concact_iterator.h"
 #include "../../include/sst/sst.h"
 #include <memory>
-#include <shared_mutex>
 #include <string>
 
 // TODO: 需要进行单元测试
 Level_Iterator::Level_Iterator(std::shared_ptr<LSMEngine> engine,
                                uint64_t max_tranc_id)
-    : engine_(engine), max_tranc_id_(max_tranc_id), rlock_(engine_->ssts_mtx) {
-  // 成员变量获取sst读锁
+    : engine_(engine), max_tranc_id_(max_tranc_id) {
+  // 内存表需要先于 Version 获取, 避免漏掉两者之间刷盘的数据
+  auto mem_tables = engine_->memtable.get_tables();
+  auto mem_iter = MemTable::tables_begin(mem_tables, max_tranc_id_);
+  version_ = engine_->current_version();
+  init(std::move(mem_iter), mem_tables);
+}
+
+Level_Iterator::Level_Iterator(std::shared_ptr<LSMEngine> engine,
+                               const Snapshot &snapshot)
+    : engine_(engine), max_tranc_id_(snapshot.get_tranc_id()),
+      version_(snapshot.get_version()) {
+  init(MemTable::tables_begin(snapshot.get_mem_tables(), max_tranc_id_),
+       snapshot.get_mem_tables());
+}
+
+void Level_Iterator::init(
+    HeapIterator mem_iter,
+    const std::vector<std::shared_ptr<SkipList>> &mem_tables) {
+  mem_tables_ = mem_tables;
+  // 0. 收集范围删除标记, 标记只删除比自身更旧的版本, 不需要区分来源
+  std::vector<std::shared_ptr<const FragmentedRangeTombstones>> range_dels;
+  for (auto &table : mem_tables) {
+    if (auto table_range_dels = table->get_range_tombstones()) {
+      range_dels.push_back(std::move(table_range_dels));
+    }
+  }
+  for (auto &[level, level_ssts] : version_->levels()) {
+    for (auto &sst : level_ssts) {
+      if (auto sst_range_dels = sst->get_range_tombstones()) {
+        range_dels.push_back(std::move(sst_range_dels));
+      }
+    }
+  }
+  range_dels_ = merge_range_tombstones(range_dels);
 
   // 1. 获取内存部分迭代器
   // TODO: 这里最好修改 memtable.begin 使其返回一个指针, 避免多余的内存拷贝
-  auto mem_iter = engine_->memtable.begin(max_tranc_id_);
   std::shared_ptr<HeapIterator> mem_iter_ptr = std::make_shared<HeapIterator>();
   *mem_iter_ptr = mem_iter;
   iter_vec.push_back(mem_iter_ptr);
 
   // 2. 获取 L0 层的迭代器
   std::vector<SearchItem> item_vec;
-  for (auto &sst_id : engine_->level_sst_ids[0]) {
-    auto sst = engine_->ssts[sst_id];
+  for (auto &sst : version_->level_ssts(0)) {
+    size_t sst_id = sst->get_sst_id();
     for (auto iter = sst->begin(max_tranc_id_);
          iter.is_valid() && iter != sst->end(); ++iter) {
       // 这里越新的sst的idx越大, 我们需要让新的sst优先在堆顶
       // 让新的sst(拥有更大的idx)排序在前面, 反转符号就行了
-      if (max_tranc_id_ != 0 && iter.get_tranc_id() > max_tranc_id_) {
+      // get_tranc_id 返回的是迭代器的 max_tranc_id, 需要记录条目自身的
+      if (max_tranc_id_ != 0 && iter.get_entry_tranc_id() > max_tranc_id_) {
         // 如果开启了事务, 比当前事务 id 更大的记录是不可见的
         continue;
       }
-      item_vec.emplace_back(iter.key(), iter.value(), -sst_id, 0,
-                            iter.get_tranc_id());
+      item_vec.emplace_back(std::string(iter.key()), std::string(iter.value()),
+                            -sst_id, 0, iter.get_entry_tranc_id());
     }
   }
   std::shared_ptr<HeapIterator> l0_iter_ptr =
-      std::make_shared<HeapIterator>(item_vec, max_tranc_id);
+      std::make_shared<HeapIterator>(item_vec, max_tranc_id_);
   iter_vec.push_back(l0_iter_ptr);
 
   // 3. 获取其他层的迭代器
-  for (auto &[level, sst_id_list] : engine_->level_sst_ids) {
+  for (auto &[level, level_ssts] : version_->levels()) {
     if (level == 0) {
       continue;
     }
     std::vector<std::shared_ptr<SST>> ssts;
-    for (auto sst_id : sst_id_list) {
-      auto sst = engine_->ssts[sst_id];
+    for (auto &sst : level_ssts) {
       ssts.push_back(sst);
       std::shared_ptr<ConcactIterator> level_i_iter =
-          std::make_shared<ConcactIterator>(ssts, max_tranc_id);
+          std::make_shared<ConcactIterator>(ssts, max_tranc_id_);
       iter_vec.push_back(level_i_iter);
     }
   }
 
+  find_next();
+}
+
+void Level_Iterator::find_next() {
   while (!is_end()) {
-    auto [min_idx, _] = get_min_key_idx();
-    cur_idx_ = min_idx;
-    update_current();
-    auto cached_kv = *cached_value;
-    if (cached_kv.second.size() == 0) {
-      // 如果当前值为空, 说明当前key已经被删除了
+    cur_idx_ = get_min_key_idx();
+    merged_value_.reset();
+    bool deleted = value().empty() || range_deleted();
+    if (!deleted && iter_vec[cur_idx_]->is_merge_operand()) {
+      // 最新的版本是 merge 操作数, 与更旧的版本合并
+      auto merged = engine_->merge_get_(std::string(key()), max_tranc_id_,
+                                        mem_tables_, *version_);
+      if (merged.has_value()) {
+        merged_value_ = std::move(merged->first);
+      } else {
+        deleted = true;
+      }
+    }
+    if (deleted) {
+      // 如果当前值为空或者被范围删除覆盖, 说明当前key已经被删除了
       // 需要跳过这个key
-      skip_key(cached_value->first);
+      cur_key_.assign(key());
+      skip_key(cur_key_);
       continue;
     } else {
       // 找到一个合法的键值对, 跳出循环
@@ -71,22 +117,25 @@ Level_Iterator::Level_Iterator(std::shared_ptr<LSMEngine> engine,
   }
 }
 
-std::pair<size_t, std::string> Level_Iterator::get_min_key_idx() const {
-  size_t min_idx = 0;
-  std::string min_key = "";
+bool Level_Iterator::range_deleted() const {
+  return range_dels_ != nullptr &&
+         range_dels_->max_covering(key(), max_tranc_id_) >
+             iter_vec[cur_idx_]->get_entry_tranc_id();
+}
+
+size_t Level_Iterator::get_min_key_idx() const {
+  size_t min_idx = iter_vec.size();
   for (size_t i = 0; i < iter_vec.size(); ++i) {
     if (!iter_vec[i]->is_valid()) {
       // 如果当前迭代器无效, 则跳过
       continue;
-    } else if (min_key == "") {
+    } else if (min_idx == iter_vec.size()) {
       // 第一次初始化
-      min_key = (**iter_vec[i]).first;
       min_idx = i;
-    } else if ((**iter_vec[i]).first < (**iter_vec[min_idx]).first) {
+    } else if (iter_vec[i]->key() < iter_vec[min_idx]->key()) {
       // 更新最小key和索引
-      min_key = (**iter_vec[i]).first;
       min_idx = i;
-    } else if ((**iter_vec[i]).first == min_key) {
+    } else if (iter_vec[i]->key() == iter_vec[min_idx]->key()) {
       // key相同时, 事务id大的排前面
       if (max_tranc_id_ != 0) {
         if ((*iter_vec[i]).get_tranc_id() >
@@ -96,12 +145,14 @@ std::pair<size_t, std::string> Level_Iterator::get_min_key_idx() const {
       }
     }
   }
-  return std::make_pair(min_idx, min_key);
+  return min_idx;
 }
 
-void Level_Iterator::skip_key(const std::string &key) {
+void Level_Iterator::skip_key(std::string_view key) {
+  cached_value = std::nullopt;
+  merged_value_.reset();
   for (size_t i = 0; i < iter_vec.size(); ++i) {
-    while ((*iter_vec[i]).is_valid() && (**iter_vec[i]).first == key) {
+    while ((*iter_vec[i]).is_valid() && iter_vec[i]->key() == key) {
       // 如果找到当前key, 则跳过这个key
       ++(*iter_vec[i]);
     }
@@ -112,30 +163,19 @@ void Level_Iterator::update_current() const {
   if (!(*iter_vec[cur_idx_]).is_valid()) {
     throw std::runtime_error("Level_Iterator is invalid");
   }
-  // Ensure cached_value points to the correct value_type
-  auto cur_kv = *(*iter_vec[cur_idx_]);
-  cached_value = std::make_optional<value_type>(cur_kv.first, cur_kv.second);
+  if (!cached_value.has_value()) {
+    cached_value =
+        std::make_optional<value_type>(std::string(key()), std::string(value()));
+  }
 }
 
 BaseIterator &Level_Iterator::operator++() {
-  // 先跳过和当前 key 相同的部分
-  skip_key(cached_value->first);
+  // 先跳过和当前 key 相同的部分, 推进之前复制当前 key
+  cur_key_.assign(key());
+  skip_key(cur_key_);
 
   // 重新选择key最小的迭代器
-  while (!is_end()) {
-    auto [min_idx, _] = get_min_key_idx();
-    cur_idx_ = min_idx;
-    update_current();
-    if (cached_value->second.size() == 0) {
-      // 如果当前值为空, 说明当前key已经被删除了
-      // 需要跳过这个key
-      skip_key(cached_value->first);
-      continue;
-    } else {
-      // 找到一个合法的键值对, 跳出循环
-      break;
-    }
-  }
+  find_next();
   return *this;
 }
 
@@ -144,8 +184,7 @@ bool Level_Iterator::operator==(const BaseIterator &other) const {
     return false;
   }
   if (other.is_valid() && is_valid()) {
-    return (*other).first == cached_value->first &&
-           (*other).second == cached_value->second;
+    return other.key() == key() && other.value() == value();
   }
   if (!other.is_valid() && !is_valid()) {
     return true;
@@ -158,10 +197,25 @@ bool Level_Iterator::operator!=(const BaseIterator &other) const {
 }
 
 BaseIterator::value_type Level_Iterator::operator*() const {
-  if (!cached_value.has_value()) {
+  update_current();
+  return *cached_value;
+}
+
+std::string_view Level_Iterator::key() const {
+  if (is_end()) {
     throw std::runtime_error("Level_Iterator is invalid");
   }
-  return *cached_value;
+  return iter_vec[cur_idx_]->key();
+}
+
+std::string_view Level_Iterator::value() const {
+  if (is_end()) {
+    throw std::runtime_error("Level_Iterator is invalid");
+  }
+  if (merged_value_.has_value()) {
+    return merged_value_.value();
+  }
+  return iter_vec[cur_idx_]->value();
 }
 
 IteratorType Level_Iterator::get_type() const {
@@ -0,0 +1,198 @@
+#include "../../include/lsm/merge_iterator.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+MergeIterator::MergeIterator(
+    std::vector<std::shared_ptr<BaseIterator>> sources, uint64_t max_tranc_id,
+    std::function<int(const std::string &)> predicate,
+    RangeDelSources range_dels, MergeResolver resolver,
+    std::optional<std::string> bound, bool reverse)
+    : max_tranc_id_(max_tranc_id), predicate_(std::move(predicate)),
+      range_dels_(std::move(range_dels)), resolver_(std::move(resolver)),
+      bound_(std::move(bound)), reverse_(reverse) {
+  if (reverse_ && predicate_) {
+    throw std::runtime_error("MergeIterator: predicate in reverse iteration");
+  }
+  cursors_.resize(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    cursors_[i].iter = std::move(sources[i]);
+    if (cursors_[i].iter != nullptr && load(cursors_[i])) {
+      heap_.push_back(i);
+    }
+  }
+  auto cmp = [this](size_t a, size_t b) { return cursor_greater(a, b); };
+  std::make_heap(heap_.begin(), heap_.end(), cmp);
+
+  find_next();
+}
+
+bool MergeIterator::load(Cursor &cursor) {
+  if (!cursor.iter->is_valid()) {
+    return false;
+  }
+  cursor.key = cursor.iter->key();
+  if (bound_.has_value() &&
+      (reverse_ ? cursor.key < bound_.value() : cursor.key >= bound_.value())) {
+    return false;
+  }
+  if (predicate_) {
+    predicate_key_.assign(cursor.key);
+    if (predicate_(predicate_key_) < 0) {
+      // 数据源之后的 key 只会更大, 不需要继续读取
+      return false;
+    }
+  }
+  cursor.tranc_id = cursor.iter->get_entry_tranc_id();
+  return true;
+}
+
+bool MergeIterator::range_deleted(size_t idx) const {
+  auto &cursor = cursors_[idx];
+  for (auto &[source, range_dels] : range_dels_) {
+    if (source > idx) {
+      break;
+    }
+    if (range_dels->max_covering(cursor.key, max_tranc_id_) > cursor.tranc_id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MergeIterator::cursor_greater(size_t a, size_t b) const {
+  auto key_a = cursors_[a].key;
+  auto key_b = cursors_[b].key;
+  if (key_a != key_b) {
+    return reverse_ ? key_a < key_b : key_a > key_b;
+  }
+  // 同一个数据源中的记录已经按 tranc_id 降序排列, 不同数据源之间新的优先
+  return a > b;
+}
+
+size_t MergeIterator::pop() {
+  auto cmp = [this](size_t a, size_t b) { return cursor_greater(a, b); };
+  std::pop_heap(heap_.begin(), heap_.end(), cmp);
+  size_t idx = heap_.back();
+  heap_.pop_back();
+  return idx;
+}
+
+void MergeIterator::advance(size_t idx) {
+  auto &cursor = cursors_[idx];
+  if (reverse_) {
+    --(*cursor.iter);
+  } else {
+    ++(*cursor.iter);
+  }
+  if (load(cursor)) {
+    auto cmp = [this](size_t a, size_t b) { return cursor_greater(a, b); };
+    heap_.push_back(idx);
+    std::push_heap(heap_.begin(), heap_.end(), cmp);
+  }
+}
+
+void MergeIterator::skip_cur_key(size_t idx) {
+  advance(idx);
+  // 剩余的相同 key 的记录都比输出的版本更旧, 包括同一个数据源中的旧版本
+  while (!heap_.empty() && cursors_[heap_.front()].key == cur_key_) {
+    advance(pop());
+  }
+}
+
+void MergeIterator::find_next() {
+  cur_.reset();
+  merged_value_.reset();
+  cur_idx_ = SIZE_MAX;
+  while (!heap_.empty()) {
+    size_t idx = pop();
+    auto &cursor = cursors_[idx];
+    if (max_tranc_id_ != 0 && cursor.tranc_id > max_tranc_id_) {
+      // 不可见的版本, 同一个数据源中之后可能还有更旧的可见版本
+      advance(idx);
+      continue;
+    }
+    cur_key_.assign(cursor.key);
+    if (cursor.iter->value().empty() || range_deleted(idx)) {
+      // 被删除的 key
+      skip_cur_key(idx);
+      continue;
+    }
+    if (cursor.iter->is_merge_operand()) {
+      if (!resolver_) {
+        throw std::runtime_error("MergeIterator: merge operand without resolver");
+      }
+      merged_value_ = resolver_(cur_key_);
+      if (!merged_value_.has_value()) {
+        skip_cur_key(idx);
+        continue;
+      }
+    }
+    // 先跳过其他数据源中相同的 key, 当前 cursor 留在原地, 视图保持有效
+    while (!heap_.empty() && cursors_[heap_.front()].key == cur_key_) {
+      advance(pop());
+    }
+    cur_idx_ = idx;
+    return;
+  }
+}
+
+BaseIterator &MergeIterator::operator++() {
+  if (cur_idx_ != SIZE_MAX) {
+    skip_cur_key(cur_idx_);
+    find_next();
+  }
+  return *this;
+}
+
+bool MergeIterator::operator==(const BaseIterator &other) const {
+  if (other.get_type() != IteratorType::MergeIterator) {
+    return false;
+  }
+  if (is_end() && other.is_end()) {
+    return true;
+  }
+  return this == &other;
+}
+
+bool MergeIterator::operator!=(const BaseIterator &other) const {
+  return !(*this == other);
+}
+
+MergeIterator::value_type MergeIterator::operator*() const {
+  return std::make_pair(std::string(key()), std::string(value()));
+}
+
+std::string_view MergeIterator::key() const {
+  if (cur_idx_ == SIZE_MAX) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return cursors_[cur_idx_].key;
+}
+
+std::string_view MergeIterator::value() const {
+  if (cur_idx_ == SIZE_MAX) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  if (merged_value_.has_value()) {
+    return merged_value_.value();
+  }
+  return cursors_[cur_idx_].iter->value();
+}
+
+MergeIterator::pointer MergeIterator::operator->() const {
+  if (!cur_.has_value()) {
+    cur_ = **this;
+  }
+  return &cur_.value();
+}
+
+IteratorType MergeIterator::get_type() const {
+  return IteratorType::MergeIterator;
+}
+
+uint64_t MergeIterator::get_tranc_id() const { return max_tranc_id_; }
+
+bool MergeIterator::is_end() const { return cur_idx_ == SIZE_MAX; }
+
+bool MergeIterator::is_valid() const { return cur_idx_ != SIZE_MAX; }
@@ -0,0 +1,76 @@
+#include "../../include/lsm/merge_operator.h"
+#include <charconv>
+#include <system_error>
+
+// ************************ Int64AddOperator ************************
+
+std::string Int64AddOperator::name() const { return "int64_add"; }
+
+std::optional<int64_t> Int64AddOperator::parse(std::string_view str) {
+  int64_t value;
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (str.empty() || ec != std::errc() || ptr != str.data() + str.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+bool Int64AddOperator::full_merge(
+    std::string_view key, const std::optional<std::string_view> &existing,
+    const std::vector<std::string_view> &operands, std::string &result) const {
+  int64_t sum = 0;
+  if (existing.has_value()) {
+    auto base = parse(existing.value());
+    if (!base.has_value()) {
+      return false;
+    }
+    sum = base.value();
+  }
+  for (auto operand : operands) {
+    auto delta = parse(operand);
+    if (!delta.has_value() || __builtin_add_overflow(sum, *delta, &sum)) {
+      return false;
+    }
+  }
+  result = std::to_string(sum);
+  return true;
+}
+
+bool Int64AddOperator::partial_merge(std::string_view key,
+                                     std::string_view left,
+                                     std::string_view right,
+                                     std::string &result) const {
+  auto a = parse(left);
+  auto b = parse(right);
+  int64_t sum;
+  if (!a.has_value() || !b.has_value() ||
+      __builtin_add_overflow(*a, *b, &sum)) {
+    return false;
+  }
+  result = std::to_string(sum);
+  return true;
+}
+
+// ************************ StringAppendOperator ************************
+
+std::string StringAppendOperator::name() const { return "string_append"; }
+
+bool StringAppendOperator::full_merge(
+    std::string_view key, const std::optional<std::string_view> &existing,
+    const std::vector<std::string_view> &operands, std::string &result) const {
+  result.assign(existing.value_or(std::string_view{}));
+  for (auto operand : operands) {
+    result.append(operand);
+  }
+  return true;
+}
+
+bool StringAppendOperator::partial_merge(std::string_view key,
+                                         std::string_view left,
+                                         std::string_view right,
+                                         std::string &result) const {
+  result.reserve(left.size() + right.size());
+  result.assign(left);
+  result.append(right);
+  return true;
+}
@@ -0,0 +1,44 @@
+#include "../../include/lsm/options.h"
+#include <stdexcept>
+#include <string>
+
+namespace {
+void check(bool cond, const char *message) {
+  if (!cond) {
+    throw std::runtime_error(std::string("Invalid options: ") + message);
+  }
+}
+} // namespace
+
+void MutableOptions::validate() const {
+  check(write_stall_l0_num > 0, "write_stall_l0_num must be positive");
+  check(level0_compact_trigger > 0,
+        "level0_compact_trigger must be positive");
+  check(subcompact_min_size > 0, "subcompact_min_size must be positive");
+  check(tiered_max_run_num >= 2, "tiered_max_run_num must be at least 2");
+  check(blob_gc_age_cutoff >= 0 && blob_gc_age_cutoff <= 1,
+        "blob_gc_age_cutoff must be in [0, 1]");
+}
+
+void Options::validate() const {
+  MutableOptions::validate();
+  check(per_mem_size_limit > 0, "per_mem_size_limit must be positive");
+  check(tol_mem_size_limit >= per_mem_size_limit,
+        "tol_mem_size_limit must not be less than per_mem_size_limit");
+  check(block_size > 0, "block_size must be positive");
+  check(sst_level_ratio >= 2, "sst_level_ratio must be at least 2");
+  check(bloom_bits_per_key > 0, "bloom_bits_per_key must be positive");
+  check(block_cache_k > 0, "block_cache_k must be positive");
+  check(block_cache_shard_bits >= 0 && block_cache_shard_bits <= 16,
+        "block_cache_shard_bits must be in [0, 16]");
+  check(row_cache_shard_bits >= 0 && row_cache_shard_bits <= 16,
+        "row_cache_shard_bits must be in [0, 16]");
+  check(bg_thread_num >= 2,
+        "bg_thread_num must be at least 2 (one for flush, one for compact)");
+  check(max_subcompactions > 0, "max_subcompactions must be positive");
+  check(open_thread_num > 0, "open_thread_num must be positive");
+  check(wal_buffer_size > 0, "wal_buffer_size must be positive");
+  check(wal_file_size_limit > 0, "wal_file_size_limit must be positive");
+  check(wal_recover_thread_num > 0, "wal_recover_thread_num must be positive");
+  check(conflict_stripe_num > 0, "conflict_stripe_num must be positive");
+}
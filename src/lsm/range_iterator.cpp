@@ -0,0 +1,83 @@
+#include "../../include/lsm/range_iterator.h"
+#include "../../include/lsm/engine.h"
+#include "../../include/lsm/snapshot.h"
+#include <utility>
+
+RangeIterator::RangeIterator(std::shared_ptr<LSMEngine> engine,
+                             ReadOptions options)
+    : engine_(std::move(engine)), options_(std::move(options)) {
+  if (options_.snapshot != nullptr) {
+    options_.tranc_id = options_.snapshot->get_tranc_id();
+    mem_tables_ = options_.snapshot->get_mem_tables();
+    version_ = options_.snapshot->get_version();
+  } else {
+    // 内存表需要先于 Version 获取, 避免漏掉两者之间刷盘的数据
+    mem_tables_ = engine_->memtable.get_tables();
+    version_ = engine_->current_version();
+  }
+}
+
+void RangeIterator::seek_to_first() {
+  seek(options_.lower_bound.value_or(std::string{}));
+}
+
+void RangeIterator::seek(const std::string &key) {
+  auto &lower_bound = options_.lower_bound;
+  const std::string &start =
+      lower_bound.has_value() && key < lower_bound.value() ? lower_bound.value()
+                                                           : key;
+  iter_ = engine_->seek_iter(options_.tranc_id, start, options_.upper_bound,
+                             mem_tables_, version_);
+  reverse_ = false;
+}
+
+void RangeIterator::seek_for_prev(const std::string &key) {
+  seek_for_prev(std::optional<std::string>(key));
+}
+
+void RangeIterator::seek_to_last() { seek_for_prev(std::nullopt); }
+
+void RangeIterator::seek_for_prev(const std::optional<std::string> &key) {
+  auto &upper_bound = options_.upper_bound;
+  bool exclusive = upper_bound.has_value() &&
+                   (!key.has_value() || key.value() >= upper_bound.value());
+  iter_ = engine_->seek_for_prev_iter(options_.tranc_id,
+                                      exclusive ? upper_bound : key,
+                                      options_.lower_bound, mem_tables_,
+                                      version_);
+  reverse_ = true;
+  if (exclusive && iter_.is_valid() && iter_.key() == upper_bound.value()) {
+    ++iter_;
+  }
+}
+
+void RangeIterator::next() {
+  if (reverse_ && iter_.is_valid()) {
+    // 从当前 key 重新正向定位, 跳过当前 key
+    std::string cur_key(iter_.key());
+    seek(cur_key);
+    if (iter_.is_valid() && iter_.key() == cur_key) {
+      ++iter_;
+    }
+    return;
+  }
+  ++iter_;
+}
+
+void RangeIterator::prev() {
+  if (!reverse_ && iter_.is_valid()) {
+    std::string cur_key(iter_.key());
+    seek_for_prev(cur_key);
+    if (iter_.is_valid() && iter_.key() == cur_key) {
+      ++iter_;
+    }
+    return;
+  }
+  ++iter_;
+}
+
+bool RangeIterator::is_valid() const { return iter_.is_valid(); }
+
+std::string_view RangeIterator::key() const { return iter_.key(); }
+
+std::string_view RangeIterator::value() const { return iter_.value(); }
@@ -0,0 +1,73 @@
+#include "../../include/lsm/replication.h"
+#include "../../include/utils/files.h"
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+constexpr size_t kPositionSize = 3 * sizeof(uint64_t);
+
+void encode_position(const WalPosition &position, std::vector<uint8_t> &dst) {
+  size_t pos = dst.size();
+  dst.resize(pos + kPositionSize);
+  memcpy(dst.data() + pos, &position.epoch, sizeof(uint64_t));
+  memcpy(dst.data() + pos + sizeof(uint64_t), &position.seq, sizeof(uint64_t));
+  memcpy(dst.data() + pos + 2 * sizeof(uint64_t), &position.offset,
+         sizeof(uint64_t));
+}
+
+WalPosition decode_position(const uint8_t *data) {
+  WalPosition position;
+  memcpy(&position.epoch, data, sizeof(uint64_t));
+  memcpy(&position.seq, data + sizeof(uint64_t), sizeof(uint64_t));
+  memcpy(&position.offset, data + 2 * sizeof(uint64_t), sizeof(uint64_t));
+  return position;
+}
+} // namespace
+
+std::vector<uint8_t> ReplicationBatch::encode() const {
+  std::vector<uint8_t> buf;
+  encode_position(next, buf);
+  if (!records.empty()) {
+    Record::encode_batch(records, buf);
+  }
+  return buf;
+}
+
+ReplicationBatch ReplicationBatch::decode(const uint8_t *data, size_t size) {
+  if (size < kPositionSize) {
+    throw std::runtime_error("Replication batch is too short");
+  }
+  ReplicationBatch batch;
+  batch.next = decode_position(data);
+  if (size > kPositionSize) {
+    batch.records =
+        Record::decode_batches(data + kPositionSize, size - kPositionSize);
+    // decode_batches 遇到损坏的数据时静默停止, 复制流中不允许丢失记录
+    if (batch.records.empty()) {
+      throw std::runtime_error("Corrupted replication batch");
+    }
+  }
+  return batch;
+}
+
+void save_replication_position(const std::string &path,
+                               const WalPosition &position) {
+  std::vector<uint8_t> buf;
+  encode_position(position, buf);
+  auto tmp_path = path + ".tmp";
+  FileObj::create_and_write(tmp_path, std::move(buf));
+  std::filesystem::rename(tmp_path, path);
+}
+
+std::optional<WalPosition> load_replication_position(const std::string &path) {
+  if (!std::filesystem::exists(path)) {
+    return std::nullopt;
+  }
+  auto file = FileObj::open(path, false);
+  if (file.size() < kPositionSize) {
+    throw std::runtime_error("Corrupted replication position: " + path);
+  }
+  auto buf = file.read_to_slice(0, kPositionSize);
+  return decode_position(buf.data());
+}
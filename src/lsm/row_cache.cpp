@@ -0,0 +1,124 @@
+#include "../../include/lsm/row_cache.h"
+#include "../../include/utils/hash.h"
+#include <stdexcept>
+
+namespace {
+// 每个 entry 在 key 和 value 之外的内存占用: 链表节点, 哈希表节点和 string
+constexpr size_t kEntryOverhead = 96;
+
+// tranc_id 为 0 表示读取最新的版本
+uint64_t read_tranc_id_of(uint64_t tranc_id) {
+  return tranc_id == 0 ? UINT64_MAX : tranc_id;
+}
+} // namespace
+
+RowCache::RowCache(size_t capacity, int shard_bits)
+    : capacity_(capacity), shard_mask_((size_t(1) << shard_bits) - 1) {
+  if (capacity == 0 || shard_bits < 0 || shard_bits > 16) {
+    throw std::runtime_error("Invalid row cache options");
+  }
+  shards_ = std::make_unique<Shard[]>(shard_mask_ + 1);
+  shard_capacity_ = (capacity + shard_mask_) / (shard_mask_ + 1);
+}
+
+RowCache::Shard &RowCache::shard_of(std::string_view key) const {
+  return shards_[hash64(key) & shard_mask_];
+}
+
+uint64_t RowCache::sequence(std::string_view key) const {
+  return shard_of(key).seq.load(std::memory_order_acquire);
+}
+
+std::optional<std::pair<std::string, uint64_t>>
+RowCache::lookup(std::string_view key, uint64_t tranc_id) {
+  auto &shard = shard_of(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end() ||
+      it->second->tranc_id > read_tranc_id_of(tranc_id)) {
+    return std::nullopt;
+  }
+  // 移动到链表头部
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  return std::pair<std::string, uint64_t>{it->second->value,
+                                          it->second->tranc_id};
+}
+
+void RowCache::insert(std::string_view key, std::string_view value,
+                      uint64_t tranc_id, uint64_t read_tranc_id,
+                      uint64_t seq) {
+  // 内存表中存在比 read_tranc_id 更新的写入时, 查到的不一定是 sst 中最新的版本
+  if (read_tranc_id_of(read_tranc_id) <
+      max_write_tranc_id_.load(std::memory_order_acquire)) {
+    return;
+  }
+  size_t charge = 2 * key.size() + value.size() + kEntryOverhead;
+  if (charge > shard_capacity_) {
+    return;
+  }
+  auto &shard = shard_of(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  if (shard.seq.load(std::memory_order_relaxed) != seq) {
+    return;
+  }
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    erase_(shard, it);
+  }
+  shard.lru.push_front(
+      Entry{std::string(key), std::string(value), tranc_id, charge});
+  shard.map.emplace(shard.lru.front().key, shard.lru.begin());
+  shard.usage += charge;
+  while (shard.usage > shard_capacity_) {
+    erase_(shard, shard.map.find(shard.lru.back().key));
+  }
+}
+
+void RowCache::invalidate(std::string_view key, uint64_t tranc_id) {
+  raise_max_write_(tranc_id);
+  auto &shard = shard_of(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  shard.seq.fetch_add(1, std::memory_order_release);
+  auto it = shard.map.find(key);
+  if (it != shard.map.end()) {
+    erase_(shard, it);
+  }
+}
+
+void RowCache::clear(uint64_t tranc_id) {
+  raise_max_write_(tranc_id);
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    auto &shard = shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.seq.fetch_add(1, std::memory_order_release);
+    shard.map.clear();
+    shard.lru.clear();
+    shard.usage = 0;
+  }
+}
+
+size_t RowCache::get_usage() const {
+  size_t usage = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mtx);
+    usage += shards_[i].usage;
+  }
+  return usage;
+}
+
+void RowCache::raise_max_write_(uint64_t tranc_id) {
+  uint64_t cur = max_write_tranc_id_.load(std::memory_order_relaxed);
+  while (cur < tranc_id &&
+         !max_write_tranc_id_.compare_exchange_weak(cur, tranc_id)) {
+  }
+}
+
+void RowCache::erase_(
+    Shard &shard,
+    std::unordered_map<std::string_view, std::list<Entry>::iterator>::iterator
+        it) {
+  auto entry = it->second;
+  shard.usage -= entry->charge;
+  shard.map.erase(it);
+  shard.lru.erase(entry);
+}
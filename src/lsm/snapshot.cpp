@@ -0,0 +1,61 @@
+#include "../../include/lsm/snapshot.h"
+#include "../../include/lsm/version.h"
+#include "../../include/skiplist/skiplist.h"
+#include <utility>
+
+// ************************ Snapshot ************************
+
+Snapshot::Snapshot(uint64_t tranc_id,
+                   std::vector<std::shared_ptr<SkipList>> mem_tables,
+                   std::shared_ptr<const Version> version)
+    : tranc_id_(tranc_id), mem_tables_(std::move(mem_tables)),
+      version_(std::move(version)) {}
+
+uint64_t Snapshot::get_tranc_id() const { return tranc_id_; }
+
+const std::vector<std::shared_ptr<SkipList>> &
+Snapshot::get_mem_tables() const {
+  return mem_tables_;
+}
+
+const std::shared_ptr<const Version> &Snapshot::get_version() const {
+  return version_;
+}
+
+// ************************ SnapshotList ************************
+
+std::shared_ptr<const Snapshot>
+SnapshotList::acquire(uint64_t tranc_id,
+                      std::vector<std::shared_ptr<SkipList>> mem_tables,
+                      std::shared_ptr<const Version> version) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    tranc_ids_.insert(tranc_id);
+  }
+  // 删除器持有列表的 shared_ptr, 快照可以比引擎活得更久
+  auto list = shared_from_this();
+  return std::shared_ptr<const Snapshot>(
+      new Snapshot(tranc_id, std::move(mem_tables), std::move(version)),
+      [list](const Snapshot *snapshot) {
+        list->release(snapshot->get_tranc_id());
+        delete snapshot;
+      });
+}
+
+std::optional<uint64_t> SnapshotList::oldest() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (tranc_ids_.empty()) {
+    return std::nullopt;
+  }
+  return *tranc_ids_.begin();
+}
+
+size_t SnapshotList::size() const {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return tranc_ids_.size();
+}
+
+void SnapshotList::release(uint64_t tranc_id) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  tranc_ids_.erase(tranc_ids_.find(tranc_id));
+}
@@ -0,0 +1,52 @@
+#include "../../include/lsm/sst_file_writer.h"
+#include <stdexcept>
+
+SstFileWriter::SstFileWriter(const Options &options) : options_(options) {}
+
+void SstFileWriter::open(const std::string &path) {
+  path_ = path;
+  // 导入的文件可能位于任意层级, 使用上层的过滤器和压缩算法
+  builder_.emplace(options_.block_size, true, options_.prefix_extractor,
+                   FilterType::BlockedBloom,
+                   options_.compression ? CompressionType::LZ4
+                                        : CompressionType::None,
+                   options_.bloom_bits_per_key);
+  last_key_.clear();
+  num_entries_ = 0;
+}
+
+void SstFileWriter::put(const std::string &key, const std::string &value) {
+  add(key, value);
+}
+
+void SstFileWriter::remove(const std::string &key) { add(key, ""); }
+
+void SstFileWriter::add(const std::string &key, const std::string &value) {
+  if (!builder_.has_value()) {
+    throw std::runtime_error("SstFileWriter is not opened");
+  }
+  if (num_entries_ > 0 && key <= last_key_) {
+    throw std::runtime_error("Keys must be added in strictly increasing order");
+  }
+  builder_->add(key, value, 0);
+  last_key_ = key;
+  num_entries_++;
+}
+
+size_t SstFileWriter::num_entries() const { return num_entries_; }
+
+size_t SstFileWriter::estimated_size() const {
+  return builder_.has_value() ? builder_->estimated_size() : 0;
+}
+
+void SstFileWriter::finish() {
+  if (!builder_.has_value()) {
+    throw std::runtime_error("SstFileWriter is not opened");
+  }
+  if (num_entries_ == 0) {
+    throw std::runtime_error("Cannot create an empty SST file: " + path_);
+  }
+  // sst_id 只在数据目录中有意义, 导入时重新分配
+  builder_->build(0, path_, nullptr);
+  builder_.reset();
+}
@@ -1,4 +1,5 @@
 #include "../../include/lsm/engine.h"
+#include "../../include/consts.h"
 #include "../../include/lsm/transaction.h"
 #include "../../include/utils/files.h"
 #include <algorithm>
@@ -7,6 +8,7 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -21,51 +23,105 @@ TranContext::TranContext(uint64_t tranc_id, std::shared_ptr<LSMEngine> engine,
 }
 
 void TranContext::put(const std::string &key, const std::string &value) {
+  put_(0, key, value);
+}
+
+void TranContext::remove(const std::string &key) { remove_(0, key); }
+
+std::optional<std::string> TranContext::get(const std::string &key) {
+  return get_(0, key);
+}
+
+void TranContext::put(const ColumnFamilyHandle &cf, const std::string &key,
+                      const std::string &value) {
+  if (cf.id != 0) {
+    cf_engines_[cf.id] = cf.engine;
+  }
+  put_(cf.id, key, value);
+}
+
+void TranContext::remove(const ColumnFamilyHandle &cf,
+                         const std::string &key) {
+  if (cf.id != 0) {
+    cf_engines_[cf.id] = cf.engine;
+  }
+  remove_(cf.id, key);
+}
+
+std::optional<std::string> TranContext::get(const ColumnFamilyHandle &cf,
+                                            const std::string &key) {
+  if (cf.id != 0) {
+    cf_engines_[cf.id] = cf.engine;
+  }
+  return get_(cf.id, key);
+}
+
+const std::shared_ptr<LSMEngine> &
+TranContext::cf_engine_(uint32_t cf_id) const {
+  if (cf_id == 0) {
+    return engine_;
+  }
+  return cf_engines_.at(cf_id);
+}
+
+void TranContext::put_(uint32_t cf_id, const std::string &key,
+                       const std::string &value) {
   auto isolation_level = get_isolation_level();
+  auto &engine = cf_engine_(cf_id);
+  auto cf_key = encode_cf_key(cf_id, key);
 
   // 所有隔离级别都需要先写入 operations 中
   operations.emplace_back(Record::putRecord(this->tranc_id_, key, value));
+  operations.back().setColumnFamilyId(cf_id);
 
   if (isolation_level == IsolationLevel::READ_UNCOMMITTED) {
     // 1 如果隔离级别是 READ_UNCOMMITTED, 直接写入 memtable
     // 先查询以前的记录, 因为回滚时可能需要
-    auto prev_record = engine_->get(key, 0);
-    rollback_map_[key] = prev_record;
-    engine_->put(key, value, tranc_id_);
+    auto prev_record = engine->get(key, 0);
+    rollback_map_[cf_key] = prev_record;
+    tranManager_->commit_writes({cf_key},
+                                [&]() { engine->put(key, value, tranc_id_); });
     return;
   }
 
   // 2 其他隔离级别需要 暂存到 temp_map_ 中, 统一提交后才在数据库中生效
-  temp_map_[key] = value;
+  temp_map_[cf_key] = value;
 }
 
-void TranContext::remove(const std::string &key) {
+void TranContext::remove_(uint32_t cf_id, const std::string &key) {
   auto isolation_level = get_isolation_level();
+  auto &engine = cf_engine_(cf_id);
+  auto cf_key = encode_cf_key(cf_id, key);
 
   // 所有隔离级别都需要先写入 operations 中
   operations.emplace_back(Record::deleteRecord(this->tranc_id_, key));
+  operations.back().setColumnFamilyId(cf_id);
 
   if (isolation_level == IsolationLevel::READ_UNCOMMITTED) {
     // 1 如果隔离级别是 READ_UNCOMMITTED, 直接写入 memtable
     // 先查询以前的记录, 因为回滚时可能需要
-    auto prev_record = engine_->get(key, 0);
-    rollback_map_[key] = prev_record;
-    engine_->remove(key, tranc_id_);
+    auto prev_record = engine->get(key, 0);
+    rollback_map_[cf_key] = prev_record;
+    tranManager_->commit_writes({cf_key},
+                                [&]() { engine->remove(key, tranc_id_); });
     return;
   }
 
   // 2 其他隔离级别需要 暂存到 temp_map_ 中, 统一提交后才在数据库中生效
-  temp_map_[key] = "";
+  temp_map_[cf_key] = "";
 }
 
-std::optional<std::string> TranContext::get(const std::string &key) {
+std::optional<std::string> TranContext::get_(uint32_t cf_id,
+                                             const std::string &key) {
   auto isolation_level = get_isolation_level();
+  auto &engine = cf_engine_(cf_id);
+  auto cf_key = encode_cf_key(cf_id, key);
 
   // 1 所有隔离级别先就近在当前操作的临时缓存中查找
-  if (temp_map_.find(key) != temp_map_.end()) {
+  if (temp_map_.find(cf_key) != temp_map_.end()) {
     // READ_UNCOMMITTED 随单次操作更新数据库, 不需要最后的统一更新
     // 这一步骤肯定会自然跳过的
-    return temp_map_[key];
+    return temp_map_[cf_key];
   }
 
   // 2 否则使用 engine 查询
@@ -73,19 +129,19 @@ std::optional<std::string> TranContext::get(const std::string &key) {
   if (isolation_level == IsolationLevel::READ_UNCOMMITTED) {
     // 2.1 如果隔离级别是 READ_UNCOMMITTED, 使用 engine
     // 查询时不需要判断 tranc_id, 直接获取最新值
-    query = engine_->get(key, 0);
+    query = engine->get(key, 0);
   } else if (isolation_level == IsolationLevel::READ_COMMITTED) {
     // 2.2 如果隔离级别是 READ_COMMITTED, 使用 engine
     // 查询时判断 tranc_id
-    query = engine_->get(key, this->tranc_id_);
+    query = engine->get(key, this->tranc_id_);
   } else {
     // 2.2 如果隔离级别是 SERIALIZABLE 或 REPEATABLE_READ, 第一次使用 engine
     // 查询后还需要暂存
-    if (read_map_.find(key) != read_map_.end()) {
-      query = read_map_[key];
+    if (read_map_.find(cf_key) != read_map_.end()) {
+      query = read_map_[cf_key];
     } else {
-      query = engine_->get(key, this->tranc_id_);
-      read_map_[key] = query;
+      query = engine->get(key, this->tranc_id_);
+      read_map_[cf_key] = query;
     }
   }
   if (query.has_value()) {
@@ -94,7 +150,43 @@ std::optional<std::string> TranContext::get(const std::string &key) {
   return std::nullopt;
 }
 
+std::vector<std::pair<std::string, std::string>>
+TranContext::get_monotony_predicate(
+    std::function<int(const std::string &)> predicate) {
+  // 与 get 相同, READ_UNCOMMITTED 直接读取最新值
+  uint64_t read_tranc_id =
+      get_isolation_level() == IsolationLevel::READ_UNCOMMITTED ? 0
+                                                                : tranc_id_;
+  std::map<std::string, std::string> result;
+  auto iters = engine_->lsm_iters_monotony_predicate(read_tranc_id, predicate);
+  if (iters.has_value()) {
+    auto [it, end] = iters.value();
+    for (; it != end; ++it) {
+      result[it->first] = it->second;
+    }
+  }
+  if (get_isolation_level() == IsolationLevel::SERIALIZABLE) {
+    range_reads_.push_back(predicate);
+  }
+
+  // 当前事务的写入覆盖数据库中的值, 空值表示删除
+  for (auto &[cf_key, v] : temp_map_) {
+    auto [cf_id, k] = decode_cf_key(cf_key);
+    if (cf_id == 0 && predicate(k) == 0) {
+      result[k] = v;
+    }
+  }
+  std::vector<std::pair<std::string, std::string>> kvs;
+  for (auto &[k, v] : result) {
+    if (!v.empty()) {
+      kvs.emplace_back(k, v);
+    }
+  }
+  return kvs;
+}
+
 bool TranContext::commit(bool test_fail) {
+  StopWatch watch(engine_->stats.get(), HistogramType::Commit);
   auto isolation_level = get_isolation_level();
 
   if (isolation_level == IsolationLevel::READ_UNCOMMITTED) {
@@ -110,58 +202,62 @@ bool TranContext::commit(bool test_fail) {
     }
     isCommited = true;
     tranManager_->update_max_finished_tranc_id(tranc_id_);
+    tranManager_->finish_tranc(tranc_id_);
     return true;
   }
 
   // commit 需要检查所有的操作是否合法
 
-  // 遍历所有的记录, 判断是否合法
-
-  // TODO: 目前为检查冲突, 全局获取了读锁, 后续考虑性能优化方案
-
-  MemTable &memtable = engine_->memtable;
-  std::unique_lock<std::shared_mutex> wlock1(memtable.frozen_mtx);
-  std::unique_lock<std::shared_mutex> wlock2(memtable.cur_mtx);
-
-  if (isolation_level == IsolationLevel::REPEATABLE_READ ||
-      isolation_level == IsolationLevel::SERIALIZABLE) {
-    // REPEATABLE_READ 需要校验冲突
-    // TODO: 目前 SERIALIZABLE 还没有实现, 逻辑和 REPEATABLE_READ 相同
-
-    // 只要需要校验的 隔离级别 需要加sst的锁
-    std::shared_lock<std::shared_mutex> rlock3(engine_->ssts_mtx);
-
-    for (auto &[k, v] : temp_map_) {
-      // 步骤1: 先在内存表中判断该 key 是否冲突
+  // 只锁住写入的 key 所在的冲突表分段, 写入不同 key 的提交可以并发进行
+  // 校验和写入 memtable 都不需要获取 memtable 的全局锁
+  std::vector<std::string> write_keys;
+  write_keys.reserve(temp_map_.size());
+  for (auto &[k, v] : temp_map_) {
+    write_keys.push_back(k);
+  }
+  bool serializable = isolation_level == IsolationLevel::SERIALIZABLE;
+  std::vector<std::string> lock_keys = write_keys;
+  if (serializable) {
+    // SERIALIZABLE 还需要保证读到的 key 在提交前没有被修改
+    for (auto &[k, v] : read_map_) {
+      lock_keys.push_back(k);
+    }
+  }
+  auto &conflict_table = tranManager_->get_conflict_table();
+  auto stripe_locks = conflict_table.lock_keys(lock_keys);
+  // 校验之前登记写入的 key, 同时校验的范围查询可以看到它们
+  conflict_table.add_pending(write_keys);
 
-      // ! 注意第二个参数设置为0, 表示忽略事务可见性的查询
-      auto res = memtable.get_(k, 0);
-      if (res.is_valid() && res.get_tranc_id() > tranc_id_) {
-        // 数据库中存在相同的 key , 且其 tranc_id 大于当前 tranc_id
-        // 表示更晚创建的事务修改了相同的key, 并先提交, 发生了冲突
+  auto abort_tranc = [this, &conflict_table, &write_keys]() {
+    conflict_table.clear_pending(write_keys);
+    isAborted = true;
+    tranManager_->finish_tranc(tranc_id_);
+    return false;
+  };
+  if (isolation_level == IsolationLevel::REPEATABLE_READ || serializable) {
+    // REPEATABLE_READ 需要校验写入的 key 是否冲突
+    for (auto &k : write_keys) {
+      if (has_write_conflict(k)) {
+        // 更晚创建的事务修改了相同的key, 并先提交, 发生了冲突
         // 需要终止事务
-        isAborted = true;
-        return false;
-      } else {
-        // 步骤2: 判断sst中是否是否存在冲突
-        if (tranManager_->get_max_flushed_tranc_id() <= tranc_id_) {
-          // sst 中最大的 tranc_id 小于当前 tranc_id, 没有冲突
-          continue;
-        }
-
-        // 否则要查询具体的key是否冲突
-        // ! 注意第二个参数设置为0, 表示忽略事务可见性的查询
-        auto res = engine_->sst_get_(k, 0);
-        if (res.has_value()) {
-          auto [v, tranc_id] = res.value();
-          if (tranc_id > tranc_id_) {
-            // 数据库中存在相同的 key , 且其 tranc_id 大于当前 tranc_id
-            // 表示更晚创建的事务修改了相同的key, 并先提交, 发生了冲突
-            // 需要终止事务
-            isAborted = true;
-            return false;
-          }
-        }
+        return abort_tranc();
+      }
+    }
+  }
+  if (serializable) {
+    // SERIALIZABLE 还需要检查读写反依赖(rw-antidependency):
+    // 读取过的 key 或者范围在事务开始之后被其他事务修改并提交了, 说明当前
+    // 事务可能读到的是旧数据, 必须排在那个事务之前; 只要存在这样的边就终止
+    // 当前事务, 已提交的事务就等价于按提交顺序串行执行, 不会出现环
+    // 这比只在出现两条连续边时终止更保守, 但不需要在提交后继续跟踪读集
+    for (auto &[k, v] : read_map_) {
+      if (has_read_conflict(k, v)) {
+        return abort_tranc();
+      }
+    }
+    for (auto &predicate : range_reads_) {
+      if (has_range_conflict(predicate, stripe_locks)) {
+        return abort_tranc();
       }
     }
   }
@@ -175,36 +271,154 @@ bool TranContext::commit(bool test_fail) {
   auto wal_success = tranManager_->write_to_wal(operations);
 
   if (!wal_success) {
+    conflict_table.clear_pending(write_keys);
     throw std::runtime_error("write to wal failed");
   }
 
   // 将暂存数据应用到数据库
   if (!test_fail) {
-    // 这里是手动调用 memtable 的无锁版本的 put_, 因为之前手动加了写锁
-    for (auto &[k, v] : temp_map_) {
-      memtable.put_(k, v, tranc_id_);
+    apply_operations();
+    // 释放分段锁之前记录, 之后提交的事务才能检测到冲突
+    auto commit_seq = tranManager_->next_commit_seq();
+    for (auto &k : write_keys) {
+      conflict_table.record(k, commit_seq);
     }
+  } else {
+    conflict_table.clear_pending(write_keys);
   }
 
   isCommited = true;
   tranManager_->update_max_finished_tranc_id(tranc_id_);
+  tranManager_->finish_tranc(tranc_id_);
+
+  // 绕过了 engine 的写入接口, 需要释放锁后手动检查是否需要后台刷盘
+  stripe_locks.clear();
+  engine_->schedule_flush_if_needed();
+  for (auto &[cf_id, engine] : cf_engines_) {
+    engine->schedule_flush_if_needed();
+  }
   return true;
 }
 
+void TranContext::apply_operations() {
+  // 跳表支持并发写入, 同一个 key 的多次操作以最后一次为准
+  if (cf_engines_.empty()) {
+    engine_->memtable.apply_records(operations);
+    engine_->invalidate_row_cache(operations);
+    return;
+  }
+  std::map<uint32_t, std::vector<Record>> cf_records;
+  for (auto &record : operations) {
+    if (record.getOperationType() == OperationType::PUT ||
+        record.getOperationType() == OperationType::DELETE) {
+      cf_records[record.getColumnFamilyId()].push_back(record);
+    }
+  }
+  for (auto &[cf_id, records] : cf_records) {
+    auto &cf_engine = cf_engine_(cf_id);
+    cf_engine->memtable.apply_records(records);
+    cf_engine->invalidate_row_cache(records);
+  }
+}
+
+bool TranContext::has_range_conflict(
+    const std::function<int(const std::string &)> &predicate,
+    const std::vector<std::unique_lock<std::mutex>> &held) {
+  // 只检查事务开始之后提交的和正在提交的 key, 不需要重新扫描范围
+  // 范围查询只覆盖默认列族
+  auto in_range = [&predicate](const std::string &cf_key) {
+    auto [cf_id, key] = decode_cf_key(cf_key);
+    return cf_id == 0 && predicate(key) == 0;
+  };
+  // 近期的记录被淘汰时无法确定, 保守地认为发生了冲突
+  return tranManager_->get_conflict_table().check_range(in_range, begin_seq_,
+                                                        held) !=
+         ConflictTable::CheckResult::NoConflict;
+}
+
+std::optional<uint64_t>
+TranContext::latest_tranc_id(const std::string &cf_key) {
+  auto [cf_id, key] = decode_cf_key(cf_key);
+  auto &engine = cf_engine_(cf_id);
+  // ! 注意第二个参数设置为0, 表示忽略事务可见性的查询
+  auto res = engine->memtable.get(key, 0);
+  if (res.is_valid()) {
+    // memtable 中的版本比 sst 中的更新
+    return res.get_tranc_id();
+  }
+  auto sst_res = engine->sst_get_(key, 0);
+  if (sst_res.has_value()) {
+    return sst_res->second;
+  }
+  return std::nullopt;
+}
+
+bool TranContext::has_write_conflict(const std::string &cf_key) {
+  switch (tranManager_->get_conflict_table().check(cf_key, begin_seq_)) {
+  case ConflictTable::CheckResult::NoConflict:
+    return false;
+  case ConflictTable::CheckResult::Conflict:
+    return true;
+  case ConflictTable::CheckResult::Unknown:
+    break;
+  }
+  // key 的记录可能已经被淘汰, 退化为查询 memtable 和 sst
+  // 数据库中存在相同的 key , 且其 tranc_id 大于当前 tranc_id
+  // 表示更晚创建的事务修改了相同的key, 并先提交, 发生了冲突
+  // ! 注意第二个参数设置为0, 表示忽略事务可见性的查询
+  auto [cf_id, key] = decode_cf_key(cf_key);
+  auto &engine = cf_engine_(cf_id);
+  auto res = engine->memtable.get(key, 0);
+  if (res.is_valid()) {
+    // memtable 中的版本比 sst 中的更新
+    return res.get_tranc_id() > tranc_id_;
+  }
+  // 没有记录刷盘进度的旧数据目录中, 只有 TranManager 记录的值
+  if (std::max(engine->flushed_tranc_id.load(),
+               tranManager_->get_max_flushed_tranc_id()) <= tranc_id_) {
+    // sst 中最大的 tranc_id 小于当前 tranc_id, 没有冲突
+    return false;
+  }
+  auto sst_res = engine->sst_get_(key, 0);
+  return sst_res.has_value() && sst_res->second > tranc_id_;
+}
+
+bool TranContext::has_read_conflict(
+    const std::string &cf_key,
+    const std::optional<std::pair<std::string, uint64_t>> &read_result) {
+  switch (tranManager_->get_conflict_table().check(cf_key, begin_seq_)) {
+  case ConflictTable::CheckResult::NoConflict:
+    return false;
+  case ConflictTable::CheckResult::Conflict:
+    return true;
+  case ConflictTable::CheckResult::Unknown:
+    break;
+  }
+  // 退化为比较最新版本与读到的版本是否相同
+  auto latest = latest_tranc_id(cf_key);
+  if (!read_result.has_value()) {
+    return latest.has_value();
+  }
+  return latest != read_result->second;
+}
+
 bool TranContext::abort() {
   auto isolation_level = get_isolation_level();
   if (isolation_level == IsolationLevel::READ_UNCOMMITTED) {
     // 需要手动恢复之前的更改
     // TODO: 需要使用批量化操作优化性能
-    for (auto &[k, res] : rollback_map_) {
+    for (auto &[cf_key, res] : rollback_map_) {
+      auto [cf_id, k] = decode_cf_key(cf_key);
+      auto &engine = cf_engine_(cf_id);
       if (res.has_value()) {
-        engine_->put(k, res.value().first, res.value().second);
+        engine->put(k, res.value().first, res.value().second);
       } else {
         // 之前本就不存在, 需要移除当前事务的新增操作
-        engine_->remove(k, tranc_id_);
+        engine->remove(k, tranc_id_);
       }
     }
     isAborted = true;
+    tranManager_->finish_tranc(tranc_id_);
 
     return true;
   }
@@ -221,6 +435,7 @@ bool TranContext::abort() {
   // }
 
   isAborted = true;
+  tranManager_->finish_tranc(tranc_id_);
 
   return true;
 }
@@ -230,7 +445,18 @@ enum IsolationLevel TranContext::get_isolation_level() {
 }
 
 // *********************** TranManager ***********************
-TranManager::TranManager(std::string data_dir) : data_dir_(data_dir) {
+TranManager::TranManager(std::string data_dir, const Options &options)
+    : data_dir_(data_dir), wal_buffer_size_(options.wal_buffer_size),
+      wal_clean_interval_(options.wal_clean_interval),
+      wal_file_size_limit_(options.wal_file_size_limit),
+      wal_recycle_num_(options.wal_recycle_num),
+      wal_recover_thread_num_(options.wal_recover_thread_num),
+      wal_recover_batch_size_(options.wal_recover_batch_size),
+      conflict_table_(options.conflict_stripe_num,
+                      options.conflict_stripe_capacity) {
+  // ! conflict_table_ 是成员变量, 不会比 TranManager 活得更久
+  conflict_table_.set_watermark_callback(
+      [this]() { return get_commit_watermark(); });
   auto file_path = get_tranc_id_file_path();
 
   // 判断文件是否存在
@@ -244,14 +470,16 @@ TranManager::TranManager(std::string data_dir) : data_dir_(data_dir) {
 }
 
 void TranManager::init_new_wal() {
-  // TODO: 1 和 4096 应该统一用宏定义
   // 先清理掉所有 wal. 开头的文件, 因为其已经被重放过了
   for (const auto &entry : std::filesystem::directory_iterator(data_dir_)) {
     if (entry.path().filename().string().find("wal.") == 0) {
       std::filesystem::remove(entry.path());
     }
   }
-  wal = std::make_shared<WAL>(data_dir_, 128, max_finished_tranc_id_, 1, 4096);
+  wal = std::make_shared<WAL>(data_dir_, wal_buffer_size_,
+                              max_finished_tranc_id_, wal_clean_interval_,
+                              wal_file_size_limit_, wal_recycle_num_,
+                              engine_ ? engine_->stats : nullptr);
 }
 
 void TranManager::set_engine(std::shared_ptr<LSMEngine> engine) {
@@ -266,6 +494,9 @@ void TranManager::write_tranc_id_file() {
   // std::atomic<uint64_t> max_flushed_tranc_id_;
   // std::atomic<uint64_t> max_finished_tranc_id_;
 
+  // flush 回调可能在后台线程中并发调用
+  std::unique_lock<std::mutex> lock(tranc_id_file_mtx_);
+
   std::vector<uint8_t> buf(3 * sizeof(uint64_t), 0);
   uint64_t nextTransactionId = nextTransactionId_.load();
   uint64_t max_flushed_tranc_id = max_flushed_tranc_id_.load();
@@ -281,6 +512,27 @@ void TranManager::write_tranc_id_file() {
   tranc_id_file_.sync();
 }
 
+void TranManager::create_checkpoint(
+    const std::string &dir, const std::function<uint64_t()> &checkpoint) {
+  uint64_t max_flushed_tranc_id;
+  if (wal != nullptr) {
+    wal->copy_to(dir, [&] { return max_flushed_tranc_id = checkpoint(); });
+  } else {
+    max_flushed_tranc_id = checkpoint();
+  }
+
+  // WAL 复制完成之后再读取, 恢复后分配的事务id不会与 WAL 中的记录重复
+  std::vector<uint8_t> buf(3 * sizeof(uint64_t), 0);
+  uint64_t nextTransactionId = nextTransactionId_.load();
+  uint64_t max_finished_tranc_id = max_finished_tranc_id_.load();
+  memcpy(buf.data(), &nextTransactionId, sizeof(uint64_t));
+  memcpy(buf.data() + sizeof(uint64_t), &max_flushed_tranc_id,
+         sizeof(uint64_t));
+  memcpy(buf.data() + 2 * sizeof(uint64_t), &max_finished_tranc_id,
+         sizeof(uint64_t));
+  FileObj::create_and_write(dir + "/tranc_id", std::move(buf));
+}
+
 void TranManager::read_tranc_id_file() {
   nextTransactionId_ = tranc_id_file_.read_uint64(0);
   max_flushed_tranc_id_ = tranc_id_file_.read_uint64(sizeof(uint64_t));
@@ -313,12 +565,31 @@ void TranManager::update_max_flushed_tranc_id(uint64_t tranc_id) {
     }
   }
   write_tranc_id_file();
+  // 已经刷盘的事务不再需要 WAL 中的记录
+  if (wal != nullptr) {
+    wal->set_max_finished_tranc_id(max_flushed_tranc_id_.load());
+  }
+}
+
+void TranManager::update_next_tranc_id(uint64_t tranc_id) {
+  uint64_t expected = nextTransactionId_.load(std::memory_order_relaxed);
+  while (tranc_id >= expected) {
+    if (nextTransactionId_.compare_exchange_weak(expected, tranc_id + 1,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed)) {
+      break;
+    }
+  }
 }
 
 uint64_t TranManager::getNextTransactionId() {
   return nextTransactionId_.fetch_add(1, std::memory_order_relaxed);
 }
 
+uint64_t TranManager::get_read_tranc_id() {
+  return nextTransactionId_.load(std::memory_order_relaxed) - 1;
+}
+
 uint64_t TranManager::get_max_flushed_tranc_id() {
   return max_flushed_tranc_id_.load();
 }
@@ -333,10 +604,37 @@ TranManager::new_tranc(const IsolationLevel &isolation_level) {
   std::unique_lock<std::mutex> lock(mutex_);
 
   auto tranc_id = getNextTransactionId();
-  activeTrans_[tranc_id] = std::make_shared<TranContext>(
+  auto tranc_context = std::make_shared<TranContext>(
       tranc_id, engine_, shared_from_this(), isolation_level);
-  return activeTrans_[tranc_id];
+  tranc_context->begin_seq_ = commit_seq_.load();
+  activeTrans_[tranc_id] = tranc_context;
+  return tranc_context;
+}
+
+void TranManager::finish_tranc(uint64_t tranc_id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  activeTrans_.erase(tranc_id);
+}
+
+uint64_t TranManager::get_gc_watermark() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // activeTrans_ 按 tranc_id 升序排列, 第一个仍然存活的事务即为最小值
+  while (!activeTrans_.empty()) {
+    auto it = activeTrans_.begin();
+    if (!it->second.expired()) {
+      return it->first;
+    }
+    activeTrans_.erase(it);
+  }
+  return nextTransactionId_.load();
 }
+WalPosition TranManager::get_wal_position() { return wal->end_position(); }
+
+WalPosition TranManager::read_wal(const WalPosition &from, size_t max_bytes,
+                                  std::vector<Record> &records) {
+  return wal->read_from(from, max_bytes, records);
+}
+
 std::string TranManager::get_tranc_id_file_path() {
   if (data_dir_.empty()) {
     data_dir_ = "./";
@@ -344,10 +642,43 @@ std::string TranManager::get_tranc_id_file_path() {
   return data_dir_ + "/tranc_id";
 }
 
-std::map<uint64_t, std::vector<Record>> TranManager::check_recover() {
-  std::map<uint64_t, std::vector<Record>> wal_records =
-      WAL::recover(data_dir_, max_flushed_tranc_id_);
-  return wal_records;
+WalRecoveryStats TranManager::recover_from_wal(
+    const std::function<void(std::vector<Record> &)> &apply) {
+  return WAL::recover_streaming(data_dir_, max_flushed_tranc_id_,
+                                wal_recover_thread_num_,
+                                wal_recover_batch_size_, apply);
+}
+
+ConflictTable &TranManager::get_conflict_table() { return conflict_table_; }
+
+void TranManager::commit_writes(const std::vector<std::string> &keys,
+                                const std::function<void()> &write) {
+  auto locks = conflict_table_.lock_keys(keys);
+  conflict_table_.add_pending(keys);
+  try {
+    write();
+  } catch (...) {
+    conflict_table_.clear_pending(keys);
+    throw;
+  }
+  auto commit_seq = next_commit_seq();
+  for (auto &key : keys) {
+    conflict_table_.record(key, commit_seq);
+  }
+}
+
+uint64_t TranManager::next_commit_seq() { return ++commit_seq_; }
+
+uint64_t TranManager::get_commit_watermark() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // begin_seq 随 tranc_id 递增, 第一个仍然存活的事务的 begin_seq 最小
+  for (auto it = activeTrans_.begin(); it != activeTrans_.end();) {
+    if (auto tranc = it->second.lock()) {
+      return tranc->begin_seq_;
+    }
+    it = activeTrans_.erase(it);
+  }
+  return commit_seq_.load();
 }
 
 bool TranManager::write_to_wal(const std::vector<Record> &records) {
@@ -20,11 +20,11 @@ bool TwoMergeIterator::choose_it_a() {
   if (it_b->is_end()) {
     return true;
   }
-  return (**it_a).first < (**it_b).first; // 比较 key
+  return it_a->key() < it_b->key(); // 比较 key, 不复制键值对
 }
 
 void TwoMergeIterator::skip_it_b() {
-  if (!it_a->is_end() && !it_b->is_end() && (**it_a).first == (**it_b).first) {
+  if (!it_a->is_end() && !it_b->is_end() && it_a->key() == it_b->key()) {
     ++(*it_b);
   }
 }
@@ -81,6 +81,14 @@ BaseIterator::value_type TwoMergeIterator::operator*() const {
   }
 }
 
+std::string_view TwoMergeIterator::key() const {
+  return choose_a ? it_a->key() : it_b->key();
+}
+
+std::string_view TwoMergeIterator::value() const {
+  return choose_a ? it_a->value() : it_b->value();
+}
+
 IteratorType TwoMergeIterator::get_type() const {
   return IteratorType::TwoMergeIterator;
 }
@@ -0,0 +1,374 @@
+#include "../../include/lsm/version.h"
+#include "../../include/utils/coding.h"
+#include "../../include/utils/hash.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+// VersionEdit 中每个字段的 tag
+enum EditTag : uint64_t {
+  kNextSstId = 1,
+  kDeletedFile = 2,
+  kAddedFile = 3,
+  kFileMeta = 4,
+  kFlushedTrancId = 5,
+  kGlobalTrancId = 6,
+};
+
+constexpr size_t kRecordHeaderSize = 2 * sizeof(uint32_t);
+
+void put_varint(std::vector<uint8_t> &dst, uint64_t value) {
+  size_t pos = dst.size();
+  dst.resize(pos + varint_length(value));
+  encode_varint(dst.data() + pos, value);
+}
+
+// | len (varint) | bytes |
+void put_string(std::vector<uint8_t> &dst, const std::string &value) {
+  put_varint(dst, value.size());
+  dst.insert(dst.end(), value.begin(), value.end());
+}
+
+const uint8_t *decode_string(const uint8_t *ptr, const uint8_t *limit,
+                             std::string *value) {
+  uint64_t len;
+  ptr = decode_varint(ptr, limit, &len);
+  if (ptr == nullptr || len > static_cast<uint64_t>(limit - ptr)) {
+    return nullptr;
+  }
+  value->assign(reinterpret_cast<const char *>(ptr), len);
+  return ptr + len;
+}
+
+uint32_t record_hash(const uint8_t *data, size_t size) {
+  return static_cast<uint32_t>(hash64(data, size));
+}
+} // namespace
+
+// ************************ VersionEdit ************************
+
+void VersionEdit::delete_file(size_t level, size_t sst_id) {
+  deleted_files.emplace_back(level, sst_id);
+}
+
+void VersionEdit::add_file(size_t level, size_t sst_id) {
+  added_files.emplace_back(level, sst_id);
+}
+
+void VersionEdit::add_file(size_t level, const std::shared_ptr<SST> &sst) {
+  add_file(level, sst->get_sst_id());
+  file_metas[sst->get_sst_id()] = sst->get_file_meta();
+}
+
+std::vector<uint8_t> VersionEdit::encode() const {
+  std::vector<uint8_t> encoded;
+  if (next_sst_id.has_value()) {
+    put_varint(encoded, kNextSstId);
+    put_varint(encoded, next_sst_id.value());
+  }
+  if (flushed_tranc_id.has_value()) {
+    put_varint(encoded, kFlushedTrancId);
+    put_varint(encoded, flushed_tranc_id.value());
+  }
+  for (auto [level, sst_id] : deleted_files) {
+    put_varint(encoded, kDeletedFile);
+    put_varint(encoded, level);
+    put_varint(encoded, sst_id);
+  }
+  for (auto [level, sst_id] : added_files) {
+    put_varint(encoded, kAddedFile);
+    put_varint(encoded, level);
+    put_varint(encoded, sst_id);
+  }
+  for (auto &[sst_id, meta] : file_metas) {
+    put_varint(encoded, kFileMeta);
+    put_varint(encoded, sst_id);
+    put_varint(encoded, meta.num_blocks);
+    put_string(encoded, meta.first_key);
+    put_string(encoded, meta.last_key);
+  }
+  for (auto &[sst_id, meta] : file_metas) {
+    if (meta.global_tranc_id != 0) {
+      put_varint(encoded, kGlobalTrancId);
+      put_varint(encoded, sst_id);
+      put_varint(encoded, meta.global_tranc_id);
+    }
+  }
+  return encoded;
+}
+
+VersionEdit VersionEdit::decode(const uint8_t *data, size_t size) {
+  VersionEdit edit;
+  const uint8_t *ptr = data;
+  const uint8_t *limit = data + size;
+  while (ptr != nullptr && ptr < limit) {
+    uint64_t tag = 0, level = 0, sst_id = 0, num_blocks = 0, tranc_id = 0;
+    SstFileMeta meta;
+    ptr = decode_varint(ptr, limit, &tag);
+    if (ptr == nullptr) {
+      break;
+    }
+    switch (tag) {
+    case kNextSstId:
+      ptr = decode_varint(ptr, limit, &sst_id);
+      if (ptr == nullptr) {
+        break;
+      }
+      edit.next_sst_id = sst_id;
+      break;
+    case kFlushedTrancId:
+      ptr = decode_varint(ptr, limit, &tranc_id);
+      if (ptr == nullptr) {
+        break;
+      }
+      edit.flushed_tranc_id = tranc_id;
+      break;
+    case kDeletedFile:
+    case kAddedFile:
+      ptr = decode_varint(ptr, limit, &level);
+      if (ptr != nullptr) {
+        ptr = decode_varint(ptr, limit, &sst_id);
+      }
+      // 解码失败时 ptr 为 nullptr, 循环结束后抛出异常
+      if (ptr == nullptr) {
+        break;
+      }
+      if (tag == kDeletedFile) {
+        edit.delete_file(level, sst_id);
+      } else {
+        edit.add_file(level, sst_id);
+      }
+      break;
+    case kFileMeta:
+      ptr = decode_varint(ptr, limit, &sst_id);
+      if (ptr != nullptr) {
+        ptr = decode_varint(ptr, limit, &num_blocks);
+      }
+      if (ptr != nullptr) {
+        ptr = decode_string(ptr, limit, &meta.first_key);
+      }
+      if (ptr != nullptr) {
+        ptr = decode_string(ptr, limit, &meta.last_key);
+      }
+      if (ptr == nullptr) {
+        break;
+      }
+      meta.num_blocks = num_blocks;
+      edit.file_metas[sst_id] = std::move(meta);
+      break;
+    case kGlobalTrancId:
+      // 总是位于对应的 kFileMeta 之后
+      ptr = decode_varint(ptr, limit, &sst_id);
+      if (ptr != nullptr) {
+        ptr = decode_varint(ptr, limit, &tranc_id);
+      }
+      if (ptr == nullptr) {
+        break;
+      }
+      edit.file_metas[sst_id].global_tranc_id = tranc_id;
+      break;
+    default:
+      throw std::runtime_error("Unknown VersionEdit tag");
+    }
+  }
+  if (ptr != limit) {
+    throw std::runtime_error("Corrupted VersionEdit");
+  }
+  return edit;
+}
+
+// ************************ Version ************************
+
+std::shared_ptr<Version>
+Version::apply(const VersionEdit &edit,
+               const std::vector<std::shared_ptr<SST>> &new_ssts) const {
+  auto version = std::make_shared<Version>(*this);
+
+  // 1. 删除的 sst 可能在 edit 中被重新添加到其他 level
+  std::unordered_map<size_t, std::shared_ptr<SST>> removed;
+  for (auto [level, sst_id] : edit.deleted_files) {
+    auto level_it = version->levels_.find(level);
+    if (level_it == version->levels_.end()) {
+      throw std::runtime_error("Deleting SST from an empty level");
+    }
+    auto &ssts = level_it->second;
+    auto it = std::find_if(ssts.begin(), ssts.end(), [sst_id](auto &sst) {
+      return sst->get_sst_id() == sst_id;
+    });
+    if (it == ssts.end()) {
+      throw std::runtime_error("Deleting SST not in the version");
+    }
+    removed[sst_id] = *it;
+    ssts.erase(it);
+    if (ssts.empty()) {
+      version->levels_.erase(level_it);
+    }
+  }
+
+  // 2. 添加新的 sst
+  for (auto [level, sst_id] : edit.added_files) {
+    std::shared_ptr<SST> sst;
+    auto it = std::find_if(
+        new_ssts.begin(), new_ssts.end(),
+        [sst_id](auto &new_sst) { return new_sst->get_sst_id() == sst_id; });
+    if (it != new_ssts.end()) {
+      sst = *it;
+    } else if (removed.count(sst_id)) {
+      sst = removed[sst_id];
+    } else {
+      throw std::runtime_error("Adding SST without an SST object");
+    }
+    version->levels_[level].push_back(std::move(sst));
+  }
+
+  // 3. 恢复每一层的顺序
+  for (auto &[level, ssts] : version->levels_) {
+    version->sort_level(level);
+  }
+  return version;
+}
+
+void Version::sort_level(size_t level) {
+  auto &ssts = levels_[level];
+  if (level == 0) {
+    // l0 按 id 从大到小排列, 越新的 sst 越靠前
+    std::sort(ssts.begin(), ssts.end(), [](auto &a, auto &b) {
+      return a->get_sst_id() > b->get_sst_id();
+    });
+  } else {
+    // 其他 level 的 sst 都是没有重叠的, 按 key 排序
+    // ! leveled compact 后 id 的大小不再代表 key 的顺序
+    std::sort(ssts.begin(), ssts.end(), [](auto &a, auto &b) {
+      return a->get_first_key() < b->get_first_key();
+    });
+  }
+}
+
+VersionEdit Version::snapshot() const {
+  VersionEdit edit;
+  for (auto &[level, ssts] : levels_) {
+    for (auto &sst : ssts) {
+      edit.add_file(level, sst);
+    }
+  }
+  return edit;
+}
+
+const std::vector<std::shared_ptr<SST>> &
+Version::level_ssts(size_t level) const {
+  static const std::vector<std::shared_ptr<SST>> empty_level;
+  auto it = levels_.find(level);
+  return it == levels_.end() ? empty_level : it->second;
+}
+
+const std::map<size_t, std::vector<std::shared_ptr<SST>>> &
+Version::levels() const {
+  return levels_;
+}
+
+size_t Version::max_level() const {
+  return levels_.empty() ? 0 : levels_.rbegin()->first;
+}
+
+size_t Version::num_ssts(size_t level) const {
+  return level_ssts(level).size();
+}
+
+size_t Version::level_size(size_t level) const {
+  size_t size = 0;
+  for (auto &sst : level_ssts(level)) {
+    size += sst->sst_size();
+  }
+  return size;
+}
+
+std::shared_ptr<SST> Version::find_sst(size_t sst_id) const {
+  for (auto &[level, ssts] : levels_) {
+    for (auto &sst : ssts) {
+      if (sst->get_sst_id() == sst_id) {
+        return sst;
+      }
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<SST> Version::find_level_sst(size_t level,
+                                             const std::string &key) const {
+  auto &ssts = level_ssts(level);
+  // 最后一个首 key 不大于 key 的 sst
+  auto it = std::upper_bound(ssts.begin(), ssts.end(), key,
+                             [](const std::string &k, const auto &sst) {
+                               return k < sst->get_first_key();
+                             });
+  if (it == ssts.begin()) {
+    return nullptr;
+  }
+  --it;
+  if ((*it)->get_last_key() < key) {
+    return nullptr;
+  }
+  return *it;
+}
+
+// ************************ Manifest ************************
+
+void Manifest::encode_record(const VersionEdit &edit,
+                             std::vector<uint8_t> &dst) {
+  auto payload = edit.encode();
+  uint32_t payload_len = payload.size();
+  uint32_t hash = record_hash(payload.data(), payload.size());
+  size_t pos = dst.size();
+  dst.resize(pos + kRecordHeaderSize + payload.size());
+  memcpy(dst.data() + pos, &payload_len, sizeof(uint32_t));
+  memcpy(dst.data() + pos + sizeof(uint32_t), &hash, sizeof(uint32_t));
+  memcpy(dst.data() + pos + kRecordHeaderSize, payload.data(), payload.size());
+}
+
+std::unique_ptr<Manifest> Manifest::create(const std::string &path,
+                                           const VersionEdit &snapshot) {
+  std::vector<uint8_t> buf;
+  encode_record(snapshot, buf);
+  // 先写入临时文件再重命名, 崩溃时旧的 MANIFEST 仍然完整
+  std::string tmp_path = path + ".tmp";
+  FileObj::create_and_write(tmp_path, std::move(buf));
+  std::filesystem::rename(tmp_path, path);
+
+  auto manifest = std::make_unique<Manifest>();
+  manifest->file_ = FileObj::open(path, false);
+  return manifest;
+}
+
+void Manifest::append(const VersionEdit &edit) {
+  std::vector<uint8_t> buf;
+  encode_record(edit, buf);
+  if (!file_.append(buf) || !file_.sync()) {
+    throw std::runtime_error("Failed to append to MANIFEST");
+  }
+}
+
+std::vector<VersionEdit> Manifest::read(const std::string &path) {
+  auto file = FileObj::open(path, false);
+  size_t file_size = file.size();
+  auto bytes = file.read_to_slice(0, file_size);
+
+  std::vector<VersionEdit> edits;
+  size_t pos = 0;
+  while (pos + kRecordHeaderSize <= file_size) {
+    uint32_t payload_len, hash;
+    memcpy(&payload_len, bytes.data() + pos, sizeof(uint32_t));
+    memcpy(&hash, bytes.data() + pos + sizeof(uint32_t), sizeof(uint32_t));
+    const uint8_t *payload = bytes.data() + pos + kRecordHeaderSize;
+    if (payload_len > file_size - pos - kRecordHeaderSize ||
+        record_hash(payload, payload_len) != hash) {
+      // 追加记录时崩溃, 之后的内容都不可信
+      break;
+    }
+    edits.push_back(VersionEdit::decode(payload, payload_len));
+    pos += kRecordHeaderSize + payload_len;
+  }
+  return edits;
+}
@@ -0,0 +1,103 @@
+#include "../../include/lsm/write_batch.h"
+#include "../../include/lsm/column_family.h"
+#include <utility>
+
+void WriteBatch::add(OperationType type, std::string key, std::string value,
+                     uint32_t cf_id) {
+  byte_size_ += key.size() + value.size();
+  operations_.push_back({type, std::move(key), std::move(value), cf_id});
+}
+
+void WriteBatch::put(std::string key, std::string value) {
+  add(OperationType::PUT, std::move(key), std::move(value), 0);
+}
+
+void WriteBatch::remove(std::string key) {
+  add(OperationType::DELETE, std::move(key), "", 0);
+}
+
+void WriteBatch::merge(std::string key, std::string operand) {
+  add(OperationType::MERGE, std::move(key), std::move(operand), 0);
+}
+
+void WriteBatch::remove_range(std::string begin, std::string end) {
+  add(OperationType::DELETE_RANGE, std::move(begin), std::move(end), 0);
+}
+
+void WriteBatch::put(const ColumnFamilyHandle &cf, std::string key,
+                     std::string value) {
+  add(OperationType::PUT, std::move(key), std::move(value), cf.id);
+}
+
+void WriteBatch::remove(const ColumnFamilyHandle &cf, std::string key) {
+  add(OperationType::DELETE, std::move(key), "", cf.id);
+}
+
+void WriteBatch::merge(const ColumnFamilyHandle &cf, std::string key,
+                       std::string operand) {
+  add(OperationType::MERGE, std::move(key), std::move(operand), cf.id);
+}
+
+void WriteBatch::remove_range(const ColumnFamilyHandle &cf, std::string begin,
+                              std::string end) {
+  add(OperationType::DELETE_RANGE, std::move(begin), std::move(end), cf.id);
+}
+
+void WriteBatch::clear() {
+  // 保留已经分配的空间, 复用时不需要重新分配
+  operations_.clear();
+  byte_size_ = 0;
+}
+
+size_t WriteBatch::size() const { return operations_.size(); }
+
+bool WriteBatch::empty() const { return operations_.empty(); }
+
+size_t WriteBatch::byte_size() const { return byte_size_; }
+
+std::vector<Record> WriteBatch::take_records(uint64_t tranc_id) {
+  std::vector<Record> records;
+  records.reserve(operations_.size() + 2);
+  records.push_back(Record::createRecord(tranc_id));
+  // 整个 batch 使用同一个 tranc_id, 范围删除无法覆盖相同 tranc_id 的记录,
+  // 因此提前丢弃被之后的 remove_range 覆盖的 put / remove / merge
+  std::vector<bool> dropped(operations_.size(), false);
+  std::vector<const Operation *> later_ranges;
+  for (size_t i = operations_.size(); i-- > 0;) {
+    auto &operation = operations_[i];
+    if (operation.type == OperationType::DELETE_RANGE) {
+      later_ranges.push_back(&operation);
+      continue;
+    }
+    for (auto *range : later_ranges) {
+      if (range->cf_id == operation.cf_id && range->key <= operation.key &&
+          operation.key < range->value) {
+        dropped[i] = true;
+        break;
+      }
+    }
+  }
+  for (size_t i = 0; i < operations_.size(); i++) {
+    auto &operation = operations_[i];
+    if (dropped[i]) {
+      continue;
+    }
+    if (operation.type == OperationType::DELETE_RANGE) {
+      records.push_back(Record::deleteRangeRecord(
+          tranc_id, std::move(operation.key), std::move(operation.value)));
+    } else if (operation.type == OperationType::PUT) {
+      records.push_back(Record::putRecord(tranc_id, std::move(operation.key),
+                                          std::move(operation.value)));
+    } else if (operation.type == OperationType::MERGE) {
+      records.push_back(Record::mergeRecord(
+          tranc_id, std::move(operation.key), std::move(operation.value)));
+    } else {
+      records.push_back(
+          Record::deleteRecord(tranc_id, std::move(operation.key)));
+    }
+    records.back().setColumnFamilyId(operation.cf_id);
+  }
+  records.push_back(Record::commitRecord(tranc_id));
+  clear();
+  return records;
+}
@@ -0,0 +1,46 @@
+#include "../../include/lsm/write_buffer_manager.h"
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size)
+    : buffer_size_(buffer_size) {}
+
+std::shared_ptr<WriteBufferManager::Member>
+WriteBufferManager::add_member(std::function<void()> flush) {
+  auto member = std::make_shared<Member>();
+  member->flush = std::move(flush);
+  std::lock_guard<std::mutex> lock(mtx_);
+  members_.push_back(member);
+  return member;
+}
+
+void WriteBufferManager::remove_member(const std::shared_ptr<Member> &member) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  members_.remove(member);
+  memory_usage_.fetch_sub(member->usage.exchange(0));
+}
+
+void WriteBufferManager::update(Member &member, size_t usage) {
+  size_t old = member.usage.exchange(usage);
+  // 无符号数的回绕保证 usage < old 时同样正确
+  size_t total = memory_usage_.fetch_add(usage - old) + usage - old;
+  if (total <= buffer_size_) {
+    return;
+  }
+  // 已经有其他写入者在选择刷盘的成员, 不需要重复选择
+  std::unique_lock<std::mutex> lock(mtx_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  Member *largest = nullptr;
+  for (auto &m : members_) {
+    if (largest == nullptr || m->usage.load() > largest->usage.load()) {
+      largest = m.get();
+    }
+  }
+  if (largest != nullptr && largest->usage.load() > 0) {
+    largest->flush();
+  }
+}
+
+size_t WriteBufferManager::buffer_size() const { return buffer_size_; }
+
+size_t WriteBufferManager::memory_usage() const { return memory_usage_.load(); }
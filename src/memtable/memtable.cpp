@@ -3,6 +3,7 @@
 #include "../../include/iterator/iterator.h"
 #include "../../include/skiplist/skiplist.h"
 #include "../../include/sst/sst.h"
+#include "../../include/utils/perf_context.h"
 #include <algorithm>
 #include <cstddef>
 #include <memory>
@@ -17,7 +18,8 @@
 class BlockCache;
 
 // MemTable implementation using PIMPL idiom
-MemTable::MemTable() : frozen_bytes(0) {
+MemTable::MemTable(size_t per_mem_size_limit)
+    : frozen_bytes(0), per_mem_size_limit_(per_mem_size_limit) {
   current_table = std::make_shared<SkipList>();
 }
 MemTable::~MemTable() = default;
@@ -29,25 +31,32 @@ void MemTable::put_(const std::string &key, const std::string &value,
 
 void MemTable::put(const std::string &key, const std::string &value,
                    uint64_t tranc_id) {
-  std::unique_lock<std::shared_mutex> lock1(cur_mtx);
+  // 跳表本身支持并发写入, 写者只需要共享锁, 防止活跃表在写入期间被冻结
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
   put_(key, value, tranc_id);
-  if (current_table->get_size() > LSM_PER_MEM_SIZE_LIMIT) {
-    // 冻结当前表还需要获取frozen_mtx的写锁
-    std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
-    frozen_cur_table_();
-  }
+  slock.unlock();
+  try_frozen_cur_table();
 }
 
 void MemTable::put_batch(
     const std::vector<std::pair<std::string, std::string>> &kvs,
     uint64_t tranc_id) {
-  std::unique_lock<std::shared_mutex> lock1(cur_mtx);
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
   for (auto &[k, v] : kvs) {
     put_(k, v, tranc_id);
   }
-  if (current_table->get_size() > LSM_PER_MEM_SIZE_LIMIT) {
-    // 冻结当前表还需要获取frozen_mtx的写锁
-    std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
+  slock.unlock();
+  try_frozen_cur_table();
+}
+
+void MemTable::try_frozen_cur_table() {
+  if (get_cur_size() <= per_mem_size_limit_) {
+    return;
+  }
+  // 冻结当前表需要两把写锁, 获取锁之后需要再次检查, 避免多个写者重复冻结
+  std::unique_lock<std::shared_mutex> lock1(cur_mtx);
+  std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
+  if (current_table->get_memory_usage() > per_mem_size_limit_) {
     frozen_cur_table_();
   }
 }
@@ -79,15 +88,17 @@ SkipListIterator MemTable::frozen_get_(const std::string &key,
 }
 
 SkipListIterator MemTable::get(const std::string &key, uint64_t tranc_id) {
-  // 先获取当前活跃表的锁
-  std::shared_lock<std::shared_mutex> slock1(cur_mtx);
-  auto cur_res = cur_get_(key, tranc_id);
+  // 读锁只用于获取活跃表的快照, 跳表的查询本身不需要加锁
+  auto cur_res = get_cur_table()->get(key, tranc_id);
   if (cur_res.is_valid()) {
     return cur_res;
   }
   // 活跃表没有找到，再获取冻结表的锁
-  slock1.unlock();
-  std::shared_lock<std::shared_mutex> slock2(frozen_mtx);
+  std::shared_lock<std::shared_mutex> slock2(frozen_mtx, std::defer_lock);
+  {
+    PerfTimer timer(&PerfContext::memtable_lock_nanos);
+    slock2.lock();
+  }
   auto frozen_result = frozen_get_(key, tranc_id);
   if (frozen_result.is_valid()) {
     return frozen_result;
@@ -95,6 +106,15 @@ SkipListIterator MemTable::get(const std::string &key, uint64_t tranc_id) {
   return SkipListIterator{};
 }
 
+std::shared_ptr<SkipList> MemTable::get_cur_table() {
+  std::shared_lock<std::shared_mutex> slock(cur_mtx, std::defer_lock);
+  {
+    PerfTimer timer(&PerfContext::memtable_lock_nanos);
+    slock.lock();
+  }
+  return current_table;
+}
+
 SkipListIterator MemTable::get_(const std::string &key, uint64_t tranc_id) {
 
   auto cur_res = cur_get_(key, tranc_id);
@@ -117,11 +137,11 @@ MemTable::get_batch(const std::vector<std::string> &keys, uint64_t tranc_id) {
       results;
   results.reserve(keys.size());
 
-  // 1. 先获取活跃表的锁
-  std::shared_lock<std::shared_mutex> slock1(cur_mtx);
+  // 1. 先在活跃表的快照中查找
+  auto cur_table = get_cur_table();
   for (size_t idx = 0; idx < keys.size(); idx++) {
     auto key = keys[idx];
-    auto cur_res = cur_get_(key, tranc_id);
+    auto cur_res = cur_table->get(key, tranc_id);
     if (cur_res.is_valid()) {
       // 值存在且不为空
       // ! 此时value可能为空, 需要返回时置为 nullopt
@@ -147,7 +167,6 @@ MemTable::get_batch(const std::vector<std::string> &keys, uint64_t tranc_id) {
     return results;
   }
 
-  slock1.unlock();                                        // 释放活跃表的锁
   std::shared_lock<std::shared_mutex> slock2(frozen_mtx); // 获取冻结表的锁
   for (size_t idx = 0; idx < keys.size(); idx++) {
     if (results[idx].second.has_value()) {
@@ -175,33 +194,90 @@ MemTable::get_batch(const std::vector<std::string> &keys, uint64_t tranc_id) {
   return results;
 }
 
+void MemTable::merge_(const std::string &key, const std::string &operand,
+                      uint64_t tranc_id) {
+  if (operand.empty()) {
+    // 空值表示删除, 空的操作数不改变 value, 直接忽略
+    return;
+  }
+  current_table->put(key, operand, tranc_id, true);
+}
+
+void MemTable::merge(const std::string &key, const std::string &operand,
+                     uint64_t tranc_id) {
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
+  merge_(key, operand, tranc_id);
+  slock.unlock();
+  try_frozen_cur_table();
+}
+
 void MemTable::remove_(const std::string &key, uint64_t tranc_id) {
   // 删除的方式是写入空值
   current_table->put(key, "", tranc_id);
 }
 
 void MemTable::remove(const std::string &key, uint64_t tranc_id) {
-  std::unique_lock<std::shared_mutex> lock(cur_mtx);
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
   remove_(key, tranc_id);
-  if (current_table->get_size() > LSM_PER_MEM_SIZE_LIMIT) {
-    // 冻结当前表还需要获取frozen_mtx的写锁
-    std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
-    frozen_cur_table_();
-  }
+  slock.unlock();
+  try_frozen_cur_table();
 }
 
 void MemTable::remove_batch(const std::vector<std::string> &keys,
                             uint64_t tranc_id) {
-  std::unique_lock<std::shared_mutex> lock(cur_mtx);
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
   // 删除的方式是写入空值
   for (auto &key : keys) {
     remove_(key, tranc_id);
   }
-  if (current_table->get_size() > LSM_PER_MEM_SIZE_LIMIT) {
-    // 冻结当前表还需要获取frozen_mtx的写锁
-    std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
-    frozen_cur_table_();
+  slock.unlock();
+  try_frozen_cur_table();
+}
+
+void MemTable::remove_range(const std::string &begin, const std::string &end,
+                            uint64_t tranc_id) {
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
+  current_table->add_range_tombstone(begin, end, tranc_id);
+  num_range_dels++;
+  slock.unlock();
+  try_frozen_cur_table();
+}
+
+bool MemTable::has_merge_operands() {
+  for (auto &table : get_tables()) {
+    if (table->has_merge_operands()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t MemTable::range_del_covering(const std::string &key,
+                                      uint64_t tranc_id) {
+  if (num_range_dels.load() == 0) {
+    return 0;
+  }
+  return tables_range_del_covering(get_tables(), key, tranc_id);
+}
+
+void MemTable::apply_records(const std::vector<Record> &records) {
+  std::shared_lock<std::shared_mutex> slock(cur_mtx);
+  for (auto &record : records) {
+    if (record.getOperationType() == OperationType::PUT) {
+      put_(record.getKey(), record.getValue(), record.getTrancId());
+    } else if (record.getOperationType() == OperationType::DELETE) {
+      remove_(record.getKey(), record.getTrancId());
+    } else if (record.getOperationType() == OperationType::MERGE) {
+      merge_(record.getKey(), record.getValue(), record.getTrancId());
+    } else if (record.getOperationType() == OperationType::DELETE_RANGE) {
+      // key 和 value 分别为范围的起止
+      current_table->add_range_tombstone(record.getKey(), record.getValue(),
+                                         record.getTrancId());
+      num_range_dels++;
+    }
   }
+  slock.unlock();
+  try_frozen_cur_table();
 }
 
 void MemTable::clear() {
@@ -209,17 +285,13 @@ void MemTable::clear() {
   std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
   frozen_tables.clear();
   current_table->clear();
+  num_range_dels = 0;
 }
 
-// 将最老的 memtable 写入 SST, 并返回控制类
-std::shared_ptr<SST>
-MemTable::flush_last(SSTBuilder &builder, std::string &sst_path, size_t sst_id,
-                     std::shared_ptr<BlockCache> block_cache) {
-  // 由于 flush 后需要移除最老的 memtable, 因此需要加写锁
-  std::unique_lock<std::shared_mutex> lock(frozen_mtx);
-
-  uint64_t max_tranc_id = 0;
-  uint64_t min_tranc_id = UINT64_MAX;
+std::shared_ptr<SkipList> MemTable::get_last_frozen() {
+  // 可能需要冻结活跃表, 因此两把写锁都需要获取
+  std::unique_lock<std::shared_mutex> lock1(cur_mtx);
+  std::unique_lock<std::shared_mutex> lock2(frozen_mtx);
 
   if (frozen_tables.empty()) {
     // 如果当前表为空，直接返回nullptr
@@ -227,31 +299,24 @@ MemTable::flush_last(SSTBuilder &builder, std::string &sst_path, size_t sst_id,
       return nullptr;
     }
     // 将当前表加入到frozen_tables头部
-    frozen_tables.push_front(current_table);
-    frozen_bytes += current_table->get_size();
-    // 创建新的空表作为当前表
-    current_table = std::make_shared<SkipList>();
+    frozen_cur_table_();
   }
 
-  // 将最老的 memtable 写入 SST
-  std::shared_ptr<SkipList> table = frozen_tables.back();
-  frozen_tables.pop_back();
-  frozen_bytes -= table->get_size();
-
-  std::vector<std::tuple<std::string, std::string, uint64_t>> flush_data =
-      table->flush();
-  for (auto &[k, v, t] : flush_data) {
-    max_tranc_id = std::max(t, max_tranc_id);
-    min_tranc_id = std::min(t, min_tranc_id);
-    builder.add(k, v, t);
-  }
-  auto sst = builder.build(sst_id, sst_path, block_cache);
+  return frozen_tables.back();
+}
 
-  return sst;
+void MemTable::remove_last_frozen() {
+  std::unique_lock<std::shared_mutex> lock(frozen_mtx);
+  if (frozen_tables.empty()) {
+    return;
+  }
+  frozen_bytes -= frozen_tables.back()->get_memory_usage();
+  num_range_dels -= frozen_tables.back()->num_range_tombstones();
+  frozen_tables.pop_back();
 }
 
 void MemTable::frozen_cur_table_() {
-  frozen_bytes += current_table->get_size();
+  frozen_bytes += current_table->get_memory_usage();
   frozen_tables.push_front(std::move(current_table));
   current_table = std::make_shared<SkipList>();
 }
@@ -264,7 +329,7 @@ void MemTable::frozen_cur_table() {
 
 size_t MemTable::get_cur_size() {
   std::shared_lock<std::shared_mutex> slock(cur_mtx);
-  return current_table->get_size();
+  return current_table->get_memory_usage();
 }
 
 size_t MemTable::get_frozen_size() {
@@ -275,37 +340,12 @@ size_t MemTable::get_frozen_size() {
 size_t MemTable::get_total_size() {
   std::shared_lock<std::shared_mutex> slock1(cur_mtx);
   std::shared_lock<std::shared_mutex> slock2(frozen_mtx);
-  return get_frozen_size() + get_cur_size();
+  // ! 这里不能调用 get_frozen_size / get_cur_size, 否则会重复获取读锁
+  return frozen_bytes + current_table->get_memory_usage();
 }
 
 HeapIterator MemTable::begin(uint64_t tranc_id) {
-  std::shared_lock<std::shared_mutex> slock1(cur_mtx);
-  std::shared_lock<std::shared_mutex> slock2(frozen_mtx);
-  std::vector<SearchItem> item_vec;
-
-  for (auto iter = current_table->begin(); iter != current_table->end();
-       ++iter) {
-    if (tranc_id != 0 && iter.get_tranc_id() > tranc_id) {
-      continue;
-    }
-    item_vec.emplace_back(iter.get_key(), iter.get_value(), 0, 0,
-                          iter.get_tranc_id());
-  }
-
-  int table_idx = 1;
-  for (auto ft = frozen_tables.begin(); ft != frozen_tables.end(); ft++) {
-    auto table = *ft;
-    for (auto iter = table->begin(); iter != table->end(); ++iter) {
-      if (tranc_id != 0 && iter.get_tranc_id() > tranc_id) {
-        continue;
-      }
-      item_vec.emplace_back(iter.get_key(), iter.get_value(), table_idx, 0,
-                            iter.get_tranc_id());
-    }
-    table_idx++;
-  }
-
-  return HeapIterator(item_vec, tranc_id);
+  return tables_begin(get_tables(), tranc_id);
 }
 
 HeapIterator MemTable::end() {
@@ -332,7 +372,7 @@ HeapIterator MemTable::iters_preffix(const std::string &preffix,
       continue;
     }
     item_vec.emplace_back(iter.get_key(), iter.get_value(), 0, 0,
-                          iter.get_tranc_id());
+                          iter.get_tranc_id(), iter.is_merge_operand());
   }
 
   int table_idx = 1;
@@ -350,7 +390,7 @@ HeapIterator MemTable::iters_preffix(const std::string &preffix,
         continue;
       }
       item_vec.emplace_back(iter.get_key(), iter.get_value(), table_idx, 0,
-                            iter.get_tranc_id());
+                            iter.get_tranc_id(), iter.is_merge_operand());
     }
     table_idx++;
   }
@@ -361,14 +401,75 @@ HeapIterator MemTable::iters_preffix(const std::string &preffix,
 std::optional<std::pair<HeapIterator, HeapIterator>>
 MemTable::iters_monotony_predicate(
     uint64_t tranc_id, std::function<int(const std::string &)> predicate) {
+  return tables_iters_monotony_predicate(get_tables(), tranc_id,
+                                         std::move(predicate));
+}
+
+std::vector<std::shared_ptr<SkipList>> MemTable::get_tables() {
   std::shared_lock<std::shared_mutex> slock1(cur_mtx);
   std::shared_lock<std::shared_mutex> slock2(frozen_mtx);
+  std::vector<std::shared_ptr<SkipList>> tables;
+  tables.reserve(frozen_tables.size() + 1);
+  tables.push_back(current_table);
+  tables.insert(tables.end(), frozen_tables.begin(), frozen_tables.end());
+  return tables;
+}
+
+SkipListIterator
+MemTable::tables_get(const std::vector<std::shared_ptr<SkipList>> &tables,
+                     const std::string &key, uint64_t tranc_id) {
+  for (auto &table : tables) {
+    auto result = table->get(key, tranc_id);
+    if (result.is_valid()) {
+      // 只要找到了 key, 不管 value 是否为空都返回
+      return result;
+    }
+  }
+  return SkipListIterator{};
+}
+
+uint64_t MemTable::tables_range_del_covering(
+    const std::vector<std::shared_ptr<SkipList>> &tables,
+    const std::string &key, uint64_t tranc_id) {
+  uint64_t covering = 0;
+  for (auto &table : tables) {
+    if (auto range_dels = table->get_range_tombstones()) {
+      covering = std::max(covering, range_dels->max_covering(key, tranc_id));
+    }
+  }
+  return covering;
+}
 
+HeapIterator
+MemTable::tables_begin(const std::vector<std::shared_ptr<SkipList>> &tables,
+                       uint64_t tranc_id) {
   std::vector<SearchItem> item_vec;
+  // 表在 tables 中的下标越小越新, 在堆中优先
+  for (size_t table_idx = 0; table_idx < tables.size(); table_idx++) {
+    auto &table = tables[table_idx];
+    for (auto iter = table->begin(); iter != table->end(); ++iter) {
+      if (tranc_id != 0 && iter.get_tranc_id() > tranc_id) {
+        continue;
+      }
+      item_vec.emplace_back(iter.get_key(), iter.get_value(), table_idx, 0,
+                            iter.get_tranc_id(), iter.is_merge_operand());
+    }
+  }
+  return HeapIterator(item_vec, tranc_id);
+}
 
-  auto cur_result = current_table->iters_monotony_predicate(predicate);
-  if (cur_result.has_value()) {
-    auto [begin, end] = cur_result.value();
+std::optional<std::pair<HeapIterator, HeapIterator>>
+MemTable::tables_iters_monotony_predicate(
+    const std::vector<std::shared_ptr<SkipList>> &tables, uint64_t tranc_id,
+    std::function<int(const std::string &)> predicate) {
+  std::vector<SearchItem> item_vec;
+
+  for (size_t table_idx = 0; table_idx < tables.size(); table_idx++) {
+    auto result = tables[table_idx]->iters_monotony_predicate(predicate);
+    if (!result.has_value()) {
+      continue;
+    }
+    auto [begin, end] = result.value();
     for (auto iter = begin; iter != end; ++iter) {
       if (tranc_id != 0 && iter.get_tranc_id() > tranc_id) {
         // 如果开启了事务, 比当前事务 id 更大的记录是不可见的
@@ -379,32 +480,9 @@ MemTable::iters_monotony_predicate(
         // 且这个记录既然已经存在于item_vec中，则其肯定满足了事务的可见性判断
         continue;
       }
-      item_vec.emplace_back(iter.get_key(), iter.get_value(), 0, 0,
-                            iter.get_tranc_id());
-    }
-  }
-
-  int table_idx = 1;
-  for (auto ft = frozen_tables.begin(); ft != frozen_tables.end(); ft++) {
-    auto table = *ft;
-    auto result = table->iters_monotony_predicate(predicate);
-    if (result.has_value()) {
-      auto [begin, end] = result.value();
-      for (auto iter = begin; iter != end; ++iter) {
-        if (tranc_id != 0 && iter.get_tranc_id() > tranc_id) {
-          // 如果开启了事务, 比当前事务 id 更大的记录是不可见的
-          continue;
-        }
-        if (!item_vec.empty() && item_vec.back().key_ == iter.get_key()) {
-          // 如果key相同，则只保留最新的事务修改的记录即可
-          // 且这个记录既然已经存在于item_vec中，则其肯定满足了事务的可见性判断
-          continue;
-        }
-        item_vec.emplace_back(iter.get_key(), iter.get_value(), table_idx, 0,
-                              iter.get_tranc_id());
-      }
+      item_vec.emplace_back(iter.get_key(), iter.get_value(), table_idx, 0,
+                            iter.get_tranc_id(), iter.is_merge_operand());
     }
-    table_idx++;
   }
 
   if (item_vec.empty()) {
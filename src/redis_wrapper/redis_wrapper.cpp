@@ -1,9 +1,13 @@
 #include "../../include/redis_wrapper/redis_wrapper.h"
+#include "../../include/redis_wrapper/resp.h"
 #include "../../include/consts.h"
+#include "../../include/utils/hash.h"
 #include <algorithm>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <optional>
 #include <shared_mutex>
@@ -13,9 +17,110 @@
 #include <vector>
 #include <unordered_set>
 
+// ************************ RedisMergeOperator ************************
+
+std::string RedisMergeOperator::name() const { return "redis"; }
+
+bool RedisMergeOperator::full_merge(
+    std::string_view key, const std::optional<std::string_view> &existing,
+    const std::vector<std::string_view> &operands, std::string &result) const {
+  // 操作数作用于去除过期时间后的 value, INCR / APPEND 不改变过期时间
+  std::optional<std::string> cur;
+  RedisTtlValue ttl_value;
+  if (existing.has_value()) {
+    ttl_value = decode_ttl_value(existing.value());
+    cur.emplace(std::move(ttl_value.value));
+  }
+  for (auto operand : operands) {
+    if (operand.empty()) {
+      continue;
+    }
+    auto arg = operand.substr(1);
+    if (operand[0] == kAppendTag) {
+      if (!cur.has_value()) {
+        cur.emplace();
+      }
+      cur->append(arg);
+    } else if (operand[0] == kIncrTag) {
+      auto delta = Int64AddOperator::parse(arg);
+      int64_t value = 0;
+      if (cur.has_value()) {
+        auto base = Int64AddOperator::parse(cur.value());
+        if (!base.has_value()) {
+          continue;
+        }
+        value = base.value();
+      }
+      if (!delta.has_value() ||
+          __builtin_add_overflow(value, delta.value(), &value)) {
+        continue;
+      }
+      cur = std::to_string(value);
+    }
+  }
+  if (!cur.has_value()) {
+    return false;
+  }
+  result = encode_ttl_value(cur.value(), ttl_value.expire_at,
+                            ttl_value.collection);
+  return true;
+}
+
+bool RedisMergeOperator::partial_merge(std::string_view key,
+                                       std::string_view left,
+                                       std::string_view right,
+                                       std::string &result) const {
+  if (left.empty() || right.empty() || left[0] != right[0]) {
+    return false;
+  }
+  if (left[0] == kAppendTag) {
+    result.assign(left);
+    result.append(right.substr(1));
+    return true;
+  }
+  // 增量之和溢出时单独作用的结果可能不同, 不能合并
+  auto a = Int64AddOperator::parse(left.substr(1));
+  auto b = Int64AddOperator::parse(right.substr(1));
+  int64_t sum;
+  if (left[0] != kIncrTag || !a.has_value() || !b.has_value() ||
+      __builtin_add_overflow(a.value(), b.value(), &sum)) {
+    return false;
+  }
+  result = kIncrTag + std::to_string(sum);
+  return true;
+}
+
+// ********************* RedisTtlCompactionFilter *********************
+
+std::string RedisTtlCompactionFilter::name() const { return "redis_ttl"; }
+
+bool RedisTtlCompactionFilter::filter(std::string_view key,
+                                      std::string_view value) const {
+  std::string_view header = REDIS_TTL_HEADER;
+  if (value.compare(0, header.size(), header) != 0) {
+    // 大部分 value 没有过期时间, 不需要解析
+    return false;
+  }
+  auto ttl_value = decode_ttl_value(value);
+  return !ttl_value.collection && ttl_value.expired();
+}
+
 // Helper functions
-RedisWrapper::RedisWrapper(const std::string &db_path) {
-  this->lsm = std::make_unique<LSM>(db_path);
+RedisWrapper::RedisWrapper(const std::string &db_path, bool wal_all_writes)
+    : RedisWrapper(db_path, [wal_all_writes]() {
+        Options options;
+        options.wal_all_writes = wal_all_writes;
+        return options;
+      }()) {}
+
+RedisWrapper::RedisWrapper(const std::string &db_path, Options options) {
+  // 集合类型按 key 的前缀扫描, 使用前缀过滤器跳过不相关的 sst
+  // INCR / DECR / APPEND 只写入操作数, 由 RedisMergeOperator 合并
+  // 过期的字符串由 RedisTtlCompactionFilter 在 compact 时清理
+  options.prefix_extractor = std::make_shared<RedisPrefixExtractor>();
+  options.merge_operator = std::make_shared<RedisMergeOperator>();
+  options.compaction_filter = std::make_shared<RedisTtlCompactionFilter>();
+  this->lsm = std::make_unique<LSM>(db_path, options);
 }
 
 std::vector<std::string>
@@ -56,9 +161,6 @@ inline bool is_value_hash(const std::string &key) {
   return key.find(REDIS_HASH_VALUE_PREFFIX) == 0;
 }
 
-inline std::string get_explire_key(const std::string &key) {
-  return REDIS_EXPIRE_HEADER + key;
-}
 
 std::string get_zset_key_socre(const std::string &key,
                                const std::string &score) {
@@ -114,36 +216,234 @@ inline std::string get_set_member_key(const std::string &key,
 
 inline std::string get_set_member_value() { return "1"; }
 
+inline std::string get_set_meta_value(int64_t size) {
+  return REDIS_SET_META_PREFFIX + std::to_string(size);
+}
+
+inline bool is_set_meta(const std::string &value) {
+  return value.find(REDIS_SET_META_PREFFIX) == 0;
+}
+
+// 旧版本中集合的元数据只有十进制的大小
+int64_t decode_set_size(const std::string &value) {
+  std::string preffix = REDIS_SET_META_PREFFIX;
+  if (is_set_meta(value)) {
+    return std::stoll(value.substr(preffix.size()));
+  }
+  return std::stoll(value);
+}
+// 以 preffix 开头的 key 都小于返回值, 用作范围删除的右边界
+inline std::string get_preffix_successor(const std::string &preffix) {
+  std::string successor = preffix;
+  while (!successor.empty() &&
+         static_cast<unsigned char>(successor.back()) == 0xff) {
+    successor.pop_back();
+  }
+  if (!successor.empty()) {
+    successor.back()++;
+  }
+  return successor;
+}
+
 inline std::string get_set_member_prefix(const std::string &key) {
   return REDIS_SET_PREFIX + key + "_";
 }
 
-bool is_expired(const std::optional<std::string> &expire_str,
-                std::time_t *now_time) {
-  if (!expire_str.has_value()) {
+// redis 的元素, 字段和链表的内部 key, SCAN 时跳过
+inline bool is_internal_key(std::string_view key) {
+  return key.starts_with(REDIS_FIELD_PREFIX) ||
+         key.starts_with(REDIS_LIST_PREFIX) ||
+         key.starts_with(REDIS_SORTED_SET_PREFIX) ||
+         key.starts_with(REDIS_SET_PREFIX);
+}
+
+// ****** SCAN 的游标 ******
+// 下一次读取的起点编码为十六进制, 非空的 key 不会编码为 "0"
+std::string encode_scan_cursor(const std::optional<std::string> &next) {
+  if (!next.has_value() || next->empty()) {
+    return "0";
+  }
+  static constexpr char kHex[] = "0123456789abcdef";
+  std::string cursor;
+  cursor.reserve(next->size() * 2);
+  for (unsigned char c : next.value()) {
+    cursor.push_back(kHex[c >> 4]);
+    cursor.push_back(kHex[c & 0xf]);
+  }
+  return cursor;
+}
+
+std::optional<std::string> decode_scan_cursor(std::string_view cursor) {
+  if (cursor == "0") {
+    return std::string{};
+  }
+  if (cursor.empty() || cursor.size() % 2 != 0) {
+    return std::nullopt;
+  }
+  auto hex_value = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  };
+  std::string start;
+  start.reserve(cursor.size() / 2);
+  for (size_t i = 0; i < cursor.size(); i += 2) {
+    int hi = hex_value(cursor[i]);
+    int lo = hex_value(cursor[i + 1]);
+    if (hi < 0 || lo < 0) {
+      return std::nullopt;
+    }
+    start.push_back(static_cast<char>(hi << 4 | lo));
+  }
+  return start;
+}
+
+// 解析 args[cursor_idx] 的游标和之后的 COUNT 选项, 失败时返回错误回复
+std::optional<std::string> parse_scan_args(const std::vector<std::string> &args,
+                                           size_t cursor_idx,
+                                           std::string &start, size_t &count) {
+  if (args.size() <= cursor_idx) {
+    return "-ERR wrong number of arguments for '" + args[0] +
+           "' command\r\n";
+  }
+  auto decoded = decode_scan_cursor(args[cursor_idx]);
+  if (!decoded.has_value()) {
+    return "-ERR invalid cursor\r\n";
+  }
+  start = std::move(decoded.value());
+  count = REDIS_SCAN_DEFAULT_COUNT;
+  for (size_t i = cursor_idx + 1; i < args.size(); i += 2) {
+    std::string option = args[i];
+    std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+    if (option != "COUNT" || i + 1 >= args.size()) {
+      return "-ERR syntax error\r\n";
+    }
+    auto &value = args[i + 1];
+    int64_t parsed;
+    auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (ec != std::errc() || ptr != value.data() + value.size() || parsed < 1) {
+      return "-ERR value is not an integer or out of range\r\n";
+    }
+    count = std::min<size_t>(parsed, REDIS_SCAN_MAX_COUNT);
+  }
+  return std::nullopt;
+}
+
+// 游标遍历的回复: | 下一次的游标 | 元素数组 |
+std::string scan_reply(const std::optional<std::string> &next,
+                       const std::vector<std::string> &items) {
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(2);
+  writer.bulk(encode_scan_cursor(next));
+  writer.array(items.size());
+  for (auto &item : items) {
+    writer.bulk(item);
+  }
+  return res_str;
+}
+
+// 序号使用定长的十六进制, 元素 key 的字典序与序号的顺序一致
+inline std::string get_list_elem_key(const std::string &key, uint64_t seq) {
+  std::ostringstream oss;
+  oss << REDIS_LIST_PREFIX << key << "_" << std::hex << std::setw(16)
+      << std::setfill('0') << seq;
+  return oss.str();
+}
+
+inline std::string get_list_meta_value(const RedisListMeta &meta) {
+  return REDIS_LIST_META_PREFFIX + std::to_string(meta.head) + "_" +
+         std::to_string(meta.tail);
+}
+
+// value 不是元数据 (旧版本的拼接格式) 时返回 nullopt
+std::optional<RedisListMeta> decode_list_meta(const std::string &value) {
+  std::string preffix = REDIS_LIST_META_PREFFIX;
+  if (value.compare(0, preffix.size(), preffix) != 0) {
+    return std::nullopt;
+  }
+  auto pos = value.find('_', preffix.size());
+  if (pos == std::string::npos) {
+    return std::nullopt;
+  }
+  RedisListMeta meta;
+  meta.head = std::stoull(value.substr(preffix.size(), pos - preffix.size()));
+  meta.tail = std::stoull(value.substr(pos + 1));
+  return meta;
+}
+
+bool RedisTtlValue::expired(std::time_t *now) const {
+  if (!expire_at.has_value()) {
     return false;
   }
-  auto now = std::chrono::system_clock::now();
-  auto now_time_t = std::chrono::system_clock::to_time_t(now);
+  auto now_time_t =
+      std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
-  if (now_time != nullptr) {
-    *now_time = now_time_t;
+  if (now != nullptr) {
+    *now = now_time_t;
   }
 
   // 检查是否过期
-  return (std::stoll(expire_str.value()) < now_time_t);
+  return expire_at.value() < now_time_t;
+}
+
+std::string encode_ttl_value(const std::string &value,
+                             std::optional<int64_t> expire_at,
+                             bool collection) {
+  if (!expire_at.has_value()) {
+    return value;
+  }
+  std::ostringstream oss;
+  oss << REDIS_TTL_HEADER
+      << (collection ? RedisTtlValue::kCollectionTag
+                     : RedisTtlValue::kStringTag)
+      << std::setw(REDIS_TTL_TIME_LEN) << std::setfill('0')
+      << expire_at.value() << value;
+  return oss.str();
 }
 
-std::string get_expire_time(const std::string &seconds_count) {
+RedisTtlValue decode_ttl_value(std::string_view raw) {
+  RedisTtlValue result;
+  std::string_view header = REDIS_TTL_HEADER;
+  size_t value_offset = header.size() + 1 + REDIS_TTL_TIME_LEN;
+  if (raw.size() >= value_offset && raw.compare(0, header.size(), header) == 0) {
+    char tag = raw[header.size()];
+    auto time_str = raw.substr(header.size() + 1, REDIS_TTL_TIME_LEN);
+    int64_t expire_at;
+    auto [ptr, ec] = std::from_chars(
+        time_str.data(), time_str.data() + time_str.size(), expire_at);
+    if ((tag == RedisTtlValue::kStringTag ||
+         tag == RedisTtlValue::kCollectionTag) &&
+        ec == std::errc() && ptr == time_str.data() + time_str.size()) {
+      result.value.assign(raw.substr(value_offset));
+      result.expire_at = expire_at;
+      result.collection = tag == RedisTtlValue::kCollectionTag;
+      return result;
+    }
+  }
+  // 没有设置过期时间
+  result.value.assign(raw);
+  return result;
+}
+
+// 集合的元数据, 设置过期时间时需要与字符串区分
+// ! 旧版本格式的链表和集合元数据无法识别, 按字符串处理
+bool is_collection_value(const std::string &key, const std::string &value) {
+  return is_value_hash(value) || decode_list_meta(value).has_value() ||
+         value == get_zset_key_preffix(key) || is_set_meta(value);
+}
+
+int64_t get_expire_time(const std::string &seconds_count) {
   // 获取当前时间戳, 以秒为单位
   auto now = std::chrono::system_clock::now();
   auto now_time_t = std::chrono::system_clock::to_time_t(now);
 
-  auto time_add = std::stoll(seconds_count);
-
-  // 将时间戳转换为字符串
-  std::string expire_time_str = std::to_string(now_time_t + time_add);
-  return expire_time_str;
+  return now_time_t + std::stoll(seconds_count);
 }
 
 std::vector<std::string> split(const std::string &str, char delimiter) {
@@ -168,100 +468,175 @@ std::string join(const std::vector<std::string> &elements, char delimiter) {
 }
 
 // ************************ Redis *************************
-bool RedisWrapper::expire_hash_clean(
-    const std::string &key, std::shared_lock<std::shared_mutex> &rlock) {
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
-
-  if (is_expired(expire_query, nullptr)) {
-    // 整个哈希数据结构都过期了, 需要删除所有的字段
-    // 先升级锁
-    rlock.unlock();                                       // 解锁读锁
-    std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-    auto fileds = get_fileds_from_hash_value(lsm->get(key));
-    for (const auto &field : fileds) {
-      std::string field_key = get_hash_filed_key(key, field);
-      lsm->remove(field_key);
-    }
-    lsm->remove(key);
-    lsm->remove(expire_key);
-    return true;
+std::shared_mutex &RedisWrapper::key_mutex(const std::string &key) {
+  return key_mtxs[hash64(key) % REDIS_LOCK_STRIPES];
+}
+
+std::vector<size_t>
+RedisWrapper::key_stripes(const std::vector<std::string> &keys) {
+  std::vector<size_t> stripes;
+  stripes.reserve(keys.size());
+  for (auto &key : keys) {
+    stripes.push_back(hash64(key) % REDIS_LOCK_STRIPES);
   }
-  return false;
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  return stripes;
 }
 
-bool RedisWrapper::expire_list_clean(
-    const std::string &key, std::shared_lock<std::shared_mutex> &rlock) {
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
-  if (is_expired(expire_query, nullptr)) {
-    // 链表都过期了, 需要删除链表
-    // 先升级锁
-    rlock.unlock();                                       // 解锁读锁
-    std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-    lsm->remove(key);
-    lsm->remove(expire_key);
-    return true;
+std::vector<std::unique_lock<std::shared_mutex>>
+RedisWrapper::lock_keys(const std::vector<std::string> &keys) {
+  std::vector<std::unique_lock<std::shared_mutex>> locks;
+  for (auto stripe : key_stripes(keys)) {
+    locks.emplace_back(key_mtxs[stripe]);
   }
-  return false;
-}
-
-bool RedisWrapper::expire_zset_clean(
-    const std::string &key, std::shared_lock<std::shared_mutex> &rlock) {
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
-  if (is_expired(expire_query, nullptr)) {
-    // 都过期了, 需要删除zset
-    // 先升级锁
-    rlock.unlock();                                       // 解锁读锁
-    std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-    lsm->remove(key);
-    lsm->remove(expire_key);
-    auto preffix = get_zset_key_preffix(key);
-    auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-        0, [&preffix](const std::string &elem) {
-          return -elem.compare(0, preffix.size(), preffix);
-        });
-    if (result_elem.has_value()) {
-      auto [elem_begin, elem_end] = result_elem.value();
-      std::vector<std::string> remove_vec;
-      for (; elem_begin != elem_end; ++elem_begin) {
-        remove_vec.push_back(elem_begin->first);
-      }
-      lsm->remove_batch(remove_vec);
-    }
-    return true;
+  return locks;
+}
+
+std::vector<std::shared_lock<std::shared_mutex>>
+RedisWrapper::lock_keys_shared(const std::vector<std::string> &keys) {
+  std::vector<std::shared_lock<std::shared_mutex>> locks;
+  for (auto stripe : key_stripes(keys)) {
+    locks.emplace_back(key_mtxs[stripe]);
+  }
+  return locks;
+}
+
+std::optional<RedisTtlValue> RedisWrapper::get_value(const std::string &key) {
+  auto raw = lsm->get(key);
+  if (!raw.has_value()) {
+    return std::nullopt;
+  }
+  return decode_ttl_value(raw.value());
+}
+
+std::optional<RedisTtlValue>
+RedisWrapper::get_live_value(const std::string &key) {
+  auto value = get_value(key);
+  if (value.has_value() && value->expired()) {
+    // 过期的数据只在之后的写命令中清理, 读命令不会写入
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<RedisTtlValue>
+RedisWrapper::get_value_for_write(const std::string &key) {
+  auto value = get_value(key);
+  if (value.has_value() && value->expired()) {
+    // 集合的元素需要在写入新的数据之前删除, 否则会重新可见
+    remove_with_elements(key, value->value);
+    return std::nullopt;
   }
-  return false;
-}
-
-bool RedisWrapper::expire_set_clean(
-    const std::string &key, std::shared_lock<std::shared_mutex> &rlock) {
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
-  if (is_expired(expire_query, nullptr)) {
-    // set都过期了, 需要删除set
-    // 先升级锁
-    rlock.unlock();                                       // 解锁读锁
-    std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-    lsm->remove(key);
-    lsm->remove(expire_key);
-    auto preffix = get_set_key_preffix(key);
-    auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-        0, [&preffix](const std::string &elem) {
-          return -elem.compare(0, preffix.size(), preffix);
+  return value;
+}
+
+void RedisWrapper::remove_with_elements(const std::string &key,
+                                        const std::string &value) {
+  if (is_value_hash(value)) {
+    // 字段的 key 之间不是前缀无关的, 不能使用范围删除, 合并为一次写入
+    WriteBatch batch;
+    for (const auto &field : get_fileds_from_hash_value(value)) {
+      batch.remove(get_hash_filed_key(key, field));
+    }
+    batch.remove(key);
+    lsm->write(std::move(batch));
+    return;
+  }
+  // 全部元素通常只需要一条范围删除标记, 不需要先扫描出来
+  if (auto meta = decode_list_meta(value)) {
+    // 元素 key 的后缀为定长的序号, 见 get_list_elem_key
+    auto elem_preffix = std::string(REDIS_LIST_PREFIX) + key + "_";
+    remove_elements(
+        REDIS_LIST_PREFIX, key,
+        get_list_elem_key(key, meta->head).substr(elem_preffix.size()),
+        get_list_elem_key(key, meta->tail).substr(elem_preffix.size()),
+        [](const std::string &meta_value) {
+          return decode_list_meta(meta_value).has_value();
         });
-    if (result_elem.has_value()) {
-      auto [elem_begin, elem_end] = result_elem.value();
-      std::vector<std::string> remove_vec;
-      for (; elem_begin != elem_end; ++elem_begin) {
-        remove_vec.push_back(elem_begin->first);
-      }
-      lsm->remove_batch(remove_vec);
+  } else if (value == get_zset_key_preffix(key)) {
+    // 成员只有 _SCORE_ 和 _ELEM_ 两种 key
+    for (std::string item : {"SCORE_", "ELEM_"}) {
+      remove_elements(REDIS_SORTED_SET_PREFIX, key, item,
+                      get_preffix_successor(item),
+                      [](const std::string &meta_value) {
+                        return meta_value.starts_with(REDIS_SORTED_SET_PREFIX);
+                      });
     }
-    return true;
+  } else if (is_set_meta(value)) {
+    remove_elements(REDIS_SET_PREFIX, key, "", std::nullopt, is_set_meta);
+  }
+  lsm->remove(key);
+}
+
+void RedisWrapper::remove_elements(
+    const std::string &type_prefix, const std::string &key,
+    const std::string &lower, const std::optional<std::string> &upper,
+    const std::function<bool(const std::string &)> &is_same_type) {
+  // 集合 <key>_<rest> 的元素位于 type_prefix + <key>_<rest>_ 之下, 落在删除
+  // 范围内时 <key>_<rest> 也位于 [<key>_<lower>, <key>_<upper>) 中
+  auto name_preffix = key + "_";
+  auto elem_preffix = type_prefix + name_preffix;
+  ReadOptions options;
+  options.lower_bound = name_preffix + lower;
+  options.upper_bound =
+      upper.has_value() ? name_preffix + upper.value()
+                        : get_preffix_successor(name_preffix);
+  std::vector<std::pair<std::string, std::string>> skips;
+  auto iter = lsm->new_iterator(std::move(options));
+  for (iter.seek_to_first(); iter.is_valid(); iter.next()) {
+    std::string name(iter.key());
+    if (is_internal_key(name) ||
+        !is_same_type(decode_ttl_value(iter.value()).value)) {
+      continue;
+    }
+    auto skip_begin = type_prefix + name + "_";
+    auto skip_end = get_preffix_successor(skip_begin);
+    skips.emplace_back(std::move(skip_begin), std::move(skip_end));
+  }
+  // 名称之间的顺序与元素前缀之间的顺序不一定相同, 排序后依次跳过
+  std::sort(skips.begin(), skips.end());
+
+  auto begin = elem_preffix + lower;
+  auto end = upper.has_value() ? elem_preffix + upper.value()
+                               : get_preffix_successor(elem_preffix);
+  for (auto &[skip_begin, skip_end] : skips) {
+    if (begin < skip_begin) {
+      lsm->remove_range(begin, skip_begin);
+    }
+    begin = std::max(begin, skip_end);
+  }
+  if (begin < end) {
+    lsm->remove_range(begin, end);
   }
-  return false;
+}
+
+std::optional<RedisListMeta>
+RedisWrapper::load_list_meta(const std::string &key,
+                             std::optional<int64_t> &expire_at) {
+  expire_at.reset();
+  auto list_opt = get_value_for_write(key);
+  if (!list_opt.has_value()) {
+    return std::nullopt;
+  }
+  expire_at = list_opt->expire_at;
+  if (auto meta = decode_list_meta(list_opt->value)) {
+    return meta;
+  }
+  // 旧版本的拼接格式, 一次性转换为逐元素的格式
+  RedisListMeta meta;
+  WriteBatch batch;
+  for (auto &elem : split(list_opt->value, REDIS_LIST_SEPARATOR)) {
+    batch.put(get_list_elem_key(key, meta.tail++), std::move(elem));
+  }
+  if (meta.size() == 0) {
+    batch.remove(key);
+    lsm->write(std::move(batch));
+    return std::nullopt;
+  }
+  batch.put(key, encode_ttl_value(get_list_meta_value(meta), expire_at, true));
+  lsm->write(std::move(batch));
+  return meta;
 }
 
 // ************************* Redis Command *************************
@@ -283,6 +658,10 @@ std::string RedisWrapper::decr(std::vector<std::string> &args) {
   return redis_decr(args[1]);
 }
 
+std::string RedisWrapper::append(std::vector<std::string> &args) {
+  return redis_append(args[1], args[2]);
+}
+
 std::string RedisWrapper::expire(std::vector<std::string> &args) {
   return redis_expire(args[1], args[2]);
 }
@@ -291,6 +670,34 @@ std::string RedisWrapper::ttl(std::vector<std::string> &args) {
   return redis_ttl(args[1]);
 }
 
+std::string RedisWrapper::mget(std::vector<std::string> &args) {
+  return redis_mget(std::vector<std::string>(args.begin() + 1, args.end()));
+}
+
+std::string RedisWrapper::mset(std::vector<std::string> &args) {
+  if (args.size() < 3 || args.size() % 2 != 1) {
+    return "-ERR wrong number of arguments for 'mset' command\r\n";
+  }
+  std::vector<std::pair<std::string, std::string>> kvs;
+  kvs.reserve(args.size() / 2);
+  for (size_t i = 1; i + 1 < args.size(); i += 2) {
+    kvs.emplace_back(std::move(args[i]), std::move(args[i + 1]));
+  }
+  redis_mset(kvs);
+  return "+OK\r\n";
+}
+
+std::string
+RedisWrapper::set_batch(std::vector<std::pair<std::string, std::string>> &kvs) {
+  redis_mset(kvs);
+  std::string res_str;
+  res_str.reserve(kvs.size() * 5);
+  for (size_t i = 0; i < kvs.size(); i++) {
+    res_str += "+OK\r\n";
+  }
+  return res_str;
+}
+
 // 哈希操作
 std::string RedisWrapper::hset(std::vector<std::string> &args) {
   // return redis_hset(args[1], args[2], args[3]);
@@ -321,6 +728,17 @@ std::string RedisWrapper::hkeys(std::vector<std::string> &args) {
   return redis_hkeys(args[1]);
 }
 
+std::string RedisWrapper::hmget(std::vector<std::string> &args) {
+  return redis_hmget(args[1],
+                     std::vector<std::string>(args.begin() + 2, args.end()));
+}
+
+std::string RedisWrapper::hmset(std::vector<std::string> &args) {
+  auto res = hset(args);
+  // HMSET 与 HSET 相同, 只是回复 +OK
+  return res.starts_with("-") ? res : "+OK\r\n";
+}
+
 // 链表操作
 std::string RedisWrapper::lpush(std::vector<std::string> &args) {
   return redis_lpush(args[1], args[2]);
@@ -394,155 +812,265 @@ std::string RedisWrapper::smembers(std::vector<std::string> &args) {
   return redis_smembers(args[1]);
 }
 
+std::string RedisWrapper::scan(std::vector<std::string> &args) {
+  std::string start;
+  size_t count;
+  if (auto err = parse_scan_args(args, 1, start, count)) {
+    return err.value();
+  }
+  return redis_scan(start, count);
+}
+
+std::string RedisWrapper::hscan(std::vector<std::string> &args) {
+  std::string start;
+  size_t count;
+  if (auto err = parse_scan_args(args, 2, start, count)) {
+    return err.value();
+  }
+  return redis_hscan(args[1], start, count);
+}
+
+std::string RedisWrapper::sscan(std::vector<std::string> &args) {
+  std::string start;
+  size_t count;
+  if (auto err = parse_scan_args(args, 2, start, count)) {
+    return err.value();
+  }
+  return redis_sscan(args[1], start, count);
+}
+
+std::string RedisWrapper::zscan(std::vector<std::string> &args) {
+  std::string start;
+  size_t count;
+  if (auto err = parse_scan_args(args, 2, start, count)) {
+    return err.value();
+  }
+  return redis_zscan(args[1], start, count);
+}
+
+std::string RedisWrapper::info(std::vector<std::string> &args) {
+  auto text = lsm->get_stats().to_string();
+  if (args.size() < 2) {
+    return resp_bulk(text);
+  }
+  auto section = args[1];
+  std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+  if (section == "all" || section == "everything" || section == "default") {
+    return resp_bulk(text);
+  }
+  // 各段之间以空行分隔, 每段的第一行为 "# 段名"
+  std::string result;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find("\r\n\r\n", pos);
+    end = end == std::string::npos ? text.size() : end + 2;
+    std::string_view part(text.data() + pos, end - pos);
+    size_t name_end = part.find("\r\n");
+    std::string name(part.substr(2, name_end - 2));
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name == section) {
+      result.assign(part);
+      break;
+    }
+    pos = end + 2;
+  }
+  return resp_bulk(result);
+}
+
+std::string RedisWrapper::replfetch(std::vector<std::string> &args) {
+  if (args.size() != 4) {
+    return "-ERR wrong number of arguments for 'replfetch' command\r\n";
+  }
+  WalPosition position;
+  try {
+    position.epoch = std::stoull(args[1]);
+    position.seq = std::stoull(args[2]);
+    position.offset = std::stoull(args[3]);
+  } catch (const std::exception &) {
+    return "-ERR invalid replication position\r\n";
+  }
+  try {
+    auto encoded = lsm->read_replication_log(position).encode();
+    return resp_bulk(std::string_view(
+        reinterpret_cast<const char *>(encoded.data()), encoded.size()));
+  } catch (const std::runtime_error &e) {
+    return std::string("-ERR ") + e.what() + "\r\n";
+  }
+}
+
+std::string RedisWrapper::replicaof(std::vector<std::string> &args) {
+  if (args.size() != 3) {
+    return "-ERR wrong number of arguments for 'replicaof' command\r\n";
+  }
+  std::string host = args[1];
+  std::string port = args[2];
+  std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+  std::transform(port.begin(), port.end(), port.begin(), ::tolower);
+  // 析构 ReplicaClient 时等待复制线程退出
+  std::unique_ptr<ReplicaClient> old_replica;
+  std::lock_guard<std::mutex> lock(replica_mtx_);
+  if (host == "no" && port == "one") {
+    old_replica = std::move(replica_);
+    return "+OK\r\n";
+  }
+  uint16_t port_num = 0;
+  auto [ptr, ec] = std::from_chars(args[2].data(),
+                                   args[2].data() + args[2].size(), port_num);
+  if (ec != std::errc() || ptr != args[2].data() + args[2].size() ||
+      port_num == 0) {
+    return "-ERR Invalid master port\r\n";
+  }
+  if (!lsm->get_replication_position().has_value()) {
+    return "-ERR replica has no replication position, open it from a "
+           "checkpoint of the leader\r\n";
+  }
+  old_replica = std::move(replica_);
+  replica_ = std::make_unique<ReplicaClient>(
+      args[1], port_num, [this]() { return lsm->get_replication_position(); },
+      [this](const ReplicationBatch &batch) {
+        apply_replication_batch(batch);
+      });
+  return "+OK\r\n";
+}
+
+bool RedisWrapper::is_replica() {
+  std::lock_guard<std::mutex> lock(replica_mtx_);
+  return replica_ != nullptr;
+}
+
+void RedisWrapper::apply_replication_batch(const ReplicationBatch &batch) {
+  lsm->apply_replication_batch(batch);
+}
+
 void RedisWrapper::clear() { this->lsm->clear(); }
 void RedisWrapper::flushall() { this->lsm->flush(); }
 
 // *********************** Redis ***********************
 // 基础操作
-std::string RedisWrapper::redis_incr(const std::string &key) {
-  // 该操作需要原子性
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-  auto original_vale = this->lsm->get(key);
-  if (!original_vale.has_value()) {
-    this->lsm->put(key, "1");
-    return "1";
+std::optional<std::string>
+RedisWrapper::merge_string(const std::string &key, const std::string &operand) {
+  {
+    // 读锁只用于与 SET / DEL 等直接写入的命令互斥
+    std::shared_lock<std::shared_mutex> rlock(key_mutex(key));
+    auto tranc_id = lsm->merge(key, operand);
+    // 只能看到这次写入之前的操作数, 即为这次写入的结果
+    auto raw = lsm->get(key, tranc_id);
+    if (!raw.has_value()) {
+      return std::nullopt;
+    }
+    auto value = decode_ttl_value(raw.value());
+    if (!value.expired()) {
+      return std::move(value.value);
+    }
+  }
+  // 操作数作用在了已经过期的 value 上, 删除后重新写入
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key));
+  // 其他命令可能已经完成了清理并写入了新的 value
+  get_value_for_write(key);
+  auto tranc_id = lsm->merge(key, operand);
+  auto raw = lsm->get(key, tranc_id);
+  if (!raw.has_value()) {
+    return std::nullopt;
+  }
+  return decode_ttl_value(raw.value()).value;
+}
+
+std::string RedisWrapper::incr_by(const std::string &key, int64_t delta) {
+  auto value = merge_string(
+      key, RedisMergeOperator::kIncrTag + std::to_string(delta));
+  if (!value.has_value() || !Int64AddOperator::parse(value.value())) {
+    // 增量操作数没有生效
+    return "-ERR value is not an integer or out of range\r\n";
   }
-  auto new_value = std::to_string(std::stoll(original_vale.value()) + 1);
-  this->lsm->put(key, new_value);
-  return new_value;
+  return value.value();
+}
+
+std::string RedisWrapper::redis_incr(const std::string &key) {
+  return incr_by(key, 1);
 }
 
 std::string RedisWrapper::redis_del(std::vector<std::string> &args) {
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  // 多个 key 的锁按固定的顺序获取, 避免死锁
+  auto locks = lock_keys(
+      std::vector<std::string>(args.begin() + 1, args.end()));
   int del_count = 0;
   for (int idx = 1; idx < args.size(); idx++) {
     std::string cur_key = args[idx];
-    auto cur_value = this->lsm->get(cur_key);
+    auto cur_value = get_value(cur_key);
 
     if (cur_value.has_value()) {
-      // 需要判断这个key的value是不是哈希类型
-      if (is_value_hash(cur_value.value())) {
-        // 如果是哈希类型, 需要删除所有字段
-        auto field_list = get_fileds_from_hash_value(cur_value);
-        for (const auto &field : field_list) {
-          std::string field_key = get_hash_filed_key(cur_key, field);
-          this->lsm->remove(field_key);
-        }
+      // 集合类型需要同时删除全部元素, 已经过期的 key 也顺便清理
+      remove_with_elements(cur_key, cur_value->value);
+      if (!cur_value->expired()) {
+        del_count++;
       }
-      this->lsm->remove(cur_key);
-      del_count++;
-    }
-    std::string expire_key = get_explire_key(cur_key);
-    if (this->lsm->get(expire_key).has_value()) {
-      this->lsm->remove(expire_key);
     }
   }
-  return ":" + std::to_string(del_count) + "\r\n";
+  return resp_integer(del_count);
 }
 
 std::string RedisWrapper::redis_decr(const std::string &key) {
-  // 该操作需要原子性
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-  auto original_vale = this->lsm->get(key);
-  if (!original_vale.has_value()) {
-    this->lsm->put(key, "-1");
-    return "-1";
-  }
-  auto new_value = std::to_string(std::stoll(original_vale.value()) - 1);
-  this->lsm->put(key, new_value);
-  return new_value;
+  return incr_by(key, -1);
+}
+
+std::string RedisWrapper::redis_append(const std::string &key,
+                                       const std::string &value) {
+  auto new_value = merge_string(key, RedisMergeOperator::kAppendTag + value);
+  return resp_integer(new_value.value_or("").size());
 }
 
 std::string RedisWrapper::redis_expire(const std::string &key,
                                        std::string seconds_count) {
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-  std::string expire_key = get_explire_key(key);
-
-  auto expire_time_str = get_expire_time(seconds_count);
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto value = get_value_for_write(key);
+  if (!value.has_value()) {
+    // key 不存在
+    return ":0\r\n";
+  }
 
-  // 存储过期时间
-  this->lsm->put(expire_key, expire_time_str);
+  // 过期时间与 value 一起重新写入
+  this->lsm->put(key, encode_ttl_value(value->value,
+                                       get_expire_time(seconds_count),
+                                       is_collection_value(key, value->value)));
 
   return ":1\r\n";
 }
 
 std::string RedisWrapper::redis_set(std::string &key, std::string &value) {
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  // 新的 value 不带过期时间, 同时清除了之前设置的过期时间
   this->lsm->put(key, value);
-  // 同时如果设置有过期时间, 需要删除过期时间
-  std::string expire_key = get_explire_key(key);
-  if (this->lsm->get(expire_key).has_value()) {
-    this->lsm->remove(expire_key);
-  }
   return "+OK\r\n";
 }
 
 std::string RedisWrapper::redis_get(std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
 
-  auto key_query = this->lsm->get(key);
-
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
-
-  if (key_query.has_value()) {
-    // 还需要检测 TTL
-    if (expire_query.has_value()) {
-
-      // 检查是否过期
-      if (is_expired(expire_query, nullptr)) {
-        // 过期了, 先进行锁升级, 再清理数据
-        rlock.unlock();                                       // 解锁读锁
-        std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-        this->lsm->remove(key);
-        this->lsm->remove(expire_key);
-        return "$-1\r\n";
-      } else {
-        // 没有过期
-        return "$" + std::to_string(key_query.value().size()) + "\r\n" +
-               key_query.value() + "\r\n";
-      }
-    } else {
-      // 没有设置过期时间, 直接返回
-      return "$" + std::to_string(key_query.value().size()) + "\r\n" +
-             key_query.value() + "\r\n";
-    }
-  } else {
-    // key 不存在, 有必要的话清理 expire_key
-    if (expire_query.has_value()) {
-      // 先进行锁升级, 再清理数据
-      rlock.unlock();                                       // 解锁读锁
-      std::unique_lock<std::shared_mutex> wlock(redis_mtx); // 写锁
-      this->lsm->remove(expire_key);
-    }
+  // 过期时间保存在 value 中, 一次查询即可判断; 过期的数据不在这里清理
+  auto value = get_live_value(key);
+  if (!value.has_value()) {
+    return "$-1\r\n"; // 表示键不存在
   }
-  return "$-1\r\n"; // 表示键不存在
+  return resp_bulk(value->value);
 }
 
 std::string RedisWrapper::redis_ttl(std::string &key) {
-  std::shared_lock<std::shared_mutex> lock(redis_mtx); // 读锁
-
-  auto key_query = this->lsm->get(key);
+  std::shared_lock<std::shared_mutex> lock(key_mutex(key)); // 读锁
 
-  std::string expire_key = get_explire_key(key);
-  auto expire_query = this->lsm->get(expire_key);
+  auto value = get_value(key);
 
-  if (key_query.has_value()) {
+  if (value.has_value()) {
     // key 存在, 判断是否过期
-    if (expire_query.has_value()) {
+    if (value->expire_at.has_value()) {
       std::time_t now_time_t;
       // 检查是否过期
-      if (is_expired(expire_query, &now_time_t)) {
+      if (value->expired(&now_time_t)) {
         // 过期了, key不存在
-        // 过期了也不删除, ttl这里设计为只读, 删除在之后进行
         // -2 表示 key 不存在
         return ":-2\r\n";
       } else {
         // 没有过期
-        auto now = std::chrono::system_clock::now();
-        return ":" +
-               std::to_string(std::stoll(expire_query.value()) - now_time_t) +
-               "\r\n";
+        return resp_integer(value->expire_at.value() - now_time_t);
       }
     } else {
       // 没有设置过期时间, 返回 -1
@@ -554,27 +1082,66 @@ std::string RedisWrapper::redis_ttl(std::string &key) {
   }
 }
 
-// 哈希操作
-std::string RedisWrapper::redis_hset_batch(const std::string &key, std::vector<std::pair<std::string, std::string>> &field_value_pairs){
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx);
-  bool is_expired = expire_hash_clean(key, rlock);
+std::string RedisWrapper::redis_mget(const std::vector<std::string> &keys) {
+  auto locks = lock_keys_shared(keys);
+  // 全部 key 一次查询, 引擎按 key 排序后共享过滤器和 block 的读取
+  auto results = lsm->get_batch(keys);
 
-  if (!is_expired) {
-    rlock.unlock();
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(results.size());
+  for (auto &[key, raw] : results) {
+    if (!raw.has_value()) {
+      writer.null_bulk();
+      continue;
+    }
+    auto value = decode_ttl_value(raw.value());
+    if (value.expired()) {
+      writer.null_bulk();
+    } else {
+      writer.bulk(value.value);
+    }
   }
-  std::unique_lock<std::shared_mutex> lock(redis_mtx);
+  return res_str;
+}
+
+void RedisWrapper::redis_mset(
+    std::vector<std::pair<std::string, std::string>> &kvs) {
+  std::vector<std::string> keys;
+  keys.reserve(kvs.size());
+  for (auto &kv : kvs) {
+    keys.push_back(kv.first);
+  }
+  auto locks = lock_keys(keys);
+  // 与 SET 相同, 新的 value 不带过期时间; 全部 key 在一个 batch 中原子地写入
+  WriteBatch batch;
+  for (auto &[key, value] : kvs) {
+    batch.put(std::move(key), std::move(value));
+  }
+  lsm->write(std::move(batch));
+}
+
+// 哈希操作
+std::string RedisWrapper::redis_hset_batch(const std::string &key, std::vector<std::pair<std::string, std::string>> &field_value_pairs){
+  // 过期的哈希表在 get_value_for_write 中清理, 这次操作相当于新建
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key));
 
   // 获取现有字段列表
-  auto field_list_opt = lsm->get(key);
-  std::vector<std::string> field_list = get_fileds_from_hash_value(field_list_opt);
+  auto field_list_opt = get_value_for_write(key);
+  std::vector<std::string> field_list;
+  std::optional<int64_t> expire_at;
+  if (field_list_opt.has_value()) {
+    field_list = get_fileds_from_hash_value(field_list_opt->value);
+    expire_at = field_list_opt->expire_at;
+  }
   
   int added_count = 0;
   std::unordered_set<std::string> existing_fields(field_list.begin(), field_list.end());
 
-  // 批量处理字段
+  // 字段和字段列表在同一个 batch 中原子地写入
+  WriteBatch batch;
   for (const auto& [field, value] : field_value_pairs) {
-    std::string field_key = get_hash_filed_key(key, field);
-    lsm->put(field_key, value);
+    batch.put(get_hash_filed_key(key, field), value);
 
     if (!existing_fields.count(field)) {
       field_list.push_back(field);
@@ -583,38 +1150,36 @@ std::string RedisWrapper::redis_hset_batch(const std::string &key, std::vector<s
     }
   }
 
-  // 更新字段列表
-  lsm->put(key, get_hash_value_from_fields(field_list));
-  return ":" + std::to_string(added_count) + "\r\n";
+  // 更新字段列表, 保留过期时间
+  batch.put(key, encode_ttl_value(get_hash_value_from_fields(field_list),
+                                  expire_at, true));
+  lsm->write(std::move(batch));
+  return resp_integer(added_count);
 }
 std::string RedisWrapper::redis_hset(const std::string &key,
                                      const std::string &field,
                                      const std::string &value) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁线判断是否过期
-  bool is_expired = expire_hash_clean(key, rlock);
-
-  // 关闭读锁打开写锁
-  if (!is_expired) {
-    // 如果没有过期的话, expire_hash_clean 不会升级读锁, 这里需要手动解锁
-    rlock.unlock();
-  }
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto field_list_opt = get_value_for_write(key);
 
   // 更新字段值
   std::string field_key = get_hash_filed_key(key, field);
   lsm->put(field_key, value);
 
   // 更新字段列表
-  auto field_list_opt = lsm->get(key);
-  std::vector<std::string> field_list =
-      get_fileds_from_hash_value(field_list_opt);
+  std::vector<std::string> field_list;
+  std::optional<int64_t> expire_at;
+  if (field_list_opt.has_value()) {
+    field_list = get_fileds_from_hash_value(field_list_opt->value);
+    expire_at = field_list_opt->expire_at;
+  }
 
   if (std::find(field_list.begin(), field_list.end(), field) ==
       field_list.end()) {
     // 不存在则添加
     field_list.push_back(field);
     auto new_value = get_hash_value_from_fields(field_list);
-    lsm->put(key, new_value);
+    lsm->put(key, encode_ttl_value(new_value, expire_at, true));
   }
 
   return "+OK\r\n";
@@ -622,10 +1187,10 @@ std::string RedisWrapper::redis_hset(const std::string &key,
 
 std::string RedisWrapper::redis_hget(const std::string &key,
                                      const std::string &field) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_hash_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return "$-1\r\n";
   }
 
@@ -633,8 +1198,7 @@ std::string RedisWrapper::redis_hget(const std::string &key,
   auto value_opt = lsm->get(field_key);
 
   if (value_opt.has_value()) {
-    return "$" + std::to_string(value_opt->size()) + "\r\n" +
-           value_opt.value() + "\r\n";
+    return resp_bulk(value_opt.value());
   } else {
     return "$-1\r\n"; // 表示字段不存在
   }
@@ -642,18 +1206,13 @@ std::string RedisWrapper::redis_hget(const std::string &key,
 
 std::string RedisWrapper::redis_hdel(const std::string &key,
                                      const std::string &field) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁线判断是否过期
-  bool is_expired = expire_hash_clean(key, rlock);
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto field_list_opt = get_value_for_write(key);
 
-  if (is_expired) {
+  if (!field_list_opt.has_value()) {
     return ":0\r\n";
   }
 
-  // 没有过期的话, expire_hash_clean 不会升级读锁, 这里需要手动解锁
-  rlock.unlock();
-  std::unique_lock<std::shared_mutex> lock(
-      redis_mtx); // 写锁, 如果过期的话, 读锁在 expire_hash_clean 中已经被释放了
-
   int del_count = 0;
   // 删除字段值
   std::string field_key = get_hash_filed_key(key, field);
@@ -663,8 +1222,7 @@ std::string RedisWrapper::redis_hdel(const std::string &key,
   }
 
   // 更新字段列表
-  auto field_list_opt = lsm->get(key);
-  auto field_list = get_fileds_from_hash_value(field_list_opt);
+  auto field_list = get_fileds_from_hash_value(field_list_opt->value);
   auto find_res = std::find(field_list.begin(), field_list.end(), field);
   if (find_res != field_list.end()) {
     // 存在则删除
@@ -675,234 +1233,241 @@ std::string RedisWrapper::redis_hdel(const std::string &key,
     } else {
       // 否则更新字段列表
       auto new_value = get_hash_value_from_fields(field_list);
-      lsm->put(key, new_value);
+      lsm->put(key,
+               encode_ttl_value(new_value, field_list_opt->expire_at, true));
     }
   }
 
-  return ":" + std::to_string(del_count) + "\r\n";
+  return resp_integer(del_count);
 }
 
 std::string RedisWrapper::redis_hkeys(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_hash_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto field_list_opt = get_live_value(key);
 
-  if (is_expired) {
+  if (!field_list_opt.has_value()) {
     return "*0\r\n";
   }
 
-  auto field_list_opt = lsm->get(key);
-  std::vector<std::string> fields;
-  auto res_vec = get_fileds_from_hash_value(field_list_opt);
+  auto res_vec = get_fileds_from_hash_value(field_list_opt->value);
 
-  std::string res_str = "*";
-  res_str += std::to_string(res_vec.size()) + "\r\n";
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(res_vec.size());
   for (const auto &field : res_vec) {
-    res_str += "$" + std::to_string(field.size()) + "\r\n" + field + "\r\n";
+    writer.bulk(field);
   }
 
   return res_str;
 }
 
-// 链表操作
-std::string RedisWrapper::redis_lpush(const std::string &key,
-                                      const std::string &value) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expire = expire_list_clean(key, rlock);
+std::string RedisWrapper::redis_hmget(const std::string &key,
+                                      const std::vector<std::string> &fields) {
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
+  bool expired = meta.has_value() && meta->expired();
 
-  if (!is_expire) {
-    // 如果过期了, 会执行清理操作, expire_list_clean 会升级读锁
-    // 没有过期的话, 读锁仍然存在, 需要手动释放
-    rlock.unlock();
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(fields.size());
+  if (expired) {
+    for (size_t i = 0; i < fields.size(); i++) {
+      writer.null_bulk();
+    }
+    return res_str;
   }
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
 
-  auto list_opt = lsm->get(key);
-  std::string list_value = list_opt.value_or("");
-  if (!list_value.empty()) {
-    list_value = value + REDIS_LIST_SEPARATOR + list_value;
-  } else {
-    list_value = value;
+  std::vector<std::string> field_keys;
+  field_keys.reserve(fields.size());
+  for (auto &field : fields) {
+    field_keys.push_back(get_hash_filed_key(key, field));
   }
-
-  lsm->put(key, list_value);
-  return ":" + std::to_string(split(list_value, REDIS_LIST_SEPARATOR).size()) +
-         "\r\n";
+  for (auto &[field_key, value] : lsm->get_batch(field_keys)) {
+    if (value.has_value()) {
+      writer.bulk(value.value());
+    } else {
+      writer.null_bulk();
+    }
+  }
+  return res_str;
 }
 
-std::string RedisWrapper::redis_rpush(const std::string &key,
+// 链表操作
+// 元素逐个保存, push 和 pop 只需要读写元数据和一个元素, 与链表的长度无关
+std::string RedisWrapper::redis_lpush(const std::string &key,
                                       const std::string &value) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expire = expire_list_clean(key, rlock);
+  // 过期的链表在 load_list_meta 中清理, 这次操作相当于新建
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
 
-  if (!is_expire) {
-    // 如果过期了, 会执行清理操作, expire_list_clean 会升级读锁
-    // 没有过期的话, 读锁仍然存在, 需要手动释放
-    rlock.unlock();
-  }
-
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  std::optional<int64_t> expire_at;
+  auto meta = load_list_meta(key, expire_at).value_or(RedisListMeta{});
+  meta.head--;
+  // 元素和元数据在同一个 batch 中原子地写入
+  WriteBatch batch;
+  batch.put(get_list_elem_key(key, meta.head), value);
+  batch.put(key, encode_ttl_value(get_list_meta_value(meta), expire_at, true));
+  lsm->write(std::move(batch));
+  return resp_integer(meta.size());
+}
 
-  auto list_opt = lsm->get(key);
-  std::string list_value = list_opt.value_or("");
-  if (!list_value.empty()) {
-    list_value = list_value + REDIS_LIST_SEPARATOR + value;
-  } else {
-    list_value = value;
-  }
+std::string RedisWrapper::redis_rpush(const std::string &key,
+                                      const std::string &value) {
+  // 过期的链表在 load_list_meta 中清理, 这次操作相当于新建
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
 
-  lsm->put(key, list_value);
-  return ":" + std::to_string(split(list_value, REDIS_LIST_SEPARATOR).size()) +
-         "\r\n";
+  std::optional<int64_t> expire_at;
+  auto meta = load_list_meta(key, expire_at).value_or(RedisListMeta{});
+  WriteBatch batch;
+  batch.put(get_list_elem_key(key, meta.tail), value);
+  meta.tail++;
+  batch.put(key, encode_ttl_value(get_list_meta_value(meta), expire_at, true));
+  lsm->write(std::move(batch));
+  return resp_integer(meta.size());
 }
 
 std::string RedisWrapper::redis_lpop(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expire = expire_list_clean(key, rlock);
-
-  if (is_expire) {
-    return "$-1\r\n";
-  }
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
 
-  // 没过期的情况, 需要手动释放读锁
-  rlock.unlock();                                      // 升级锁
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-
-  auto list_opt = lsm->get(key);
-  if (!list_opt.has_value()) {
+  std::optional<int64_t> expire_at;
+  auto meta = load_list_meta(key, expire_at);
+  if (!meta.has_value() || meta->size() == 0) {
     return "$-1\r\n"; // 表示链表不存在
   }
 
-  std::vector<std::string> elements =
-      split(list_opt.value(), REDIS_LIST_SEPARATOR);
-  if (elements.empty()) {
-    return "$-1\r\n"; // 表示链表为空
-  }
-
-  std::string value = elements.front();
-  elements.erase(elements.begin());
+  auto elem_key = get_list_elem_key(key, meta->head);
+  std::string value = lsm->get(elem_key).value_or("");
+  meta->head++;
 
-  if (elements.empty()) {
-    lsm->remove(key);
+  WriteBatch batch;
+  batch.remove(elem_key);
+  if (meta->size() == 0) {
+    batch.remove(key);
   } else {
-    lsm->put(key, join(elements, REDIS_LIST_SEPARATOR));
+    batch.put(key, encode_ttl_value(get_list_meta_value(meta.value()),
+                                    expire_at, true));
   }
-  return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+  lsm->write(std::move(batch));
+  return resp_bulk(value);
 }
 
 std::string RedisWrapper::redis_rpop(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expire = expire_list_clean(key, rlock);
-
-  if (is_expire) {
-    return "$-1\r\n";
-  }
-
-  // 没过期的情况, 需要手动释放读锁
-  rlock.unlock();                                      // 升级锁
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
 
-  auto list_opt = lsm->get(key);
-  if (!list_opt.has_value()) {
+  std::optional<int64_t> expire_at;
+  auto meta = load_list_meta(key, expire_at);
+  if (!meta.has_value() || meta->size() == 0) {
     return "$-1\r\n"; // 表示链表不存在
   }
 
-  std::vector<std::string> elements =
-      split(list_opt.value(), REDIS_LIST_SEPARATOR);
-  if (elements.empty()) {
-    return "$-1\r\n"; // 表示链表为空
-  }
+  meta->tail--;
+  auto elem_key = get_list_elem_key(key, meta->tail);
+  std::string value = lsm->get(elem_key).value_or("");
 
-  std::string value = elements.back();
-  elements.pop_back();
-
-  if (elements.empty()) {
-    lsm->remove(key);
+  WriteBatch batch;
+  batch.remove(elem_key);
+  if (meta->size() == 0) {
+    batch.remove(key);
   } else {
-    lsm->put(key, join(elements, REDIS_LIST_SEPARATOR));
+    batch.put(key, encode_ttl_value(get_list_meta_value(meta.value()),
+                                    expire_at, true));
   }
-  return "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+  lsm->write(std::move(batch));
+  return resp_bulk(value);
 }
 
 std::string RedisWrapper::redis_llen(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_list_clean(key, rlock);
-
-  if (is_expired) {
-    return ":0\r\n";
-  }
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
 
-  auto list_opt = lsm->get(key);
+  auto list_opt = get_live_value(key);
   if (!list_opt.has_value()) {
-    return ":0\r\n"; // 表示链表不存在
+    return ":0\r\n"; // 表示链表不存在或者已经过期
   }
 
+  if (auto meta = decode_list_meta(list_opt->value)) {
+    return resp_integer(meta->size());
+  }
+  // 旧版本的拼接格式, 只读的命令不做转换
   std::vector<std::string> elements =
-      split(list_opt.value(), REDIS_LIST_SEPARATOR);
-  return ":" + std::to_string(elements.size()) + "\r\n";
+      split(list_opt->value, REDIS_LIST_SEPARATOR);
+  return resp_integer(elements.size());
 }
 
 std::string RedisWrapper::redis_lrange(const std::string &key, int start,
                                        int stop) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expire = expire_list_clean(key, rlock);
-
-  if (is_expire) {
-    return "*0\r\n";
-  }
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
 
-  auto list_opt = lsm->get(key);
+  auto list_opt = get_live_value(key);
   if (!list_opt.has_value()) {
-    return "*0\r\n"; // 表示链表不存在
+    return "*0\r\n"; // 表示链表不存在或者已经过期
   }
 
-  std::vector<std::string> elements =
-      split(list_opt.value(), REDIS_LIST_SEPARATOR);
-  if (elements.empty()) {
+  auto meta = decode_list_meta(list_opt->value);
+  std::vector<std::string> elements;
+  if (!meta.has_value()) {
+    // 旧版本的拼接格式, 只读的命令不做转换
+    elements = split(list_opt->value, REDIS_LIST_SEPARATOR);
+  }
+  int64_t size = meta.has_value() ? static_cast<int64_t>(meta->size())
+                                  : static_cast<int64_t>(elements.size());
+  if (size == 0) {
     return "*0\r\n"; // 表示链表为空
   }
 
-  if (start < 0)
-    start += elements.size();
-  if (stop < 0)
-    stop += elements.size();
-  if (start < 0)
-    start = 0;
-  if (stop >= elements.size())
-    stop = elements.size() - 1;
-  if (start > stop)
+  int64_t first = start;
+  int64_t last = stop;
+  if (first < 0)
+    first += size;
+  if (last < 0)
+    last += size;
+  if (first < 0)
+    first = 0;
+  if (last >= size)
+    last = size - 1;
+  if (first > last)
     return "*0\r\n";
 
-  std::ostringstream oss;
-  oss << "*" << (stop - start + 1) << "\r\n";
-  for (int i = start; i <= stop; ++i) {
-    oss << "$" << elements[i].size() << "\r\n" << elements[i] << "\r\n";
+  if (meta.has_value()) {
+    // 只扫描 [first, last] 对应的元素 key
+    auto lower = get_list_elem_key(key, meta->head + first);
+    auto upper = get_list_elem_key(key, meta->head + last + 1);
+    auto result = lsm->lsm_iters_monotony_predicate(
+        0, [&lower, &upper](const std::string &elem_key) {
+          if (elem_key < lower) {
+            return 1;
+          }
+          return elem_key < upper ? 0 : -1;
+        });
+    if (result.has_value()) {
+      for (auto &it = result->first; it.is_valid(); ++it) {
+        elements.emplace_back(it.value());
+      }
+    }
+    first = 0;
+    last = static_cast<int64_t>(elements.size()) - 1;
   }
-  return oss.str();
+
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(last - first + 1);
+  for (int64_t i = first; i <= last; ++i) {
+    writer.bulk(elements[i]);
+  }
+  return res_str;
 }
 
 std::string RedisWrapper::redis_zadd(std::vector<std::string> &args) {
   std::string key = args[1];
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
-
-  if (!is_expired) {
-    // 如果过期了, 会执行清理操作, expire_hash_clean 会升级读锁
-    // 这次操作还会继续, 因为相当于新建
-    // 没有过期过期, 需要手动释放读锁
-    rlock.unlock();
-  }
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  // 过期的有序集合在 get_value_for_write 中清理, 这次操作相当于新建
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
 
-  std::vector<std::pair<std::string, std::string>> put_kvs;
-  std::vector<std::string> del_keys;
+  // 旧 score 的删除和新成员的写入在同一个 batch 中原子地完成
+  WriteBatch batch;
 
-  auto value = get_zset_key_preffix(key); // 直接将 前缀 作为 value
-  if (!lsm->get(value).has_value()) {
-    // 如果不存在, 需要新建
-    put_kvs.emplace_back(key, value);
+  if (!get_value_for_write(key).has_value()) {
+    // 如果不存在, 需要新建, 直接将 前缀 作为 value
+    batch.put(key, get_zset_key_preffix(key));
   }
 
-  std::vector<std::string> remove_keys;
   int added_count = 0;
   for (size_t i = 2; i < args.size(); i += 2) {
     std::string score = args[i];
@@ -921,16 +1486,15 @@ std::string RedisWrapper::redis_zadd(std::vector<std::string> &args) {
       }
       // 需要移除旧 score
       std::string original_key_score = get_zset_key_socre(key, original_score);
-      remove_keys.push_back(original_key_score);
+      batch.remove(original_key_score);
     }
-    put_kvs.emplace_back(key_score, elem);
-    put_kvs.emplace_back(key_elem, score);
+    batch.put(key_score, elem);
+    batch.put(key_elem, score);
     added_count++;
   }
-  lsm->remove_batch(del_keys);
-  lsm->put_batch(put_kvs);
+  lsm->write(std::move(batch));
 
-  return ":" + std::to_string(added_count) + "\r\n";
+  return resp_integer(added_count);
 }
 
 std::string RedisWrapper::redis_zrem(std::vector<std::string> &args) {
@@ -939,32 +1503,32 @@ std::string RedisWrapper::redis_zrem(std::vector<std::string> &args) {
   }
 
   std::string key = args[1];
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto meta = get_value_for_write(key);
 
-  if (is_expired) {
+  if (!meta.has_value()) {
     return ":0\r\n";
   }
 
-  rlock.unlock();
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-
-  int removed_count = 0;
+  // 成员的 _ELEM_ 和 _SCORE_ 两个 key 在同一个 batch 中原子地删除
+  WriteBatch batch;
+  std::unordered_set<std::string> removed;
   for (size_t i = 2; i < args.size(); ++i) {
     std::string elem = args[i];
     std::string key_elem = get_zset_key_elem(key, elem);
 
     auto query_elem = lsm->get(key_elem);
-    if (query_elem.has_value()) {
+    // 重复的成员只删除一次
+    if (query_elem.has_value() && removed.insert(elem).second) {
       std::string score = query_elem.value();
       std::string key_score = get_zset_key_socre(key, score);
-      lsm->remove(key_elem);
-      lsm->remove(key_score);
-      removed_count++;
+      batch.remove(key_elem);
+      batch.remove(key_score);
     }
   }
+  lsm->write(std::move(batch));
 
-  return ":" + std::to_string(removed_count) + "\r\n";
+  return resp_integer(removed.size());
 }
 
 std::string RedisWrapper::redis_zrange(std::vector<std::string> &args) {
@@ -972,19 +1536,16 @@ std::string RedisWrapper::redis_zrange(std::vector<std::string> &args) {
   int start = std::stoi(args[2]);
   int stop = std::stoi(args[3]);
 
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return "*0\r\n";
   }
 
   // 范围查询: 按照 score 查询就能满足 zrange 的顺序
   std::string preffix_score = get_zset_score_preffix(key);
-  auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-      0, [&preffix_score](const std::string &elem) {
-        return -elem.compare(0, preffix_score.size(), preffix_score);
-      });
+  auto result_elem = this->lsm->lsm_iters_preffix(0, preffix_score);
 
   if (!result_elem.has_value()) {
     return "*0\r\n";
@@ -1010,29 +1571,26 @@ std::string RedisWrapper::redis_zrange(std::vector<std::string> &args) {
   if (start > stop)
     return "*0\r\n";
 
-  std::ostringstream oss;
-  oss << "*" << (stop - start + 1) << "\r\n";
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(stop - start + 1);
   for (int i = start; i <= stop; ++i) {
-    oss << "$" << elements[i].second.size() << "\r\n"
-        << elements[i].second << "\r\n";
+    writer.bulk(elements[i].second);
   }
-  return oss.str();
+  return res_str;
 }
 
 std::string RedisWrapper::redis_zcard(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return ":0\r\n";
   }
 
   // key_score 和 key_elem 是一对, 所以只需要一个即可
   std::string preffix = get_zset_score_preffix(key);
-  auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-      0, [&preffix](const std::string &elem) {
-        return -elem.compare(0, preffix.size(), preffix);
-      });
+  auto result_elem = this->lsm->lsm_iters_preffix(0, preffix);
 
   if (!result_elem.has_value()) {
     return ":0\r\n";
@@ -1045,15 +1603,15 @@ std::string RedisWrapper::redis_zcard(const std::string &key) {
     ++elem_begin;
   }
 
-  return ":" + std::to_string(count) + "\r\n";
+  return resp_integer(count);
 }
 
 std::string RedisWrapper::redis_zscore(const std::string &key,
                                        const std::string &elem) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return "$-1\r\n";
   }
 
@@ -1061,8 +1619,7 @@ std::string RedisWrapper::redis_zscore(const std::string &key,
   auto query_elem = lsm->get(key_elem);
 
   if (query_elem.has_value()) {
-    return "$" + std::to_string(query_elem.value().size()) + "\r\n" +
-           query_elem.value() + "\r\n";
+    return resp_bulk(query_elem.value());
   } else {
     return "$-1\r\n"; // 表示成员不存在
   }
@@ -1071,13 +1628,13 @@ std::string RedisWrapper::redis_zscore(const std::string &key,
 std::string RedisWrapper::redis_zincrby(const std::string &key,
                                         const std::string &increment,
                                         const std::string &elem) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
-
-  if (!is_expired) {
-    rlock.unlock();
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  // 与 ZADD 相同, 旧 score 的删除和新 score 的写入在同一个 batch 中完成
+  WriteBatch batch;
+  if (!get_value_for_write(key).has_value()) {
+    // 如果不存在, 需要新建, 与 ZADD 一致
+    batch.put(key, get_zset_key_preffix(key));
   }
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
 
   std::string key_elem = get_zset_key_elem(key, elem);
   auto query_elem = lsm->get(key_elem);
@@ -1087,7 +1644,7 @@ std::string RedisWrapper::redis_zincrby(const std::string &key,
     std::string original_score = query_elem.value();
     new_score = std::stol(original_score) + std::stod(increment);
     std::string original_key_score = get_zset_key_socre(key, original_score);
-    lsm->remove(original_key_score);
+    batch.remove(original_key_score);
   } else {
     // 如果查询不到, 则相当于新建
     new_score = std::stod(increment);
@@ -1096,18 +1653,19 @@ std::string RedisWrapper::redis_zincrby(const std::string &key,
   std::string new_score_str = std::to_string(new_score);
   std::string key_score = get_zset_key_socre(key, new_score_str);
 
-  lsm->put(key_elem, new_score_str);
-  lsm->put(key_score, elem);
+  batch.put(key_elem, new_score_str);
+  batch.put(key_score, elem);
+  lsm->write(std::move(batch));
 
-  return ":" + new_score_str + "\r\n";
+  return resp_integer(new_score_str);
 }
 
 std::string RedisWrapper::redis_zrank(const std::string &key,
                                       const std::string &elem) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_zset_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return "$-1\r\n";
   }
 
@@ -1124,10 +1682,7 @@ std::string RedisWrapper::redis_zrank(const std::string &key,
 
   // 获取有序集合的前缀
   std::string preffix_score = get_zset_key_preffix(key);
-  auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-      0, [&preffix_score](const std::string &elem) {
-        return -elem.compare(0, preffix_score.size(), preffix_score);
-      });
+  auto result_elem = this->lsm->lsm_iters_preffix(0, preffix_score);
 
   if (!result_elem.has_value()) {
     return "$-1\r\n";
@@ -1137,7 +1692,7 @@ std::string RedisWrapper::redis_zrank(const std::string &key,
   int rank = 0;
   for (; elem_begin != elem_end; ++elem_begin) {
     if (elem_begin->first == key_score) {
-      return ":" + std::to_string(rank) + "\r\n";
+      return resp_integer(rank);
     }
     rank++;
   }
@@ -1148,82 +1703,73 @@ std::string RedisWrapper::redis_zrank(const std::string &key,
 std::string RedisWrapper::redis_sadd(std::vector<std::string> &args) {
 
   std::string key = args[1];
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_set_clean(key, rlock);
-
-  if (!is_expired) {
-    rlock.unlock();
-  }
+  WriteBatch batch;
 
-  std::vector<std::pair<std::string, std::string>> put_kvs;
-
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
+  // 过期的集合在 get_value_for_write 中清理, 这次操作相当于新建
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto key_query = get_value_for_write(key);
 
   for (size_t i = 2; i < args.size(); ++i) {
     std::string member = args[i];
     std::string member_key = get_set_member_key(key, member);
 
     if (!lsm->get(member_key).has_value()) {
-      put_kvs.emplace_back(member_key, get_set_member_value());
+      batch.put(member_key, get_set_member_value());
     }
   }
 
-  // 更新集合大小
-  auto key_query = lsm->get(key);
-  int set_size = put_kvs.size();
+  // 更新集合大小, 保留过期时间
+  int added_count = batch.size();
+  int64_t set_size = added_count;
+  std::optional<int64_t> expire_at;
   if (key_query.has_value()) {
-    auto prev_size = std::stoi(key_query.value());
-    set_size += prev_size;
+    set_size += decode_set_size(key_query->value);
+    expire_at = key_query->expire_at;
   }
-  put_kvs.emplace_back(key, std::to_string(set_size));
+  batch.put(key, encode_ttl_value(get_set_meta_value(set_size), expire_at,
+                                  true));
 
-  lsm->put_batch(put_kvs);
+  lsm->write(std::move(batch));
 
-  return ":" + std::to_string(put_kvs.size() - 1) + "\r\n";
+  return resp_integer(added_count);
 }
 
 std::string RedisWrapper::redis_srem(std::vector<std::string> &args) {
   std::string key = args[1];
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_set_clean(key, rlock);
+  std::unique_lock<std::shared_mutex> lock(key_mutex(key)); // 写锁
+  auto key_query = get_value_for_write(key);
 
-  if (is_expired) {
+  if (!key_query.has_value()) {
     return ":0\r\n";
   }
 
-  rlock.unlock();
-  std::unique_lock<std::shared_mutex> lock(redis_mtx); // 写锁
-
-  std::vector<std::string> del_kvs;
+  WriteBatch batch;
 
   for (size_t i = 2; i < args.size(); ++i) {
     std::string member = args[i];
     std::string member_key = get_set_member_key(key, member);
 
     if (lsm->get(member_key).has_value()) {
-      del_kvs.emplace_back(member_key);
+      batch.remove(member_key);
     }
   }
 
-  // 更新集合大小
-  auto key_query = lsm->get(key);
-  int set_size = -del_kvs.size();
-  if (key_query.has_value()) {
-    auto prev_size = std::stoi(key_query.value());
-    set_size += prev_size;
-  }
-  this->lsm->put(key, std::to_string(set_size));
-  this->lsm->remove_batch(del_kvs);
+  // 更新集合大小, 保留过期时间
+  int removed_count = batch.size();
+  int64_t set_size = decode_set_size(key_query->value) - removed_count;
+  batch.put(key, encode_ttl_value(get_set_meta_value(set_size),
+                                  key_query->expire_at, true));
+  this->lsm->write(std::move(batch));
 
-  return ":" + std::to_string(del_kvs.size()) + "\r\n";
+  return resp_integer(removed_count);
 }
 
 std::string RedisWrapper::redis_sismember(const std::string &key,
                                           const std::string &member) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_set_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return ":0\r\n";
   }
 
@@ -1236,16 +1782,15 @@ std::string RedisWrapper::redis_sismember(const std::string &key,
 }
 
 std::string RedisWrapper::redis_scard(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_set_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return ":0\r\n";
   }
 
-  auto key_query = lsm->get(key);
-  if (key_query.has_value()) {
-    return ":" + key_query.value() + "\r\n";
+  if (meta.has_value()) {
+    return resp_integer(decode_set_size(meta->value));
 
   } else {
     return ":0\r\n";
@@ -1253,18 +1798,15 @@ std::string RedisWrapper::redis_scard(const std::string &key) {
 }
 
 std::string RedisWrapper::redis_smembers(const std::string &key) {
-  std::shared_lock<std::shared_mutex> rlock(redis_mtx); // 读锁
-  bool is_expired = expire_set_clean(key, rlock);
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  auto meta = get_value(key);
 
-  if (is_expired) {
+  if (meta.has_value() && meta->expired()) {
     return "*0\r\n"; // 空数组
   }
 
   std::string prefix = get_set_member_prefix(key);
-  auto result_elem = this->lsm->lsm_iters_monotony_predicate(
-      0, [&prefix](const std::string &elem) {
-        return -elem.compare(0, prefix.size(), prefix);
-      });
+  auto result_elem = this->lsm->lsm_iters_preffix(0, prefix);
 
   if (!result_elem.has_value()) {
     return "*0\r\n"; // 空数组
@@ -1278,10 +1820,90 @@ std::string RedisWrapper::redis_smembers(const std::string &key) {
     members.emplace_back(member);
   }
 
-  std::ostringstream oss;
-  oss << "*" << members.size() << "\r\n";
+  std::string res_str;
+  RespWriter writer(res_str);
+  writer.array(members.size());
   for (const auto &member : members) {
-    oss << "$" << member.size() << "\r\n" << member << "\r\n";
+    writer.bulk(member);
   }
-  return oss.str();
-}
\ No newline at end of file
+  return res_str;
+}
+// 游标遍历
+// 迭代器直接定位到起点, 读到 preffix 的后继即结束, 之后只推进 count + 1 条
+// 记录, 每次调用的开销与集合的大小无关
+std::optional<std::string> RedisWrapper::scan_preffix(
+    const std::string &preffix, const std::string &start, size_t count,
+    const std::function<void(std::string_view, std::string_view)> &visit) {
+  ReadOptions options;
+  if (auto successor = get_preffix_successor(preffix); !successor.empty()) {
+    options.upper_bound = std::move(successor);
+  }
+  auto iter = lsm->new_iterator(std::move(options));
+  for (iter.seek(preffix + start); iter.is_valid(); iter.next()) {
+    auto key = iter.key().substr(preffix.size());
+    if (count-- == 0) {
+      return std::string(key);
+    }
+    visit(key, iter.value());
+  }
+  return std::nullopt;
+}
+
+std::string RedisWrapper::redis_scan(const std::string &start, size_t count) {
+  std::vector<std::string> keys;
+  auto next = scan_preffix(
+      "", start, count, [&](std::string_view key, std::string_view value) {
+        // 内部 key 和已经过期的 key 同样计入 count, 回复中的 key 可能少于
+        // count, 与 redis 一致
+        if (!is_internal_key(key) && !decode_ttl_value(value).expired()) {
+          keys.emplace_back(key);
+        }
+      });
+  return scan_reply(next, keys);
+}
+
+std::string RedisWrapper::redis_hscan(const std::string &key,
+                                      const std::string &start, size_t count) {
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  if (!get_live_value(key).has_value()) {
+    return scan_reply(std::nullopt, {});
+  }
+  std::vector<std::string> items;
+  auto next = scan_preffix(get_hash_filed_key(key, ""), start, count,
+                           [&](std::string_view field, std::string_view value) {
+                             items.emplace_back(field);
+                             items.emplace_back(value);
+                           });
+  return scan_reply(next, items);
+}
+
+std::string RedisWrapper::redis_sscan(const std::string &key,
+                                      const std::string &start, size_t count) {
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  if (!get_live_value(key).has_value()) {
+    return scan_reply(std::nullopt, {});
+  }
+  std::vector<std::string> members;
+  auto next = scan_preffix(
+      get_set_member_prefix(key), start, count,
+      [&](std::string_view member, std::string_view) {
+        members.emplace_back(member);
+      });
+  return scan_reply(next, members);
+}
+
+std::string RedisWrapper::redis_zscan(const std::string &key,
+                                      const std::string &start, size_t count) {
+  std::shared_lock<std::shared_mutex> rlock(key_mutex(key)); // 读锁
+  if (!get_live_value(key).has_value()) {
+    return scan_reply(std::nullopt, {});
+  }
+  // 按成员的顺序遍历, 成员 key 的 value 为分数
+  std::vector<std::string> items;
+  auto next = scan_preffix(get_zset_elem_preffix(key), start, count,
+                           [&](std::string_view elem, std::string_view score) {
+                             items.emplace_back(elem);
+                             items.emplace_back(score);
+                           });
+  return scan_reply(next, items);
+}
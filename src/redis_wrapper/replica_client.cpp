@@ -0,0 +1,163 @@
+#include "../../include/redis_wrapper/replica_client.h"
+#include "../../include/consts.h"
+#include "../../include/redis_wrapper/resp.h"
+#include <cerrno>
+#include <chrono>
+#include <netdb.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// 阻塞的读写设置超时, 复制线程可以及时发现停止的请求
+constexpr int kSocketTimeoutSec = 1;
+
+void send_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    auto n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      throw std::runtime_error("failed to send to leader");
+    }
+    sent += n;
+  }
+}
+} // namespace
+
+ReplicaClient::ReplicaClient(std::string host, uint16_t port,
+                             PositionFn position, ApplyFn apply)
+    : host_(std::move(host)), port_(port), position_(std::move(position)),
+      apply_(std::move(apply)) {
+  thread_ = std::thread(&ReplicaClient::run, this);
+}
+
+ReplicaClient::~ReplicaClient() {
+  stop_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::string ReplicaClient::last_error() {
+  std::lock_guard<std::mutex> lock(error_mtx_);
+  return last_error_;
+}
+
+void ReplicaClient::set_error(const std::string &error) {
+  std::lock_guard<std::mutex> lock(error_mtx_);
+  last_error_ = error;
+}
+
+void ReplicaClient::run() {
+  int fd = -1;
+  while (!stop_) {
+    bool fetched = false;
+    try {
+      auto position = position_();
+      if (!position.has_value()) {
+        throw std::runtime_error("replica has no replication position");
+      }
+      if (fd < 0) {
+        fd = connect_leader();
+      }
+      fetched = fetch(fd, position.value());
+      set_error("");
+    } catch (const std::exception &e) {
+      set_error(e.what());
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+      read_buf_.clear();
+    }
+    if (!fetched && !stop_) {
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(REDIS_REPLICA_POLL_MS));
+    }
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+int ReplicaClient::connect_leader() {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints,
+                  &res) != 0) {
+    throw std::runtime_error("failed to resolve leader " + host_);
+  }
+  int fd = -1;
+  for (auto *ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) {
+    throw std::runtime_error("failed to connect to leader " + host_ + ":" +
+                             std::to_string(port_));
+  }
+  timeval timeout{kSocketTimeoutSec, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+bool ReplicaClient::fetch(int fd, const WalPosition &position) {
+  std::string request;
+  RespWriter writer(request);
+  writer.array(4)
+      .bulk("REPLFETCH")
+      .bulk(std::to_string(position.epoch))
+      .bulk(std::to_string(position.seq))
+      .bulk(std::to_string(position.offset));
+  send_all(fd, request);
+
+  // 回复为 $<len>\r\n<batch>\r\n 或者 -<error>\r\n
+  // 读取超时时继续等待, 直到收到完整的回复或者需要停止
+  auto read_more = [&]() {
+    char buf[64 * 1024];
+    while (true) {
+      auto n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        read_buf_.append(buf, n);
+        return;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !stop_) {
+        continue;
+      }
+      throw std::runtime_error("connection to leader closed");
+    }
+  };
+  size_t line_end;
+  while ((line_end = read_buf_.find("\r\n")) == std::string::npos) {
+    read_more();
+  }
+  if (read_buf_[0] == '-') {
+    throw std::runtime_error(read_buf_.substr(1, line_end - 1));
+  }
+  if (read_buf_[0] != '$') {
+    throw std::runtime_error("unexpected reply from leader");
+  }
+  size_t len = std::stoull(read_buf_.substr(1, line_end - 1));
+  size_t total = line_end + 2 + len + 2;
+  while (read_buf_.size() < total) {
+    read_more();
+  }
+  auto batch = ReplicationBatch::decode(
+      reinterpret_cast<const uint8_t *>(read_buf_.data()) + line_end + 2, len);
+  read_buf_.erase(0, total);
+  apply_(batch);
+  return !batch.records.empty();
+}
@@ -0,0 +1,199 @@
+#include "../../include/redis_wrapper/resp.h"
+#include "../../include/consts.h"
+#include <charconv>
+#include <cstdint>
+#include <system_error>
+
+namespace {
+
+// 整数所在的行最多只有这么长, 超出时不需要继续等待 \r\n
+constexpr size_t kMaxIntLineLen = 32;
+
+RespParseResult resp_error(std::string error) {
+  return {RespStatus::Error, 0, std::move(error)};
+}
+
+// 解析 pos 开始以 \r\n 结尾的十进制整数, 成功时 pos 指向 \r\n 之后
+RespStatus parse_line_int(std::string_view data, size_t &pos,
+                          int64_t &value) {
+  auto end = data.find("\r\n", pos);
+  if (end == std::string_view::npos) {
+    return data.size() - pos > kMaxIntLineLen ? RespStatus::Error
+                                              : RespStatus::Incomplete;
+  }
+  auto [ptr, ec] = std::from_chars(data.data() + pos, data.data() + end, value);
+  if (pos == end || ec != std::errc() || ptr != data.data() + end) {
+    return RespStatus::Error;
+  }
+  pos = end + 2;
+  return RespStatus::Ok;
+}
+
+RespParseResult parse_inline(std::string_view data,
+                             std::vector<std::string> &args) {
+  auto newline = data.find('\n');
+  if (newline == std::string_view::npos) {
+    if (data.size() > REDIS_MAX_INLINE_LEN) {
+      return resp_error("-ERR Protocol error: too big inline request\r\n");
+    }
+    return {RespStatus::Incomplete};
+  }
+  auto line = data.substr(0, newline);
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  size_t argc = 0;
+  size_t pos = 0;
+  while (pos < line.size()) {
+    auto begin = line.find_first_not_of(" \t", pos);
+    if (begin == std::string_view::npos) {
+      break;
+    }
+    auto end = line.find_first_of(" \t", begin);
+    if (end == std::string_view::npos) {
+      end = line.size();
+    }
+    if (args.size() <= argc) {
+      args.emplace_back();
+    }
+    args[argc++].assign(line.substr(begin, end - begin));
+    pos = end;
+  }
+  args.resize(argc);
+  return {RespStatus::Ok, newline + 1};
+}
+
+} // namespace
+
+RespParseResult parse_resp_command(std::string_view data,
+                                   std::vector<std::string> &args) {
+  if (data.empty()) {
+    return {RespStatus::Incomplete};
+  }
+  if (data[0] != '*') {
+    return parse_inline(data, args);
+  }
+
+  size_t pos = 1;
+  int64_t argc;
+  auto status = parse_line_int(data, pos, argc);
+  if (status == RespStatus::Incomplete) {
+    return {status};
+  }
+  if (status == RespStatus::Error || argc > REDIS_MAX_MULTIBULK_LEN) {
+    return resp_error("-ERR Protocol error: invalid multibulk length\r\n");
+  }
+  if (argc <= 0) {
+    // *0 和 *-1 不包含任何命令
+    args.clear();
+    return {RespStatus::Ok, pos};
+  }
+
+  // 先确认整个命令都已经到达, 再复制参数; 参数只记录在缓冲区中的位置
+  static thread_local std::vector<std::string_view> views;
+  views.clear();
+  for (int64_t i = 0; i < argc; i++) {
+    if (pos >= data.size()) {
+      return {RespStatus::Incomplete};
+    }
+    if (data[pos] != '$') {
+      return resp_error("-ERR Protocol error: expected '$', got '" +
+                        std::string(1, data[pos]) + "'\r\n");
+    }
+    pos++;
+    int64_t len;
+    status = parse_line_int(data, pos, len);
+    if (status == RespStatus::Incomplete) {
+      return {status};
+    }
+    if (status == RespStatus::Error || len < 0 || len > REDIS_MAX_BULK_LEN) {
+      return resp_error("-ERR Protocol error: invalid bulk length\r\n");
+    }
+    if (data.size() - pos < static_cast<size_t>(len) + 2) {
+      return {RespStatus::Incomplete};
+    }
+    if (data.compare(pos + len, 2, "\r\n") != 0) {
+      return resp_error("-ERR Protocol error: expected '\\r\\n'\r\n");
+    }
+    views.push_back(data.substr(pos, len));
+    pos += len + 2;
+  }
+
+  // resize 保留已有参数的内存, 连续的命令之间不需要重新分配
+  args.resize(views.size());
+  for (size_t i = 0; i < views.size(); i++) {
+    args[i].assign(views[i]);
+  }
+  return {RespStatus::Ok, pos};
+}
+
+// ************************ RespWriter ************************
+
+void RespWriter::append_header(char type, int64_t value) {
+  char buf[24];
+  buf[0] = type;
+  auto [ptr, ec] = std::to_chars(buf + 1, buf + sizeof(buf) - 2, value);
+  *ptr++ = '\r';
+  *ptr++ = '\n';
+  out_.append(buf, ptr - buf);
+}
+
+RespWriter &RespWriter::simple(std::string_view str) {
+  out_.reserve(out_.size() + str.size() + 3);
+  out_.push_back('+');
+  out_.append(str);
+  out_.append("\r\n");
+  return *this;
+}
+
+RespWriter &RespWriter::error(std::string_view str) {
+  out_.reserve(out_.size() + str.size() + 3);
+  out_.push_back('-');
+  out_.append(str);
+  out_.append("\r\n");
+  return *this;
+}
+
+RespWriter &RespWriter::integer(int64_t value) {
+  append_header(':', value);
+  return *this;
+}
+
+RespWriter &RespWriter::bulk(std::string_view str) {
+  out_.reserve(out_.size() + str.size() + 24);
+  append_header('$', static_cast<int64_t>(str.size()));
+  out_.append(str);
+  out_.append("\r\n");
+  return *this;
+}
+
+RespWriter &RespWriter::null_bulk() {
+  out_.append("$-1\r\n");
+  return *this;
+}
+
+RespWriter &RespWriter::array(size_t size) {
+  append_header('*', static_cast<int64_t>(size));
+  return *this;
+}
+
+std::string resp_integer(int64_t value) {
+  std::string out;
+  RespWriter(out).integer(value);
+  return out;
+}
+
+std::string resp_integer(std::string_view value) {
+  std::string out;
+  out.reserve(value.size() + 3);
+  out.push_back(':');
+  out.append(value);
+  out.append("\r\n");
+  return out;
+}
+
+std::string resp_bulk(std::string_view str) {
+  std::string out;
+  RespWriter(out).bulk(str);
+  return out;
+}
@@ -0,0 +1,327 @@
+#include "../../include/redis_wrapper/sharded_redis.h"
+#include "../../include/redis_wrapper/resp.h"
+#include "../../include/utils/hash.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// 分片数记录在该文件中, 重新打开时检查
+const char *kShardsFile = "SHARDS";
+
+void check_shard_num(const std::string &db_path, size_t shard_num) {
+  std::filesystem::create_directories(db_path);
+  auto path = db_path + "/" + kShardsFile;
+  if (std::filesystem::exists(path)) {
+    std::ifstream in(path);
+    size_t saved = 0;
+    if (!(in >> saved) || saved != shard_num) {
+      throw std::runtime_error("Database " + db_path + " has " +
+                               std::to_string(saved) + " shards, cannot " +
+                               "open it with " + std::to_string(shard_num));
+    }
+    return;
+  }
+  std::ofstream out(path, std::ios::trunc);
+  out << shard_num << '\n';
+  if (!out.flush()) {
+    throw std::runtime_error("Failed to write " + path);
+  }
+}
+
+// 把当前线程绑定到 cpu 上, 其他平台上不做处理
+void pin_current_thread(size_t cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// 读取 data 中从 pos 开始以 \r\n 结尾的一行, pos 移动到下一行的开头
+std::string_view read_line(std::string_view data, size_t &pos) {
+  auto end = data.find("\r\n", pos);
+  if (end == std::string_view::npos) {
+    throw std::runtime_error("Malformed reply from shard");
+  }
+  auto line = data.substr(pos, end - pos);
+  pos = end + 2;
+  return line;
+}
+
+int64_t parse_int(std::string_view str) {
+  int64_t value = 0;
+  auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec != std::errc() || ptr != str.data() + str.size()) {
+    throw std::runtime_error("Malformed reply from shard");
+  }
+  return value;
+}
+
+// 读取 data 中从 pos 开始的一个 bulk 回复 (包括 $-1), 返回其完整的编码
+std::string_view read_bulk(std::string_view data, size_t &pos) {
+  size_t begin = pos;
+  auto header = read_line(data, pos);
+  if (header.empty() || header[0] != '$') {
+    throw std::runtime_error("Malformed reply from shard");
+  }
+  auto len = parse_int(header.substr(1));
+  if (len >= 0) {
+    pos += len + 2;
+  }
+  return data.substr(begin, pos - begin);
+}
+
+// bulk 回复中的内容
+std::string_view bulk_content(std::string_view bulk) {
+  size_t pos = 0;
+  read_line(bulk, pos);
+  return bulk.substr(pos, bulk.size() - pos - 2);
+}
+
+// 解析 SCAN 的游标, "0" 为第 0 个分片的开头
+bool parse_shard_cursor(const std::string &cursor, size_t shard_num,
+                        size_t &shard, std::string &inner) {
+  if (cursor == "0") {
+    shard = 0;
+    inner = "0";
+    return true;
+  }
+  auto sep = cursor.find(':');
+  if (sep == std::string::npos) {
+    return false;
+  }
+  auto [ptr, ec] = std::from_chars(cursor.data(), cursor.data() + sep, shard);
+  if (ec != std::errc() || ptr != cursor.data() + sep || shard >= shard_num) {
+    return false;
+  }
+  inner = cursor.substr(sep + 1);
+  return !inner.empty();
+}
+
+} // namespace
+
+ShardedRedis::ShardedRedis(const std::string &db_path, size_t shard_num,
+                           bool wal_all_writes) {
+  if (shard_num == 0) {
+    throw std::runtime_error("shard_num must be positive");
+  }
+  check_shard_num(db_path, shard_num);
+
+  // 全部分片的内存占用与不分片时的单个引擎相同
+  Options options;
+  options.wal_all_writes = wal_all_writes;
+  options.tol_mem_size_limit =
+      std::max(options.tol_mem_size_limit / shard_num,
+               options.per_mem_size_limit);
+  options.write_stall_frozen_bytes = 2 * options.tol_mem_size_limit;
+  options.block_cache_capacity =
+      std::max<size_t>(options.block_cache_capacity / shard_num, 1);
+
+  size_t cpu_num = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  shards_.resize(shard_num);
+  for (size_t i = 0; i < shard_num; i++) {
+    auto &shard = shards_[i];
+    shard.redis = std::make_unique<RedisWrapper>(
+        db_path + "/shard_" + std::to_string(i), options);
+    shard.pool = std::make_unique<ThreadPool>(1);
+    shard.pool->submit([i, cpu_num]() { pin_current_thread(i % cpu_num); });
+  }
+}
+
+ShardedRedis::~ShardedRedis() = default;
+
+size_t ShardedRedis::shard_of(std::string_view key) const {
+  return hash64(key) % shards_.size();
+}
+
+std::string ShardedRedis::mget(std::vector<std::string> &args) {
+  // 每个分片中的 key 在 args 中的下标
+  std::vector<std::vector<size_t>> idxs(shards_.size());
+  for (size_t i = 1; i < args.size(); i++) {
+    idxs[shard_of(args[i])].push_back(i);
+  }
+  std::vector<std::future<std::string>> futures(shards_.size());
+  for (size_t shard = 0; shard < shards_.size(); shard++) {
+    if (idxs[shard].empty()) {
+      continue;
+    }
+    std::vector<std::string> shard_args = {args[0]};
+    for (auto idx : idxs[shard]) {
+      shard_args.push_back(args[idx]);
+    }
+    futures[shard] = submit(
+        shard, [shard_args = std::move(shard_args)](RedisWrapper &redis) mutable {
+          return redis.mget(shard_args);
+        });
+  }
+
+  // 按 key 原本的顺序排列各个分片回复中的元素
+  std::vector<std::string> values(args.size());
+  for (size_t shard = 0; shard < shards_.size(); shard++) {
+    if (idxs[shard].empty()) {
+      continue;
+    }
+    auto reply = futures[shard].get();
+    if (!reply.empty() && reply[0] == '-') {
+      return reply;
+    }
+    size_t pos = 0;
+    read_line(reply, pos);
+    for (auto idx : idxs[shard]) {
+      values[idx] = read_bulk(reply, pos);
+    }
+  }
+  std::string res_str;
+  RespWriter(res_str).array(args.size() - 1);
+  for (size_t i = 1; i < values.size(); i++) {
+    res_str += values[i];
+  }
+  return res_str;
+}
+
+std::string ShardedRedis::mset(std::vector<std::string> &args) {
+  if (args.size() < 3 || args.size() % 2 != 1) {
+    return "-ERR wrong number of arguments for 'mset' command\r\n";
+  }
+  std::vector<std::pair<std::string, std::string>> kvs;
+  kvs.reserve(args.size() / 2);
+  for (size_t i = 1; i + 1 < args.size(); i += 2) {
+    kvs.emplace_back(std::move(args[i]), std::move(args[i + 1]));
+  }
+  set_batch(kvs);
+  return "+OK\r\n";
+}
+
+std::string ShardedRedis::del(std::vector<std::string> &args) {
+  std::vector<std::vector<std::string>> shard_args(shards_.size());
+  for (size_t i = 1; i < args.size(); i++) {
+    auto &target = shard_args[shard_of(args[i])];
+    if (target.empty()) {
+      target.push_back(args[0]);
+    }
+    target.push_back(args[i]);
+  }
+  std::vector<std::future<std::string>> futures;
+  for (size_t shard = 0; shard < shards_.size(); shard++) {
+    if (!shard_args[shard].empty()) {
+      futures.push_back(submit(
+          shard, [del_args = std::move(shard_args[shard])](
+                     RedisWrapper &redis) mutable {
+            return redis.del(del_args);
+          }));
+    }
+  }
+  int64_t del_count = 0;
+  for (auto &future : futures) {
+    auto reply = future.get();
+    if (reply.empty() || reply[0] != ':') {
+      return reply;
+    }
+    size_t pos = 0;
+    del_count += parse_int(read_line(reply, pos).substr(1));
+  }
+  return resp_integer(del_count);
+}
+
+std::string
+ShardedRedis::set_batch(std::vector<std::pair<std::string, std::string>> &kvs) {
+  std::vector<std::vector<std::pair<std::string, std::string>>> shard_kvs(
+      shards_.size());
+  for (auto &kv : kvs) {
+    shard_kvs[shard_of(kv.first)].push_back(std::move(kv));
+  }
+  std::vector<std::future<std::string>> futures;
+  for (size_t shard = 0; shard < shards_.size(); shard++) {
+    if (!shard_kvs[shard].empty()) {
+      futures.push_back(submit(
+          shard,
+          [batch = std::move(shard_kvs[shard])](RedisWrapper &redis) mutable {
+            return redis.set_batch(batch);
+          }));
+    }
+  }
+  // 每个 SET 的回复都是 +OK, 合并的顺序不影响结果
+  std::string res_str;
+  for (auto &future : futures) {
+    res_str += future.get();
+  }
+  return res_str;
+}
+
+std::string ShardedRedis::scan(std::vector<std::string> &args) {
+  if (args.size() < 2) {
+    return "-ERR wrong number of arguments for '" + args[0] + "' command\r\n";
+  }
+  size_t shard;
+  std::string inner;
+  if (!parse_shard_cursor(args[1], shards_.size(), shard, inner)) {
+    return "-ERR invalid cursor\r\n";
+  }
+  std::vector<std::string> shard_args = args;
+  shard_args[1] = inner;
+  auto reply = submit(shard, [&shard_args](RedisWrapper &redis) {
+                 return redis.scan(shard_args);
+               }).get();
+  if (reply.empty() || reply[0] != '*') {
+    return reply;
+  }
+
+  // 分片内的游标为 "0" 时从下一个分片的开头继续, 最后一个分片遍历完成时为 "0"
+  size_t pos = 0;
+  read_line(reply, pos);
+  auto next = bulk_content(read_bulk(reply, pos));
+  std::string cursor;
+  if (next != "0") {
+    cursor = std::to_string(shard) + ":" + std::string(next);
+  } else if (shard + 1 < shards_.size()) {
+    cursor = std::to_string(shard + 1) + ":0";
+  } else {
+    cursor = "0";
+  }
+  std::string res_str;
+  RespWriter(res_str).array(2).bulk(cursor);
+  res_str.append(reply, pos);
+  return res_str;
+}
+
+std::string ShardedRedis::info(std::vector<std::string> &args) {
+  auto replies =
+      broadcast([&args](RedisWrapper &redis) { return redis.info(args); });
+  std::string text;
+  for (size_t i = 0; i < replies.size(); i++) {
+    if (replies[i].empty() || replies[i][0] != '$') {
+      return replies[i];
+    }
+    auto content = bulk_content(replies[i]);
+    if (!content.empty()) {
+      text += "# Shard " + std::to_string(i) + "\r\n";
+      text += content;
+    }
+  }
+  return resp_bulk(text);
+}
+
+void ShardedRedis::clear() {
+  broadcast([](RedisWrapper &redis) {
+    redis.clear();
+    return std::string();
+  });
+}
+
+void ShardedRedis::flushall() {
+  broadcast([](RedisWrapper &redis) {
+    redis.flushall();
+    return std::string();
+  });
+}
@@ -1,6 +1,12 @@
 #include "../../include/skiplist/skiplist.h"
+#include "../../include/consts.h"
+#include "../../include/utils/perf_context.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <random>
 #include <stdexcept>
 #include <tuple>
 #include <utility>
@@ -9,7 +15,11 @@
 
 BaseIterator &SkipListIterator::operator++() {
   if (current) {
-    current = current->forward_[0];
+    current = current->next(0);
+    // 跳过被逻辑删除的节点
+    while (current && current->deleted_.load(std::memory_order_acquire)) {
+      current = current->next(0);
+    }
   }
   return *this;
 }
@@ -28,32 +38,68 @@ bool SkipListIterator::operator!=(const BaseIterator &other) const {
 SkipListIterator::value_type SkipListIterator::operator*() const {
   if (!current)
     throw std::runtime_error("Dereferencing invalid iterator");
-  return {current->key_, current->value_};
+  return {std::string(current->key()), std::string(current->value())};
+}
+
+std::string_view SkipListIterator::key() const {
+  if (!current)
+    throw std::runtime_error("Dereferencing invalid iterator");
+  return current->key();
+}
+
+std::string_view SkipListIterator::value() const {
+  if (!current)
+    throw std::runtime_error("Dereferencing invalid iterator");
+  return current->value();
 }
 
 IteratorType SkipListIterator::get_type() const {
   return IteratorType::SkipListIterator;
 }
 
-bool SkipListIterator::is_valid() const {
-  return current && !current->key_.empty();
+BaseIterator &SkipListIterator::operator--() {
+  if (list_ == nullptr) {
+    throw std::runtime_error(
+        "SkipListIterator: reverse iteration needs SkipList::seek_for_prev");
+  }
+  if (current) {
+    current = list_->prev_visible(current->key(), max_tranc_id_);
+  }
+  return *this;
 }
+
+bool SkipListIterator::is_valid() const { return current != nullptr; }
 bool SkipListIterator::is_end() const { return current == nullptr; }
 
-std::string SkipListIterator::get_key() const { return current->key_; }
-std::string SkipListIterator::get_value() const { return current->value_; }
+std::string SkipListIterator::get_key() const {
+  return std::string(current->key());
+}
+std::string SkipListIterator::get_value() const {
+  return std::string(current->value());
+}
 uint64_t SkipListIterator::get_tranc_id() const { return current->tranc_id_; }
+bool SkipListIterator::is_merge_operand() const {
+  return current != nullptr && current->is_merge();
+}
 
 // ************************ SkipList ************************
 // 构造函数
-SkipList::SkipList(int max_lvl) : max_level(max_lvl), current_level(1) {
-  head = std::make_shared<SkipListNode>("", "", max_level, 0);
-  dis_01 = std::uniform_int_distribution<>(0, 1);
-  dis_level = std::uniform_int_distribution<>(0, (1 << max_lvl) - 1);
-  gen = std::mt19937(std::random_device()());
+SkipList::SkipList(int max_lvl)
+    : arena_(std::make_shared<Arena>(LSM_SKIPLIST_ARENA_BLOCK_SIZE)),
+      max_level(std::min(std::max(max_lvl, 1), kMaxLevel)), current_level(1) {
+  reset_head();
+}
+
+void SkipList::reset_head() {
+  // 头节点不从 Arena 分配, 这样空跳表不占用 Arena 的内存
+  head_mem = std::make_unique<char[]>(node_size(0, max_level));
+  head = init_node(head_mem.get(), "", 0, max_level);
 }
 
 int SkipList::random_level() {
+  // 每个线程使用独立的随机数生成器, 避免并发写入时的竞争
+  thread_local std::mt19937 gen(std::random_device{}());
+  thread_local std::uniform_int_distribution<> dis_01(0, 1);
   int level = 1;
   // 通过"抛硬币"的方式随机生成层数：
   // - 每次有50%的概率增加一层
@@ -65,194 +111,315 @@ int SkipList::random_level() {
   return level;
 }
 
-// 插入或更新键值对
-void SkipList::put(const std::string &key, const std::string &value,
-                   uint64_t tranc_id) {
-  std::vector<std::shared_ptr<SkipListNode>> update(max_level, nullptr);
-
-  // 先创建一个新节点
-  int new_level = std::max(random_level(), current_level);
-  auto new_node =
-      std::make_shared<SkipListNode>(key, value, new_level, tranc_id);
+size_t SkipList::node_size(size_t key_size, int height) {
+  return sizeof(SkipListNode) +
+         sizeof(std::atomic<SkipListNode *>) * (height - 1) + key_size;
+}
 
-  // std::unique_lock<std::shared_mutex> lock(rw_mutex);
-  auto current = head;
+SkipListNode *SkipList::new_node(const std::string &key, uint64_t tranc_id,
+                                 int height) {
+  return init_node(arena_->allocate(node_size(key.size(), height)), key,
+                   tranc_id, height);
+}
 
-  // 从最高层开始查找插入位置
-  for (int i = current_level - 1; i >= 0; --i) {
-    while (current->forward_[i] && *current->forward_[i] < *new_node) {
-      current = current->forward_[i];
-    }
-    update[i] = current;
+SkipListNode *SkipList::init_node(char *mem, const std::string &key,
+                                  uint64_t tranc_id, int height) {
+  auto *node = new (mem) SkipListNode();
+  node->tranc_id_ = tranc_id;
+  node->key_prefix_ = key_prefix(key);
+  node->key_size_ = static_cast<uint32_t>(key.size());
+  node->height_ = height;
+  node->value_.store(nullptr, std::memory_order_relaxed);
+  node->deleted_.store(false, std::memory_order_relaxed);
+  for (int i = 0; i < height; i++) {
+    new (&node->next_[i]) std::atomic<SkipListNode *>(nullptr);
   }
+  std::memcpy(reinterpret_cast<char *>(&node->next_[height]), key.data(),
+              key.size());
+  return node;
+}
 
-  // 移动到最底层
-  current = current->forward_[0];
+const char *SkipList::new_value(const std::string &value, bool merge) {
+  char *mem = arena_->allocate(sizeof(uint32_t) + value.size());
+  uint32_t value_size = static_cast<uint32_t>(value.size());
+  if (merge) {
+    value_size |= SkipListNode::kMergeFlag;
+  }
+  std::memcpy(mem, &value_size, sizeof(uint32_t));
+  std::memcpy(mem + sizeof(uint32_t), value.data(), value.size());
+  return mem;
+}
 
-  if (current && current->key_ == key && current->tranc_id_ == tranc_id) {
-    // 若 key 存在且 tranc_id 相同，更新 value
-    size_bytes += value.size() - current->value_.size();
-    current->value_ = value;
-    current->tranc_id_ = tranc_id;
-    return;
+bool SkipList::node_less(const SkipListNode *node, std::string_view key,
+                         uint64_t prefix, uint64_t tranc_id) {
+  int cmp = compare_with_prefix(node->key_prefix_, node->key(), prefix, key);
+  if (cmp != 0) {
+    return cmp < 0;
   }
+  // key 相等时，trans_id 更大的优先级更高
+  return node->tranc_id_ > tranc_id;
+}
 
-  // 如果key不存在，创建新节点
-  // ! 默认新的 tranc_id 一定比当前的大, 由上层保证
-  if (new_level > current_level) {
-    for (int i = current_level; i < new_level; ++i) {
-      update[i] = head;
+void SkipList::find_splice_for_level(std::string_view key, uint64_t prefix,
+                                     uint64_t tranc_id, SkipListNode *before,
+                                     int level, SkipListNode **prev,
+                                     SkipListNode **next) {
+  while (true) {
+    SkipListNode *node = before->next(level);
+    if (node == nullptr || !node_less(node, key, prefix, tranc_id)) {
+      *prev = before;
+      *next = node;
+      return;
     }
+    before = node;
   }
+}
 
-  // 生成一个随机数，用于决定是否在每一层更新节点
-  int random_bits = dis_level(gen);
-
-  size_bytes += key.size() + value.size() + sizeof(uint64_t);
-
-  // 更新各层的指针
-  for (int i = 0; i < new_level; ++i) {
-    bool need_update = false;
-    if (i == 0 || (new_level > current_level) || (random_bits & (1 << i))) {
-      // 按照如下顺序判断是否进行更新
-      // 1. 第0层总是更新
-      // 2. 如果需要创建新的层级, 这个节点需要再之前所有的层级上都更新
-      // 3. 否则, 根据随机数的位数按照50%的概率更新
-      need_update = true;
+SkipListNode *SkipList::seek(std::string_view key, uint64_t tranc_id) {
+  uint64_t prefix = key_prefix(key);
+  SkipListNode *current = head;
+  // 从最高层开始查找
+  for (int i = current_level.load(std::memory_order_acquire) - 1; i >= 0;
+       --i) {
+    SkipListNode *node = current->next(i);
+    while (node && node_less(node, key, prefix, tranc_id)) {
+      current = node;
+      node = current->next(i);
     }
+  }
+  // 移动到最底层
+  return current->next(0);
+}
 
-    if (need_update) {
-      new_node->forward_[i] = update[i]->forward_[i]; // 可能为nullptr
-      if (new_node->forward_[i]) {
-        new_node->forward_[i]->set_backward(i, new_node);
-      }
-      update[i]->forward_[i] = new_node;
-      new_node->set_backward(i, update[i]);
-    } else {
-      // 如果不更新当前层，之后更高的层级都不更新
-      break;
+SkipListNode *SkipList::find_less_than(std::string_view key) {
+  uint64_t prefix = key_prefix(key);
+  SkipListNode *current = head;
+  for (int i = current_level.load(std::memory_order_acquire) - 1; i >= 0;
+       --i) {
+    SkipListNode *node = current->next(i);
+    while (node &&
+           compare_with_prefix(node->key_prefix_, node->key(), prefix, key) <
+               0) {
+      current = node;
+      node = current->next(i);
     }
   }
-
-  current_level = new_level;
+  return current == head ? nullptr : current;
 }
 
-// 查找键值对
-SkipListIterator SkipList::get(const std::string &key, uint64_t tranc_id) {
-  // std::shared_lock<std::shared_mutex> slock(rw_mutex);
-
-  auto current = head;
-  // 从最高层开始查找
-  for (int i = current_level - 1; i >= 0; --i) {
-    while (current->forward_[i] && current->forward_[i]->key_ < key) {
-      current = current->forward_[i];
+SkipListNode *SkipList::find_last() {
+  SkipListNode *current = head;
+  for (int i = current_level.load(std::memory_order_acquire) - 1; i >= 0;
+       --i) {
+    while (SkipListNode *node = current->next(i)) {
+      current = node;
     }
   }
-  // 移动到最底层
-  current = current->forward_[0];
-  if (tranc_id == 0) {
-    // 如果没有开启事务，直接比较key即可
-    // 如果找到匹配的key，返回value
-    if (current && current->key_ == key) {
-      return SkipListIterator{current};
+  return current == head ? nullptr : current;
+}
+
+SkipListNode *SkipList::visible_in_key(SkipListNode *node, uint64_t tranc_id) {
+  if (node == nullptr) {
+    return nullptr;
+  }
+  auto key = node->key();
+  for (; node && node->key() == key; node = node->next(0)) {
+    if (!node->deleted_.load(std::memory_order_acquire) &&
+        (tranc_id == 0 || node->tranc_id_ <= tranc_id)) {
+      return node;
     }
-  } else {
-    while (current && current->key_ == key) {
-      // 如果开启了事务，只返回小于等于事务id的值
-      if (tranc_id != 0) {
-        if (current->tranc_id_ <= tranc_id) {
-          // 满足事务可见性
-          return SkipListIterator{current};
-
-        } else {
-          // 否则跳过
-          current = current->forward_[0];
-        }
-      } else {
-        // 没有开启事务
-        return SkipListIterator{current};
-      }
+  }
+  return nullptr;
+}
+
+SkipListNode *SkipList::prev_visible(std::string_view key, uint64_t tranc_id) {
+  std::string cur_key(key);
+  while (auto prev = find_less_than(cur_key)) {
+    // prev 是前一个 key 的最旧版本, 重新定位到它的第一个版本
+    cur_key.assign(prev->key());
+    if (auto node = visible_in_key(seek(cur_key, UINT64_MAX), tranc_id)) {
+      return node;
     }
   }
-  // 未找到返回空
-  return SkipListIterator{};
+  return nullptr;
 }
 
-// 删除键值对
-// ! 这里的 remove 是跳表本身真实的 remove,  lsm 应该使用 put 空值表示删除,
-// ! 这里只是为了实现完整的 SkipList 不会真正被上层调用
-void SkipList::remove(const std::string &key) {
-  std::vector<std::shared_ptr<SkipListNode>> update(max_level, nullptr);
+SkipListNode *SkipList::skip_deleted(SkipListNode *node) {
+  while (node && node->deleted_.load(std::memory_order_acquire)) {
+    node = node->next(0);
+  }
+  return node;
+}
 
-  // std::unique_lock<std::shared_mutex> lock(rw_mutex);
-  auto current = head;
+void SkipList::update_node(SkipListNode *node, const std::string &value,
+                           const char *value_ptr) {
+  size_t old_value_size = node->value().size();
+  node->value_.store(value_ptr, std::memory_order_release);
+  if (node->deleted_.exchange(false, std::memory_order_acq_rel)) {
+    // 被逻辑删除的节点重新生效
+    size_bytes += node->key_size_ + value.size() + sizeof(uint64_t);
+  } else {
+    size_bytes += value.size();
+    size_bytes -= old_value_size;
+  }
+}
 
-  // 从最高层开始查找目标节点
-  for (int i = current->forward_.size() - 1; i >= 0; --i) {
-    while (current->forward_[i] && current->forward_[i]->key_ < key) {
-      current = current->forward_[i];
-    }
-    update[i] = current;
+// 插入或更新键值对
+void SkipList::put(const std::string &key, const std::string &value,
+                   uint64_t tranc_id, bool merge) {
+  const char *value_ptr = new_value(value, merge);
+  if (merge) {
+    num_merge_operands++;
+  }
+  SkipListNode *prev[kMaxLevel];
+  SkipListNode *next[kMaxLevel];
+
+  // 1. 从最高层开始查找每一层的插入位置
+  uint64_t prefix = key_prefix(key);
+  int level = current_level.load(std::memory_order_acquire);
+  SkipListNode *before = head;
+  for (int i = level - 1; i >= 0; --i) {
+    find_splice_for_level(key, prefix, tranc_id, before, i, &prev[i],
+                          &next[i]);
+    before = prev[i];
   }
 
-  // 移动到最底层
-  current = current->forward_[0];
+  if (next[0] && next[0]->key() == key && next[0]->tranc_id_ == tranc_id) {
+    // 若 key 存在且 tranc_id 相同，更新 value
+    update_node(next[0], value, value_ptr);
+    return;
+  }
 
-  // 如果找到目标节点，执行删除操作
-  if (current && current->key_ == key) {
-    // 更新每一层的 forward 指针，跳过目标节点
-    for (int i = 0; i < current_level; ++i) {
-      if (update[i]->forward_[i] != current) {
+  // 2. 如果需要创建新的层级, 原子地提升跳表高度
+  // ! 默认新的 tranc_id 一定比当前的大, 由上层保证
+  int height = random_level();
+  int cur_level = level;
+  while (height > cur_level &&
+         !current_level.compare_exchange_weak(cur_level, height,
+                                              std::memory_order_acq_rel)) {
+  }
+  for (int i = level; i < height; ++i) {
+    // 如果这些层已经被其他写者创建, 下面的 CAS 会失败并重新查找
+    prev[i] = head;
+    next[i] = nullptr;
+  }
+
+  // 3. 自底向上逐层 CAS 链接, 第 0 层链接成功后节点就对读者可见了
+  SkipListNode *node = new_node(key, tranc_id, height);
+  node->value_.store(value_ptr, std::memory_order_relaxed);
+  for (int i = 0; i < height; ++i) {
+    while (true) {
+      node->next_[i].store(next[i], std::memory_order_relaxed);
+      if (prev[i]->cas_next(i, next[i], node)) {
         break;
       }
-      update[i]->forward_[i] = current->forward_[i];
-    }
-
-    // 更新 backward 指针
-    for (int i = 0; i < current->backward_.size() && i < current_level; ++i) {
-      if (current->forward_[i]) {
-        current->forward_[i]->set_backward(i, update[i]);
+      // 其他写者修改了这一层, 节点不会被物理删除, 从 prev 继续向后查找即可
+      find_splice_for_level(key, prefix, tranc_id, prev[i], i, &prev[i],
+                            &next[i]);
+      if (i == 0 && next[0] && next[0]->key() == key &&
+          next[0]->tranc_id_ == tranc_id) {
+        // 其他写者并发插入了相同的版本, 改为更新, 新节点留在 Arena 中即可
+        update_node(next[0], value, value_ptr);
+        return;
       }
     }
+  }
+
+  size_bytes += key.size() + value.size() + sizeof(uint64_t);
+}
 
-    // 更新跳表的内存大小
-    size_bytes -= key.size() + current->value_.size() + sizeof(uint64_t);
+// 查找键值对
+SkipListIterator SkipList::get(const std::string &key, uint64_t tranc_id) {
+  perf_count(&PerfContext::memtable_probes);
+  // 如果开启了事务，只返回小于等于事务id的值
+  // 否则直接返回最新的值, 即该 key 的第一个节点
+  auto current = skip_deleted(seek(key, tranc_id == 0 ? UINT64_MAX : tranc_id));
+  if (current && current->key() == key) {
+    return SkipListIterator{current, arena_};
+  }
+  // 未找到返回空
+  return SkipListIterator{};
+}
 
-    // 如果删除的节点是最高层的节点，更新跳表的当前层级
-    while (current_level > 1 && head->forward_[current_level - 1] == nullptr) {
-      current_level--;
+// 删除键值对
+// ! 这里的 remove 是跳表本身真实的 remove,  lsm 应该使用 put 空值表示删除,
+// ! 这里只是为了实现完整的 SkipList 不会真正被上层调用
+// ! 为了支持无锁的并发读写, 这里只做逻辑删除, 节点的内存随 Arena 一起释放
+void SkipList::remove(const std::string &key) {
+  auto current = skip_deleted(seek(key, UINT64_MAX));
+  if (current && current->key() == key) {
+    if (!current->deleted_.exchange(true, std::memory_order_acq_rel)) {
+      // 更新跳表的内存大小
+      size_bytes -=
+          key.size() + current->value().size() + sizeof(uint64_t);
     }
   }
 }
 
 // 刷盘时可以直接遍历最底层链表
 std::vector<std::tuple<std::string, std::string, uint64_t>> SkipList::flush() {
-  // std::shared_lock<std::shared_mutex> slock(rw_mutex);
-
   std::vector<std::tuple<std::string, std::string, uint64_t>> data;
-  auto node = head->forward_[0];
-  while (node) {
-    data.emplace_back(node->key_, node->value_, node->tranc_id_);
-    node = node->forward_[0];
+  for (auto node = skip_deleted(head->next(0)); node;
+       node = skip_deleted(node->next(0))) {
+    data.emplace_back(std::string(node->key()), std::string(node->value()),
+                      node->tranc_id_);
   }
   return data;
 }
 
-size_t SkipList::get_size() {
-  // std::shared_lock<std::shared_mutex> slock(rw_mutex);
-  return size_bytes;
+size_t SkipList::get_size() { return size_bytes.load(); }
+
+size_t SkipList::get_memory_usage() {
+  return arena_->memory_usage() + range_del_bytes.load();
+}
+
+void SkipList::add_range_tombstone(const std::string &begin,
+                                   const std::string &end, uint64_t tranc_id) {
+  size_t bytes = begin.size() + end.size() + sizeof(uint64_t);
+  std::lock_guard<std::mutex> lock(range_del_mtx);
+  range_dels.emplace_back(begin, end, tranc_id);
+  fragmented_range_dels = nullptr;
+  num_range_dels++;
+  range_del_bytes += bytes;
+  size_bytes += bytes;
+}
+
+std::shared_ptr<const FragmentedRangeTombstones>
+SkipList::get_range_tombstones() {
+  if (num_range_dels.load() == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(range_del_mtx);
+  if (fragmented_range_dels == nullptr) {
+    fragmented_range_dels =
+        std::make_shared<const FragmentedRangeTombstones>(range_dels);
+  }
+  return fragmented_range_dels;
+}
+
+size_t SkipList::num_range_tombstones() const { return num_range_dels.load(); }
+
+bool SkipList::has_merge_operands() const {
+  return num_merge_operands.load() > 0;
 }
 
 // 清空跳表，释放内存
 void SkipList::clear() {
-  // std::unique_lock<std::shared_mutex> lock(rw_mutex);
-  head = std::make_shared<SkipListNode>("", "", max_level, 0);
+  // ! 旧的节点仍然可能被迭代器引用, 由迭代器持有的 Arena 负责释放
+  arena_ = std::make_shared<Arena>(LSM_SKIPLIST_ARENA_BLOCK_SIZE);
+  reset_head();
+  current_level = 1;
   size_bytes = 0;
+  num_merge_operands = 0;
+  std::lock_guard<std::mutex> lock(range_del_mtx);
+  range_dels.clear();
+  fragmented_range_dels = nullptr;
+  num_range_dels = 0;
+  range_del_bytes = 0;
 }
 
 SkipListIterator SkipList::begin() {
-  // return SkipListIterator(head->forward[0], rw_mutex);
-  return SkipListIterator(head->forward_[0]);
+  return SkipListIterator(skip_deleted(head->next(0)), arena_);
 }
 
 SkipListIterator SkipList::end() {
@@ -262,42 +429,45 @@ SkipListIterator SkipList::end() {
 // 找到前缀的起始位置
 // 返回第一个前缀匹配或者大于前缀的迭代器
 SkipListIterator SkipList::begin_preffix(const std::string &preffix) {
-  // std::shared_lock<std::shared_mutex> slock(rw_mutex);
+  return SkipListIterator(skip_deleted(seek(preffix, UINT64_MAX)), arena_);
+}
 
-  auto current = head;
-  // 从最高层开始查找
-  for (int i = current_level - 1; i >= 0; --i) {
-    while (current->forward_[i] && current->forward_[i]->key_ < preffix) {
-      current = current->forward_[i];
+SkipListIterator SkipList::lower_bound(const std::string &key) {
+  return SkipListIterator(skip_deleted(seek(key, UINT64_MAX)), arena_);
+}
+
+SkipListIterator SkipList::seek_for_prev(const std::optional<std::string> &key,
+                                         uint64_t tranc_id) {
+  SkipListNode *node = nullptr;
+  if (key.has_value()) {
+    auto first = seek(key.value(), UINT64_MAX);
+    if (first && first->key() == key.value()) {
+      node = visible_in_key(first, tranc_id);
+    }
+    if (node == nullptr) {
+      node = prev_visible(key.value(), tranc_id);
+    }
+  } else if (auto last = find_last()) {
+    std::string last_key(last->key());
+    node = visible_in_key(seek(last_key, UINT64_MAX), tranc_id);
+    if (node == nullptr) {
+      node = prev_visible(last_key, tranc_id);
     }
   }
-  // 移动到最底层
-  current = current->forward_[0];
-
-  return SkipListIterator(current);
+  return SkipListIterator(node, arena_, this, tranc_id);
 }
 
 // 找到前缀的终结位置
 SkipListIterator SkipList::end_preffix(const std::string &prefix) {
-  auto current = head;
-
-  // 从最高层开始查找
-  for (int i = current_level - 1; i >= 0; --i) {
-    while (current->forward_[i] && current->forward_[i]->key_ < prefix) {
-      current = current->forward_[i];
-    }
-  }
-
-  // 移动到最底层
-  current = current->forward_[0];
+  auto current = skip_deleted(seek(prefix, UINT64_MAX));
 
   // 找到第一个键不以给定前缀开头的节点
-  while (current && current->key_.substr(0, prefix.size()) == prefix) {
-    current = current->forward_[0];
+  while (current && current->key().starts_with(prefix)) {
+    current = skip_deleted(current->next(0));
   }
 
   // 返回当前节点的迭代器
-  return SkipListIterator(current);
+  return SkipListIterator(current, arena_);
 }
 
 // 返回第一个满足谓词的位置和最后一个满足谓词的迭代器
@@ -311,100 +481,39 @@ SkipListIterator SkipList::end_preffix(const std::string &prefix) {
 std::optional<std::pair<SkipListIterator, SkipListIterator>>
 SkipList::iters_monotony_predicate(
     std::function<int(const std::string &)> predicate) {
-  auto current = head;
-  SkipListIterator begin_iter = SkipListIterator(nullptr);
-  SkipListIterator end_iter = SkipListIterator(nullptr);
-
-  // 从最高层开始查找
-  // 一开始 current == head, 所以  current_level - 1 处肯定有合法的指针
-  bool find1 = false;
-  for (int i = current_level - 1; i >= 0; --i) {
-    while (!find1) {
-      auto forward_i = current->forward_[i];
-      if (forward_i == nullptr) {
-        break;
-      }
-      auto direction = predicate(forward_i->key_);
-      if (direction == 0) {
-        // current 已经满足谓词了
-        find1 = true;
-        current = forward_i;
-        break;
-      } else if (direction < 0) {
-        // 下一个位置不满足谓词, 且方向错误(位于目标区间右侧)
-        // 需要尝试更小的步长(层级)
-        break;
-      } else {
-        // 下一个位置不满足谓词, 但方向正确(位于目标区间左侧)
-        current = forward_i;
-      }
+  int level = current_level.load(std::memory_order_acquire);
+
+  // 1. 从最高层开始, 找到最后一个位于目标区间左侧(谓词返回 >0)的节点
+  // 它在最底层的后继就是第一个可能满足谓词的节点
+  SkipListNode *current = head;
+  for (int i = level - 1; i >= 0; --i) {
+    SkipListNode *node = current->next(i);
+    while (node && predicate(std::string(node->key())) > 0) {
+      current = node;
+      node = current->next(i);
     }
   }
-
-  if (!find1) {
+  SkipListNode *first = skip_deleted(current->next(0));
+  if (first == nullptr || predicate(std::string(first->key())) != 0) {
     // 无法找到第一个满足谓词的迭代器, 直接返回
     return std::nullopt;
   }
 
-  // 记住当前 current 的位置
-  auto current2 = current;
-
-  // current 已经满足谓词, 但有可能中途跳过了节点, 需要前向检查
-  // 注意此时 不能直接从 current_level - 1 层开始,
-  // 因为当前节点的层数不一定等于最大层数
-  for (int i = current->backward_.size() - 1; i >= 0; --i) {
-    while (true) {
-      if (current->backward_[i].lock() == nullptr ||
-          current->backward_[i].lock() == head) {
-        // 当前层没有前向节点, 或前向节点指向头结点
-        break;
-      }
-      auto direction = predicate(current->backward_[i].lock()->key_);
-      if (direction == 0) {
-        // 前一个位置满足谓词, 继续判断
-        current = current->backward_[i].lock();
-        continue;
-      } else if (direction > 0) {
-        // 前一个位置不满足谓词
-        // 需要尝试更小的步长(层级)
-        break;
-      } else {
-        // 因为当前位置满足了谓词, 前一个位置不可能返回-1
-        // 这种情况属于跳表实现错误, 需要排查
-        throw std::runtime_error("iters_predicate: invalid direction");
-      }
-    }
-  }
-
-  // 找到第一个满足谓词的节点
-  begin_iter = SkipListIterator(current);
-
-  // 找到最后一个满足谓词的节点
-  for (int i = current2->forward_.size() - 1; i >= 0; --i) {
-    while (true) {
-      if (current2->forward_[i] == nullptr) {
-        // 当前层没有后向节点
-        break;
-      }
-      auto direction = predicate(current2->forward_[i]->key_);
-      if (direction == 0) {
-        // 后一个位置满足谓词, 继续判断
-        current2 = current2->forward_[i];
-        continue;
-      } else if (direction < 0) {
-        // 后一个位置不满足谓词
-        // 需要尝试更小的步长(层级)
-        break;
-      } else {
-        // 因为当前位置满足了谓词, 后一个位置不可能返回1
-        // 这种情况属于跳表实现错误, 需要排查
-        throw std::runtime_error("iters_predicate: invalid direction");
-      }
+  // 2. 从第一个满足谓词的节点开始, 找到最后一个没有位于目标区间右侧的节点
+  // 注意从 first 出发时, 只能使用 first 自身拥有的层级
+  current = first;
+  for (int i = first->height_ - 1; i >= 0; --i) {
+    SkipListNode *node = current->next(i);
+    while (node && predicate(std::string(node->key())) >= 0) {
+      current = node;
+      // current 的高度不低于 i, 可以继续在这一层前进
+      node = current->next(i);
     }
   }
 
-  end_iter = SkipListIterator(current2);
   // 转化为开区间
+  SkipListIterator begin_iter(first, arena_);
+  SkipListIterator end_iter(current, arena_);
   ++end_iter;
 
   return std::make_optional<std::pair<SkipListIterator, SkipListIterator>>(
@@ -414,10 +523,10 @@ SkipList::iters_monotony_predicate(
 void SkipList::print_skiplist() {
   for (int level = 0; level < current_level; level++) {
     std::cout << "Level " << level << ": ";
-    auto current = head->forward_[level];
+    auto current = head->next(level);
     while (current) {
-      std::cout << current->key_;
-      current = current->forward_[level];
+      std::cout << current->key();
+      current = current->next(level);
       if (current) {
         std::cout << " -> ";
       }
@@ -0,0 +1,209 @@
+#include "../../include/sst/blob_file.h"
+#include "../../include/utils/coding.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace {
+constexpr const char *kBlobFilePrefix = "blob_";
+constexpr const char *kBlobFileSuffix = ".blob";
+} // namespace
+
+// ************************ BlobIndex ************************
+
+std::string BlobIndex::encode() const {
+  uint8_t buf[30];
+  uint8_t *pos = encode_varint(buf, file_id);
+  pos = encode_varint(pos, offset);
+  pos = encode_varint(pos, size);
+  return std::string(reinterpret_cast<const char *>(buf), pos - buf);
+}
+
+BlobIndex BlobIndex::decode(std::string_view encoded) {
+  auto ptr = reinterpret_cast<const uint8_t *>(encoded.data());
+  auto limit = ptr + encoded.size();
+  BlobIndex index;
+  ptr = decode_varint(ptr, limit, &index.file_id);
+  if (ptr != nullptr) {
+    ptr = decode_varint(ptr, limit, &index.offset);
+  }
+  if (ptr != nullptr) {
+    ptr = decode_varint(ptr, limit, &index.size);
+  }
+  if (ptr != limit) {
+    throw std::runtime_error("Corrupted blob index");
+  }
+  return index;
+}
+
+// ************************ BlobFile ************************
+
+BlobFile::BlobFile(uint64_t file_id, std::string path)
+    : file_id_(file_id), path_(std::move(path)) {}
+
+BlobFile::~BlobFile() {
+  if (obsolete_) {
+    // 引用它的 sst 都已经被删除, 并且没有读者再持有这些 sst
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+  }
+}
+
+uint64_t BlobFile::get_file_id() const { return file_id_; }
+
+std::string BlobFile::read(uint64_t offset, uint64_t size) {
+  std::call_once(open_flag_,
+                 [this]() { file_ = FileObj::open(path_, false); });
+  if (offset + size > file_.size()) {
+    throw std::runtime_error("Blob index out of range: " + path_);
+  }
+  auto bytes = file_.read_to_slice(offset, size);
+  return std::string(bytes.begin(), bytes.end());
+}
+
+void BlobFile::ref_live() {
+  live_refs_++;
+  obsolete_ = false;
+}
+
+void BlobFile::unref_live() {
+  if (--live_refs_ == 0) {
+    obsolete_ = true;
+  }
+}
+
+size_t BlobFile::live_refs() const { return live_refs_; }
+
+// ************************ BlobFileBuilder ************************
+
+BlobFileBuilder::BlobFileBuilder(uint64_t file_id, std::string path)
+    : file_id_(file_id), path_(std::move(path)) {}
+
+BlobIndex BlobFileBuilder::add(const std::string &key,
+                               const std::string &value) {
+  uint32_t key_len = key.size();
+  uint32_t value_len = value.size();
+  size_t pos = data_.size();
+  data_.resize(pos + 2 * sizeof(uint32_t) + key.size() + value.size());
+  memcpy(data_.data() + pos, &key_len, sizeof(uint32_t));
+  memcpy(data_.data() + pos + sizeof(uint32_t), &value_len, sizeof(uint32_t));
+  pos += 2 * sizeof(uint32_t);
+  memcpy(data_.data() + pos, key.data(), key.size());
+  pos += key.size();
+  memcpy(data_.data() + pos, value.data(), value.size());
+
+  BlobIndex index;
+  index.file_id = file_id_;
+  index.offset = pos;
+  index.size = value.size();
+  return index;
+}
+
+uint64_t BlobFileBuilder::get_file_id() const { return file_id_; }
+
+size_t BlobFileBuilder::size() const { return data_.size(); }
+
+void BlobFileBuilder::set_rate_limiter(
+    std::shared_ptr<RateLimiter> rate_limiter, IOPriority priority) {
+  rate_limiter_ = std::move(rate_limiter);
+  io_priority_ = priority;
+}
+
+void BlobFileBuilder::finish() {
+  FileObj::create_and_write(path_, std::move(data_), rate_limiter_.get(),
+                            io_priority_);
+  data_.clear();
+}
+
+// ************************ BlobStore ************************
+
+BlobStore::BlobStore(std::string dir) : dir_(std::move(dir)) {
+  // 重启后从已有的最大 file_id 之后继续分配
+  if (!std::filesystem::exists(dir_)) {
+    return;
+  }
+  for (const auto &entry : std::filesystem::directory_iterator(dir_)) {
+    auto filename = entry.path().filename().string();
+    if (!entry.is_regular_file() || !is_blob_file(filename)) {
+      continue;
+    }
+    uint64_t file_id =
+        std::stoull(filename.substr(std::strlen(kBlobFilePrefix)));
+    next_file_id_ = std::max(next_file_id_.load(), file_id + 1);
+  }
+}
+
+std::unique_ptr<BlobFileBuilder> BlobStore::new_builder() {
+  uint64_t file_id = next_file_id_++;
+  return std::make_unique<BlobFileBuilder>(file_id, get_file_path(file_id));
+}
+
+std::shared_ptr<BlobFile> BlobStore::get_file(uint64_t file_id) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto &weak_file = files_[file_id];
+  auto file = weak_file.lock();
+  if (file == nullptr) {
+    file = std::make_shared<BlobFile>(file_id, get_file_path(file_id));
+    weak_file = file;
+  }
+  return file;
+}
+
+std::string BlobStore::read(const BlobIndex &index) {
+  return get_file(index.file_id)->read(index.offset, index.size);
+}
+
+void BlobStore::remove_unreferenced_files() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (const auto &entry : std::filesystem::directory_iterator(dir_)) {
+    auto filename = entry.path().filename().string();
+    if (!entry.is_regular_file() || !is_blob_file(filename)) {
+      continue;
+    }
+    uint64_t file_id =
+        std::stoull(filename.substr(std::strlen(kBlobFilePrefix)));
+    auto it = files_.find(file_id);
+    std::shared_ptr<BlobFile> file =
+        it == files_.end() ? nullptr : it->second.lock();
+    if (file == nullptr || file->live_refs() == 0) {
+      std::filesystem::remove(entry.path());
+    }
+  }
+}
+
+uint64_t BlobStore::relocation_cutoff(double age_cutoff) {
+  std::vector<uint64_t> live_ids;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto it = files_.begin(); it != files_.end();) {
+      auto file = it->second.lock();
+      if (file == nullptr) {
+        // 顺便清理已经释放的文件对象
+        it = files_.erase(it);
+        continue;
+      }
+      if (file->live_refs() > 0) {
+        live_ids.push_back(it->first);
+      }
+      ++it;
+    }
+  }
+  size_t num_relocate = live_ids.size() * age_cutoff;
+  if (num_relocate == 0) {
+    return 0;
+  }
+  std::sort(live_ids.begin(), live_ids.end());
+  return num_relocate < live_ids.size() ? live_ids[num_relocate]
+                                        : live_ids.back() + 1;
+}
+
+std::string BlobStore::get_file_path(uint64_t file_id) const {
+  return dir_ + "/" + kBlobFilePrefix + std::to_string(file_id) +
+         kBlobFileSuffix;
+}
+
+bool BlobStore::is_blob_file(const std::string &filename) {
+  return filename.starts_with(kBlobFilePrefix) &&
+         filename.ends_with(kBlobFileSuffix);
+}
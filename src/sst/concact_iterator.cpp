@@ -1,22 +1,99 @@
 #include "../../include/sst/concact_iterator.h"
+#include <algorithm>
 
 ConcactIterator::ConcactIterator(std::vector<std::shared_ptr<SST>> ssts,
                                  uint64_t tranc_id)
     : ssts(ssts), cur_iter(nullptr, tranc_id), cur_idx(0),
       max_tranc_id_(tranc_id) {
   if (!this->ssts.empty()) {
-    cur_iter = ssts[0]->begin(max_tranc_id_);
+    cur_iter = this->ssts[0]->begin(max_tranc_id_);
+    skip_empty_ssts();
   }
 }
 
+void ConcactIterator::skip_empty_ssts() {
+  while (is_end() && cur_idx + 1 < ssts.size()) {
+    cur_idx++;
+    cur_iter = ssts[cur_idx]->begin(max_tranc_id_);
+  }
+}
+
+ConcactIterator::ConcactIterator(
+    std::vector<std::shared_ptr<SST>> ssts, uint64_t tranc_id,
+    const std::function<int(const std::string &)> &predicate)
+    : ssts(std::move(ssts)), cur_iter(nullptr, tranc_id), cur_idx(0),
+      max_tranc_id_(tranc_id) {
+  // sst 之间按 key 有序且互不重叠, 二分查找第一个尾 key 不位于范围左侧的 sst
+  size_t left = 0;
+  size_t right = this->ssts.size();
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (predicate(this->ssts[mid]->get_last_key()) > 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  cur_idx = left;
+  if (cur_idx < this->ssts.size()) {
+    cur_iter = SstIterator(this->ssts[cur_idx], max_tranc_id_, predicate);
+  }
+  // 尾 key 的版本都不可见时, 需要从下一个 sst 的开头继续
+  skip_empty_ssts();
+}
+
+ConcactIterator::ConcactIterator(std::vector<std::shared_ptr<SST>> ssts,
+                                 uint64_t tranc_id, const std::string &key,
+                                 bool reverse)
+    : ssts(std::move(ssts)), cur_iter(nullptr, tranc_id), cur_idx(0),
+      max_tranc_id_(tranc_id) {
+  if (reverse) {
+    auto it = std::partition_point(
+        this->ssts.begin(), this->ssts.end(),
+        [&](const std::shared_ptr<SST> &sst) {
+          return sst->get_first_key() <= key;
+        });
+    cur_idx = it - this->ssts.begin();
+    if (cur_idx > 0) {
+      cur_idx--;
+      cur_iter = this->ssts[cur_idx]->seek_for_prev(key, max_tranc_id_);
+      skip_empty_ssts_reverse();
+    }
+    return;
+  }
+  auto it = std::partition_point(
+      this->ssts.begin(), this->ssts.end(),
+      [&](const std::shared_ptr<SST> &sst) { return sst->get_last_key() < key; });
+  cur_idx = it - this->ssts.begin();
+  if (cur_idx < this->ssts.size()) {
+    cur_iter = this->ssts[cur_idx]->seek(key, max_tranc_id_);
+  }
+  skip_empty_ssts();
+}
+
+void ConcactIterator::skip_empty_ssts_reverse() {
+  while (is_end() && cur_idx > 0) {
+    cur_idx--;
+    cur_iter = ssts[cur_idx]->seek_for_prev(ssts[cur_idx]->get_last_key(),
+                                            max_tranc_id_);
+  }
+}
+
+BaseIterator &ConcactIterator::operator--() {
+  --cur_iter;
+  if (is_end()) {
+    skip_empty_ssts_reverse();
+  }
+  return *this;
+}
+
 BaseIterator &ConcactIterator::operator++() {
   ++cur_iter;
 
   if (cur_iter.is_end() || !cur_iter.is_valid()) {
-    cur_idx++;
-    if (cur_idx < ssts.size()) {
-      cur_iter = ssts[cur_idx]->begin(max_tranc_id_);
-    } else {
+    skip_empty_ssts();
+    if (is_end()) {
+      cur_idx = ssts.size();
       cur_iter = SstIterator(nullptr, max_tranc_id_);
     }
   }
@@ -45,6 +122,10 @@ IteratorType ConcactIterator::get_type() const {
 
 uint64_t ConcactIterator::get_tranc_id() const { return max_tranc_id_; }
 
+uint64_t ConcactIterator::get_entry_tranc_id() const {
+  return cur_iter.get_entry_tranc_id();
+}
+
 bool ConcactIterator::is_end() const {
   return cur_iter.is_end() || !cur_iter.is_valid();
 }
@@ -57,6 +138,6 @@ ConcactIterator::pointer ConcactIterator::operator->() const {
   return cur_iter.operator->();
 }
 
-std::string ConcactIterator::key() { return cur_iter.key(); }
+std::string_view ConcactIterator::key() const { return cur_iter.key(); }
 
-std::string ConcactIterator::value() { return cur_iter.value(); }
\ No newline at end of file
+std::string_view ConcactIterator::value() const { return cur_iter.value(); }
\ No newline at end of file
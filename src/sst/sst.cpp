@@ -1,6 +1,11 @@
 #include "../../include/sst/sst.h"
 #include "../../include/consts.h"
 #include "../../include/sst/sst_iterator.h"
+#include "../../include/utils/blocked_bloom_filter.h"
+#include "../../include/utils/bloom_filter.h"
+#include "../../include/utils/hash.h"
+#include "../../include/utils/perf_context.h"
+#include "../../include/utils/xor_filter.h"
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
@@ -9,72 +14,303 @@
 #include <memory>
 #include <stdexcept>
 
+namespace {
+// 版本 2 开始在文件末尾追加 format_version, flags 和 magic
+constexpr uint32_t kSstFormatVersion = 2;
+constexpr uint64_t kSstMagic = 0x54534d534c696e6fULL;
+constexpr size_t kSstLegacyExtraLen =
+    sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2;
+constexpr size_t kSstTrailerLen = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+// 过滤器中包含 key 的前缀
+constexpr uint32_t kSstFlagPrefixFilter = 1;
+// 每个 data block 的末尾有一个 codec 字节
+constexpr uint32_t kSstFlagBlockCodec = 2;
+// 过滤器之后记录了 sst 引用的 blob 文件
+constexpr uint32_t kSstFlagBlobRefs = 4;
+// extra 之前记录了范围删除标记
+constexpr uint32_t kSstFlagRangeDel = 8;
+
+uint32_t block_hash(const uint8_t *data, size_t size) {
+  return static_cast<uint32_t>(std::hash<std::string_view>{}(
+      std::string_view(reinterpret_cast<const char *>(data), size)));
+}
+} // namespace
+
 // **************************************************
 // SST
 // **************************************************
 
 std::shared_ptr<SST> SST::open(size_t sst_id, FileObj file,
-                               std::shared_ptr<BlockCache> block_cache) {
+                               std::shared_ptr<BlockCache> block_cache,
+                               bool pin_meta,
+                               std::shared_ptr<BlobStore> blob_store,
+                               const SstFileMeta *file_meta) {
   auto sst = std::make_shared<SST>();
   sst->sst_id = sst_id;
   sst->file = std::move(file);
   sst->block_cache = block_cache;
+  if (LSM_SST_USE_MMAP) {
+    sst->mmap_file = sst->file.map_file();
+  }
 
   size_t file_size = sst->file.size();
   // 读取文件末尾的元数据块
-  if (file_size < sizeof(uint64_t) * 2 + sizeof(uint32_t) * 2) {
+  if (file_size < kSstLegacyExtraLen) {
     throw std::runtime_error("Invalid SST file: too small");
   }
 
-  // 0. 读取最大和最小的事务id
-  auto max_tranc_id =
-      sst->file.read_to_slice(file_size - sizeof(uint64_t), sizeof(uint64_t));
-  memcpy(&sst->max_tranc_id_, max_tranc_id.data(), sizeof(uint64_t));
-
-  auto min_tranc_id = sst->file.read_to_slice(file_size - sizeof(uint64_t) * 2,
-                                              sizeof(uint64_t));
-  memcpy(&sst->min_tranc_id_, min_tranc_id.data(), sizeof(uint64_t));
-
-  // 1. 读取元数据块的偏移量, 最后8字节: 2个 uint32_t,
-  // 分别是 meta 和 bloom 的 offset
-
-  auto bloom_offset_bytes = sst->file.read_to_slice(
-      file_size - sizeof(uint64_t) * 2 - sizeof(uint32_t), sizeof(uint32_t));
-  memcpy(&sst->bloom_offset, bloom_offset_bytes.data(), sizeof(uint32_t));
+  // 0. 根据末尾的 magic 判断文件格式, 没有 magic 的是版本 1 的文件
+  size_t extra_end = file_size;
+  if (file_size >= kSstLegacyExtraLen + kSstTrailerLen) {
+    auto trailer =
+        sst->file.read_to_slice(file_size - kSstTrailerLen, kSstTrailerLen);
+    uint64_t magic;
+    memcpy(&magic, trailer.data() + sizeof(uint32_t) * 2, sizeof(uint64_t));
+    if (magic == kSstMagic) {
+      memcpy(&sst->format_version_, trailer.data(), sizeof(uint32_t));
+      memcpy(&sst->format_flags_, trailer.data() + sizeof(uint32_t),
+             sizeof(uint32_t));
+      if (sst->format_version_ > kSstFormatVersion) {
+        throw std::runtime_error("Unsupported SST format version");
+      }
+      extra_end = file_size - kSstTrailerLen;
+    }
+  }
 
-  auto meta_offset_bytes = sst->file.read_to_slice(
-      file_size - sizeof(uint64_t) * 2 - sizeof(uint32_t) * 2,
-      sizeof(uint32_t));
-  memcpy(&sst->meta_block_offset, meta_offset_bytes.data(), sizeof(uint32_t));
+  // 1. 读取 extra: 2个 uint32_t, 分别是 meta 和 bloom 的 offset,
+  // 然后是最小和最大的事务id
+  auto extra = sst->file.read_to_slice(extra_end - kSstLegacyExtraLen,
+                                       kSstLegacyExtraLen);
+  memcpy(&sst->meta_block_offset, extra.data(), sizeof(uint32_t));
+  memcpy(&sst->bloom_offset, extra.data() + sizeof(uint32_t),
+         sizeof(uint32_t));
+  memcpy(&sst->min_tranc_id_, extra.data() + sizeof(uint32_t) * 2,
+         sizeof(uint64_t));
+  memcpy(&sst->max_tranc_id_,
+         extra.data() + sizeof(uint32_t) * 2 + sizeof(uint64_t),
+         sizeof(uint64_t));
+  if (file_meta != nullptr && file_meta->global_tranc_id != 0) {
+    sst->set_global_tranc_id(file_meta->global_tranc_id);
+  }
 
   // 2. 读取 bloom filter
-  if (sst->bloom_offset + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t) <
-      file_size) {
-    // 布隆过滤器偏移量 + 2*uint32_t 的大小小于文件大小
-    // 表示存在布隆过滤器
-    uint32_t bloom_size = file_size - sizeof(uint64_t) * 2 - sst->bloom_offset -
-                          sizeof(uint32_t) * 2;
-    auto bloom_bytes = sst->file.read_to_slice(sst->bloom_offset, bloom_size);
+  if (sst->bloom_offset + kSstLegacyExtraLen < extra_end) {
+    // 布隆过滤器和 extra 之间还有数据, 表示存在布隆过滤器
+    sst->bloom_size_ = extra_end - kSstLegacyExtraLen - sst->bloom_offset;
+  }
+  if (sst->format_flags_ & kSstFlagRangeDel) {
+    // 范围删除标记位于最后
+    uint32_t range_del_size = sst->file.read_uint32(
+        sst->bloom_offset + sst->bloom_size_ - sizeof(uint32_t));
+    sst->bloom_size_ -= sizeof(uint32_t) + range_del_size;
+    auto range_del_bytes = sst->file.read_to_slice(
+        sst->bloom_offset + sst->bloom_size_, range_del_size);
+    sst->range_dels_ = std::make_shared<const FragmentedRangeTombstones>(
+        FragmentedRangeTombstones::decode(range_del_bytes.data(),
+                                          range_del_bytes.size()));
+  }
+  if (sst->format_flags_ & kSstFlagBlobRefs) {
+    // 最后是引用的 blob 文件的 id 和数量
+    uint32_t num_blob_files = sst->file.read_uint32(
+        sst->bloom_offset + sst->bloom_size_ - sizeof(uint32_t));
+    sst->bloom_size_ -= sizeof(uint32_t) + num_blob_files * sizeof(uint64_t);
+    auto id_bytes = sst->file.read_to_slice(
+        sst->bloom_offset + sst->bloom_size_,
+        num_blob_files * sizeof(uint64_t));
+    std::vector<uint64_t> blob_file_ids(num_blob_files);
+    memcpy(blob_file_ids.data(), id_bytes.data(), id_bytes.size());
+    sst->set_blob_files(blob_file_ids, std::move(blob_store));
+  }
+  if (sst->format_flags_ & kSstFlagPrefixFilter) {
+    // 过滤器之后是 PrefixExtractor 的名称和长度
+    uint32_t name_len;
+    auto name_len_bytes = sst->file.read_to_slice(
+        sst->bloom_offset + sst->bloom_size_ - sizeof(uint32_t),
+        sizeof(uint32_t));
+    memcpy(&name_len, name_len_bytes.data(), sizeof(uint32_t));
+    sst->bloom_size_ -= sizeof(uint32_t) + name_len;
+    auto name = sst->file.read_to_slice(sst->bloom_offset + sst->bloom_size_,
+                                        name_len);
+    sst->prefix_extractor_name_.assign(name.begin(), name.end());
+  }
 
-    auto bloom = BloomFilter::decode(bloom_bytes);
-    sst->bloom_filter = std::make_shared<BloomFilter>(std::move(bloom));
+  bool cache_meta = block_cache != nullptr && block_cache->cache_meta();
+  if (file_meta != nullptr && cache_meta && !pin_meta) {
+    // 首尾 key 已经记录在 MANIFEST 中, 不需要在打开时读取元数据块
+    sst->first_key = file_meta->first_key;
+    sst->last_key = file_meta->last_key;
+    sst->num_blocks_ = file_meta->num_blocks;
+    return sst;
   }
+  auto filter = sst->load_filter();
 
   // 3. 读取并解码元数据块
-  uint32_t meta_size = sst->bloom_offset - sst->meta_block_offset;
-  auto meta_bytes = sst->file.read_to_slice(sst->meta_block_offset, meta_size);
-  sst->meta_entries = BlockMeta::decode_meta_from_slice(meta_bytes);
+  auto index = sst->load_index();
 
-  // 4. 设置首尾key
-  if (!sst->meta_entries.empty()) {
-    sst->first_key = sst->meta_entries.front().first_key;
-    sst->last_key = sst->meta_entries.back().last_key;
+  // 4. 设置首尾key, 需要覆盖范围删除标记
+  if (!index->empty()) {
+    sst->first_key = index->boundary(0);
+    sst->last_key = index->boundary(index->size());
+  }
+  if (sst->range_dels_ != nullptr) {
+    for (auto &tombstone : sst->range_dels_->tombstones()) {
+      if (sst->first_key.empty() || tombstone.begin < sst->first_key) {
+        sst->first_key = tombstone.begin;
+      }
+      sst->last_key = std::max(sst->last_key, tombstone.end);
+    }
   }
 
+  sst->init_meta(std::move(index), std::move(filter), pin_meta);
   return sst;
 }
 
-void SST::del_sst() { file.del_file(); }
+void SST::init_meta(std::shared_ptr<BlockIndex> index,
+                    std::shared_ptr<Filter> filter, bool pin_meta) {
+  num_blocks_ = index->size();
+  bool cache_meta = block_cache != nullptr && block_cache->cache_meta();
+  if (!cache_meta || pin_meta) {
+    // 常驻内存
+    block_index = index;
+    bloom_filter = filter;
+  }
+  if (cache_meta) {
+    // 刚打开的 sst 大概率马上被访问, 直接预热缓存
+    size_t charge = index->memory_usage();
+    block_cache->put_meta(sst_id, BlockCache::MetaType::Index,
+                          std::move(index), charge, pin_meta);
+    if (filter != nullptr) {
+      block_cache->put_meta(sst_id, BlockCache::MetaType::Filter, filter,
+                            filter_charge(), pin_meta);
+    }
+  }
+}
+
+std::shared_ptr<BlockIndex> SST::load_index() {
+  uint32_t meta_size = bloom_offset - meta_block_offset;
+  auto meta_bytes = file.read_to_slice(meta_block_offset, meta_size);
+  return std::make_shared<BlockIndex>(
+      BlockMeta::decode_meta_from_slice(meta_bytes));
+}
+
+std::shared_ptr<Filter> SST::load_filter() {
+  if (bloom_size_ == 0) {
+    return nullptr;
+  }
+  auto bloom_bytes = file.read_to_slice(bloom_offset, bloom_size_);
+  if (format_version_ == 1) {
+    // 版本 1 的过滤器没有类型字节
+    return std::make_shared<BloomFilter>(BloomFilter::decode(bloom_bytes));
+  }
+  return Filter::decode_filter(bloom_bytes);
+}
+
+size_t SST::filter_charge() const { return sizeof(BloomFilter) + bloom_size_; }
+
+std::shared_ptr<BlockIndex> SST::get_index() {
+  if (block_index != nullptr) {
+    return block_index;
+  }
+  if (block_cache != nullptr) {
+    auto cached = block_cache->get_meta(sst_id, BlockCache::MetaType::Index);
+    if (cached != nullptr) {
+      return std::static_pointer_cast<BlockIndex>(cached);
+    }
+  }
+  auto index = load_index();
+  if (block_cache != nullptr) {
+    block_cache->put_meta(sst_id, BlockCache::MetaType::Index, index,
+                          index->memory_usage(), false);
+  }
+  return index;
+}
+
+std::shared_ptr<Filter> SST::get_filter() {
+  if (bloom_filter != nullptr || bloom_size_ == 0) {
+    return bloom_filter;
+  }
+  if (block_cache != nullptr) {
+    auto cached = block_cache->get_meta(sst_id, BlockCache::MetaType::Filter);
+    if (cached != nullptr) {
+      return std::static_pointer_cast<Filter>(cached);
+    }
+  }
+  auto filter = load_filter();
+  if (block_cache != nullptr) {
+    block_cache->put_meta(sst_id, BlockCache::MetaType::Filter, filter,
+                          filter_charge(), false);
+  }
+  return filter;
+}
+
+SST::~SST() {
+  if (obsolete_) {
+    file.del_file();
+  }
+}
+
+void SST::del_sst() {
+  file.del_file();
+  for (auto &blob_file : blob_files_) {
+    blob_file->unref_live();
+  }
+}
+
+void SST::mark_obsolete() {
+  if (obsolete_.exchange(true)) {
+    return;
+  }
+  for (auto &blob_file : blob_files_) {
+    blob_file->unref_live();
+  }
+}
+
+void SST::set_blob_files(const std::vector<uint64_t> &file_ids,
+                         std::shared_ptr<BlobStore> blob_store) {
+  if (!file_ids.empty() && blob_store == nullptr) {
+    throw std::runtime_error("SST references blob files without a blob store");
+  }
+  for (auto file_id : file_ids) {
+    auto blob_file = blob_store->get_file(file_id);
+    blob_file->ref_live();
+    blob_files_.push_back(std::move(blob_file));
+  }
+}
+
+std::shared_ptr<const FragmentedRangeTombstones>
+SST::get_range_tombstones() const {
+  return range_dels_;
+}
+
+uint64_t SST::range_del_covering(std::string_view key,
+                                 uint64_t tranc_id) const {
+  if (range_dels_ == nullptr) {
+    return 0;
+  }
+  return range_dels_->max_covering(key, tranc_id);
+}
+
+std::string SST::read_blob(const std::string &blob_index) {
+  auto index = BlobIndex::decode(blob_index);
+  auto it = std::lower_bound(blob_files_.begin(), blob_files_.end(),
+                             index.file_id, [](const auto &file, uint64_t id) {
+                               return file->get_file_id() < id;
+                             });
+  if (it == blob_files_.end() || (*it)->get_file_id() != index.file_id) {
+    throw std::runtime_error("Blob file not referenced by SST");
+  }
+  return (*it)->read(index.offset, index.size);
+}
+
+std::vector<uint64_t> SST::get_blob_file_ids() const {
+  std::vector<uint64_t> file_ids;
+  for (auto &blob_file : blob_files_) {
+    file_ids.push_back(blob_file->get_file_id());
+  }
+  return file_ids;
+}
+
+void SST::rename_sst(const std::string &new_path) { file.rename(new_path); }
 
 std::shared_ptr<SST> SST::create_sst_with_meta_only(
     size_t sst_id, size_t file_size, const std::string &first_key,
@@ -90,8 +326,65 @@ std::shared_ptr<SST> SST::create_sst_with_meta_only(
   return sst;
 }
 
-std::shared_ptr<Block> SST::read_block(size_t block_idx) {
-  if (block_idx >= meta_entries.size()) {
+std::pair<size_t, size_t> SST::block_range_(size_t block_idx) {
+  auto index = get_index();
+  size_t block_offset = index->block_offset(block_idx);
+  size_t block_size;
+
+  // 计算block大小
+  if (block_idx == index->size() - 1) {
+    block_size = meta_block_offset - block_offset;
+  } else {
+    block_size = index->block_offset(block_idx + 1) - block_offset;
+  }
+  return {block_offset, block_size};
+}
+
+std::shared_ptr<Block> SST::decode_block_(const uint8_t *block_data,
+                                          size_t block_size,
+                                          std::vector<uint8_t> block_bytes) {
+  PerfTimer timer(&PerfContext::block_decode_nanos);
+  perf_count(&PerfContext::block_decode_bytes, block_size);
+  std::shared_ptr<Block> block_res;
+  if (!(format_flags_ & kSstFlagBlockCodec)) {
+    if (block_bytes.empty()) {
+      // 零拷贝: block 直接引用映射的内存, 由 block 持有映射
+      block_res = Block::decode_view(block_data, block_size, mmap_file, true);
+    } else {
+      block_res = Block::decode(block_bytes, true);
+    }
+  } else {
+    // | block | codec | hash |, 先校验哈希再解压
+    size_t trailer_size = sizeof(uint8_t) + sizeof(uint32_t);
+    if (block_size < trailer_size) {
+      throw std::runtime_error("Invalid SST block size");
+    }
+    uint32_t expected_hash;
+    memcpy(&expected_hash, block_data + block_size - sizeof(uint32_t),
+           sizeof(uint32_t));
+    if (block_hash(block_data, block_size - sizeof(uint32_t)) !=
+        expected_hash) {
+      throw std::runtime_error("Block hash verification failed");
+    }
+    auto codec =
+        static_cast<CompressionType>(block_data[block_size - trailer_size]);
+    size_t payload_size = block_size - trailer_size;
+    if (codec == CompressionType::None && block_bytes.empty()) {
+      block_res = Block::decode_view(block_data, payload_size, mmap_file);
+    } else if (codec == CompressionType::None) {
+      block_bytes.resize(payload_size);
+      block_res = Block::decode(block_bytes);
+    } else {
+      // 缓存池中保存的是解压后的 block
+      block_res =
+          Block::decode(decompress_block(codec, block_data, payload_size));
+    }
+  }
+  return block_res;
+}
+
+std::shared_ptr<Block> SST::read_block(size_t block_idx, bool fill_cache) {
+  if (block_idx >= num_blocks_) {
     throw std::out_of_range("Block index out of range");
   }
 
@@ -105,89 +398,243 @@ std::shared_ptr<Block> SST::read_block(size_t block_idx) {
     throw std::runtime_error("Block cache not set");
   }
 
-  const auto &meta = meta_entries[block_idx];
-  size_t block_size;
-
-  // 计算block大小
-  if (block_idx == meta_entries.size() - 1) {
-    block_size = meta_block_offset - meta.offset;
-  } else {
-    block_size = meta_entries[block_idx + 1].offset - meta.offset;
-  }
+  auto [block_offset, block_size] = block_range_(block_idx);
 
   // 读取block数据
-  auto block_data = file.read_to_slice(meta.offset, block_size);
-  auto block_res = Block::decode(block_data, true);
+  std::vector<uint8_t> block_bytes;
+  const uint8_t *block_data;
+  perf_count(&PerfContext::blocks_read);
+  perf_count(&PerfContext::block_read_bytes, block_size);
+  {
+    PerfTimer timer(&PerfContext::block_read_nanos);
+    if (mmap_file != nullptr) {
+      block_data = mmap_file->view(block_offset, block_size);
+    } else {
+      block_bytes = file.read_to_slice(block_offset, block_size);
+      block_data = block_bytes.data();
+    }
+  }
+  auto block_res = decode_block_(block_data, block_size, std::move(block_bytes));
 
   // 更新缓存
-  if (block_cache != nullptr) {
+  if (fill_cache) {
     block_cache->put(this->sst_id, block_idx, block_res);
-  } else {
+  }
+  return block_res;
+}
+
+std::shared_ptr<Block> SST::submit_block_read(size_t block_idx, IoBatch &batch,
+                                              size_t &request) {
+  request = SIZE_MAX;
+  if (block_idx >= num_blocks_) {
+    throw std::out_of_range("Block index out of range");
+  }
+  if (block_cache == nullptr) {
     throw std::runtime_error("Block cache not set");
   }
+  auto cache_ptr = block_cache->get(this->sst_id, block_idx);
+  if (cache_ptr != nullptr) {
+    return cache_ptr;
+  }
+  auto [block_offset, block_size] = block_range_(block_idx);
+  if (mmap_file != nullptr) {
+    // 映射的内存不需要 read, 只发起预读, 完成时直接引用
+    // complete_block_read 时经过 read_block, 在那里计入读取的 block
+    mmap_file->prefetch(block_offset, block_size);
+  } else {
+    request = batch.add(file, block_offset, block_size);
+    perf_count(&PerfContext::blocks_read);
+    perf_count(&PerfContext::block_read_bytes, block_size);
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Block> SST::complete_block_read(size_t block_idx,
+                                                IoBatch &batch,
+                                                size_t request) {
+  if (request == SIZE_MAX) {
+    return read_block(block_idx);
+  }
+  auto block_size = block_range_(block_idx).second;
+  auto &block_bytes = batch.data(request);
+  const uint8_t *block_data = block_bytes.data();
+  auto block_res =
+      decode_block_(block_data, block_size, std::move(block_bytes));
+  block_cache->put(this->sst_id, block_idx, block_res);
   return block_res;
 }
 
+size_t SST::prefetch_blocks(size_t first_block, size_t max_bytes) {
+  if (first_block >= num_blocks_) {
+    return num_blocks_;
+  }
+  auto index = get_index();
+  // 第 idx 个 block 的结束位置
+  auto block_end = [&](size_t idx) -> size_t {
+    return idx + 1 < num_blocks_ ? index->block_offset(idx + 1)
+                                 : meta_block_offset;
+  };
+  size_t begin = index->block_offset(first_block);
+  size_t end_block = first_block + 1;
+  while (end_block < num_blocks_ && block_end(end_block) - begin <= max_bytes) {
+    end_block++;
+  }
+  size_t length = block_end(end_block - 1) - begin;
+  if (mmap_file != nullptr) {
+    mmap_file->prefetch(begin, length);
+  } else {
+    file.prefetch(begin, length);
+  }
+  return end_block;
+}
+
 size_t SST::find_block_idx(const std::string &key) {
   // 先在布隆过滤器判断key是否存在
-  if (bloom_filter != nullptr && !bloom_filter->possibly_contains(key)) {
+  auto filter = get_filter();
+  if (filter != nullptr && !filter->possibly_contains(key)) {
     return -1;
   }
 
-  // 二分查找
-  size_t left = 0;
-  size_t right = meta_entries.size();
+  // 在分隔 key 上二分, 只比较连续内存中的 string_view
+  auto index = get_index();
+  size_t block_idx = index->seek(key);
+  if (block_idx >= index->size() || key < index->boundary(0)) {
+    return -1;
+  }
+  return block_idx;
+}
 
-  while (left < right) {
-    size_t mid = (left + right) / 2;
-    const auto &meta = meta_entries[mid];
+void SST::filter_batch(std::span<const std::string_view> keys,
+                       std::span<const uint64_t> key_hashes,
+                       uint8_t *results, Statistics *stats) {
+  auto filter = get_filter();
+  if (filter == nullptr) {
+    std::fill(results, results + keys.size(), 1);
+    return;
+  }
+  filter->possibly_contains_batch(keys, key_hashes, results);
+  if (stats == nullptr && get_perf_level() == PerfLevel::Disable) {
+    return;
+  }
+  size_t positive = std::count(results, results + keys.size(), 1);
+  perf_count(&PerfContext::bloom_positive, positive);
+  perf_count(&PerfContext::bloom_useful, keys.size() - positive);
+  if (stats != nullptr) {
+    stats->record_tick(Ticker::BloomFullPositive, positive);
+    stats->record_tick(Ticker::BloomUseful, keys.size() - positive);
+  }
+}
 
-    if (key < meta.first_key) {
-      right = mid;
-    } else if (key > meta.last_key) {
-      left = mid + 1;
-    } else {
-      return mid;
+size_t SST::lower_bound_block_idx(const std::string &key) {
+  return get_index()->seek(key);
+}
+
+std::string SST::get_block_boundary_key(size_t block_idx) {
+  return std::string(get_index()->boundary(block_idx));
+}
+
+SstIterator SST::get(const std::string &key, uint64_t tranc_id,
+                     Statistics *stats) {
+  if (key < first_key || key > last_key || !visible_to(tranc_id)) {
+    return this->end();
+  }
+
+  // 在布隆过滤器判断key是否存在
+  auto filter = get_filter();
+  if (filter != nullptr && !filter->possibly_contains(key)) {
+    perf_count(&PerfContext::bloom_useful);
+    if (stats != nullptr) {
+      stats->record_tick(Ticker::BloomUseful);
     }
+    return this->end();
+  }
+  if (filter != nullptr) {
+    perf_count(&PerfContext::bloom_positive);
   }
 
-  if (left >= meta_entries.size()) {
-    // 如果没有找到完全匹配的块，返回-1
-    return -1;
+  SstIterator iter(shared_from_this(), key, tranc_id);
+  if (filter != nullptr && stats != nullptr) {
+    stats->record_tick(Ticker::BloomFullPositive);
+    if (iter.is_valid()) {
+      stats->record_tick(Ticker::BloomTruePositive);
+    }
   }
-  return left;
+  return iter;
 }
 
-SstIterator SST::get(const std::string &key, uint64_t tranc_id) {
-  if (key < first_key || key > last_key) {
+SstIterator SST::seek(const std::string &key, uint64_t tranc_id) {
+  if (!visible_to(tranc_id)) {
     return this->end();
   }
+  SstIterator it(nullptr, tranc_id);
+  it.m_sst = shared_from_this();
+  it.seek_lower_bound(key);
+  return it;
+}
 
-  // 在布隆过滤器判断key是否存在
-  if (bloom_filter != nullptr && !bloom_filter->possibly_contains(key)) {
+SstIterator SST::seek_for_prev(const std::string &key, uint64_t tranc_id) {
+  if (!visible_to(tranc_id)) {
     return this->end();
   }
+  SstIterator it(nullptr, tranc_id);
+  it.m_sst = shared_from_this();
+  it.seek_for_prev(key);
+  return it;
+}
+
+bool SST::preffix_may_match(const std::string &preffix,
+                            const PrefixExtractor *extractor) {
+  // 以 preffix 为前缀的 key 位于 [preffix, preffix 的后继) 之间
+  if (last_key < preffix) {
+    return false;
+  }
+  if (first_key > preffix && first_key.compare(0, preffix.size(), preffix)) {
+    return false;
+  }
 
-  return SstIterator(shared_from_this(), key, tranc_id);
+  if (extractor == nullptr || prefix_extractor_name_.empty() ||
+      extractor->name() != prefix_extractor_name_ ||
+      !extractor->in_domain(preffix)) {
+    return true;
+  }
+  auto filter = get_filter();
+  return filter == nullptr ||
+         filter->possibly_contains_prefix(extractor->transform(preffix));
 }
 
-size_t SST::num_blocks() const { return meta_entries.size(); }
+size_t SST::num_blocks() const { return num_blocks_; }
 
-std::string SST::get_first_key() const { return first_key; }
+bool SST::has_filter() const { return bloom_size_ != 0; }
 
-std::string SST::get_last_key() const { return last_key; }
+const std::string &SST::get_first_key() const { return first_key; }
+
+const std::string &SST::get_last_key() const { return last_key; }
 
 size_t SST::sst_size() const { return file.size(); }
 
 size_t SST::get_sst_id() const { return sst_id; }
 
+SstFileMeta SST::get_file_meta() const {
+  SstFileMeta meta;
+  meta.first_key = first_key;
+  meta.last_key = last_key;
+  meta.num_blocks = num_blocks_;
+  meta.global_tranc_id = global_tranc_id_;
+  return meta;
+}
+
 SstIterator SST::begin(uint64_t tranc_id) {
+  if (!visible_to(tranc_id)) {
+    return this->end();
+  }
   return SstIterator(shared_from_this(), tranc_id);
 }
 
 SstIterator SST::end() {
-  SstIterator res(shared_from_this(), 0);
-  res.m_block_idx = meta_entries.size();
+  // 不经过 seek_first, 否则每次构造 end 都会读取第一个 block
+  SstIterator res(nullptr, 0);
+  res.m_sst = shared_from_this();
+  res.m_block_idx = num_blocks_;
   res.m_block_it = nullptr;
   return res;
 }
@@ -196,16 +643,68 @@ std::pair<uint64_t, uint64_t> SST::get_tranc_id_range() const {
   return std::make_pair(min_tranc_id_, max_tranc_id_);
 }
 
+void SST::set_global_tranc_id(uint64_t tranc_id) {
+  global_tranc_id_ = tranc_id;
+  min_tranc_id_ = tranc_id;
+  max_tranc_id_ = tranc_id;
+}
+
+uint64_t SST::get_global_tranc_id() const { return global_tranc_id_; }
+
+uint32_t SST::get_format_version() const { return format_version_; }
+
+// **************************************************
+// SstReadahead
+// **************************************************
+
+SstReadahead::SstReadahead(bool sequential)
+    : sequential_(sequential),
+      readahead_bytes_(sequential ? LSM_SST_READAHEAD_MAX
+                                  : LSM_SST_READAHEAD_MIN) {}
+
+size_t SstReadahead::on_block_read(SST &sst, size_t block_idx) {
+  bool continuous = sst_ == &sst && last_block_ != SIZE_MAX &&
+                    block_idx == last_block_ + 1;
+  if (sst_ != &sst || (!continuous && !sequential_)) {
+    // 重新检测顺序读取
+    sst_ = &sst;
+    prefetched_end_ = 0;
+    trigger_block_ = 0;
+    if (!sequential_) {
+      readahead_bytes_ = LSM_SST_READAHEAD_MIN;
+    }
+  }
+  last_block_ = block_idx;
+  if (!continuous && !sequential_) {
+    return 0;
+  }
+  // 读到已预读范围的一半时继续预读之后的 block, 读到末尾时数据已经就绪
+  if (block_idx < trigger_block_ || prefetched_end_ >= sst.num_blocks() ||
+      block_idx + 1 >= sst.num_blocks()) {
+    return 0;
+  }
+  size_t first = std::max(block_idx + 1, prefetched_end_);
+  size_t end = sst.prefetch_blocks(first, readahead_bytes_);
+  prefetched_end_ = end;
+  trigger_block_ = first + (end - first) / 2;
+  readahead_bytes_ = std::min<size_t>(readahead_bytes_ * 2,
+                                      LSM_SST_READAHEAD_MAX);
+  return end - first;
+}
+
 // **************************************************
 // SSTBuilder
 // **************************************************
 
-SSTBuilder::SSTBuilder(size_t block_size, bool has_bloom) : block(block_size) {
+SSTBuilder::SSTBuilder(size_t block_size, bool has_bloom,
+                       std::shared_ptr<PrefixExtractor> prefix_extractor,
+                       FilterType filter_type, CompressionType compression,
+                       size_t bloom_bits_per_key)
+    : block(block_size), has_bloom_(has_bloom),
+      prefix_extractor_(has_bloom ? std::move(prefix_extractor) : nullptr),
+      filter_type_(filter_type), compression_(compression),
+      bloom_bits_per_key_(bloom_bits_per_key) {
   // 初始化第一个block
-  if (has_bloom) {
-    bloom_filter = std::make_shared<BloomFilter>(
-        BLOOM_FILTER_EXPECTED_SIZE, BLOOM_FILTER_EXPECTED_ERROR_RATE);
-  }
   meta_entries.clear();
   data.clear();
   first_key.clear();
@@ -213,25 +712,41 @@ SSTBuilder::SSTBuilder(size_t block_size, bool has_bloom) : block(block_size) {
 }
 
 void SSTBuilder::add(const std::string &key, const std::string &value,
-                     uint64_t tranc_id) {
+                     uint64_t tranc_id, bool blob_index) {
   // 记录第一个key
   if (first_key.empty()) {
     first_key = key;
   }
 
-  // 在 布隆过滤器 中添加key
-  if (bloom_filter != nullptr) {
-    bloom_filter->add(key);
+  // 记录 key 的哈希值, 同一个 key 的多个版本只记录一次
+  if (has_bloom_ && (key_hashes.empty() || key != last_key)) {
+    key_hashes.push_back(hash64(key));
+  }
+  // 有序的 key 中相同的前缀是连续的, 同样只记录一次
+  if (prefix_extractor_ != nullptr && prefix_extractor_->in_domain(key)) {
+    auto preffix = prefix_extractor_->transform(key);
+    if (preffix != last_prefix_) {
+      key_hashes.push_back(Filter::prefix_hash(preffix));
+      last_prefix_ = preffix;
+    }
   }
 
   // 记录 事务id 范围
   max_tranc_id_ = std::max(max_tranc_id_, tranc_id);
   min_tranc_id_ = std::min(min_tranc_id_, tranc_id);
 
+  if (blob_index) {
+    auto file_id = BlobIndex::decode(value).file_id;
+    if (std::find(blob_file_ids_.begin(), blob_file_ids_.end(), file_id) ==
+        blob_file_ids_.end()) {
+      blob_file_ids_.push_back(file_id);
+    }
+  }
+
   bool force_write = key == last_key;
   // 连续出现相同的 key 必须位于 同一个 block 中
 
-  if (block.add_entry(key, value, tranc_id, force_write)) {
+  if (block.add_entry(key, value, tranc_id, force_write, blob_index)) {
     // block 满足容量限制, 插入成功
     last_key = key;
     return;
@@ -239,12 +754,25 @@ void SSTBuilder::add(const std::string &key, const std::string &value,
 
   finish_block(); // 将当前 block 写入
 
-  block.add_entry(key, value, tranc_id, false);
+  block.add_entry(key, value, tranc_id, false, blob_index);
   first_key = key;
   last_key = key; // 更新最后一个key
 }
 
-size_t SSTBuilder::estimated_size() const { return data.size(); }
+void SSTBuilder::add_range_tombstone(const std::string &begin,
+                                     const std::string &end,
+                                     uint64_t tranc_id) {
+  max_tranc_id_ = std::max(max_tranc_id_, tranc_id);
+  min_tranc_id_ = std::min(min_tranc_id_, tranc_id);
+  range_del_bytes_ += begin.size() + end.size() + sizeof(uint64_t);
+  range_dels_.emplace_back(begin, end, tranc_id);
+}
+
+size_t SSTBuilder::estimated_size() const {
+  // ! 需要包含还没有 finish 的 block, 否则数据不足一个 block 时会被当作空
+  return data.size() + (block.is_empty() ? 0 : block.cur_size()) +
+         range_del_bytes_;
+}
 
 void SSTBuilder::finish_block() {
   auto old_block = std::move(this->block);
@@ -252,30 +780,46 @@ void SSTBuilder::finish_block() {
 
   meta_entries.emplace_back(data.size(), first_key, last_key);
 
-  // 计算block的哈希值
-  auto block_hash = static_cast<uint32_t>(std::hash<std::string_view>{}(
-      std::string_view(reinterpret_cast<const char *>(encoded_block.data()),
-                       encoded_block.size())));
+  // 压缩 block, 收益不足时保存原始数据
+  std::vector<uint8_t> compressed;
+  auto codec = CompressionType::None;
+  if (compress_block(compression_, encoded_block.data(), encoded_block.size(),
+                     compressed)) {
+    codec = compression_;
+    encoded_block = std::move(compressed);
+  }
 
-  // 预分配空间并添加数据
-  data.reserve(data.size() + encoded_block.size() +
-               sizeof(uint32_t)); // 加上的是哈希值
+  // 预分配空间并添加数据, 开启压缩时之后是 codec, 最后是哈希值
+  size_t block_start = data.size();
+  data.reserve(data.size() + encoded_block.size() + sizeof(uint8_t) +
+               sizeof(uint32_t));
   data.insert(data.end(), encoded_block.begin(), encoded_block.end());
+  if (compression_ != CompressionType::None) {
+    data.push_back(static_cast<uint8_t>(codec));
+  }
+  auto hash = block_hash(data.data() + block_start, data.size() - block_start);
   data.resize(data.size() + sizeof(uint32_t));
-  memcpy(data.data() + data.size() - sizeof(uint32_t), &block_hash,
+  memcpy(data.data() + data.size() - sizeof(uint32_t), &hash,
          sizeof(uint32_t));
 }
 
+void SSTBuilder::set_rate_limiter(std::shared_ptr<RateLimiter> rate_limiter,
+                                  IOPriority priority) {
+  rate_limiter_ = std::move(rate_limiter);
+  io_priority_ = priority;
+}
+
 std::shared_ptr<SST>
 SSTBuilder::build(size_t sst_id, const std::string &path,
-                  std::shared_ptr<BlockCache> block_cache) {
+                  std::shared_ptr<BlockCache> block_cache, bool pin_meta,
+                  std::shared_ptr<BlobStore> blob_store) {
   // 完成最后一个block
   if (!block.is_empty()) {
     finish_block();
   }
 
   // 如果没有数据，抛出异常
-  if (meta_entries.empty()) {
+  if (meta_entries.empty() && range_dels_.empty()) {
     throw std::runtime_error("Cannot build empty SST");
   }
 
@@ -295,48 +839,119 @@ SSTBuilder::build(size_t sst_id, const std::string &path,
 
   // 3. 编码布隆过滤器
   uint32_t bloom_offset = file_content.size();
-  if (bloom_filter != nullptr) {
-    auto bf_data = bloom_filter->encode();
+  uint32_t bloom_size = 0;
+  std::shared_ptr<Filter> bloom_filter;
+  if (has_bloom_ && !meta_entries.empty()) {
+    if (filter_type_ == FilterType::Xor8) {
+      bloom_filter = XorFilter::build(std::move(key_hashes));
+    } else {
+      bloom_filter =
+          BlockedBloomFilter::build(key_hashes, bloom_bits_per_key_);
+    }
+    auto bf_data = bloom_filter->encode_filter();
+    bloom_size = bf_data.size();
     file_content.insert(file_content.end(), bf_data.begin(), bf_data.end());
   }
+  // 未开启压缩的 sst 与之前的 block 格式保持一致
+  uint32_t flags =
+      compression_ != CompressionType::None ? kSstFlagBlockCodec : 0;
+  std::string prefix_extractor_name;
+  if (prefix_extractor_ != nullptr) {
+    flags |= kSstFlagPrefixFilter;
+    prefix_extractor_name = prefix_extractor_->name();
+    uint32_t name_len = prefix_extractor_name.size();
+    file_content.insert(file_content.end(), prefix_extractor_name.begin(),
+                        prefix_extractor_name.end());
+    file_content.resize(file_content.size() + sizeof(uint32_t));
+    memcpy(file_content.data() + file_content.size() - sizeof(uint32_t),
+           &name_len, sizeof(uint32_t));
+  }
+  std::sort(blob_file_ids_.begin(), blob_file_ids_.end());
+  if (!blob_file_ids_.empty()) {
+    flags |= kSstFlagBlobRefs;
+    uint32_t num_blob_files = blob_file_ids_.size();
+    size_t pos = file_content.size();
+    file_content.resize(pos + num_blob_files * sizeof(uint64_t) +
+                        sizeof(uint32_t));
+    memcpy(file_content.data() + pos, blob_file_ids_.data(),
+           num_blob_files * sizeof(uint64_t));
+    memcpy(file_content.data() + file_content.size() - sizeof(uint32_t),
+           &num_blob_files, sizeof(uint32_t));
+  }
+  if (!range_dels_.empty()) {
+    flags |= kSstFlagRangeDel;
+    size_t pos = file_content.size();
+    FragmentedRangeTombstones::encode(range_dels_, file_content);
+    uint32_t range_del_size = file_content.size() - pos;
+    file_content.resize(file_content.size() + sizeof(uint32_t));
+    memcpy(file_content.data() + file_content.size() - sizeof(uint32_t),
+           &range_del_size, sizeof(uint32_t));
+  }
 
-  auto extra_len = sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2;
-  file_content.resize(file_content.size() + extra_len);
+  size_t extra_offset = file_content.size();
+  file_content.resize(file_content.size() + kSstLegacyExtraLen +
+                      kSstTrailerLen);
+  uint8_t *extra = file_content.data() + extra_offset;
   // sizeof(uint32_t) * 2  表示: 元数据块的偏移量, 布隆过滤器偏移量,
   // sizeof(uint64_t) * 2  表示: 最小事务id,, 最大事务id
 
   // 4. 添加元数据块偏移量
-  memcpy(file_content.data() + file_content.size() - extra_len, &meta_offset,
-         sizeof(uint32_t));
+  memcpy(extra, &meta_offset, sizeof(uint32_t));
 
   // 5. 添加布隆过滤器偏移量
-  memcpy(file_content.data() + file_content.size() - extra_len +
-             sizeof(uint32_t),
-         &bloom_offset, sizeof(uint32_t));
+  memcpy(extra + sizeof(uint32_t), &bloom_offset, sizeof(uint32_t));
 
   // 6. 添加最大和最小的事务id
-  memcpy(file_content.data() + file_content.size() - sizeof(uint64_t) * 2,
-         &min_tranc_id_, sizeof(uint64_t));
-  memcpy(file_content.data() + file_content.size() - sizeof(uint64_t),
-         &max_tranc_id_, sizeof(uint64_t));
+  memcpy(extra + sizeof(uint32_t) * 2, &min_tranc_id_, sizeof(uint64_t));
+  memcpy(extra + sizeof(uint32_t) * 2 + sizeof(uint64_t), &max_tranc_id_,
+         sizeof(uint64_t));
+
+  // 7. 添加格式版本和 magic
+  uint32_t format_version = kSstFormatVersion;
+  extra += kSstLegacyExtraLen;
+  memcpy(extra, &format_version, sizeof(uint32_t));
+  memcpy(extra + sizeof(uint32_t), &flags, sizeof(uint32_t));
+  memcpy(extra + sizeof(uint32_t) * 2, &kSstMagic, sizeof(uint64_t));
 
   // 创建文件
-  FileObj file = FileObj::create_and_write(path, file_content);
+  FileObj file = FileObj::create_and_write(path, std::move(file_content),
+                                           rate_limiter_.get(), io_priority_);
 
   // 返回SST对象
   auto res = std::make_shared<SST>();
 
   res->sst_id = sst_id;
   res->file = std::move(file);
-  res->first_key = meta_entries.front().first_key;
-  res->last_key = meta_entries.back().last_key;
+  if (!meta_entries.empty()) {
+    res->first_key = meta_entries.front().first_key;
+    res->last_key = meta_entries.back().last_key;
+  }
+  if (!range_dels_.empty()) {
+    // 首尾 key 扩展到覆盖全部范围删除标记
+    for (auto &tombstone : range_dels_) {
+      if (res->first_key.empty() || tombstone.begin < res->first_key) {
+        res->first_key = tombstone.begin;
+      }
+      res->last_key = std::max(res->last_key, tombstone.end);
+    }
+    res->range_dels_ = std::make_shared<const FragmentedRangeTombstones>(
+        std::move(range_dels_));
+  }
   res->meta_block_offset = meta_offset;
-  res->bloom_filter = this->bloom_filter;
   res->bloom_offset = bloom_offset;
-  res->meta_entries = std::move(meta_entries);
+  res->bloom_size_ = bloom_size;
   res->block_cache = block_cache;
   res->max_tranc_id_ = max_tranc_id_;
   res->min_tranc_id_ = min_tranc_id_;
+  res->format_version_ = kSstFormatVersion;
+  res->format_flags_ = flags;
+  res->prefix_extractor_name_ = std::move(prefix_extractor_name);
+  res->set_blob_files(blob_file_ids_, std::move(blob_store));
+  if (LSM_SST_USE_MMAP) {
+    res->mmap_file = res->file.map_file();
+  }
+  res->init_meta(std::make_shared<BlockIndex>(meta_entries),
+                 std::move(bloom_filter), pin_meta);
 
   return res;
 }
@@ -1,5 +1,6 @@
 #include "../../include/sst/sst_iterator.h"
 #include "../../include/sst/sst.h"
+#include <algorithm>
 #include <cstddef>
 #include <optional>
 #include <stdexcept>
@@ -11,18 +12,29 @@
 std::optional<std::pair<SstIterator, SstIterator>> sst_iters_monotony_predicate(
     std::shared_ptr<SST> sst, uint64_t tranc_id,
     std::function<int(const std::string &)> predicate) {
+  if (!sst->visible_to(tranc_id)) {
+    return std::nullopt;
+  }
   std::optional<SstIterator> final_begin = std::nullopt;
   std::optional<SstIterator> final_end = std::nullopt;
-  for (int block_idx = 0; block_idx < sst->meta_entries.size(); block_idx++) {
-    auto block = sst->read_block(block_idx);
-
-    BlockMeta &meta_i = sst->meta_entries[block_idx];
-    if (predicate(meta_i.first_key) < 0 || predicate(meta_i.last_key) > 0) {
+  auto index = sst->get_index();
+  for (size_t block_idx = 0; block_idx < index->size(); block_idx++) {
+    // block 中的 key 都位于 [boundary(i), boundary(i + 1)] 之间
+    std::string lower(index->boundary(block_idx));
+    if (predicate(lower) < 0) {
+      // 之后的 block 都位于谓词范围的右侧
       break;
     }
+    std::string upper(index->boundary(block_idx + 1));
+    if (predicate(upper) > 0) {
+      // 整个 block 位于谓词范围的左侧, 不需要读取
+      continue;
+    }
+    auto block = sst->read_block(block_idx);
 
     auto result_i = block->get_monotony_predicate_iters(tranc_id, predicate);
-    if (result_i.has_value()) {
+    if (result_i.has_value() && !result_i->first->is_end()) {
+      // 分隔 key 不是 block 中真实的 key, block 可能整体位于谓词范围的左侧
       auto [i_begin, i_end] = result_i.value();
       if (!final_begin.has_value()) {
         auto tmp_it = SstIterator(sst, tranc_id);
@@ -33,21 +45,43 @@ std::optional<std::pair<SstIterator, SstIterator>> sst_iters_monotony_predicate(
       auto tmp_it = SstIterator(sst, tranc_id);
       tmp_it.set_block_idx(block_idx);
       tmp_it.set_block_it(i_end);
-      if (tmp_it.is_end() && tmp_it.m_block_idx == sst->num_blocks()) {
-        tmp_it.set_block_it(nullptr);
-      }
       final_end = tmp_it;
     }
   }
   if (!final_begin.has_value() || !final_end.has_value()) {
     return std::nullopt;
   }
+  if (final_end->m_block_it->is_end()) {
+    // 范围恰好在 block 末尾结束, 与 operator++ 保持一致,
+    // end 指向下一个 block 的开头, 或者最后一个 block 之后的 end
+    auto &end_it = final_end.value();
+    end_it.set_block_idx(end_it.m_block_idx + 1);
+    if (end_it.m_block_idx < sst->num_blocks()) {
+      end_it.set_block_it(std::make_shared<BlockIterator>(
+          sst->read_block(end_it.m_block_idx), 0, tranc_id));
+    } else {
+      end_it.set_block_it(nullptr);
+    }
+  }
   return std::make_pair(final_begin.value(), final_end.value());
 }
 
+std::optional<std::pair<SstIterator, SstIterator>>
+sst_iters_preffix(std::shared_ptr<SST> sst, uint64_t tranc_id,
+                  const std::string &preffix,
+                  const PrefixExtractor *extractor) {
+  if (!sst->preffix_may_match(preffix, extractor)) {
+    return std::nullopt;
+  }
+  return sst_iters_monotony_predicate(
+      sst, tranc_id, [preffix](const std::string &key) {
+        return -key.compare(0, preffix.size(), preffix);
+      });
+}
+
 SstIterator::SstIterator(std::shared_ptr<SST> sst, uint64_t tranc_id)
     : m_sst(sst), m_block_idx(0), m_block_it(nullptr), max_tranc_id_(tranc_id) {
-  if (m_sst) {
+  if (m_sst && m_sst->visible_to(tranc_id)) {
     seek_first();
   }
 }
@@ -55,14 +89,25 @@ SstIterator::SstIterator(std::shared_ptr<SST> sst, uint64_t tranc_id)
 SstIterator::SstIterator(std::shared_ptr<SST> sst, const std::string &key,
                          uint64_t tranc_id)
     : m_sst(sst), m_block_idx(0), m_block_it(nullptr), max_tranc_id_(tranc_id) {
-  if (m_sst) {
+  if (m_sst && m_sst->visible_to(tranc_id)) {
     seek(key);
   }
 }
 
+SstIterator::SstIterator(
+    std::shared_ptr<SST> sst, uint64_t tranc_id,
+    const std::function<int(const std::string &)> &predicate)
+    : m_sst(sst), m_block_idx(0), m_block_it(nullptr), max_tranc_id_(tranc_id) {
+  if (m_sst && m_sst->visible_to(tranc_id)) {
+    seek_monotony_predicate(predicate);
+  }
+}
+
 void SstIterator::set_block_idx(size_t idx) { m_block_idx = idx; }
 void SstIterator::set_block_it(std::shared_ptr<BlockIterator> it) {
   m_block_it = it;
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
 }
 
 void SstIterator::seek_first() {
@@ -71,7 +116,10 @@ void SstIterator::seek_first() {
     return;
   }
 
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
   m_block_idx = 0;
+  readahead_.on_block_read(*m_sst, m_block_idx);
   auto block = m_sst->read_block(m_block_idx);
   m_block_it = std::make_shared<BlockIterator>(block, 0, max_tranc_id_);
 }
@@ -81,6 +129,8 @@ void SstIterator::seek(const std::string &key) {
     m_block_it = nullptr;
     return;
   }
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
 
   try {
     m_block_idx = m_sst->find_block_idx(key);
@@ -91,6 +141,7 @@ void SstIterator::seek(const std::string &key) {
       m_block_idx = m_sst->num_blocks();
       return;
     }
+    readahead_.on_block_read(*m_sst, m_block_idx);
     auto block = m_sst->read_block(m_block_idx);
     if (!block) {
       m_block_it = nullptr;
@@ -109,29 +160,134 @@ void SstIterator::seek(const std::string &key) {
   }
 }
 
-std::string SstIterator::key() {
+void SstIterator::seek_lower_bound(const std::string &key) {
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
+  m_block_it = nullptr;
+  if (!m_sst) {
+    return;
+  }
+  // 之后的 block 中的 key 都不小于 key, 从 block 开头读取即可;
+  // 跳过全部记录都不可见的 block
+  m_block_idx = m_sst->lower_bound_block_idx(key);
+  for (bool first = true; m_block_idx < m_sst->num_blocks();
+       m_block_idx++, first = false) {
+    readahead_.on_block_read(*m_sst, m_block_idx);
+    auto block = m_sst->read_block(m_block_idx);
+    size_t idx = first ? block->lower_bound_idx(key) : 0;
+    auto block_it = std::make_shared<BlockIterator>(block, idx, max_tranc_id_);
+    if (!block_it->is_end()) {
+      m_block_it = block_it;
+      return;
+    }
+  }
+}
+
+void SstIterator::seek_for_prev(const std::string &key) {
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
+  m_block_it = nullptr;
+  if (!m_sst || m_sst->num_blocks() == 0) {
+    return;
+  }
+  // 不大于 key 的 key 只会位于 seek 到的 block 及其之前的 block 中
+  m_block_idx =
+      std::min(m_sst->lower_bound_block_idx(key), m_sst->num_blocks() - 1);
+  auto block_it = std::make_shared<BlockIterator>(
+      m_sst->read_block(m_block_idx), 0, max_tranc_id_);
+  block_it->seek_for_prev(key);
+  if (!block_it->is_end()) {
+    m_block_it = block_it;
+    return;
+  }
+  seek_prev_block();
+}
+
+void SstIterator::seek_prev_block() {
+  // 反向读取时不预读, 预读只针对向后的顺序读取
+  while (m_block_idx > 0) {
+    m_block_idx--;
+    auto block_it = std::make_shared<BlockIterator>(
+        m_sst->read_block(m_block_idx), 0, max_tranc_id_);
+    block_it->seek_to_last();
+    if (!block_it->is_end()) {
+      m_block_it = block_it;
+      return;
+    }
+  }
+  m_block_it = nullptr;
+}
+
+void SstIterator::seek_monotony_predicate(
+    const std::function<int(const std::string &)> &predicate) {
+  // 二分查找第一个上边界不位于谓词范围左侧的 block, 之前的 block 不需要读取
+  auto index = m_sst->get_index();
+  size_t left = 0;
+  size_t right = m_sst->num_blocks();
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (predicate(std::string(index->boundary(mid + 1))) > 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  // 跳过全部记录都不可见的 block
+  m_block_it = nullptr;
+  for (m_block_idx = left; m_block_idx < m_sst->num_blocks(); m_block_idx++) {
+    readahead_.on_block_read(*m_sst, m_block_idx);
+    auto block_it = std::make_shared<BlockIterator>(
+        m_sst->read_block(m_block_idx), 0, max_tranc_id_);
+    if (!block_it->is_end()) {
+      m_block_it = block_it;
+      break;
+    }
+  }
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
+  // 分隔 key 不是真实的 key, block 开头仍然可能有位于范围左侧的 key
+  std::string cur_key;
+  while (is_valid()) {
+    cur_key.assign(m_block_it->key());
+    if (predicate(cur_key) <= 0) {
+      break;
+    }
+    ++(*this);
+  }
+}
+
+std::string_view SstIterator::key() const {
   if (!m_block_it) {
     throw std::runtime_error("Iterator is invalid");
   }
-  return (*m_block_it)->first;
+  return m_block_it->key();
 }
 
-std::string SstIterator::value() {
+std::string_view SstIterator::value() const {
   if (!m_block_it) {
     throw std::runtime_error("Iterator is invalid");
   }
-  return (*m_block_it)->second;
+  if (m_block_it->is_blob_index()) {
+    if (!blob_value_.has_value()) {
+      blob_value_ = m_sst->read_blob(std::string(m_block_it->value()));
+    }
+    return *blob_value_;
+  }
+  return m_block_it->value();
 }
 
 BaseIterator &SstIterator::operator++() {
   if (!m_block_it) { // 添加空指针检查
     return *this;
   }
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
   ++(*m_block_it);
   if (m_block_it->is_end()) {
     m_block_idx++;
     if (m_block_idx < m_sst->num_blocks()) {
       // 读取下一个block
+      readahead_.on_block_read(*m_sst, m_block_idx);
       auto next_block = m_sst->read_block(m_block_idx);
       BlockIterator new_blk_it(next_block, 0, max_tranc_id_);
       (*m_block_it) = new_blk_it;
@@ -143,6 +299,19 @@ BaseIterator &SstIterator::operator++() {
   return *this;
 }
 
+BaseIterator &SstIterator::operator--() {
+  if (!m_block_it) {
+    return *this;
+  }
+  cached_value = std::nullopt;
+  blob_value_ = std::nullopt;
+  --(*m_block_it);
+  if (m_block_it->is_end()) {
+    seek_prev_block();
+  }
+  return *this;
+}
+
 bool SstIterator::operator==(const BaseIterator &other) const {
   if (other.get_type() != IteratorType::SstIterator) {
     return false;
@@ -171,12 +340,20 @@ SstIterator::value_type SstIterator::operator*() const {
   if (!m_block_it) {
     throw std::runtime_error("Iterator is invalid");
   }
-  return (**m_block_it);
+  // 只有读取 value 时才会访问 blob 文件
+  return std::make_pair(std::string(key()), std::string(value()));
 }
 
 IteratorType SstIterator::get_type() const { return IteratorType::SstIterator; }
 
 uint64_t SstIterator::get_tranc_id() const { return max_tranc_id_; }
+
+uint64_t SstIterator::get_entry_tranc_id() const {
+  if (!m_block_it) {
+    throw std::runtime_error("Iterator is invalid");
+  }
+  return m_sst->resolve_tranc_id(m_block_it->get_tranc_id());
+}
 bool SstIterator::is_end() const { return !m_block_it; }
 
 bool SstIterator::is_valid() const {
@@ -190,7 +367,7 @@ SstIterator::pointer SstIterator::operator->() const {
 
 void SstIterator::update_current() const {
   if (!cached_value && m_block_it && !m_block_it->is_end()) {
-    cached_value = *(*m_block_it);
+    cached_value = **this;
   }
 }
 
@@ -205,7 +382,8 @@ SstIterator::merge_sst_iterator(std::vector<SstIterator> iter_vec,
   for (auto &iter : iter_vec) {
     while (iter.is_valid() && !iter.is_end()) {
       it_begin.items.emplace(
-          iter.key(), iter.value(), -iter.m_sst->get_sst_id(), 0,
+          std::string(iter.key()), std::string(iter.value()),
+          -iter.m_sst->get_sst_id(), 0,
           tranc_id); // ! 此处的level暂时没有作用, 都作用于同一层的比较
       ++iter;
     }
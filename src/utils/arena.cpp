@@ -0,0 +1,60 @@
+#include "../../include/utils/arena.h"
+
+namespace {
+constexpr size_t kAlign = 8;
+
+size_t align_up(size_t bytes) { return (bytes + kAlign - 1) & ~(kAlign - 1); }
+} // namespace
+
+Arena::Arena(size_t block_size) : block_size_(align_up(block_size)) {}
+
+char *Arena::allocate(size_t bytes) {
+  bytes = align_up(bytes == 0 ? 1 : bytes);
+  if (bytes > block_size_ / 4) {
+    // 较大的分配单独使用一个 block, 避免浪费当前 block 的剩余空间
+    std::lock_guard<std::mutex> lock(mtx_);
+    return new_block(bytes)->data.get();
+  }
+
+  Block *block = cur_block_.load(std::memory_order_acquire);
+  if (block != nullptr) {
+    size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+    if (offset + bytes <= block->capacity) {
+      return block->data.get() + offset;
+    }
+  }
+  return allocate_fallback(block, bytes);
+}
+
+char *Arena::allocate_fallback(Block *full_block, size_t bytes) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  while (true) {
+    Block *block = cur_block_.load(std::memory_order_acquire);
+    if (block == full_block) {
+      // 还没有其他线程切换 block(或者还没有申请过 block), 由当前线程切换
+      block = new_block(block_size_);
+      cur_block_.store(block, std::memory_order_release);
+    }
+    size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+    if (offset + bytes <= block->capacity) {
+      return block->data.get() + offset;
+    }
+    // 新的 block 也在锁外被其他线程用完了, 继续切换
+    full_block = block;
+  }
+}
+
+Arena::Block *Arena::new_block(size_t capacity) {
+  // ! 调用者需要持有 mtx_
+  auto block = std::make_unique<Block>();
+  block->capacity = capacity;
+  block->data = std::make_unique<char[]>(capacity);
+  Block *res = block.get();
+  blocks_.push_back(std::move(block));
+  memory_usage_.fetch_add(capacity + sizeof(Block), std::memory_order_relaxed);
+  return res;
+}
+
+size_t Arena::memory_usage() const {
+  return memory_usage_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,131 @@
+#include "../../include/utils/blocked_bloom_filter.h"
+#include "../../include/utils/hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+constexpr size_t kLineBits = 512;
+constexpr size_t kHeaderSize = 8;
+} // namespace
+
+std::shared_ptr<BlockedBloomFilter>
+BlockedBloomFilter::build(const std::vector<uint64_t> &key_hashes,
+                          size_t bits_per_key) {
+  auto filter = std::make_shared<BlockedBloomFilter>();
+  bits_per_key = std::max<size_t>(bits_per_key, 1);
+  size_t num_lines = std::max<size_t>(
+      1, (key_hashes.size() * bits_per_key + kLineBits - 1) / kLineBits);
+  filter->lines_.assign(num_lines, CacheLine{});
+  // 同一个 cache line 内的探测位之间存在相关性, 探测次数比标准布隆过滤器略少
+  filter->num_probes_ = std::clamp(
+      static_cast<int>(std::lround(bits_per_key * 0.6)), 1, 12);
+
+  for (auto key_hash : key_hashes) {
+    uint64_t mask[8] = {0};
+    probe_mask(static_cast<uint32_t>(key_hash), filter->num_probes_, mask);
+    auto &line = filter->lines_[filter->line_idx(key_hash)];
+    for (int w = 0; w < 8; w++) {
+      line.words[w] |= mask[w];
+    }
+  }
+  return filter;
+}
+
+void BlockedBloomFilter::probe_mask(uint32_t h, int num_probes,
+                                    uint64_t mask[8]) {
+  for (int i = 0; i < num_probes; i++) {
+    // 高 9 位决定 cache line 内的位置, 之后乘以黄金分割常数得到下一个位置
+    uint32_t bit = h >> 23;
+    mask[bit >> 6] |= 1ULL << (bit & 63);
+    h *= 0x9e3779b9U;
+  }
+}
+
+size_t BlockedBloomFilter::line_idx(uint64_t key_hash) const {
+  // 用乘法代替取模, 将高 32 位映射到 [0, num_lines)
+  return static_cast<size_t>(((key_hash >> 32) * lines_.size()) >> 32);
+}
+
+bool BlockedBloomFilter::possibly_contains(const std::string &key) const {
+  return possibly_contains_hash(hash64(key));
+}
+
+bool BlockedBloomFilter::possibly_contains_prefix(
+    std::string_view preffix) const {
+  return possibly_contains_hash(prefix_hash(preffix));
+}
+
+bool BlockedBloomFilter::possibly_contains_hash(uint64_t key_hash) const {
+  uint64_t mask[8] = {0};
+  probe_mask(static_cast<uint32_t>(key_hash), num_probes_, mask);
+  const auto &line = lines_[line_idx(key_hash)];
+  // 不提前退出, 固定 8 次的与运算可以被编译器向量化
+  uint64_t missing = 0;
+  for (int w = 0; w < 8; w++) {
+    missing |= mask[w] & ~line.words[w];
+  }
+  return missing == 0;
+}
+
+void BlockedBloomFilter::possibly_contains_batch(
+    std::span<const std::string_view>, std::span<const uint64_t> key_hashes,
+    uint8_t *results) const {
+  // 每组先计算 cache line 并预取, 再逐个探测
+  constexpr size_t kGroup = 16;
+  size_t lines[kGroup];
+  for (size_t begin = 0; begin < key_hashes.size(); begin += kGroup) {
+    size_t n = std::min(kGroup, key_hashes.size() - begin);
+    for (size_t i = 0; i < n; i++) {
+      lines[i] = line_idx(key_hashes[begin + i]);
+      __builtin_prefetch(&lines_[lines[i]]);
+    }
+    for (size_t i = 0; i < n; i++) {
+      uint64_t mask[8] = {0};
+      probe_mask(static_cast<uint32_t>(key_hashes[begin + i]), num_probes_,
+                 mask);
+      const auto &line = lines_[lines[i]];
+      uint64_t missing = 0;
+      for (int w = 0; w < 8; w++) {
+        missing |= mask[w] & ~line.words[w];
+      }
+      results[begin + i] = missing == 0;
+    }
+  }
+}
+
+std::vector<uint8_t> BlockedBloomFilter::encode_filter() {
+  std::vector<uint8_t> data(kHeaderSize + lines_.size() * sizeof(CacheLine));
+  data[0] = static_cast<uint8_t>(FilterType::BlockedBloom);
+  data[1] = static_cast<uint8_t>(num_probes_);
+  uint32_t num_lines = lines_.size();
+  memcpy(data.data() + 4, &num_lines, sizeof(uint32_t));
+  memcpy(data.data() + kHeaderSize, lines_.data(),
+         lines_.size() * sizeof(CacheLine));
+  return data;
+}
+
+std::shared_ptr<BlockedBloomFilter>
+BlockedBloomFilter::decode(const uint8_t *data, size_t size) {
+  if (size < kHeaderSize ||
+      data[0] != static_cast<uint8_t>(FilterType::BlockedBloom)) {
+    throw std::runtime_error("Invalid blocked bloom filter");
+  }
+  uint32_t num_lines;
+  memcpy(&num_lines, data + 4, sizeof(uint32_t));
+  if (num_lines == 0 || size != kHeaderSize + num_lines * sizeof(CacheLine)) {
+    throw std::runtime_error("Invalid blocked bloom filter size");
+  }
+
+  auto filter = std::make_shared<BlockedBloomFilter>();
+  filter->num_probes_ = data[1];
+  filter->lines_.resize(num_lines);
+  memcpy(filter->lines_.data(), data + kHeaderSize,
+         num_lines * sizeof(CacheLine));
+  return filter;
+}
+
+size_t BlockedBloomFilter::num_lines() const { return lines_.size(); }
+
+int BlockedBloomFilter::num_probes() const { return num_probes_; }
@@ -114,6 +114,12 @@ std::vector<uint8_t> BloomFilter::encode() {
   return data;
 }
 
+std::vector<uint8_t> BloomFilter::encode_filter() {
+  auto data = encode();
+  data.insert(data.begin(), static_cast<uint8_t>(FilterType::Bloom));
+  return data;
+}
+
 // 从 std::vector<uint8_t> 解码布隆过滤器
 BloomFilter BloomFilter::decode(const std::vector<uint8_t> &data) {
   size_t index = 0;
@@ -0,0 +1,218 @@
+#include "../../include/utils/compression.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef LSM_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+// ************************ LZ4 ************************
+// LZ4 block 格式: 由若干个 sequence 组成, 每个 sequence 为
+// | token | literal_len... | literals | offset (16) | match_len... |
+// token 的高 4 位为 literal 长度, 低 4 位为 match 长度 - 4, 等于 15 时
+// 后面跟随若干个长度字节. 最后一个 sequence 只有 literals
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMfLimit = 12;    // 最后一个 match 至少在结尾 12 字节之前开始
+constexpr size_t kLastLiterals = 5; // 最后 5 个字节必须是 literals
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashLog = 14;
+
+uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(uint32_t));
+  return v;
+}
+
+uint32_t lz4_hash(uint32_t v) { return (v * 2654435761U) >> (32 - kHashLog); }
+
+void write_len(std::vector<uint8_t> &out, size_t len) {
+  while (len >= 255) {
+    out.push_back(255);
+    len -= 255;
+  }
+  out.push_back(static_cast<uint8_t>(len));
+}
+
+void emit_sequence(std::vector<uint8_t> &out, const uint8_t *literals,
+                   size_t literal_len, size_t offset, size_t match_len) {
+  uint8_t token = static_cast<uint8_t>(std::min<size_t>(literal_len, 15) << 4);
+  if (match_len > 0) {
+    token |= static_cast<uint8_t>(std::min<size_t>(match_len - kMinMatch, 15));
+  }
+  out.push_back(token);
+  if (literal_len >= 15) {
+    write_len(out, literal_len - 15);
+  }
+  out.insert(out.end(), literals, literals + literal_len);
+  if (match_len == 0) {
+    return; // 最后一个 sequence
+  }
+  out.push_back(static_cast<uint8_t>(offset & 0xff));
+  out.push_back(static_cast<uint8_t>(offset >> 8));
+  if (match_len - kMinMatch >= 15) {
+    write_len(out, match_len - kMinMatch - 15);
+  }
+}
+
+void lz4_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out) {
+  size_t anchor = 0;
+  if (size > kMfLimit) {
+    std::vector<int32_t> table(1 << kHashLog, -1);
+    size_t ip = 0;
+    while (ip + kMfLimit <= size) {
+      uint32_t seq = read32(src + ip);
+      uint32_t h = lz4_hash(seq);
+      int32_t ref = table[h];
+      table[h] = static_cast<int32_t>(ip);
+      if (ref < 0 || ip - static_cast<size_t>(ref) > kMaxOffset ||
+          read32(src + ref) != seq) {
+        ip++;
+        continue;
+      }
+      size_t match_len = kMinMatch;
+      while (ip + match_len < size - kLastLiterals &&
+             src[ref + match_len] == src[ip + match_len]) {
+        match_len++;
+      }
+      emit_sequence(out, src + anchor, ip - anchor, ip - ref, match_len);
+      ip += match_len;
+      anchor = ip;
+    }
+  }
+  emit_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+size_t read_len(const uint8_t *src, size_t size, size_t &ip) {
+  size_t len = 0;
+  uint8_t b;
+  do {
+    if (ip >= size) {
+      throw std::runtime_error("Corrupted lz4 block");
+    }
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+void lz4_decompress(const uint8_t *src, size_t size, size_t raw_size,
+                    std::vector<uint8_t> &out) {
+  out.reserve(raw_size);
+  size_t ip = 0;
+  while (ip < size) {
+    uint8_t token = src[ip++];
+    size_t literal_len = token >> 4;
+    if (literal_len == 15) {
+      literal_len += read_len(src, size, ip);
+    }
+    if (ip + literal_len > size || out.size() + literal_len > raw_size) {
+      throw std::runtime_error("Corrupted lz4 block");
+    }
+    out.insert(out.end(), src + ip, src + ip + literal_len);
+    ip += literal_len;
+    if (ip == size) {
+      break; // 最后一个 sequence
+    }
+
+    if (ip + 2 > size) {
+      throw std::runtime_error("Corrupted lz4 block");
+    }
+    size_t offset = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+    ip += 2;
+    size_t match_len = token & 0x0f;
+    if (match_len == 15) {
+      match_len += read_len(src, size, ip);
+    }
+    match_len += kMinMatch;
+    if (offset == 0 || offset > out.size() ||
+        out.size() + match_len > raw_size) {
+      throw std::runtime_error("Corrupted lz4 block");
+    }
+    // match 可能与正在写入的部分重叠, 需要逐字节复制
+    size_t match_pos = out.size() - offset;
+    for (size_t i = 0; i < match_len; i++) {
+      out.push_back(out[match_pos + i]);
+    }
+  }
+}
+} // namespace
+
+bool compression_supported(CompressionType type) {
+  switch (type) {
+  case CompressionType::None:
+  case CompressionType::LZ4:
+    return true;
+  case CompressionType::Zstd:
+#ifdef LSM_HAS_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+bool compress_block(CompressionType type, const uint8_t *data, size_t size,
+                    std::vector<uint8_t> &out) {
+  if (type == CompressionType::None || !compression_supported(type)) {
+    return false;
+  }
+  out.resize(sizeof(uint32_t));
+  uint32_t raw_size = size;
+  memcpy(out.data(), &raw_size, sizeof(uint32_t));
+
+  if (type == CompressionType::LZ4) {
+    lz4_compress(data, size, out);
+  } else {
+#ifdef LSM_HAS_ZSTD
+    size_t bound = ZSTD_compressBound(size);
+    out.resize(sizeof(uint32_t) + bound);
+    size_t res = ZSTD_compress(out.data() + sizeof(uint32_t), bound, data,
+                               size, ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(res)) {
+      return false;
+    }
+    out.resize(sizeof(uint32_t) + res);
+#endif
+  }
+  // 压缩率低于 12.5% 时不值得解压的开销
+  return out.size() < size - size / 8;
+}
+
+std::vector<uint8_t> decompress_block(CompressionType type,
+                                      const uint8_t *data, size_t size) {
+  if (size < sizeof(uint32_t)) {
+    throw std::runtime_error("Corrupted compressed block");
+  }
+  uint32_t raw_size;
+  memcpy(&raw_size, data, sizeof(uint32_t));
+  data += sizeof(uint32_t);
+  size -= sizeof(uint32_t);
+
+  std::vector<uint8_t> out;
+  switch (type) {
+  case CompressionType::LZ4:
+    lz4_decompress(data, size, raw_size, out);
+    break;
+  case CompressionType::Zstd: {
+#ifdef LSM_HAS_ZSTD
+    out.resize(raw_size);
+    size_t res = ZSTD_decompress(out.data(), raw_size, data, size);
+    if (ZSTD_isError(res)) {
+      throw std::runtime_error("Corrupted zstd block");
+    }
+    out.resize(res);
+    break;
+#else
+    throw std::runtime_error("Zstd is not supported in this build");
+#endif
+  }
+  default:
+    throw std::runtime_error("Unknown compression type");
+  }
+  if (out.size() != raw_size) {
+    throw std::runtime_error("Corrupted compressed block");
+  }
+  return out;
+}
@@ -0,0 +1,92 @@
+#include "../../include/utils/crc32c.h"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define LSM_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define LSM_CRC32C_ARM 1
+#endif
+
+namespace {
+constexpr uint32_t kPoly = 0x82f63b78; // 反转后的 Castagnoli 多项式
+
+constexpr std::array<uint32_t, 256> make_table() {
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? kPoly : 0);
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr auto kTable = make_table();
+
+uint32_t crc32c_sw(const uint8_t *p, size_t len, uint32_t crc) {
+  for (size_t i = 0; i < len; i++) {
+    crc = kTable[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(LSM_CRC32C_X86)
+__attribute__((target("sse4.2"))) uint32_t crc32c_hw(const uint8_t *p,
+                                                     size_t len, uint32_t crc) {
+  uint64_t crc64 = crc;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += sizeof(uint64_t);
+    len -= sizeof(uint64_t);
+  }
+  uint32_t crc32 = static_cast<uint32_t>(crc64);
+  while (len > 0) {
+    crc32 = _mm_crc32_u8(crc32, *p++);
+    len--;
+  }
+  return crc32;
+}
+
+bool detect_hardware() { return __builtin_cpu_supports("sse4.2"); }
+#elif defined(LSM_CRC32C_ARM)
+uint32_t crc32c_hw(const uint8_t *p, size_t len, uint32_t crc) {
+  while (len >= sizeof(uint64_t)) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc = __crc32cd(crc, v);
+    p += sizeof(uint64_t);
+    len -= sizeof(uint64_t);
+  }
+  while (len > 0) {
+    crc = __crc32cb(crc, *p++);
+    len--;
+  }
+  return crc;
+}
+
+bool detect_hardware() { return true; }
+#else
+uint32_t crc32c_hw(const uint8_t *p, size_t len, uint32_t crc) {
+  return crc32c_sw(p, len, crc);
+}
+
+bool detect_hardware() { return false; }
+#endif
+
+const bool kHardwareSupported = detect_hardware();
+} // namespace
+
+uint32_t crc32c(const void *data, size_t len, uint32_t init_crc) {
+  auto p = static_cast<const uint8_t *>(data);
+  uint32_t crc = ~init_crc;
+  crc = kHardwareSupported ? crc32c_hw(p, len, crc) : crc32c_sw(p, len, crc);
+  return ~crc;
+}
+
+bool crc32c_hardware_supported() { return kHardwareSupported; }
@@ -1,8 +1,10 @@
 #include "../../include/utils/files.h"
+#include <algorithm>
 #include <cstring>
+#include <filesystem>
 #include <stdexcept>
 
-FileObj::FileObj() : m_file(std::make_unique<StdFile>()) {}
+FileObj::FileObj() : m_file(std::make_unique<FileBackend>()) {}
 
 FileObj::~FileObj() = default;
 
@@ -26,6 +28,12 @@ size_t FileObj::size() const { return m_file->size(); }
 void FileObj::set_size(size_t size) { m_size = size; }
 
 void FileObj::del_file() { m_file->remove(); }
+
+void FileObj::rename(const std::string &new_path) {
+  if (!m_file->rename(new_path)) {
+    throw std::runtime_error("Failed to rename file to: " + new_path);
+  }
+}
 FileObj FileObj::create_and_write(const std::string &path,
                                   std::vector<uint8_t> buf) {
   FileObj file_obj;
@@ -39,6 +47,41 @@ FileObj FileObj::create_and_write(const std::string &path,
   return std::move(file_obj);
 }
 
+FileObj FileObj::create_and_write(const std::string &path,
+                                  std::vector<uint8_t> buf,
+                                  RateLimiter *rate_limiter,
+                                  IOPriority priority) {
+  if (rate_limiter == nullptr) {
+    return create_and_write(path, std::move(buf));
+  }
+  FileObj file_obj;
+  if (!file_obj.m_file->open(path, true)) {
+    throw std::runtime_error("Failed to create or write file: " + path);
+  }
+  // 按令牌补充的周期分段写入, 避免一次写入几十 MB 占满磁盘带宽
+  size_t chunk_size = rate_limiter->get_single_burst_bytes();
+  for (size_t offset = 0; offset < buf.size(); offset += chunk_size) {
+    size_t len = std::min(chunk_size, buf.size() - offset);
+    rate_limiter->request(len, priority);
+    if (!file_obj.m_file->write(offset, buf.data() + offset, len)) {
+      throw std::runtime_error("Failed to create or write file: " + path);
+    }
+  }
+
+  // 同步到磁盘
+  file_obj.m_file->sync();
+
+  return std::move(file_obj);
+}
+
+void FileObj::link_or_copy(const std::string &src, const std::string &dst) {
+  std::error_code ec;
+  std::filesystem::create_hard_link(src, dst, ec);
+  if (ec) {
+    std::filesystem::copy_file(src, dst);
+  }
+}
+
 FileObj FileObj::open(const std::string &path, bool create) {
   FileObj file_obj;
 
@@ -115,6 +158,8 @@ bool FileObj::write(size_t offset, std::vector<uint8_t> &buf) {
   return m_file->write(offset, buf.data(), buf.size());
 }
 
+bool FileObj::allocate(size_t size) { return m_file->allocate(size); }
+
 // 追加到文件
 bool FileObj::append(std::vector<uint8_t> &buf) {
   // 获取文件大小
@@ -132,3 +177,17 @@ bool FileObj::append(std::vector<uint8_t> &buf) {
 }
 
 bool FileObj::sync() { return m_file->sync(); }
+
+bool FileObj::prefetch(size_t offset, size_t length) {
+  return m_file->prefetch(offset, length);
+}
+
+int FileObj::native_fd() const { return m_file->native_fd(); }
+
+std::shared_ptr<MmapFile> FileObj::map_file() const {
+  auto mmap_file = std::make_shared<MmapFile>();
+  if (!mmap_file->open(m_file->path(), false) || mmap_file->size() == 0) {
+    return nullptr;
+  }
+  return mmap_file;
+}
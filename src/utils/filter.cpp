@@ -0,0 +1,41 @@
+#include "../../include/utils/filter.h"
+#include "../../include/utils/blocked_bloom_filter.h"
+#include "../../include/utils/bloom_filter.h"
+#include "../../include/utils/hash.h"
+#include "../../include/utils/xor_filter.h"
+#include <stdexcept>
+
+namespace {
+constexpr uint64_t kPrefixSeed = 0x70726566;
+} // namespace
+
+uint64_t Filter::prefix_hash(std::string_view preffix) {
+  return hash64(preffix, kPrefixSeed);
+}
+
+void Filter::possibly_contains_batch(std::span<const std::string_view> keys,
+                                     std::span<const uint64_t>,
+                                     uint8_t *results) const {
+  std::string key;
+  for (size_t i = 0; i < keys.size(); i++) {
+    key.assign(keys[i]);
+    results[i] = possibly_contains(key);
+  }
+}
+
+std::shared_ptr<Filter>
+Filter::decode_filter(const std::vector<uint8_t> &data) {
+  if (data.empty()) {
+    throw std::runtime_error("Empty filter data");
+  }
+  switch (static_cast<FilterType>(data[0])) {
+  case FilterType::Bloom:
+    return std::make_shared<BloomFilter>(BloomFilter::decode(
+        std::vector<uint8_t>(data.begin() + 1, data.end())));
+  case FilterType::BlockedBloom:
+    return BlockedBloomFilter::decode(data.data(), data.size());
+  case FilterType::Xor8:
+    return XorFilter::decode(data.data(), data.size());
+  }
+  throw std::runtime_error("Unknown filter type");
+}
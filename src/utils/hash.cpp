@@ -0,0 +1,81 @@
+#include "../../include/utils/hash.h"
+#include <cstring>
+
+namespace {
+constexpr uint64_t kSecret0 = 0x2d358dccaa6c78a5ULL;
+constexpr uint64_t kSecret1 = 0x8bb84b93962eacc9ULL;
+constexpr uint64_t kSecret2 = 0x4b33a62ed433d4a3ULL;
+constexpr uint64_t kSecret3 = 0x4d5a2da51de1aa47ULL;
+
+// 128 位乘法, 结果的高低 64 位分别写回 a 和 b
+inline void mum(uint64_t *a, uint64_t *b) {
+  __uint128_t r = *a;
+  r *= *b;
+  *a = static_cast<uint64_t>(r);
+  *b = static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+  mum(&a, &b);
+  return a ^ b;
+}
+
+inline uint64_t read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t read4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t read3(const uint8_t *p, size_t k) {
+  return (static_cast<uint64_t>(p[0]) << 16) |
+         (static_cast<uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+} // namespace
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed) {
+  auto p = static_cast<const uint8_t *>(data);
+  seed ^= mix(seed ^ kSecret0, kSecret1);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+      b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      // 每轮处理 48 字节, 三条相互独立的依赖链可以并行执行
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = mix(read8(p) ^ kSecret1, read8(p + 8) ^ seed);
+        see1 = mix(read8(p + 16) ^ kSecret2, read8(p + 24) ^ see1);
+        see2 = mix(read8(p + 32) ^ kSecret3, read8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = mix(read8(p) ^ kSecret1, read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = read8(p + i - 16);
+    b = read8(p + i - 8);
+  }
+  a ^= kSecret1;
+  b ^= seed;
+  mum(&a, &b);
+  return mix(a ^ kSecret0 ^ len, b ^ kSecret1);
+}
@@ -0,0 +1,171 @@
+#include "../../include/utils/io_batch.h"
+#include "../../include/consts.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef LSM_HAS_IO_URING
+#include <liburing.h>
+#endif
+
+IoBatch::~IoBatch() {
+#ifdef LSM_HAS_IO_URING
+  if (ring_ != nullptr) {
+    // 内核仍在写入在途请求的缓冲区, 释放之前需要等待它们完成
+    while (inflight_ > 0) {
+      io_uring_cqe *cqe;
+      if (io_uring_wait_cqe(ring_, &cqe) < 0) {
+        break;
+      }
+      io_uring_cqe_seen(ring_, cqe);
+      inflight_--;
+    }
+    io_uring_queue_exit(ring_);
+    delete ring_;
+  }
+#endif
+}
+
+size_t IoBatch::add(FileObj &file, size_t offset, size_t length) {
+  if (submitted_) {
+    throw std::runtime_error("IoBatch: add after submit");
+  }
+  if (offset + length > file.size()) {
+    throw std::out_of_range("Read beyond file size");
+  }
+  requests_.push_back(Request{&file, offset, length, {}});
+  return requests_.size() - 1;
+}
+
+void IoBatch::submit() {
+  if (submitted_) {
+    return;
+  }
+  submitted_ = true;
+
+#ifdef LSM_HAS_IO_URING
+  size_t ring_requests = 0;
+  for (auto &request : requests_) {
+    request.via_ring = request.file->native_fd() >= 0;
+    ring_requests += request.via_ring;
+  }
+  if (ring_requests > 0) {
+    ring_ = new io_uring;
+    unsigned entries = static_cast<unsigned>(
+        std::min<size_t>(ring_requests, LSM_IO_URING_QUEUE_DEPTH));
+    if (io_uring_queue_init(entries, ring_, 0) < 0) {
+      // 内核不支持或者被禁用, 全部退化为预读 + pread
+      delete ring_;
+      ring_ = nullptr;
+      for (auto &request : requests_) {
+        request.via_ring = false;
+      }
+    } else {
+      submit_ring_();
+    }
+  }
+#endif
+
+  for (auto &request : requests_) {
+    if (!request.via_ring) {
+      request.file->prefetch(request.offset, request.length);
+    }
+  }
+}
+
+size_t IoBatch::wait_any() {
+  if (!submitted_) {
+    submit();
+  }
+#ifdef LSM_HAS_IO_URING
+  if (inflight_ > 0) {
+    size_t idx = reap_ring_(false);
+    if (idx != SIZE_MAX) {
+      return idx;
+    }
+  }
+#endif
+  // io_uring 的请求还没有完成时, 先同步读取其他请求
+  while (next_sync_ < requests_.size() && requests_[next_sync_].via_ring) {
+    next_sync_++;
+  }
+  if (next_sync_ < requests_.size()) {
+    auto &request = requests_[next_sync_];
+    request.buf = request.file->read_to_slice(request.offset, request.length);
+    request.done = true;
+    return next_sync_++;
+  }
+#ifdef LSM_HAS_IO_URING
+  if (inflight_ > 0) {
+    return reap_ring_(true);
+  }
+#endif
+  return SIZE_MAX;
+}
+
+std::vector<uint8_t> &IoBatch::data(size_t request) {
+  if (request >= requests_.size() || !requests_[request].done) {
+    throw std::runtime_error("IoBatch: request is not completed");
+  }
+  return requests_[request].buf;
+}
+
+size_t IoBatch::size() const { return requests_.size(); }
+
+#ifdef LSM_HAS_IO_URING
+void IoBatch::submit_ring_() {
+  size_t queued = 0;
+  while (next_ring_ < requests_.size() &&
+         inflight_ + queued < LSM_IO_URING_QUEUE_DEPTH) {
+    auto &request = requests_[next_ring_];
+    if (!request.via_ring) {
+      next_ring_++;
+      continue;
+    }
+    io_uring_sqe *sqe = io_uring_get_sqe(ring_);
+    if (sqe == nullptr) {
+      break;
+    }
+    request.buf.resize(request.length);
+    io_uring_prep_read(sqe, request.file->native_fd(), request.buf.data(),
+                       static_cast<unsigned>(request.length), request.offset);
+    io_uring_sqe_set_data(sqe,
+                          reinterpret_cast<void *>(
+                              static_cast<uintptr_t>(next_ring_)));
+    next_ring_++;
+    queued++;
+  }
+  if (queued > 0) {
+    int ret = io_uring_submit(ring_);
+    if (ret < 0) {
+      throw std::runtime_error("IoBatch: io_uring submit failed");
+    }
+    inflight_ += queued;
+  }
+}
+
+size_t IoBatch::reap_ring_(bool wait) {
+  io_uring_cqe *cqe;
+  int ret = wait ? io_uring_wait_cqe(ring_, &cqe) : io_uring_peek_cqe(ring_, &cqe);
+  if (ret < 0) {
+    if (!wait) {
+      return SIZE_MAX;
+    }
+    throw std::runtime_error("IoBatch: io_uring wait failed");
+  }
+  size_t idx = static_cast<size_t>(
+      reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+  int res = cqe->res;
+  io_uring_cqe_seen(ring_, cqe);
+  inflight_--;
+
+  auto &request = requests_[idx];
+  if (res < 0 || static_cast<size_t>(res) != request.length) {
+    // 出错或者读取不完整 (例如被信号打断), 同步重新读取, 真正的错误会抛出异常
+    request.buf = request.file->read_to_slice(request.offset, request.length);
+  }
+  request.done = true;
+  submit_ring_();
+  return idx;
+}
+#endif
@@ -0,0 +1,59 @@
+#include "../../include/utils/key_prefix.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define LSM_KEY_PREFIX_X86 1
+#endif
+
+namespace {
+// 超过该数量时二分查找的比较次数更少, 不再线性扫描
+constexpr size_t kLinearScanMax = 64;
+
+size_t count_less_sw(const uint64_t *prefixes, size_t n, uint64_t target) {
+  // 没有分支的计数, 编译器可以自动向量化
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    count += prefixes[i] < target;
+  }
+  return count;
+}
+
+#if defined(LSM_KEY_PREFIX_X86)
+__attribute__((target("avx2"))) size_t
+count_less_avx2(const uint64_t *prefixes, size_t n, uint64_t target) {
+  // AVX2 只有有符号的 64 位比较, 两边同时翻转符号位后等价于无符号比较
+  const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i t =
+      _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(target)), sign);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(prefixes + i));
+    __m256i less = _mm256_cmpgt_epi64(t, _mm256_xor_si256(v, sign));
+    count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(less)));
+  }
+  return count + count_less_sw(prefixes + i, n - i, target);
+}
+
+bool detect_hardware() { return __builtin_cpu_supports("avx2"); }
+#else
+size_t count_less_avx2(const uint64_t *prefixes, size_t n, uint64_t target) {
+  return count_less_sw(prefixes, n, target);
+}
+
+bool detect_hardware() { return false; }
+#endif
+
+const bool kHardwareSupported = detect_hardware();
+} // namespace
+
+size_t key_prefix_lower_bound(const uint64_t *prefixes, size_t n,
+                              uint64_t target) {
+  if (n > kLinearScanMax) {
+    return std::lower_bound(prefixes, prefixes + n, target) - prefixes;
+  }
+  return kHardwareSupported ? count_less_avx2(prefixes, n, target)
+                            : count_less_sw(prefixes, n, target);
+}
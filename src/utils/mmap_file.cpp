@@ -1,4 +1,5 @@
 #include "../../include/utils/mmap_file.h"
+#include <algorithm>
 #include <cstdint>
 #include <errno.h>
 #include <stdexcept>
@@ -107,6 +108,25 @@ std::vector<uint8_t> MmapFile::read(size_t offset, size_t length) {
   return result;
 }
 
+const uint8_t *MmapFile::view(size_t offset, size_t length) const {
+  if (mapped_data_ == nullptr || offset + length > file_size_) {
+    throw std::out_of_range("Read beyond mapped file size");
+  }
+  return static_cast<const uint8_t *>(this->data()) + offset;
+}
+
+bool MmapFile::prefetch(size_t offset, size_t length) const {
+  if (mapped_data_ == nullptr || offset >= file_size_) {
+    return false;
+  }
+  length = std::min(length, file_size_ - offset);
+  // madvise 要求起始地址按页对齐
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t aligned = offset / page_size * page_size;
+  return madvise(static_cast<char *>(mapped_data_) + aligned,
+                 length + (offset - aligned), MADV_WILLNEED) == 0;
+}
+
 bool MmapFile::sync() {
   if (mapped_data_ != nullptr && mapped_data_ != MAP_FAILED) {
     return msync(mapped_data_, file_size_, MS_SYNC) == 0;
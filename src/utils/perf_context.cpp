@@ -0,0 +1,40 @@
+#include "../../include/utils/perf_context.h"
+#include <sstream>
+#include <utility>
+
+void PerfContext::reset() { *this = PerfContext{}; }
+
+std::string PerfContext::to_string() const {
+  const std::pair<const char *, uint64_t> metrics[] = {
+      {"get_nanos", get_nanos},
+      {"memtable_get_nanos", memtable_get_nanos},
+      {"memtable_lock_nanos", memtable_lock_nanos},
+      {"memtable_probes", memtable_probes},
+      {"get_from_l0_nanos", get_from_l0_nanos},
+      {"get_from_levels_nanos", get_from_levels_nanos},
+      {"sst_checked", sst_checked},
+      {"bloom_useful", bloom_useful},
+      {"bloom_positive", bloom_positive},
+      {"block_cache_hits", block_cache_hits},
+      {"block_cache_misses", block_cache_misses},
+      {"block_cache_lock_nanos", block_cache_lock_nanos},
+      {"blocks_read", blocks_read},
+      {"block_read_bytes", block_read_bytes},
+      {"block_read_nanos", block_read_nanos},
+      {"block_decode_bytes", block_decode_bytes},
+      {"block_decode_nanos", block_decode_nanos},
+  };
+  std::ostringstream oss;
+  bool first = true;
+  for (auto &[name, value] : metrics) {
+    if (value == 0) {
+      continue;
+    }
+    if (!first) {
+      oss << ", ";
+    }
+    oss << name << " = " << value;
+    first = false;
+  }
+  return oss.str();
+}
@@ -0,0 +1,128 @@
+#include "../../include/utils/posix_file.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool PosixFile::open(const std::string &filename, bool create) {
+  close();
+  filename_ = filename;
+
+  // 与 StdFile 保持一致: create 时清空已有的内容
+  int flags = O_RDWR | O_CLOEXEC;
+  if (create) {
+    flags |= O_CREAT | O_TRUNC;
+  }
+  fd_ = ::open(filename.c_str(), flags, 0644);
+  if (fd_ == -1) {
+    return false;
+  }
+
+  struct stat st;
+  if (::fstat(fd_, &st) == -1) {
+    close();
+    return false;
+  }
+  file_size_ = st.st_size;
+  return true;
+}
+
+bool PosixFile::create(const std::string &filename, std::vector<uint8_t> &buf) {
+  if (!this->open(filename, true)) {
+    throw std::runtime_error("Failed to open file for writing");
+  }
+  if (!buf.empty()) {
+    return write(0, buf.data(), buf.size());
+  }
+  return true;
+}
+
+void PosixFile::close() {
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+size_t PosixFile::size() { return file_size_.load(); }
+
+bool PosixFile::write(size_t offset, const void *data, size_t size) {
+  if (fd_ == -1) {
+    return false;
+  }
+  auto ptr = static_cast<const char *>(data);
+  size_t written = 0;
+  while (written < size) {
+    ssize_t n = ::pwrite(fd_, ptr + written, size - written, offset + written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += n;
+  }
+
+  // 只有写入超出原来的末尾时才更新文件大小
+  size_t end = offset + size;
+  size_t cur = file_size_.load();
+  while (end > cur && !file_size_.compare_exchange_weak(cur, end)) {
+  }
+  return true;
+}
+
+std::vector<uint8_t> PosixFile::read(size_t offset, size_t length) {
+  std::vector<uint8_t> buf(length);
+  size_t read_bytes = 0;
+  while (read_bytes < length) {
+    ssize_t n = ::pread(fd_, buf.data() + read_bytes, length - read_bytes,
+                        offset + read_bytes);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("Failed to read from file");
+    }
+    read_bytes += n;
+  }
+  return buf;
+}
+
+bool PosixFile::sync() {
+  if (fd_ == -1) {
+    return false;
+  }
+  return ::fdatasync(fd_) == 0;
+}
+
+bool PosixFile::prefetch(size_t offset, size_t length) {
+  if (fd_ == -1) {
+    return false;
+  }
+  return ::posix_fadvise(fd_, offset, length, POSIX_FADV_WILLNEED) == 0;
+}
+
+bool PosixFile::allocate(size_t size) {
+  if (fd_ == -1) {
+    return false;
+  }
+  if (::posix_fallocate(fd_, 0, size) != 0) {
+    return false;
+  }
+  size_t cur = file_size_.load();
+  while (size > cur && !file_size_.compare_exchange_weak(cur, size)) {
+  }
+  return true;
+}
+
+bool PosixFile::remove() { return std::remove(filename_.c_str()) == 0; }
+
+bool PosixFile::rename(const std::string &new_filename) {
+  if (::rename(filename_.c_str(), new_filename.c_str()) != 0) {
+    return false;
+  }
+  filename_ = new_filename;
+  return true;
+}
@@ -0,0 +1,45 @@
+#include "../../include/utils/prefix_extractor.h"
+#include "../../include/consts.h"
+
+// ************************ FixedPrefixExtractor ************************
+
+FixedPrefixExtractor::FixedPrefixExtractor(size_t len) : len_(len) {}
+
+std::string FixedPrefixExtractor::name() const {
+  return "fixed:" + std::to_string(len_);
+}
+
+bool FixedPrefixExtractor::in_domain(std::string_view key) const {
+  return key.size() >= len_;
+}
+
+std::string_view FixedPrefixExtractor::transform(std::string_view key) const {
+  return key.substr(0, len_);
+}
+
+// ************************ RedisPrefixExtractor ************************
+
+RedisPrefixExtractor::RedisPrefixExtractor()
+    : namespaces_{REDIS_FIELD_PREFIX, REDIS_SET_PREFIX,
+                  REDIS_SORTED_SET_PREFIX, REDIS_LIST_PREFIX} {}
+
+std::string RedisPrefixExtractor::name() const { return "redis"; }
+
+size_t RedisPrefixExtractor::prefix_len(std::string_view key) const {
+  for (auto &ns : namespaces_) {
+    if (key.substr(0, ns.size()) != ns) {
+      continue;
+    }
+    auto pos = key.find('_', ns.size());
+    return pos == std::string_view::npos ? 0 : pos + 1;
+  }
+  return 0;
+}
+
+bool RedisPrefixExtractor::in_domain(std::string_view key) const {
+  return prefix_len(key) > 0;
+}
+
+std::string_view RedisPrefixExtractor::transform(std::string_view key) const {
+  return key.substr(0, prefix_len(key));
+}
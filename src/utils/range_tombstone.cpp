@@ -0,0 +1,150 @@
+#include "../../include/utils/range_tombstone.h"
+#include "../../include/utils/coding.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(
+    std::vector<RangeTombstone> tombstones) {
+  // 空范围不会删除任何 key
+  std::erase_if(tombstones,
+                [](const RangeTombstone &t) { return t.begin >= t.end; });
+  std::sort(tombstones.begin(), tombstones.end(),
+            [](const RangeTombstone &a, const RangeTombstone &b) {
+              return a.begin < b.begin;
+            });
+  tombstones_ = std::move(tombstones);
+
+  // 全部端点将 key 空间切分为若干区间, 从左到右扫描,
+  // 维护覆盖当前区间的标记
+  std::vector<std::string_view> points;
+  points.reserve(tombstones_.size() * 2);
+  for (auto &t : tombstones_) {
+    points.push_back(t.begin);
+    points.push_back(t.end);
+  }
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+
+  std::vector<const RangeTombstone *> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    while (next < tombstones_.size() && tombstones_[next].begin <= points[i]) {
+      active.push_back(&tombstones_[next++]);
+    }
+    std::erase_if(active,
+                  [&](const RangeTombstone *t) { return t->end <= points[i]; });
+    if (active.empty()) {
+      continue;
+    }
+    std::vector<uint64_t> tranc_ids;
+    tranc_ids.reserve(active.size());
+    for (auto *t : active) {
+      tranc_ids.push_back(t->tranc_id);
+    }
+    std::sort(tranc_ids.begin(), tranc_ids.end(), std::greater<uint64_t>());
+    tranc_ids.erase(std::unique(tranc_ids.begin(), tranc_ids.end()),
+                    tranc_ids.end());
+    if (!fragments_.empty() && fragments_.back().end == points[i] &&
+        fragments_.back().tranc_ids == tranc_ids) {
+      // 与前一个片段相邻且被相同的标记覆盖, 直接合并
+      fragments_.back().end.assign(points[i + 1]);
+      continue;
+    }
+    fragments_.push_back(Fragment{std::string(points[i]),
+                                  std::string(points[i + 1]),
+                                  std::move(tranc_ids)});
+  }
+}
+
+bool FragmentedRangeTombstones::empty() const { return fragments_.empty(); }
+
+const std::vector<RangeTombstone> &
+FragmentedRangeTombstones::tombstones() const {
+  return tombstones_;
+}
+
+const std::vector<FragmentedRangeTombstones::Fragment> &
+FragmentedRangeTombstones::fragments() const {
+  return fragments_;
+}
+
+uint64_t FragmentedRangeTombstones::max_covering(std::string_view key,
+                                                 uint64_t max_tranc_id) const {
+  // 最后一个 begin <= key 的片段
+  auto it = std::upper_bound(
+      fragments_.begin(), fragments_.end(), key,
+      [](std::string_view k, const Fragment &f) { return k < f.begin; });
+  if (it == fragments_.begin()) {
+    return 0;
+  }
+  --it;
+  if (key >= it->end) {
+    return 0;
+  }
+  if (max_tranc_id == 0) {
+    return it->tranc_ids.front();
+  }
+  for (auto tranc_id : it->tranc_ids) {
+    if (tranc_id <= max_tranc_id) {
+      return tranc_id;
+    }
+  }
+  return 0;
+}
+
+void FragmentedRangeTombstones::encode(
+    const std::vector<RangeTombstone> &tombstones, std::vector<uint8_t> &dst) {
+  size_t len = varint_length(tombstones.size());
+  for (auto &t : tombstones) {
+    len += varint_length(t.begin.size()) + t.begin.size() +
+           varint_length(t.end.size()) + t.end.size() +
+           varint_length(t.tranc_id);
+  }
+  size_t pos = dst.size();
+  dst.resize(pos + len);
+  uint8_t *ptr = dst.data() + pos;
+  auto put_bytes = [&ptr](const std::string &bytes) {
+    ptr = encode_varint(ptr, bytes.size());
+    memcpy(ptr, bytes.data(), bytes.size());
+    ptr += bytes.size();
+  };
+  ptr = encode_varint(ptr, tombstones.size());
+  for (auto &t : tombstones) {
+    put_bytes(t.begin);
+    put_bytes(t.end);
+    ptr = encode_varint(ptr, t.tranc_id);
+  }
+}
+
+std::vector<RangeTombstone>
+FragmentedRangeTombstones::decode(const uint8_t *data, size_t size) {
+  const uint8_t *ptr = data;
+  const uint8_t *limit = data + size;
+  auto get_bytes = [&ptr, limit](std::string &dst) {
+    uint64_t len;
+    ptr = decode_varint(ptr, limit, &len);
+    if (ptr == nullptr || len > static_cast<uint64_t>(limit - ptr)) {
+      throw std::runtime_error("Invalid range tombstone block");
+    }
+    dst.assign(reinterpret_cast<const char *>(ptr), len);
+    ptr += len;
+  };
+
+  uint64_t num;
+  ptr = decode_varint(ptr, limit, &num);
+  if (ptr == nullptr || num > size) {
+    throw std::runtime_error("Invalid range tombstone block");
+  }
+  std::vector<RangeTombstone> tombstones(num);
+  for (auto &t : tombstones) {
+    get_bytes(t.begin);
+    get_bytes(t.end);
+    ptr = decode_varint(ptr, limit, &t.tranc_id);
+    if (ptr == nullptr) {
+      throw std::runtime_error("Invalid range tombstone block");
+    }
+  }
+  return tombstones;
+}
@@ -0,0 +1,149 @@
+#include "../../include/utils/rate_limiter.h"
+#include <algorithm>
+#include <stdexcept>
+
+RateLimiter::RateLimiter(int64_t bytes_per_second, bool auto_tuned,
+                         int64_t refill_period_us)
+    : auto_tuned_(auto_tuned), refill_period_us_(refill_period_us),
+      max_bytes_per_second_(bytes_per_second),
+      bytes_per_second_(bytes_per_second) {
+  if (bytes_per_second <= 0 || refill_period_us <= 0) {
+    throw std::runtime_error("Invalid rate limiter parameters");
+  }
+  if (auto_tuned_) {
+    // 没有积压时以最低速率开始
+    bytes_per_second_ = std::max<int64_t>(
+        1, bytes_per_second / LSM_RATE_LIMITER_AUTO_TUNE_RATIO);
+  }
+  available_bytes_ = refill_bytes_();
+  next_refill_ =
+      Clock::now() + std::chrono::microseconds(refill_period_us_);
+}
+
+void RateLimiter::request(size_t bytes, IOPriority priority) {
+  total_bytes_[static_cast<size_t>(priority)].fetch_add(
+      bytes, std::memory_order_relaxed);
+  while (bytes > 0) {
+    // 单次获取的令牌不超过一个周期的补充量, 否则永远无法满足
+    size_t chunk = std::min(bytes, get_single_burst_bytes());
+    request_chunk(chunk, priority);
+    bytes -= chunk;
+  }
+}
+
+void RateLimiter::request_chunk(size_t bytes, IOPriority priority) {
+  std::unique_lock<std::mutex> lock(mtx_);
+  auto now = Clock::now();
+  if (now >= next_refill_) {
+    refill_(now);
+  }
+  // 有请求在排队时不能插队, 即使剩余的令牌足够
+  if (queues_empty_() && available_bytes_ >= static_cast<int64_t>(bytes)) {
+    available_bytes_ -= bytes;
+    return;
+  }
+
+  Request req{bytes};
+  queues_[static_cast<size_t>(priority)].push_back(&req);
+  auto start = now;
+  while (!req.granted) {
+    now = Clock::now();
+    if (now >= next_refill_) {
+      // 由到期后第一个醒来的等待者负责补充
+      refill_(now);
+      continue;
+    }
+    cv_.wait_until(lock, next_refill_);
+  }
+  total_wait_micros_.fetch_add(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            start)
+          .count(),
+      std::memory_order_relaxed);
+}
+
+void RateLimiter::refill_(Clock::time_point now) {
+  // 空闲期间的令牌不累积, 避免积压之后出现突发的写入
+  int64_t refill = refill_bytes_();
+  available_bytes_ = std::min(available_bytes_ + refill, refill);
+  next_refill_ = now + std::chrono::microseconds(refill_period_us_);
+
+  bool granted = false;
+  for (auto &queue : queues_) {
+    // 令牌已满时总是满足队首的请求, 速率降低后之前拆分的请求可能超过
+    // 一个周期的补充量, 透支的部分由之后的补充抵扣
+    while (!queue.empty() &&
+           (static_cast<int64_t>(queue.front()->bytes) <= available_bytes_ ||
+            available_bytes_ >= refill)) {
+      available_bytes_ -= queue.front()->bytes;
+      queue.front()->granted = true;
+      queue.pop_front();
+      granted = true;
+    }
+    if (!queue.empty()) {
+      // 高优先级的请求仍在等待, 低优先级的请求不能使用剩余的令牌
+      break;
+    }
+  }
+  if (granted) {
+    cv_.notify_all();
+  }
+}
+
+int64_t RateLimiter::refill_bytes_() const {
+  return bytes_per_second_.load(std::memory_order_relaxed) *
+         refill_period_us_ / 1000000;
+}
+
+size_t RateLimiter::get_single_burst_bytes() const {
+  return static_cast<size_t>(std::max<int64_t>(1, refill_bytes_()));
+}
+
+bool RateLimiter::queues_empty_() const {
+  return std::all_of(queues_.begin(), queues_.end(),
+                     [](const auto &queue) { return queue.empty(); });
+}
+
+void RateLimiter::set_bytes_per_second(int64_t bytes_per_second) {
+  if (bytes_per_second <= 0) {
+    throw std::runtime_error("Invalid rate limiter parameters");
+  }
+  max_bytes_per_second_ = bytes_per_second;
+  if (!auto_tuned_) {
+    bytes_per_second_ = bytes_per_second;
+    return;
+  }
+  // 自动调节时保持当前速率与上限的比例不超过范围
+  bytes_per_second_ = std::clamp<int64_t>(
+      bytes_per_second_.load(),
+      std::max<int64_t>(1, bytes_per_second / LSM_RATE_LIMITER_AUTO_TUNE_RATIO),
+      bytes_per_second);
+}
+
+int64_t RateLimiter::get_bytes_per_second() const {
+  return max_bytes_per_second_.load();
+}
+
+int64_t RateLimiter::get_effective_bytes_per_second() const {
+  return bytes_per_second_.load();
+}
+
+void RateLimiter::update_compaction_debt(double debt) {
+  if (!auto_tuned_) {
+    return;
+  }
+  debt = std::clamp(debt, 0.0, 1.0);
+  int64_t max_rate = max_bytes_per_second_.load();
+  int64_t min_rate =
+      std::max<int64_t>(1, max_rate / LSM_RATE_LIMITER_AUTO_TUNE_RATIO);
+  bytes_per_second_ =
+      min_rate + static_cast<int64_t>((max_rate - min_rate) * debt);
+}
+
+uint64_t RateLimiter::get_total_bytes_through(IOPriority priority) const {
+  return total_bytes_[static_cast<size_t>(priority)].load();
+}
+
+uint64_t RateLimiter::get_total_wait_micros() const {
+  return total_wait_micros_.load();
+}
@@ -0,0 +1,245 @@
+#include "../../include/utils/statistics.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+// 线程第一次记录时分配的分片, 之后固定不变
+size_t local_shard_idx() {
+  static std::atomic<size_t> next_idx{0};
+  thread_local size_t idx =
+      next_idx.fetch_add(1, std::memory_order_relaxed) % LSM_STATS_SHARD_NUM;
+  return idx;
+}
+} // namespace
+
+// ************************ HistogramData ************************
+
+size_t HistogramData::bucket_index(uint64_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+  // value 的最高位为 msb, 其后的 kSubBucketBits 位决定所在的子区间
+  size_t msb = 63 - std::countl_zero(value);
+  size_t sub = (value >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+  return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t HistogramData::bucket_lower(size_t idx) {
+  if (idx < kSubBuckets) {
+    return idx;
+  }
+  size_t msb = idx / kSubBuckets + kSubBucketBits - 1;
+  uint64_t sub = idx % kSubBuckets;
+  return (kSubBuckets + sub) << (msb - kSubBucketBits);
+}
+
+uint64_t HistogramData::bucket_width(size_t idx) {
+  if (idx < kSubBuckets) {
+    return 1;
+  }
+  size_t msb = idx / kSubBuckets + kSubBucketBits - 1;
+  return 1ULL << (msb - kSubBucketBits);
+}
+
+void HistogramData::add(uint64_t value) {
+  min = count == 0 ? value : std::min(min, value);
+  max = std::max(max, value);
+  count++;
+  sum += value;
+  buckets[bucket_index(value)]++;
+}
+
+void HistogramData::merge(const HistogramData &other) {
+  if (other.count == 0) {
+    return;
+  }
+  min = count == 0 ? other.min : std::min(min, other.min);
+  max = std::max(max, other.max);
+  count += other.count;
+  sum += other.sum;
+  for (size_t idx = 0; idx < kNumBuckets; idx++) {
+    buckets[idx] += other.buckets[idx];
+  }
+}
+
+double HistogramData::mean() const {
+  return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+}
+
+double HistogramData::percentile(double p) const {
+  if (count == 0) {
+    return 0.0;
+  }
+  double rank = std::clamp(p, 0.0, 100.0) / 100.0 * count;
+  uint64_t seen = 0;
+  for (size_t idx = 0; idx < kNumBuckets; idx++) {
+    if (buckets[idx] == 0) {
+      continue;
+    }
+    if (seen + buckets[idx] >= rank) {
+      double lower = static_cast<double>(bucket_lower(idx));
+      double value = lower + (rank - seen) / buckets[idx] * bucket_width(idx);
+      return std::clamp(value, static_cast<double>(min),
+                        static_cast<double>(max));
+    }
+    seen += buckets[idx];
+  }
+  return static_cast<double>(max);
+}
+
+// ************************ Statistics ************************
+
+Statistics::Statistics() : shards_(new Shard[LSM_STATS_SHARD_NUM]) {}
+
+Statistics::Shard &Statistics::local_shard() {
+  return shards_[local_shard_idx()];
+}
+
+void Statistics::record_tick(Ticker ticker, uint64_t count) {
+  local_shard()
+      .tickers[static_cast<size_t>(ticker)]
+      .fetch_add(count, std::memory_order_relaxed);
+}
+
+void Statistics::record(HistogramType type, uint64_t value) {
+  auto &hist = local_shard().histograms[static_cast<size_t>(type)];
+  hist.buckets[HistogramData::bucket_index(value)].fetch_add(
+      1, std::memory_order_relaxed);
+  hist.sum.fetch_add(value, std::memory_order_relaxed);
+  // 分片中的最值很少变化, 先读取再比较, 避免多数情况下的写入
+  uint64_t cur = hist.min.load(std::memory_order_relaxed);
+  while (value < cur && !hist.min.compare_exchange_weak(
+                            cur, value, std::memory_order_relaxed)) {
+  }
+  cur = hist.max.load(std::memory_order_relaxed);
+  while (value > cur && !hist.max.compare_exchange_weak(
+                            cur, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t Statistics::get_ticker(Ticker ticker) const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < LSM_STATS_SHARD_NUM; i++) {
+    total += shards_[i].tickers[static_cast<size_t>(ticker)].load(
+        std::memory_order_relaxed);
+  }
+  return total;
+}
+
+HistogramData Statistics::get_histogram(HistogramType type) const {
+  HistogramData data;
+  data.min = UINT64_MAX;
+  for (size_t i = 0; i < LSM_STATS_SHARD_NUM; i++) {
+    auto &hist = shards_[i].histograms[static_cast<size_t>(type)];
+    for (size_t idx = 0; idx < HistogramData::kNumBuckets; idx++) {
+      uint64_t num = hist.buckets[idx].load(std::memory_order_relaxed);
+      data.buckets[idx] += num;
+      data.count += num;
+    }
+    data.sum += hist.sum.load(std::memory_order_relaxed);
+    data.min = std::min(data.min, hist.min.load(std::memory_order_relaxed));
+    data.max = std::max(data.max, hist.max.load(std::memory_order_relaxed));
+  }
+  if (data.count == 0) {
+    data.min = 0;
+  }
+  return data;
+}
+
+void Statistics::reset() {
+  for (size_t i = 0; i < LSM_STATS_SHARD_NUM; i++) {
+    auto &shard = shards_[i];
+    for (auto &ticker : shard.tickers) {
+      ticker.store(0, std::memory_order_relaxed);
+    }
+    for (auto &hist : shard.histograms) {
+      for (auto &bucket : hist.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      hist.sum.store(0, std::memory_order_relaxed);
+      hist.min.store(UINT64_MAX, std::memory_order_relaxed);
+      hist.max.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+const char *Statistics::ticker_name(Ticker ticker) {
+  switch (ticker) {
+  case Ticker::GetHitMemtable:
+    return "get_hit_memtable";
+  case Ticker::GetHitRowCache:
+    return "get_hit_row_cache";
+  case Ticker::GetHitL0:
+    return "get_hit_l0";
+  case Ticker::GetHitL1:
+    return "get_hit_l1";
+  case Ticker::GetHitL2AndUp:
+    return "get_hit_l2_and_up";
+  case Ticker::GetMiss:
+    return "get_miss";
+  case Ticker::BloomUseful:
+    return "bloom_useful";
+  case Ticker::BloomFullPositive:
+    return "bloom_full_positive";
+  case Ticker::BloomTruePositive:
+    return "bloom_true_positive";
+  case Ticker::StallCount:
+    return "stall_count";
+  case Ticker::StallMicros:
+    return "stall_micros";
+  case Ticker::FlushBytes:
+    return "flush_bytes";
+  case Ticker::CompactReadBytes:
+    return "compact_read_bytes";
+  case Ticker::CompactWriteBytes:
+    return "compact_write_bytes";
+  case Ticker::WalBytes:
+    return "wal_bytes";
+  default:
+    return "unknown";
+  }
+}
+
+const char *Statistics::histogram_name(HistogramType type) {
+  switch (type) {
+  case HistogramType::Get:
+    return "get_micros";
+  case HistogramType::MultiGet:
+    return "multiget_micros";
+  case HistogramType::Write:
+    return "write_micros";
+  case HistogramType::Commit:
+    return "commit_micros";
+  case HistogramType::Flush:
+    return "flush_micros";
+  case HistogramType::Compaction:
+    return "compaction_micros";
+  case HistogramType::WalSync:
+    return "wal_sync_micros";
+  case HistogramType::SstPerGet:
+    return "sst_per_get";
+  default:
+    return "unknown";
+  }
+}
+
+// ************************ StopWatch ************************
+
+StopWatch::StopWatch(Statistics *stats, HistogramType type)
+    : stats_(stats), type_(type) {
+  if (stats_ != nullptr) {
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+StopWatch::~StopWatch() {
+  if (stats_ != nullptr) {
+    stats_->record(type_, elapsed_micros());
+  }
+}
+
+uint64_t StopWatch::elapsed_micros() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start_)
+      .count();
+}
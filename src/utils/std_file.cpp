@@ -52,6 +52,8 @@ bool StdFile::write(size_t offset, const void *data, size_t size) {
   return true;
 }
 
+bool StdFile::prefetch(size_t, size_t) { return false; }
+
 bool StdFile::sync() {
   if (!file_.is_open()) {
     return false;
@@ -60,4 +62,25 @@ bool StdFile::sync() {
   return file_.good();
 }
 
-bool StdFile::remove() { return std::remove(filename_.c_str()) == 0; }
\ No newline at end of file
+bool StdFile::allocate(size_t size) {
+  size_t cur = this->size();
+  if (cur >= size) {
+    return true;
+  }
+  std::vector<char> zeros(size - cur, 0);
+  file_.seekp(cur, std::ios::beg);
+  file_.write(zeros.data(), zeros.size());
+  return file_.good();
+}
+
+bool StdFile::remove() { return std::remove(filename_.c_str()) == 0; }
+
+bool StdFile::rename(const std::string &new_filename) {
+  std::error_code ec;
+  std::filesystem::rename(filename_, new_filename, ec);
+  if (ec) {
+    return false;
+  }
+  filename_ = new_filename;
+  return true;
+}
\ No newline at end of file
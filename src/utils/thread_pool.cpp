@@ -0,0 +1,42 @@
+#include "../../include/utils/thread_pool.h"
+
+ThreadPool::ThreadPool(size_t thread_num) {
+  if (thread_num == 0) {
+    thread_num = 1;
+  }
+  for (size_t i = 0; i < thread_num; i++) {
+    workers_.emplace_back([this]() { worker_loop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+size_t ThreadPool::thread_num() const { return workers_.size(); }
+
+void ThreadPool::worker_loop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      // 停止后仍然需要把队列中剩余的任务执行完
+      if (stop_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
@@ -0,0 +1,190 @@
+#include "../../include/utils/xor_filter.h"
+#include "../../include/utils/hash.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+constexpr size_t kHeaderSize = 16;
+constexpr int kMaxBuildAttempts = 64;
+
+uint64_t rotl64(uint64_t n, unsigned c) { return (n << c) | (n >> (64 - c)); }
+
+// 将 32 位的值映射到 [0, n)
+uint32_t reduce(uint32_t hash, uint32_t n) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(hash) * n) >> 32);
+}
+
+uint64_t splitmix64(uint64_t &state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+} // namespace
+
+std::shared_ptr<XorFilter> XorFilter::build(std::vector<uint64_t> key_hashes) {
+  // 重复的哈希值会导致剥离失败
+  std::sort(key_hashes.begin(), key_hashes.end());
+  key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()),
+                   key_hashes.end());
+
+  auto filter = std::make_shared<XorFilter>();
+  size_t capacity = 32 + (key_hashes.size() * 123 + 99) / 100;
+  filter->block_length_ = capacity / 3;
+  filter->fingerprints_.assign(3 * filter->block_length_, 0);
+
+  uint64_t rng = 0x726f7865;
+  for (int attempt = 0; attempt < kMaxBuildAttempts; attempt++) {
+    filter->seed_ = splitmix64(rng);
+    if (filter->try_build(key_hashes)) {
+      return filter;
+    }
+  }
+  throw std::runtime_error("Failed to build xor filter");
+}
+
+bool XorFilter::try_build(const std::vector<uint64_t> &key_hashes) {
+  size_t capacity = fingerprints_.size();
+  // 每个位置上哈希值的个数和异或和, 个数为 1 时异或和就是唯一的哈希值
+  std::vector<uint32_t> counts(capacity, 0);
+  std::vector<uint64_t> xor_masks(capacity, 0);
+  for (auto key_hash : key_hashes) {
+    uint64_t h = mix(key_hash);
+    uint32_t pos[3];
+    positions(h, pos);
+    for (auto p : pos) {
+      counts[p]++;
+      xor_masks[p] ^= h;
+    }
+  }
+
+  // 不断剥离只有一个哈希值的位置
+  std::vector<uint32_t> queue;
+  for (uint32_t i = 0; i < capacity; i++) {
+    if (counts[i] == 1) {
+      queue.push_back(i);
+    }
+  }
+  std::vector<std::pair<uint64_t, uint32_t>> stack;
+  stack.reserve(key_hashes.size());
+  while (!queue.empty()) {
+    uint32_t idx = queue.back();
+    queue.pop_back();
+    if (counts[idx] != 1) {
+      continue;
+    }
+    uint64_t h = xor_masks[idx];
+    stack.emplace_back(h, idx);
+    uint32_t pos[3];
+    positions(h, pos);
+    for (auto p : pos) {
+      counts[p]--;
+      xor_masks[p] ^= h;
+      if (counts[p] == 1) {
+        queue.push_back(p);
+      }
+    }
+  }
+  if (stack.size() != key_hashes.size()) {
+    return false;
+  }
+
+  // 按剥离的逆序赋值, 保证每个 key 三个位置的异或等于其指纹
+  std::fill(fingerprints_.begin(), fingerprints_.end(), 0);
+  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+    auto [h, idx] = *it;
+    uint32_t pos[3];
+    positions(h, pos);
+    fingerprints_[idx] = 0;
+    fingerprints_[idx] = fingerprint(h) ^ fingerprints_[pos[0]] ^
+                         fingerprints_[pos[1]] ^ fingerprints_[pos[2]];
+  }
+  return true;
+}
+
+uint64_t XorFilter::mix(uint64_t key_hash) const {
+  uint64_t state = key_hash ^ seed_;
+  return splitmix64(state);
+}
+
+void XorFilter::positions(uint64_t h, uint32_t pos[3]) const {
+  pos[0] = reduce(static_cast<uint32_t>(h), block_length_);
+  pos[1] = reduce(static_cast<uint32_t>(rotl64(h, 21)), block_length_) +
+           block_length_;
+  pos[2] = reduce(static_cast<uint32_t>(rotl64(h, 42)), block_length_) +
+           2 * block_length_;
+}
+
+uint8_t XorFilter::fingerprint(uint64_t h) {
+  return static_cast<uint8_t>(h ^ (h >> 32));
+}
+
+bool XorFilter::possibly_contains(const std::string &key) const {
+  return possibly_contains_hash(hash64(key));
+}
+
+bool XorFilter::possibly_contains_prefix(std::string_view preffix) const {
+  return possibly_contains_hash(prefix_hash(preffix));
+}
+
+bool XorFilter::possibly_contains_hash(uint64_t key_hash) const {
+  uint64_t h = mix(key_hash);
+  uint32_t pos[3];
+  positions(h, pos);
+  return fingerprint(h) == (fingerprints_[pos[0]] ^ fingerprints_[pos[1]] ^
+                            fingerprints_[pos[2]]);
+}
+
+void XorFilter::possibly_contains_batch(std::span<const std::string_view>,
+                                        std::span<const uint64_t> key_hashes,
+                                        uint8_t *results) const {
+  // 每组先计算三个位置并预取, 再逐个比较指纹
+  constexpr size_t kGroup = 16;
+  uint64_t hashes[kGroup];
+  uint32_t pos[kGroup][3];
+  for (size_t begin = 0; begin < key_hashes.size(); begin += kGroup) {
+    size_t n = std::min(kGroup, key_hashes.size() - begin);
+    for (size_t i = 0; i < n; i++) {
+      hashes[i] = mix(key_hashes[begin + i]);
+      positions(hashes[i], pos[i]);
+      for (int j = 0; j < 3; j++) {
+        __builtin_prefetch(&fingerprints_[pos[i][j]]);
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      results[begin + i] =
+          fingerprint(hashes[i]) == (fingerprints_[pos[i][0]] ^
+                                     fingerprints_[pos[i][1]] ^
+                                     fingerprints_[pos[i][2]]);
+    }
+  }
+}
+
+std::vector<uint8_t> XorFilter::encode_filter() {
+  std::vector<uint8_t> data(kHeaderSize + fingerprints_.size(), 0);
+  data[0] = static_cast<uint8_t>(FilterType::Xor8);
+  memcpy(data.data() + 4, &block_length_, sizeof(uint32_t));
+  memcpy(data.data() + 8, &seed_, sizeof(uint64_t));
+  memcpy(data.data() + kHeaderSize, fingerprints_.data(),
+         fingerprints_.size());
+  return data;
+}
+
+std::shared_ptr<XorFilter> XorFilter::decode(const uint8_t *data,
+                                             size_t size) {
+  if (size < kHeaderSize || data[0] != static_cast<uint8_t>(FilterType::Xor8)) {
+    throw std::runtime_error("Invalid xor filter");
+  }
+  auto filter = std::make_shared<XorFilter>();
+  memcpy(&filter->block_length_, data + 4, sizeof(uint32_t));
+  memcpy(&filter->seed_, data + 8, sizeof(uint64_t));
+  if (filter->block_length_ == 0 ||
+      size != kHeaderSize + 3 * static_cast<size_t>(filter->block_length_)) {
+    throw std::runtime_error("Invalid xor filter size");
+  }
+  filter->fingerprints_.assign(data + kHeaderSize, data + size);
+  return filter;
+}
+
+size_t XorFilter::size_in_bytes() const { return fingerprints_.size(); }
@@ -1,163 +1,281 @@
 // src/wal/record.cpp
 
 #include "../../include/wal/record.h"
+#include "../../include/utils/coding.h"
+#include "../../include/utils/crc32c.h"
 #include <cstddef>
 #include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace {
+constexpr size_t kBatchHeaderSize = 3 * sizeof(uint32_t);
+// op 的最高位表示之后有 cf_id
+constexpr uint8_t kColumnFamilyFlag = 0x80;
+} // namespace
 
 Record Record::createRecord(uint64_t tranc_id) {
   Record record;
   record.operation_type_ = OperationType::CREATE;
   record.tranc_id_ = tranc_id;
-  record.record_len_ = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
   return record;
 }
 Record Record::commitRecord(uint64_t tranc_id) {
   Record record;
   record.operation_type_ = OperationType::COMMIT;
   record.tranc_id_ = tranc_id;
-  record.record_len_ = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
   return record;
 }
 Record Record::rollbackRecord(uint64_t tranc_id) {
   Record record;
   record.operation_type_ = OperationType::ROLLBACK;
   record.tranc_id_ = tranc_id;
-  record.record_len_ = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
   return record;
 }
-Record Record::putRecord(uint64_t tranc_id, const std::string &key,
-                         const std::string &value) {
+Record Record::putRecord(uint64_t tranc_id, std::string key,
+                         std::string value) {
   Record record;
   record.operation_type_ = OperationType::PUT;
   record.tranc_id_ = tranc_id;
-  record.key_ = key;
-  record.value_ = value;
-  record.record_len_ = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t) +
-                       sizeof(uint16_t) + key.size() + sizeof(uint16_t) +
-                       value.size();
+  record.key_ = std::move(key);
+  record.value_ = std::move(value);
   return record;
 }
-Record Record::deleteRecord(uint64_t tranc_id, const std::string &key) {
+Record Record::deleteRecord(uint64_t tranc_id, std::string key) {
   Record record;
   record.operation_type_ = OperationType::DELETE;
   record.tranc_id_ = tranc_id;
-  record.key_ = key;
-  record.record_len_ = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t) +
-                       sizeof(uint16_t) + key.size();
+  record.key_ = std::move(key);
   return record;
 }
 
-std::vector<uint8_t> Record::encode() const {
-  std::vector<uint8_t> record;
-
-  size_t key_offset = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
-  // 记录长度本身(16) + 事务id(64) +
-  // 操作类型(8), 固有的编码部分
-
-  record.resize(record_len_, 0);
+Record Record::deleteRangeRecord(uint64_t tranc_id, std::string begin,
+                                std::string end) {
+  Record record;
+  record.operation_type_ = OperationType::DELETE_RANGE;
+  record.tranc_id_ = tranc_id;
+  record.key_ = std::move(begin);
+  record.value_ = std::move(end);
+  return record;
+}
 
-  // 编码 record_len
-  std::memcpy(record.data(), &record_len_, sizeof(uint16_t));
+Record Record::mergeRecord(uint64_t tranc_id, std::string key,
+                           std::string operand) {
+  Record record;
+  record.operation_type_ = OperationType::MERGE;
+  record.tranc_id_ = tranc_id;
+  record.key_ = std::move(key);
+  record.value_ = std::move(operand);
+  return record;
+}
 
-  // 编码 tranc_id
-  std::memcpy(record.data() + sizeof(uint16_t), &tranc_id_, sizeof(uint64_t));
+bool Record::has_key() const {
+  return operation_type_ == OperationType::PUT ||
+         operation_type_ == OperationType::DELETE ||
+         operation_type_ == OperationType::DELETE_RANGE ||
+         operation_type_ == OperationType::MERGE;
+}
 
-  // 编码 operation_type
-  auto type_byte = static_cast<uint8_t>(operation_type_);
-  std::memcpy(record.data() + sizeof(uint16_t) + sizeof(uint64_t), &type_byte,
-              sizeof(uint8_t));
+bool Record::has_value() const {
+  return operation_type_ == OperationType::PUT ||
+         operation_type_ == OperationType::DELETE_RANGE ||
+         operation_type_ == OperationType::MERGE;
+}
 
-  if (this->operation_type_ == OperationType::PUT) {
-    uint16_t key_len = key_.size();
-    std::memcpy(record.data() + key_offset, &key_len, sizeof(uint16_t));
-    std::memcpy(record.data() + key_offset + sizeof(uint16_t), key_.data(),
-                key_.size());
+void Record::encode_batch(const std::vector<Record> &records,
+                          std::vector<uint8_t> &dst) {
+  // 先计算长度, 一次性分配空间
+  size_t payload_len = 0;
+  for (const auto &record : records) {
+    payload_len += varint_length(record.tranc_id_) + sizeof(uint8_t);
+    if (record.cf_id_ != 0) {
+      payload_len += varint_length(record.cf_id_);
+    }
+    if (record.has_key()) {
+      payload_len += varint_length(record.key_.size()) + record.key_.size();
+    }
+    if (record.has_value()) {
+      payload_len += varint_length(record.value_.size()) + record.value_.size();
+    }
+  }
+  if (payload_len > UINT32_MAX) {
+    throw std::runtime_error("WAL batch is too large");
+  }
 
-    size_t value_offset = key_offset + sizeof(uint16_t) + key_.size();
+  size_t batch_pos = dst.size();
+  dst.resize(batch_pos + kBatchHeaderSize + payload_len);
+  uint8_t *header = dst.data() + batch_pos;
+  uint32_t len32 = payload_len;
+  uint32_t count = records.size();
+  std::memcpy(header + sizeof(uint32_t), &len32, sizeof(uint32_t));
+  std::memcpy(header + 2 * sizeof(uint32_t), &count, sizeof(uint32_t));
 
-    uint16_t value_len = value_.size();
-    std::memcpy(record.data() + value_offset, &value_len, sizeof(uint16_t));
-    std::memcpy(record.data() + value_offset + sizeof(uint16_t), value_.data(),
-                value_.size());
-  } else if (this->operation_type_ == OperationType::DELETE) {
-    uint16_t key_len = key_.size();
-    std::memcpy(record.data() + key_offset, &key_len, sizeof(uint16_t));
-    std::memcpy(record.data() + key_offset + sizeof(uint16_t), key_.data(),
-                key_.size());
+  uint8_t *ptr = header + kBatchHeaderSize;
+  auto put_bytes = [&ptr](const std::string &bytes) {
+    ptr = encode_varint(ptr, bytes.size());
+    std::memcpy(ptr, bytes.data(), bytes.size());
+    ptr += bytes.size();
+  };
+  for (const auto &record : records) {
+    ptr = encode_varint(ptr, record.tranc_id_);
+    uint8_t op = static_cast<uint8_t>(record.operation_type_);
+    if (record.cf_id_ != 0) {
+      *ptr++ = op | kColumnFamilyFlag;
+      ptr = encode_varint(ptr, record.cf_id_);
+    } else {
+      *ptr++ = op;
+    }
+    if (record.has_key()) {
+      put_bytes(record.key_);
+    }
+    if (record.has_value()) {
+      put_bytes(record.value_);
+    }
   }
 
-  return record;
+  uint32_t crc = crc32c(header + sizeof(uint32_t),
+                        kBatchHeaderSize - sizeof(uint32_t) + payload_len);
+  std::memcpy(header, &crc, sizeof(uint32_t));
 }
 
-std::vector<Record> Record::decode(const std::vector<uint8_t> &data) {
-  if (data.size() < sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t)) {
-    return {};
+std::vector<Record> Record::decode_batches(const uint8_t *data, size_t size) {
+  std::vector<Record> records;
+  size_t pos = 0;
+  while (pos + kBatchHeaderSize <= size) {
+    uint32_t crc, payload_len, count;
+    std::memcpy(&crc, data + pos, sizeof(uint32_t));
+    std::memcpy(&payload_len, data + pos + sizeof(uint32_t), sizeof(uint32_t));
+    std::memcpy(&count, data + pos + 2 * sizeof(uint32_t), sizeof(uint32_t));
+    // count 为 0 说明到达了预先分配的空白区域
+    if (count == 0 || payload_len > size - pos - kBatchHeaderSize) {
+      break;
+    }
+    if (crc32c(data + pos + sizeof(uint32_t),
+               kBatchHeaderSize - sizeof(uint32_t) + payload_len) != crc) {
+      break;
+    }
+
+    // 校验通过后仍然无法解析的 batch 同样视为损坏, 不会只恢复其中一部分记录
+    auto batch = decode_batch_payload(data + pos + kBatchHeaderSize,
+                                      payload_len, count);
+    if (!batch.has_value()) {
+      break;
+    }
+    std::move(batch->begin(), batch->end(), std::back_inserter(records));
+    pos += kBatchHeaderSize + payload_len;
   }
+  return records;
+}
+
+std::vector<Record> Record::decode_legacy(const uint8_t *data, size_t size) {
+  constexpr size_t header_len =
+      sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
 
   std::vector<Record> records;
   size_t pos = 0;
-
-  while (pos < data.size()) {
-    // 读取 record_len
+  while (pos + header_len <= size) {
+    // 记录不完整时说明写入时发生了崩溃, 之后的数据都不可信
+    // record_len 为 0 说明到达了预先分配的空白区域
     uint16_t record_len;
-    std::memcpy(&record_len, data.data() + pos, sizeof(uint16_t));
-    pos += sizeof(uint16_t);
+    std::memcpy(&record_len, data + pos, sizeof(uint16_t));
+    if (record_len < header_len || pos + record_len > size) {
+      break;
+    }
+    const uint8_t *record_end = data + pos + record_len;
+    const uint8_t *ptr = data + pos + sizeof(uint16_t);
+
+    Record record;
+    std::memcpy(&record.tranc_id_, ptr, sizeof(uint64_t));
+    ptr += sizeof(uint64_t);
+    uint8_t op = *ptr++;
+    if (op > static_cast<uint8_t>(OperationType::DELETE)) {
+      break;
+    }
+    record.operation_type_ = static_cast<OperationType>(op);
 
-    // 检查数据长度是否足够
-    if (data.size() < record_len) {
-      throw std::runtime_error("Data length does not match record length");
+    // 读取 | len (16) | bytes |, 超出记录范围时返回 false
+    auto read_str = [&](std::string &dst) {
+      uint16_t len;
+      if (ptr + sizeof(uint16_t) > record_end) {
+        return false;
+      }
+      std::memcpy(&len, ptr, sizeof(uint16_t));
+      ptr += sizeof(uint16_t);
+      if (ptr + len > record_end) {
+        return false;
+      }
+      dst.assign(reinterpret_cast<const char *>(ptr), len);
+      ptr += len;
+      return true;
+    };
+    if (record.operation_type_ == OperationType::PUT) {
+      if (!read_str(record.key_) || !read_str(record.value_)) {
+        break;
+      }
+    } else if (record.operation_type_ == OperationType::DELETE) {
+      if (!read_str(record.key_)) {
+        break;
+      }
     }
 
-    // 读取 tranc_id
-    uint64_t tranc_id;
-    std::memcpy(&tranc_id, data.data() + pos, sizeof(uint64_t));
-    pos += sizeof(uint64_t);
+    records.push_back(std::move(record));
+    pos += record_len;
+  }
+  return records;
+}
 
-    // 读取 operation_type
-    uint8_t op_type = data[pos++];
-    OperationType operation_type = static_cast<OperationType>(op_type);
+std::optional<std::vector<Record>>
+Record::decode_batch_payload(const uint8_t *ptr, size_t payload_len,
+                             uint32_t count) {
+  const uint8_t *limit = ptr + payload_len;
+  auto get_bytes = [&ptr, limit](std::string &dst) {
+    uint64_t len;
+    ptr = decode_varint(ptr, limit, &len);
+    if (ptr == nullptr || len > static_cast<uint64_t>(limit - ptr)) {
+      return false;
+    }
+    dst.assign(reinterpret_cast<const char *>(ptr), len);
+    ptr += len;
+    return true;
+  };
 
+  std::vector<Record> records;
+  records.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
     Record record;
-    record.tranc_id_ = tranc_id;
-    record.operation_type_ = operation_type;
-    record.record_len_ = record_len;
-
-    if (operation_type == OperationType::PUT) {
-      // 读取 key_len
-      uint16_t key_len;
-      std::memcpy(&key_len, data.data() + pos, sizeof(uint16_t));
-      pos += sizeof(uint16_t);
-
-      // 读取 key
-      record.key_ = std::string(
-          reinterpret_cast<const char *>(data.data() + pos), key_len);
-      pos += key_len;
-
-      // 读取 value_len
-      uint16_t value_len;
-      std::memcpy(&value_len, data.data() + pos, sizeof(uint16_t));
-      pos += sizeof(uint16_t);
-
-      // 读取 value
-      record.value_ = std::string(
-          reinterpret_cast<const char *>(data.data() + pos), value_len);
-      pos += value_len;
-    } else if (operation_type == OperationType::DELETE) {
-      // 读取 key_len
-      uint16_t key_len;
-      std::memcpy(&key_len, data.data() + pos, sizeof(uint16_t));
-      pos += sizeof(uint16_t);
-
-      // 读取 key
-      record.key_ = std::string(
-          reinterpret_cast<const char *>(data.data() + pos), key_len);
-      pos += key_len;
-    }
-
-    records.push_back(record);
+    ptr = decode_varint(ptr, limit, &record.tranc_id_);
+    if (ptr == nullptr || ptr >= limit) {
+      return std::nullopt;
+    }
+    uint8_t op = *ptr++;
+    record.operation_type_ =
+        static_cast<OperationType>(op & ~kColumnFamilyFlag);
+    if (op & kColumnFamilyFlag) {
+      uint64_t cf_id;
+      ptr = decode_varint(ptr, limit, &cf_id);
+      if (ptr == nullptr || cf_id > UINT32_MAX) {
+        return std::nullopt;
+      }
+      record.cf_id_ = static_cast<uint32_t>(cf_id);
+    }
+    if (record.has_key()) {
+      if (!get_bytes(record.key_)) {
+        return std::nullopt;
+      }
+    }
+    if (record.has_value()) {
+      if (!get_bytes(record.value_)) {
+        return std::nullopt;
+      }
+    }
+    records.push_back(std::move(record));
+  }
+  if (ptr != limit) {
+    return std::nullopt;
   }
   return records;
 }
+
 void Record::print() const {
   std::cout << "Record: tranc_id=" << tranc_id_
             << ", operation_type=" << static_cast<int>(operation_type_)
@@ -166,7 +284,7 @@ void Record::print() const {
 
 bool Record::operator==(const Record &other) const {
   if (tranc_id_ != other.tranc_id_ ||
-      operation_type_ != other.operation_type_) {
+      operation_type_ != other.operation_type_ || cf_id_ != other.cf_id_) {
     return false;
   }
 
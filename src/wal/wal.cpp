@@ -1,50 +1,98 @@
 // src/wal/wal.cpp
 
 #include "../../include/wal/wal.h"
+#include "../../include/utils/thread_pool.h"
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <random>
+#include <unordered_map>
 #include <iostream>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+namespace {
+// 等待复用的 WAL 文件, 不以 "wal." 开头, 恢复时不会被读取
+constexpr const char *kFreeWalPrefix = "wal_free.";
+} // namespace
+
 // 从零开始的初始化流程
 WAL::WAL(const std::string &log_dir, size_t buffer_size,
          uint64_t max_finished_tranc_id, uint64_t clean_interval,
-         uint64_t file_size_limit)
+         uint64_t file_size_limit, size_t recycle_num,
+         std::shared_ptr<Statistics> stats)
     : buffer_size_(buffer_size), max_finished_tranc_id_(max_finished_tranc_id),
       stop_cleaner_(false), clean_interval_(clean_interval),
-      file_size_limit_(file_size_limit) {
-  active_log_path_ = log_dir + "/wal.0";
-  log_file_ = FileObj::open(active_log_path_, true);
+      file_size_limit_(file_size_limit), log_dir_(log_dir),
+      recycle_num_(recycle_num), stats_(std::move(stats)) {
+  // 上次运行时留下的空闲文件已经清零, 可以直接复用
+  if (std::filesystem::exists(log_dir_)) {
+    for (const auto &entry : std::filesystem::directory_iterator(log_dir_)) {
+      std::string filename = entry.path().filename().string();
+      if (!entry.is_regular_file() || !filename.starts_with(kFreeWalPrefix)) {
+        continue;
+      }
+      if (free_segments_.size() < recycle_num_) {
+        free_segments_.push_back(entry.path().string());
+      } else {
+        std::filesystem::remove(entry.path());
+      }
+    }
+  }
+  std::random_device rd;
+  epoch_ = (static_cast<uint64_t>(rd()) << 32 | rd()) | 1;
+  open_segment(0);
+  synced_offset_ = write_offset_;
 
+  writer_thread_ = std::thread(&WAL::writer, this);
   cleaner_thread_ = std::thread(&WAL::cleaner, this);
 }
 
 WAL::~WAL() {
   // 先将缓冲区所有内容强制刷入
-  log({}, true);
+  try {
+    log({}, true);
+  } catch (const std::exception &e) {
+    std::cerr << "WAL::~WAL: " << e.what() << std::endl;
+  }
   {
     std::lock_guard<std::mutex> lock(mutex_);
     stop_cleaner_ = true;
+    stop_writer_ = true;
   }
+  writer_cv_.notify_all();
 
+  if (writer_thread_.joinable()) {
+    writer_thread_.join();
+  }
   if (cleaner_thread_.joinable()) {
     cleaner_thread_.join();
   }
   log_file_.sync();
 }
 
-std::map<uint64_t, std::vector<Record>>
-WAL::recover(const std::string &log_dir, uint64_t max_flushed_tranc_id) {
-  std::map<uint64_t, std::vector<Record>> tranc_records{};
+double WalRecoveryStats::throughput_mb() const {
+  if (elapsed_sec <= 0) {
+    return 0;
+  }
+  return num_bytes / (1024.0 * 1024.0) / elapsed_sec;
+}
 
+std::vector<std::string> WAL::list_wal_paths(const std::string &log_dir) {
   // 引擎启动时判断
   if (!std::filesystem::exists(log_dir)) {
-    return tranc_records;
+    return {};
   }
 
   // 遍历log_dir下的所有文件
-  std::vector<std::string> wal_paths;
+  std::vector<std::pair<uint64_t, std::string>> wal_files;
   for (const auto &entry : std::filesystem::directory_iterator(log_dir)) {
     if (entry.is_regular_file()) {
       // 获取/符号后的文件名
@@ -52,43 +100,222 @@ WAL::recover(const std::string &log_dir, uint64_t max_flushed_tranc_id) {
       if (filename.substr(0, 4) != "wal.") {
         continue;
       }
-
-      wal_paths.push_back(entry.path().string());
+      uint64_t seq = std::stoull(filename.substr(4));
+      wal_files.emplace_back(seq, entry.path().string());
     }
   }
 
   // 按照seq升序排序
-  std::sort(wal_paths.begin(), wal_paths.end(),
-            [](const std::string &a, const std::string &b) {
-              auto a_seq_str = a.substr(a.find_last_of(".") + 1);
-              auto b_seq_str = b.substr(b.find_last_of(".") + 1);
-              return std::stoi(a_seq_str) < std::stoi(b_seq_str);
-            });
+  std::sort(wal_files.begin(), wal_files.end());
+  std::vector<std::string> wal_paths;
+  for (auto &[seq, path] : wal_files) {
+    wal_paths.push_back(std::move(path));
+  }
+  return wal_paths;
+}
+
+std::vector<Record> WAL::decode_wal_file(const std::string &wal_path,
+                                         uint64_t max_flushed_tranc_id) {
+  auto wal_file = FileObj::open(wal_path, false);
+  if (wal_file.size() == 0) {
+    return {};
+  }
+  // 优先直接在映射的内存上解码, 避免将整个文件复制一次
+  std::vector<Record> records;
+  auto mmap_file = wal_file.map_file();
+  if (mmap_file != nullptr) {
+    records = decode_segment(mmap_file->view(0, mmap_file->size()),
+                             mmap_file->size());
+  } else {
+    auto bytes = wal_file.read_to_slice(0, wal_file.size());
+    records = decode_segment(bytes.data(), bytes.size());
+  }
+  // 如果记录的 tranc_id 大于 max_flushed_tranc_id, 才需要尝试恢复
+  std::erase_if(records, [max_flushed_tranc_id](const Record &record) {
+    return record.getTrancId() <= max_flushed_tranc_id;
+  });
+  return records;
+}
+
+std::vector<Record> WAL::decode_segment(const uint8_t *data, size_t size) {
+  if (size >= kSegmentHeaderSize &&
+      std::memcmp(data, kSegmentMagic, kSegmentHeaderSize) == 0) {
+    return Record::decode_batches(data + kSegmentHeaderSize,
+                                  size - kSegmentHeaderSize);
+  }
+  // 升级前留下的文件中可能还有没有刷盘的已提交事务, 不能丢弃
+  return Record::decode_legacy(data, size);
+}
+
+std::map<uint64_t, std::vector<Record>>
+WAL::recover(const std::string &log_dir, uint64_t max_flushed_tranc_id) {
+  std::map<uint64_t, std::vector<Record>> tranc_records{};
 
   // 读取所有的记录
-  for (const auto &wal_path : wal_paths) {
-    auto wal_file = FileObj::open(wal_path, false);
-    auto wal_records_slice = wal_file.read_to_slice(0, wal_file.size());
-    auto records = Record::decode(wal_records_slice);
-    for (const auto &record : records) {
-      if (record.getTrancId() > max_flushed_tranc_id) {
-        // 如果记录的 tranc_id 大于 max_finished_tranc_id, 才需要尝试恢复
-        tranc_records[record.getTrancId()].push_back(record);
-      }
+  for (const auto &wal_path : list_wal_paths(log_dir)) {
+    for (auto &record : decode_wal_file(wal_path, max_flushed_tranc_id)) {
+      tranc_records[record.getTrancId()].push_back(std::move(record));
     }
   }
 
   return tranc_records;
 }
 
+WalRecoveryStats WAL::recover_streaming(
+    const std::string &log_dir, uint64_t max_flushed_tranc_id,
+    size_t thread_num, size_t batch_size,
+    const std::function<void(std::vector<Record> &)> &apply) {
+  auto start = std::chrono::steady_clock::now();
+  WalRecoveryStats stats;
+  auto wal_paths = list_wal_paths(log_dir);
+  stats.num_files = wal_paths.size();
+  for (auto &wal_path : wal_paths) {
+    stats.num_bytes += std::filesystem::file_size(wal_path);
+  }
+
+  // 1. 预先提交 thread_num 个文件的解码任务, 每消费一个文件再提交下一个
+  ThreadPool decode_pool(std::max<size_t>(thread_num, 1));
+  std::deque<std::future<std::vector<Record>>> decoding;
+  size_t next_file = 0;
+  auto submit_next = [&]() {
+    if (next_file < wal_paths.size()) {
+      auto wal_path = wal_paths[next_file++];
+      decoding.push_back(decode_pool.submit([wal_path, max_flushed_tranc_id]() {
+        return decode_wal_file(wal_path, max_flushed_tranc_id);
+      }));
+    }
+  };
+  for (size_t i = 0; i < std::max<size_t>(thread_num, 1); i++) {
+    submit_next();
+  }
+
+  // 2. 按文件顺序组装事务, 提交的事务进入当前批次
+  // 一个事务的记录可能分布在相邻的两个文件中
+  std::unordered_map<uint64_t, std::vector<Record>> pending_trancs;
+  std::vector<Record> batch;
+  while (!decoding.empty()) {
+    auto records = decoding.front().get();
+    decoding.pop_front();
+    submit_next();
+
+    for (auto &record : records) {
+      uint64_t tranc_id = record.getTrancId();
+      switch (record.getOperationType()) {
+      case OperationType::ROLLBACK:
+        pending_trancs.erase(tranc_id);
+        break;
+      case OperationType::COMMIT: {
+        auto it = pending_trancs.find(tranc_id);
+        if (it != pending_trancs.end()) {
+          std::move(it->second.begin(), it->second.end(),
+                    std::back_inserter(batch));
+          pending_trancs.erase(it);
+        }
+        batch.push_back(std::move(record));
+        stats.num_trancs++;
+        if (batch.size() >= batch_size) {
+          stats.num_records += batch.size();
+          apply(batch);
+          batch.clear();
+        }
+        break;
+      }
+      default:
+        pending_trancs[tranc_id].push_back(std::move(record));
+        break;
+      }
+    }
+  }
+  if (!batch.empty()) {
+    stats.num_records += batch.size();
+    apply(batch);
+  }
+
+  stats.elapsed_sec = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  return stats;
+}
+
 // commit 时 强制写入
-void WAL::flush() { std::lock_guard<std::mutex> lock(mutex_); }
+void WAL::flush() { log({}, true); }
 
 void WAL::set_max_finished_tranc_id(uint64_t max_finished_tranc_id) {
   std::lock_guard<std::mutex> lock(mutex_);
   max_finished_tranc_id_ = max_finished_tranc_id;
 }
 
+void WAL::copy_to(const std::string &dir,
+                  const std::function<uint64_t()> &checkpoint) {
+  // 在 checkpoint 之后刷盘的记录仍然需要从 WAL 中恢复, 复制完成前不能清理
+  std::lock_guard<std::mutex> clean_lock(clean_mtx_);
+  uint64_t max_flushed_tranc_id = checkpoint();
+  std::vector<uint64_t> seqs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &[seq, meta] : sealed_segments_) {
+      if (meta.max_tranc_id > max_flushed_tranc_id) {
+        seqs.push_back(seq);
+      }
+    }
+    // 之后切换的文件中只有复制开始之后提交的记录, 不需要复制
+    seqs.push_back(active_seq_);
+  }
+  for (auto seq : seqs) {
+    std::filesystem::copy_file(get_segment_path(seq),
+                               dir + "/wal." + std::to_string(seq));
+  }
+}
+
+WalPosition WAL::end_position() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {epoch_, synced_seq_, synced_offset_};
+}
+
+WalPosition WAL::read_from(const WalPosition &from, size_t max_bytes,
+                           std::vector<Record> &records) {
+  // 读取期间不清理, 列出的文件不会被删除或者复用
+  std::lock_guard<std::mutex> clean_lock(clean_mtx_);
+  std::vector<std::pair<uint64_t, size_t>> segments; // {seq, 写入磁盘的大小}
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (from.epoch != epoch_ || from.seq > synced_seq_) {
+      throw std::runtime_error("WAL position is from another epoch");
+    }
+    // 写线程切换文件后, 更新 synced_seq_ 之前, 旧文件已经在 sealed_segments_ 中
+    for (auto it = sealed_segments_.lower_bound(from.seq);
+         it != sealed_segments_.end() && it->first < synced_seq_; ++it) {
+      segments.emplace_back(it->first, it->second.size);
+    }
+    segments.emplace_back(synced_seq_, synced_offset_);
+    // 清理不一定从最旧的文件开始, 中间缺少的文件同样无法继续读取
+    if (segments.size() != synced_seq_ - from.seq + 1 ||
+        from.offset > segments.front().second) {
+      throw std::runtime_error("WAL position is no longer available");
+    }
+  }
+
+  WalPosition next = from;
+  size_t num_bytes = 0;
+  for (auto [seq, size] : segments) {
+    size_t offset =
+        std::max(seq == from.seq ? from.offset : 0, kSegmentHeaderSize);
+    if (offset < size) {
+      auto file = FileObj::open(get_segment_path(seq), false);
+      auto data = file.read_to_slice(offset, size - offset);
+      for (auto &record : Record::decode_batches(data.data(), data.size())) {
+        records.push_back(std::move(record));
+      }
+      num_bytes += size - offset;
+    }
+    next = {epoch_, seq, size};
+    if (num_bytes >= max_bytes) {
+      break;
+    }
+  }
+  return next;
+}
+
 void WAL::log(const std::vector<Record> &records, bool force_flush) {
   std::unique_lock<std::mutex> lock(mutex_);
 
@@ -103,20 +330,85 @@ void WAL::log(const std::vector<Record> &records, bool force_flush) {
     return;
   }
 
-  // 否则写入 wal 文件
-  auto pre_buffer = std::move(log_buffer_);
-  for (const auto &record : pre_buffer) {
-    std::vector<uint8_t> encoded_record = record.encode();
-    log_file_.append(encoded_record);
+  // 否则交给写线程, 等待所在的组写入磁盘
+  uint64_t group = submit_buffer_();
+  writer_cv_.notify_one();
+  synced_cv_.wait(lock, [&] { return synced_group_ >= group || io_failed_; });
+  if (synced_group_ < group) {
+    throw std::runtime_error("Failed to sync WAL file");
   }
-  if (!log_file_.sync()) {
-    // 确保日志立即写入磁盘
+}
+
+uint64_t WAL::submit_buffer_() {
+  if (io_failed_) {
     throw std::runtime_error("Failed to sync WAL file");
   }
+  if (log_buffer_.empty() && pending_records_.empty()) {
+    // 没有新的记录, 只需要等待已经交给写线程的组完成
+    return filling_group_ - 1;
+  }
+  for (auto &record : log_buffer_) {
+    pending_records_.push_back(std::move(record));
+  }
+  log_buffer_.clear();
+  return filling_group_;
+}
+
+void WAL::writer() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    writer_cv_.wait(lock,
+                    [&] { return stop_writer_ || !pending_records_.empty(); });
+    if (pending_records_.empty()) {
+      // stop_writer_ 且所有记录都已经写入
+      break;
+    }
+
+    // 取出当前组的全部记录, 之后到达的记录属于下一个组
+    auto records = std::move(pending_records_);
+    pending_records_.clear();
+    uint64_t group = filling_group_++;
+    lock.unlock();
+
+    // 不持有锁的情况下编码和写入, 期间其他提交者可以继续加入下一个组
+    bool success = true;
+    try {
+      // 整个组编码为一个 batch, 复用同一块缓冲区
+      write_buf_.clear();
+      Record::encode_batch(records, write_buf_);
+      for (const auto &record : records) {
+        segment_max_tranc_id_ =
+            std::max(segment_max_tranc_id_, record.getTrancId());
+      }
+      // 在预先分配的空间中写入, 不需要更新文件大小等元数据
+      {
+        StopWatch watch(stats_.get(), HistogramType::WalSync);
+        success =
+            log_file_.write(write_offset_, write_buf_) && log_file_.sync();
+      }
+      if (stats_ != nullptr) {
+        stats_->record_tick(Ticker::WalBytes, write_buf_.size());
+      }
+      write_offset_ += write_buf_.size();
+      if (success && write_offset_ >= file_size_limit_) {
+        std::lock_guard<std::mutex> path_lock(mutex_);
+        reset_file();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "WAL::writer: " << e.what() << std::endl;
+      success = false;
+    }
 
-  auto cur_file_size = log_file_.size();
-  if (cur_file_size > file_size_limit_) {
-    reset_file();
+    lock.lock();
+    if (success) {
+      synced_group_ = group;
+      // 切换文件之后 write_offset_ 为新文件中第一个 batch 的位置
+      synced_seq_ = active_seq_;
+      synced_offset_ = write_offset_;
+    } else {
+      io_failed_ = true;
+    }
+    synced_cv_.notify_all();
   }
 }
 
@@ -134,83 +426,79 @@ void WAL::cleaner() {
 }
 
 void WAL::cleanWALFile() {
-  // 遍历log_file_所在的文件夹
-  std::string dir_path;
-
-  std::unique_lock<std::mutex> lock(mutex_); // 只在获取当前文件路径时获取锁
-  if (active_log_path_.find("/") != std::string::npos) {
-    dir_path =
-        active_log_path_.substr(0, active_log_path_.find_last_of("/")) + "/";
-  } else {
-    dir_path = "./";
-  }
-  lock.unlock();
-
-  // wal文件格式为:
-  // wal.seq
-
-  std::vector<std::pair<size_t, std::string>> wal_paths;
-
-  for (const auto &entry : std::filesystem::directory_iterator(dir_path)) {
-    if (entry.is_regular_file() &&
-        entry.path().filename().string().substr(0, 4) == "wal.") {
-      std::string filename = entry.path().filename().string();
-      size_t dot_pos = filename.find_last_of(".");
-      std::string seq_str = filename.substr(dot_pos + 1);
-      uint64_t seq = std::stoull(seq_str);
-      wal_paths.push_back({seq, entry.path().string()});
+  std::lock_guard<std::mutex> clean_lock(clean_mtx_);
+  // 1. 只根据内存中记录的每个文件的最大 tranc_id 判断, 不需要读取文件
+  // 已刷盘的最大 tranc_id 之前的记录都不再需要
+  std::vector<std::pair<uint64_t, SegmentMeta>> obsolete;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = sealed_segments_.begin(); it != sealed_segments_.end();) {
+      if (it->second.max_tranc_id <= max_finished_tranc_id_) {
+        obsolete.emplace_back(*it);
+        it = sealed_segments_.erase(it);
+      } else {
+        ++it;
+      }
     }
   }
 
-  // 按照seq升序排序
-  std::sort(wal_paths.begin(), wal_paths.end(),
-            [](const std::pair<size_t, std::string> &a,
-               const std::pair<size_t, std::string> &b) {
-              return a.first < b.first;
-            });
-
-  // 判断是否可以删除
-  std::vector<FileObj> del_paths;
-  for (int idx = 0; idx < wal_paths.size() - 1; idx++) {
-    auto cur_path = wal_paths[idx].second;
-    auto cur_file = FileObj::open(cur_path, false);
-    // 遍历文件记录, 读取所有的tranc_id,
-    // 判断是否都小于等于max_finished_tranc_id_
-    size_t offset = 0;
-    bool has_unfinished = false;
-    while (offset + sizeof(uint16_t) < cur_file.size()) {
-      uint16_t record_size = cur_file.read_uint16(offset);
-      uint64_t tranc_id = cur_file.read_uint64(offset + sizeof(uint16_t));
-      if (tranc_id > max_finished_tranc_id_) {
-        has_unfinished = true;
-        break;
-      }
+  // 2. 清零后放入空闲列表等待复用, 空闲文件足够时直接删除
+  for (auto &[seq, meta] : obsolete) {
+    auto path = get_segment_path(seq);
+    bool recycle;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      recycle = free_segments_.size() < recycle_num_;
     }
-    if (!has_unfinished) {
-      del_paths.push_back(std::move(cur_file));
+    if (!recycle) {
+      std::filesystem::remove(path);
+      continue;
     }
-  }
-
-  for (auto &del_file : del_paths) {
-    del_file.del_file();
+    // 复用的文件必须清零, 否则恢复时会读到上一轮的旧记录
+    auto file = FileObj::open(path, false);
+    std::vector<uint8_t> zeros(meta.size, 0);
+    auto free_path = log_dir_ + "/" + kFreeWalPrefix + std::to_string(seq);
+    if (!file.write(0, zeros) || !file.sync()) {
+      file.del_file();
+      continue;
+    }
+    file.rename(free_path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_segments_.push_back(free_path);
   }
 }
 
 void WAL::reset_file() {
   // wal文件格式为:
   // wal.seq
-  // 当当前wal文件容量超出阈值后, 创建新的文件, 将seq自增
-
-  auto old_path = active_log_path_;
-  // 字符串处理获取seq
-  auto seq = std::stoi(old_path.substr(old_path.find_last_of(".") + 1));
-  seq++;
+  // 当当前wal文件容量超出阈值后, 记录当前文件的元数据并切换到下一个文件
+  sealed_segments_[active_seq_] = {segment_max_tranc_id_, write_offset_};
+  open_segment(active_seq_ + 1);
+}
 
-  active_log_path_ = old_path.substr(0, old_path.find_last_of(".")) + "." +
-                     std::to_string(seq);
+void WAL::open_segment(uint64_t seq) {
+  active_seq_ = seq;
+  active_log_path_ = get_segment_path(seq);
+  segment_max_tranc_id_ = 0;
+  if (!free_segments_.empty()) {
+    // 复用空闲文件只需要一次重命名, 文件空间已经分配好了
+    auto free_path = free_segments_.back();
+    free_segments_.pop_back();
+    std::filesystem::rename(free_path, active_log_path_);
+    log_file_ = FileObj::open(active_log_path_, false);
+  } else {
+    log_file_ = FileObj::open(active_log_path_, true);
+    // 预先分配文件空间, 分配失败时只影响性能
+    log_file_.allocate(file_size_limit_);
+  }
+  // 标记和之后的第一个 batch 一起 sync, 崩溃时没有标记的文件中也没有记录
+  std::vector<uint8_t> magic(kSegmentMagic, kSegmentMagic + kSegmentHeaderSize);
+  if (!log_file_.write(0, magic)) {
+    throw std::runtime_error("Failed to write WAL header: " + active_log_path_);
+  }
+  write_offset_ = kSegmentHeaderSize;
+}
 
-  // 创建新的文件
-  // ? 如果不注释下面这行, debug 模式下 test_wal 能通过但 release 模式下报错
-  // log_file_.~FileObj();
-  log_file_ = FileObj::create_and_write(active_log_path_, {});
-}
\ No newline at end of file
+std::string WAL::get_segment_path(uint64_t seq) const {
+  return log_dir_ + "/wal." + std::to_string(seq);
+}
@@ -1,6 +1,7 @@
 #include "../include/block/block.h"
 #include "../include/block/block_iterator.h"
 #include "../include/consts.h"
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <iomanip>
 #include <memory>
@@ -86,6 +87,27 @@ TEST_F(BlockTest, DecodeTest) {
   EXPECT_EQ(block->get_value_binary("orange", 3).value(), "orange3");
 }
 
+// 测试零拷贝解码
+TEST_F(BlockTest, DecodeViewTest) {
+  auto encoded = std::make_shared<std::vector<uint8_t>>(getEncodedBlock());
+  auto block = Block::decode_view(encoded->data(), encoded->size(), encoded);
+  // block 持有 owner, 外部释放后数据仍然有效
+  std::weak_ptr<std::vector<uint8_t>> weak_encoded = encoded;
+  encoded.reset();
+  EXPECT_FALSE(weak_encoded.expired());
+
+  EXPECT_EQ(block->get_first_key(), "apple");
+  EXPECT_EQ(block->get_value_binary("banana", 0).value(), "yellow");
+  EXPECT_EQ(block->get_value_binary("orange", 2).value(), "orange2");
+  // 重新编码的结果与原始数据一致
+  EXPECT_EQ(block->encode(), *weak_encoded.lock());
+  // 视图模式的 block 是只读的
+  EXPECT_THROW(block->add_entry("pear", "green", 0, true), std::runtime_error);
+
+  block.reset();
+  EXPECT_TRUE(weak_encoded.expired());
+}
+
 // 测试编码
 TEST_F(BlockTest, EncodeTest) {
   Block block(1024);
@@ -408,6 +430,204 @@ TEST_F(BlockTest, TrancPredicateTest) {
   EXPECT_EQ(results, expected);
 }
 
+// 新写入的 block 按前缀压缩 key, 跨越多个 restart 点的查找和遍历结果不变
+TEST_F(BlockTest, PrefixCompressionTest) {
+  auto block = std::make_shared<Block>(32 * 1024);
+  size_t full_key_bytes = 0;
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; i++) {
+    char key_buf[64];
+    snprintf(key_buf, sizeof(key_buf), "REDIS_FIELD_user%04d$field", i / 4);
+    std::string key = std::string(key_buf) + std::to_string(i % 4);
+    keys.push_back(key);
+    // 每个 key 写入两个版本, 相同的 key 可能跨越 restart 点
+    block->add_entry(key, "new" + std::to_string(i), 2, false);
+    block->add_entry(key, "old" + std::to_string(i), 1, false);
+    full_key_bytes += 2 * key.size();
+  }
+  auto encoded = block->encode();
+  // 共享的前缀只保存一次, 完整的 key 需要的空间远大于编码后的整个 block
+  EXPECT_LT(encoded.size(), full_key_bytes);
+
+  for (auto &cur : {block, Block::decode(encoded)}) {
+    for (int i = 0; i < 200; i++) {
+      EXPECT_EQ(cur->get_value_binary(keys[i], 0).value(),
+                "new" + std::to_string(i));
+      EXPECT_EQ(cur->get_value_binary(keys[i], 1).value(),
+                "old" + std::to_string(i));
+    }
+    EXPECT_FALSE(cur->get_value_binary("REDIS_FIELD_user0000$field", 0));
+    EXPECT_FALSE(cur->get_value_binary("REDIS_FIELD_user9999$field0", 0));
+
+    // 遍历时每个 key 只返回最新的版本
+    int count = 0;
+    for (auto it = cur->begin(); it != cur->end(); ++it) {
+      EXPECT_EQ(it->first, keys[count]);
+      EXPECT_EQ(it->second, "new" + std::to_string(count));
+      count++;
+    }
+    EXPECT_EQ(count, 200);
+  }
+  // 解码后重新编码的结果不变
+  EXPECT_EQ(Block::decode(encoded)->encode(), encoded);
+}
+
+// 版本 3 的 entry 使用 varint 长度, 支持超过 64KB 的 value 和完整的 64 位事务 id
+TEST_F(BlockTest, VarintEncodingTest) {
+  auto block = std::make_shared<Block>(4096);
+  EXPECT_EQ(block->get_format(), Block::Format::Varint);
+  std::string large_value(100 * 1024, 'x');
+  uint64_t base = (1ULL << 40) + 7;
+  block->add_entry("big", large_value, base, false);
+  // 事务 id 可能小于第一个 entry 的事务 id
+  block->add_entry("key", "v3", base + 70000, true);
+  block->add_entry("key", "v2", base - 1, true);
+  block->add_entry("key", "v1", 1, true);
+  EXPECT_GT(block->cur_size(), large_value.size());
+
+  auto encoded = block->encode();
+  auto decoded = Block::decode(encoded);
+  EXPECT_EQ(decoded->get_format(), Block::Format::Varint);
+  EXPECT_EQ(decoded->encode(), encoded);
+  for (auto &cur : {block, decoded}) {
+    EXPECT_EQ(cur->get_value_binary("big", 0).value(), large_value);
+    EXPECT_FALSE(cur->get_value_binary("big", base - 1).has_value());
+    EXPECT_EQ(cur->get_value_binary("key", 0).value(), "v3");
+    EXPECT_EQ(cur->get_value_binary("key", base + 69999).value(), "v2");
+    EXPECT_EQ(cur->get_value_binary("key", base - 2).value(), "v1");
+    auto entry = cur->get_entry_at(cur->get_offset_at(1));
+    EXPECT_EQ(entry.tranc_id, base + 70000);
+  }
+
+  // 同一个 block 中相近的事务 id 只需要很少的字节
+  Block small(1024);
+  for (int i = 0; i < 10; i++) {
+    small.add_entry("key" + std::to_string(i), "v", base + i, false);
+  }
+  EXPECT_LT(small.encode().size(), 10 * (4 + 1 + sizeof(uint64_t)));
+
+  // 截断的 entry 无法解码
+  encoded.erase(encoded.begin() + 10, encoded.begin() + 20);
+  EXPECT_THROW(Block::decode(encoded), std::runtime_error);
+}
+
+// 哈希索引: 点查直接定位 restart 区间, 不存在的 key 大多在 bucket 上就被排除
+TEST_F(BlockTest, HashIndexTest) {
+  auto block = std::make_shared<Block>(32 * 1024);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 300; i++) {
+    char key_buf[32];
+    snprintf(key_buf, sizeof(key_buf), "key%05d", i * 2);
+    keys.push_back(key_buf);
+    // 多个版本的 key 可能跨越 restart 点
+    for (int v = 3; v > 0; v--) {
+      block->add_entry(keys.back(), "value" + std::to_string(i * 10 + v), v,
+                       false);
+    }
+  }
+  auto encoded = block->encode();
+  EXPECT_LE(encoded.size(), block->cur_size());
+  auto decoded = Block::decode(encoded);
+  EXPECT_EQ(decoded->has_hash_index(), LSM_BLOCK_HASH_INDEX);
+  EXPECT_EQ(decoded->encode(), encoded);
+
+  for (int i = 0; i < 300; i++) {
+    EXPECT_EQ(decoded->get_value_binary(keys[i], 0).value(),
+              "value" + std::to_string(i * 10 + 3));
+    EXPECT_EQ(decoded->get_value_binary(keys[i], 1).value(),
+              "value" + std::to_string(i * 10 + 1));
+    char key_buf[32];
+    snprintf(key_buf, sizeof(key_buf), "key%05d", i * 2 + 1);
+    EXPECT_FALSE(decoded->get_value_binary(key_buf, 0).has_value());
+  }
+  EXPECT_FALSE(decoded->get_value_binary("a", 0).has_value());
+  EXPECT_FALSE(decoded->get_value_binary("zzz", 0).has_value());
+
+  // 遍历不受哈希索引影响
+  int count = 0;
+  for (auto it = decoded->begin(); it != decoded->end(); ++it) {
+    EXPECT_EQ(it->first, keys[count++]);
+  }
+  EXPECT_EQ(count, 300);
+}
+
+// restart 点上的查找先比较公共前缀之后的定长前缀, 结果与直接比较 key 相同
+TEST_F(BlockTest, RestartPrefixSearchTest) {
+  auto block = std::make_shared<Block>(32 * 1024);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; i++) {
+    // 公共前缀之后的前 8 个字节大多相同, 只在最后几位不同
+    char key_buf[64];
+    snprintf(key_buf, sizeof(key_buf), "REDIS_FIELD_user$%03d", i / 20);
+    std::string key = key_buf + std::string(8, 'x');
+    key.push_back(static_cast<char>(0x80 + i % 20)); // 大于 0x7f 的字节
+    keys.push_back(key);
+    block->add_entry(key, "value" + std::to_string(i), 1, false);
+  }
+  auto decoded = Block::decode(block->encode());
+
+  std::vector<std::string> targets = {"", "A", "REDIS_FIELD_", "zzz",
+                                      "REDIS_FIELD_user$999"};
+  for (int i = 0; i < 200; i++) {
+    targets.push_back(keys[i]);
+    targets.push_back(keys[i] + '\0');
+    targets.push_back(keys[i].substr(0, keys[i].size() - 1));
+  }
+  for (auto &target : targets) {
+    size_t expected =
+        std::lower_bound(keys.begin(), keys.end(), target) - keys.begin();
+    EXPECT_EQ(decoded->lower_bound_idx(target), expected) << target;
+    EXPECT_EQ(block->lower_bound_idx(target), expected) << target;
+  }
+  for (int i = 0; i < 200; i++) {
+    EXPECT_EQ(decoded->get_value_binary(keys[i], 0).value(),
+              "value" + std::to_string(i));
+  }
+}
+
+// key() / value() 返回 block 内存上的视图, 与复制键值对的 operator* 结果一致
+TEST_F(BlockTest, IteratorViewTest) {
+  auto block = std::make_shared<Block>(32 * 1024);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; i++) {
+    char key_buf[32];
+    snprintf(key_buf, sizeof(key_buf), "user%04d", i);
+    keys.push_back(key_buf);
+    // 较新的版本只有一半的 key 可见, 遍历时需要跨过不可见的 entry
+    if (i % 2 == 0) {
+      block->add_entry(key_buf, "new" + std::to_string(i), 3, false);
+    }
+    block->add_entry(key_buf, "old" + std::to_string(i), 1, false);
+  }
+  auto decoded = Block::decode(block->encode());
+
+  for (auto &cur : {block, decoded}) {
+    for (uint64_t tranc_id : {0, 2}) {
+      int count = 0;
+      for (auto it = cur->begin(tranc_id); !it.is_end(); ++it) {
+        std::string expected_value =
+            (tranc_id == 0 && count % 2 == 0 ? "new" : "old") +
+            std::to_string(count);
+        EXPECT_EQ(it.key(), keys[count]);
+        EXPECT_EQ(it.value(), expected_value);
+        // 重复读取不会重新解码, 视图保持不变
+        EXPECT_EQ(it.value().data(), it.value().data());
+        EXPECT_EQ((*it).first, it.key());
+        EXPECT_EQ((*it).second, it.value());
+        count++;
+      }
+      EXPECT_EQ(count, 100);
+    }
+
+    // 从 restart 区间中间开始时先从 restart 点还原 key
+    BlockIterator it(cur, std::string("user0037"), 0);
+    EXPECT_EQ(it.key(), "user0037");
+    ++it;
+    EXPECT_EQ(it.key(), "user0038");
+    EXPECT_EQ(it.value(), "new38");
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -2,13 +2,16 @@
 #include "../include/block/block_cache.h"
 #include <gtest/gtest.h>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 class BlockCacheTest : public ::testing::Test {
 protected:
   void SetUp() override {
-    // 初始化缓存池，容量为3，K值为2
-    cache = std::make_unique<BlockCache>(3, 2);
+    // 初始化缓存池，容量为3个空 block，K值为2, 只使用一个分片
+    cache = std::make_unique<BlockCache>(3 * BlockCache::get_charge(Block()),
+                                         2, 0);
   }
 
   std::unique_ptr<BlockCache> cache;
@@ -92,6 +95,83 @@ TEST_F(BlockCacheTest, HitRate) {
   EXPECT_EQ(cache->hit_rate(), 2.0 / 3.0);
 }
 
+TEST_F(BlockCacheTest, ChargeByBytes) {
+  // 容量按字节计算, 一个较大的 block 会驱逐多个较小的 block
+  auto big_block = std::make_shared<Block>(1024);
+  big_block->add_entry("key", std::string(1000, 'v'), 0, true);
+  size_t capacity = BlockCache::get_charge(*big_block);
+  BlockCache byte_cache(capacity, 2, 0);
+
+  auto small1 = std::make_shared<Block>();
+  auto small2 = std::make_shared<Block>();
+  byte_cache.put(1, 1, small1);
+  byte_cache.put(1, 2, small2);
+  EXPECT_EQ(byte_cache.get_usage(), 2 * BlockCache::get_charge(Block()));
+
+  byte_cache.put(1, 3, big_block);
+  EXPECT_EQ(byte_cache.get(1, 1), nullptr);
+  EXPECT_EQ(byte_cache.get(1, 2), nullptr);
+  EXPECT_EQ(byte_cache.get(1, 3), big_block);
+  EXPECT_EQ(byte_cache.get_usage(), capacity);
+}
+
+TEST_F(BlockCacheTest, ShardedConcurrentAccess) {
+  const int num_blocks = 256;
+  BlockCache sharded(num_blocks * BlockCache::get_charge(Block()), 2, 4);
+  std::vector<std::shared_ptr<Block>> blocks;
+  for (int i = 0; i < num_blocks; i++) {
+    blocks.push_back(std::make_shared<Block>());
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 100; round++) {
+        for (int i = t; i < num_blocks; i += 8) {
+          if (sharded.get(i, round % 4) == nullptr) {
+            sharded.put(i, round % 4, blocks[i]);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // 总占用不超过各分片容量之和
+  EXPECT_LE(sharded.get_usage(),
+            (num_blocks + 16) * BlockCache::get_charge(Block()));
+  EXPECT_GT(sharded.hit_rate(), 0.0);
+}
+
+// share 得到的缓存共用容量, 但相同的 (sst_id, block_id) 互不影响
+TEST_F(BlockCacheTest, Share) {
+  auto other = cache->share();
+  auto block1 = std::make_shared<Block>();
+  auto block2 = std::make_shared<Block>();
+  auto block3 = std::make_shared<Block>();
+
+  cache->put(1, 1, block1);
+  other->put(1, 1, block2);
+  other->put(1, 2, block3);
+  EXPECT_EQ(cache->get_usage(), 3 * BlockCache::get_charge(Block()));
+  EXPECT_EQ(other->get_usage(), cache->get_usage());
+
+  // 总容量为 3 个 block, 另一方的写入会驱逐当前缓存中最旧的 block
+  other->put(1, 3, std::make_shared<Block>());
+  EXPECT_EQ(cache->get(1, 1), nullptr);
+  EXPECT_EQ(other->get(1, 1), block2);
+  EXPECT_EQ(other->get(1, 2), block3);
+
+  cache->put(1, 2, block1);
+  EXPECT_EQ(cache->get(1, 2), block1);
+  EXPECT_EQ(other->get(1, 2), block3);
+  // 命中率分别统计
+  EXPECT_DOUBLE_EQ(cache->hit_rate(), 0.5);
+  EXPECT_DOUBLE_EQ(other->hit_rate(), 1.0);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
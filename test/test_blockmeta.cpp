@@ -1,3 +1,4 @@
+#include "../include/block/block_index.h"
 #include "../include/block/blockmeta.h"
 #include <gtest/gtest.h>
 
@@ -163,6 +164,35 @@ TEST_F(BlockMetaTest, OrderTest) {
   }
 }
 
+// BlockIndex 在相邻 block 之间只保存最短的分隔 key
+TEST_F(BlockMetaTest, BlockIndexTest) {
+  EXPECT_EQ(BlockIndex::shortest_separator("a199", "a200"), "a2");
+  EXPECT_EQ(BlockIndex::shortest_separator("abc", "abcd"), "abcd");
+  EXPECT_EQ(BlockIndex::shortest_separator("abc", "abd"), "abd");
+  EXPECT_EQ(BlockIndex::shortest_separator("apple", "banana"), "b");
+
+  BlockIndex index(createTestMetas());
+  ASSERT_EQ(index.size(), 3);
+  EXPECT_EQ(index.boundary(0), "a100");
+  EXPECT_EQ(index.boundary(1), "a2");
+  EXPECT_EQ(index.boundary(2), "a3");
+  EXPECT_EQ(index.boundary(3), "a399");
+  EXPECT_EQ(index.block_offset(1), 100);
+
+  EXPECT_EQ(index.seek("a000"), 0);
+  EXPECT_EQ(index.seek("a150"), 0);
+  EXPECT_EQ(index.seek("a1999"), 0);
+  EXPECT_EQ(index.seek("a2"), 1);
+  EXPECT_EQ(index.seek("a299"), 1);
+  EXPECT_EQ(index.seek("a300"), 2);
+  EXPECT_EQ(index.seek("a399"), 2);
+  EXPECT_EQ(index.seek("a3990"), 3);
+
+  BlockIndex empty_index(std::vector<BlockMeta>{});
+  EXPECT_TRUE(empty_index.empty());
+  EXPECT_EQ(empty_index.seek("a"), 0);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
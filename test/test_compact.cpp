@@ -1,9 +1,16 @@
 #include "../include/consts.h"
+#include "../include/lsm/compact_iterator.h"
 #include "../include/lsm/engine.h"
+#include "../include/block/block_cache.h"
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <gtest/gtest.h>
+#include <iomanip>
 #include <iostream>
+#include <random>
+#include <set>
 
 class CompactTest : public ::testing::Test {
 protected:
@@ -23,6 +30,15 @@ protected:
     }
   }
 
+  // 当前 Version 中 level 层的 sst_id
+  static std::vector<size_t> level_sst_ids(LSMEngine &engine, size_t level) {
+    std::vector<size_t> sst_ids;
+    for (auto &sst : engine.current_version()->level_ssts(level)) {
+      sst_ids.push_back(sst->get_sst_id());
+    }
+    return sst_ids;
+  }
+
   std::string test_dir;
 };
 
@@ -75,6 +91,476 @@ TEST_F(CompactTest, Persistence) {
   EXPECT_FALSE(lsm.get("nonexistent").has_value());
 }
 
+TEST_F(CompactTest, LeveledCompact) {
+  LSMEngine engine(test_dir, CompactType::LeveledCompact);
+
+  auto put_range = [&](const std::string &preffix, int round) {
+    for (int flush_idx = 0; flush_idx < LSM_SST_LEVEL_RATIO; flush_idx++) {
+      for (int i = 0; i < 1000; i++) {
+        std::ostringstream oss_key;
+        oss_key << preffix << std::setw(4) << std::setfill('0') << i;
+        engine.put(oss_key.str(), "value" + std::to_string(round), round);
+      }
+      // 手动刷入 l0, 达到数量后会触发后台 compact
+      engine.flush();
+    }
+    engine.wait_for_bg_jobs();
+  };
+
+  // 第一轮: a 开头的 key, l0 全部合并到 l1
+  put_range("a", 1);
+  EXPECT_TRUE(level_sst_ids(engine, 0).empty());
+  ASSERT_FALSE(level_sst_ids(engine, 1).empty());
+  auto old_l1_ids = level_sst_ids(engine, 1);
+
+  // 第二轮: b 开头的 key 与 l1 的 sst 没有重叠, l1 原有的 sst 不应该被重写
+  put_range("b", 2);
+  EXPECT_TRUE(level_sst_ids(engine, 0).empty());
+  auto l1_ids = level_sst_ids(engine, 1);
+  for (auto id : old_l1_ids) {
+    EXPECT_NE(std::find(l1_ids.begin(), l1_ids.end(), id), l1_ids.end());
+  }
+
+  // 第三轮: 覆盖 a 开头的 key, 只有重叠的 sst 被重写
+  put_range("a", 3);
+  l1_ids = level_sst_ids(engine, 1);
+  for (auto id : old_l1_ids) {
+    EXPECT_EQ(std::find(l1_ids.begin(), l1_ids.end(), id), l1_ids.end());
+  }
+
+  // l1 的 sst 按 key 有序且没有重叠
+  auto l1_ssts = engine.current_version()->level_ssts(1);
+  for (size_t i = 1; i < l1_ssts.size(); i++) {
+    EXPECT_LT(l1_ssts[i - 1]->get_last_key(), l1_ssts[i]->get_first_key());
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    std::ostringstream oss_a, oss_b;
+    oss_a << "a" << std::setw(4) << std::setfill('0') << i;
+    oss_b << "b" << std::setw(4) << std::setfill('0') << i;
+    EXPECT_EQ(engine.get(oss_a.str(), 0).value().first, "value3");
+    EXPECT_EQ(engine.get(oss_b.str(), 0).value().first, "value2");
+  }
+}
+
+TEST_F(CompactTest, TieredCompact) {
+  auto key_of = [](const std::string &preffix, int i) {
+    std::ostringstream oss_key;
+    oss_key << preffix << std::setw(5) << std::setfill('0') << i;
+    return oss_key.str();
+  };
+
+  std::vector<size_t> old_run_ids;
+  {
+    LSMEngine engine(test_dir, CompactType::TieredCompact);
+    auto put_range = [&](const std::string &preffix, int key_num) {
+      for (int flush_idx = 0; flush_idx < LSM_SST_LEVEL_RATIO; flush_idx++) {
+        for (int i = 0; i < key_num; i++) {
+          engine.put(key_of(preffix, i), "value_" + preffix, 1);
+        }
+        engine.flush();
+      }
+      engine.wait_for_bg_jobs();
+    };
+
+    // 第一轮: l0 合并为 l1 的一个 sorted run
+    put_range("a", 20000);
+    EXPECT_TRUE(level_sst_ids(engine, 0).empty());
+    ASSERT_FALSE(level_sst_ids(engine, 1).empty());
+    old_run_ids = level_sst_ids(engine, 1);
+
+    // 第二轮: 新的 sorted run 远小于 l1, 不会重写 l1, 而是将其下移到 l2
+    put_range("b", 100);
+    EXPECT_TRUE(level_sst_ids(engine, 0).empty());
+    EXPECT_FALSE(level_sst_ids(engine, 1).empty());
+    EXPECT_EQ(level_sst_ids(engine, 2), old_run_ids);
+
+    // 第三轮: 与 l1 大小相近, 合并到 l1, l2 仍然不受影响
+    put_range("c", 100);
+    EXPECT_EQ(level_sst_ids(engine, 2), old_run_ids);
+
+    for (auto &preffix : {"b", "c"}) {
+      for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(engine.get(key_of(preffix, i), 0).value().first,
+                  std::string("value_") + preffix);
+      }
+    }
+  }
+
+  // 重启后 sorted run 所在的 level 保持不变
+  LSMEngine engine(test_dir, CompactType::TieredCompact);
+  EXPECT_EQ(level_sst_ids(engine, 2), old_run_ids);
+  for (int i = 0; i < 20000; i += 7) {
+    EXPECT_EQ(engine.get(key_of("a", i), 0).value().first, "value_a");
+  }
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(engine.get(key_of("c", i), 0).value().first, "value_c");
+  }
+}
+
+TEST_F(CompactTest, MvccGarbageCollect) {
+  LSMEngine engine(test_dir);
+  std::atomic<uint64_t> watermark = 2;
+  engine.set_gc_watermark_callback([&watermark]() { return watermark.load(); });
+
+  auto key_of = [](int i) {
+    std::ostringstream oss_key;
+    oss_key << "key" << std::setw(4) << std::setfill('0') << i;
+    return oss_key.str();
+  };
+  // 不做任何清理, 统计 level 中所有版本的数量
+  auto count_versions = [&](size_t level) {
+    auto level_ssts = engine.current_version()->level_ssts(level);
+    size_t cnt = 0;
+    for (CompactIterator it({level_ssts}, 0, false); it.is_valid(); ++it) {
+      cnt++;
+    }
+    return cnt;
+  };
+
+  // 事务 1-3 依次覆盖 1000 个 key, 事务 4 删除前 100 个 key, 每次都刷入 l0
+  for (uint64_t tranc_id = 1; tranc_id <= 3; tranc_id++) {
+    for (int i = 0; i < 1000; i++) {
+      engine.put(key_of(i), "value" + std::to_string(tranc_id), tranc_id);
+    }
+    engine.flush();
+  }
+  for (int i = 0; i < 100; i++) {
+    engine.remove(key_of(i), 4);
+  }
+  engine.flush();
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+
+  // watermark 为 2: 事务 1 的版本被清理, 事务 2 的版本仍然可见
+  EXPECT_EQ(count_versions(1), 100 * 3 + 900 * 2);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(engine.get(key_of(i), 2).value().first, "value2");
+    if (i < 100) {
+      EXPECT_FALSE(engine.get(key_of(i), 0).has_value());
+    } else {
+      EXPECT_EQ(engine.get(key_of(i), 0).value().first, "value3");
+    }
+  }
+
+  // 所有事务都已经结束, 最底层只保留最新的版本, 删除标记也被清理
+  watermark = 10;
+  for (uint64_t tranc_id = 5; tranc_id <= 8; tranc_id++) {
+    for (int i = 0; i < 10; i++) {
+      engine.put("other" + std::to_string(i), "value", tranc_id);
+    }
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+  EXPECT_EQ(count_versions(1), 900 + 10);
+  for (int i = 0; i < 1000; i++) {
+    if (i < 100) {
+      EXPECT_FALSE(engine.get(key_of(i), 0).has_value());
+    } else {
+      EXPECT_EQ(engine.get(key_of(i), 0).value().first, "value3");
+    }
+  }
+}
+
+// 范围删除标记在 watermark 之下时, 被覆盖的版本和最底层的标记都会被清理
+TEST_F(CompactTest, RangeDeleteGarbageCollect) {
+  LSMEngine engine(test_dir);
+  std::atomic<uint64_t> watermark = 1;
+  engine.set_gc_watermark_callback([&watermark]() { return watermark.load(); });
+
+  auto key_of = [](int i) {
+    std::ostringstream oss_key;
+    oss_key << "key" << std::setw(4) << std::setfill('0') << i;
+    return oss_key.str();
+  };
+  auto count_key_versions = [&]() {
+    auto level_ssts = engine.current_version()->level_ssts(1);
+    size_t cnt = 0;
+    for (CompactIterator it({level_ssts}, 0, false); it.is_valid(); ++it) {
+      cnt += it.key().starts_with("key");
+    }
+    return cnt;
+  };
+  auto has_range_dels = [&]() {
+    for (auto &sst : engine.current_version()->level_ssts(1)) {
+      if (sst->get_range_tombstones() != nullptr) {
+        return true;
+      }
+    }
+    return false;
+  };
+  uint64_t tranc_id = 1;
+  auto flush_fillers = [&](int rounds) {
+    for (int round = 0; round < rounds; round++) {
+      engine.put("other", "value", ++tranc_id);
+      engine.flush();
+    }
+    engine.wait_for_bg_jobs();
+  };
+
+  for (int i = 0; i < 1000; i++) {
+    engine.put(key_of(i), "value", 1);
+  }
+  engine.flush();
+  engine.remove_range(key_of(100), key_of(300), ++tranc_id);
+  engine.flush();
+  flush_fillers(LSM_SST_LEVEL_RATIO - 2);
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+
+  // watermark 之上的标记不能清理任何版本, 标记本身也需要保留
+  EXPECT_EQ(count_key_versions(), 1000);
+  EXPECT_TRUE(has_range_dels());
+  EXPECT_EQ(engine.get(key_of(150), 1).value().first, "value");
+  EXPECT_FALSE(engine.get(key_of(150), 0).has_value());
+  EXPECT_FALSE(engine.get(key_of(299), 0).has_value());
+  EXPECT_EQ(engine.get(key_of(300), 0).value().first, "value");
+
+  // 所有事务都已经结束, 被覆盖的版本和最底层的标记都被清理
+  watermark = 100;
+  flush_fillers(LSM_SST_LEVEL_RATIO);
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+  EXPECT_EQ(count_key_versions(), 800);
+  EXPECT_FALSE(has_range_dels());
+  EXPECT_FALSE(engine.get(key_of(150), 0).has_value());
+  EXPECT_EQ(engine.get(key_of(99), 0).value().first, "value");
+  EXPECT_EQ(engine.get(key_of(300), 0).value().first, "value");
+}
+
+// compaction_filter 丢弃的版本在最底层直接清理, 在上层输出为删除标记
+TEST_F(CompactTest, CompactionFilter) {
+  class DropExpired : public CompactionFilter {
+  public:
+    std::string name() const override { return "drop_expired"; }
+    bool filter(std::string_view key, std::string_view value) const override {
+      return value == "expired";
+    }
+  };
+  auto compaction_filter = std::make_shared<DropExpired>();
+  LSMEngine engine(test_dir, CompactType::FullCompact, nullptr, nullptr,
+                   compaction_filter);
+  std::atomic<uint64_t> watermark = 1;
+  engine.set_gc_watermark_callback([&watermark]() { return watermark.load(); });
+
+  auto key_of = [](int i) {
+    std::ostringstream oss_key;
+    oss_key << "key" << std::setw(4) << std::setfill('0') << i;
+    return oss_key.str();
+  };
+  for (int i = 0; i < 1000; i++) {
+    engine.put(key_of(i), "value", 1);
+  }
+  engine.flush();
+  // 事务 3 的版本在 watermark 之上, 不会传给 filter
+  for (int i = 0; i < 1000; i++) {
+    engine.put(key_of(i), i % 2 == 0 ? "expired" : "value", i < 500 ? 2 : 3);
+  }
+  engine.flush();
+
+  // 不是最底层时输出删除标记, 遮挡更旧的版本
+  watermark = 2;
+  auto l0_ssts = engine.current_version()->level_ssts(0);
+  std::vector<std::vector<std::shared_ptr<SST>>> runs;
+  for (auto &sst : l0_ssts) {
+    runs.push_back({sst});
+  }
+  size_t tombstones = 0, expired = 0;
+  for (CompactIterator it(runs, 2, false, std::nullopt, std::nullopt, nullptr,
+                          compaction_filter);
+       it.is_valid(); ++it) {
+    tombstones += it.value().empty();
+    expired += it.value() == "expired";
+  }
+  EXPECT_EQ(tombstones, 250);
+  EXPECT_EQ(expired, 250);
+
+  // 所有事务都已经结束, 最底层直接丢弃
+  watermark = 100;
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO - 2; round++) {
+    engine.put("other", "value", 10 + round);
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+  size_t cnt = 0;
+  for (CompactIterator it({engine.current_version()->level_ssts(1)}, 0, false);
+       it.is_valid(); ++it) {
+    cnt += it.key().starts_with("key");
+  }
+  EXPECT_EQ(cnt, 500);
+  for (int i = 0; i < 1000; i++) {
+    auto res = engine.get(key_of(i), 0);
+    if (i % 2 == 0) {
+      EXPECT_FALSE(res.has_value());
+    } else {
+      EXPECT_EQ(res.value().first, "value");
+    }
+  }
+}
+
+TEST_F(CompactTest, SubCompaction) {
+  LSMEngine engine(test_dir);
+  auto key_of = [](int i) {
+    std::ostringstream oss_key;
+    oss_key << "key" << std::setw(5) << std::setfill('0') << i;
+    return oss_key.str();
+  };
+
+  // 随机的 value 无法被压缩, 保证 sst 的大小不受 block 压缩的影响
+  auto value_of = [](int i) {
+    std::mt19937 gen(i);
+    std::string value(1024, '\0');
+    for (auto &c : value) {
+      c = static_cast<char>('a' + gen() % 26);
+    }
+    return value;
+  };
+
+  // 每个 l0 sst 的 key 范围都覆盖全部 key, 合并的输入足够拆分为多个子任务
+  int key_num = 3900;
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+    for (int i = 0; i < key_num; i++) {
+      int key_idx = i * LSM_SST_LEVEL_RATIO + round;
+      engine.put(key_of(key_idx), value_of(key_idx), 1);
+    }
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+
+  // 每个子任务单独输出 sst, 且不同子任务的 key 范围互不重叠
+  auto l1_ssts = engine.current_version()->level_ssts(1);
+  EXPECT_GE(l1_ssts.size(), 2);
+  for (size_t i = 1; i < l1_ssts.size(); i++) {
+    EXPECT_LT(l1_ssts[i - 1]->get_last_key(), l1_ssts[i]->get_first_key());
+  }
+
+  for (int i = 0; i < key_num * LSM_SST_LEVEL_RATIO; i++) {
+    auto res = engine.get(key_of(i), 0);
+    ASSERT_TRUE(res.has_value());
+    EXPECT_EQ(res.value().first, value_of(i));
+  }
+}
+
+// 读者持有的旧 Version 中的 sst 在 compact 后仍然可读,
+// 最后一个 Version 释放后才删除文件
+TEST_F(CompactTest, VersionPinsObsoleteSst) {
+  LSMEngine engine(test_dir);
+  for (int flush_idx = 0; flush_idx < LSM_SST_LEVEL_RATIO - 1; flush_idx++) {
+    for (int i = 0; i < 100; i++) {
+      engine.put("key" + std::to_string(i), "value" + std::to_string(flush_idx),
+                 1);
+    }
+    engine.flush();
+  }
+  auto old_version = engine.current_version();
+  ASSERT_EQ(old_version->num_ssts(0), LSM_SST_LEVEL_RATIO - 1);
+
+  // 最后一次 flush 触发 l0 的 compact
+  engine.put("key0", "latest", 2);
+  engine.flush();
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(level_sst_ids(engine, 0).empty());
+  EXPECT_EQ(engine.get("key0", 0)->first, "latest");
+
+  auto &old_l0 = old_version->level_ssts(0);
+  std::vector<std::string> old_paths;
+  for (auto &sst : old_l0) {
+    old_paths.push_back(engine.get_sst_path(sst->get_sst_id(), 0));
+    EXPECT_TRUE(std::filesystem::exists(old_paths.back()));
+  }
+  {
+    auto it = old_l0.front()->get("key1", 0);
+    ASSERT_TRUE(it.is_valid());
+    EXPECT_EQ(it.value(), "value" + std::to_string(LSM_SST_LEVEL_RATIO - 2));
+  }
+
+  old_version.reset();
+  for (auto &path : old_paths) {
+    EXPECT_FALSE(std::filesystem::exists(path));
+  }
+
+  // 重放 MANIFEST 得到的 sst 与当前 Version 一致
+  std::map<size_t, std::set<size_t>> replayed;
+  for (auto &edit : Manifest::read(test_dir + "/MANIFEST")) {
+    for (auto [level, sst_id] : edit.deleted_files) {
+      replayed[level].erase(sst_id);
+    }
+    for (auto [level, sst_id] : edit.added_files) {
+      replayed[level].insert(sst_id);
+    }
+  }
+  for (auto &[level, level_ssts] : engine.current_version()->levels()) {
+    auto sst_ids = level_sst_ids(engine, level);
+    EXPECT_EQ(replayed[level], std::set<size_t>(sst_ids.begin(), sst_ids.end()));
+    replayed.erase(level);
+  }
+  for (auto &[level, sst_ids] : replayed) {
+    EXPECT_TRUE(sst_ids.empty());
+  }
+}
+
+// 两个 run 的 compact 使用定长的 TwoRunCompactIterator, 输出与基于堆的版本一致
+// 吞吐量的对比见 bench/bench_compact.cpp
+TEST_F(CompactTest, TwoRunMatchesHeap) {
+  auto cache = std::make_shared<BlockCache>(1024, 2);
+  size_t next_id = 0;
+  // 新的 run 覆盖一半的 key, 旧的 run 包含全部的 key
+  // 每个 run 拆分为多个 sst, 覆盖 run 内切换 sst 的情况
+  auto build_run = [&](int step, uint64_t tranc_id) {
+    std::vector<std::shared_ptr<SST>> run;
+    SSTBuilder builder(LSM_BLOCK_SIZE, true);
+    char key[32];
+    for (int i = 0; i < 20000; i += step) {
+      snprintf(key, sizeof(key), "user%08d", i);
+      // 新的 run 中的部分 key 为删除标记
+      std::string value = step == 2 && i % 10 == 0
+                              ? ""
+                              : "value" + std::to_string(i * tranc_id);
+      builder.add(key, value, tranc_id);
+      if (builder.estimated_size() >= 4 * LSM_BLOCK_SIZE) {
+        run.push_back(builder.build(
+            next_id, test_dir + "/sst_" + std::to_string(next_id), cache));
+        next_id++;
+        builder = SSTBuilder(LSM_BLOCK_SIZE, true);
+      }
+    }
+    run.push_back(builder.build(
+        next_id, test_dir + "/sst_" + std::to_string(next_id), cache));
+    next_id++;
+    return run;
+  };
+  std::vector<std::vector<std::shared_ptr<SST>>> runs = {build_run(2, 2),
+                                                         build_run(1, 1)};
+  ASSERT_GT(runs[0].size(), 1);
+
+  for (uint64_t watermark : {0, 5}) {
+    for (bool bottommost : {false, true}) {
+      std::vector<std::pair<std::string, uint64_t>> expected;
+      for (CompactIterator it(runs, watermark, bottommost); it.is_valid();
+           ++it) {
+        expected.emplace_back(std::string(it.key()), it.get_tranc_id());
+      }
+      // watermark 为 0 时保留全部版本, 否则每个 key 只保留最新的版本,
+      // 最底层的删除标记也会被丢弃
+      size_t expected_num = watermark == 0 ? 30000
+                            : bottommost   ? 18000
+                                           : 20000;
+      EXPECT_EQ(expected.size(), expected_num);
+
+      size_t idx = 0;
+      for (TwoRunCompactIterator it(runs, watermark, bottommost); it.is_valid();
+           ++it, ++idx) {
+        ASSERT_LT(idx, expected.size());
+        EXPECT_EQ(it.key(), expected[idx].first);
+        EXPECT_EQ(it.get_tranc_id(), expected[idx].second);
+      }
+      EXPECT_EQ(idx, expected.size());
+    }
+  }
+  EXPECT_THROW(TwoRunCompactIterator({runs[0]}, 0, false), std::runtime_error);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
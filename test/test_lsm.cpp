@@ -1,6 +1,11 @@
+#include "../include/consts.h"
 #include "../include/lsm/engine.h"
+#include <atomic>
 #include <cstdlib>
 #include <filesystem>
+#include <future>
+#include <map>
+#include <thread>
 #include <gtest/gtest.h>
 #include "../include/lsm/level_iterator.h"
 #include <string>
@@ -218,6 +223,242 @@ TEST_F(LSMTest, MonotonyPredicate) {
   EXPECT_EQ(actual_keys, expected_keys);
 }
 
+// seek 和上下边界与有序的 map 一致, 数据分布在内存表和多个 sst 中
+TEST_F(LSMTest, RangeIterator) {
+  LSM lsm(test_dir);
+  std::map<std::string, std::string> expected;
+  auto make_key = [](int i) {
+    std::ostringstream oss;
+    oss << "key" << std::setw(4) << std::setfill('0') << i;
+    return oss.str();
+  };
+  for (int round = 0; round < 6; round++) {
+    for (int i = round; i < 1000; i += 2) {
+      auto key = make_key(i);
+      auto value = "value" + std::to_string(round) + "_" + std::to_string(i);
+      lsm.put(key, value);
+      expected[key] = value;
+    }
+    for (int i = round * 7; i < 1000; i += 37) {
+      lsm.remove(make_key(i));
+      expected.erase(make_key(i));
+    }
+    if (round < 5) {
+      // 刷盘次数超过 l0 的上限, 触发 compact, 数据分布到 l0 和 l1
+      lsm.flush();
+    }
+  }
+  lsm.remove_range(make_key(500), make_key(520));
+  expected.erase(expected.lower_bound(make_key(500)),
+                 expected.lower_bound(make_key(520)));
+
+  auto collect = [](RangeIterator &iter, size_t limit) {
+    std::vector<std::pair<std::string, std::string>> result;
+    for (; iter.is_valid() && result.size() < limit; iter.next()) {
+      result.emplace_back(iter.key(), iter.value());
+    }
+    return result;
+  };
+  auto expect_range = [&](const std::string &seek_key,
+                          const std::optional<std::string> &lower,
+                          const std::optional<std::string> &upper,
+                          size_t limit) {
+    std::vector<std::pair<std::string, std::string>> want;
+    auto it = expected.lower_bound(
+        lower.has_value() && seek_key < *lower ? *lower : seek_key);
+    for (; it != expected.end() && want.size() < limit; ++it) {
+      if (upper.has_value() && it->first >= *upper) {
+        break;
+      }
+      want.emplace_back(it->first, it->second);
+    }
+    ReadOptions options;
+    options.lower_bound = lower;
+    options.upper_bound = upper;
+    auto iter = lsm.new_iterator(options);
+    iter.seek(seek_key);
+    EXPECT_EQ(collect(iter, limit), want) << seek_key;
+  };
+
+  expect_range("", std::nullopt, std::nullopt, SIZE_MAX);
+  expect_range("key0100", std::nullopt, std::nullopt, 10);
+  expect_range("key0100x", std::nullopt, make_key(130), SIZE_MAX);
+  expect_range("key0490", std::nullopt, make_key(530), SIZE_MAX);
+  expect_range("a", make_key(900), std::nullopt, SIZE_MAX);
+  expect_range(make_key(990), make_key(10), make_key(995), SIZE_MAX);
+  expect_range("zzz", std::nullopt, std::nullopt, SIZE_MAX);
+
+  // 同一个迭代器可以多次 seek, 创建之后的写入不可见
+  ReadOptions options;
+  options.upper_bound = make_key(4);
+  auto iter = lsm.new_iterator(options);
+  lsm.put(make_key(1), "new_value");
+  iter.seek_to_first();
+  ASSERT_TRUE(iter.is_valid());
+  EXPECT_EQ(iter.key(), make_key(1));
+  EXPECT_EQ(iter.value(), expected[make_key(1)]);
+  iter.seek(make_key(2));
+  EXPECT_EQ(collect(iter, SIZE_MAX).size(), 2);
+
+  // 快照上的迭代器
+  auto snapshot = lsm.get_snapshot();
+  lsm.put(make_key(2), "after_snapshot");
+  ReadOptions snapshot_options;
+  snapshot_options.snapshot = snapshot;
+  auto snapshot_iter = lsm.new_iterator(snapshot_options);
+  snapshot_iter.seek(make_key(1));
+  ASSERT_TRUE(snapshot_iter.is_valid());
+  EXPECT_EQ(snapshot_iter.value(), "new_value");
+  snapshot_iter.next();
+  EXPECT_EQ(snapshot_iter.value(), expected[make_key(2)]);
+}
+
+// 反向遍历与正向遍历的结果相反, 改变方向时从当前 key 继续
+TEST_F(LSMTest, RangeIteratorReverse) {
+  LSM lsm(test_dir);
+  std::map<std::string, std::string> expected;
+  auto make_key = [](int i) {
+    std::ostringstream oss;
+    oss << "key" << std::setw(4) << std::setfill('0') << i;
+    return oss.str();
+  };
+  for (int round = 0; round < 6; round++) {
+    for (int i = round; i < 1000; i += 3) {
+      auto key = make_key(i);
+      auto value = "value" + std::to_string(round) + "_" + std::to_string(i);
+      lsm.put(key, value);
+      expected[key] = value;
+    }
+    for (int i = round * 5; i < 1000; i += 41) {
+      lsm.remove(make_key(i));
+      expected.erase(make_key(i));
+    }
+    if (round < 5) {
+      lsm.flush();
+    }
+  }
+  lsm.remove_range(make_key(300), make_key(330));
+  expected.erase(expected.lower_bound(make_key(300)),
+                 expected.lower_bound(make_key(330)));
+
+  auto expect_reverse = [&](const std::optional<std::string> &seek_key,
+                            const std::optional<std::string> &lower,
+                            const std::optional<std::string> &upper) {
+    std::vector<std::pair<std::string, std::string>> want;
+    for (auto it = expected.rbegin(); it != expected.rend(); ++it) {
+      if ((seek_key.has_value() && it->first > *seek_key) ||
+          (upper.has_value() && it->first >= *upper)) {
+        continue;
+      }
+      if (lower.has_value() && it->first < *lower) {
+        break;
+      }
+      want.emplace_back(it->first, it->second);
+    }
+    ReadOptions options;
+    options.lower_bound = lower;
+    options.upper_bound = upper;
+    auto iter = lsm.new_iterator(options);
+    if (seek_key.has_value()) {
+      iter.seek_for_prev(*seek_key);
+    } else {
+      iter.seek_to_last();
+    }
+    std::vector<std::pair<std::string, std::string>> actual;
+    for (; iter.is_valid(); iter.prev()) {
+      actual.emplace_back(iter.key(), iter.value());
+    }
+    EXPECT_EQ(actual, want);
+  };
+
+  expect_reverse(std::nullopt, std::nullopt, std::nullopt);
+  expect_reverse(make_key(500), std::nullopt, std::nullopt);
+  expect_reverse("key0500x", make_key(290), std::nullopt);
+  expect_reverse(std::nullopt, make_key(100), make_key(200));
+  expect_reverse(make_key(900), std::nullopt, make_key(201));
+  expect_reverse("a", std::nullopt, std::nullopt);
+
+  // 改变方向
+  auto iter = lsm.new_iterator();
+  iter.seek(make_key(600));
+  auto first = expected.lower_bound(make_key(600));
+  ASSERT_TRUE(iter.is_valid());
+  EXPECT_EQ(iter.key(), first->first);
+  iter.next();
+  iter.next();
+  iter.prev();
+  EXPECT_EQ(iter.key(), std::next(first)->first);
+  iter.prev();
+  iter.prev();
+  EXPECT_EQ(iter.key(), std::prev(first)->first);
+  iter.next();
+  EXPECT_EQ(iter.key(), first->first);
+  EXPECT_EQ(iter.value(), first->second);
+}
+
+// 范围查询归并内存表、l0 和其他层的数据, 较新的数据源中的删除会覆盖旧数据
+TEST_F(LSMTest, MonotonyPredicateMerge) {
+  auto engine = std::make_shared<LSMEngine>(test_dir);
+  auto key_of = [](int i) {
+    std::ostringstream oss;
+    oss << "key" << std::setw(3) << std::setfill('0') << i;
+    return oss.str();
+  };
+  // 每一轮写入的结果, 用于计算每个 tranc_id 下可见的数据
+  std::map<uint64_t, std::map<std::string, std::string>> snapshots;
+  std::map<std::string, std::string> expected;
+  auto write_round = [&](int round, int step, bool remove) {
+    uint64_t tranc_id = round + 1;
+    for (int i = round % step; i < 1000; i += step) {
+      if (remove) {
+        engine->remove(key_of(i), tranc_id);
+        expected.erase(key_of(i));
+      } else {
+        auto value = "value" + std::to_string(i) + "_" + std::to_string(round);
+        engine->put(key_of(i), value, tranc_id);
+        expected[key_of(i)] = value;
+      }
+    }
+    snapshots[tranc_id] = expected;
+  };
+
+  // 前几轮被 compact 到 l1, 之后一轮留在 l0, 最后两轮在内存表中
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+    write_round(round, 1 + round, false);
+    engine->flush();
+    engine->wait_for_bg_jobs();
+  }
+  ASSERT_TRUE(engine->current_version()->level_ssts(0).empty());
+  write_round(LSM_SST_LEVEL_RATIO, 3, true);
+  engine->flush();
+  write_round(LSM_SST_LEVEL_RATIO + 1, 5, false);
+  write_round(LSM_SST_LEVEL_RATIO + 2, 7, true);
+  ASSERT_EQ(engine->current_version()->level_ssts(0).size(), 1);
+
+  auto predicate = [&](const std::string &key) {
+    if (key < key_of(150)) {
+      return 1;
+    }
+    return key > key_of(850) ? -1 : 0;
+  };
+  for (auto &[tranc_id, state] : snapshots) {
+    std::vector<std::pair<std::string, std::string>> want;
+    for (auto &[k, v] : state) {
+      if (predicate(k) == 0) {
+        want.emplace_back(k, v);
+      }
+    }
+    std::vector<std::pair<std::string, std::string>> got;
+    auto result = engine->lsm_iters_monotony_predicate(tranc_id, predicate);
+    if (result.has_value()) {
+      for (auto it = result->first; it != result->second; ++it) {
+        got.emplace_back(it->first, it->second);
+      }
+    }
+    EXPECT_EQ(got, want) << "tranc_id " << tranc_id;
+  }
+}
+
 TEST_F(LSMTest, TrancIdTest) {
   // 注意是 LSMEngine 而不是 LSM
   // 因为 LSMEngine 才能手动控制事务id
@@ -296,6 +537,290 @@ TEST_F(LSMTest, TranContextTest) {
   EXPECT_FALSE(commit_res);
 }
 
+TEST_F(LSMTest, ConcurrentCommit) {
+  LSM lsm(test_dir);
+  const int num_threads = 8;
+  const int num_trancs = 200;
+  // 每个线程写入不同的 key, 提交之间没有冲突
+  std::vector<std::thread> threads;
+  std::atomic<int> num_committed = 0;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < num_trancs; i++) {
+        auto tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+        std::string key = "t" + std::to_string(t) + "_" + std::to_string(i);
+        tranc->put(key, "value");
+        tranc->put(key + "_2", "value");
+        if (tranc->commit()) {
+          num_committed++;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_committed, num_threads * num_trancs);
+  EXPECT_EQ(lsm.get("t3_150_2").value(), "value");
+
+  // 写入相同 key 的并发事务中, 先开始的事务在后开始的事务提交后会冲突
+  auto older = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  auto newer = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  older->put("shared", "older");
+  newer->put("shared", "newer");
+  EXPECT_TRUE(newer->commit());
+  EXPECT_FALSE(older->commit());
+  EXPECT_EQ(lsm.get("shared").value(), "newer");
+
+  // WriteBatch 的写入同样会导致冲突
+  auto tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  tranc->put("batch_key", "tranc");
+  WriteBatch batch;
+  batch.put("batch_key", "batch");
+  lsm.write(std::move(batch));
+  EXPECT_FALSE(tranc->commit());
+
+  // READ_COMMITTED 不检查冲突
+  auto rc = lsm.begin_tran(IsolationLevel::READ_COMMITTED);
+  rc->put("shared", "rc");
+  lsm.put("shared", "plain");
+  EXPECT_TRUE(rc->commit());
+}
+
+TEST(ConflictTableTest, EvictAndWatermark) {
+  uint64_t watermark = 0;
+  ConflictTable table(1, 8);
+  table.set_watermark_callback([&watermark]() { return watermark; });
+
+  auto record = [&table](const std::string &key, uint64_t commit_seq) {
+    auto locks = table.lock_keys({key});
+    table.record(key, commit_seq);
+  };
+  auto check = [&table](const std::string &key, uint64_t begin_seq) {
+    auto locks = table.lock_keys({key});
+    return table.check(key, begin_seq);
+  };
+  record("key", 10);
+  EXPECT_EQ(check("key", 5), ConflictTable::CheckResult::Conflict);
+  EXPECT_EQ(check("key", 10), ConflictTable::CheckResult::NoConflict);
+  EXPECT_EQ(check("other", 5), ConflictTable::CheckResult::NoConflict);
+
+  // 存在活跃的旧事务时无法清理, 超出容量后淘汰较旧的记录
+  for (uint64_t i = 0; i < 8; i++) {
+    record("key" + std::to_string(i), 20 + i);
+  }
+  EXPECT_LE(table.size(), 8);
+  EXPECT_EQ(check("key", 15), ConflictTable::CheckResult::Unknown);
+  EXPECT_EQ(check("key7", 15), ConflictTable::CheckResult::Conflict);
+  EXPECT_EQ(check("missing", 100), ConflictTable::CheckResult::NoConflict);
+
+  // 旧事务结束后, 不晚于 watermark 的记录被清理, 结果仍然准确
+  watermark = 100;
+  for (uint64_t i = 0; i < 8; i++) {
+    record("new" + std::to_string(i), 100 + i);
+  }
+  EXPECT_EQ(check("key", 100), ConflictTable::CheckResult::NoConflict);
+  EXPECT_EQ(check("new7", 100), ConflictTable::CheckResult::Conflict);
+}
+
+TEST(ConflictTableTest, CheckRange) {
+  ConflictTable table(4, 8);
+  auto in_range = [](const std::string &key) { return key[0] == 'a'; };
+  auto check_range = [&](uint64_t begin_seq, const std::string &own_key) {
+    auto held = table.lock_keys({own_key});
+    return table.check_range(in_range, begin_seq, held);
+  };
+  {
+    auto locks = table.lock_keys({"a1"});
+    table.add_pending({"a1"});
+    // 其他提交者正在写入的 key, 以及自己正在写入的 key
+    EXPECT_EQ(table.check_range(in_range, 0, {}),
+              ConflictTable::CheckResult::Conflict);
+    EXPECT_EQ(table.check_range(in_range, 0, locks),
+              ConflictTable::CheckResult::NoConflict);
+    table.record("a1", 10);
+  }
+  EXPECT_EQ(check_range(5, "b"), ConflictTable::CheckResult::Conflict);
+  EXPECT_EQ(check_range(10, "b"), ConflictTable::CheckResult::NoConflict);
+
+  // 撤销登记之后不再冲突
+  {
+    auto locks = table.lock_keys({"a2"});
+    table.add_pending({"a2"});
+    table.clear_pending({"a2"});
+  }
+  EXPECT_EQ(check_range(10, "b"), ConflictTable::CheckResult::NoConflict);
+
+  // 没有 watermark 时只能淘汰, 之后较早开始的检查无法确定
+  for (uint64_t i = 0; i < 64; i++) {
+    auto key = "b" + std::to_string(i);
+    auto locks = table.lock_keys({key});
+    table.record(key, 20 + i);
+  }
+  EXPECT_EQ(check_range(10, "b"), ConflictTable::CheckResult::Unknown);
+  EXPECT_EQ(check_range(100, "b"), ConflictTable::CheckResult::NoConflict);
+}
+
+TEST_F(LSMTest, Serializable) {
+  LSM lsm(test_dir);
+  lsm.put("x", "0");
+  lsm.put("y", "0");
+
+  // write skew: 两个事务各自读取对方要写的 key, REPEATABLE_READ 下都能提交
+  auto rr1 = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  auto rr2 = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  rr1->get("y");
+  rr2->get("x");
+  rr1->put("x", "1");
+  rr2->put("y", "1");
+  EXPECT_TRUE(rr1->commit());
+  EXPECT_TRUE(rr2->commit());
+
+  // SERIALIZABLE 下后提交的事务会被终止
+  auto s1 = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  auto s2 = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  s1->get("y");
+  s2->get("x");
+  s1->put("x", "2");
+  s2->put("y", "2");
+  EXPECT_TRUE(s1->commit());
+  EXPECT_FALSE(s2->commit());
+
+  // 先开始的事务在后开始的事务读取之后提交, 同样会被检测到
+  auto older = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  auto newer = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  EXPECT_EQ(newer->get("x").value(), "2");
+  older->put("x", "3");
+  EXPECT_TRUE(older->commit());
+  newer->put("z", "1");
+  EXPECT_FALSE(newer->commit());
+
+  // 范围查询之后, 范围内插入了新的 key
+  auto predicate = [](const std::string &key) {
+    if (key < "range_") {
+      return 1;
+    }
+    return key.compare(0, 6, "range_") > 0 ? -1 : 0;
+  };
+  lsm.put("range_a", "1");
+  auto scanner = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  scanner->put("range_b", "2");
+  auto kvs = scanner->get_monotony_predicate(predicate);
+  ASSERT_EQ(kvs.size(), 2);
+  EXPECT_EQ(kvs[0].first, "range_a");
+  EXPECT_EQ(kvs[1].first, "range_b");
+  scanner->put("summary", std::to_string(kvs.size()));
+  lsm.put("range_c", "3");
+  EXPECT_FALSE(scanner->commit());
+
+  // 范围没有变化时可以提交
+  scanner = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  EXPECT_EQ(scanner->get_monotony_predicate(predicate).size(), 2);
+  scanner->put("summary", "2");
+  EXPECT_TRUE(scanner->commit());
+}
+
+TEST_F(LSMTest, SerializableCounter) {
+  LSM lsm(test_dir);
+  const int num_threads = 8;
+  const int num_incr = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < num_incr; i++) {
+        while (true) {
+          auto tranc = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+          auto value = tranc->get("counter");
+          int count = value.has_value() ? std::stoi(value.value()) : 0;
+          tranc->put("counter", std::to_string(count + 1));
+          if (tranc->commit()) {
+            break;
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  // 没有丢失任何一次自增
+  EXPECT_EQ(lsm.get("counter").value(), std::to_string(num_threads * num_incr));
+}
+
+TEST_F(LSMTest, SerializableDisjointRanges) {
+  LSM lsm(test_dir);
+  auto prefix_predicate = [](const std::string &prefix) {
+    return [prefix](const std::string &key) {
+      if (key < prefix) {
+        return 1;
+      }
+      return key.compare(0, prefix.size(), prefix) > 0 ? -1 : 0;
+    };
+  };
+
+  // t1 的谓词在提交校验时阻塞, 此时 t1 持有 ra_key 所在分段的锁
+  // ra_key 和 rb_key 位于冲突表的不同分段
+  std::atomic<bool> armed = false;
+  std::promise<void> entered;
+  std::promise<void> release;
+  auto release_future = release.get_future().share();
+  auto range_a = prefix_predicate("ra_");
+  auto blocking_a = [&, range_a](const std::string &key) {
+    if (armed.exchange(false)) {
+      entered.set_value();
+      release_future.wait();
+    }
+    return range_a(key);
+  };
+  auto t1 = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+  t1->get_monotony_predicate(blocking_a);
+  t1->put("ra_key", "1");
+  // t1 开始之后的提交使校验时调用谓词
+  lsm.put("unrelated", "1");
+  armed = true;
+  auto t1_commit = std::async(std::launch::async, [&]() { return t1->commit(); });
+  entered.get_future().wait();
+
+  // 范围不相交的事务不需要等待 t1 完成校验
+  auto t2_commit = std::async(std::launch::async, [&]() {
+    auto t2 = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+    t2->get_monotony_predicate(prefix_predicate("rb_"));
+    t2->put("rb_key", "1");
+    return t2->commit();
+  });
+  bool t2_finished =
+      t2_commit.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+  release.set_value();
+  EXPECT_TRUE(t2_finished);
+  EXPECT_TRUE(t2_commit.get());
+  EXPECT_TRUE(t1_commit.get());
+
+  // 各自读写不同范围的并发事务都可以提交
+  const int num_threads = 8;
+  const int num_trancs = 50;
+  std::atomic<int> num_committed = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([&, t]() {
+      std::string prefix = "r" + std::to_string(t) + "_";
+      auto predicate = prefix_predicate(prefix);
+      for (int i = 0; i < num_trancs; i++) {
+        auto tranc = lsm.begin_tran(IsolationLevel::SERIALIZABLE);
+        auto kvs = tranc->get_monotony_predicate(predicate);
+        EXPECT_EQ(kvs.size(), i);
+        tranc->put(prefix + std::to_string(1000 + i), "1");
+        if (tranc->commit()) {
+          num_committed++;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_committed, num_threads * num_trancs);
+}
+
 TEST_F(LSMTest, Recover) {
   {
     LSM lsm(test_dir);
@@ -319,6 +844,11 @@ TEST_F(LSMTest, Recover) {
   }
   {
     LSM lsm(test_dir);
+    // 事务的 100 条 PUT 以及 CREATE 和 COMMIT 记录
+    auto &stats = lsm.get_recovery_stats();
+    EXPECT_EQ(stats.num_trancs, 1);
+    EXPECT_EQ(stats.num_records, 102);
+    EXPECT_GT(stats.num_bytes, 0);
 
     for (int i = 0; i < 100; i++) {
       std::ostringstream oss_key;
@@ -332,7 +862,1208 @@ TEST_F(LSMTest, Recover) {
     }
   }
 }
+TEST_F(LSMTest, WriteBatch) {
+  {
+    LSM lsm(test_dir);
+    lsm.put("old1", "value");
+    lsm.put("old2", "value");
+
+    WriteBatch batch;
+    for (int i = 0; i < 100; i++) {
+      batch.put("key" + std::to_string(i), "value" + std::to_string(i));
+    }
+    batch.remove("old1");
+    // 同一个 key 的多次操作以最后一次为准
+    batch.put("key0", "overwritten");
+    batch.remove("key1");
+    batch.remove("old2");
+    batch.put("old2", "revived");
+    EXPECT_EQ(batch.size(), 105);
+    lsm.write(std::move(batch));
+
+    // 写入后 batch 被清空, 可以继续复用
+    EXPECT_TRUE(batch.empty());
+    EXPECT_EQ(batch.byte_size(), 0);
+    batch.put("reused", "value");
+    lsm.write(std::move(batch));
+
+    EXPECT_EQ(lsm.get("key0").value(), "overwritten");
+    EXPECT_FALSE(lsm.get("key1").has_value());
+    EXPECT_EQ(lsm.get("key99").value(), "value99");
+    EXPECT_FALSE(lsm.get("old1").has_value());
+    EXPECT_EQ(lsm.get("old2").value(), "revived");
+    EXPECT_EQ(lsm.get("reused").value(), "value");
+  }
+  LSM lsm(test_dir);
+  EXPECT_EQ(lsm.get("key0").value(), "overwritten");
+  EXPECT_FALSE(lsm.get("key1").has_value());
+  EXPECT_EQ(lsm.get("key50").value(), "value50");
+  EXPECT_FALSE(lsm.get("old1").has_value());
+  EXPECT_EQ(lsm.get("old2").value(), "revived");
+}
+
+TEST_F(LSMTest, BackgroundFlush) {
+  LSMEngine engine(test_dir);
+
+  // 写入超过 memtable 总大小限制的数据, 刷盘由后台线程完成
+  std::string value(1024, 'v');
+  int num = LSM_TOL_MEM_SIZE_LIMIT / 1024 + 10000;
+  for (int i = 0; i < num; i++) {
+    engine.put("key" + std::to_string(i), value + std::to_string(i), 1);
+  }
+  engine.wait_for_bg_jobs();
+
+  // 后台线程已经完成刷盘
+  EXPECT_LT(engine.memtable.get_total_size(), LSM_TOL_MEM_SIZE_LIMIT);
+  EXPECT_GT(engine.current_version()->levels().size(), 0);
+
+  for (int i = 0; i < num; i += 97) {
+    auto res = engine.get("key" + std::to_string(i), 0);
+    ASSERT_TRUE(res.has_value());
+    EXPECT_EQ(res->first, value + std::to_string(i));
+  }
+}
+
+// 较大的 value 保存在 blob 文件中, compact 只复制 BlobIndex,
+// 不再被引用的 blob 文件会被删除
+TEST_F(LSMTest, BlobSeparation) {
+  auto count_blob_files = [this]() {
+    size_t count = 0;
+    for (auto &entry : std::filesystem::directory_iterator(test_dir)) {
+      count += BlobStore::is_blob_file(entry.path().filename().string());
+    }
+    return count;
+  };
+  auto large_value = [](int i, int round) {
+    return std::string(LSM_BLOB_MIN_VALUE_SIZE + i, 'a' + round) +
+           std::to_string(i);
+  };
+
+  {
+    auto engine = std::make_shared<LSMEngine>(test_dir);
+    engine->set_gc_watermark_callback([]() { return 1000; });
+    for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+      for (int i = 0; i < 50; i++) {
+        engine->put("key" + std::to_string(i), large_value(i, round),
+                    round + 1);
+        engine->put("small" + std::to_string(i),
+                    "v" + std::to_string(round), round + 1);
+      }
+      engine->flush();
+      if (round == 0) {
+        // sst 中只保存 BlobIndex
+        EXPECT_EQ(count_blob_files(), 1);
+        auto sst = engine->current_version()->level_ssts(0).front();
+        EXPECT_EQ(sst->get_blob_file_ids().size(), 1);
+        EXPECT_LT(sst->sst_size(), 50 * LSM_BLOB_MIN_VALUE_SIZE / 10);
+        EXPECT_EQ(engine->get("key7", 0)->first, large_value(7, 0));
+      }
+    }
+    engine->wait_for_bg_jobs();
+    ASSERT_TRUE(engine->current_version()->level_ssts(0).empty());
+
+    // 旧版本被 compact 清理后, 只剩最新一轮写入的 blob 文件
+    EXPECT_EQ(count_blob_files(), 1);
+    std::unordered_map<std::string, std::string> expected;
+    for (int i = 0; i < 50; i++) {
+      expected["key" + std::to_string(i)] =
+          large_value(i, LSM_SST_LEVEL_RATIO - 1);
+      expected["small" + std::to_string(i)] =
+          "v" + std::to_string(LSM_SST_LEVEL_RATIO - 1);
+    }
+    size_t count = 0;
+    for (auto it = engine->begin(0); it != engine->end(); ++it) {
+      EXPECT_EQ(it->second, expected[it->first]);
+      count++;
+    }
+    EXPECT_EQ(count, expected.size());
+  }
+
+  // 重启后仍然可以通过 BlobIndex 读取 value
+  auto engine = std::make_shared<LSMEngine>(test_dir);
+  EXPECT_EQ(count_blob_files(), 1);
+  for (int i = 0; i < 50; i++) {
+    EXPECT_EQ(engine->get("key" + std::to_string(i), 0)->first,
+              large_value(i, LSM_SST_LEVEL_RATIO - 1));
+  }
+}
+
+// 重启时根据 MANIFEST 恢复每一层的 sst, 不在 MANIFEST 中的 sst 文件会被删除
+TEST_F(LSMTest, ManifestRecovery) {
+  auto layout_of = [](LSMEngine &engine) {
+    std::map<size_t, std::vector<size_t>> layout;
+    for (auto &[level, level_ssts] : engine.current_version()->levels()) {
+      for (auto &sst : level_ssts) {
+        layout[level].push_back(sst->get_sst_id());
+      }
+    }
+    return layout;
+  };
+
+  std::map<size_t, std::vector<size_t>> layout;
+  std::map<size_t, SstFileMeta> metas;
+  std::string orphan_path;
+  {
+    auto engine = std::make_shared<LSMEngine>(test_dir);
+    // 先触发一次 l0 到 l1 的 compact, 再额外刷入一个 l0 的 sst
+    for (int round = 0; round <= LSM_SST_LEVEL_RATIO; round++) {
+      for (int i = 0; i < 1000; i++) {
+        engine->put("key" + std::to_string(i),
+                    "value" + std::to_string(round), round + 1);
+      }
+      engine->flush();
+      engine->wait_for_bg_jobs();
+    }
+    layout = layout_of(*engine);
+    ASSERT_EQ(layout[0].size(), 1);
+    ASSERT_FALSE(layout[1].empty());
+    for (auto &sst : engine->current_version()->level_ssts(1)) {
+      metas[sst->get_sst_id()] = sst->get_file_meta();
+    }
+
+    // 模拟 flush 写完 sst 后, 安装 Version 之前崩溃
+    orphan_path = engine->get_sst_path(engine->next_sst_id + 100, 0);
+    std::filesystem::copy_file(engine->get_sst_path(layout[0].front(), 0),
+                               orphan_path);
+  }
+
+  auto engine = std::make_shared<LSMEngine>(test_dir);
+  EXPECT_EQ(layout_of(*engine), layout);
+  EXPECT_FALSE(std::filesystem::exists(orphan_path));
+  for (auto &sst : engine->current_version()->level_ssts(1)) {
+    auto &meta = metas[sst->get_sst_id()];
+    EXPECT_EQ(sst->get_first_key(), meta.first_key);
+    EXPECT_EQ(sst->get_last_key(), meta.last_key);
+    EXPECT_EQ(sst->num_blocks(), meta.num_blocks);
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(engine->get("key" + std::to_string(i), 0)->first,
+              "value" + std::to_string(LSM_SST_LEVEL_RATIO));
+  }
+  // 新分配的 sst_id 不会与已有的 sst 重复
+  engine->put("new_key", "new_value", LSM_SST_LEVEL_RATIO + 2);
+  engine->flush();
+  EXPECT_EQ(engine->get("new_key", 0)->first, "new_value");
+  EXPECT_EQ(engine->current_version()->num_ssts(0), 2);
+}
+
+// 快照持有的内存表和 Version 不受之后的写入、flush 和 compact 影响,
+// 快照存活期间 compact 会保留它需要的旧版本
+TEST_F(LSMTest, Snapshot) {
+  auto engine = std::make_shared<LSMEngine>(test_dir);
+  engine->set_gc_watermark_callback([]() { return 1000; });
+  auto value_of = [](int i, int round) {
+    return "value" + std::to_string(i) + "_" + std::to_string(round);
+  };
+
+  // 第 0 轮写入一部分在 sst 中, 一部分在内存表中
+  for (int i = 0; i < 1000; i++) {
+    engine->put("key" + std::to_string(i), value_of(i, 0), 1);
+    if (i == 499) {
+      engine->flush();
+    }
+  }
+  auto snapshot = engine->get_snapshot(1);
+  EXPECT_EQ(engine->snapshots->size(), 1);
+  EXPECT_EQ(snapshot->get_mem_tables().size(), 1);
+
+  // 之后的写入全部刷盘并触发 compact
+  for (int round = 1; round < LSM_SST_LEVEL_RATIO; round++) {
+    for (int i = 0; i < 1000; i++) {
+      if (i % 10 == 0) {
+        engine->remove("key" + std::to_string(i), round + 1);
+      } else {
+        engine->put("key" + std::to_string(i), value_of(i, round), round + 1);
+      }
+    }
+    engine->flush();
+    engine->wait_for_bg_jobs();
+  }
+  ASSERT_TRUE(engine->current_version()->level_ssts(0).empty());
+
+  for (int i = 0; i < 1000; i++) {
+    auto key = "key" + std::to_string(i);
+    EXPECT_EQ(engine->get(key, *snapshot)->first, value_of(i, 0));
+    // compact 为快照保留了旧版本, 不持有快照的读取也能看到
+    EXPECT_EQ(engine->get(key, 1)->first, value_of(i, 0));
+  }
+  size_t count = 0;
+  for (auto it = engine->begin(*snapshot); it != engine->end(); ++it) {
+    EXPECT_EQ(it->second, value_of(std::stoi(it->first.substr(3)), 0));
+    count++;
+  }
+  EXPECT_EQ(count, 1000);
+  auto result = engine->lsm_iters_monotony_predicate(
+      *snapshot, [](const std::string &key) {
+        return key < "key10" ? 1 : (key > "key19" ? -1 : 0);
+      });
+  ASSERT_TRUE(result.has_value());
+  count = 0;
+  for (auto it = result->first; it != result->second; ++it) {
+    EXPECT_EQ(it->second, value_of(std::stoi(it->first.substr(3)), 0));
+    count++;
+  }
+  // 字典序位于 [key10, key19] 之间: key10 - key19 以及 key100 - key189
+  EXPECT_EQ(count, 100);
+
+  // 释放快照后, 旧版本会在下一次 compact 时被清理
+  snapshot.reset();
+  EXPECT_EQ(engine->snapshots->size(), 0);
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+    engine->put("other" + std::to_string(round), "v", 100);
+    engine->flush();
+    engine->wait_for_bg_jobs();
+  }
+  for (int i = 1; i < 1000; i += 10) {
+    EXPECT_FALSE(engine->get("key" + std::to_string(i), 1).has_value());
+    EXPECT_EQ(engine->get("key" + std::to_string(i), 0)->first,
+              value_of(i, LSM_SST_LEVEL_RATIO - 1));
+  }
+}
+
+TEST_F(LSMTest, SnapshotRead) {
+  LSM lsm(test_dir);
+  lsm.put("key1", "value1");
+  lsm.put("key2", "value2");
+  auto snapshot = lsm.get_snapshot();
+
+  lsm.put("key1", "new_value1");
+  lsm.remove("key2");
+  lsm.put("key3", "value3");
+  lsm.flush_all();
+
+  EXPECT_EQ(lsm.get("key1", *snapshot), "value1");
+  EXPECT_EQ(lsm.get("key2", *snapshot), "value2");
+  EXPECT_FALSE(lsm.get("key3", *snapshot).has_value());
+  std::vector<std::pair<std::string, std::string>> expected = {
+      {"key1", "value1"}, {"key2", "value2"}};
+  std::vector<std::pair<std::string, std::string>> actual;
+  for (auto it = lsm.begin(*snapshot); it != lsm.end(); ++it) {
+    actual.emplace_back(it->first, it->second);
+  }
+  EXPECT_EQ(actual, expected);
+
+  // 普通读取总是看到最新的数据
+  EXPECT_EQ(lsm.get("key1"), "new_value1");
+  EXPECT_FALSE(lsm.get("key2").has_value());
+  EXPECT_EQ(lsm.get("key3"), "value3");
+}
+
+TEST_F(LSMTest, RangeDelete) {
+  // begin 需要通过 shared_from_this 持有引擎
+  auto engine_ptr = std::make_shared<LSMEngine>(test_dir);
+  auto &engine = *engine_ptr;
+  const int num = 2000;
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+    for (int i = 0; i < num; i++) {
+      engine.put("key" + std::to_string(i),
+                 "v" + std::to_string(round) + "_" + std::to_string(i),
+                 round + 1);
+    }
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(engine.current_version()->level_ssts(0).empty());
+
+  // 按字典序删除 key1, key10 ~ key19, key100 ~ key199, key1000 ~ key1999
+  engine.remove_range("key1", "key2", 100);
+  // 范围删除之后的写入不受影响
+  engine.put("key15", "new", 101);
+  auto deleted = [](const std::string &key) {
+    return key >= "key1" && key < "key2" && key != "key15";
+  };
+  auto expected_value = [&](int i) -> std::optional<std::string> {
+    auto key = "key" + std::to_string(i);
+    if (key == "key15") {
+      return "new";
+    }
+    if (deleted(key)) {
+      return std::nullopt;
+    }
+    return "v" + std::to_string(LSM_SST_LEVEL_RATIO - 1) + "_" +
+           std::to_string(i);
+  };
+
+  std::map<std::string, std::string> fillers;
+  auto check = [&]() {
+    std::vector<std::string> keys;
+    for (int i = 0; i < num; i++) {
+      keys.push_back("key" + std::to_string(i));
+      EXPECT_EQ(engine.get(keys.back(), 0).has_value(),
+                expected_value(i).has_value())
+          << keys.back();
+    }
+    EXPECT_EQ(engine.get("key15", 0)->first, "new");
+    // 范围删除之前的事务仍然可以看到旧版本
+    EXPECT_EQ(engine.get("key1500", 99)->first,
+              "v" + std::to_string(LSM_SST_LEVEL_RATIO - 1) + "_1500");
+
+    auto results = engine.get_batch(keys, 0);
+    for (int i = 0; i < num; i++) {
+      auto expected = expected_value(i);
+      ASSERT_EQ(results[i].second.has_value(), expected.has_value()) << keys[i];
+      if (expected.has_value()) {
+        EXPECT_EQ(results[i].second->first, expected.value());
+      }
+    }
+    results = engine.get_batch(keys, 99);
+    for (int i = 0; i < num; i++) {
+      EXPECT_TRUE(results[i].second.has_value()) << keys[i];
+    }
+
+    std::map<std::string, std::string> expected_scan = fillers;
+    for (int i = 0; i < num; i++) {
+      if (auto value = expected_value(i)) {
+        expected_scan["key" + std::to_string(i)] = value.value();
+      }
+    }
+    std::map<std::string, std::string> scanned;
+    auto result = engine.lsm_iters_monotony_predicate(
+        0, [](const std::string &) { return 0; });
+    ASSERT_TRUE(result.has_value());
+    for (auto it = result->first; it.is_valid(); ++it) {
+      scanned[std::string(it.key())] = std::string(it.value());
+    }
+    EXPECT_EQ(scanned, expected_scan);
+
+    scanned.clear();
+    for (auto it = engine.begin(0); it.is_valid(); ++it) {
+      scanned[std::string(it.key())] = std::string(it.value());
+    }
+    EXPECT_EQ(scanned, expected_scan);
+  };
+
+  // 1. 标记位于内存表中
+  check();
+  // 2. 标记位于 l0 的 sst 中
+  engine.flush();
+  ASSERT_EQ(engine.current_version()->level_ssts(0).size(), 1);
+  check();
+  // 3. 标记随 compact 进入下层
+  for (int round = 1; round < LSM_SST_LEVEL_RATIO; round++) {
+    engine.put("filler" + std::to_string(round), "value", 200 + round);
+    fillers["filler" + std::to_string(round)] = "value";
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(engine.current_version()->level_ssts(0).empty());
+  check();
+}
+
+TEST_F(LSMTest, RangeDeleteRecover) {
+  {
+    LSM lsm(test_dir);
+    for (int i = 0; i < 100; i++) {
+      lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+    }
+    WriteBatch batch;
+    batch.put("key50", "before");
+    // 同一个 batch 中范围删除覆盖之前的写入, 不影响之后的写入
+    batch.remove_range("key5", "key6");
+    batch.put("key55", "after");
+    lsm.write(std::move(batch));
+    lsm.remove_range("key2", "key3");
+    EXPECT_FALSE(lsm.get("key50").has_value());
+    EXPECT_EQ(lsm.get("key55").value(), "after");
+  }
+  LSM lsm(test_dir);
+  for (int i = 0; i < 100; i++) {
+    auto key = "key" + std::to_string(i);
+    auto value = lsm.get(key);
+    if (key == "key55") {
+      EXPECT_EQ(value.value(), "after");
+    } else if ((key >= "key2" && key < "key3") ||
+               (key >= "key5" && key < "key6")) {
+      EXPECT_FALSE(value.has_value()) << key;
+    } else {
+      EXPECT_EQ(value.value(), "value" + std::to_string(i));
+    }
+  }
+}
+
+// 批量查询与逐个查询的结果一致: 内存表中的记录 (包括删除标记) 优先,
+// 其次是 l0 的 sst, 最后是更深的 level
+TEST_F(LSMTest, GetBatchMatchesGet) {
+  LSMEngine engine(test_dir);
+  const int num = 2000;
+  for (int round = 0; round < LSM_SST_LEVEL_RATIO; round++) {
+    for (int i = 0; i < num; i++) {
+      engine.put("key" + std::to_string(i),
+                 "v" + std::to_string(round) + "_" + std::to_string(i),
+                 round + 1);
+    }
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  ASSERT_TRUE(engine.current_version()->level_ssts(0).empty());
+
+  // l0 中的新版本和删除标记
+  for (int i = 0; i < num; i++) {
+    if (i % 5 == 0) {
+      engine.remove("key" + std::to_string(i), 100);
+    } else if (i % 3 == 0) {
+      engine.put("key" + std::to_string(i), "l0_" + std::to_string(i), 100);
+    }
+  }
+  engine.flush();
+  ASSERT_EQ(engine.current_version()->level_ssts(0).size(), 1);
+
+  // 内存表中的新版本和删除标记
+  for (int i = 0; i < num; i++) {
+    if (i % 11 == 0) {
+      engine.remove("key" + std::to_string(i), 200);
+    } else if (i % 7 == 0) {
+      engine.put("key" + std::to_string(i), "mem_" + std::to_string(i), 200);
+    }
+  }
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < num; i++) {
+    keys.push_back("key" + std::to_string(i));
+    if (i % 10 == 0) {
+      keys.push_back("missing" + std::to_string(i));
+    }
+    if (i % 13 == 0) {
+      // 重复的 key 只查询一次, 每个位置都返回结果
+      keys.push_back("key" + std::to_string(i / 2));
+    }
+  }
+  for (uint64_t tranc_id : {0, 150, 50}) {
+    auto results = engine.get_batch(keys, tranc_id);
+    ASSERT_EQ(results.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_EQ(results[i].first, keys[i]);
+      auto expected = engine.get(keys[i], tranc_id);
+      ASSERT_EQ(results[i].second.has_value(), expected.has_value())
+          << keys[i] << " at " << tranc_id;
+      if (expected.has_value()) {
+        EXPECT_EQ(results[i].second->first, expected->first);
+      }
+    }
+  }
+
+  auto results = engine.get_batch({"key0", "key21", "key39", "key5", "key1"}, 0);
+  EXPECT_FALSE(results[0].second.has_value());
+  EXPECT_EQ(results[1].second->first, "mem_21");
+  EXPECT_EQ(results[2].second->first, "l0_39");
+  EXPECT_FALSE(results[3].second.has_value());
+  EXPECT_EQ(results[4].second->first,
+            "v" + std::to_string(LSM_SST_LEVEL_RATIO - 1) + "_1");
+}
+
+// merge 操作数在内存表, 刷盘后的 sst, 快照和遍历中的合并结果
+TEST_F(LSMTest, MergeOperator) {
+  auto engine = std::make_shared<LSMEngine>(
+      test_dir, CompactType::FullCompact, nullptr,
+      std::make_shared<Int64AddOperator>());
+  engine->put("c1", "10", 1);
+  engine->merge("c1", "5", 2);
+  engine->merge("c1", "-3", 3);
+  engine->merge("c2", "7", 4);
+  EXPECT_EQ(engine->get("c1", 0)->first, "12");
+  EXPECT_EQ(engine->get("c1", 0)->second, 3);
+  EXPECT_EQ(engine->get("c1", 2)->first, "15");
+  EXPECT_EQ(engine->get("c1", 1)->first, "10");
+  EXPECT_EQ(engine->get("c2", 0)->first, "7");
+
+  // 刷盘时每个操作数被合并为其所在版本的完整 value
+  engine->flush();
+  EXPECT_EQ(engine->get("c1", 0)->first, "12");
+  EXPECT_EQ(engine->get("c1", 2)->first, "15");
+  engine->merge("c1", "100", 5);
+  EXPECT_EQ(engine->get("c1", 0)->first, "112");
+  EXPECT_EQ(engine->get("c1", 4)->first, "12");
+
+  // 范围删除之后的操作数没有基础值
+  engine->remove_range("c", "d", 6);
+  engine->merge("c1", "1", 7);
+  EXPECT_EQ(engine->get("c1", 0)->first, "1");
+  EXPECT_FALSE(engine->get("c2", 0).has_value());
+  EXPECT_EQ(engine->get("c1", 5)->first, "112");
+
+  auto snapshot = engine->get_snapshot(8);
+  engine->merge("c3", "2", 8);
+  engine->merge("c1", "1", 9);
+  EXPECT_EQ(engine->get("c1", *snapshot)->first, "1");
+  EXPECT_EQ(engine->get("c3", *snapshot)->first, "2");
+  EXPECT_EQ(engine->get("c1", 0)->first, "2");
+
+  // 无法合并的操作数被忽略
+  engine->put("s", "abc", 10);
+  engine->merge("s", "1", 11);
+  EXPECT_EQ(engine->get("s", 0)->first, "abc");
+
+  auto results = engine->get_batch({"c1", "c2", "c3", "s"}, 0);
+  EXPECT_EQ(results[0].second->first, "2");
+  EXPECT_FALSE(results[1].second.has_value());
+  EXPECT_EQ(results[2].second->first, "2");
+  EXPECT_EQ(results[3].second->first, "abc");
+
+  std::map<std::string, std::string> expected = {
+      {"c1", "2"}, {"c3", "2"}, {"s", "abc"}};
+  std::map<std::string, std::string> scanned;
+  for (auto it = engine->begin(0); it != engine->end(); ++it) {
+    scanned[it->first] = it->second;
+  }
+  EXPECT_EQ(scanned, expected);
+  auto range = engine->lsm_iters_monotony_predicate(
+      0, [](const std::string &key) {
+        if (key < "c") {
+          return 1;
+        }
+        return key < "d" ? 0 : -1;
+      });
+  ASSERT_TRUE(range.has_value());
+  scanned.clear();
+  for (auto it = range->first; it.is_valid(); ++it) {
+    scanned[std::string(it.key())] = std::string(it.value());
+  }
+  expected.erase("s");
+  EXPECT_EQ(scanned, expected);
+
+  // 全部刷盘之后 sst 中只有完整的 value
+  while (engine->memtable.get_total_size() > 0) {
+    engine->flush();
+  }
+  EXPECT_EQ(engine->get("c1", 0)->first, "2");
+  EXPECT_EQ(engine->get("c1", 8)->first, "1");
+  EXPECT_EQ(engine->get("c3", 0)->first, "2");
+  EXPECT_EQ(engine->get("s", 0)->first, "abc");
+}
+
+TEST_F(LSMTest, MergeRecover) {
+  {
+    LSM lsm(test_dir, CompactType::FullCompact, nullptr,
+            std::make_shared<StringAppendOperator>());
+    lsm.put("k", "a");
+    lsm.merge("k", "b");
+    WriteBatch batch;
+    // 同一个 batch 中对同一个 key 的多次 merge 合并为一条记录
+    batch.merge("k", "c");
+    batch.merge("k", "d");
+    batch.put("m", "1");
+    batch.merge("m", "2");
+    batch.merge("n", "x");
+    lsm.write(std::move(batch));
+    EXPECT_EQ(lsm.get("k").value(), "abcd");
+    EXPECT_EQ(lsm.get("m").value(), "12");
+    EXPECT_EQ(lsm.get("n").value(), "x");
+  }
+  LSM lsm(test_dir, CompactType::FullCompact, nullptr,
+          std::make_shared<StringAppendOperator>());
+  EXPECT_EQ(lsm.get("k").value(), "abcd");
+  EXPECT_EQ(lsm.get("m").value(), "12");
+  EXPECT_EQ(lsm.get("n").value(), "x");
+  lsm.merge("n", "y");
+  EXPECT_EQ(lsm.get("n").value(), "xy");
+}
+
+// get_stats 汇总读写路径和后台任务的统计信息
+TEST_F(LSMTest, Statistics) {
+  LSM lsm(test_dir);
+  for (int i = 0; i < 1000; i++) {
+    lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  lsm.flush();
+  lsm.put("mem_key", "mem_value");
+
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(lsm.get("key" + std::to_string(i)).has_value());
+  }
+  EXPECT_TRUE(lsm.get("mem_key").has_value());
+  // 位于 sst 的范围内, 但不存在的 key
+  for (int i = 0; i < 100; i++) {
+    EXPECT_FALSE(lsm.get("key" + std::to_string(i) + "!missing").has_value());
+  }
+
+  auto stats = lsm.get_stats();
+  EXPECT_EQ(stats.ticker(Ticker::GetHitMemtable), 1);
+  EXPECT_EQ(stats.ticker(Ticker::GetHitL0), 1000);
+  EXPECT_EQ(stats.ticker(Ticker::GetMiss), 100);
+  EXPECT_EQ(stats.ticker(Ticker::BloomTruePositive), 1000);
+  EXPECT_EQ(stats.ticker(Ticker::BloomUseful) +
+                stats.ticker(Ticker::BloomFullPositive),
+            1100);
+  EXPECT_EQ(stats.bloom_false_positive(),
+            stats.ticker(Ticker::BloomFullPositive) - 1000);
+  EXPECT_EQ(stats.histogram(HistogramType::Get).count, 1101);
+  EXPECT_EQ(stats.histogram(HistogramType::SstPerGet).count, 1100);
+  EXPECT_EQ(stats.histogram(HistogramType::SstPerGet).max, 1);
+  EXPECT_EQ(stats.histogram(HistogramType::Write).count, 1001);
+  EXPECT_EQ(stats.histogram(HistogramType::Flush).count, 1);
+  EXPECT_GT(stats.ticker(Ticker::FlushBytes), 0);
+  EXPECT_GT(stats.memtable_bytes, 0);
+  ASSERT_EQ(stats.levels.size(), 1);
+  EXPECT_EQ(stats.levels[0].level, 0);
+  EXPECT_EQ(stats.levels[0].num_ssts, 1);
+  EXPECT_EQ(stats.levels[0].bytes, stats.ticker(Ticker::FlushBytes));
+
+  auto text = stats.to_string();
+  EXPECT_NE(text.find("# Stats\r\n"), std::string::npos);
+  EXPECT_NE(text.find("get_hit_l0:1000\r\n"), std::string::npos);
+  EXPECT_NE(text.find("level0:ssts=1,"), std::string::npos);
+  EXPECT_NE(text.find("get_micros:count=1101,"), std::string::npos);
+
+  // 事务的提交经过 WAL
+  auto tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  tranc->put("tranc_key", "tranc_value");
+  EXPECT_TRUE(tranc->commit());
+  stats = lsm.get_stats();
+  EXPECT_EQ(stats.histogram(HistogramType::Commit).count, 1);
+  EXPECT_GE(stats.histogram(HistogramType::WalSync).count, 1);
+  EXPECT_GT(stats.ticker(Ticker::WalBytes), 0);
+}
+
+// perf context 只记录当前线程上开启之后的调用
+TEST_F(LSMTest, PerfContext) {
+  LSM lsm(test_dir);
+  for (int i = 0; i < 1000; i++) {
+    lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  lsm.flush();
+  lsm.put("mem_key", "mem_value");
+
+  // 默认关闭, 不记录任何数据
+  get_perf_context().reset();
+  EXPECT_TRUE(lsm.get("key1").has_value());
+  EXPECT_EQ(get_perf_context().to_string(), "");
+
+  set_perf_level(PerfLevel::EnableTime);
+  get_perf_context().reset();
+  EXPECT_TRUE(lsm.get("mem_key").has_value());
+  auto &ctx = get_perf_context();
+  EXPECT_GE(ctx.memtable_probes, 1);
+  EXPECT_EQ(ctx.sst_checked, 0);
+  EXPECT_GT(ctx.get_nanos, 0);
+  EXPECT_GE(ctx.get_nanos, ctx.memtable_get_nanos);
+
+  get_perf_context().reset();
+  EXPECT_TRUE(lsm.get("key500").has_value());
+  EXPECT_EQ(ctx.sst_checked, 1);
+  EXPECT_EQ(ctx.bloom_positive, 1);
+  EXPECT_EQ(ctx.block_cache_hits + ctx.block_cache_misses, 1);
+  EXPECT_EQ(ctx.blocks_read, ctx.block_cache_misses);
+  EXPECT_GT(ctx.get_from_l0_nanos, 0);
+  EXPECT_NE(ctx.to_string().find("sst_checked = 1"), std::string::npos);
+
+  // 第二次读取同一个 block 命中缓存
+  get_perf_context().reset();
+  EXPECT_TRUE(lsm.get("key500").has_value());
+  EXPECT_EQ(ctx.block_cache_hits, 1);
+  EXPECT_EQ(ctx.blocks_read, 0);
+
+  get_perf_context().reset();
+  EXPECT_FALSE(lsm.get("key500!missing").has_value());
+  EXPECT_EQ(ctx.sst_checked, 1);
+  EXPECT_EQ(ctx.bloom_useful + ctx.bloom_positive, 1);
+
+  // 只计数时不记录耗时
+  set_perf_level(PerfLevel::EnableCount);
+  get_perf_context().reset();
+  EXPECT_TRUE(lsm.get("key501").has_value());
+  EXPECT_EQ(ctx.sst_checked, 1);
+  EXPECT_EQ(ctx.get_nanos, 0);
+  set_perf_level(PerfLevel::Disable);
+}
+
+// 同一个进程中的引擎可以使用不同的参数
+TEST_F(LSMTest, Options) {
+  Options bad;
+  bad.tol_mem_size_limit = bad.per_mem_size_limit - 1;
+  EXPECT_THROW(LSM(test_dir, bad), std::runtime_error);
+
+  Options options;
+  options.per_mem_size_limit = 16 * 1024;
+  options.tol_mem_size_limit = 64 * 1024;
+  options.block_size = 1024;
+  LSMEngine engine(test_dir, options);
+  EXPECT_EQ(engine.options.per_mem_size_limit, 16 * 1024);
+
+  std::string value(100, 'v');
+  for (int i = 0; i < 5000; i++) {
+    engine.put("key" + std::to_string(i), value, 1);
+  }
+  engine.wait_for_bg_jobs();
+  // 默认参数下这些数据全部位于内存表中
+  EXPECT_LT(engine.memtable.get_total_size(), options.tol_mem_size_limit);
+  EXPECT_FALSE(engine.current_version()->levels().empty());
+  for (int i = 0; i < 5000; i += 37) {
+    auto res = engine.get("key" + std::to_string(i), 0);
+    ASSERT_TRUE(res.has_value());
+    EXPECT_EQ(res->first, value);
+  }
+}
+
+// 关闭自动 compact 后 l0 可以超过触发的数量, 重新开启后恢复
+TEST_F(LSMTest, SetOptions) {
+  Options options;
+  options.level0_compact_trigger = 2;
+  LSMEngine engine(test_dir, options);
+
+  MutableOptions mutable_options = *engine.mutable_options();
+  mutable_options.disable_auto_compactions = true;
+  engine.set_options(mutable_options);
+  EXPECT_TRUE(engine.mutable_options()->disable_auto_compactions);
+
+  for (int i = 0; i < 4; i++) {
+    engine.put("key" + std::to_string(i), "value" + std::to_string(i), 1);
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  EXPECT_EQ(engine.current_version()->num_ssts(0), 4);
+
+  // 不合法的参数不会生效
+  MutableOptions bad = mutable_options;
+  bad.level0_compact_trigger = 0;
+  EXPECT_THROW(engine.set_options(bad), std::runtime_error);
+  EXPECT_EQ(engine.mutable_options()->level0_compact_trigger, 2);
+
+  mutable_options.disable_auto_compactions = false;
+  engine.set_options(mutable_options);
+  engine.wait_for_bg_jobs();
+  EXPECT_LT(engine.current_version()->num_ssts(0), 2);
+  for (int i = 0; i < 4; i++) {
+    auto res = engine.get("key" + std::to_string(i), 0);
+    ASSERT_TRUE(res.has_value());
+    EXPECT_EQ(res->first, "value" + std::to_string(i));
+  }
+}
+
+// 多个引擎共用缓存和内存表的限制
+TEST_F(LSMTest, SharedCacheAndWriteBuffer) {
+  Options options;
+  options.block_cache = std::make_shared<BlockCache>(
+      LSMmm_BLOCK_CACHE_CAPACITY, LSMmm_BLOCK_CACHE_K);
+  options.write_buffer_manager =
+      std::make_shared<WriteBufferManager>(256 * 1024);
+  auto engine1 = std::make_unique<LSMEngine>(test_dir + "/db1", options);
+  LSMEngine engine2(test_dir + "/db2", options);
+
+  // 两个引擎中的 sst_id 相同, 缓存中的 block 不会混淆
+  for (int i = 0; i < 100; i++) {
+    engine1->put("key" + std::to_string(i), "value1_" + std::to_string(i), 1);
+    engine2.put("key" + std::to_string(i), "value2_" + std::to_string(i), 1);
+  }
+  engine1->flush();
+  engine2.flush();
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      EXPECT_EQ(engine1->get("key" + std::to_string(i), 0)->first,
+                "value1_" + std::to_string(i));
+      EXPECT_EQ(engine2.get("key" + std::to_string(i), 0)->first,
+                "value2_" + std::to_string(i));
+    }
+  }
+  EXPECT_GT(options.block_cache->get_usage(), 0);
+
+  // 单个引擎的内存表远小于 tol_mem_size_limit, 但总和超过了共用的限制
+  std::string value(1024, 'v');
+  for (int i = 0; i < 1000; i++) {
+    engine1->put("big" + std::to_string(i), value, 1);
+  }
+  engine1->wait_for_bg_jobs();
+  engine2.wait_for_bg_jobs();
+  EXPECT_LT(engine1->memtable.get_total_size(), 256 * 1024);
+  EXPECT_LE(options.write_buffer_manager->memory_usage(), 256 * 1024);
+  for (int i = 0; i < 1000; i += 37) {
+    EXPECT_EQ(engine1->get("big" + std::to_string(i), 0)->first, value);
+  }
+
+  // 关闭的引擎不再计入总和
+  engine1.reset();
+  EXPECT_EQ(options.write_buffer_manager->memory_usage(),
+            engine2.memtable.get_total_size());
+}
+
+TEST_F(LSMTest, ColumnFamily) {
+  {
+    LSM lsm(test_dir);
+    auto users = lsm.create_column_family("users");
+    auto orders = lsm.create_column_family("orders");
+    EXPECT_THROW(lsm.create_column_family("users"), std::runtime_error);
+    EXPECT_THROW(lsm.create_column_family(LSM_DEFAULT_COLUMN_FAMILY),
+                 std::runtime_error);
+    EXPECT_EQ(lsm.list_column_families().size(), 3);
+    EXPECT_EQ(lsm.get_column_family("users"), users);
+    EXPECT_EQ(lsm.get_column_family("missing"), nullptr);
+
+    // 不同列族中相同的 key 互不影响
+    lsm.put("k", "default");
+    lsm.put(*users, "k", "user");
+    EXPECT_EQ(lsm.get("k").value(), "default");
+    EXPECT_EQ(lsm.get(*users, "k").value(), "user");
+    EXPECT_FALSE(lsm.get(*orders, "k").has_value());
+    lsm.remove(*users, "k");
+    EXPECT_FALSE(lsm.get(*users, "k").has_value());
+    EXPECT_EQ(lsm.get("k").value(), "default");
+
+    // 一个 batch 可以同时写入多个列族
+    WriteBatch batch;
+    batch.put(*users, "u1", "alice");
+    batch.put(*orders, "o1", "u1");
+    batch.put("meta", "v");
+    lsm.write(std::move(batch));
+    lsm.flush_all();
+    EXPECT_EQ(lsm.get(*users, "u1").value(), "alice");
+    EXPECT_EQ(lsm.get(*orders, "o1").value(), "u1");
+
+    // 事务的冲突检测区分列族
+    auto tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+    tranc->put(*users, "u2", "bob");
+    tranc->put(*orders, "o2", "u2");
+    lsm.put("u2", "default");
+    EXPECT_EQ(tranc->get(*users, "u2").value(), "bob");
+    EXPECT_TRUE(tranc->commit());
+    tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+    tranc->put(*users, "u2", "carol");
+    lsm.put(*users, "u2", "dave");
+    EXPECT_FALSE(tranc->commit());
+
+    auto iter = lsm.new_iterator(*orders);
+    std::vector<std::string> keys;
+    for (iter.seek_to_first(); iter.is_valid(); iter.next()) {
+      keys.emplace_back(iter.key());
+    }
+    EXPECT_EQ(keys, (std::vector<std::string>{"o1", "o2"}));
+
+    // 只写入 WAL 和 memtable 的数据重启后通过 WAL 恢复到对应的列族
+    WriteBatch unflushed;
+    unflushed.put(*orders, "o3", "u1");
+    unflushed.remove(*users, "u1");
+    lsm.write(std::move(unflushed));
+  }
+  {
+    // 已经创建的列族重启后自动打开
+    LSM lsm(test_dir);
+    auto users = lsm.get_column_family("users");
+    auto orders = lsm.get_column_family("orders");
+    ASSERT_NE(users, nullptr);
+    ASSERT_NE(orders, nullptr);
+    EXPECT_FALSE(lsm.get(*users, "u1").has_value());
+    EXPECT_EQ(lsm.get(*users, "u2").value(), "dave");
+    EXPECT_EQ(lsm.get(*orders, "o3").value(), "u1");
+    EXPECT_EQ(lsm.get("u2").value(), "default");
+  }
+  Options options;
+  options.merge_operator = std::make_shared<StringAppendOperator>();
+  LSM lsm(test_dir, Options{}, {{"orders", options}, {"logs", options}});
+  EXPECT_EQ(lsm.list_column_families().size(), 4);
+  auto orders = lsm.get_column_family("orders");
+  EXPECT_EQ(lsm.get(*orders, "o1").value(), "u1");
+  WriteBatch batch;
+  batch.merge(*orders, "o1", "2");
+  batch.merge(*lsm.get_column_family("logs"), "l", "x");
+  lsm.write(std::move(batch));
+  EXPECT_EQ(lsm.get(*orders, "o1").value(), "u12");
+  EXPECT_EQ(lsm.get(*lsm.get_column_family("logs"), "l").value(), "x");
+}
+
+// flush 和 compact 的写入经过限速器, 并按输出的层级区分优先级
+TEST_F(LSMTest, RateLimiter) {
+  Options options;
+  options.rate_limiter = std::make_shared<RateLimiter>(256 << 20, true);
+  LSMEngine engine(test_dir, options);
+  for (size_t i = 0; i < options.level0_compact_trigger; i++) {
+    for (int j = 0; j < 100; j++) {
+      engine.put("key" + std::to_string(j), "value" + std::to_string(i), 1);
+    }
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  auto &limiter = *options.rate_limiter;
+  EXPECT_GT(limiter.get_total_bytes_through(IOPriority::Flush), 0);
+  EXPECT_GT(limiter.get_total_bytes_through(IOPriority::L0Compaction), 0);
+  EXPECT_EQ(limiter.get_total_bytes_through(IOPriority::Compaction), 0);
+  // compact 结束后积压已经消化, 速率回到下限
+  EXPECT_EQ(limiter.get_effective_bytes_per_second(),
+            (256 << 20) / LSM_RATE_LIMITER_AUTO_TUNE_RATIO);
+  EXPECT_EQ(engine.get("key7", 0)->first,
+            "value" + std::to_string(options.level0_compact_trigger - 1));
+}
+
+TEST_F(LSMTest, IngestExternalFiles) {
+  std::string file1 = test_dir + "/external1.sst";
+  std::string file2 = test_dir + "/external2.sst";
+  SstFileWriter writer;
+  writer.open(file1);
+  writer.put("k1", "ingested");
+  writer.remove("k2");
+  writer.put("k3", "ingested");
+  EXPECT_THROW(writer.put("k0", "unordered"), std::runtime_error);
+  writer.finish();
+  writer.open(file2);
+  for (int i = 0; i < 1000; i++) {
+    writer.put("z" + std::to_string(100000 + i), "bulk" + std::to_string(i));
+  }
+  EXPECT_EQ(writer.num_entries(), 1000);
+  writer.finish();
+  writer.open(test_dir + "/empty.sst");
+  EXPECT_THROW(writer.finish(), std::runtime_error);
+
+  {
+    LSM lsm(test_dir + "/db");
+    lsm.put("k1", "old");
+    lsm.put("k2", "old");
+    lsm.put("k9", "old");
+    lsm.flush_all();
+    lsm.put("k3", "memtable");
+    auto snapshot = lsm.get_snapshot();
+
+    // 有重叠的文件不能一起导入
+    EXPECT_THROW(lsm.ingest_external_files({file1, file1}), std::runtime_error);
+    auto tranc_id = lsm.ingest_external_files({file2, file1});
+    EXPECT_GT(tranc_id, 0);
+    EXPECT_EQ(lsm.get("k1").value(), "ingested");
+    EXPECT_FALSE(lsm.get("k2").has_value());
+    EXPECT_EQ(lsm.get("k3").value(), "ingested");
+    EXPECT_EQ(lsm.get("k9").value(), "old");
+    EXPECT_EQ(lsm.get("z100500").value(), "bulk500");
+    // 导入之前的快照和事务看不到导入的数据
+    EXPECT_EQ(lsm.get("k1", *snapshot).value(), "old");
+    EXPECT_FALSE(lsm.get("z100500", *snapshot).has_value());
+    auto batch = lsm.get_batch({"k1", "k2", "z100999"});
+    EXPECT_EQ(batch[0].second.value(), "ingested");
+    EXPECT_FALSE(batch[1].second.has_value());
+    EXPECT_EQ(batch[2].second.value(), "bulk999");
+
+    size_t count = 0;
+    auto iter = lsm.new_iterator();
+    for (iter.seek("z"); iter.is_valid(); iter.next()) {
+      count++;
+    }
+    EXPECT_EQ(count, 1000);
+    lsm.put("k1", "newer");
+  }
+  // 文件通过链接导入, 原文件仍然存在
+  EXPECT_TRUE(std::filesystem::exists(file1));
+
+  // 全局 tranc_id 记录在 MANIFEST 中, 重启后导入的数据与之后的写入保持顺序
+  LSM lsm(test_dir + "/db");
+  EXPECT_EQ(lsm.get("k1").value(), "newer");
+  EXPECT_EQ(lsm.get("k3").value(), "ingested");
+  EXPECT_EQ(lsm.get("z100000").value(), "bulk0");
+  lsm.put("z100001", "overwritten");
+  lsm.flush_all();
+  EXPECT_EQ(lsm.get("z100001").value(), "overwritten");
+  EXPECT_EQ(lsm.get("z100002").value(), "bulk2");
+
+  // compact 输出真实的 tranc_id, 更旧的版本仍然按 tranc_id 区分
+  LSMEngine engine(test_dir + "/engine");
+  engine.put("k1", "v50", 50);
+  engine.flush();
+  engine.ingest_external_files({file1}, 100);
+  EXPECT_EQ(engine.current_version()->num_ssts(0), 2);
+  engine.put("k3", "v200", 200);
+  engine.flush();
+  for (size_t i = 0; i < LSM_SST_LEVEL_RATIO; i++) {
+    engine.put("other" + std::to_string(i), "v", 300);
+    engine.flush();
+  }
+  engine.wait_for_bg_jobs();
+  EXPECT_GE(engine.current_version()->max_level(), 1);
+  EXPECT_EQ(engine.get("k1", 0)->first, "ingested");
+  EXPECT_EQ(engine.get("k1", 60)->first, "v50");
+  EXPECT_FALSE(engine.get("k2", 0).has_value());
+  EXPECT_EQ(engine.get("k3", 0)->first, "v200");
+  EXPECT_EQ(engine.get("k3", 150)->first, "ingested");
+}
+
+TEST_F(LSMTest, Checkpoint) {
+  {
+    // 没有 compact 删除原文件时, 两个目录中的 sst 是同一个文件
+    LSM lsm(test_dir + "/quiet");
+    lsm.put("k", "v");
+    lsm.create_checkpoint(test_dir + "/quiet_checkpoint");
+    size_t sst_num = 0;
+    for (auto &entry :
+         std::filesystem::directory_iterator(test_dir + "/quiet_checkpoint")) {
+      if (entry.path().filename().string().rfind("sst_", 0) == 0) {
+        EXPECT_EQ(std::filesystem::hard_link_count(entry.path()), 2);
+        sst_num++;
+      }
+    }
+    EXPECT_EQ(sst_num, 1);
+  }
+
+  Options options;
+  options.per_mem_size_limit = 16 * 1024;
+  options.tol_mem_size_limit = 64 * 1024;
+  std::string checkpoint_dir = test_dir + "/checkpoint";
+  std::atomic<int> committed{0};
+  {
+    LSM lsm(test_dir + "/db", options);
+    auto users = lsm.create_column_family("users");
+    for (int i = 0; i < 2000; i++) {
+      lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+    }
+    lsm.put(*users, "u1", "alice");
+    lsm.remove("key0");
+
+    // 检查点期间持续提交事务, 并触发 flush 和 compact
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+      for (int i = 0; !stop.load(); i++) {
+        auto tranc = lsm.begin_tran(IsolationLevel::READ_COMMITTED);
+        tranc->put("tranc" + std::to_string(i), std::string(100, 'x'));
+        EXPECT_TRUE(tranc->commit());
+        committed = i + 1;
+      }
+    });
+    while (committed.load() < 20) {
+      std::this_thread::yield();
+    }
+    int committed_before = committed.load();
+    lsm.create_checkpoint(checkpoint_dir);
+    stop = true;
+    writer.join();
+    committed = committed_before;
+
+    EXPECT_THROW(lsm.create_checkpoint(checkpoint_dir), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(checkpoint_dir + ".tmp"));
+    lsm.put("key1", "after checkpoint");
+  }
+
+  // 检查点可以作为独立的数据目录打开, 不包含之后的写入
+  LSM lsm(checkpoint_dir, options);
+  EXPECT_FALSE(lsm.get("key0").has_value());
+  EXPECT_EQ(lsm.get("key1").value(), "value1");
+  EXPECT_EQ(lsm.get("key1999").value(), "value1999");
+  for (int i = 0; i < committed.load(); i++) {
+    EXPECT_TRUE(lsm.get("tranc" + std::to_string(i)).has_value()) << i;
+  }
+  auto users = lsm.get_column_family("users");
+  ASSERT_NE(users, nullptr);
+  EXPECT_EQ(lsm.get(*users, "u1").value(), "alice");
+  // 检查点中分配的 tranc_id 不会与已有的记录重复
+  lsm.put("key2", "new");
+  EXPECT_EQ(lsm.get("key2").value(), "new");
+}
+
+TEST_F(LSMTest, Replication) {
+  Options options;
+  options.wal_all_writes = true;
+  LSM leader(test_dir + "/leader", options);
+  leader.put("k0", "v0");
+  // 从节点从主节点的检查点开始, 检查点中记录了继续复制的位置
+  leader.create_checkpoint(test_dir + "/follower");
+  WalPosition position;
+  {
+    LSM follower(test_dir + "/follower");
+    ASSERT_TRUE(follower.get_replication_position().has_value());
+    position = follower.get_replication_position().value();
+    EXPECT_EQ(follower.get("k0").value(), "v0");
+
+    leader.put("k1", "v1");
+    leader.remove("k0");
+    WriteBatch batch;
+    batch.put("k2", "v2");
+    batch.remove_range("r0", "r9");
+    leader.write(std::move(batch));
+    auto tranc = leader.begin_tran(IsolationLevel::REPEATABLE_READ);
+    tranc->put("k3", "v3");
+    EXPECT_TRUE(tranc->commit());
+    // 回滚的事务不会出现在复制流中
+    tranc = leader.begin_tran(IsolationLevel::REPEATABLE_READ);
+    tranc->put("k4", "v4");
+    EXPECT_TRUE(tranc->abort());
+
+    // 经过编码后传输给从节点
+    auto encoded = leader.read_replication_log(position).encode();
+    auto replicated = ReplicationBatch::decode(encoded.data(), encoded.size());
+    follower.apply_replication_batch(replicated);
+    EXPECT_FALSE(follower.get("k0").has_value());
+    EXPECT_EQ(follower.get("k1").value(), "v1");
+    EXPECT_EQ(follower.get("k2").value(), "v2");
+    EXPECT_EQ(follower.get("k3").value(), "v3");
+    EXPECT_FALSE(follower.get("k4").has_value());
+    EXPECT_EQ(follower.get_replication_position(), replicated.next);
+
+    // 复制流已经追上主节点
+    auto empty = leader.read_replication_log(replicated.next);
+    EXPECT_TRUE(empty.records.empty());
+    EXPECT_EQ(empty.next, leader.get_wal_position());
+
+    // 每次只读取一部分时, 多次读取后同样追上主节点, 其间跨越多个 WAL 文件
+    for (int i = 0; i < 200; i++) {
+      leader.put("key" + std::to_string(i), std::string(100, 'v'));
+    }
+    position = empty.next;
+    int reads = 0;
+    while (position != leader.get_wal_position()) {
+      auto part = leader.read_replication_log(position, 1);
+      follower.apply_replication_batch(part);
+      position = part.next;
+      reads++;
+    }
+    EXPECT_GT(reads, 1);
+    EXPECT_EQ(follower.get("key199").value(), std::string(100, 'v'));
+
+    WalPosition stale = position;
+    stale.epoch++;
+    EXPECT_THROW(leader.read_replication_log(stale), std::runtime_error);
+  }
+
+  // 从节点重启后从保存的位置继续复制
+  LSM follower(test_dir + "/follower");
+  EXPECT_EQ(follower.get_replication_position(), position);
+  EXPECT_EQ(follower.get("k1").value(), "v1");
+  EXPECT_EQ(follower.get("key0").value(), std::string(100, 'v'));
+  leader.put("k5", "v5");
+  follower.apply_replication_batch(leader.read_replication_log(position));
+  EXPECT_EQ(follower.get("k5").value(), "v5");
+}
+
+// 行缓存中的版本在写入内存表, 范围删除和旧事务的读取下都保持正确
+TEST_F(LSMTest, RowCache) {
+  Options options;
+  options.row_cache_capacity = 1 << 20;
+  LSM lsm(test_dir, options);
+  for (int i = 0; i < 100; i++) {
+    lsm.put("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  lsm.flush();
+
+  // 第一次从 sst 中读取后填充, 第二次命中
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      EXPECT_EQ(lsm.get("key" + std::to_string(i)).value(),
+                "value" + std::to_string(i));
+    }
+  }
+  auto stats = lsm.get_stats();
+  EXPECT_EQ(stats.ticker(Ticker::GetHitRowCache), 100);
+  EXPECT_EQ(stats.ticker(Ticker::GetHitL0), 100);
+  EXPECT_GT(stats.row_cache_usage, 0);
+
+  // 覆盖写入刷盘之后不能读到缓存的旧值
+  auto old_tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  lsm.put("key0", "new0");
+  lsm.remove("key1");
+  lsm.flush();
+  EXPECT_EQ(lsm.get("key0").value(), "new0");
+  EXPECT_EQ(lsm.get("key0").value(), "new0");
+  EXPECT_FALSE(lsm.get("key1").has_value());
+  // 旧事务读不到新缓存的版本
+  EXPECT_EQ(old_tranc->get("key0").value(), "value0");
+  EXPECT_EQ(old_tranc->get("key1").value(), "value1");
+
+  // 范围删除清空缓存
+  lsm.remove_range("key2", "key3");
+  EXPECT_FALSE(lsm.get("key2").has_value());
+  EXPECT_FALSE(lsm.get("key29").has_value());
+  lsm.flush();
+  EXPECT_FALSE(lsm.get("key2").has_value());
+  EXPECT_EQ(lsm.get("key3").value(), "value3");
+
+  // 事务的提交同样使缓存失效
+  auto tranc = lsm.begin_tran(IsolationLevel::REPEATABLE_READ);
+  tranc->put("key4", "tranc4");
+  EXPECT_TRUE(tranc->commit());
+  lsm.flush();
+  EXPECT_EQ(lsm.get("key4").value(), "tranc4");
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -1,7 +1,12 @@
 #include "../include/redis_wrapper/redis_wrapper.h"
+#include "../include/redis_wrapper/resp.h"
+#include "../include/redis_wrapper/sharded_redis.h"
+#include "../server/include/handler.h"
 #include <gtest/gtest.h>
 #include <memory>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 class RedisCommandsTest : public ::testing::Test {
@@ -48,6 +53,50 @@ TEST_F(RedisCommandsTest, IncrAndDecr) {
   EXPECT_EQ(lsm.decr(decr_args), "-1");
 }
 
+TEST_F(RedisCommandsTest, IncrAndAppend) {
+  RedisWrapper lsm(test_dir);
+
+  std::vector<std::string> append_args = {"APPEND", "str", "hello"};
+  EXPECT_EQ(lsm.append(append_args), ":5\r\n");
+  append_args[2] = " world";
+  EXPECT_EQ(lsm.append(append_args), ":11\r\n");
+  std::vector<std::string> get_args = {"GET", "str"};
+  EXPECT_EQ(lsm.get(get_args), "$11\r\nhello world\r\n");
+
+  // 不是整数的 value 不能自增, 也不会被修改
+  std::vector<std::string> incr_args = {"INCR", "str"};
+  EXPECT_EQ(lsm.incr(incr_args), "-ERR value is not an integer or out of range\r\n");
+  EXPECT_EQ(lsm.get(get_args), "$11\r\nhello world\r\n");
+
+  // 自增的结果刷盘后保持不变
+  incr_args[1] = "counter";
+  for (int i = 0; i < 10; i++) {
+    lsm.incr(incr_args);
+  }
+  lsm.flushall();
+  EXPECT_EQ(lsm.incr(incr_args), "11");
+  std::vector<std::string> append_counter = {"APPEND", "counter", "0"};
+  EXPECT_EQ(lsm.append(append_counter), ":3\r\n");
+  EXPECT_EQ(lsm.incr(incr_args), "111");
+}
+
+TEST_F(RedisCommandsTest, IncrDecrHandler) {
+  RedisWrapper lsm(test_dir);
+
+  // 负数的结果同样需要按照 RESP 整数返回
+  std::vector<std::string> decr_args = {"DECR", "missing"};
+  EXPECT_EQ(decr_handler(decr_args, lsm), ":-1\r\n");
+  EXPECT_EQ(decr_handler(decr_args, lsm), ":-2\r\n");
+  std::vector<std::string> incr_args = {"INCR", "missing"};
+  EXPECT_EQ(incr_handler(incr_args, lsm), ":-1\r\n");
+
+  std::vector<std::string> set_args = {"SET", "str", "hello"};
+  lsm.set(set_args);
+  incr_args[1] = "str";
+  EXPECT_EQ(incr_handler(incr_args, lsm),
+            "-ERR value is not an integer or out of range\r\n");
+}
+
 TEST_F(RedisCommandsTest, Expire) {
   RedisWrapper lsm(test_dir);
 
@@ -197,6 +246,82 @@ TEST_F(RedisCommandsTest, HExpire) {
   EXPECT_EQ(lsm.hget(hget_args), "$6\r\n" + value2 + "\r\n");
 }
 
+// 过期时间保存在 value 中, INCR / APPEND 不改变过期时间, SET 会清除
+TEST_F(RedisCommandsTest, TtlInValue) {
+  RedisWrapper lsm(test_dir);
+
+  std::vector<std::string> expire_args = {"EXPIRE", "str", "100"};
+  EXPECT_EQ(lsm.expire(expire_args), ":0\r\n"); // key 不存在
+
+  std::vector<std::string> append_args = {"APPEND", "str", "hello"};
+  EXPECT_EQ(lsm.append(append_args), ":5\r\n");
+  EXPECT_EQ(lsm.expire(expire_args), ":1\r\n");
+  append_args[2] = " world";
+  EXPECT_EQ(lsm.append(append_args), ":11\r\n");
+  std::vector<std::string> get_args = {"GET", "str"};
+  EXPECT_EQ(lsm.get(get_args), "$11\r\nhello world\r\n");
+  std::vector<std::string> ttl_args = {"TTL", "str"};
+  auto ttl = lsm.ttl(ttl_args);
+  EXPECT_TRUE(ttl == ":100\r\n" || ttl == ":99\r\n") << ttl;
+
+  std::vector<std::string> incr_args = {"INCR", "counter"};
+  EXPECT_EQ(lsm.incr(incr_args), "1");
+  expire_args[1] = "counter";
+  EXPECT_EQ(lsm.expire(expire_args), ":1\r\n");
+  EXPECT_EQ(lsm.incr(incr_args), "2");
+  lsm.flushall();
+  EXPECT_EQ(lsm.incr(incr_args), "3");
+  ttl_args[1] = "counter";
+  EXPECT_NE(lsm.ttl(ttl_args), ":-1\r\n");
+
+  std::vector<std::string> set_args = {"SET", "counter", "10"};
+  EXPECT_EQ(lsm.set(set_args), "+OK\r\n");
+  EXPECT_EQ(lsm.ttl(ttl_args), ":-1\r\n");
+
+  // 过期的 key 上的 INCR 从 0 开始, 不再带有过期时间
+  expire_args[2] = "0";
+  EXPECT_EQ(lsm.expire(expire_args), ":1\r\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  EXPECT_EQ(lsm.incr(incr_args), "1");
+  EXPECT_EQ(lsm.ttl(ttl_args), ":-1\r\n");
+
+  // 过期的字符串由 compaction filter 丢弃, 集合的元数据需要保留
+  RedisTtlCompactionFilter filter;
+  EXPECT_TRUE(filter.filter("str", encode_ttl_value("v", 1, false)));
+  EXPECT_FALSE(filter.filter("zset", encode_ttl_value("v", 1, true)));
+  EXPECT_FALSE(filter.filter("str", encode_ttl_value("v", INT64_MAX, false)));
+  EXPECT_FALSE(filter.filter("str", "v"));
+}
+
+// 过期的集合在读取时直接视为不存在, 之后的写入会先清理旧的元素
+TEST_F(RedisCommandsTest, CollectionExpire) {
+  RedisWrapper lsm(test_dir);
+
+  std::vector<std::string> zadd_args = {"ZADD", "zset", "1", "one", "2", "two"};
+  EXPECT_EQ(lsm.zadd(zadd_args), ":2\r\n");
+  std::vector<std::string> sadd_args = {"SADD", "set", "a", "b"};
+  EXPECT_EQ(lsm.sadd(sadd_args), ":2\r\n");
+  std::vector<std::string> expire_args = {"EXPIRE", "zset", "0"};
+  EXPECT_EQ(lsm.expire(expire_args), ":1\r\n");
+  expire_args[1] = "set";
+  EXPECT_EQ(lsm.expire(expire_args), ":1\r\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+  std::vector<std::string> zcard_args = {"ZCARD", "zset"};
+  EXPECT_EQ(lsm.zcard(zcard_args), ":0\r\n");
+  std::vector<std::string> scard_args = {"SCARD", "set"};
+  EXPECT_EQ(lsm.scard(scard_args), ":0\r\n");
+
+  std::vector<std::string> zadd_new = {"ZADD", "zset", "3", "three"};
+  EXPECT_EQ(lsm.zadd(zadd_new), ":1\r\n");
+  EXPECT_EQ(lsm.zcard(zcard_args), ":1\r\n");
+  std::vector<std::string> sadd_new = {"SADD", "set", "c"};
+  EXPECT_EQ(lsm.sadd(sadd_new), ":1\r\n");
+  EXPECT_EQ(lsm.scard(scard_args), ":1\r\n");
+  std::vector<std::string> smembers_args = {"SMEMBERS", "set"};
+  EXPECT_EQ(lsm.smembers(smembers_args), "*1\r\n$1\r\nc\r\n");
+}
+
 TEST_F(RedisCommandsTest, ListOperations) {
   RedisWrapper lsm(test_dir);
 
@@ -241,6 +366,167 @@ TEST_F(RedisCommandsTest, ListOperations) {
   std::string expected_lrange2 = "*1\r\n$6\r\nvalue1\r\n";
   EXPECT_EQ(lsm.lrange(lrange_args2), expected_lrange2);
 }
+
+TEST_F(RedisCommandsTest, ListElementEncoding) {
+  RedisWrapper lsm(test_dir);
+
+  // 旧版本的拼接格式仍然可以读取, 第一次修改时转换为逐元素的格式
+  std::vector<std::string> set_args = {"SET", "legacy", "a#b#c"};
+  lsm.set(set_args);
+  std::vector<std::string> llen_args = {"LLEN", "legacy"};
+  EXPECT_EQ(lsm.llen(llen_args), ":3\r\n");
+  std::vector<std::string> rpush_args = {"RPUSH", "legacy", "d"};
+  EXPECT_EQ(lsm.rpush(rpush_args), ":4\r\n");
+  std::vector<std::string> lrange_args = {"LRANGE", "legacy", "0", "-1"};
+  EXPECT_EQ(lsm.lrange(lrange_args),
+            "*4\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n$1\r\nd\r\n");
+  std::vector<std::string> lpop_args = {"LPOP", "legacy"};
+  EXPECT_EQ(lsm.lpop(lpop_args), "$1\r\na\r\n");
+
+  // 两端交替插入, LRANGE 只读取需要的部分
+  const int num = 1000;
+  for (int i = 0; i < num; i++) {
+    std::vector<std::string> args = {i % 2 == 0 ? "RPUSH" : "LPUSH", "queue",
+                                     std::to_string(i)};
+    auto res = i % 2 == 0 ? lsm.rpush(args) : lsm.lpush(args);
+    EXPECT_EQ(res, ":" + std::to_string(i + 1) + "\r\n");
+  }
+  // 链表为 999 997 ... 3 1 0 2 4 ... 998
+  std::vector<std::string> range_args = {"LRANGE", "queue", "499", "501"};
+  EXPECT_EQ(lsm.lrange(range_args),
+            "*3\r\n$1\r\n1\r\n$1\r\n0\r\n$1\r\n2\r\n");
+  std::vector<std::string> tail_args = {"LRANGE", "queue", "-2", "100000"};
+  EXPECT_EQ(lsm.lrange(tail_args), "*2\r\n$3\r\n996\r\n$3\r\n998\r\n");
+  std::vector<std::string> rpop_args = {"RPOP", "queue"};
+  EXPECT_EQ(lsm.rpop(rpop_args), "$3\r\n998\r\n");
+  std::vector<std::string> queue_len_args = {"LLEN", "queue"};
+  EXPECT_EQ(lsm.llen(queue_len_args), ":999\r\n");
+
+  // 删除之后重新创建的链表不包含旧的元素
+  std::vector<std::string> del_args = {"DEL", "queue"};
+  EXPECT_EQ(lsm.del(del_args), ":1\r\n");
+  EXPECT_EQ(lsm.llen(queue_len_args), ":0\r\n");
+  std::vector<std::string> push_args = {"RPUSH", "queue", "new"};
+  EXPECT_EQ(lsm.rpush(push_args), ":1\r\n");
+  std::vector<std::string> all_args = {"LRANGE", "queue", "0", "-1"};
+  EXPECT_EQ(lsm.lrange(all_args), "*1\r\n$3\r\nnew\r\n");
+}
+
+TEST_F(RedisCommandsTest, MultiKey) {
+  RedisWrapper lsm(test_dir);
+
+  std::vector<std::string> mset_args = {"MSET", "k1", "v1", "k2", "v2", "k1",
+                                        "v3"};
+  EXPECT_EQ(lsm.mset(mset_args), "+OK\r\n");
+  std::vector<std::string> bad_mset_args = {"MSET", "k1"};
+  EXPECT_EQ(lsm.mset(bad_mset_args).substr(0, 4), "-ERR");
+
+  // 同一个 key 写入多次时以最后一次为准, 回复的顺序与参数一致
+  std::vector<std::string> mget_args = {"MGET", "k2", "missing", "k1"};
+  EXPECT_EQ(lsm.mget(mget_args), "*3\r\n$2\r\nv2\r\n$-1\r\n$2\r\nv3\r\n");
+
+  // 过期的 key 返回空
+  std::vector<std::string> expire_args = {"EXPIRE", "k2", "-1"};
+  lsm.expire(expire_args);
+  EXPECT_EQ(lsm.mget(mget_args), "*3\r\n$-1\r\n$-1\r\n$2\r\nv3\r\n");
+
+  std::vector<std::pair<std::string, std::string>> sets = {{"k3", "a"},
+                                                           {"k4", "b"}};
+  EXPECT_EQ(lsm.set_batch(sets), "+OK\r\n+OK\r\n");
+  std::vector<std::string> get_args = {"GET", "k4"};
+  EXPECT_EQ(lsm.get(get_args), "$1\r\nb\r\n");
+
+  std::vector<std::string> hmset_args = {"HMSET", "h", "f1", "x", "f2", "y"};
+  EXPECT_EQ(lsm.hmset(hmset_args), "+OK\r\n");
+  std::vector<std::string> hmget_args = {"HMGET", "h", "f2", "f3", "f1"};
+  EXPECT_EQ(lsm.hmget(hmget_args), "*3\r\n$1\r\ny\r\n$-1\r\n$1\r\nx\r\n");
+  std::vector<std::string> missing_args = {"HMGET", "nohash", "f1"};
+  EXPECT_EQ(lsm.hmget(missing_args), "*1\r\n$-1\r\n");
+  std::vector<std::string> hkeys_args = {"HKEYS", "h"};
+  EXPECT_EQ(lsm.hkeys(hkeys_args), "*2\r\n$2\r\nf1\r\n$2\r\nf2\r\n");
+}
+
+TEST_F(RedisCommandsTest, Scan) {
+  RedisWrapper lsm(test_dir);
+
+  // 解析回复中的游标和元素
+  auto parse_scan = [](const std::string &reply) {
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    while ((pos = reply.find('$', pos)) != std::string::npos) {
+      size_t len_end = reply.find("\r\n", pos);
+      size_t len = std::stoul(reply.substr(pos + 1, len_end - pos - 1));
+      parts.push_back(reply.substr(len_end + 2, len));
+      pos = len_end + 2 + len;
+    }
+    return parts;
+  };
+
+  for (int i = 0; i < 25; i++) {
+    std::vector<std::string> sadd_args = {"SADD", "myset",
+                                          "member" + std::to_string(i)};
+    lsm.sadd(sadd_args);
+  }
+  std::set<std::string> members;
+  std::string cursor = "0";
+  int rounds = 0;
+  do {
+    std::vector<std::string> sscan_args = {"SSCAN", "myset", cursor, "COUNT",
+                                           "4"};
+    auto parts = parse_scan(lsm.sscan(sscan_args));
+    ASSERT_FALSE(parts.empty());
+    EXPECT_LE(parts.size() - 1, 4);
+    cursor = parts[0];
+    members.insert(parts.begin() + 1, parts.end());
+    rounds++;
+  } while (cursor != "0" && rounds < 100);
+  EXPECT_EQ(members.size(), 25);
+  EXPECT_EQ(rounds, 7);
+
+  std::vector<std::string> hset_args = {"HSET", "myhash", "f1", "v1"};
+  lsm.hset(hset_args);
+  std::vector<std::string> hscan_args = {"HSCAN", "myhash", "0"};
+  EXPECT_EQ(lsm.hscan(hscan_args),
+            "*2\r\n$1\r\n0\r\n*2\r\n$2\r\nf1\r\n$2\r\nv1\r\n");
+
+  std::vector<std::string> zadd_args = {"ZADD", "myzset", "1", "a", "2", "b"};
+  lsm.zadd(zadd_args);
+  std::vector<std::string> zscan_args = {"ZSCAN", "myzset", "0", "COUNT", "1"};
+  auto parts = parse_scan(lsm.zscan(zscan_args));
+  ASSERT_EQ(parts.size(), 3);
+  EXPECT_EQ(parts[1], "a");
+  EXPECT_EQ(parts[2], "1");
+  zscan_args[2] = parts[0];
+  parts = parse_scan(lsm.zscan(zscan_args));
+  ASSERT_EQ(parts.size(), 3);
+  EXPECT_EQ(parts[0], "0");
+  EXPECT_EQ(parts[1], "b");
+
+  // SCAN 只返回用户的 key, 跳过内部 key 和过期的 key
+  std::vector<std::string> set_args = {"SET", "plain", "v"};
+  lsm.set(set_args);
+  std::vector<std::string> set_args2 = {"SET", "gone", "v"};
+  lsm.set(set_args2);
+  std::vector<std::string> expire_args = {"EXPIRE", "gone", "-1"};
+  lsm.expire(expire_args);
+  std::set<std::string> keys;
+  cursor = "0";
+  rounds = 0;
+  do {
+    std::vector<std::string> scan_args = {"SCAN", cursor, "COUNT", "10"};
+    auto parts = parse_scan(lsm.scan(scan_args));
+    cursor = parts[0];
+    keys.insert(parts.begin() + 1, parts.end());
+    rounds++;
+  } while (cursor != "0" && rounds < 100);
+  EXPECT_EQ(keys, (std::set<std::string>{"myhash", "myset", "myzset", "plain"}));
+
+  std::vector<std::string> bad_cursor = {"SCAN", "xyz"};
+  EXPECT_EQ(lsm.scan(bad_cursor), "-ERR invalid cursor\r\n");
+  std::vector<std::string> bad_count = {"SCAN", "0", "COUNT", "0"};
+  EXPECT_EQ(lsm.scan(bad_count).substr(0, 4), "-ERR");
+}
+
 TEST_F(RedisCommandsTest, ZSetOperations) {
   RedisWrapper lsm(test_dir);
 
@@ -327,7 +613,251 @@ TEST_F(RedisCommandsTest, SetOperations) {
   std::vector<std::string> sismember_args5 = {"SISMEMBER", "myset", "member3"};
   EXPECT_EQ(lsm.sismember(sismember_args5), ":0\r\n");
 }
+
+// 一个 key 是另一个 key 的前缀时, DEL 不能删除另一个集合的元素
+TEST_F(RedisCommandsTest, DelKeyPrefixOfOtherKey) {
+  RedisWrapper lsm(test_dir);
+
+  std::vector<std::string> zadd_a = {"ZADD", "a", "1", "x"};
+  std::vector<std::string> zadd_ab = {"ZADD", "a_b", "1", "y", "2", "z"};
+  lsm.zadd(zadd_a);
+  lsm.zadd(zadd_ab);
+  std::vector<std::string> del_a = {"DEL", "a"};
+  EXPECT_EQ(lsm.del(del_a), ":1\r\n");
+  std::vector<std::string> zcard_ab = {"ZCARD", "a_b"};
+  EXPECT_EQ(lsm.zcard(zcard_ab), ":2\r\n");
+  std::vector<std::string> zrange_ab = {"ZRANGE", "a_b", "0", "-1"};
+  EXPECT_EQ(lsm.zrange(zrange_ab), "*2\r\n$1\r\ny\r\n$1\r\nz\r\n");
+  // 重复的成员只删除一次, 两个 key 在同一个 batch 中删除
+  std::vector<std::string> zrem_ab = {"ZREM", "a_b", "y", "y"};
+  EXPECT_EQ(lsm.zrem(zrem_ab), ":1\r\n");
+  EXPECT_EQ(lsm.zrange(zrange_ab), "*1\r\n$1\r\nz\r\n");
+
+  std::vector<std::string> sadd_s = {"SADD", "s", "x"};
+  std::vector<std::string> sadd_sb = {"SADD", "s_b", "y", "z"};
+  lsm.sadd(sadd_s);
+  lsm.sadd(sadd_sb);
+  std::vector<std::string> del_s = {"DEL", "s"};
+  EXPECT_EQ(lsm.del(del_s), ":1\r\n");
+  std::vector<std::string> smembers_sb = {"SMEMBERS", "s_b"};
+  EXPECT_EQ(lsm.smembers(smembers_sb), "*2\r\n$1\r\ny\r\n$1\r\nz\r\n");
+
+  // 链表元素 key 的后缀为序号, 名称为 <key>_<序号> 的链表同样落在范围内
+  std::vector<std::string> rpush_l = {"RPUSH", "l", "x", "y"};
+  std::vector<std::string> rpush_lb = {"RPUSH", "l_8000000000000000", "z"};
+  lsm.rpush(rpush_l);
+  lsm.rpush(rpush_lb);
+  std::vector<std::string> del_l = {"DEL", "l"};
+  EXPECT_EQ(lsm.del(del_l), ":1\r\n");
+  std::vector<std::string> lrange_lb = {"LRANGE", "l_8000000000000000", "0",
+                                        "-1"};
+  EXPECT_EQ(lsm.lrange(lrange_lb), "*1\r\n$1\r\nz\r\n");
+  std::vector<std::string> lrange_l = {"LRANGE", "l", "0", "-1"};
+  EXPECT_EQ(lsm.lrange(lrange_l), "*0\r\n");
+}
+// 不同 key 的命令并行执行, 多个 key 的 DEL 与其他命令之间不会死锁
+TEST_F(RedisCommandsTest, ConcurrentKeys) {
+  RedisWrapper lsm(test_dir);
+  const int kThreads = 4;
+  const int kOps = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&lsm, t]() {
+      std::string list = "list" + std::to_string(t);
+      for (int i = 0; i < kOps; i++) {
+        std::vector<std::string> rpush_args = {"RPUSH", list,
+                                               std::to_string(i)};
+        lsm.rpush(rpush_args);
+        std::vector<std::string> del_args = {"DEL", "tmp" + std::to_string(t),
+                                             "tmp" + std::to_string(i % 7),
+                                             "tmp" + std::to_string(t)};
+        lsm.del(del_args);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; t++) {
+    std::vector<std::string> llen_args = {"LLEN", "list" + std::to_string(t)};
+    EXPECT_EQ(lsm.llen(llen_args), ":" + std::to_string(kOps) + "\r\n");
+  }
+}
+
+// 流水线中的多个命令逐个解析, 不完整的命令等待之后的数据
+TEST(RespParserTest, PipelineAndPartialFrames) {
+  std::string data = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$5\r\nhello\r\n"
+                     "*2\r\n$3\r\nGET\r\n$1\r\nk\r\n"
+                     "PING\r\n";
+  std::vector<std::string> args;
+  std::vector<std::vector<std::string>> commands;
+  std::string_view view = data;
+  while (!view.empty()) {
+    auto result = parse_resp_command(view, args);
+    ASSERT_EQ(result.status, RespStatus::Ok);
+    commands.push_back(args);
+    view.remove_prefix(result.consumed);
+  }
+  ASSERT_EQ(commands.size(), 3);
+  EXPECT_EQ(commands[0], (std::vector<std::string>{"SET", "k", "hello"}));
+  EXPECT_EQ(commands[1], (std::vector<std::string>{"GET", "k"}));
+  EXPECT_EQ(commands[2], (std::vector<std::string>{"PING"}));
+
+  // 任意位置截断的命令都不会被消费
+  std::string first = data.substr(0, data.find("*2"));
+  for (size_t len = 0; len < first.size(); len++) {
+    auto result = parse_resp_command(std::string_view(first).substr(0, len), args);
+    EXPECT_EQ(result.status, RespStatus::Incomplete) << len;
+  }
+
+  // value 中可以包含 \r\n
+  std::string binary = "*2\r\n$4\r\nECHO\r\n$4\r\na\r\nb\r\n";
+  auto result = parse_resp_command(binary, args);
+  ASSERT_EQ(result.status, RespStatus::Ok);
+  EXPECT_EQ(result.consumed, binary.size());
+  EXPECT_EQ(args[1], "a\r\nb");
+
+  EXPECT_EQ(parse_resp_command("*1\r\n+PING\r\n", args).status,
+            RespStatus::Error);
+  EXPECT_EQ(parse_resp_command("*x\r\n", args).status, RespStatus::Error);
+  EXPECT_EQ(parse_resp_command("*1\r\n$-2\r\n", args).status,
+            RespStatus::Error);
+  EXPECT_EQ(parse_resp_command("*1\r\n$1\r\nab\r\n", args).status,
+            RespStatus::Error);
+}
+
+TEST(RespWriterTest, Replies) {
+  std::string out;
+  RespWriter writer(out);
+  writer.simple("OK").integer(-12).bulk("a\r\nb").null_bulk().array(2);
+  writer.bulk("").error("ERR bad");
+  EXPECT_EQ(out, "+OK\r\n:-12\r\n$4\r\na\r\nb\r\n$-1\r\n*2\r\n$0\r\n\r\n"
+                 "-ERR bad\r\n");
+  EXPECT_EQ(resp_integer(INT64_MIN), ":-9223372036854775808\r\n");
+  EXPECT_EQ(resp_integer(std::string("42")), ":42\r\n");
+  EXPECT_EQ(resp_bulk("hi"), "$2\r\nhi\r\n");
+}
+
+TEST_F(RedisCommandsTest, Info) {
+  RedisWrapper lsm(test_dir);
+  std::vector<std::string> set_args = {"SET", "k", "v"};
+  lsm.set(set_args);
+  std::vector<std::string> get_args = {"GET", "k"};
+  lsm.get(get_args);
+
+  std::vector<std::string> info_args = {"INFO"};
+  auto all = lsm.info(info_args);
+  EXPECT_EQ(all[0], '$');
+  EXPECT_NE(all.find("# Memtable\r\n"), std::string::npos);
+  EXPECT_NE(all.find("get_hit_memtable:1\r\n"), std::string::npos);
+
+  // 只返回指定的段, 段名不区分大小写
+  std::vector<std::string> section_args = {"INFO", "STATS"};
+  auto stats = lsm.info(section_args);
+  EXPECT_NE(stats.find("# Stats\r\n"), std::string::npos);
+  EXPECT_EQ(stats.find("# Memtable"), std::string::npos);
+  EXPECT_EQ(stats.find("# Latency"), std::string::npos);
+  std::vector<std::string> unknown_args = {"INFO", "unknown"};
+  EXPECT_EQ(lsm.info(unknown_args), "$0\r\n\r\n");
+}
+
+TEST_F(RedisCommandsTest, Replication) {
+  RedisWrapper lsm(test_dir, true);
+  std::vector<std::string> set_args = {"SET", "k", "v"};
+  EXPECT_EQ(lsm.set(set_args), "+OK\r\n");
+
+  std::vector<std::string> bad_args = {"REPLFETCH", "x", "0", "0"};
+  EXPECT_EQ(lsm.replfetch(bad_args), "-ERR invalid replication position\r\n");
+  // epoch 为偶数的位置一定不属于当前的 WAL
+  std::vector<std::string> stale_args = {"REPLFETCH", "2", "0", "0"};
+  EXPECT_EQ(lsm.replfetch(stale_args).rfind("-ERR ", 0), 0);
+
+  // 不是从 leader 的 checkpoint 打开的引擎没有复制位置
+  std::vector<std::string> replicaof_args = {"REPLICAOF", "127.0.0.1", "6379"};
+  EXPECT_EQ(lsm.replicaof(replicaof_args).rfind("-ERR ", 0), 0);
+  EXPECT_FALSE(lsm.is_replica());
+  std::vector<std::string> port_args = {"REPLICAOF", "127.0.0.1", "abc"};
+  EXPECT_EQ(lsm.replicaof(port_args), "-ERR Invalid master port\r\n");
+  std::vector<std::string> no_one_args = {"REPLICAOF", "NO", "ONE"};
+  EXPECT_EQ(lsm.replicaof(no_one_args), "+OK\r\n");
+  EXPECT_FALSE(lsm.is_replica());
+}
+
+TEST_F(RedisCommandsTest, Sharded) {
+  {
+    ShardedRedis redis(test_dir, 4);
+    std::vector<std::string> mset_args = {"MSET"};
+    std::vector<std::string> mget_args = {"MGET"};
+    std::string expected = "*21\r\n";
+    for (int i = 0; i < 20; i++) {
+      std::string key = "key" + std::to_string(i);
+      std::string value = "value" + std::to_string(i);
+      mset_args.push_back(key);
+      mset_args.push_back(value);
+      mget_args.push_back(key);
+      expected += resp_bulk(value);
+    }
+    mget_args.push_back("missing");
+    expected += "$-1\r\n";
+    EXPECT_EQ(redis.mset(mset_args), "+OK\r\n");
+    // 回复中的元素按 key 原本的顺序排列
+    EXPECT_EQ(redis.mget(mget_args), expected);
+
+    // 单个 key 的命令在 key 所在的分片中执行
+    auto shard = redis.shard_of("key3");
+    auto get = redis.submit(shard, [](RedisWrapper &engine) {
+      std::vector<std::string> args = {"GET", "key3"};
+      return engine.get(args);
+    });
+    EXPECT_EQ(get.get(), "$6\r\nvalue3\r\n");
+
+    std::vector<std::string> del_args = {"DEL", "key0", "key1", "key2",
+                                         "missing"};
+    EXPECT_EQ(redis.del(del_args), ":3\r\n");
+
+    // 依次遍历全部分片
+    std::set<std::string> keys;
+    std::string cursor = "0";
+    int rounds = 0;
+    do {
+      std::vector<std::string> scan_args = {"SCAN", cursor, "COUNT", "5"};
+      auto reply = redis.scan(scan_args);
+      // *2\r\n$<len>\r\n<cursor>\r\n*<n>\r\n$<len>\r\n<key>\r\n...
+      std::vector<std::string> lines;
+      size_t pos = 0;
+      while (pos < reply.size()) {
+        auto end = reply.find("\r\n", pos);
+        lines.push_back(reply.substr(pos, end - pos));
+        pos = end + 2;
+      }
+      ASSERT_GE(lines.size(), 4);
+      cursor = lines[2];
+      for (size_t i = 5; i < lines.size(); i += 2) {
+        keys.insert(lines[i]);
+      }
+      ASSERT_LT(++rounds, 100);
+    } while (cursor != "0");
+    EXPECT_EQ(keys.size(), 17);
+    EXPECT_EQ(keys.count("key0"), 0);
+    EXPECT_EQ(keys.count("key19"), 1);
+    std::vector<std::string> bad_cursor = {"SCAN", "9:0"};
+    EXPECT_EQ(redis.scan(bad_cursor), "-ERR invalid cursor\r\n");
+
+    std::vector<std::string> info_args = {"INFO", "stats"};
+    auto info = redis.info(info_args);
+    EXPECT_NE(info.find("# Shard 3\r\n"), std::string::npos);
+  }
+
+  // 分片数记录在数据目录中, 重新打开时保留数据
+  {
+    ShardedRedis redis(test_dir, 4);
+    std::vector<std::string> mget_args = {"MGET", "key0", "key5"};
+    EXPECT_EQ(redis.mget(mget_args), "*2\r\n$-1\r\n$6\r\nvalue5\r\n");
+  }
+  EXPECT_THROW(ShardedRedis(test_dir, 2), std::runtime_error);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -178,6 +178,30 @@ TEST(SkipListTest, MemorySizeTracking) {
   EXPECT_EQ(skipList.get_size(), 0);
 }
 
+// 测试实际内存占用的统计
+TEST(SkipListTest, MemoryUsageTracking) {
+  SkipList skipList;
+  // 空跳表不占用 Arena 的内存
+  EXPECT_EQ(skipList.get_memory_usage(), 0);
+
+  const int num = 10000;
+  for (int i = 0; i < num; i++) {
+    skipList.put("k" + std::to_string(i), "v", 0);
+  }
+  // 每个节点至少包含节点头和 key, value 的内容, 实际内存远大于有效数据的大小
+  size_t min_usage = num * (sizeof(SkipListNode) + 2);
+  EXPECT_GE(skipList.get_memory_usage(), min_usage);
+  EXPECT_GT(skipList.get_memory_usage(), skipList.get_size());
+
+  // 逻辑删除不会释放内存
+  size_t usage = skipList.get_memory_usage();
+  skipList.remove("k0");
+  EXPECT_EQ(skipList.get_memory_usage(), usage);
+
+  skipList.clear();
+  EXPECT_EQ(skipList.get_memory_usage(), 0);
+}
+
 TEST(SkipListTest, IteratorPreffix) {
   SkipList skipList;
 
@@ -340,6 +364,34 @@ TEST(SkipListTest, TransactionId) {
   EXPECT_EQ((skipList.get("key1", 2).get_value()), "value2");
 }
 
+// 反向遍历时每个 key 只输出可见的最新版本, 没有可见版本的 key 被跳过
+TEST(SkipListTest, SeekForPrev) {
+  SkipList skipList;
+  skipList.put("a", "a1", 1);
+  skipList.put("b", "b3", 3);
+  skipList.put("b", "b1", 1);
+  skipList.put("c", "c5", 5);
+  skipList.put("d", "d2", 2);
+  skipList.put("d", "d4", 4);
+
+  std::vector<std::string> values;
+  for (auto it = skipList.seek_for_prev(std::nullopt, 0); it.is_valid(); --it) {
+    values.push_back(it.get_value());
+  }
+  EXPECT_EQ(values, (std::vector<std::string>{"d4", "c5", "b3", "a1"}));
+
+  values.clear();
+  for (auto it = skipList.seek_for_prev("cc", 2); it.is_valid(); --it) {
+    values.push_back(it.get_value());
+  }
+  EXPECT_EQ(values, (std::vector<std::string>{"b1", "a1"}));
+
+  auto it = skipList.seek_for_prev("d", 3);
+  ASSERT_TRUE(it.is_valid());
+  EXPECT_EQ(it.get_value(), "d2");
+  EXPECT_FALSE(skipList.seek_for_prev("0", 0).is_valid());
+}
+
 // ! 现在的实现, 并发的锁由 SkipList 的上层 MemTable 实现, 因此不需要测试
 // SkipList 的并发性
 // // 测试跳表的并发性能
@@ -483,6 +535,64 @@ TEST(SkipListTest, TransactionId) {
 //             num_writers * num_operations); // 跳表大小不应超过最大可能值
 // }
 
+// 多个写线程并发写入, 读线程同时无锁读取
+TEST(SkipListTest, ConcurrentPutAndGet) {
+  SkipList skipList;
+  const int num_writers = 4;
+  const int num_per_writer = 5000;
+  std::atomic<bool> writing{true};
+  std::latch start(num_writers + 1);
+
+  std::vector<std::thread> writers;
+  for (int t = 0; t < num_writers; t++) {
+    writers.emplace_back([&, t]() {
+      start.arrive_and_wait();
+      for (int i = 0; i < num_per_writer; i++) {
+        std::string key = "key" + std::to_string(i * num_writers + t);
+        skipList.put(key, "value" + std::to_string(i * num_writers + t), 0);
+      }
+    });
+  }
+
+  std::thread reader([&]() {
+    start.arrive_and_wait();
+    while (writing.load()) {
+      // 读到的 key 一定对应正确的 value
+      for (int i = 0; i < 100; i++) {
+        std::string key = "key" + std::to_string(i);
+        auto it = skipList.get(key, 0);
+        if (it.is_valid()) {
+          EXPECT_EQ(it.get_value(), "value" + std::to_string(i));
+        }
+      }
+    }
+  });
+
+  for (auto &w : writers) {
+    w.join();
+  }
+  writing.store(false);
+  reader.join();
+
+  // 所有 key 都写入成功, 且遍历结果有序
+  for (int i = 0; i < num_writers * num_per_writer; i++) {
+    std::string key = "key" + std::to_string(i);
+    auto it = skipList.get(key, 0);
+    ASSERT_TRUE(it.is_valid());
+    EXPECT_EQ(it.get_value(), "value" + std::to_string(i));
+  }
+  size_t count = 0;
+  std::string prev;
+  for (auto it = skipList.begin(); it != skipList.end(); ++it) {
+    if (count > 0) {
+      EXPECT_LT(prev, it.get_key());
+    }
+    prev = it.get_key();
+    count++;
+  }
+  EXPECT_EQ(count, num_writers * num_per_writer);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
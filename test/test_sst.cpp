@@ -1,6 +1,7 @@
 #include "../include/consts.h"
 #include "../include/sst/sst.h"
 #include "../include/sst/sst_iterator.h"
+#include "../include/utils/bloom_filter.h"
 #include <filesystem>
 #include <gtest/gtest.h>
 
@@ -231,6 +232,326 @@ TEST_F(SSTTest, LargeSSTPredicate) {
   EXPECT_EQ(iter_end.key(), "key501");
 }
 
+// 按谓词定位迭代器, 只读取范围开头所在的 block
+TEST_F(SSTTest, SeekMonotonyPredicate) {
+  SSTBuilder builder(4096, true);
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  auto key_of = [](int i) {
+    return "key" + std::string(3 - std::to_string(i).length(), '0') +
+           std::to_string(i);
+  };
+  // 只写入偶数 key, 范围的开头可能不是 sst 中真实的 key
+  for (int i = 0; i < 1000; i += 2) {
+    builder.add(key_of(i), "val" + std::to_string(i), 0);
+  }
+  auto sst = builder.build(1, "test_data/seek.sst", block_cache);
+  ASSERT_GT(sst->num_blocks(), 1);
+
+  auto range_from = [](std::string lower) {
+    return [lower](const std::string &key) { return key < lower ? 1 : 0; };
+  };
+  for (int i = 0; i < 990; i += 37) {
+    SstIterator iter(sst, 0, range_from(key_of(i)));
+    ASSERT_TRUE(iter.is_valid());
+    EXPECT_EQ(iter.key(), key_of(i % 2 == 0 ? i : i + 1));
+  }
+  SstIterator first(sst, 0, range_from(""));
+  EXPECT_EQ(first.key(), key_of(0));
+  SstIterator past_end(sst, 0, range_from("key999"));
+  EXPECT_FALSE(past_end.is_valid());
+}
+
+// 测试元数据由缓存池管理
+TEST_F(SSTTest, CachedMetaAndPinning) {
+  // 缓存池只能容纳很少的数据, 元数据会被频繁驱逐
+  auto block_cache = std::make_shared<BlockCache>(4096, 2, 0, true);
+
+  auto build_sst = [&](size_t sst_id, bool pin_meta) {
+    SSTBuilder builder(256, true);
+    for (size_t i = 0; i < 200; i++) {
+      builder.add("key" + std::to_string(1000 + i), "value" + std::to_string(i),
+                  0);
+    }
+    return builder.build(sst_id, "test_data/meta" + std::to_string(sst_id) +
+                                     ".sst",
+                         block_cache, pin_meta);
+  };
+  auto sst = build_sst(1, false);
+  auto pinned_sst = build_sst(2, true);
+  size_t num_blocks = sst->num_blocks();
+  EXPECT_GT(num_blocks, 1);
+
+  // 元数据被驱逐后会从文件重新读取, 查询结果不受影响
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < 200; i++) {
+      std::string key = "key" + std::to_string(1000 + i);
+      for (auto &cur : {sst, pinned_sst}) {
+        auto it = cur->get(key, 0);
+        ASSERT_TRUE(it.is_valid());
+        EXPECT_EQ(it.value(), "value" + std::to_string(i));
+      }
+    }
+  }
+  EXPECT_EQ(sst->get(std::string("key0"), 0).is_end(), true);
+  EXPECT_EQ(sst->num_blocks(), num_blocks);
+  // 元数据的访问也计入命中率, 总占用不超过容量
+  EXPECT_GT(block_cache->hit_rate(), 0.0);
+  EXPECT_LE(block_cache->get_usage(), 4096);
+
+  // 重新打开后元数据一致
+  sst.reset();
+  auto reopened = SST::open(1, FileObj::open("test_data/meta1.sst", false),
+                            block_cache);
+  EXPECT_EQ(reopened->num_blocks(), num_blocks);
+  EXPECT_EQ(reopened->get_first_key(), "key1000");
+  EXPECT_EQ(reopened->get_last_key(), "key1199");
+}
+
+// 新文件使用版本 2 的格式, 没有 magic 的版本 1 文件仍然可以读取
+TEST_F(SSTTest, LegacyFormatCompatibility) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  SSTBuilder builder(256, false);
+  BloomFilter legacy_bloom(BLOOM_FILTER_EXPECTED_SIZE,
+                           BLOOM_FILTER_EXPECTED_ERROR_RATE);
+  for (size_t i = 0; i < 100; i++) {
+    std::string key = "key" + std::to_string(1000 + i);
+    builder.add(key, "value" + std::to_string(i), i + 1);
+    legacy_bloom.add(key);
+  }
+  auto sst = builder.build(1, "test_data/v2.sst", block_cache);
+  EXPECT_EQ(sst->get_format_version(), 2);
+  size_t num_blocks = sst->num_blocks();
+
+  // 去掉末尾的 format_version, flags 和 magic, 并在 extra 之前插入旧版本的
+  // BloomFilter, 得到版本 1 的文件(bloom_offset 不变)
+  auto v2 = SST::open(1, FileObj::open("test_data/v2.sst", false), block_cache);
+  EXPECT_EQ(v2->get_format_version(), 2);
+  auto bytes = FileObj::open("test_data/v2.sst", false)
+                   .read_to_slice(0, v2->sst_size());
+  size_t trailer_len = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+  size_t extra_len = sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2;
+  std::vector<uint8_t> v1(bytes.begin(),
+                          bytes.end() - trailer_len - extra_len);
+  auto bloom_bytes = legacy_bloom.encode();
+  v1.insert(v1.end(), bloom_bytes.begin(), bloom_bytes.end());
+  v1.insert(v1.end(), bytes.end() - trailer_len - extra_len,
+            bytes.end() - trailer_len);
+  FileObj::create_and_write("test_data/v1.sst", v1);
+
+  auto legacy_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                   LSMmm_BLOCK_CACHE_K);
+  auto legacy = SST::open(2, FileObj::open("test_data/v1.sst", false),
+                          legacy_cache);
+  EXPECT_EQ(legacy->get_format_version(), 1);
+  EXPECT_EQ(legacy->num_blocks(), num_blocks);
+  EXPECT_EQ(legacy->get_tranc_id_range(), std::make_pair(1UL, 100UL));
+  for (size_t i = 0; i < 100; i++) {
+    auto it = legacy->get("key" + std::to_string(1000 + i), 0);
+    ASSERT_TRUE(it.is_valid());
+    EXPECT_EQ(it.value(), "value" + std::to_string(i));
+  }
+  EXPECT_TRUE(legacy->get(std::string("key1050x"), 0).is_end());
+}
+
+// 使用 Xor 过滤器的 sst, 重新打开时根据过滤器的类型字节解码
+TEST_F(SSTTest, XorFilter) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  auto extractor = std::make_shared<FixedPrefixExtractor>(5);
+  SSTBuilder builder(256, true, extractor, FilterType::Xor8);
+  for (size_t i = 0; i < 500; i++) {
+    builder.add("key" + std::to_string(1000 + i * 2), "value", 0);
+  }
+  builder.build(1, "test_data/xor.sst", block_cache);
+  auto sst =
+      SST::open(1, FileObj::open("test_data/xor.sst", false), block_cache);
+
+  int false_positives = 0;
+  for (size_t i = 0; i < 500; i++) {
+    EXPECT_TRUE(sst->get("key" + std::to_string(1000 + i * 2), 0).is_valid());
+    if (sst->find_block_idx("key" + std::to_string(1001 + i * 2)) !=
+        static_cast<size_t>(-1)) {
+      false_positives++;
+    }
+  }
+  EXPECT_LE(false_positives, 10);
+  EXPECT_TRUE(sst->preffix_may_match("key10", extractor.get()));
+}
+
+// 前缀过滤器可以在不读取 block 的情况下跳过不包含该前缀的 sst
+TEST_F(SSTTest, PrefixFilter) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  auto extractor = std::make_shared<RedisPrefixExtractor>();
+  SSTBuilder builder(256, true, extractor);
+  for (int set_id = 0; set_id < 100; set_id += 2) {
+    for (int i = 0; i < 5; i++) {
+      builder.add("REDIS_SET_s" + std::to_string(1000 + set_id) + "_m" +
+                      std::to_string(i),
+                  "1", 0);
+    }
+  }
+  builder.build(1, "test_data/prefix.sst", block_cache);
+  auto sst = SST::open(1, FileObj::open("test_data/prefix.sst", false),
+                       block_cache);
+
+  int false_positives = 0;
+  for (int set_id = 0; set_id < 100; set_id++) {
+    std::string preffix = "REDIS_SET_s" + std::to_string(1000 + set_id) + "_";
+    bool may_match = sst->preffix_may_match(preffix, extractor.get());
+    if (set_id % 2 == 0) {
+      EXPECT_TRUE(may_match);
+      auto result = sst_iters_preffix(sst, 0, preffix, extractor.get());
+      ASSERT_TRUE(result.has_value());
+      int count = 0;
+      for (auto [it, end] = result.value(); it != end; ++it) {
+        count++;
+      }
+      EXPECT_EQ(count, 5);
+    } else if (may_match) {
+      false_positives++;
+    }
+  }
+  EXPECT_LE(false_positives, 5);
+
+  // 超出首尾key的范围时不需要过滤器
+  EXPECT_FALSE(sst->preffix_may_match("REDIS_SET_s0999_", extractor.get()));
+  EXPECT_FALSE(sst->preffix_may_match("REDIS_SET_s2000_", extractor.get()));
+  // 不同的 extractor 或者不在 domain 中的前缀无法使用过滤器
+  FixedPrefixExtractor fixed(12);
+  EXPECT_TRUE(sst->preffix_may_match("REDIS_SET_s1001_", &fixed));
+  EXPECT_TRUE(sst->preffix_may_match("REDIS_SET_s1001", extractor.get()));
+}
+
+// 压缩后的 sst 更小, 读取时透明地解压
+TEST_F(SSTTest, BlockCompression) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  SSTBuilder raw_builder(4096, true);
+  SSTBuilder lz4_builder(4096, true, nullptr, FilterType::BlockedBloom,
+                         CompressionType::LZ4);
+  for (size_t i = 0; i < 2000; i++) {
+    std::string key = "key" + std::to_string(10000 + i);
+    std::string value = "value_" + std::string(64, 'a' + i % 26);
+    raw_builder.add(key, value, 0);
+    lz4_builder.add(key, value, 0);
+  }
+  raw_builder.build(1, "test_data/raw.sst", block_cache);
+  lz4_builder.build(2, "test_data/lz4.sst", block_cache);
+  EXPECT_LT(std::filesystem::file_size("test_data/lz4.sst"),
+            std::filesystem::file_size("test_data/raw.sst") / 2);
+
+  auto sst =
+      SST::open(2, FileObj::open("test_data/lz4.sst", false), block_cache);
+  for (size_t i = 0; i < 2000; i++) {
+    auto it = sst->get("key" + std::to_string(10000 + i), 0);
+    ASSERT_TRUE(it.is_valid());
+    EXPECT_EQ(it->second, "value_" + std::string(64, 'a' + i % 26));
+  }
+  size_t count = 0;
+  for (auto it = sst->begin(0); it != sst->end(); ++it) {
+    count++;
+  }
+  EXPECT_EQ(count, 2000);
+}
+
+// compact 读取的 block 不放入缓存池; 顺序读取时预读的范围逐渐扩大
+TEST_F(SSTTest, ReadaheadAndCacheBypass) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  SSTBuilder builder(1024, true);
+  for (int i = 0; i < 20000; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%06d", i);
+    builder.add(key, "value" + std::to_string(i), 0);
+  }
+  auto sst = builder.build(1, "test_data/readahead.sst", block_cache);
+  ASSERT_GT(sst->num_blocks(), 100);
+
+  EXPECT_NE(sst->read_block(3, false), nullptr);
+  EXPECT_EQ(block_cache->get(1, 3), nullptr);
+  EXPECT_NE(sst->read_block(3), nullptr);
+  EXPECT_NE(block_cache->get(1, 3), nullptr);
+
+  // 第一次读取和不连续的读取不会预读
+  SstReadahead readahead;
+  EXPECT_EQ(readahead.on_block_read(*sst, 10), 0);
+  EXPECT_EQ(readahead.on_block_read(*sst, 50), 0);
+  // 连续读取后按 LSM_SST_READAHEAD_MIN 开始预读, 之后每次翻倍
+  size_t first = readahead.on_block_read(*sst, 51);
+  EXPECT_GT(first, 0);
+  size_t second = 0;
+  for (size_t idx = 52; idx < 52 + first && second == 0; idx++) {
+    second = readahead.on_block_read(*sst, idx);
+  }
+  EXPECT_GT(second, first);
+  // 跳跃之后重新检测
+  EXPECT_EQ(readahead.on_block_read(*sst, 5), 0);
+
+  // compact 的输入第一次读取就按上限预读
+  SstReadahead sequential(true);
+  EXPECT_GE(sequential.on_block_read(*sst, 0), second);
+
+  // 预读不影响迭代的结果
+  int count = 0;
+  for (auto it = sst->begin(0); it.is_valid() && !it.is_end(); ++it) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%06d", count);
+    EXPECT_EQ(it.key(), key);
+    count++;
+  }
+  EXPECT_EQ(count, 20000);
+}
+
+TEST_F(SSTTest, RangeTombstones) {
+  auto block_cache = std::make_shared<BlockCache>(LSMmm_BLOCK_CACHE_CAPACITY,
+                                                  LSMmm_BLOCK_CACHE_K);
+  {
+    SSTBuilder builder(256, true);
+    for (int i = 10; i < 20; i++) {
+      builder.add("key" + std::to_string(i), "value", 3);
+    }
+    builder.add_range_tombstone("key05", "key15", 5);
+    builder.add_range_tombstone("key18", "key30", 7);
+    auto sst = builder.build(1, "test_data/range_del.sst", block_cache);
+    // key 范围覆盖范围删除标记
+    EXPECT_EQ(sst->get_first_key(), "key05");
+    EXPECT_EQ(sst->get_last_key(), "key30");
+    EXPECT_EQ(sst->get_tranc_id_range().first, 3);
+    EXPECT_EQ(sst->get_tranc_id_range().second, 7);
+  }
+
+  FileObj file = FileObj::open("test_data/range_del.sst", false);
+  auto sst = SST::open(1, std::move(file), block_cache);
+  EXPECT_EQ(sst->get_first_key(), "key05");
+  EXPECT_EQ(sst->get_last_key(), "key30");
+  ASSERT_NE(sst->get_range_tombstones(), nullptr);
+  EXPECT_EQ(sst->get_range_tombstones()->tombstones().size(), 2);
+  EXPECT_EQ(sst->range_del_covering("key12", 0), 5);
+  EXPECT_EQ(sst->range_del_covering("key12", 4), 0);
+  EXPECT_EQ(sst->range_del_covering("key16", 0), 0);
+  EXPECT_EQ(sst->range_del_covering("key2", 0), 7);
+  // 点记录不受影响, 由读路径比较 tranc_id
+  EXPECT_EQ(sst->get("key12", 0).value(), "value");
+
+  // 只包含范围删除标记的 sst
+  {
+    SSTBuilder builder(256, true);
+    builder.add_range_tombstone("a", "c", 9);
+    auto only = builder.build(2, "test_data/range_del_only.sst", block_cache);
+    EXPECT_EQ(only->num_blocks(), 0);
+  }
+  FileObj only_file = FileObj::open("test_data/range_del_only.sst", false);
+  auto only = SST::open(2, std::move(only_file), block_cache);
+  EXPECT_EQ(only->num_blocks(), 0);
+  EXPECT_EQ(only->get_first_key(), "a");
+  EXPECT_EQ(only->get_last_key(), "c");
+  EXPECT_EQ(only->range_del_covering("b", 0), 9);
+  EXPECT_TRUE(only->begin(0).is_end() || !only->begin(0).is_valid());
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
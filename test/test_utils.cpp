@@ -1,8 +1,24 @@
+#include "../include/utils/blocked_bloom_filter.h"
 #include "../include/utils/bloom_filter.h"
+#include "../include/utils/compression.h"
+#include "../include/utils/crc32c.h"
 #include "../include/utils/files.h"
+#include "../include/utils/hash.h"
+#include "../include/utils/io_batch.h"
+#include "../include/utils/key_prefix.h"
+#include "../include/utils/prefix_extractor.h"
+#include "../include/utils/rate_limiter.h"
+#include "../include/utils/range_tombstone.h"
+#include "../include/utils/statistics.h"
+#include "../include/utils/xor_filter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <gtest/gtest.h>
 #include <random>
+#include <thread>
+#include <vector>
 
 class FileTest : public ::testing::Test {
 protected:
@@ -131,6 +147,101 @@ protected:
 //   EXPECT_EQ(read_data, data);
 // }
 
+// 测试追加写入和多线程并发读取
+TEST_F(FileTest, AppendAndConcurrentRead) {
+  const std::string path = "test_data/concurrent.dat";
+  auto file = FileObj::create_and_write(path, {});
+  EXPECT_EQ(file.size(), 0);
+
+  const size_t chunk_size = 4096;
+  const int num_chunks = 64;
+  std::vector<uint8_t> expected;
+  for (int i = 0; i < num_chunks; i++) {
+    auto chunk = generate_random_data(chunk_size);
+    ASSERT_TRUE(file.append(chunk));
+    expected.insert(expected.end(), chunk.begin(), chunk.end());
+  }
+  ASSERT_TRUE(file.sync());
+  EXPECT_EQ(file.size(), expected.size());
+
+  // 多个线程同时读取不同的位置, 结果互不干扰
+  std::vector<std::thread> readers;
+  std::atomic<int> mismatches{0};
+  for (int t = 0; t < 8; t++) {
+    readers.emplace_back([&, t]() {
+      for (int round = 0; round < 200; round++) {
+        size_t chunk = (t * 7 + round) % num_chunks;
+        auto data = file.read_to_slice(chunk * chunk_size, chunk_size);
+        if (!std::equal(data.begin(), data.end(),
+                        expected.begin() + chunk * chunk_size)) {
+          mismatches++;
+        }
+      }
+    });
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(mismatches.load(), 0);
+
+  // 重新打开后内容不变
+  auto reopened = FileObj::open(path, false);
+  EXPECT_EQ(reopened.size(), expected.size());
+  EXPECT_EQ(reopened.read_to_slice(0, expected.size()), expected);
+  EXPECT_THROW(reopened.read_to_slice(expected.size(), 1), std::out_of_range);
+}
+
+// 限速写入的内容与普通写入一致, 耗时不少于限速对应的时间
+TEST_F(FileTest, RateLimitedWrite) {
+  // 1MB/s, 每 10ms 补充 10KB
+  RateLimiter limiter(1 << 20, false, 10000);
+  auto data = generate_random_data(200 * 1024);
+  auto start = std::chrono::steady_clock::now();
+  auto file = FileObj::create_and_write("test_data/limited.dat", data,
+                                        &limiter, IOPriority::Compaction);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(150));
+  EXPECT_EQ(file.read_to_slice(0, data.size()), data);
+  EXPECT_EQ(limiter.get_total_bytes_through(IOPriority::Compaction),
+            data.size());
+  EXPECT_EQ(limiter.get_total_bytes_through(IOPriority::Flush), 0);
+}
+
+// 一批读取请求中的每个请求恰好完成一次, 读到的内容与逐个读取一致
+TEST_F(FileTest, IoBatchRead) {
+  const std::string path = "test_data/batch.dat";
+  auto expected = generate_random_data(256 * 1024);
+  auto file = FileObj::create_and_write(path, expected);
+  auto other = FileObj::create_and_write("test_data/batch2.dat", expected);
+
+  IoBatch batch;
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t i = 0; i < 100; i++) {
+    size_t offset = (i * 7919) % (expected.size() - 4096);
+    size_t length = 1 + (i * 131) % 4096;
+    ranges.emplace_back(offset, length);
+    EXPECT_EQ(batch.add(i % 2 ? file : other, offset, length), i);
+  }
+  EXPECT_THROW(batch.add(file, expected.size(), 1), std::out_of_range);
+  EXPECT_EQ(batch.size(), ranges.size());
+  batch.submit();
+  EXPECT_THROW(batch.add(file, 0, 1), std::runtime_error);
+
+  std::vector<bool> completed(ranges.size(), false);
+  size_t request;
+  while ((request = batch.wait_any()) != SIZE_MAX) {
+    ASSERT_LT(request, ranges.size());
+    EXPECT_FALSE(completed[request]);
+    completed[request] = true;
+    auto [offset, length] = ranges[request];
+    auto &data = batch.data(request);
+    ASSERT_EQ(data.size(), length);
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), expected.begin() + offset));
+  }
+  EXPECT_TRUE(std::all_of(completed.begin(), completed.end(),
+                          [](bool done) { return done; }));
+}
+
 // 综合测试布隆过滤器的功能
 TEST(BloomFilterTest, ComprehensiveTest) {
   // 创建布隆过滤器，预期插入1000个元素，假阳性率为0.01
@@ -169,6 +280,334 @@ TEST(BloomFilterTest, ComprehensiveTest) {
 #endif
 }
 
+// 分块布隆过滤器没有假阴性, 10 bits/key 时假阳性率约为 1%
+TEST(BlockedBloomFilterTest, FalsePositiveAndEncode) {
+  std::vector<uint64_t> hashes;
+  for (int i = 0; i < 10000; ++i) {
+    hashes.push_back(hash64("key" + std::to_string(i)));
+  }
+  auto filter = BlockedBloomFilter::build(hashes, 10);
+  EXPECT_EQ(filter->num_lines(), (10000 * 10 + 511) / 512);
+
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_TRUE(filter->possibly_contains("key" + std::to_string(i)));
+  }
+  int false_positives = 0;
+  for (int i = 10000; i < 20000; ++i) {
+    if (filter->possibly_contains("key" + std::to_string(i))) {
+      ++false_positives;
+    }
+  }
+  EXPECT_LE(false_positives, 200);
+
+  // 编码后通过 Filter::decode_filter 按类型字节解码
+  auto decoded = Filter::decode_filter(filter->encode_filter());
+  for (int i = 0; i < 20000; ++i) {
+    auto key = "key" + std::to_string(i);
+    EXPECT_EQ(decoded->possibly_contains(key), filter->possibly_contains(key));
+  }
+  EXPECT_THROW(Filter::decode_filter({0xff}), std::runtime_error);
+}
+
+// Xor 过滤器没有假阴性, 假阳性率约为 0.39%, 每个 key 约占 1.23 字节
+TEST(XorFilterTest, FalsePositiveAndEncode) {
+  std::vector<uint64_t> hashes;
+  for (int i = 0; i < 10000; ++i) {
+    hashes.push_back(hash64("key" + std::to_string(i)));
+  }
+  // 重复的哈希值不影响构建
+  hashes.push_back(hashes.front());
+  auto filter = XorFilter::build(hashes);
+  EXPECT_LE(filter->size_in_bytes(), 10000 * 123 / 100 + 32);
+
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_TRUE(filter->possibly_contains("key" + std::to_string(i)));
+  }
+  int false_positives = 0;
+  for (int i = 10000; i < 30000; ++i) {
+    if (filter->possibly_contains("key" + std::to_string(i))) {
+      ++false_positives;
+    }
+  }
+  EXPECT_LE(false_positives, 200);
+
+  auto decoded = Filter::decode_filter(filter->encode_filter());
+  for (int i = 0; i < 30000; ++i) {
+    auto key = "key" + std::to_string(i);
+    EXPECT_EQ(decoded->possibly_contains(key), filter->possibly_contains(key));
+  }
+  EXPECT_TRUE(XorFilter::build({})->encode_filter().size() > 0);
+}
+
+// 批量判断与逐个判断的结果一致
+TEST(FilterTest, PossiblyContainsBatch) {
+  std::vector<uint64_t> hashes;
+  BloomFilter bloom(1000, 0.01);
+  for (int i = 0; i < 1000; ++i) {
+    auto key = "key" + std::to_string(i);
+    hashes.push_back(hash64(key));
+    bloom.add(key);
+  }
+  std::vector<std::shared_ptr<Filter>> filters = {
+      BlockedBloomFilter::build(hashes, 10), XorFilter::build(hashes),
+      std::make_shared<BloomFilter>(bloom)};
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 3000; i += 3) {
+    keys.push_back("key" + std::to_string(i));
+  }
+  std::vector<std::string_view> key_views(keys.begin(), keys.end());
+  std::vector<uint64_t> key_hashes;
+  for (auto &key : keys) {
+    key_hashes.push_back(hash64(key));
+  }
+  for (auto &filter : filters) {
+    std::vector<uint8_t> results(keys.size(), 2);
+    filter->possibly_contains_batch(key_views, key_hashes, results.data());
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_EQ(results[i], filter->possibly_contains(keys[i]) ? 1 : 0);
+    }
+  }
+}
+
+// 同一个集合的元素的前缀相同, 不属于任何 namespace 的 key 没有前缀
+TEST(PrefixExtractorTest, RedisNamespaces) {
+  RedisPrefixExtractor extractor;
+  EXPECT_TRUE(extractor.in_domain("REDIS_SET_myset_member1"));
+  EXPECT_EQ(extractor.transform("REDIS_SET_myset_member1"), "REDIS_SET_myset_");
+  EXPECT_EQ(extractor.transform("REDIS_SORTED_SET_z_SCORE_0001"),
+            "REDIS_SORTED_SET_z_");
+  EXPECT_EQ(extractor.transform("REDIS_FIELD_h_f"), "REDIS_FIELD_h_");
+  // 前缀查询的前缀本身也需要位于 domain 中
+  EXPECT_EQ(extractor.transform("REDIS_SORTED_SET_z_ELEM_"),
+            "REDIS_SORTED_SET_z_");
+  EXPECT_FALSE(extractor.in_domain("REDIS_SET_myset"));
+  EXPECT_FALSE(extractor.in_domain("plain_key"));
+
+  EXPECT_EQ(BlockedBloomFilter::build({}, 10)->num_lines(), 1);
+  auto filter = BlockedBloomFilter::build(
+      {Filter::prefix_hash("REDIS_SET_myset_")}, 10);
+  EXPECT_TRUE(filter->possibly_contains_prefix("REDIS_SET_myset_"));
+  EXPECT_FALSE(filter->possibly_contains("REDIS_SET_myset_"));
+
+  FixedPrefixExtractor fixed(4);
+  EXPECT_FALSE(fixed.in_domain("abc"));
+  EXPECT_EQ(fixed.transform("abcdef"), "abcd");
+  EXPECT_EQ(fixed.name(), "fixed:4");
+}
+
+// LZ4 压缩后可以还原, 收益不足或者数据损坏时给出对应的结果
+TEST(CompressionTest, LZ4RoundTrip) {
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 2000; i++) {
+    std::string entry = "key" + std::to_string(i % 37) + "value";
+    data.insert(data.end(), entry.begin(), entry.end());
+  }
+  // 长度远大于偏移的匹配(重叠拷贝)
+  data.insert(data.end(), 5000, 'a');
+
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(compress_block(CompressionType::LZ4, data.data(), data.size(),
+                             compressed));
+  EXPECT_LT(compressed.size(), data.size() / 4);
+  EXPECT_EQ(decompress_block(CompressionType::LZ4, compressed.data(),
+                             compressed.size()),
+            data);
+
+  // 随机数据无法压缩
+  std::mt19937 gen(42);
+  std::vector<uint8_t> random_data(4096);
+  for (auto &byte : random_data) {
+    byte = static_cast<uint8_t>(gen());
+  }
+  EXPECT_FALSE(compress_block(CompressionType::LZ4, random_data.data(),
+                              random_data.size(), compressed));
+  EXPECT_FALSE(compress_block(CompressionType::None, data.data(), data.size(),
+                              compressed));
+
+  ASSERT_TRUE(compress_block(CompressionType::LZ4, data.data(), data.size(),
+                             compressed));
+  compressed.resize(compressed.size() / 2);
+  EXPECT_THROW(decompress_block(CompressionType::LZ4, compressed.data(),
+                                compressed.size()),
+               std::runtime_error);
+}
+
+TEST(Crc32cTest, KnownValueAndExtend) {
+  // crc32c 的标准测试向量
+  EXPECT_EQ(crc32c("123456789", 9), 0xE3069283u);
+  EXPECT_EQ(crc32c("", 0), 0u);
+
+  std::string data;
+  std::mt19937 gen(7);
+  for (int i = 0; i < 1000; i++) {
+    data.push_back(static_cast<char>(gen()));
+  }
+  uint32_t whole = crc32c(data.data(), data.size());
+  // 分段计算的结果与整体计算相同, 覆盖未对齐的开头和结尾
+  for (size_t split : {0, 1, 7, 8, 333, 999, 1000}) {
+    uint32_t crc = crc32c(data.data(), split);
+    EXPECT_EQ(crc32c(data.data() + split, data.size() - split, crc), whole);
+  }
+  data[500] ^= 0x1;
+  EXPECT_NE(crc32c(data.data(), data.size()), whole);
+}
+
+TEST(KeyPrefixTest, OrderAndLowerBound) {
+  // 前缀不同时与 key 的字典序一致, 包括大于 0x7f 的字节和不足 8 个字节的 key
+  std::vector<std::string> keys = {"",         "a",        std::string("a\0", 2),
+                                   "ab",       "abcdefgh", "abcdefgh1",
+                                   "abcdefgi", "\x80",     "\xff\xff"};
+  for (auto &a : keys) {
+    for (auto &b : keys) {
+      int cmp = compare_with_prefix(key_prefix(a), a, key_prefix(b), b);
+      EXPECT_EQ(cmp < 0, a < b) << a << " " << b;
+      EXPECT_EQ(cmp == 0, a == b) << a << " " << b;
+    }
+  }
+  EXPECT_EQ(key_prefix("a"), key_prefix(std::string("a\0", 2)));
+
+  // 覆盖 4 个一组的部分, 剩余的部分, 以及超过线性扫描上限使用二分的情况
+  std::mt19937_64 gen(11);
+  for (size_t n : {0, 1, 3, 4, 7, 64, 65, 300}) {
+    std::vector<uint64_t> prefixes(n);
+    for (auto &prefix : prefixes) {
+      // 包含最高位为 1 的值, 检查无符号比较
+      prefix = gen() % 4 == 0 ? gen() : gen() % 100;
+    }
+    std::sort(prefixes.begin(), prefixes.end());
+    for (int i = 0; i < 100; i++) {
+      uint64_t target = i % 2 == 0 || n == 0 ? gen() : prefixes[gen() % n];
+      EXPECT_EQ(key_prefix_lower_bound(prefixes.data(), n, target),
+                std::lower_bound(prefixes.begin(), prefixes.end(), target) -
+                    prefixes.begin());
+    }
+  }
+}
+
+TEST(RangeTombstoneTest, FragmentAndEncode) {
+  std::vector<RangeTombstone> tombstones = {
+      {"d", "h", 5}, {"a", "e", 3}, {"f", "g", 8}, {"x", "x", 9}};
+  FragmentedRangeTombstones fragmented(tombstones);
+  // 空的范围被丢弃, 其余按 begin 排序
+  ASSERT_EQ(fragmented.tombstones().size(), 3);
+  EXPECT_EQ(fragmented.tombstones().front().begin, "a");
+
+  // [a, d) {3}, [d, e) {5, 3}, [e, f) {5}, [f, g) {8, 5}, [g, h) {5}
+  auto &fragments = fragmented.fragments();
+  ASSERT_EQ(fragments.size(), 5);
+  EXPECT_EQ(fragments[1].begin, "d");
+  EXPECT_EQ(fragments[1].end, "e");
+  EXPECT_EQ(fragments[1].tranc_ids, (std::vector<uint64_t>{5, 3}));
+
+  EXPECT_EQ(fragmented.max_covering("a", 0), 3);
+  EXPECT_EQ(fragmented.max_covering("dd", 0), 5);
+  EXPECT_EQ(fragmented.max_covering("f", 0), 8);
+  // 只有不超过 max_tranc_id 的标记可见
+  EXPECT_EQ(fragmented.max_covering("f", 7), 5);
+  EXPECT_EQ(fragmented.max_covering("f", 4), 0);
+  EXPECT_EQ(fragmented.max_covering("dd", 4), 3);
+  // end 不包含在范围内
+  EXPECT_EQ(fragmented.max_covering("h", 0), 0);
+  EXPECT_EQ(fragmented.max_covering("0", 0), 0);
+  EXPECT_EQ(fragmented.max_covering("x", 0), 0);
+
+  std::vector<uint8_t> encoded;
+  FragmentedRangeTombstones::encode(fragmented.tombstones(), encoded);
+  auto decoded =
+      FragmentedRangeTombstones::decode(encoded.data(), encoded.size());
+  EXPECT_EQ(decoded, fragmented.tombstones());
+  EXPECT_THROW(
+      FragmentedRangeTombstones::decode(encoded.data(), encoded.size() - 1),
+      std::runtime_error);
+}
+
+TEST(StatisticsTest, CountersAndHistogram) {
+  // 桶的范围首尾相接, 且每个值都落在自己的桶内
+  for (uint64_t value : std::vector<uint64_t>{0, 7, 8, 9, 1000, 123456789,
+                                              UINT64_MAX}) {
+    size_t idx = HistogramData::bucket_index(value);
+    ASSERT_LT(idx, HistogramData::kNumBuckets);
+    EXPECT_GE(value, HistogramData::bucket_lower(idx));
+    EXPECT_LE(value - HistogramData::bucket_lower(idx),
+              HistogramData::bucket_width(idx) - 1);
+  }
+  for (size_t idx = 1; idx + 1 < HistogramData::kNumBuckets; idx++) {
+    EXPECT_EQ(HistogramData::bucket_lower(idx - 1) +
+                  HistogramData::bucket_width(idx - 1),
+              HistogramData::bucket_lower(idx));
+  }
+
+  // 多个线程分散到不同的分片上, 读取时汇总
+  Statistics stats;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&stats]() {
+      for (uint64_t i = 1; i <= 1000; i++) {
+        stats.record_tick(Ticker::GetMiss);
+        stats.record(HistogramType::Get, i);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(stats.get_ticker(Ticker::GetMiss), 8000);
+  auto hist = stats.get_histogram(HistogramType::Get);
+  EXPECT_EQ(hist.count, 8000);
+  EXPECT_EQ(hist.min, 1);
+  EXPECT_EQ(hist.max, 1000);
+  EXPECT_DOUBLE_EQ(hist.mean(), 500.5);
+  // 相对误差不超过一个子区间
+  EXPECT_NEAR(hist.percentile(50), 500, 500 / 8.0);
+  EXPECT_NEAR(hist.percentile(99), 990, 990 / 8.0);
+  EXPECT_LE(hist.percentile(100), 1000);
+
+  stats.reset();
+  EXPECT_EQ(stats.get_ticker(Ticker::GetMiss), 0);
+  EXPECT_EQ(stats.get_histogram(HistogramType::Get).count, 0);
+  EXPECT_EQ(stats.get_histogram(HistogramType::Get).percentile(99), 0);
+}
+
+TEST(RateLimiterTest, PriorityAndAutoTune) {
+  RateLimiter limiter(1 << 20, false, 10000);
+  // 低优先级的请求排满队列时, 高优先级的请求仍然在下一次补充时优先满足
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::time_point> low_done(4);
+  std::vector<std::thread> lows;
+  for (int t = 0; t < 4; t++) {
+    lows.emplace_back([&, t]() {
+      limiter.request(200 * 1024, IOPriority::Compaction);
+      low_done[t] = Clock::now();
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  limiter.request(50 * 1024, IOPriority::Flush);
+  auto flush_done = Clock::now();
+  for (auto &low : lows) {
+    low.join();
+  }
+  EXPECT_LT(flush_done, *std::max_element(low_done.begin(), low_done.end()));
+  EXPECT_EQ(limiter.get_total_bytes_through(IOPriority::Compaction),
+            4 * 200 * 1024);
+  EXPECT_GT(limiter.get_total_wait_micros(), 0);
+
+  // 自动调节时速率随积压在 [上限 / ratio, 上限] 之间变化
+  RateLimiter tuned(8 << 20, true);
+  EXPECT_EQ(tuned.get_bytes_per_second(), 8 << 20);
+  EXPECT_EQ(tuned.get_effective_bytes_per_second(),
+            (8 << 20) / LSM_RATE_LIMITER_AUTO_TUNE_RATIO);
+  tuned.update_compaction_debt(1);
+  EXPECT_EQ(tuned.get_effective_bytes_per_second(), 8 << 20);
+  tuned.update_compaction_debt(0);
+  EXPECT_EQ(tuned.get_effective_bytes_per_second(),
+            (8 << 20) / LSM_RATE_LIMITER_AUTO_TUNE_RATIO);
+  // 固定速率的限速器忽略积压
+  limiter.update_compaction_debt(1);
+  EXPECT_EQ(limiter.get_effective_bytes_per_second(), 1 << 20);
+  EXPECT_THROW(RateLimiter(0), std::runtime_error);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
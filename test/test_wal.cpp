@@ -1,8 +1,13 @@
 #include "../include/wal/record.h"
 #include "../include/wal/wal.h"
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
 
 using namespace testing;
 
@@ -153,6 +158,312 @@ TEST_F(WALTest, RecoverTest) {
   }
 }
 
+TEST_F(WALTest, ConcurrentGroupCommit) {
+  const int num_threads = 8;
+  const int trancs_per_thread = 50;
+  {
+    WAL wal(test_dir, 1024, 0, 1, 1024 * 1024);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; i < trancs_per_thread; i++) {
+          uint64_t tranc_id = t * trancs_per_thread + i + 1;
+          std::vector<Record> records;
+          records.push_back(Record::createRecord(tranc_id));
+          records.push_back(Record::putRecord(
+              tranc_id, "key" + std::to_string(tranc_id), "value"));
+          records.push_back(Record::commitRecord(tranc_id));
+          // 每次提交都强制写入, 返回时记录已经在磁盘上
+          wal.log(records, true);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // 每个事务的记录都完整且连续地写入
+  auto tranc_records = WAL::recover(test_dir, 0);
+  EXPECT_EQ(tranc_records.size(), num_threads * trancs_per_thread);
+  for (auto &[tranc_id, records] : tranc_records) {
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[0].getOperationType(), OperationType::CREATE);
+    EXPECT_EQ(records[1].getKey(), "key" + std::to_string(tranc_id));
+    EXPECT_EQ(records[2].getOperationType(), OperationType::COMMIT);
+  }
+}
+
+TEST_F(WALTest, StreamingRecover) {
+  const int num_trancs = 200;
+  {
+    // 文件大小限制很小, 记录会分布在多个 WAL 文件中
+    WAL wal(test_dir, 1024, 0, 1, 256);
+    for (uint64_t tranc_id = 1; tranc_id <= num_trancs; tranc_id++) {
+      std::vector<Record> records;
+      records.push_back(Record::createRecord(tranc_id));
+      records.push_back(Record::putRecord(
+          tranc_id, "key" + std::to_string(tranc_id), "value"));
+      if (tranc_id % 10 == 0) {
+        records.push_back(
+            Record::deleteRecord(tranc_id, "key" + std::to_string(tranc_id)));
+      }
+      if (tranc_id % 7 != 0) {
+        // tranc_id 为 7 的倍数的事务没有提交
+        records.push_back(Record::commitRecord(tranc_id));
+      }
+      wal.log(records, true);
+    }
+  }
+  // 模拟最后一次写入时崩溃, 留下不完整的记录
+  {
+    std::vector<std::pair<uint64_t, std::string>> wal_files;
+    for (auto &entry : std::filesystem::directory_iterator(test_dir)) {
+      auto filename = entry.path().filename().string();
+      wal_files.emplace_back(std::stoull(filename.substr(4)),
+                             entry.path().string());
+    }
+    ASSERT_GT(wal_files.size(), 1);
+    std::sort(wal_files.begin(), wal_files.end());
+    std::vector<uint8_t> torn;
+    Record::encode_batch({Record::createRecord(num_trancs + 1),
+                          Record::putRecord(num_trancs + 1, "torn", "value"),
+                          Record::commitRecord(num_trancs + 1)},
+                         torn);
+    torn.resize(torn.size() / 2);
+    // 覆盖到最后一个 batch 之后, 即预先分配的空白区域的开头
+    auto file = FileObj::open(wal_files.back().second, false);
+    auto bytes = file.read_to_slice(0, file.size());
+    size_t end = WAL::kSegmentHeaderSize;
+    while (end + 3 * sizeof(uint32_t) <= bytes.size()) {
+      uint32_t payload_len, count;
+      memcpy(&payload_len, bytes.data() + end + sizeof(uint32_t),
+             sizeof(uint32_t));
+      memcpy(&count, bytes.data() + end + 2 * sizeof(uint32_t),
+             sizeof(uint32_t));
+      if (count == 0) {
+        break;
+      }
+      end += 3 * sizeof(uint32_t) + payload_len;
+    }
+    ASSERT_TRUE(file.write(end, torn));
+  }
+
+  uint64_t max_flushed_tranc_id = 50;
+  std::vector<std::vector<Record>> batches;
+  auto stats = WAL::recover_streaming(
+      test_dir, max_flushed_tranc_id, 4, 16,
+      [&](std::vector<Record> &records) { batches.push_back(records); });
+
+  // 每个已提交事务的记录完整且连续, 并且按提交顺序出现
+  size_t num_records = 0;
+  uint64_t expected_tranc_id = max_flushed_tranc_id + 1;
+  size_t num_committed = 0;
+  for (auto &batch : batches) {
+    ASSERT_FALSE(batch.empty());
+    EXPECT_EQ(batch.back().getOperationType(), OperationType::COMMIT);
+    num_records += batch.size();
+    size_t i = 0;
+    while (i < batch.size()) {
+      while (expected_tranc_id % 7 == 0) {
+        expected_tranc_id++;
+      }
+      uint64_t tranc_id = expected_tranc_id++;
+      size_t tranc_len = tranc_id % 10 == 0 ? 4 : 3;
+      ASSERT_LE(i + tranc_len, batch.size());
+      EXPECT_EQ(batch[i].getOperationType(), OperationType::CREATE);
+      EXPECT_EQ(batch[i + 1].getKey(), "key" + std::to_string(tranc_id));
+      for (size_t j = 0; j < tranc_len; j++) {
+        EXPECT_EQ(batch[i + j].getTrancId(), tranc_id);
+      }
+      EXPECT_EQ(batch[i + tranc_len - 1].getOperationType(),
+                OperationType::COMMIT);
+      i += tranc_len;
+      num_committed++;
+    }
+  }
+  for (size_t i = 0; i + 1 < batches.size(); i++) {
+    EXPECT_GE(batches[i].size(), 16);
+  }
+  // 51 ~ 200 中去掉 7 的倍数
+  EXPECT_EQ(num_committed, 150 - 21);
+  EXPECT_EQ(stats.num_trancs, num_committed);
+  EXPECT_EQ(stats.num_records, num_records);
+  EXPECT_GT(stats.num_files, 1);
+}
+
+TEST_F(WALTest, SegmentRecycle) {
+  auto count_files = [this](const std::string &preffix) {
+    size_t count = 0;
+    for (auto &entry : std::filesystem::directory_iterator(test_dir)) {
+      count += entry.path().filename().string().starts_with(preffix);
+    }
+    return count;
+  };
+  auto log_trancs = [](WAL &wal, uint64_t begin, uint64_t end) {
+    for (uint64_t tranc_id = begin; tranc_id < end; tranc_id++) {
+      wal.log({Record::createRecord(tranc_id),
+               Record::putRecord(tranc_id, "key" + std::to_string(tranc_id),
+                                 "value" + std::to_string(tranc_id)),
+               Record::commitRecord(tranc_id)},
+              true);
+    }
+  };
+
+  {
+    WAL wal(test_dir, 1024, 0, 1, 256, 2);
+    // 新文件的空间是预先分配的
+    EXPECT_GE(std::filesystem::file_size(test_dir + "/wal.0"), 256);
+    log_trancs(wal, 1, 101);
+    size_t num_segments = count_files("wal.");
+    ASSERT_GT(num_segments, 4);
+
+    // 前 50 个事务已经刷盘, 只包含它们的文件被清零后复用或者删除
+    wal.set_max_finished_tranc_id(50);
+    for (int i = 0; i < 50 && count_files("wal_free.") == 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    EXPECT_EQ(count_files("wal_free."), 2);
+    EXPECT_LT(count_files("wal."), num_segments);
+
+    // 之后切换文件时优先复用空闲文件
+    log_trancs(wal, 101, 121);
+    EXPECT_LT(count_files("wal_free."), 2);
+  }
+
+  // 复用的文件中不会残留旧的记录
+  auto tranc_records = WAL::recover(test_dir, 50);
+  std::set<uint64_t> tranc_ids;
+  for (auto &[tranc_id, records] : tranc_records) {
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[1].getValue(), "value" + std::to_string(tranc_id));
+    tranc_ids.insert(tranc_id);
+  }
+  EXPECT_EQ(tranc_ids.size(), 70);
+  EXPECT_EQ(*tranc_ids.begin(), 51);
+  EXPECT_EQ(*tranc_ids.rbegin(), 120);
+}
+
+TEST_F(WALTest, BatchChecksum) {
+  std::vector<Record> first = {Record::createRecord(1),
+                               Record::putRecord(1, "key1", "value1"),
+                               Record::deleteRecord(1, "key2"),
+                               Record::commitRecord(1)};
+  // 超过 64KB 的 key 和 value 也可以被编码
+  std::vector<Record> second = {
+      Record::createRecord(300),
+      Record::putRecord(300, std::string(70000, 'k'), std::string(100000, 'v')),
+      Record::rollbackRecord(300)};
+  std::vector<uint8_t> encoded;
+  Record::encode_batch(first, encoded);
+  size_t first_size = encoded.size();
+  Record::encode_batch(second, encoded);
+
+  auto records = Record::decode_batches(encoded.data(), encoded.size());
+  ASSERT_EQ(records.size(), first.size() + second.size());
+  for (size_t i = 0; i < first.size(); i++) {
+    EXPECT_EQ(records[i], first[i]);
+  }
+  for (size_t i = 0; i < second.size(); i++) {
+    EXPECT_EQ(records[first.size() + i], second[i]);
+  }
+  EXPECT_EQ(records[first.size() + 1].getValue().size(), 100000);
+
+  // 第二个 batch 损坏后只能恢复第一个 batch
+  encoded[first_size + 20] ^= 0x1;
+  records = Record::decode_batches(encoded.data(), encoded.size());
+  ASSERT_EQ(records.size(), first.size());
+  for (size_t i = 0; i < first.size(); i++) {
+    EXPECT_EQ(records[i], first[i]);
+  }
+
+  // 第一个 batch 写入不完整时什么都不恢复
+  EXPECT_TRUE(Record::decode_batches(encoded.data(), first_size - 1).empty());
+}
+
+// 升级前按记录编码的 WAL 文件没有标记, 恢复时仍然可以读取
+TEST_F(WALTest, LegacySegmentRecover) {
+  std::vector<Record> records = {Record::createRecord(7),
+                                 Record::putRecord(7, "key", "value"),
+                                 Record::deleteRecord(7, "old"),
+                                 Record::commitRecord(7)};
+  std::vector<uint8_t> legacy;
+  auto put_u16 = [&legacy](uint16_t v) {
+    legacy.insert(legacy.end(), reinterpret_cast<uint8_t *>(&v),
+                  reinterpret_cast<uint8_t *>(&v) + sizeof(v));
+  };
+  for (auto &record : records) {
+    auto type = record.getOperationType();
+    auto key = record.getKey();
+    auto value = record.getValue();
+    size_t len = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
+    if (type == OperationType::PUT || type == OperationType::DELETE) {
+      len += sizeof(uint16_t) + key.size();
+    }
+    if (type == OperationType::PUT) {
+      len += sizeof(uint16_t) + value.size();
+    }
+    put_u16(len);
+    uint64_t tranc_id = record.getTrancId();
+    legacy.insert(legacy.end(), reinterpret_cast<uint8_t *>(&tranc_id),
+                  reinterpret_cast<uint8_t *>(&tranc_id) + sizeof(tranc_id));
+    legacy.push_back(static_cast<uint8_t>(type));
+    if (type == OperationType::PUT || type == OperationType::DELETE) {
+      put_u16(key.size());
+      legacy.insert(legacy.end(), key.begin(), key.end());
+    }
+    if (type == OperationType::PUT) {
+      put_u16(value.size());
+      legacy.insert(legacy.end(), value.begin(), value.end());
+    }
+  }
+  // 预先分配的空白区域
+  legacy.resize(legacy.size() + 64, 0);
+  auto file = FileObj::open(test_dir + "/wal.0", true);
+  ASSERT_TRUE(file.write(0, legacy));
+  ASSERT_TRUE(file.sync());
+
+  auto tranc_records = WAL::recover(test_dir, 0);
+  ASSERT_EQ(tranc_records.size(), 1);
+  EXPECT_EQ(tranc_records[7], records);
+
+  // 新写入的文件带有标记, 同样可以恢复
+  std::filesystem::remove(test_dir + "/wal.0");
+  {
+    WAL wal(test_dir, 1024, 0, 1, 4096);
+    wal.log(records, true);
+  }
+  tranc_records = WAL::recover(test_dir, 0);
+  EXPECT_EQ(tranc_records[7], records);
+}
+
+// 非默认列族的记录额外编码 cf_id, 默认列族的编码不变
+TEST_F(WALTest, ColumnFamilyRecord) {
+  std::vector<Record> records = {Record::createRecord(1),
+                                 Record::putRecord(1, "key", "value"),
+                                 Record::putRecord(1, "key", "value2"),
+                                 Record::deleteRecord(1, "key"),
+                                 Record::commitRecord(1)};
+  std::vector<uint8_t> plain;
+  Record::encode_batch(records, plain);
+  records[2].setColumnFamilyId(3);
+  records[3].setColumnFamilyId(300);
+  std::vector<uint8_t> encoded;
+  Record::encode_batch(records, encoded);
+  EXPECT_EQ(encoded.size(), plain.size() + 3);
+
+  auto decoded = Record::decode_batches(encoded.data(), encoded.size());
+  ASSERT_EQ(decoded.size(), records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(decoded[i], records[i]);
+  }
+  EXPECT_EQ(decoded[1].getColumnFamilyId(), 0);
+  EXPECT_EQ(decoded[2].getColumnFamilyId(), 3);
+  EXPECT_EQ(decoded[3].getColumnFamilyId(), 300);
+  EXPECT_EQ(decoded[3].getOperationType(), OperationType::DELETE);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
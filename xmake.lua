@@ -5,6 +5,7 @@ set_languages("c++20")
 
 add_rules("mode.debug", "mode.release")
 add_requires("gtest") -- 添加gtest依赖
+add_requires("benchmark") -- 性能测试使用 google benchmark
 -- 添加Muduo库
 add_requires("muduo")
 add_requires("pybind11")
@@ -13,11 +14,52 @@ if is_mode("debug") then
     add_defines("LSM_DEBUG")
 end
 
+-- 文件后端: 默认使用 pread/pwrite/fdatasync, 开启后使用 std::fstream
+option("std_file")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Use std::fstream as the file backend")
+option_end()
+
+if has_config("std_file") then
+    add_defines("LSM_USE_STD_FILE")
+end
+
+-- sst block 压缩: LZ4 为内置实现, 开启后底层的 sst 使用 Zstd 压缩
+option("zstd")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compress bottom level SST blocks with zstd")
+option_end()
+
+if has_config("zstd") then
+    add_requires("zstd")
+    add_defines("LSM_HAS_ZSTD")
+end
+
+-- 批量读取: 开启后 MultiGet 缺失的 sst block 通过 io_uring 一次提交
+option("io_uring")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Submit batched SST block reads through io_uring")
+option_end()
+
+if has_config("io_uring") then
+    add_requires("liburing")
+    add_defines("LSM_HAS_IO_URING")
+end
+
 
 target("utils")
     set_kind("static")  -- 生成静态库
     add_files("src/utils/*.cpp")
     add_includedirs("include", {public = true})
+    if has_config("zstd") then
+        add_packages("zstd", {public = true})
+    end
+    if has_config("io_uring") then
+        add_packages("liburing", {public = true})
+    end
 
 target("iterator")
     set_kind("static")  -- 生成静态库
@@ -26,6 +68,7 @@ target("iterator")
 
 target("skiplist")
     set_kind("static")  -- 生成静态库
+    add_deps("utils")  -- 跳表节点分配自 utils 中的 Arena
     add_files("src/skiplist/*.cpp")
     add_includedirs("include", {public = true})
 
@@ -38,6 +81,7 @@ target("memtable")
 
 target("block")
     set_kind("static")  -- 生成静态库
+    add_deps("utils")
     add_files("src/block/*.cpp")
     add_includedirs("include", {public = true})
 
@@ -70,6 +114,12 @@ target("lsm_shared")
     set_kind("shared")
     add_files("src/**.cpp")
     add_includedirs("include", {public = true})
+    if has_config("zstd") then
+        add_packages("zstd")
+    end
+    if has_config("io_uring") then
+        add_packages("liburing")
+    end
     set_targetdir("$(buildir)/lib")
 
     -- 安装头文件和动态链接库
@@ -145,9 +195,10 @@ target("test_compact")
 target("test_redis")
     set_kind("binary")
     add_files("test/test_redis.cpp")
+    add_files("server/src/handler.cpp")  -- 测试命令处理函数返回的 RESP
     add_deps("redis", "memtable", "iterator")  -- Added memtable and iterator dependencies
     add_includedirs("include")
-    add_packages("gtest")
+    add_packages("gtest", "muduo")
 
 target("test_wal")
     set_kind("binary")
@@ -156,6 +207,56 @@ target("test_wal")
     add_includedirs("include")
     add_packages("gtest")
 
+-- 定义性能测试, 需要在 release 模式下运行: xmake f -m release && xmake build -g bench
+target("bench_skiplist")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/bench_skiplist.cpp")
+    add_deps("skiplist")
+    add_packages("benchmark")
+    add_includedirs("include")
+
+target("bench_block")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/bench_block.cpp")
+    add_deps("block")
+    add_packages("benchmark")
+    add_includedirs("include")
+
+target("bench_utils")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/bench_utils.cpp")
+    add_deps("utils")
+    add_packages("benchmark")
+    add_includedirs("include")
+
+target("bench_wal")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/bench_wal.cpp")
+    add_deps("wal")
+    add_packages("benchmark")
+    add_includedirs("include")
+
+target("bench_compact")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/bench_compact.cpp")
+    add_deps("lsm")
+    add_packages("benchmark")
+    add_includedirs("include")
+
+-- db_bench 风格的整体测试, 不依赖 google benchmark
+target("db_bench")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/db_bench.cpp")
+    add_deps("lsm", "memtable", "iterator")
+    add_includedirs("include")
+    set_targetdir("$(buildir)/bin")
+
 -- 定义 示例
 target("example")
     set_kind("binary")
@@ -181,6 +282,15 @@ target("server")
     add_packages("muduo")
     set_targetdir("$(buildir)/bin")
 
+-- YCSB 工作负载, 可以测试嵌入的引擎或者通过 RESP 协议测试 server
+target("ycsb")
+    set_kind("binary")
+    set_group("bench")
+    add_files("bench/ycsb.cpp")
+    add_deps("lsm", "memtable", "iterator")
+    add_includedirs("include")
+    set_targetdir("$(buildir)/bin")
+
 target("lsm_pybind")
     set_kind("shared")
     add_files("sdk/lsm_pybind.cpp")